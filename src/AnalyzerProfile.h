@@ -0,0 +1,89 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef analyzerprofile_h
+#define analyzerprofile_h
+
+#include <time.h>
+
+#include "util.h"
+
+// Number of values created so far; see Val.h.
+extern uint64 num_vals_created;
+
+// Resource usage of all analyzers of one type, protocol or file, collected
+// while analyzer_profiling is on.
+class AnalyzerProfile {
+public:
+	AnalyzerProfile()	{ Reset(); }
+
+	void Reset()	{ deliveries = bytes = nsecs = vals = 0; }
+
+	uint64 deliveries;	// calls into the analyzers
+	uint64 bytes;		// payload passed in by those calls
+	uint64 nsecs;		// time spent in them, without nested analyzers
+	uint64 vals;		// values created by them, ditto
+};
+
+// Charges the time and values spent during its lifetime to a profile.
+// Scopes nest: what an analyzer passes on to its children (or to the file
+// analyzers) counts for those, not for the analyzer itself.
+class AnalyzerProfileScope {
+public:
+	// With a null profile, this does nothing.
+	AnalyzerProfileScope(AnalyzerProfile* arg_profile, uint64 len)
+		{
+		profile = arg_profile;
+
+		if ( ! profile )
+			return;
+
+		++profile->deliveries;
+		profile->bytes += len;
+
+		parent = current;
+		current = this;
+		nested_nsecs = nested_vals = 0;
+		start_vals = num_vals_created;
+		start = Now();
+		}
+
+	~AnalyzerProfileScope()
+		{
+		if ( ! profile )
+			return;
+
+		uint64 nsecs = Now() - start;
+		uint64 vals = num_vals_created - start_vals;
+
+		profile->nsecs += nsecs - nested_nsecs;
+		profile->vals += vals - nested_vals;
+
+		if ( parent )
+			{
+			parent->nested_nsecs += nsecs;
+			parent->nested_vals += vals;
+			}
+
+		current = parent;
+		}
+
+private:
+	static uint64 Now()
+		{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+		}
+
+	AnalyzerProfile* profile;
+	AnalyzerProfileScope* parent;
+	uint64 start;
+	uint64 start_vals;
+	uint64 nested_nsecs;
+	uint64 nested_vals;
+
+	// The innermost scope.
+	static AnalyzerProfileScope* current;
+};
+
+#endif
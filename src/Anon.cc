@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <sys/time.h>
 
+#include <openssl/evp.h>
+
 #include "util.h"
 #include "net_util.h"
 #include "Anon.h"
@@ -104,14 +106,37 @@ ipaddr32_t AnonymizeIPAddr_RandomMD5::anonymize(ipaddr32_t input)
 //
 // http://www.imconf.net/imw-2001/proceedings.html
 
-ipaddr32_t AnonymizeIPAddr_PrefixMD5::anonymize(ipaddr32_t input)
+ipaddr32_t AnonymizeIPAddr_PrefixPreserving::anonymize(ipaddr32_t input)
+	{
+	input = ntohl(input);
+
+	uint32 net = input >> 8;
+	uint32 flips;
+
+	std::unordered_map<uint32, uint32>::const_iterator i = net_flips.find(net);
+
+	if ( i != net_flips.end() )
+		flips = i->second;
+	else
+		{
+		flips = PrefixFlips(input, 0, 24);
+
+		if ( net_flips.size() >= MAX_MEMOIZED_NETS )
+			net_flips.clear();
+
+		net_flips[net] = flips;
+		}
+
+	return htonl(input ^ flips ^ PrefixFlips(input, 24, 32));
+	}
+
+uint32 AnonymizeIPAddr_PrefixMD5::PrefixFlips(uint32 input, int from, int to)
 	{
 	uint8 digest[16];
 	ipaddr32_t prefix_mask = 0xffffffff;
-	input = ntohl(input);
-	ipaddr32_t output = input;
+	uint32 output = 0;
 
-	for ( int i = 0; i < 32; ++i )
+	for ( int i = from; i < to; ++i )
 		{
 		// PAD(x_0 ... x_{i-1}) = x_0 ... x_{i-1} 1 0 ... 0 .
 		prefix.len = htonl(i + 1);
@@ -127,7 +152,86 @@ ipaddr32_t AnonymizeIPAddr_PrefixMD5::anonymize(ipaddr32_t input)
 		output ^= bit_mask;
 		}
 
-	return htonl(output);
+	return output;
+	}
+
+AnonymizeIPAddr_CryptoPAn::AnonymizeIPAddr_CryptoPAn()
+	{
+	// The 32-byte Crypto-PAn key: an AES key, and the block that the
+	// pad gets encrypted from.
+	static const char* key_labels[2] = { "Crypto-PAn key", "Crypto-PAn pad" };
+	u_char key[32];
+
+	for ( int i = 0; i < 2; ++i )
+		hmac_md5(strlen(key_labels[i]), (const u_char*) key_labels[i],
+			 key + 16 * i);
+
+	ctx = EVP_CIPHER_CTX_new();
+	int len;
+
+	if ( ! ctx ||
+	     ! EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), 0, key, 0) ||
+	     ! EVP_CIPHER_CTX_set_padding(ctx, 0) ||
+	     ! EVP_EncryptUpdate(ctx, pad, &len, key + 16, 16) )
+		{
+		reporter->Error("cannot set up AES for Crypto-PAn address anonymization");
+
+		if ( ctx )
+			EVP_CIPHER_CTX_free(ctx);
+
+		ctx = 0;
+		}
+	}
+
+AnonymizeIPAddr_CryptoPAn::~AnonymizeIPAddr_CryptoPAn()
+	{
+	if ( ctx )
+		EVP_CIPHER_CTX_free(ctx);
+	}
+
+uint32 AnonymizeIPAddr_CryptoPAn::PrefixFlips(uint32 input, int from, int to)
+	{
+	if ( ! ctx )
+		return 0;
+
+	uint32 pad_bits = (uint32(pad[0]) << 24) | (pad[1] << 16) |
+			  (pad[2] << 8) | pad[3];
+
+	// Block i is the pad with the first four bytes replaced by the
+	// address' first i bits, followed by the pad's remaining ones.
+	u_char in[32 * 16];
+	u_char out[32 * 16];
+	int n = to - from;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		int pos = from + i;
+		uint32 mask = first_n_bit_mask(pos);
+		uint32 bits = (input & mask) | (pad_bits & ~mask);
+
+		u_char* b = in + 16 * i;
+		b[0] = bits >> 24;
+		b[1] = bits >> 16;
+		b[2] = bits >> 8;
+		b[3] = bits;
+		memcpy(b + 4, pad + 4, 12);
+		}
+
+	int len;
+
+	if ( ! EVP_EncryptUpdate(ctx, out, &len, in, 16 * n) )
+		{
+		reporter->Error("AES failed for Crypto-PAn address anonymization");
+		return 0;
+		}
+
+	// Each flip is the first bit of the block's encryption.
+	uint32 flips = 0;
+
+	for ( int i = 0; i < n; ++i )
+		flips |= uint32(out[16 * i] >> 7) << (31 - (from + i));
+
+	return flips;
 	}
 
 AnonymizeIPAddr_A50::~AnonymizeIPAddr_A50()
@@ -353,6 +457,7 @@ void init_ip_addr_anonymizers()
 	ip_anonymizer[RANDOM_MD5] = new AnonymizeIPAddr_RandomMD5();
 	ip_anonymizer[PREFIX_PRESERVING_A50] = new AnonymizeIPAddr_A50();
 	ip_anonymizer[PREFIX_PRESERVING_MD5] = new AnonymizeIPAddr_PrefixMD5();
+	ip_anonymizer[PREFIX_PRESERVING_CRYPTOPAN] = new AnonymizeIPAddr_CryptoPAn();
 	}
 
 ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl)
@@ -14,6 +14,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 using namespace std;
 
 #include "Reporter.h"
@@ -34,6 +35,7 @@ enum ip_addr_anonymization_method_t {
 	RANDOM_MD5,
 	PREFIX_PRESERVING_A50,
 	PREFIX_PRESERVING_MD5,
+	PREFIX_PRESERVING_CRYPTOPAN,
 	NUM_ADDR_ANONYMIZATION_METHODS,
 };
 
@@ -77,17 +79,50 @@ public:
 	ipaddr32_t anonymize(ipaddr32_t addr);
 };
 
-class AnonymizeIPAddr_PrefixMD5 : public AnonymizeIPAddr {
+// Base class for the schemes that flip each bit of an address depending on
+// a keyed function of the bits before it. The flips of an address' first
+// 24 bits then only depend on its /24, so they get computed once per /24.
+class AnonymizeIPAddr_PrefixPreserving : public AnonymizeIPAddr {
 public:
 	ipaddr32_t anonymize(ipaddr32_t addr);
 
+	// How many /24s to remember at most, before starting over.
+	static const size_t MAX_MEMOIZED_NETS = 65536;
+
+protected:
+	// Returns the bits to flip for positions [from, to) of an address,
+	// in host order, counting from the most significant bit.
+	virtual uint32 PrefixFlips(uint32 input, int from, int to) = 0;
+
+	std::unordered_map<uint32, uint32> net_flips;	// by /24
+};
+
+class AnonymizeIPAddr_PrefixMD5 : public AnonymizeIPAddr_PrefixPreserving {
 protected:
+	uint32 PrefixFlips(uint32 input, int from, int to) override;
+
 	struct anon_prefix {
 		int len;
 		ipaddr32_t prefix;
 	} prefix;
 };
 
+// Crypto-PAn (Fan et al., "Prefix-preserving IP address anonymization",
+// Computer Networks 46(2), 2004), keyed from the HMAC key. All of an
+// address' AES blocks go through the cipher in one call, letting OpenSSL
+// use AES-NI or other pipelined code where it has it.
+class AnonymizeIPAddr_CryptoPAn : public AnonymizeIPAddr_PrefixPreserving {
+public:
+	AnonymizeIPAddr_CryptoPAn();
+	~AnonymizeIPAddr_CryptoPAn();
+
+protected:
+	uint32 PrefixFlips(uint32 input, int from, int to) override;
+
+	struct evp_cipher_ctx_st* ctx;	// null if OpenSSL failed us
+	u_char pad[16];
+};
+
 class AnonymizeIPAddr_A50 : public AnonymizeIPAddr {
 public:
 	AnonymizeIPAddr_A50()	{ init(); }
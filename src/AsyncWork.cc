@@ -0,0 +1,235 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <signal.h>
+
+#include "AsyncWork.h"
+#include "Frame.h"
+#include "Metrics.h"
+#include "NetVar.h"
+#include "Reporter.h"
+#include "Trigger.h"
+#include "iosource/Manager.h"
+
+static AsyncWorkPool* async_work_pool = 0;
+static bool async_work_pool_failed = false;
+
+static double jobs_outstanding()
+	{
+	return async_work_pool ? async_work_pool->Outstanding() : 0;
+	}
+
+static metrics::Histogram* job_latency()
+	{
+	static metrics::Histogram* h = 0;
+
+	if ( ! h )
+		{
+		std::vector<uint64> bounds;
+
+		for ( uint64 b = 100; b <= 10000000; b *= 10 )
+			bounds.push_back(b);
+
+		h = metrics::registry()->NewHistogram("async_bifs.latency_usec",
+			"Time from queueing BiF work until its result is back, in microseconds.",
+			bounds);
+		}
+
+	return h;
+	}
+
+AsyncWorkPool* AsyncWorkPool::Instance()
+	{
+	if ( async_work_pool || async_work_pool_failed || async_bif_threads <= 0 )
+		return async_work_pool;
+
+	AsyncWorkPool* p = new AsyncWorkPool();
+
+	if ( ! p->Start(async_bif_threads) )
+		{
+		reporter->Error("cannot create threads for BiF work, doing it directly");
+		delete p;
+		async_work_pool_failed = true;
+		return 0;
+		}
+
+	async_work_pool = p;
+	iosource_mgr->Register(p, true);
+
+	metrics::registry()->NewCallbackGauge("async_bifs.outstanding",
+					      "BiF work queued or running on its threads.",
+					      jobs_outstanding);
+
+	return async_work_pool;
+	}
+
+AsyncWorkPool* AsyncWorkPool::ForInput(Frame* frame, uint64 bytes)
+	{
+	if ( ! frame->GetTrigger() || bytes < async_bif_min_bytes )
+		return 0;
+
+	return Instance();
+	}
+
+AsyncWorkPool::AsyncWorkPool()
+	{
+	outstanding = 0;
+	stopping = false;
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&has_work, 0);
+
+	SetIdle(true);
+	}
+
+AsyncWorkPool::~AsyncWorkPool()
+	{
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&has_work);
+	pthread_mutex_unlock(&mutex);
+
+	for ( size_t i = 0; i < threads.size(); ++i )
+		pthread_join(threads[i], 0);
+
+	for ( std::deque<AsyncJob*>::iterator i = todo.begin(); i != todo.end(); ++i )
+		{
+		Unref((*i)->trigger);
+		delete *i;
+		}
+
+	for ( std::vector<AsyncJob*>::iterator i = done.begin(); i != done.end(); ++i )
+		{
+		Unref((*i)->trigger);
+		delete *i;
+		}
+
+	if ( async_work_pool == this )
+		async_work_pool = 0;
+
+	pthread_cond_destroy(&has_work);
+	pthread_mutex_destroy(&mutex);
+	}
+
+bool AsyncWorkPool::Start(int num_threads)
+	{
+	for ( int i = 0; i < num_threads; ++i )
+		{
+		pthread_t t;
+
+		if ( pthread_create(&t, 0, Launcher, this) != 0 )
+			return i > 0;
+
+		threads.push_back(t);
+		}
+
+	return true;
+	}
+
+void* AsyncWorkPool::Launcher(void* arg)
+	{
+	// Signals are for the main thread to handle, except for those which
+	// POSIX leaves undefined when blocked.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	((AsyncWorkPool*) arg)->Run();
+	return 0;
+	}
+
+void AsyncWorkPool::Submit(Frame* frame, AsyncJob* job)
+	{
+	Trigger* trigger = frame->GetTrigger();
+	frame->SetDelayed();
+	trigger->Hold();
+
+	Ref(trigger);
+	job->trigger = trigger;
+	job->call = frame->GetCall();
+	job->queued = current_time();
+	++outstanding;
+
+	pthread_mutex_lock(&mutex);
+	todo.push_back(job);
+	pthread_cond_signal(&has_work);
+	pthread_mutex_unlock(&mutex);
+	}
+
+void AsyncWorkPool::Run()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( true )
+		{
+		while ( todo.empty() && ! stopping )
+			pthread_cond_wait(&has_work, &mutex);
+
+		if ( stopping )
+			break;
+
+		AsyncJob* job = todo.front();
+		todo.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		job->Work();
+
+		pthread_mutex_lock(&mutex);
+
+		if ( done.empty() )
+			done_flare.Fire();
+
+		done.push_back(job);
+		}
+
+	pthread_mutex_unlock(&mutex);
+	}
+
+void AsyncWorkPool::GetFds(iosource::FD_Set* read, iosource::FD_Set* write,
+			   iosource::FD_Set* except)
+	{
+	read->Insert(done_flare.FD());
+	}
+
+double AsyncWorkPool::NextTimestamp(double* network_time)
+	{
+	pthread_mutex_lock(&mutex);
+	bool have_done = ! done.empty();
+	pthread_mutex_unlock(&mutex);
+
+	// Like with DNS results, there's no rush before network time starts.
+	return have_done ? timer_mgr->Time() : -1.0;
+	}
+
+void AsyncWorkPool::Process()
+	{
+	std::vector<AsyncJob*> finished;
+
+	pthread_mutex_lock(&mutex);
+	finished.swap(done);
+	done_flare.Extinguish();
+	pthread_mutex_unlock(&mutex);
+
+	double now = current_time();
+	metrics::Histogram* latency = job_latency();
+
+	for ( std::vector<AsyncJob*>::iterator i = finished.begin(); i != finished.end(); ++i )
+		{
+		AsyncJob* job = *i;
+		Val* result = job->Result();
+
+		job->trigger->Cache(job->call, result);
+		Unref(result);
+		job->trigger->Release();
+		Unref(job->trigger);
+
+		latency->Observe(uint64((now - job->queued) * 1e6));
+		--outstanding;
+		delete job;
+		}
+	}
@@ -0,0 +1,122 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef asyncwork_h
+#define asyncwork_h
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "util.h"
+#include "Flare.h"
+#include "iosource/IOSource.h"
+
+class CallExpr;
+class Frame;
+class Trigger;
+class Val;
+
+/**
+ * A computation that a BiF hands off to the AsyncWorkPool, so that it
+ * doesn't hold up the main thread. Work() runs on one of the pool's
+ * threads, and may only use what the job copied for itself: no Vals, and
+ * nothing else of the main thread's. Then, back on the main thread,
+ * Result() becomes the value of the BiF call in the ``when`` condition
+ * that made it.
+ */
+class AsyncJob {
+public:
+	AsyncJob()	{ trigger = 0; call = 0; queued = 0; }
+	virtual ~AsyncJob()	{ }
+
+	/**
+	 * Does the work, on a pool thread.
+	 */
+	virtual void Work() = 0;
+
+	/**
+	 * Returns the BiF's result after Work() finished, on the main thread.
+	 * The caller takes ownership.
+	 */
+	virtual Val* Result() = 0;
+
+private:
+	friend class AsyncWorkPool;
+
+	Trigger* trigger;
+	const CallExpr* call;
+	double queued;	// when it got queued, in real time
+};
+
+/**
+ * The threads running AsyncJobs. BiFs that may take long queue a job
+ * when a ``when`` condition calls them, the way lookup_addr() waits for
+ * DNS, and the condition gets evaluated again once the result is there.
+ * Finished jobs light a flare that wakes up the main loop.
+ */
+class AsyncWorkPool : public iosource::IOSource {
+public:
+	/**
+	 * Returns the pool, starting it on first use. Returns null if BiFs
+	 * should do their work themselves, because async_bif_threads is
+	 * zero or the threads couldn't be started.
+	 */
+	static AsyncWorkPool* Instance();
+
+	/**
+	 * Destructor. Waits for the jobs that are running, and drops the
+	 * others.
+	 */
+	~AsyncWorkPool();
+
+	/**
+	 * Returns the pool if a BiF should hand off its work: if it got
+	 * called from a ``when`` condition, and its input has at least
+	 * async_bif_min_bytes. Returns null otherwise.
+	 *
+	 * @param frame The BiF's frame.
+	 *
+	 * @param bytes The size of the BiF's input.
+	 */
+	static AsyncWorkPool* ForInput(Frame* frame, uint64 bytes);
+
+	/**
+	 * Queues a job and delays the result of the BiF call that it's for,
+	 * which then needs to return null. Takes ownership of the job.
+	 *
+	 * @param frame The BiF's frame.
+	 */
+	void Submit(Frame* frame, AsyncJob* job);
+
+	/**
+	 * Returns the number of jobs that haven't finished yet.
+	 */
+	uint64 Outstanding() const	{ return outstanding; }
+
+	virtual void GetFds(iosource::FD_Set* read, iosource::FD_Set* write,
+			    iosource::FD_Set* except);
+	virtual double NextTimestamp(double* network_time);
+	virtual void Process();
+	virtual const char* Tag()	{ return "AsyncWorkPool"; }
+
+private:
+	AsyncWorkPool();
+
+	bool Start(int num_threads);
+
+	static void* Launcher(void* arg);
+
+	void Run();
+
+	std::deque<AsyncJob*> todo;
+	std::vector<AsyncJob*> done;
+	uint64 outstanding;	// used by the main thread only
+
+	pthread_mutex_t mutex;	// protects todo and done
+	pthread_cond_t has_work;
+	bool stopping;
+	bro::Flare done_flare;	// lit while done isn't empty
+	std::vector<pthread_t> threads;
+};
+
+#endif
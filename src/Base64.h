@@ -65,6 +65,7 @@ protected:
 	int base64_after_padding;
 	int* base64_table;
 	int errored;	// if true, we encountered an error - skip further processing
+	bool simd_decode;	// if true, decode blocks of regular characters with SSSE3
 	Connection* conn;
 
 };
@@ -17,9 +17,10 @@ class HashKey;
 declare(PList,HashKey);
 typedef PList(HashKey) hash_key_list;
 
+// Lists of values mostly are short ones, like event arguments, which the
+// inline entries spare an allocation.
 class Val;
-declare(PList,Val);
-typedef PList(Val) val_list;
+typedef InlineList<Val*> val_list;
 
 class Stmt;
 declare(PList,Stmt);
@@ -2,7 +2,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <assert.h>
 
@@ -10,12 +13,47 @@
 #include <openssl/err.h>
 
 #include <algorithm>
+#include <atomic>
 
 #include "bro-config.h"
 #include "ChunkedIO.h"
 #include "NetVar.h"
 #include "RemoteSerializer.h"
 
+// Shared data starts with a count of the chunks pointing to it.
+struct SharedChunkHdr {
+	uint32 refs;
+	uint32 pad;	// keeps the data aligned
+};
+
+void ChunkedIO::Chunk::free_func_shared(char* data)
+	{
+	SharedChunkHdr* hdr = (SharedChunkHdr*) (data - sizeof(SharedChunkHdr));
+
+	if ( --hdr->refs == 0 )
+		delete [] (char*) hdr;
+	}
+
+ChunkedIO::Chunk* ChunkedIO::Chunk::Share()
+	{
+	if ( free_func != free_func_shared )
+		{
+		// Once, we move the data to where it can carry the count.
+		char* buf = new char[sizeof(SharedChunkHdr) + len];
+		SharedChunkHdr* hdr = (SharedChunkHdr*) buf;
+		hdr->refs = 1;
+		hdr->pad = 0;
+		memcpy(buf + sizeof(SharedChunkHdr), data, len);
+
+		free_func(data);
+		data = buf + sizeof(SharedChunkHdr);
+		free_func = free_func_shared;
+		}
+
+	++((SharedChunkHdr*) (data - sizeof(SharedChunkHdr)))->refs;
+	return new Chunk(data, len, free_func_shared);
+	}
+
 ChunkedIO::ChunkedIO() : stats(), tag(), pure()
 	{
 	}
@@ -118,6 +156,7 @@ ChunkedIOFd::ChunkedIOFd(int arg_fd, const char* arg_tag, pid_t arg_pid)
 
 	pending_head = 0;
 	pending_tail = 0;
+	pending_pos = 0;
 
 	pid = arg_pid;
 	}
@@ -144,50 +183,54 @@ bool ChunkedIOFd::Write(Chunk* chunk)
 #endif
 
 	if ( chunk->len <= BUFFER_SIZE - sizeof(uint32) )
-		return WriteChunk(chunk, false);
+		return WriteChunk(chunk);
 
-	// We have to split it up.
+	// We have to split it up. The parts point into the chunk's data,
+	// and the last one takes care of deleting it.
 	char* p = chunk->data;
 	uint32 left = chunk->len;
 
 	while ( left )
 		{
 		uint32 sz = min<uint32>(BUFFER_SIZE - sizeof(uint32), left);
-		Chunk* part = new Chunk(new char[sz], sz);
+		left -= sz;
 
-		memcpy(part->data, p, part->len);
-		left -= part->len;
-		p += part->len;
-
-		if ( ! WriteChunk(part, left != 0) )
-			return false;
+		++stats.chunks_written;
+		QueueChunk(left ? 0 : chunk, p, left ? sz | FLAG_PARTIAL : sz);
+		p += sz;
 		}
 
-	delete chunk;
-	return true;
+	return Flush();
 	}
 
-bool ChunkedIOFd::WriteChunk(Chunk* chunk, bool partial)
+bool ChunkedIOFd::WriteChunk(Chunk* chunk)
 	{
 	assert(chunk->len <= BUFFER_SIZE - sizeof(uint32) );
 
 	if ( chunk->len == 0 )
 		InternalError("attempt to write 0 bytes chunk");
 
-	if ( partial )
-		chunk->len |= FLAG_PARTIAL;
-
 	++stats.chunks_written;
 
-	// If it fits into the buffer, we're done (but keep care not
-	// to reorder chunks).
-	if ( ! pending_head && PutIntoWriteBuffer(chunk) )
+	// If it's small and fits into the buffer, we're done (but keep care
+	// not to reorder chunks).
+	if ( ! pending_head && chunk->len <= COPY_THRESHOLD &&
+	     PutIntoWriteBuffer(chunk) )
 		return true;
 
 	// Otherwise queue it.
+	QueueChunk(chunk, chunk->data, chunk->len);
+	return Flush();
+	}
+
+void ChunkedIOFd::QueueChunk(Chunk* owner, char* data, uint32 len)
+	{
 	++stats.pending;
 	ChunkQueue* q = new ChunkQueue;
-	q->chunk = chunk;
+	q->chunk = owner;
+	q->data = data;
+	q->len = len;
+	q->nlen = htonl(len);
 	q->next = 0;
 
 	if ( pending_tail )
@@ -199,10 +242,8 @@ bool ChunkedIOFd::WriteChunk(Chunk* chunk, bool partial)
 		pending_head = pending_tail = q;
 
 	write_flare.Fire();
-	return Flush();
 	}
 
-
 bool ChunkedIOFd::PutIntoWriteBuffer(Chunk* chunk)
 	{
 	uint32 len = chunk->len & ~FLAG_PARTIAL;
@@ -233,11 +274,43 @@ bool ChunkedIOFd::FlushWriteBuffer()
 	{
 	last_flush = network_time;
 
-	while ( write_pos != write_len )
+	// Write the buffer and the queued chunks with as few calls as
+	// possible.
+	while ( write_pos != write_len || pending_head )
 		{
-		uint32 len = write_len - write_pos;
+		struct iovec iov[MAX_IOVECS];
+		int n = 0;
+		uint32 len = 0;
+
+		if ( write_pos != write_len )
+			{
+			iov[n].iov_base = write_buffer + write_pos;
+			iov[n].iov_len = write_len - write_pos;
+			len += iov[n++].iov_len;
+			}
+
+		for ( ChunkQueue* q = pending_head; q && n < MAX_IOVECS - 1 &&
+		      len < BUFFER_SIZE; q = q->next )
+			{
+			uint32 skip = (q == pending_head ? pending_pos : 0);
+			uint32 hlen = IsPure() ? 0 : sizeof(q->nlen);
+
+			if ( skip < hlen )
+				{
+				iov[n].iov_base = (char*) &q->nlen + skip;
+				iov[n].iov_len = hlen - skip;
+				len += iov[n++].iov_len;
+				skip = 0;
+				}
+			else
+				skip -= hlen;
 
-		int written = write(fd, write_buffer + write_pos, len);
+			iov[n].iov_base = q->data + skip;
+			iov[n].iov_len = (q->len & ~FLAG_PARTIAL) - skip;
+			len += iov[n++].iov_len;
+			}
+
+		int written = writev(fd, iov, n);
 
 		if ( written < 0 )
 			{
@@ -248,70 +321,79 @@ bool ChunkedIOFd::FlushWriteBuffer()
 				// These errnos are equal on POSIX.
 				return errno == EWOULDBLOCK || errno == EAGAIN;
 
-			else
-				written = 0;
+			continue;
 			}
 
 		stats.bytes_written += written;
 		if ( written > 0 )
 			++stats.writes;
 
-		if ( unsigned(written) == len )
-			{
-			write_pos = write_len = 0;
-
-			if ( ! pending_head )
-				write_flare.Extinguish();
-
-			return true;
-			}
-
 		if ( written == 0 )
 			InternalError("written==0");
 
-		// Short write.
-		write_pos += written;
+		ConsumeWritten(written);
+
+		// Short write, try the rest again.
 		}
 
+	write_flare.Extinguish();
 	return true;
 	}
 
-bool ChunkedIOFd::OptionalFlush()
+void ChunkedIOFd::ConsumeWritten(uint32 len)
 	{
-	// This threshhold is quite arbitrary.
-//	if ( current_time() - last_flush > 0.01 )
-	return Flush();
-	}
+	uint32 buffered = write_len - write_pos;
 
-bool ChunkedIOFd::Flush()
-	{
-	// Try to write data out.
-	while ( pending_head )
+	if ( len < buffered )
 		{
-		if ( ! FlushWriteBuffer() )
-			return false;
+		write_pos += len;
+		return;
+		}
 
-		// If we couldn't write the whole buffer, we stop here
-		// and try again next time.
-		if ( write_len > 0 )
-			return true;
+	len -= buffered;
+	write_pos = write_len = 0;
+
+	while ( len && pending_head )
+		{
+		uint32 left = (IsPure() ? 0 : sizeof(pending_head->nlen)) +
+			(pending_head->len & ~FLAG_PARTIAL) - pending_pos;
 
-		// Put as many pending chunks into the buffer as possible.
-		while ( pending_head )
+		if ( len < left )
 			{
-			if ( ! PutIntoWriteBuffer(pending_head->chunk) )
-				break;
+			pending_pos += len;
+			return;
+			}
 
-			ChunkQueue* q = pending_head;
-			pending_head = pending_head->next;
-			if ( ! pending_head )
-				pending_tail = 0;
+		len -= left;
+		pending_pos = 0;
 
-			--stats.pending;
-			delete q;
-			}
+		ChunkQueue* q = pending_head;
+		pending_head = pending_head->next;
+		if ( ! pending_head )
+			pending_tail = 0;
+
+		--stats.pending;
+		delete q->chunk;
+		delete q;
 		}
+	}
+
+bool ChunkedIOFd::OptionalFlush()
+	{
+	// Nothing to do if nothing's waiting; that's the common case with
+	// the frequent calls from the read side.
+	if ( write_pos == write_len && ! pending_head )
+		return true;
+
+	// This threshhold is quite arbitrary.
+//	if ( current_time() - last_flush > 0.01 )
+	return Flush();
+	}
 
+bool ChunkedIOFd::Flush()
+	{
+	// Try to write data out. If we can't write everything, we try
+	// again next time.
 	bool rval = FlushWriteBuffer();
 
 	if ( ! pending_head && write_len == 0 )
@@ -637,6 +719,7 @@ void ChunkedIOFd::Clear()
 		}
 
 	pending_head = pending_tail = 0;
+	pending_pos = 0;
 
 	if ( write_len == 0 )
 		write_flare.Extinguish();
@@ -1177,6 +1260,490 @@ void ChunkedIOSSL::Stats(char* buffer, int length)
 	ChunkedIO::Stats(buffer + i, length - i);
 	}
 
+// Layout of the shared memory: the header, followed by the data of the
+// creator's outgoing ring, followed by that of the other one. Positions
+// only ever grow; the data is at position modulo the ring's size.
+struct ChunkedIOShm::Ring {
+	std::atomic<uint64> head;	// next to read, written by the reader
+	char pad1[64 - sizeof(std::atomic<uint64>)];
+	std::atomic<uint64> tail;	// next to write, written by the writer
+	char pad2[64 - sizeof(std::atomic<uint64>)];
+	std::atomic<uint32> reader_waiting;
+	std::atomic<uint32> writer_waiting;
+	char pad3[64 - 2 * sizeof(std::atomic<uint32>)];
+};
+
+struct ChunkedIOShm::Header {
+	char magic[8];
+	uint32 size;
+	uint32 pad[13];
+	Ring rings[2];
+};
+
+static const char shm_magic[8] = { 'B', 'R', 'O', 'S', 'H', 'M', '1', '\0' };
+
+ChunkedIOShm::ChunkedIOShm(const char* arg_path, uint32 arg_size)
+	{
+	path = arg_path;
+	create = (arg_size != 0);
+	unlinked = false;
+	error = 0;
+
+	base = 0;
+	mapped_len = 0;
+	in = out = 0;
+	in_data = out_data = 0;
+
+	// The rings' sizes are powers of two, so that positions map to
+	// offsets nicely even after they wrap around.
+	size = 65536;
+
+	while ( size < arg_size && size < (1U << 30) )
+		size <<= 1;
+
+	io = 0;
+	reads = writes = false;
+	eof = false;
+	pending_pos = 0;
+	}
+
+ChunkedIOShm::~ChunkedIOShm()
+	{
+	Clear();
+
+	if ( create && ! unlinked && base )
+		unlink(path.c_str());
+
+	if ( base )
+		munmap(base, mapped_len);
+
+	delete io;
+	}
+
+bool ChunkedIOShm::Init()
+	{
+	int fd;
+
+	if ( create )
+		{
+		path += "/bro-shm-XXXXXX";
+		fd = mkstemp(&path[0]);
+
+		if ( fd < 0 )
+			{
+			error = strerror(errno);
+			return false;
+			}
+
+		mapped_len = sizeof(Header) + 2 * size;
+
+		if ( ftruncate(fd, mapped_len) < 0 )
+			{
+			error = strerror(errno);
+			close(fd);
+			unlink(path.c_str());
+			unlinked = true;
+			return false;
+			}
+		}
+
+	else
+		{
+		fd = open(path.c_str(), O_RDWR);
+
+		if ( fd < 0 )
+			{
+			error = strerror(errno);
+			return false;
+			}
+
+		struct stat st;
+
+		if ( fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(Header) )
+			{
+			error = "shared memory file too small";
+			close(fd);
+			return false;
+			}
+
+		mapped_len = st.st_size;
+		}
+
+	void* m = mmap(0, mapped_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( m == MAP_FAILED )
+		{
+		error = strerror(errno);
+
+		if ( create )
+			{
+			unlink(path.c_str());
+			unlinked = true;
+			}
+
+		return false;
+		}
+
+	base = (char*) m;
+	Header* h = (Header*) base;
+
+	if ( create )
+		{
+		// The file starts out zeroed, which is what the counters need.
+		h->size = size;
+		memcpy(h->magic, shm_magic, sizeof(shm_magic));
+		}
+
+	else
+		{
+		size = h->size;
+
+		if ( memcmp(h->magic, shm_magic, sizeof(shm_magic)) != 0 ||
+		     size == 0 || (size & (size - 1)) != 0 ||
+		     mapped_len < sizeof(Header) + 2 * size_t(size) )
+			{
+			error = "invalid shared memory file";
+			return false;
+			}
+
+		// Both sides have it now.
+		unlink(path.c_str());
+		unlinked = true;
+		}
+
+	out = &h->rings[create ? 0 : 1];
+	in = &h->rings[create ? 1 : 0];
+	out_data = base + sizeof(Header) + (create ? 0 : size);
+	in_data = base + sizeof(Header) + (create ? size : 0);
+
+	return true;
+	}
+
+void ChunkedIOShm::CopyToRing(uint64 pos, const void* data, uint32 len)
+	{
+	uint32 offset = pos & (size - 1);
+	uint32 n = min(len, size - offset);
+	memcpy(out_data + offset, data, n);
+	memcpy(out_data, (const char*) data + n, len - n);
+	}
+
+void ChunkedIOShm::CopyFromRing(uint64 pos, void* data, uint32 len)
+	{
+	uint32 offset = pos & (size - 1);
+	uint32 n = min(len, size - offset);
+	memcpy(data, in_data + offset, n);
+	memcpy((char*) data + n, in_data, len - n);
+	}
+
+bool ChunkedIOShm::WriteRing(const char* data, uint32 len)
+	{
+	uint32 real_len = len & ~FLAG_PARTIAL;
+	uint64 head = out->head.load();
+	uint64 tail = out->tail.load(std::memory_order_relaxed);
+
+	if ( size - (tail - head) < sizeof(len) + real_len )
+		{
+		// Tell the reader we're waiting for space, then check again
+		// in case it made some in the meantime.
+		out->writer_waiting.store(1);
+		head = out->head.load();
+
+		if ( size - (tail - head) < sizeof(len) + real_len )
+			return false;
+		}
+
+	CopyToRing(tail, &len, sizeof(len));
+	CopyToRing(tail + sizeof(len), data, real_len);
+	out->tail.store(tail + sizeof(len) + real_len);
+
+	stats.bytes_written += sizeof(len) + real_len;
+	++stats.writes;
+
+	if ( out->reader_waiting.exchange(0) )
+		RingDoorbell();
+
+	return true;
+	}
+
+bool ChunkedIOShm::ReadRing(Chunk** chunk)
+	{
+	uint64 head = in->head.load(std::memory_order_relaxed);
+
+	while ( head != in->tail.load() )
+		{
+		uint32 len;
+		CopyFromRing(head, &len, sizeof(len));
+		uint32 real_len = len & ~FLAG_PARTIAL;
+
+		if ( real_len > size - sizeof(len) )
+			{
+			error = "corrupt shared memory ring";
+			return false;
+			}
+
+		char* data = new char[real_len];
+		CopyFromRing(head + sizeof(len), data, real_len);
+		head += sizeof(len) + real_len;
+		in->head.store(head);
+
+		stats.bytes_read += sizeof(len) + real_len;
+		++stats.reads;
+
+		if ( in->writer_waiting.exchange(0) )
+			RingDoorbell();
+
+		if ( len & FLAG_PARTIAL )
+			{
+			partial.append(data, real_len);
+			delete [] data;
+			continue;
+			}
+
+		if ( partial.size() )
+			{
+			partial.append(data, real_len);
+			delete [] data;
+
+			real_len = partial.size();
+			data = new char[real_len];
+			memcpy(data, partial.data(), real_len);
+			partial.clear();
+			}
+
+		*chunk = new Chunk(data, real_len);
+		++stats.chunks_read;
+		return true;
+		}
+
+	return true;
+	}
+
+bool ChunkedIOShm::RingEmpty()
+	{
+	if ( in->head.load(std::memory_order_relaxed) != in->tail.load() )
+		return false;
+
+	// Tell the writer to wake us up, then check again in case it just
+	// wrote something.
+	in->reader_waiting.store(1);
+	return in->head.load(std::memory_order_relaxed) == in->tail.load();
+	}
+
+void ChunkedIOShm::RingDoorbell()
+	{
+	// Any byte will do. We use 0xff as the reader might still be looking
+	// at the connection for chunks, and that's too long for one.
+	char b = '\xff';
+
+	if ( write(io->Fd(), &b, 1) < 0 && errno == EPIPE )
+		eof = true;
+	}
+
+bool ChunkedIOShm::DrainDoorbell()
+	{
+	char buffer[64];
+
+	while ( true )
+		{
+		int n = read(io->Fd(), buffer, sizeof(buffer));
+
+		if ( n > 0 )
+			continue;
+
+		if ( n == 0 )
+			{
+			eof = true;
+			return false;
+			}
+
+		if ( errno == EINTR )
+			continue;
+
+		if ( errno == EWOULDBLOCK || errno == EAGAIN )
+			return true;
+
+		if ( errno == EPIPE || errno == ECONNRESET )
+			eof = true;
+
+		return false;
+		}
+	}
+
+bool ChunkedIOShm::Read(Chunk** chunk, bool may_block)
+	{
+	*chunk = 0;
+
+	// We will be called regularly. So take the opportunity to move
+	// pending chunks into the ring.
+	Flush();
+
+	if ( ! reads )
+		return io->Read(chunk, may_block);
+
+	if ( ! ReadRing(chunk) )
+		return false;
+
+	if ( *chunk )
+		{
+		read_flare.Fire();
+		return true;
+		}
+
+	read_flare.Extinguish();
+
+	// See whether the other side is still there.
+	return DrainDoorbell();
+	}
+
+bool ChunkedIOShm::Write(Chunk* chunk)
+	{
+	if ( ! writes )
+		return io->Write(chunk);
+
+	if ( chunk->len == 0 )
+		InternalError("attempt to write 0 bytes chunk");
+
+	++stats.chunks_written;
+	++stats.pending;
+	pending.push_back(chunk);
+
+	return Flush();
+	}
+
+bool ChunkedIOShm::Flush()
+	{
+	// Anything sent before the switch has to go out first.
+	if ( ! io->Flush() )
+		return false;
+
+	if ( eof )
+		return false;
+
+	// Chunks go in parts of at most a quarter of the ring, so that
+	// even large ones get through in pieces.
+	uint32 max_part = size / 4;
+
+	while ( ! pending.empty() )
+		{
+		Chunk* c = pending.front();
+
+		while ( pending_pos < c->len )
+			{
+			uint32 n = min(max_part, c->len - pending_pos);
+			uint32 len = n;
+
+			if ( pending_pos + n < c->len )
+				len |= FLAG_PARTIAL;
+
+			if ( ! WriteRing(c->data + pending_pos, len) )
+				{
+				// Try again once the reader made space.
+				write_flare.Fire();
+				return true;
+				}
+
+			pending_pos += n;
+			}
+
+		pending.pop_front();
+		pending_pos = 0;
+		--stats.pending;
+		delete c;
+		}
+
+	write_flare.Extinguish();
+	return true;
+	}
+
+const char* ChunkedIOShm::Error()
+	{
+	if ( error )
+		return error;
+
+	if ( io )
+		return io->Error();
+
+	static char buffer[1024];
+	safe_snprintf(buffer, sizeof(buffer), "%s [%d]", strerror(errno), errno);
+	return buffer;
+	}
+
+bool ChunkedIOShm::CanRead()
+	{
+	// We will be called regularly. So take the opportunity to move
+	// pending chunks into the ring.
+	Flush();
+
+	if ( ! reads )
+		return io->CanRead();
+
+	// If the connection's gone, Read() will tell.
+	return ! RingEmpty() || ! DrainDoorbell();
+	}
+
+bool ChunkedIOShm::CanWrite()
+	{
+	return ! pending.empty() || io->CanWrite();
+	}
+
+bool ChunkedIOShm::IsIdle()
+	{
+	if ( ! reads )
+		return io->IsIdle();
+
+	return pending.empty() &&
+		in->head.load(std::memory_order_relaxed) == in->tail.load();
+	}
+
+bool ChunkedIOShm::IsFillingUp()
+	{
+	return stats.pending > chunked_io_buffer_soft_cap || io->IsFillingUp();
+	}
+
+void ChunkedIOShm::Clear()
+	{
+	while ( ! pending.empty() )
+		{
+		delete pending.front();
+		pending.pop_front();
+		}
+
+	pending_pos = 0;
+	stats.pending = 0;
+	partial.clear();
+
+	if ( io )
+		io->Clear();
+
+	write_flare.Extinguish();
+	}
+
+bool ChunkedIOShm::Eof()
+	{
+	return eof || (io && io->Eof());
+	}
+
+iosource::FD_Set ChunkedIOShm::ExtraReadFDs() const
+	{
+	iosource::FD_Set rval;
+
+	if ( io )
+		rval.Insert(io->ExtraReadFDs());
+
+	rval.Insert(write_flare.FD());
+	rval.Insert(read_flare.FD());
+	return rval;
+	}
+
+void ChunkedIOShm::Stats(char* buffer, int length)
+	{
+	uint64 used = out ? out->tail.load() - out->head.load() : 0;
+	int i = safe_snprintf(buffer, length, "shm pending=%lu ring=%" PRIu64 "/%u ",
+			      stats.pending, used, size);
+	ChunkedIO::Stats(buffer + i, length - i);
+	}
+
 bool CompressedChunkedIO::Init()
 	{
 	zin.zalloc = 0;
@@ -9,6 +9,7 @@
 #include "Flare.h"
 #include "iosource/FD_Set.h"
 #include <list>
+#include <string>
 
 #ifdef NEED_KRB5_H
 # include <krb5.h>
@@ -42,9 +43,18 @@ public:
 		~Chunk()
 			{ free_func(data); }
 
+		// Returns a new chunk with the same data, without copying
+		// it. The data then stays around until the last of the
+		// chunks sharing it is gone. Sharing isn't thread-safe, so
+		// all of these chunks need to stay within one thread.
+		Chunk* Share();
+
 		char* data;
 		uint32 len;
 		FreeFunc free_func;
+
+	private:
+		static void free_func_shared(char* data);
 	};
 
 	// Initialization before any I/O operation is performed. Returns false
@@ -187,6 +197,8 @@ private:
 
 	bool PutIntoWriteBuffer(Chunk* chunk);
 	bool FlushWriteBuffer();
+	void QueueChunk(Chunk* owner, char* data, uint32 len);
+	void ConsumeWritten(uint32 len);
 	Chunk* ExtractChunk();
 
 	// Returns size of next chunk in buffer or 0 if none.
@@ -200,7 +212,7 @@ private:
 	Chunk* ConcatChunks(Chunk* c1, Chunk* c2);
 
 	// Reads/writes on chunk of upto BUFFER_SIZE bytes.
-	bool WriteChunk(Chunk* chunk, bool partial);
+	bool WriteChunk(Chunk* chunk);
 	bool ReadChunk(Chunk** chunk, bool may_block);
 
 	int fd;
@@ -218,6 +230,14 @@ private:
 	// than BUFFER_SIZE.
 	static const uint32 FLAG_PARTIAL = 0x80000000;
 
+	// Chunks up to this size get copied into the write buffer, to go
+	// out together with others. Larger ones are written straight from
+	// their own memory.
+	static const uint32 COPY_THRESHOLD = 16 * 1024;
+
+	// Maximum number of pieces passed to a single writev().
+	static const int MAX_IOVECS = 64;
+
 	char* read_buffer;
 	uint32 read_len;
 	uint32 read_pos;
@@ -227,14 +247,20 @@ private:
 	uint32 write_len;
 	uint32 write_pos;
 
+	// A chunk, or a part of one, waiting to be written after the
+	// write buffer's content.
 	struct ChunkQueue {
-		Chunk* chunk;
+		Chunk* chunk;	// to delete once written, may be null for parts
+		char* data;
+		uint32 len;	// may have FLAG_PARTIAL set
+		uint32 nlen;	// len in network order, written before data
 		ChunkQueue* next;
 	};
 
-	// Chunks that don't fit into our write buffer.
+	// Chunks that are too large for, or don't fit into, our write buffer.
 	ChunkQueue* pending_head;
 	ChunkQueue* pending_tail;
+	uint32 pending_pos;	// bytes of pending_head already written
 
 	pid_t pid;
 	bro::Flare write_flare;
@@ -310,6 +336,90 @@ private:
 	bro::Flare write_flare;
 };
 
+// Chunked I/O through two rings, one per direction, in memory shared
+// between two processes on the same host. It wraps the ChunkedIO of the
+// connection to the peer process. That connection carries the setup
+// and then serves as a doorbell, waking up the other side if it's
+// waiting for data or space, and tells when the other side is gone.
+// Reads and writes go through the wrapped ChunkedIO until enabled for
+// the rings, so that each side can switch over once the other has seen
+// everything it sent before.
+class ChunkedIOShm : public ChunkedIO {
+public:
+	// If size is non-zero, creates a new file backing the shared memory
+	// in the directory path, with rings of about size bytes each.
+	// Otherwise opens the file path created by the other side, and
+	// removes it.
+	ChunkedIOShm(const char* path, uint32 size);
+	virtual ~ChunkedIOShm();
+
+	virtual bool Init();
+	virtual bool Read(Chunk** chunk, bool may_block = false);
+	virtual bool Write(Chunk* chunk);
+	virtual bool Flush();
+	virtual const char* Error();
+	virtual bool CanRead();
+	virtual bool CanWrite();
+	virtual bool IsIdle();
+	virtual bool IsFillingUp();
+	virtual void Clear();
+	virtual bool Eof();
+	virtual int Fd()	{ return io ? io->Fd() : -1; }
+	virtual iosource::FD_Set ExtraReadFDs() const;
+	virtual void Stats(char* buffer, int length);
+
+	// File backing the shared memory.
+	const char* Path() const	{ return path.c_str(); }
+
+	// Sets the connection to the other side (takes ownership).
+	void SetConnection(ChunkedIO* arg_io)	{ io = arg_io; }
+
+	// Switches writes, respectively reads, over to the rings.
+	void EnableWrites()	{ writes = true; }
+	void EnableReads()	{ reads = true; }
+
+private:
+	struct Header;
+	struct Ring;
+
+	bool WriteRing(const char* data, uint32 len);
+	bool ReadRing(Chunk** chunk);
+	void CopyToRing(uint64 pos, const void* data, uint32 len);
+	void CopyFromRing(uint64 pos, void* data, uint32 len);
+	bool RingEmpty();
+	bool DrainDoorbell();
+	void RingDoorbell();
+
+	// We 'or' this to the length of a data chunk to mark that it's
+	// part of a larger one.
+	static const uint32 FLAG_PARTIAL = 0x80000000;
+
+	std::string path;
+	bool create;
+	bool unlinked;
+	const char* error;
+
+	char* base;
+	size_t mapped_len;
+	uint32 size;	// of each ring, a power of two
+	Ring* in;
+	Ring* out;
+	char* in_data;
+	char* out_data;
+
+	ChunkedIO* io;
+	bool reads;
+	bool writes;
+	bool eof;
+
+	std::list<Chunk*> pending;	// chunks not fitting into the ring yet
+	uint32 pending_pos;	// bytes of the first one already written
+	std::string partial;	// data of the parts of a chunk read so far
+
+	bro::Flare write_flare;
+	bro::Flare read_flare;
+};
+
 #include <zlib.h>
 
 // Wrapper class around a another ChunkedIO which the (un-)compresses data.
@@ -6,6 +6,9 @@
 #include "Val.h"
 #include "Reporter.h"
 #include "Func.h"
+#include "RE.h"
+
+#include <string>
 
 CompositeHash::CompositeHash(TypeList* composite_type)
 	{
@@ -143,6 +146,27 @@ char* CompositeHash::SingleValHash(int type_check, char* kp0,
 			break;
 			}
 
+		case TYPE_PATTERN:
+			{
+			// The lengths of both texts, then the texts.
+			const char* exact = v->AsPattern()->PatternText();
+			const char* anywhere = v->AsPattern()->AnywherePatternText();
+			int exact_len = strlen(exact);
+			int anywhere_len = strlen(anywhere);
+
+			int* kp = AlignAndPadType<int>(kp0);
+			*kp = exact_len;
+			kp = AlignAndPadType<int>(reinterpret_cast<char*>(kp+1));
+			*kp = anywhere_len;
+			kp1 = reinterpret_cast<char*>(kp+1);
+
+			memcpy(kp1, exact, exact_len);
+			kp1 += exact_len;
+			memcpy(kp1, anywhere, anywhere_len);
+			kp1 += anywhere_len;
+			break;
+			}
+
 		case TYPE_RECORD:
 			{
 			char* kp = kp0;
@@ -333,6 +357,93 @@ HashKey* CompositeHash::ComputeHash(const Val* v, int type_check) const
 	return new HashKey((k == key), (void*) k, kp - k);
 	}
 
+bool CompositeHash::ComputeRawKey(const Val* v, int type_check,
+				  RawKeyBuffer* buf, const void*& arg_key,
+				  int& arg_size) const
+	{
+	if ( is_complex_type )
+		return false;
+
+	if ( ! is_singleton )
+		{
+		// Same as ComputeHash(), but with the scratch space coming
+		// from our buffer if the key's size isn't fixed.
+		char* k = key;
+
+		if ( ! k )
+			{
+			int sz = ComputeKeySize(v, type_check, false);
+			if ( sz == 0 || sz > MAX_RAW_KEY_SIZE )
+				return false;
+
+			k = reinterpret_cast<char*>(buf->composite);
+			type_check = 0;	// no need to type-check again.
+			}
+
+		if ( type_check && v->Type()->Tag() != TYPE_LIST )
+			return false;
+
+		const type_list* tl = type->Types();
+		const val_list* vl = v->AsListVal()->Vals();
+		if ( type_check && vl->length() != tl->length() )
+			return false;
+
+		char* kp = k;
+		loop_over_list(*tl, i)
+			{
+			kp = SingleValHash(type_check, kp, (*tl)[i], (*vl)[i], false);
+			if ( ! kp )
+				return false;
+			}
+
+		arg_key = k;
+		arg_size = kp - k;
+		return true;
+		}
+
+	if ( v->Type()->Tag() == TYPE_LIST )
+		{
+		const val_list* vl = v->AsListVal()->Vals();
+		if ( type_check && vl->length() != 1 )
+			return false;
+
+		v = (*vl)[0];
+		}
+
+	if ( type_check && v->Type()->InternalType() != singleton_tag )
+		return false;
+
+	// These must match the keys that ComputeSingletonHash() builds.
+	switch ( singleton_tag ) {
+	case TYPE_INTERNAL_INT:
+	case TYPE_INTERNAL_UNSIGNED:
+		buf->i = v->ForceAsInt();
+		arg_key = &buf->i;
+		arg_size = sizeof(buf->i);
+		return true;
+
+	case TYPE_INTERNAL_ADDR:
+		v->AsAddr().CopyIPv6(&buf->addr);
+		arg_key = &buf->addr;
+		arg_size = sizeof(buf->addr);
+		return true;
+
+	case TYPE_INTERNAL_DOUBLE:
+		buf->d = v->InternalDouble();
+		arg_key = &buf->d;
+		arg_size = sizeof(buf->d);
+		return true;
+
+	case TYPE_INTERNAL_STRING:
+		arg_key = v->AsString()->Bytes();
+		arg_size = v->AsString()->Len();
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
 HashKey* CompositeHash::ComputeSingletonHash(const Val* v, int type_check) const
 	{
 	if ( v->Type()->Tag() == TYPE_LIST )
@@ -366,6 +477,17 @@ HashKey* CompositeHash::ComputeSingletonHash(const Val* v, int type_check) const
 		if ( v->Type()->Tag() == TYPE_FUNC )
 			return new HashKey(v->AsFunc()->GetUniqueFuncID());
 
+		if ( v->Type()->Tag() == TYPE_PATTERN )
+			{
+			// Laid out as for composite keys.
+			BroType* bt = (*type->Types())[0];
+			int sz = SingleTypeKeySize(bt, v, 0, 0, false, false);
+			char* k = new char[sz];
+
+			SingleValHash(0, k, bt, const_cast<Val*>(v), false);
+			return new HashKey(0, k, sz);
+			}
+
 		reporter->InternalError("bad index type in CompositeHash::ComputeSingletonHash");
 		return 0;
 
@@ -427,6 +549,18 @@ int CompositeHash::SingleTypeKeySize(BroType* bt, const Val* v,
 			break;
 			}
 
+		case TYPE_PATTERN:
+			{
+			if ( ! v )
+				return (optional && ! calc_static_size) ? sz : 0;
+
+			sz = SizeAlign(sz, sizeof(int));
+			sz = SizeAlign(sz, sizeof(int));
+			sz += strlen(v->AsPattern()->PatternText());
+			sz += strlen(v->AsPattern()->AnywherePatternText());
+			break;
+			}
+
 		case TYPE_RECORD:
 			{
 			const RecordVal* rv = v ? v->AsRecordVal() : 0;
@@ -633,6 +767,23 @@ int CompositeHash::SizeAlign(int offset, unsigned int size) const
 	return offset;
 	}
 
+void CompositeHash::RecoverVals(const void* key, int size, Val** vals) const
+	{
+	HashKey k(key, size, 0, true);
+	const type_list* tl = type->Types();
+	const char* kp = (const char*) key;
+	const char* const k_end = kp + size;
+
+	loop_over_list(*tl, i)
+		{
+		kp = RecoverOneVal(&k, kp, k_end, (*tl)[i], vals[i], false);
+		ASSERT(vals[i]);
+		}
+
+	if ( kp != k_end )
+		reporter->InternalError("under-ran key in CompositeHash::RecoverVals %zd", k_end - kp);
+	}
+
 ListVal* CompositeHash::RecoverVals(const HashKey* k) const
 	{
 	ListVal* l = new ListVal(TYPE_ANY);
@@ -703,7 +854,7 @@ const char* CompositeHash::RecoverOneVal(const HashKey* k, const char* kp0,
 			break;
 
 		case TYPE_PORT:
-			pval = new PortVal(*kp);
+			pval = val_mgr->GetPort(*kp);
 			break;
 
 		default:
@@ -786,6 +937,28 @@ const char* CompositeHash::RecoverOneVal(const HashKey* k, const char* kp0,
 			}
 			break;
 
+		case TYPE_PATTERN:
+			{
+			const int* kp = AlignType<int>(kp0);
+			int exact_len = *kp;
+			kp = AlignType<int>(reinterpret_cast<const char*>(kp+1));
+			int anywhere_len = *kp;
+			kp1 = reinterpret_cast<const char*>(kp+1);
+
+			std::string exact(kp1, exact_len);
+			kp1 += exact_len;
+			std::string anywhere(kp1, anywhere_len);
+			kp1 += anywhere_len;
+
+			RE_Matcher* re = new RE_Matcher(exact.c_str(), anywhere.c_str());
+
+			if ( ! re->Compile() )
+				reporter->InternalError("failed to compile pattern in CompositeHash::RecoverOneVal()");
+
+			pval = new PatternVal(re);
+			}
+			break;
+
 		case TYPE_RECORD:
 			{
 			const char* kp = kp0;
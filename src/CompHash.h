@@ -3,6 +3,8 @@
 #ifndef comphash_h
 #define comphash_h
 
+#include <netinet/in.h>
+
 #include "Hash.h"
 #include "Type.h"
 
@@ -17,9 +19,37 @@ public:
 	// or 0 if it fails to typecheck.
 	HashKey* ComputeHash(const Val* v, int type_check) const;
 
+	// Largest variable-size composite key that ComputeRawKey() builds
+	// in its buffer.
+	static const int MAX_RAW_KEY_SIZE = 256;
+
+	// Storage for the keys computed by ComputeRawKey().  Composite
+	// keys get the same alignment as ComputeHash() gives them.
+	union RawKeyBuffer {
+		bro_int_t i;
+		double d;
+		in6_addr addr;
+		double composite[MAX_RAW_KEY_SIZE / sizeof(double)];
+	};
+
+	// Computes the same key as ComputeHash(), but without allocating
+	// anything, for use by lookups: key is set to the key's bytes and
+	// size to their number.  The bytes live in *buf, in v itself (for
+	// single strings), or in the scratch space of fixed-size composite
+	// keys, so they stay valid only until the next call.  Returns false
+	// if v fails to typecheck, or if the key doesn't fit any of these
+	// (records as single index, or larger variable-size keys); use
+	// ComputeHash() then.
+	bool ComputeRawKey(const Val* v, int type_check, RawKeyBuffer* buf,
+			   const void*& arg_key, int& arg_size) const;
+
 	// Given a hash key, recover the values used to create it.
 	ListVal* RecoverVals(const HashKey* k) const;
 
+	// Same, from the key's bytes, storing the values into vals, one per
+	// index type.
+	void RecoverVals(const void* key, int size, Val** vals) const;
+
 	unsigned int MemoryAllocation() const { return padded_sizeof(*this) + pad_size(size); }
 
 protected:
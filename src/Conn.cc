@@ -3,6 +3,8 @@
 #include "bro-config.h"
 
 #include <ctype.h>
+#include <math.h>
+#include <algorithm>
 
 #include "Net.h"
 #include "NetVar.h"
@@ -14,8 +16,12 @@
 #include "analyzer/protocol/pia/PIA.h"
 #include "binpac.h"
 #include "TunnelEncapsulation.h"
+#include "PacketRing.h"
 #include "analyzer/Analyzer.h"
 #include "analyzer/Manager.h"
+#include "iosource/Manager.h"
+#include "iosource/PktSrc.h"
+#include "analyzer/protocol/conn-size/events.bif.h"
 
 void ConnectionTimer::Init(Connection* arg_conn, timer_func arg_timer,
 				int arg_do_expire)
@@ -112,6 +118,8 @@ uint64 Connection::total_connections = 0;
 uint64 Connection::current_connections = 0;
 uint64 Connection::external_connections = 0;
 
+ObjPool Connection_pool("Connection", sizeof(Connection));
+
 IMPLEMENT_SERIAL(Connection, SER_CONNECTION);
 
 Connection::Connection(NetSessions* s, HashKey* k, double t, const ConnID* id,
@@ -146,10 +154,18 @@ Connection::Connection(NetSessions* s, HashKey* k, double t, const ConnID* id,
 	inner_vlan = pkt->inner_vlan;
 
 	conn_val = 0;
+	conn_val_outdated = 0;
 	login_conn = 0;
 
 	is_active = 1;
 	skip = 0;
+	bypassed = 0;
+	bypassed_orig_bytes = bypassed_resp_bytes = 0;
+	ip_bytes = 0;
+	num_pkts[0] = num_pkts[1] = 0;
+	num_bytes_ip[0] = num_bytes_ip[1] = 0;
+	pkts_thresh[0] = pkts_thresh[1] = 0;
+	bytes_thresh[0] = bytes_thresh[1] = 0;
 	weird = 0;
 	persistent = 0;
 
@@ -160,6 +176,8 @@ Connection::Connection(NetSessions* s, HashKey* k, double t, const ConnID* id,
 
 	timers_canceled = 0;
 	inactivity_timeout = 0;
+	sweep_due = 0;
+	sweep_idx = -1;
 	installed_status_timer = 0;
 
 	finished = 0;
@@ -176,10 +194,14 @@ Connection::Connection(NetSessions* s, HashKey* k, double t, const ConnID* id,
 	TimerMgr::Tag* tag = current_iosrc->GetCurrentTag();
 	conn_timer_mgr = tag ? new TimerMgr::Tag(*tag) : 0;
 
-	if ( arg_encap )
-		encapsulation = new EncapsulationStack(*arg_encap);
-	else
-		encapsulation = 0;
+	encapsulation = arg_encap;
+
+	if ( encapsulation )
+		Ref(const_cast<EncapsulationStack*>(encapsulation));
+
+	weird_state = 0;
+	packet_ring = 0;
+	packet_dump_file = 0;
 
 	if ( conn_timer_mgr )
 		{
@@ -208,7 +230,14 @@ Connection::~Connection()
 	delete key;
 	delete root_analyzer;
 	delete conn_timer_mgr;
-	delete encapsulation;
+
+	if ( encapsulation )
+		Unref(const_cast<EncapsulationStack*>(encapsulation));
+	delete weird_state;
+	delete packet_ring;
+
+	if ( packet_dump_file )
+		packet_ring_writer->Close(packet_dump_file);
 
 	--current_connections;
 	if ( conn_timer_mgr )
@@ -217,33 +246,68 @@ Connection::~Connection()
 
 void Connection::CheckEncapsulation(const EncapsulationStack* arg_encap)
 	{
-	if ( encapsulation && arg_encap )
+	// Stacks are interned, so this is all it takes to compare them.
+	if ( encapsulation == arg_encap )
+		return;
+
+	if ( arg_encap )
 		{
-		if ( *encapsulation != *arg_encap )
-			{
-			Event(tunnel_changed, 0, arg_encap->GetVectorVal());
-			delete encapsulation;
-			encapsulation = new EncapsulationStack(*arg_encap);
-			}
+		Event(tunnel_changed, 0, arg_encap->GetVectorVal());
+		Ref(const_cast<EncapsulationStack*>(arg_encap));
 		}
+	else
+		Event(tunnel_changed, 0, EncapsulationStack::GetEmptyVectorVal());
+
+	if ( encapsulation )
+		Unref(const_cast<EncapsulationStack*>(encapsulation));
 
-	else if ( encapsulation )
+	encapsulation = arg_encap;
+	}
+
+void Connection::DoBufferPacket(const Packet* pkt)
+	{
+	if ( packet_dump_file )
 		{
-		EncapsulationStack empty;
-		Event(tunnel_changed, 0, empty.GetVectorVal());
-		delete encapsulation;
-		encapsulation = 0;
+		packet_ring_writer->Write(packet_dump_file, pkt);
+		return;
 		}
 
-	else if ( arg_encap )
+	if ( ! packet_ring )
+		packet_ring = new PacketRing(BifConst::packet_ring_packets);
+
+	packet_ring->Add(pkt);
+	}
+
+bool Connection::DumpPackets(const string& path)
+	{
+	if ( packet_dump_file )
+		return packet_dump_file->path == path;
+
+	packet_dump_file = packet_ring_writer->Open(path);
+
+	if ( ! packet_dump_file )
+		return false;
+
+	if ( packet_ring )
 		{
-		Event(tunnel_changed, 0, arg_encap->GetVectorVal());
-		encapsulation = new EncapsulationStack(*arg_encap);
+		std::deque<BufferedPacket> pkts;
+		packet_ring->Take(&pkts);
+		packet_ring_writer->Write(packet_dump_file, &pkts);
+
+		delete packet_ring;
+		packet_ring = 0;
 		}
+
+	return true;
 	}
 
 void Connection::Done()
 	{
+	if ( bypassed && ! finished && connection_bypass_done )
+		Event(connection_bypass_done, 0,
+		      new Val(bypassed_orig_bytes, TYPE_COUNT),
+		      new Val(bypassed_resp_bytes, TYPE_COUNT));
+
 	finished = 1;
 
 	if ( root_analyzer && ! root_analyzer->IsFinished() )
@@ -278,6 +342,29 @@ void Connection::NextPacket(double t, int is_orig,
 	current_pkt = 0;
 	}
 
+void Connection::Bypass()
+	{
+	if ( bypassed )
+		return;
+
+	bypassed = 1;
+
+	ConnID id;
+	id.src_addr = orig_addr;
+	id.dst_addr = resp_addr;
+	id.src_port = orig_port;
+	id.dst_port = resp_port;
+	id.is_one_way = false;
+
+	const iosource::Manager::PktSrcList& srcs = iosource_mgr->GetPktSrcs();
+
+	for ( iosource::Manager::PktSrcList::const_iterator i = srcs.begin();
+	      i != srcs.end(); ++i )
+		(*i)->BypassFlow(id, ConnTransport());
+
+	Event(connection_bypassed, 0);
+	}
+
 void Connection::SetLifetime(double lifetime)
 	{
 	ADD_TIMER(&Connection::DeleteTimer, network_time + lifetime, 0,
@@ -324,6 +411,18 @@ void Connection::RemoveConnectionTimer(double t)
 
 void Connection::SetInactivityTimeout(double timeout)
 	{
+	InactivitySweeper* sweeper = GetInactivitySweeper();
+
+	if ( sweeper )
+		{
+		inactivity_timeout = timeout;
+
+		if ( timeout )
+			sweeper->Schedule(this);
+
+		return;
+		}
+
 	// We add a new inactivity timer even if there already is one.  When
 	// it fires, we always use the current value to check for inactivity.
 	if ( timeout )
@@ -364,14 +463,14 @@ RecordVal* Connection::BuildConnVal()
 
 		RecordVal* id_val = new RecordVal(conn_id);
 		id_val->Assign(0, new AddrVal(orig_addr));
-		id_val->Assign(1, new PortVal(ntohs(orig_port), prot_type));
+		id_val->Assign(1, val_mgr->GetPort(ntohs(orig_port), prot_type));
 		id_val->Assign(2, new AddrVal(resp_addr));
-		id_val->Assign(3, new PortVal(ntohs(resp_port), prot_type));
+		id_val->Assign(3, val_mgr->GetPort(ntohs(resp_port), prot_type));
 
 		RecordVal *orig_endp = new RecordVal(endpoint);
-		orig_endp->Assign(0, new Val(0, TYPE_COUNT));
-		orig_endp->Assign(1, new Val(0, TYPE_COUNT));
-		orig_endp->Assign(4, new Val(orig_flow_label, TYPE_COUNT));
+		orig_endp->Assign(0, val_mgr->GetCount(0));
+		orig_endp->Assign(1, val_mgr->GetCount(0));
+		orig_endp->Assign(4, val_mgr->GetCount(orig_flow_label));
 
 		const int l2_len = sizeof(orig_l2_addr);
 		char null[l2_len]{};
@@ -380,9 +479,9 @@ RecordVal* Connection::BuildConnVal()
 			orig_endp->Assign(5, new StringVal(fmt_mac(orig_l2_addr, l2_len)));
 
 		RecordVal *resp_endp = new RecordVal(endpoint);
-		resp_endp->Assign(0, new Val(0, TYPE_COUNT));
-		resp_endp->Assign(1, new Val(0, TYPE_COUNT));
-		resp_endp->Assign(4, new Val(resp_flow_label, TYPE_COUNT));
+		resp_endp->Assign(0, val_mgr->GetCount(0));
+		resp_endp->Assign(1, val_mgr->GetCount(0));
+		resp_endp->Assign(4, val_mgr->GetCount(resp_flow_label));
 
 		if ( memcmp(&resp_l2_addr, &null, l2_len) != 0 )
 			resp_endp->Assign(5, new StringVal(fmt_mac(resp_l2_addr, l2_len)));
@@ -392,26 +491,25 @@ RecordVal* Connection::BuildConnVal()
 		conn_val->Assign(2, resp_endp);
 		// 3 and 4 are set below.
 		conn_val->Assign(5, new TableVal(string_set));	// service
-		conn_val->Assign(6, new StringVal(""));	// history
+		conn_val->Assign(6, val_mgr->GetEmptyString());	// history
 
 		if ( ! uid )
 			uid.Set(bits_per_uid);
 
-		conn_val->Assign(7, new StringVal(uid.Base62("C").c_str()));
+		conn_val->Assign(7, new StringVal(uid.Base62("C")));
 
 		if ( encapsulation && encapsulation->Depth() > 0 )
 			conn_val->Assign(8, encapsulation->GetVectorVal());
 
 		if ( vlan != 0 )
-			conn_val->Assign(9, new Val(vlan, TYPE_INT));
+			conn_val->Assign(9, val_mgr->GetInt(vlan));
 
 		if ( inner_vlan != 0 )
-			conn_val->Assign(10, new Val(inner_vlan, TYPE_INT));
+			conn_val->Assign(10, val_mgr->GetInt(inner_vlan));
 
 		}
 
-	if ( root_analyzer )
-		root_analyzer->UpdateConnVal(conn_val);
+	conn_val_outdated = 1;
 
 	conn_val->Assign(3, new Val(start_time, TYPE_TIME));	// ###
 	conn_val->Assign(4, new Val(last_time - start_time, TYPE_INTERVAL));
@@ -424,6 +522,63 @@ RecordVal* Connection::BuildConnVal()
 	return conn_val;
 	}
 
+void Connection::CompleteConnVal()
+	{
+	if ( ! conn_val_outdated )
+		return;
+
+	conn_val_outdated = 0;
+
+	if ( BifConst::use_conn_size_analyzer )
+		{
+		RecordVal* orig_endp = conn_val->Lookup(1)->AsRecordVal();
+		RecordVal* resp_endp = conn_val->Lookup(2)->AsRecordVal();
+		orig_endp->Assign(2, val_mgr->GetCount(num_pkts[0]));
+		orig_endp->Assign(3, val_mgr->GetCount(num_bytes_ip[0]));
+		resp_endp->Assign(2, val_mgr->GetCount(num_pkts[1]));
+		resp_endp->Assign(3, val_mgr->GetCount(num_bytes_ip[1]));
+		}
+
+	if ( root_analyzer )
+		root_analyzer->UpdateConnVal(conn_val);
+	}
+
+void Connection::SetSizeThreshold(uint64 threshold, bool bytes, bool is_orig)
+	{
+	int i = is_orig ? 0 : 1;
+
+	if ( bytes )
+		bytes_thresh[i] = threshold;
+	else
+		pkts_thresh[i] = threshold;
+
+	// It may be crossed already.
+	CheckSizeThresholds(is_orig);
+	}
+
+void Connection::CheckSizeThresholds(bool is_orig)
+	{
+	int i = is_orig ? 0 : 1;
+
+	if ( bytes_thresh[i] && num_bytes_ip[i] >= bytes_thresh[i] )
+		{
+		uint64 threshold = bytes_thresh[i];
+		bytes_thresh[i] = 0;
+
+		Event(conn_bytes_threshold_crossed, 0,
+		      val_mgr->GetCount(threshold), val_mgr->GetBool(is_orig));
+		}
+
+	if ( pkts_thresh[i] && num_pkts[i] >= pkts_thresh[i] )
+		{
+		uint64 threshold = pkts_thresh[i];
+		pkts_thresh[i] = 0;
+
+		Event(conn_packets_threshold_crossed, 0,
+		      val_mgr->GetCount(threshold), val_mgr->GetBool(is_orig));
+		}
+	}
+
 analyzer::Analyzer* Connection::FindAnalyzer(analyzer::ID id)
 	{
 	return root_analyzer ? root_analyzer->FindChild(id) : 0;
@@ -503,7 +658,7 @@ Val* Connection::BuildVersionVal(const char* s, int len)
 		;
 
 	if ( s != e )
-		major = new Val(atoi(s), TYPE_INT);
+		major = val_mgr->GetInt(atoi(s));
 
 	// Find second number seperated only by punctuation chars -
 	// that's the minor version.
@@ -513,7 +668,7 @@ Val* Connection::BuildVersionVal(const char* s, int len)
 		;
 
 	if ( s != e )
-		minor = new Val(atoi(s), TYPE_INT);
+		minor = val_mgr->GetInt(atoi(s));
 
 	// Find second number seperated only by punctuation chars; -
 	// that's the minor version.
@@ -523,7 +678,7 @@ Val* Connection::BuildVersionVal(const char* s, int len)
 		;
 
 	if ( s != e )
-		minor2 = new Val(atoi(s), TYPE_INT);
+		minor2 = val_mgr->GetInt(atoi(s));
 
 	// Anything after following punctuation and until next white space is
 	// an additional version string.
@@ -560,10 +715,10 @@ Val* Connection::BuildVersionVal(const char* s, int len)
 		}
 
 	RecordVal* version = new RecordVal(software_version);
-	version->Assign(0, major ? major : new Val(-1, TYPE_INT));
-	version->Assign(1, minor ? minor : new Val(-1, TYPE_INT));
-	version->Assign(2, minor2 ? minor2 : new Val(-1, TYPE_INT));
-	version->Assign(3, addl ? addl : new StringVal(""));
+	version->Assign(0, major ? major : val_mgr->GetInt(-1));
+	version->Assign(1, minor ? minor : val_mgr->GetInt(-1));
+	version->Assign(2, minor2 ? minor2 : val_mgr->GetInt(-1));
+	version->Assign(3, addl ? addl : val_mgr->GetEmptyString());
 
 	RecordVal* sw = new RecordVal(software);
 	sw->Assign(0, name);
@@ -725,10 +880,21 @@ void Connection::CancelTimers()
 	loop_over_list(tmp, i)
 		GetTimerMgr()->Cancel(tmp[i]);
 
+	if ( sweep_due )
+		GetInactivitySweeper()->Unschedule(this);
+
 	timers_canceled = 1;
 	timers.clear();
 	}
 
+InactivitySweeper* Connection::GetInactivitySweeper() const
+	{
+	if ( conn_timer_mgr )
+		return 0;
+
+	return sessions->GetInactivitySweeper();
+	}
+
 TimerMgr* Connection::GetTimerMgr() const
 	{
 	if ( ! conn_timer_mgr )
@@ -766,8 +932,17 @@ void Connection::FlipRoles()
 	resp_flow_label = orig_flow_label;
 	orig_flow_label = tmp_flow;
 
-	Unref(conn_val);
-	conn_val = 0;
+	// The thresholds stay with the direction they were set for.
+	std::swap(num_pkts[0], num_pkts[1]);
+	std::swap(num_bytes_ip[0], num_bytes_ip[1]);
+
+	if ( conn_val )
+		{
+		conn_val->SetOrigin(0);
+		Unref(conn_val);
+		conn_val = 0;
+		conn_val_outdated = 0;
+		}
 
 	if ( root_analyzer )
 		root_analyzer->FlipRoles();
@@ -881,6 +1056,7 @@ bool Connection::DoSerialize(SerialInfo* info) const
 		if ( ! timers[i]->Serialize(info) )
 			return false;
 
+	const_cast<Connection*>(this)->CompleteConnVal();
 	SERIALIZE_OPTIONAL(conn_val);
 
 	// FIXME: RuleEndpointState not yet serializable.
@@ -1005,7 +1181,7 @@ void Connection::CheckFlowLabel(bool is_orig, uint32 flow_label)
 		if ( conn_val )
 			{
 			RecordVal *endp = conn_val->Lookup(is_orig ? 1 : 2)->AsRecordVal();
-			endp->Assign(4, new Val(flow_label, TYPE_COUNT));
+			endp->Assign(4, val_mgr->GetCount(flow_label));
 			}
 
 		if ( connection_flow_label_changed &&
@@ -1013,9 +1189,9 @@ void Connection::CheckFlowLabel(bool is_orig, uint32 flow_label)
 			{
 			val_list* vl = new val_list(4);
 			vl->append(BuildConnVal());
-			vl->append(new Val(is_orig, TYPE_BOOL));
-			vl->append(new Val(my_flow_label, TYPE_COUNT));
-			vl->append(new Val(flow_label, TYPE_COUNT));
+			vl->append(val_mgr->GetBool(is_orig));
+			vl->append(val_mgr->GetCount(my_flow_label));
+			vl->append(val_mgr->GetCount(flow_label));
 			ConnectionEvent(connection_flow_label_changed, 0, vl);
 			}
 
@@ -1027,3 +1203,153 @@ void Connection::CheckFlowLabel(bool is_orig, uint32 flow_label)
 	else
 		saw_first_resp_packet = 1;
 	}
+
+class InactivitySweepTimer : public Timer {
+public:
+	InactivitySweepTimer(double t, InactivitySweeper* arg_sweeper)
+		: Timer(t, TIMER_CONN_INACTIVITY), sweeper(arg_sweeper)	{ }
+
+	void Dispatch(double t, int is_expire) override
+		{
+		// The manager deletes us after this.
+		sweeper->TimerExpired();
+
+		// Same as for the inactivity timers, we don't time out
+		// anything when Bro terminates.
+		if ( ! is_expire )
+			sweeper->Sweep(t);
+		}
+
+protected:
+	InactivitySweeper* sweeper;
+};
+
+InactivitySweeper::InactivitySweeper(TimerMgr* arg_mgr, double arg_granularity)
+	{
+	mgr = arg_mgr;
+	granularity = arg_granularity > 0 ? arg_granularity : 1.0;
+	num_conns = 0;
+	sweeping = false;
+	timer = 0;
+	timer_time = 0;
+	}
+
+InactivitySweeper::~InactivitySweeper()
+	{
+	if ( timer )
+		mgr->Cancel(timer);
+	}
+
+void InactivitySweeper::Schedule(Connection* c)
+	{
+	// Same conditions as in Connection::AddTimer().
+	if ( c->timers_canceled || ! c->key || ! c->inactivity_timeout )
+		return;
+
+	double deadline = c->last_time + c->inactivity_timeout;
+	double due = (floor(deadline / granularity) + 1) * granularity;
+
+	if ( c->sweep_due )
+		{
+		if ( c->sweep_due <= due )
+			// We'll look at it early enough already.
+			return;
+
+		Unschedule(c);
+		}
+
+	bucket& b = buckets[due];
+	c->sweep_due = due;
+	c->sweep_idx = b.size();
+	b.push_back(c);
+	++num_conns;
+
+	if ( ! sweeping && (! timer || due < timer_time) )
+		Arm();
+	}
+
+void InactivitySweeper::Unschedule(Connection* c)
+	{
+	if ( ! c->sweep_due )
+		return;
+
+	bucket_map::iterator i = buckets.find(c->sweep_due);
+
+	if ( i != buckets.end() )
+		{
+		bucket& b = i->second;
+		int idx = c->sweep_idx;
+
+		if ( idx >= 0 && idx < int(b.size()) && b[idx] == c )
+			{
+			// Fill the gap with the last one.
+			Connection* last = b.back();
+			b[idx] = last;
+			last->sweep_idx = idx;
+			b.pop_back();
+			--num_conns;
+
+			if ( b.empty() )
+				buckets.erase(i);
+			}
+		}
+
+	c->sweep_due = 0;
+	c->sweep_idx = -1;
+	}
+
+void InactivitySweeper::Arm()
+	{
+	if ( timer )
+		{
+		mgr->Cancel(timer);
+		timer = 0;
+		}
+
+	if ( buckets.empty() )
+		return;
+
+	timer_time = buckets.begin()->first;
+	timer = new InactivitySweepTimer(timer_time, this);
+	mgr->Add(timer);
+	}
+
+void InactivitySweeper::Sweep(double t)
+	{
+	sweeping = true;
+
+	while ( ! buckets.empty() && buckets.begin()->first <= t )
+		{
+		bucket conns;
+		conns.swap(buckets.begin()->second);
+		buckets.erase(buckets.begin());
+		num_conns -= conns.size();
+
+		// Timing out one connection may remove others as well, so
+		// we keep them all around until we're done with the batch.
+		for ( bucket::iterator i = conns.begin(); i != conns.end(); ++i )
+			{
+			(*i)->sweep_due = 0;
+			(*i)->sweep_idx = -1;
+			Ref(*i);
+			}
+
+		for ( bucket::iterator i = conns.begin(); i != conns.end(); ++i )
+			{
+			Connection* c = *i;
+
+			if ( c->key && c->inactivity_timeout && ! c->timers_canceled )
+				{
+				if ( c->last_time + c->inactivity_timeout <= t )
+					c->InactivityTimer(t);
+				else
+					Schedule(c);
+				}
+
+			Unref(c);
+			}
+		}
+
+	sweeping = false;
+	Arm();
+	}
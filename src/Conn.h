@@ -5,6 +5,9 @@
 
 #include <sys/types.h>
 
+#include <map>
+#include <vector>
+
 #include "Dict.h"
 #include "Val.h"
 #include "Timer.h"
@@ -12,14 +15,20 @@
 #include "PersistenceSerializer.h"
 #include "RuleMatcher.h"
 #include "IPAddr.h"
+#include "ObjPool.h"
 #include "TunnelEncapsulation.h"
 #include "UID.h"
+#include "WeirdState.h"
 
 #include "analyzer/Tag.h"
 #include "analyzer/Analyzer.h"
 
 class Connection;
 class ConnectionTimer;
+class PacketRing;
+
+struct PacketDumpFile;
+class InactivitySweeper;
 class NetSessions;
 class LoginConn;
 class RuleHdrTest;
@@ -53,7 +62,11 @@ static inline int addr_port_canon_lt(const IPAddr& addr1, uint32 p1,
 
 namespace analyzer { class Analyzer; }
 
+extern ObjPool Connection_pool;
+
 class Connection : public BroObj {
+	DECLARE_POOL_ALLOCATION(Connection)
+
 public:
 	Connection(NetSessions* s, HashKey* k, double t, const ConnID* id,
 	           uint32 flow, const Packet* pkt, const EncapsulationStack* arg_encap);
@@ -127,6 +140,21 @@ public:
 	void SetRecordCurrentContent(int do_record)
 		{ record_current_content = do_record; }
 
+	// Keeps a copy of the packet in the connection's ring, if there's
+	// one, or writes it out if the connection's packets are being
+	// dumped.
+	void BufferPacket(const Packet* pkt)
+		{
+		if ( packet_dump_file || BifConst::packet_ring_packets )
+			DoBufferPacket(pkt);
+		}
+
+	// Writes the packets buffered so far to a trace file, and all
+	// further ones of the connection as well. Returns false if the file
+	// can't be opened, or if the connection's packets already go to
+	// another one.
+	bool DumpPackets(const string& path);
+
 	// FIXME: Now this is in Analyzer and should eventually be removed here.
 	//
 	// If true, skip processing of remainder of connection.  Note
@@ -135,6 +163,62 @@ public:
 	void SetSkip(int do_skip)		{ skip = do_skip; }
 	int Skipping() const			{ return skip; }
 
+	// Stops all processing of the connection.  From then on, its
+	// packets get discarded right after the connection lookup, with
+	// just their sizes counted towards BypassedBytes().  The packet
+	// sources get asked to stop delivering them in the first place.
+	void Bypass();
+	bool IsBypassed() const			{ return bypassed; }
+
+	// Accounts for a packet that got discarded because of Bypass().
+	void BypassedPacket(double t, int is_orig, uint32 len)
+		{
+		last_time = t;
+
+		if ( is_orig )
+			bypassed_orig_bytes += len;
+		else
+			bypassed_resp_bytes += len;
+		}
+
+	// Accounts for a packet that's getting processed.
+	void CountBytes(uint32 len)		{ ip_bytes += len; }
+
+	// Returns the IP-level bytes of the packets processed so far, in
+	// both directions together.
+	uint64 IPBytes() const			{ return ip_bytes; }
+
+	// Returns the IP-level bytes discarded because of Bypass().
+	uint64 BypassedBytes(int is_orig) const
+		{ return is_orig ? bypassed_orig_bytes : bypassed_resp_bytes; }
+
+	// Counts a packet that the transport analyzer passed on, for the
+	// endpoint's num_pkts and num_bytes_ip, and checks the thresholds
+	// that set_current_conn_*_threshold() arm.
+	void CountPacket(bool is_orig, uint32 ip_len)
+		{
+		int i = is_orig ? 0 : 1;
+		++num_pkts[i];
+		num_bytes_ip[i] += ip_len;
+
+		if ( pkts_thresh[i] | bytes_thresh[i] )
+			CheckSizeThresholds(is_orig);
+		}
+
+	uint64 NumPackets(bool is_orig) const	{ return num_pkts[is_orig ? 0 : 1]; }
+	uint64 NumIPBytes(bool is_orig) const	{ return num_bytes_ip[is_orig ? 0 : 1]; }
+
+	// Sets the packet or byte count at which to raise
+	// conn_packets_threshold_crossed or conn_bytes_threshold_crossed,
+	// once; zero for none. If it's crossed already, the event comes
+	// right away.
+	void SetSizeThreshold(uint64 threshold, bool bytes, bool is_orig);
+	uint64 SizeThreshold(bool bytes, bool is_orig) const
+		{
+		int i = is_orig ? 0 : 1;
+		return bytes ? bytes_thresh[i] : pkts_thresh[i];
+		}
+
 	// Arrange for the connection to expire after the given amount of time.
 	void SetLifetime(double lifetime);
 
@@ -150,7 +234,17 @@ public:
 	// Activate connection_status_update timer.
 	void EnableStatusUpdateTimer();
 
+	// Returns the connection record, creating it on first use. The
+	// analyzers' part of it, i.e. the $orig and $resp endpoints, is
+	// left for later: CompleteConnVal() fills it in, which the event
+	// manager does when queueing an event whose handlers may look at
+	// it.
 	RecordVal* BuildConnVal();
+
+	// Brings the endpoints of the connection record up to date, if
+	// outdated.
+	void CompleteConnVal();
+
 	void AppendAddl(const char* str);
 
 	LoginConn* AsLoginConn()		{ return login_conn; }
@@ -259,6 +353,16 @@ public:
 	const EncapsulationStack* GetEncapsulation() const
 		{ return encapsulation; }
 
+	// Returns the counts of the weirds seen for this connection, for
+	// the Reporter's sampling.
+	WeirdStateMap* GetWeirdState()
+		{
+		if ( ! weird_state )
+			weird_state = new WeirdStateMap;
+
+		return weird_state;
+		}
+
 	void CheckFlowLabel(bool is_orig, uint32 flow_label);
 
 	uint32 GetOrigFlowLabel() { return orig_flow_label; }
@@ -266,7 +370,35 @@ public:
 
 protected:
 
-	Connection()	{ persistent = 0; }
+	// Raises the threshold events that are due, disarming them.
+	void CheckSizeThresholds(bool is_orig);
+
+	// For unserialization, which fills in the rest. Members that the
+	// serialized state doesn't cover get their defaults here.
+	Connection()
+		{
+		persistent = 0;
+		conn_val_outdated = 0;
+		bypassed = 0;
+		bypassed_orig_bytes = bypassed_resp_bytes = 0;
+		ip_bytes = 0;
+		num_pkts[0] = num_pkts[1] = 0;
+		num_bytes_ip[0] = num_bytes_ip[1] = 0;
+		pkts_thresh[0] = pkts_thresh[1] = 0;
+		bytes_thresh[0] = bytes_thresh[1] = 0;
+		orig_flow_label = resp_flow_label = 0;
+		vlan = inner_vlan = 0;
+		bzero(orig_l2_addr, sizeof(orig_l2_addr));
+		bzero(resp_l2_addr, sizeof(resp_l2_addr));
+		sweep_due = 0;
+		sweep_idx = -1;
+		encapsulation = 0;
+		weird_state = 0;
+		packet_ring = 0;
+		packet_dump_file = 0;
+		record_current_packet = record_current_content = 0;
+		saw_first_orig_packet = saw_first_resp_packet = 0;
+		}
 
 	// Add the given timer to expire at time t.  If do_expire
 	// is true, then the timer is also evaluated when Bro terminates,
@@ -276,8 +408,15 @@ protected:
 
 	void RemoveTimer(Timer* t);
 
+	void DoBufferPacket(const Packet* pkt);
+
 	// Allow other classes to access pointers to these:
 	friend class ConnectionTimer;
+	friend class InactivitySweeper;
+
+	// Returns the sweeper to track our inactivity with, or null if
+	// we use timers.
+	InactivitySweeper* GetInactivitySweeper() const;
 
 	void InactivityTimer(double t);
 	void StatusUpdateTimer(double t);
@@ -300,21 +439,36 @@ protected:
 	u_char resp_l2_addr[Packet::l2_addr_len];	// Link-layer responder address, if available
 	double start_time, last_time;
 	double inactivity_timeout;
+	double sweep_due;	// Bucket of the InactivitySweeper; 0 if none.
+	int sweep_idx;	// Position inside that bucket.
 	RecordVal* conn_val;
 	LoginConn* login_conn;	// either nil, or this
 	const EncapsulationStack* encapsulation; // tunnels
+	WeirdStateMap* weird_state;	// allocated on the first weird
+	PacketRing* packet_ring;	// recent packets, if buffering them
+	PacketDumpFile* packet_dump_file;	// where DumpPackets() writes to
 	int suppress_event;	// suppress certain events to once per conn.
+	uint64 bypassed_orig_bytes, bypassed_resp_bytes;
+	uint64 ip_bytes;	// of the packets processed, both directions
+
+	// What the transport analyzers passed on, indexed by ! is_orig.
+	uint64 num_pkts[2];
+	uint64 num_bytes_ip[2];
+	uint64 pkts_thresh[2];
+	uint64 bytes_thresh[2];
 
 	unsigned int installed_status_timer:1;
 	unsigned int timers_canceled:1;
 	unsigned int is_active:1;
 	unsigned int skip:1;
+	unsigned int bypassed:1;
 	unsigned int weird:1;
 	unsigned int finished:1;
 	unsigned int record_packets:1, record_contents:1;
 	unsigned int persistent:1;
 	unsigned int record_current_packet:1, record_current_content:1;
 	unsigned int saw_first_orig_packet:1, saw_first_resp_packet:1;
+	unsigned int conn_val_outdated:1;	// see CompleteConnVal()
 
 	// Count number of connections.
 	static uint64 total_connections;
@@ -352,6 +506,51 @@ protected:
 	int do_expire;
 };
 
+// With lazy inactivity timeouts, connections don't keep a timer for
+// their inactivity. Instead, the sweeper keeps them in coarse buckets by
+// deadline and, when a bucket comes due, checks all its connections in a
+// batch. Those that have seen activity in the meantime just move on to a
+// later bucket, so that busy connections don't generate timers anymore.
+// A single timer in the manager drives the sweeps.
+class InactivitySweeper {
+public:
+	// granularity is the time span covered by each bucket, which is
+	// also how late a timeout may get reported.
+	InactivitySweeper(TimerMgr* mgr, double granularity);
+	~InactivitySweeper();
+
+	// Makes sure that the connection gets checked no later than its
+	// current deadline.
+	void Schedule(Connection* c);
+
+	// Stops tracking the connection.
+	void Unschedule(Connection* c);
+
+	// Checks the connections of all buckets that are due by time t.
+	void Sweep(double t);
+
+	// Called by our timer when the manager drops it without a sweep.
+	void TimerExpired()	{ timer = 0; }
+
+	int Size() const	{ return num_conns; }
+
+private:
+	// Makes sure our timer fires when the first bucket is due.
+	void Arm();
+
+	typedef std::vector<Connection*> bucket;
+	typedef std::map<double, bucket> bucket_map;
+
+	TimerMgr* mgr;
+	double granularity;
+	bucket_map buckets;
+	int num_conns;
+	bool sweeping;
+
+	Timer* timer;	// Our pending timer, if any.
+	double timer_time;
+};
+
 #define ADD_TIMER(timer, t, do_expire, type) \
 	AddTimer(timer_func(timer), (t), (do_expire), (type))
 
@@ -0,0 +1,189 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include "ConnCompressor.h"
+#include "Event.h"
+#include "Hash.h"
+#include "IP.h"
+#include "Net.h"
+#include "NetVar.h"
+#include "net_util.h"
+
+ConnCompressor::Pending::~Pending()
+	{
+	delete syn;
+	delete key;
+	}
+
+ConnCompressor::ConnCompressor()
+	{
+	next_report = 0;
+	replaying = false;
+	num_promoted = num_summarized = 0;
+	}
+
+ConnCompressor::~ConnCompressor()
+	{
+	while ( ! expire_list.empty() )
+		{
+		Pending* p = expire_list.front();
+		Remove(p);
+		delete p;
+		}
+	}
+
+bool ConnCompressor::NextPacket(double t, HashKey* key, const Packet* pkt,
+				const IP_Hdr* ip, const struct tcphdr* tp,
+				Pending** promote)
+	{
+	*promote = 0;
+
+	if ( replaying )
+		return false;
+
+	bool bare_syn = (tp->th_flags & (TH_SYN|TH_ACK|TH_RST|TH_FIN)) == TH_SYN;
+	Pending* p = (Pending*) pending.Lookup(key);
+
+	if ( p )
+		{
+		if ( bare_syn && ip->SrcAddr() == p->orig )
+			{
+			// A retransmission, still unanswered.
+			++p->packets;
+			p->last_seen = t;
+			return true;
+			}
+
+		Remove(p);
+		++num_promoted;
+		*promote = p;
+		return false;
+		}
+
+	if ( ! bare_syn )
+		return false;
+
+	// We can only replay the SYN later if it's what starts the captured
+	// packet, and if it's entirely there. SYNs carrying data go the
+	// regular way.
+	const u_char* ip_data = ip->IP4_Hdr() ?
+		(const u_char*) ip->IP4_Hdr() : (const u_char*) ip->IP6_Hdr();
+
+	if ( ip_data != pkt->data + pkt->hdr_size ||
+	     pkt->cap_len < pkt->len ||
+	     ip->PayloadLen() != (uint32) tp->th_off * 4 )
+		return false;
+
+	if ( pending.Length() >= int(BifConst::conn_compressor_max_pending) )
+		return false;
+
+	struct timeval ts = pkt->ts;
+
+	p = new Pending;
+	p->syn = new Packet(pkt->link_type, &ts, pkt->cap_len, pkt->len,
+			    pkt->data, true, pkt->tag);
+	p->first_seen = p->last_seen = t;
+	p->packets = 1;
+	p->orig = ip->SrcAddr();
+	p->key = new HashKey(key->Key(), key->Size(), key->Hash());
+	p->expire_pos = expire_list.insert(expire_list.end(), p);
+
+	pending.Insert((void*) p->key->Key(), p->key->Size(), p->key->Hash(), p, 1);
+
+	return true;
+	}
+
+void ConnCompressor::Remove(Pending* p)
+	{
+	pending.Remove(p->key);
+	expire_list.erase(p->expire_pos);
+	}
+
+void ConnCompressor::Summarize(Pending* p)
+	{
+	++num_summarized;
+
+	if ( connection_attempt_summary )
+		{
+		summary_map::iterator i = summaries.find(p->orig);
+
+		if ( i == summaries.end() )
+			{
+			Summary s;
+			s.attempts = 0;
+			s.packets = 0;
+			s.first_seen = p->first_seen;
+			s.last_seen = p->last_seen;
+			i = summaries.insert(summary_map::value_type(p->orig, s)).first;
+			}
+
+		Summary& s = i->second;
+		++s.attempts;
+		s.packets += p->packets;
+
+		if ( p->first_seen < s.first_seen )
+			s.first_seen = p->first_seen;
+
+		if ( p->last_seen > s.last_seen )
+			s.last_seen = p->last_seen;
+		}
+
+	delete p;
+	}
+
+void ConnCompressor::DoExpire(double t)
+	{
+	while ( ! expire_list.empty() )
+		{
+		Pending* p = expire_list.front();
+
+		// Retransmissions don't extend the timeout; when the
+		// original SYN didn't get a reply in time, they're
+		// unlikely to either.
+		if ( p->first_seen + tcp_attempt_delay > t )
+			break;
+
+		Remove(p);
+		Summarize(p);
+		}
+
+	if ( t >= next_report )
+		{
+		if ( next_report > 0 )
+			Report();
+
+		next_report = t + BifConst::conn_compressor_summary_interval;
+		}
+	}
+
+void ConnCompressor::Drain()
+	{
+	while ( ! expire_list.empty() )
+		{
+		Pending* p = expire_list.front();
+		Remove(p);
+		Summarize(p);
+		}
+
+	Report();
+	}
+
+void ConnCompressor::Report()
+	{
+	for ( summary_map::const_iterator i = summaries.begin();
+	      i != summaries.end(); ++i )
+		{
+		const Summary& s = i->second;
+
+		val_list* vl = new val_list(5);
+		vl->append(new AddrVal(i->first));
+		vl->append(new Val(s.attempts, TYPE_COUNT));
+		vl->append(new Val(s.packets, TYPE_COUNT));
+		vl->append(new Val(s.first_seen, TYPE_TIME));
+		vl->append(new Val(s.last_seen, TYPE_TIME));
+		mgr.QueueEvent(connection_attempt_summary, vl);
+		}
+
+	summaries.clear();
+	}
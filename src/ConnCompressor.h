@@ -0,0 +1,147 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef connCompressor_h
+#define connCompressor_h
+
+#include <list>
+#include <map>
+
+#include "Dict.h"
+#include "IPAddr.h"
+#include "iosource/Packet.h"
+
+class HashKey;
+class IP_Hdr;
+struct tcphdr;
+
+/**
+ * Holds back the TCP connection attempts that nobody has answered yet,
+ * so that scans and SYN floods don't cost a full Connection (with its
+ * analyzer tree, timers, and eventually a conn.log entry) per probe. An
+ * attempt keeps just a copy of its SYN until anything else shows up for
+ * it; then NetSessions instantiates the Connection as usual, replaying the
+ * SYN first. Attempts that time out without a reply only count towards
+ * per-originator summaries instead, which get reported periodically
+ * through connection_attempt_summary.
+ *
+ * That means that for these attempts, there are no new_connection,
+ * connection_attempt, or connection_state_remove events, and scripts see
+ * promoted connections only once the second packet arrives.
+ */
+class ConnCompressor {
+public:
+	/**
+	 * An attempt that's being held back.
+	 */
+	struct Pending {
+		Packet* syn;	// copy of the first SYN
+		double first_seen;
+		double last_seen;
+		uint32 packets;	// including retransmissions
+		IPAddr orig;
+		HashKey* key;
+		std::list<Pending*>::iterator expire_pos;
+
+		~Pending();
+	};
+
+	ConnCompressor();
+	~ConnCompressor();
+
+	/**
+	 * Looks at a TCP packet of a connection that NetSessions doesn't know.
+	 *
+	 * @param t The packet's time.
+	 *
+	 * @param key The connection's key. It stays the caller's.
+	 *
+	 * @param pkt The packet, which must not be encapsulated.
+	 *
+	 * @param ip The packet's IP header.
+	 *
+	 * @param tp The packet's TCP header.
+	 *
+	 * @param promote Set to the pending attempt if the packet continues
+	 * one, which the caller must then replay before processing the
+	 * packet itself, and delete afterwards. Set to null otherwise.
+	 *
+	 * @return True if the packet went into a pending attempt, and needs
+	 * no further processing.
+	 */
+	bool NextPacket(double t, HashKey* key, const Packet* pkt,
+			const IP_Hdr* ip, const struct tcphdr* tp,
+			Pending** promote);
+
+	/**
+	 * Tells the compressor that the caller is replaying a promoted SYN,
+	 * which NextPacket() mustn't take again.
+	 */
+	void SetReplaying(bool arg_replaying)	{ replaying = arg_replaying; }
+
+	/**
+	 * Summarizes the attempts that have timed out by t, and reports the
+	 * summaries if it's time to.
+	 */
+	void Expire(double t)
+		{
+		if ( ! expire_list.empty() || t >= next_report )
+			DoExpire(t);
+		}
+
+	/**
+	 * Summarizes all pending attempts and reports the summaries, for
+	 * shutting down.
+	 */
+	void Drain();
+
+	/**
+	 * @return The number of pending attempts.
+	 */
+	int NumPending() const	{ return pending.Length(); }
+
+	/**
+	 * @return The number of attempts that turned into connections.
+	 */
+	uint64 NumPromoted() const	{ return num_promoted; }
+
+	/**
+	 * @return The number of attempts that timed out into summaries.
+	 */
+	uint64 NumSummarized() const	{ return num_summarized; }
+
+private:
+	struct Summary {
+		uint64 attempts;
+		uint64 packets;
+		double first_seen;
+		double last_seen;
+	};
+
+	void DoExpire(double t);
+
+	// Removes the attempt from the table and the expiration list.
+	void Remove(Pending* p);
+
+	// Counts a dead attempt towards its originator's summary, and
+	// deletes it.
+	void Summarize(Pending* p);
+
+	void Report();
+
+	Dictionary pending;
+
+	// The pending attempts, oldest first. As they all have the same
+	// timeout, that's also the order they expire in.
+	std::list<Pending*> expire_list;
+
+	typedef std::map<IPAddr, Summary> summary_map;
+	summary_map summaries;
+
+	double next_report;
+	bool replaying;
+
+	uint64 num_promoted;
+	uint64 num_summarized;
+};
+
+#endif
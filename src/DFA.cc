@@ -2,10 +2,11 @@
 
 #include "bro-config.h"
 
-#include <openssl/md5.h>
+#include <vector>
 
 #include "EquivClass.h"
 #include "DFA.h"
+#include "NetVar.h"
 
 unsigned int DFA_State::transition_counter = 0;
 
@@ -19,12 +20,15 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 	accept = arg_accept;
 	mark = 0;
 	centry = 0;
+	used = true;
 
 	SymPartition(ec);
 
-	xtions = new DFA_State*[num_sym];
+	num_xtions = meta_ec->NumClasses();
+	sym_class = meta_ec->EquivClasses();
+	xtions = new DFA_State*[num_xtions];
 
-	for ( int i = 0; i < num_sym; ++i )
+	for ( int i = 0; i < num_xtions; ++i )
 		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
 	}
 
@@ -38,7 +42,19 @@ DFA_State::~DFA_State()
 
 void DFA_State::AddXtion(int sym, DFA_State* next_state)
 	{
-	xtions[sym] = next_state;
+	xtions[sym_class[sym]] = next_state;
+	}
+
+void DFA_State::ResetXtions(bool evicted_only)
+	{
+	for ( int i = 0; i < num_xtions; ++i )
+		{
+		DFA_State* s = xtions[i];
+
+		if ( ! evicted_only ||
+		     (s && s != DFA_UNCOMPUTED_STATE_PTR && ! s->centry) )
+			xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+		}
 	}
 
 void DFA_State::SymPartition(const EquivClass* ec)
@@ -76,22 +92,15 @@ void DFA_State::SymPartition(const EquivClass* ec)
 
 DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	{
-	int equiv_sym = meta_ec->EquivRep(sym);
-	if ( xtions[equiv_sym] != DFA_UNCOMPUTED_STATE_PTR )
-		{
-		AddXtion(sym, xtions[equiv_sym]);
-		return xtions[sym];
-		}
-
 	const EquivClass* ec = machine->EC();
 
 	DFA_State* next_d;
 
-	NFA_state_list* ns = SymFollowSet(equiv_sym, ec);
+	NFA_state_list* ns = SymFollowSet(meta_ec->EquivRep(sym), ec);
 	if ( ns->length() > 0 )
 		{
 		NFA_state_list* state_set = epsilon_closure(ns);
-		if ( ! machine->StateSetToDFA_State(state_set, next_d, ec) )
+		if ( ! machine->StateSetToDFA_State(state_set, next_d, ec, this) )
 			delete state_set;
 		}
 	else
@@ -100,11 +109,13 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 		next_d = 0;	// Jam
 		}
 
-	AddXtion(equiv_sym, next_d);
-	if ( sym != equiv_sym )
+	// A state evicted from the cache doesn't record the transition, as
+	// the cache wouldn't know to drop it when evicting next_d later.
+	if ( centry )
 		AddXtion(sym, next_d);
 
-	return xtions[sym];
+	used = true;
+	return next_d;
 	}
 
 void DFA_State::AppendIfNew(int sym, int_list* sym_list)
@@ -185,7 +196,7 @@ void DFA_State::ClearMarks()
 		{
 		SetMark(0);
 
-		for ( int i = 0; i < num_sym; ++i )
+		for ( int i = 0; i < num_xtions; ++i )
 			{
 			DFA_State* s = xtions[i];
 
@@ -220,7 +231,7 @@ void DFA_State::Dump(FILE* f, DFA_Machine* m)
 	int num_trans = 0;
 	for ( int sym = 0; sym < num_sym; ++sym )
 		{
-		DFA_State* s = xtions[sym];
+		DFA_State* s = xtions[sym_class[sym]];
 
 		if ( ! s )
 			continue;
@@ -228,7 +239,7 @@ void DFA_State::Dump(FILE* f, DFA_Machine* m)
 		// Look ahead for compression.
 		int i;
 		for ( i = sym + 1; i < num_sym; ++i )
-			if ( xtions[i] != s )
+			if ( xtions[sym_class[i]] != s )
 				break;
 
 		char xbuf[512];
@@ -258,9 +269,9 @@ void DFA_State::Dump(FILE* f, DFA_Machine* m)
 
 	SetMark(this);
 
-	for ( int sym = 0; sym < num_sym; ++sym )
+	for ( int i = 0; i < num_xtions; ++i )
 		{
-		DFA_State* s = xtions[sym];
+		DFA_State* s = xtions[i];
 
 		if ( s && s != DFA_UNCOMPUTED_STATE_PTR )
 			s->Dump(f, m);
@@ -271,7 +282,7 @@ void DFA_State::Stats(unsigned int* computed, unsigned int* uncomputed)
 	{
 	for ( int sym = 0; sym < num_sym; ++sym )
 		{
-		DFA_State* s = xtions[sym];
+		DFA_State* s = xtions[sym_class[sym]];
 
 		if ( s == DFA_UNCOMPUTED_STATE_PTR )
 			(*uncomputed)++;
@@ -283,7 +294,7 @@ void DFA_State::Stats(unsigned int* computed, unsigned int* uncomputed)
 unsigned int DFA_State::Size()
 	{
 	return sizeof(*this)
-		+ pad_size(sizeof(DFA_State*) * num_sym)
+		+ pad_size(sizeof(DFA_State*) * num_xtions)
 		+ (accept ? pad_size(sizeof(int) * accept->size()) : 0)
 		+ (nfa_states ? pad_size(sizeof(NFA_State*) * nfa_states->length()) : 0)
 		+ (meta_ec ? meta_ec->Size() : 0)
@@ -292,7 +303,7 @@ unsigned int DFA_State::Size()
 
 DFA_State_Cache::DFA_State_Cache()
 	{
-	hits = misses = 0;
+	hits = misses = evictions = 0;
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
@@ -311,33 +322,28 @@ DFA_State_Cache::~DFA_State_Cache()
 DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas,
 						HashKey** hash)
 	{
-	// We assume that state ID's don't exceed 10 digits, plus
-	// we allow one more character for the delimiter.
-	u_char id_tag[nfas.length() * 11 + 1];
-	u_char* p = id_tag;
+	// The key is a digest of the (sorted) state IDs rather than the
+	// IDs themselves, because the data is copied into the key. It's two
+	// independent 64-bit hashes, computed in a single pass, which is
+	// plenty to tell apart the states of one machine.
+	uint64 digest[2];
+	digest[0] = 0xcbf29ce484222325ULL;	// FNV-1a
+	digest[1] = nfas.length();
 
 	for ( int i = 0; i < nfas.length(); ++i )
 		{
 		NFA_State* n = nfas[i];
 		if ( n->TransSym() != SYM_EPSILON || n->Accept() != NO_ACCEPT )
 			{
-			int id = n->ID();
-			do
-				{
-				*p++ = '0' + (char)(id % 10);
-				id /= 10;
-				}
-			while ( id > 0 );
-			*p++ = '&';
-			}
-		}
+			uint64 id = n->ID();
 
-	*p++ = '\0';
+			digest[0] = (digest[0] ^ id) * 0x100000001b3ULL;
 
-	// We use the short MD5 instead of the full string for the
-	// HashKey because the data is copied into the key.
-	u_char digest[16];
-	MD5(id_tag, p - id_tag, digest);
+			digest[1] += id;
+			digest[1] *= 0x9e3779b97f4a7c15ULL;
+			digest[1] ^= digest[1] >> 29;
+			}
+		}
 
 	*hash = new HashKey(&digest, sizeof(digest));
 	CacheEntry* e = states.Lookup(*hash);
@@ -354,8 +360,12 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas,
 	return e->state;
 	}
 
-DFA_State* DFA_State_Cache::Insert(DFA_State* state, HashKey* hash)
+DFA_State* DFA_State_Cache::Insert(DFA_State* state, HashKey* hash,
+					const DFA_State* keep)
 	{
+	if ( dfa_state_cache_size > 0 && states.Length() >= dfa_state_cache_size )
+		Evict(keep);
+
 	CacheEntry* e;
 
 	e = new CacheEntry;
@@ -369,6 +379,62 @@ DFA_State* DFA_State_Cache::Insert(DFA_State* state, HashKey* hash)
 	return e->state;
 	}
 
+void DFA_State_Cache::Evict(const DFA_State* keep)
+	{
+	// We make room for a quarter of the maximum right away, so that
+	// the next round doesn't come soon. States that haven't been used
+	// since the previous round go first, and all start over as unused.
+	// States referenced from elsewhere stay, as matchers sit on them
+	// (or the machine starts from them).
+	int num_evict = states.Length() - dfa_state_cache_size * 3 / 4;
+
+	std::vector<CacheEntry*> victims;
+	std::vector<CacheEntry*> warm;
+
+	IterCookie* i = states.InitForIteration();
+	CacheEntry* e;
+	while ( (e = (CacheEntry*) states.NextEntry(i)) )
+		{
+		DFA_State* s = e->state;
+
+		if ( s != keep && s->RefCnt() == 1 )
+			{
+			if ( s->used )
+				warm.push_back(e);
+			else
+				victims.push_back(e);
+			}
+
+		s->used = false;
+		}
+
+	for ( unsigned int j = 0;
+	      j < warm.size() && int(victims.size()) < num_evict; ++j )
+		victims.push_back(warm[j]);
+
+	for ( unsigned int j = 0; j < victims.size(); ++j )
+		{
+		states.Remove(victims[j]->hash);
+		victims[j]->state->centry = 0;
+		}
+
+	// Drop the transitions into evicted states.
+	i = states.InitForIteration();
+	while ( (e = (CacheEntry*) states.NextEntry(i)) )
+		e->state->ResetXtions(true);
+
+	for ( unsigned int j = 0; j < victims.size(); ++j )
+		{
+		e = victims[j];
+		e->state->ResetXtions(false);
+		Unref(e->state);
+		delete e->hash;
+		delete e;
+		}
+
+	evictions += victims.size();
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -378,6 +444,7 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->evictions = evictions;
 
 	CacheEntry* e;
 
@@ -409,6 +476,9 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 		{
 		NFA_state_list* state_set = epsilon_closure(ns);
 		(void) StateSetToDFA_State(state_set, start_state, ec);
+
+		// Keeps the cache from evicting it.
+		Ref(start_state);
 		}
 	else
 		{
@@ -419,6 +489,7 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 
 DFA_Machine::~DFA_Machine()
 	{
+	Unref(start_state);
 	delete dfa_state_cache;
 	Unref(nfa);
 	}
@@ -447,7 +518,8 @@ unsigned int DFA_Machine::MemoryAllocation() const
 	}
 
 int DFA_Machine::StateSetToDFA_State(NFA_state_list* state_set,
-				DFA_State*& d, const EquivClass* ec)
+				DFA_State*& d, const EquivClass* ec,
+				const DFA_State* keep)
 	{
 	HashKey* hash;
 	d = dfa_state_cache->Lookup(*state_set, &hash);
@@ -472,7 +544,7 @@ int DFA_Machine::StateSetToDFA_State(NFA_state_list* state_set,
 		}
 
 	DFA_State* ds = new DFA_State(state_count++, ec, state_set, accept);
-	d = dfa_state_cache->Insert(ds, hash);
+	d = dfa_state_cache->Insert(ds, hash, keep);
 
 	return 1;
 	}
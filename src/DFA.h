@@ -31,6 +31,10 @@ public:
 
 	inline DFA_State* Xtion(int sym, DFA_Machine* machine);
 
+	// Returns true if the state is still in its machine's cache. States
+	// that have been evicted from it don't keep their transitions.
+	bool IsCached() const	{ return centry != 0; }
+
 	const AcceptingSet* Accept() const	{ return accept; }
 	void SymPartition(const EquivClass* ec);
 
@@ -53,12 +57,25 @@ protected:
 	friend class DFA_State_Cache;
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
+
+	// Marks transitions as uncomputed: all of them, or just those into
+	// states evicted from the cache.
+	void ResetXtions(bool evicted_only);
 	void AppendIfNew(int sym, int_list* sym_list);
 
 	int state_num;
 	int num_sym;
+	int num_xtions;
 
+	// Transitions are the same for all symbols in one of the meta
+	// equivalence classes, so we keep just one per class. sym_class
+	// maps symbols to classes.
 	DFA_State** xtions;
+	const int* sym_class;
+
+	// Set when we transition out of the state; the cache evicts states
+	// that haven't been used since the previous round of evictions.
+	bool used;
 
 	AcceptingSet* accept;
 	NFA_state_list* nfa_states;
@@ -84,7 +101,11 @@ public:
 					HashKey** hash);
 
 	// Takes ownership of both; hash is the one returned by Lookup().
-	DFA_State* Insert(DFA_State* state, HashKey* hash);
+	// If the cache is full, first evicts states that haven't been used
+	// recently, except for keep and the states referenced from
+	// elsewhere.
+	DFA_State* Insert(DFA_State* state, HashKey* hash,
+				const DFA_State* keep = 0);
 
 	int NumEntries() const	{ return states.Length(); }
 
@@ -97,13 +118,17 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int evictions;
 	};
 
 	void GetStats(Stats* s);
 
 private:
+	void Evict(const DFA_State* keep);
+
 	int hits;	// Statistics
 	int misses;
+	int evictions;
 
 	declare(PDict,CacheEntry);
 
@@ -140,9 +165,11 @@ protected:
 
 	int state_count;
 
-	// The state list has to be sorted according to IDs.
+	// The state list has to be sorted according to IDs. If a new state
+	// needs to go into the cache, the cache won't evict keep to make
+	// room for it.
 	int StateSetToDFA_State(NFA_state_list* state_set, DFA_State*& d,
-				const EquivClass* ec);
+				const EquivClass* ec, const DFA_State* keep = 0);
 	const EquivClass* EC() const	{ return ec; }
 
 	EquivClass* ec;	// equivalence classes corresponding to NFAs
@@ -154,10 +181,13 @@ protected:
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
 	{
-	if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
+	DFA_State* next = xtions[sym_class[sym]];
+
+	if ( next == DFA_UNCOMPUTED_STATE_PTR )
 		return ComputeXtion(sym, machine);
-	else
-		return xtions[sym];
+
+	used = true;
+	return next;
 	}
 
 #endif
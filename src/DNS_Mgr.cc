@@ -100,7 +100,10 @@ class DNS_Mapping {
 public:
 	DNS_Mapping(const char* host, struct hostent* h, uint32 ttl);
 	DNS_Mapping(const IPAddr& addr, struct hostent* h, uint32 ttl);
-	DNS_Mapping(FILE* f);
+
+	// Reads the next mapping from a cache file, in the binary format
+	// that Save() writes or else in the older text one.
+	DNS_Mapping(FILE* f, bool binary);
 
 	int NoMapping() const		{ return no_mapping; }
 	int InitFailed() const		{ return init_failed; }
@@ -128,6 +131,10 @@ public:
 
 	bool Expired() const
 		{
+		if ( failed )
+			// Negatively cached for as long as the TTL says.
+			return current_time() > (creation_time + req_ttl);
+
 		if ( req_host && num_addrs == 0)
 			return false; // nothing to expire
 
@@ -142,6 +149,9 @@ protected:
 	void Init(struct hostent* h);
 	void Clear();
 
+	void LoadText(FILE* f);
+	void LoadBinary(FILE* f);
+
 	int no_mapping;	// when initializing from a file, immediately hit EOF
 	int init_failed;
 
@@ -160,6 +170,10 @@ protected:
 	int failed;
 	double creation_time;
 	int map_type;
+
+	// When the mapping was last used, for evicting the least recently
+	// used ones first. The DNS_Mgr counts the uses.
+	uint64 last_used;
 };
 
 void DNS_Mgr_mapping_delete_func(void* v)
@@ -194,7 +208,7 @@ DNS_Mapping::DNS_Mapping(const IPAddr& addr, struct hostent* h, uint32 ttl)
 	req_ttl = ttl;
 	}
 
-DNS_Mapping::DNS_Mapping(FILE* f)
+DNS_Mapping::DNS_Mapping(FILE* f, bool binary)
 	{
 	Clear();
 	init_failed = 1;
@@ -202,7 +216,16 @@ DNS_Mapping::DNS_Mapping(FILE* f)
 	req_host = 0;
 	req_ttl = 0;
 	creation_time = 0;
+	last_used = 0;
 
+	if ( binary )
+		LoadBinary(f);
+	else
+		LoadText(f);
+	}
+
+void DNS_Mapping::LoadText(FILE* f)
+	{
 	char buf[512];
 
 	if ( ! fgets(buf, sizeof(buf), f) )
@@ -253,6 +276,92 @@ DNS_Mapping::DNS_Mapping(FILE* f)
 	init_failed = 0;
 	}
 
+// Reads len bytes, returning false if the file ends before.
+static bool read_bytes(FILE* f, void* data, size_t len)
+	{
+	return fread(data, 1, len, f) == len;
+	}
+
+// Reads a string that write_string() wrote, with an empty one standing
+// for none.
+static bool read_string(FILE* f, char** s)
+	{
+	uint32 len;
+
+	if ( ! read_bytes(f, &len, sizeof(len)) || len > 4096 )
+		return false;
+
+	if ( len == 0 )
+		{
+		*s = 0;
+		return true;
+		}
+
+	*s = new char[len + 1];
+	(*s)[len] = '\0';
+
+	return read_bytes(f, *s, len);
+	}
+
+static bool read_addr(FILE* f, IPAddr* addr)
+	{
+	in6_addr in6;
+
+	if ( ! read_bytes(f, &in6, sizeof(in6)) )
+		return false;
+
+	*addr = IPAddr(in6);
+	return true;
+	}
+
+void DNS_Mapping::LoadBinary(FILE* f)
+	{
+	if ( ! read_bytes(f, &creation_time, sizeof(creation_time)) )
+		{
+		no_mapping = 1;
+		return;
+		}
+
+	uint8 flags;
+
+	if ( ! read_bytes(f, &req_ttl, sizeof(req_ttl)) ||
+	     ! read_bytes(f, &map_type, sizeof(map_type)) ||
+	     ! read_bytes(f, &flags, sizeof(flags)) )
+		return;
+
+	failed = (flags & 2) != 0;
+
+	if ( flags & 1 )
+		{
+		if ( ! read_string(f, &req_host) )
+			return;
+		}
+
+	else if ( ! read_addr(f, &req_addr) )
+		return;
+
+	num_names = 1;
+	names = new char*[num_names];
+	names[0] = 0;
+
+	uint32 n;
+
+	if ( ! read_string(f, &names[0]) ||
+	     ! read_bytes(f, &n, sizeof(n)) || n > 65536 )
+		return;
+
+	if ( n > 0 )
+		{
+		addrs = new IPAddr[n];
+
+		for ( num_addrs = 0; num_addrs < int(n); ++num_addrs )
+			if ( ! read_addr(f, &addrs[num_addrs]) )
+				return;
+		}
+
+	init_failed = 0;
+	}
+
 DNS_Mapping::~DNS_Mapping()
 	{
 	delete [] req_host;
@@ -311,6 +420,7 @@ void DNS_Mapping::Init(struct hostent* h)
 	{
 	no_mapping = 0;
 	init_failed = 0;
+	last_used = 0;
 	creation_time = current_time();
 	host_val = 0;
 	addrs_val = 0;
@@ -358,15 +468,42 @@ void DNS_Mapping::Clear()
 	failed = 1;
 	}
 
+static void write_string(FILE* f, const char* s)
+	{
+	uint32 len = s ? strlen(s) : 0;
+	fwrite(&len, sizeof(len), 1, f);
+	fwrite(s, 1, len, f);
+	}
+
+static void write_addr(FILE* f, const IPAddr& addr)
+	{
+	in6_addr in6;
+	addr.CopyIPv6(&in6);
+	fwrite(&in6, sizeof(in6), 1, f);
+	}
+
 void DNS_Mapping::Save(FILE* f) const
 	{
-	fprintf(f, "%.0f %d %s %d %s %d %d %" PRIu32"\n", creation_time, req_host != 0,
-		req_host ? req_host : req_addr.AsString().c_str(),
-		failed, (names && names[0]) ? names[0] : "*",
-		map_type, num_addrs, req_ttl);
+	// The cache is only for ourselves, so it uses host byte order.
+	uint8 flags = (req_host ? 1 : 0) | (failed ? 2 : 0);
+
+	fwrite(&creation_time, sizeof(creation_time), 1, f);
+	fwrite(&req_ttl, sizeof(req_ttl), 1, f);
+	fwrite(&map_type, sizeof(map_type), 1, f);
+	fwrite(&flags, sizeof(flags), 1, f);
+
+	if ( req_host )
+		write_string(f, req_host);
+	else
+		write_addr(f, req_addr);
+
+	write_string(f, names ? names[0] : 0);
+
+	uint32 n = num_addrs;
+	fwrite(&n, sizeof(n), 1, f);
 
 	for ( int i = 0; i < num_addrs; ++i )
-		fprintf(f, "%s\n", addrs[i].AsString().c_str());
+		write_addr(f, addrs[i]);
 	}
 
 
@@ -394,6 +531,9 @@ DNS_Mgr::DNS_Mgr(DNS_MgrMode arg_mode)
 	num_requests = 0;
 	successful = 0;
 	failed = 0;
+	negative_hits = 0;
+	evicted = 0;
+	cache_clock = 0;
 	}
 
 DNS_Mgr::~DNS_Mgr()
@@ -577,7 +717,14 @@ void DNS_Mgr::Verify()
 	{
 	}
 
-#define MAX_PENDING_REQUESTS 20
+// Starts the binary cache files; older ones are text.
+static const char dns_cache_magic[8] = { 'B', 'R', 'O', 'D', 'N', 'S', '1', '\0' };
+
+int DNS_Mgr::MaxPending()
+	{
+	return BifConst::dns_max_pending_requests > 0 ?
+		int(BifConst::dns_max_pending_requests) : 1;
+	}
 
 void DNS_Mgr::Resolve()
 	{
@@ -587,7 +734,7 @@ void DNS_Mgr::Resolve()
 	int i;
 
 	int first_req = 0;
-	int num_pending = min(requests.length(), MAX_PENDING_REQUESTS);
+	int num_pending = min(requests.length(), MaxPending());
 	int last_req = num_pending - 1;
 
 	// Prime with the initial requests.
@@ -616,7 +763,7 @@ void DNS_Mgr::Resolve()
 
 			first_req = last_req + 1;
 			num_pending = min(requests.length() - first_req,
-						MAX_PENDING_REQUESTS);
+						MaxPending());
 			last_req = first_req + num_pending - 1;
 
 			for ( i = first_req; i <= last_req; ++i )
@@ -667,6 +814,7 @@ int DNS_Mgr::Save()
 	if ( ! f )
 		return 0;
 
+	fwrite(dns_cache_magic, sizeof(dns_cache_magic), 1, f);
 	Save(f, host_mappings);
 	Save(f, addr_mappings);
 	// Save(f, text_mappings); // We don't save the TXT mappings (yet?).
@@ -715,7 +863,7 @@ Val* DNS_Mgr::BuildMappingVal(DNS_Mapping* dm)
 	r->Assign(0, new Val(dm->CreationTime(), TYPE_TIME));
 	r->Assign(1, new StringVal(dm->ReqHost() ? dm->ReqHost() : ""));
 	r->Assign(2, new AddrVal(dm->ReqAddr()));
-	r->Assign(3, new Val(dm->Valid(), TYPE_BOOL));
+	r->Assign(3, val_mgr->GetBool(dm->Valid()));
 
 	Val* h = dm->Host();
 	r->Assign(4, h ? h : new StringVal("<none>"));
@@ -729,6 +877,11 @@ void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 	struct hostent* h = (r && r->host_errno == 0) ? r->hostent : 0;
 	u_int32_t ttl = (r && r->host_errno == 0) ? r->ttl : 0;
 
+	if ( r && r->host_errno != 0 )
+		// The server says there's nothing, which we believe for a
+		// while. Without an answer at all, we'll try again next time.
+		ttl = u_int32_t(BifConst::dns_negative_ttl);
+
 	DNS_Mapping* new_dm;
 	DNS_Mapping* prev_dm;
 	int keep_prev = 0;
@@ -812,9 +965,101 @@ void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 		CompareMappings(prev_dm, new_dm);
 
 	if ( keep_prev )
+		{
+		Touch(prev_dm);
 		delete new_dm;
+		}
 	else
+		{
+		Touch(new_dm);
 		delete prev_dm;
+		}
+
+	EnforceCacheLimit();
+	}
+
+void DNS_Mgr::Touch(DNS_Mapping* dm)
+	{
+	dm->last_used = ++cache_clock;
+	}
+
+void DNS_Mgr::EnforceCacheLimit()
+	{
+	size_t max_entries = BifConst::dns_cache_max_entries;
+	size_t n = host_mappings.size() + addr_mappings.size() +
+		text_mappings.size();
+
+	if ( max_entries == 0 || n <= max_entries )
+		return;
+
+	// Entries older than the cutoff go. For a host, that's the more
+	// recent use of its two mappings.
+	std::vector<uint64> uses;
+	uses.reserve(n);
+
+	for ( HostMap::const_iterator i = host_mappings.begin();
+	      i != host_mappings.end(); ++i )
+		{
+		uint64 u4 = i->second.first ? i->second.first->last_used : 0;
+		uint64 u6 = i->second.second ? i->second.second->last_used : 0;
+		uses.push_back(max(u4, u6));
+		}
+
+	for ( AddrMap::const_iterator i = addr_mappings.begin();
+	      i != addr_mappings.end(); ++i )
+		uses.push_back(i->second->last_used);
+
+	for ( TextMap::const_iterator i = text_mappings.begin();
+	      i != text_mappings.end(); ++i )
+		uses.push_back(i->second->last_used);
+
+	size_t num_evict = n - max_entries * 9 / 10;
+	std::nth_element(uses.begin(), uses.begin() + num_evict, uses.end());
+	uint64 cutoff = uses[num_evict];
+
+	for ( HostMap::iterator i = host_mappings.begin();
+	      i != host_mappings.end(); )
+		{
+		DNS_Mapping* d4 = i->second.first;
+		DNS_Mapping* d6 = i->second.second;
+		uint64 u = max(d4 ? d4->last_used : 0, d6 ? d6->last_used : 0);
+
+		if ( u < cutoff )
+			{
+			delete d4;
+			delete d6;
+			host_mappings.erase(i++);
+			++evicted;
+			}
+		else
+			++i;
+		}
+
+	for ( AddrMap::iterator i = addr_mappings.begin();
+	      i != addr_mappings.end(); )
+		{
+		if ( i->second->last_used < cutoff )
+			{
+			delete i->second;
+			addr_mappings.erase(i++);
+			++evicted;
+			}
+		else
+			++i;
+		}
+
+	for ( TextMap::iterator i = text_mappings.begin();
+	      i != text_mappings.end(); )
+		{
+		if ( i->second->last_used < cutoff )
+			{
+			delete i->second;
+			text_mappings.erase(i++);
+			++evicted;
+			}
+		else
+			++i;
+		}
 	}
 
 void DNS_Mgr::CompareMappings(DNS_Mapping* prev_dm, DNS_Mapping* new_dm)
@@ -910,9 +1155,19 @@ void DNS_Mgr::LoadCache(FILE* f)
 	if ( ! f )
 		return;
 
-	DNS_Mapping* m = new DNS_Mapping(f);
-	for ( ; ! m->NoMapping() && ! m->InitFailed(); m = new DNS_Mapping(f) )
+	char magic[sizeof(dns_cache_magic)];
+	bool binary = fread(magic, sizeof(magic), 1, f) == 1 &&
+		memcmp(magic, dns_cache_magic, sizeof(magic)) == 0;
+
+	if ( ! binary )
+		rewind(f);
+
+	DNS_Mapping* m = new DNS_Mapping(f, binary);
+	for ( ; ! m->NoMapping() && ! m->InitFailed();
+	      m = new DNS_Mapping(f, binary) )
 		{
+		Touch(m);
+
 		if ( m->ReqHost() )
 			{
 			if ( host_mappings.find(m->ReqHost()) == host_mappings.end() )
@@ -977,13 +1232,18 @@ const char* DNS_Mgr::LookupAddrInCache(const IPAddr& addr)
 		return 0;
 		}
 
+	Touch(d);
+
 	// The escapes in the following strings are to avoid having it
 	// interpreted as a trigraph sequence.
 	return d->names ? d->names[0] : "<\?\?\?>";
 	}
 
-TableVal* DNS_Mgr::LookupNameInCache(const string& name)
+TableVal* DNS_Mgr::LookupNameInCache(const string& name, bool* failed)
 	{
+	if ( failed )
+		*failed = false;
+
 	HostMap::iterator it = host_mappings.find(name);
 	if ( it == host_mappings.end() )
 		{
@@ -994,7 +1254,8 @@ TableVal* DNS_Mgr::LookupNameInCache(const string& name)
 	DNS_Mapping* d4 = it->second.first;
 	DNS_Mapping* d6 = it->second.second;
 
-	if ( ! d4 || ! d4->names || ! d6 || ! d6->names )
+	if ( ! d4 || ! d6 )
+		// Still waiting for the other half.
 		return 0;
 
 	if ( d4->Expired() || d6->Expired() )
@@ -1005,6 +1266,19 @@ TableVal* DNS_Mgr::LookupNameInCache(const string& name)
 		return 0;
 		}
 
+	if ( d4->Failed() && d6->Failed() )
+		{
+		if ( failed )
+			*failed = true;
+
+		return 0;
+		}
+
+	Touch(d4);
+	Touch(d6);
+
+	// A failed half just contributes no addresses.
+
 	TableVal* tv4 = d4->AddrsSet();
 	TableVal* tv6 = d6->AddrsSet();
 	tv4->AddTo(tv6, false);
@@ -1027,6 +1301,8 @@ const char* DNS_Mgr::LookupTextInCache(const string& name)
 		return 0;
 		}
 
+	Touch(d);
+
 	// The escapes in the following strings are to avoid having it
 	// interpreted as a trigraph sequence.
 	return d->names ? d->names[0] : "<\?\?\?>";
@@ -1098,13 +1374,23 @@ void DNS_Mgr::AsyncLookupName(const string& name, LookupCallback* callback)
 		}
 
 	// Do we already know the answer?
-	TableVal* addrs = LookupNameInCache(name);
+	bool neg = false;
+	TableVal* addrs = LookupNameInCache(name, &neg);
 	if ( addrs )
 		{
 		resolve_lookup_cb(callback, addrs);
 		return;
 		}
 
+	if ( neg )
+		{
+		// We asked recently, without success.
+		++negative_hits;
+		callback->Timeout();
+		delete callback;
+		return;
+		}
+
 	AsyncRequest* req = 0;
 
 	// Have we already a request waiting for this host?
@@ -1179,7 +1465,7 @@ static bool DoRequest(nb_dns_info* nb_dns, DNS_Mgr_Request* dr)
 
 void DNS_Mgr::IssueAsyncRequests()
 	{
-	while ( asyncs_queued.size() && asyncs_pending < MAX_PENDING_REQUESTS )
+	while ( asyncs_queued.size() && asyncs_pending < MaxPending() )
 		{
 		AsyncRequest* req = asyncs_queued.front();
 		asyncs_queued.pop_front();
@@ -1385,19 +1671,24 @@ void DNS_Mgr::DoProcess(bool flush)
 	if ( asyncs_addrs.size() == 0 && asyncs_names.size() == 0 && asyncs_texts.size() == 0 )
 		return;
 
-	if ( AnswerAvailable(0) <= 0 )
-		return;
+	// Take all the answers that have arrived, rather than just one per
+	// round, but not so many that we'd hold up packet processing.
+	for ( int n = MaxPending(); n > 0 && AnswerAvailable(0) > 0; --n )
+		{
+		char err[NB_DNS_ERRSIZE];
+		struct nb_dns_result r;
 
-	char err[NB_DNS_ERRSIZE];
-	struct nb_dns_result r;
+		int status = nb_dns_activity(nb_dns, &r, err);
 
-	int status = nb_dns_activity(nb_dns, &r, err);
+		if ( status < 0 )
+			{
+			reporter->Warning("NB-DNS error in DNS_Mgr::Process (%s)", err);
+			break;
+			}
 
-	if ( status < 0 )
-		reporter->Warning("NB-DNS error in DNS_Mgr::Process (%s)", err);
+		if ( status == 0 )
+			continue;
 
-	else if ( status > 0 )
-		{
 		DNS_Mgr_Request* dr = (DNS_Mgr_Request*) r.cookie;
 
 		bool do_host_timeout = true;
@@ -1475,5 +1766,7 @@ void DNS_Mgr::GetStats(Stats* stats)
 	stats->cached_hosts = host_mappings.size();
 	stats->cached_addresses = addr_mappings.size();
 	stats->cached_texts = text_mappings.size();
+	stats->negative_hits = negative_hits;
+	stats->evicted = evicted;
 	}
 
@@ -61,8 +61,12 @@ public:
 	void Resolve();
 	int Save();
 
+	// These return nil if there's no valid entry in the cache.  For
+	// names, *failed then tells, if given, whether that's because the
+	// lookup failed recently, so that there's no point in trying again
+	// yet.  (Failed address and text lookups cache "<???>".)
 	const char* LookupAddrInCache(const IPAddr& addr);
-	TableVal* LookupNameInCache(const string& name);
+	TableVal* LookupNameInCache(const string& name, bool* failed = 0);
 	const char* LookupTextInCache(const string& name);
 
 	// Support for async lookups.
@@ -88,6 +92,8 @@ public:
 		unsigned long cached_hosts;
 		unsigned long cached_addresses;
 		unsigned long cached_texts;
+		unsigned long negative_hits;	// failed name lookups answered from cache
+		unsigned long evicted;	// entries over dns_cache_max_entries
 	};
 
 	void GetStats(Stats* stats);
@@ -107,6 +113,17 @@ protected:
 	ListVal* AddrListDelta(ListVal* al1, ListVal* al2);
 	void DumpAddrList(FILE* f, ListVal* al);
 
+	// Marks the mapping as just used.
+	void Touch(DNS_Mapping* dm);
+
+	// If the cache holds more than dns_cache_max_entries, evicts the
+	// least recently used entries until it's back at 90% of that, so
+	// that this doesn't happen for every new entry.
+	void EnforceCacheLimit();
+
+	// Number of requests that may be outstanding at the same time.
+	static int MaxPending();
+
 	typedef map<string, pair<DNS_Mapping*, DNS_Mapping*> > HostMap;
 	typedef map<IPAddr, DNS_Mapping*> AddrMap;
 	typedef map<string, DNS_Mapping*> TextMap;
@@ -232,6 +249,10 @@ protected:
 	unsigned long num_requests;
 	unsigned long successful;
 	unsigned long failed;
+	unsigned long negative_hits;
+	unsigned long evicted;
+
+	uint64 cache_clock;	// counts the uses of mappings
 };
 
 extern DNS_Mgr* dns_mgr;
@@ -10,7 +10,6 @@
 #include "File.h"
 #include "Reporter.h"
 
-#define DEFAULT_SIZE 128
 #define SLOP 10
 
 ODesc::ODesc(desc_type t, BroFile* arg_f)
@@ -21,9 +20,9 @@ ODesc::ODesc(desc_type t, BroFile* arg_f)
 
 	if ( f == 0 )
 		{
-		size = DEFAULT_SIZE;
-		base = safe_malloc(size);
-		((char*) base)[0] = '\0';
+		size = INLINE_SIZE;
+		base = inline_buf;
+		inline_buf[0] = '\0';
 		offset = 0;
 		}
 	else
@@ -48,7 +47,7 @@ ODesc::~ODesc()
 		if ( do_flush )
 			f->Flush();
 		}
-	else if ( base )
+	else if ( base != inline_buf )
 		free(base);
 	}
 
@@ -336,25 +335,67 @@ void ODesc::AddBytesRaw(const void* bytes, unsigned int n)
 
 void ODesc::Grow(unsigned int n)
 	{
-	while ( offset + n + SLOP >= size )
+	if ( offset + n + SLOP < size )
+		return;
+
+	unsigned int new_size = size ? size : INLINE_SIZE;
+
+	while ( offset + n + SLOP >= new_size )
+		new_size *= 2;
+
+	if ( base == inline_buf )
+		{
+		base = safe_malloc(new_size);
+		memcpy(base, inline_buf, offset + 1);
+		}
+	else
+		base = safe_realloc(base, new_size);
+
+	size = new_size;
+	}
+
+byte_vec ODesc::TakeBytes()
+	{
+	void* t = base;
+
+	if ( base == inline_buf )
 		{
-		size *= 2;
-		base = safe_realloc(base, size);
+		t = safe_malloc(offset + 1);
+		memcpy(t, inline_buf, offset + 1);
 		}
+
+	base = 0;
+	size = 0;
+
+	// Don't clear offset, as we want to still support
+	// subsequent calls to Len().
+
+	return byte_vec(t);
 	}
 
 void ODesc::Clear()
 	{
 	offset = 0;
 
+	if ( f )
+		return;
+
+	if ( ! base )
+		{
+		// The bytes got taken.
+		size = INLINE_SIZE;
+		base = inline_buf;
+		}
+
 	// If we've allocated an exceedingly large amount of space, free it.
-	if ( size > 10 * 1024 * 1024 )
+	else if ( size > 10 * 1024 * 1024 )
 		{
 		free(base);
-		size = DEFAULT_SIZE;
-		base = safe_malloc(size);
-		((char*) base)[0] = '\0';
+		size = INLINE_SIZE;
+		base = inline_buf;
 		}
+
+	((char*) base)[0] = '\0';
 	}
 
 bool ODesc::PushType(const BroType* type)
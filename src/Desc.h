@@ -125,17 +125,10 @@ public:
 	const char* Description() const		{ return (const char*) base; }
 
 	const u_char* Bytes() const	{ return (const u_char *) base; }
-	byte_vec TakeBytes()
-		{
-		const void* t = base;
-		base = 0;
-		size = 0;
-
-		// Don't clear offset, as we want to still support
-		// subsequent calls to Len().
 
-		return byte_vec(t);
-		}
+	// Returns the buffer, allocated with malloc(), and passes ownership
+	// to the caller.
+	byte_vec TakeBytes();
 
 	int Len() const		{ return offset; }
 
@@ -181,9 +174,14 @@ protected:
 	desc_type type;
 	desc_style style;
 
+	// Most descriptions are short, so the buffer starts out inline and
+	// only moves to the heap once it needs to grow.
+	static const unsigned int INLINE_SIZE = 128;
+
 	void* base;		// beginning of buffer
 	unsigned int offset;	// where we are in the buffer
 	unsigned int size;	// size of buffer in bytes
+	char inline_buf[INLINE_SIZE];
 
 	bool escape;	// escape unprintable characters in output?
 	typedef set<string> escape_set;
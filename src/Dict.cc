@@ -2,11 +2,15 @@
 
 #include "bro-config.h"
 
+#include <limits.h>
+#include <new>
+
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
 
 #include "Dict.h"
+#include "HugePages.h"
 #include "Reporter.h"
 
 // If the mean bucket length exceeds the following then Insert() will
@@ -17,22 +21,103 @@
 // is prime.
 #define PRIME_THRESH 1000
 
+// For the OPEN_ADDRESSING layout, the table is grown once the number of
+// used slots (live entries plus tombstones) exceeds this fraction of its
+// size.  Keeping part of the table empty bounds the probe lengths and
+// guarantees that every probe sequence terminates.
+#define MAX_SLOT_LOAD 0.75
+
+// Control byte values for the OPEN_ADDRESSING layout.  Full slots store
+// the low seven bits of their entry's hash, so both special values have
+// the high bit set.
+#define SLOT_EMPTY 0x80
+#define SLOT_DELETED 0xfe
+
+// Multiplier for mapping hash values to slots (Fibonacci hashing).  It
+// makes the slot index depend on all bits of the hash.
+#define SLOT_HASH_MULT 0x9e3779b97f4a7c15ULL
+
+// The links of an ORDERED dictionary's entry to those inserted right
+// before and after it.  They precede the entry in its allocation, so that
+// entries of other dictionaries don't pay for them.
+struct DictOrderLinks {
+	DictEntry* prev;
+	DictEntry* next;
+};
+
+// An entry of the CHAINED layout.  The key's bytes follow the entry in the
+// same allocation, which spares each entry a second heap block (with its
+// own malloc overhead) and the pointer to it.
 class DictEntry {
 public:
-	DictEntry(void* k, int l, hash_t h, void* val)
-		{ key = k; len = l; hash = h; value = val; }
+	// Returns a new entry with a copy of the key.  If ordered, the entry
+	// comes with order links.
+	static DictEntry* New(const void* k, int l, hash_t h, void* val,
+				bool ordered)
+		{
+		size_t links = ordered ? sizeof(DictOrderLinks) : 0;
+		char* mem = new char[links + sizeof(DictEntry) + l];
+		DictEntry* e = new (mem + links) DictEntry;
+		e->len = l;
+		e->hash = h;
+		e->value = val;
+		memcpy(e->Key(), k, l);
+		return e;
+		}
 
-	~DictEntry()
+	static void Delete(DictEntry* e, bool ordered)
 		{
-		delete [] (char*) key;
+		char* mem = (char*) e;
+
+		if ( ordered )
+			mem -= sizeof(DictOrderLinks);
+
+		delete [] mem;
 		}
 
-	void* key;
+	void* Key()	{ return this + 1; }
+
+	// Only for entries created as ordered.
+	DictOrderLinks* Links()	{ return (DictOrderLinks*) this - 1; }
+
+	// Bytes that the entry takes up, key included.
+	size_t Size() const	{ return pad_size(sizeof(DictEntry) + len); }
+
+	hash_t hash;
+	void* value;
 	int len;
+};
+
+// An entry of the OPEN_ADDRESSING layout.  Unlike DictEntry, slots are
+// stored by value in one array, with the hash right in front of the key's
+// pointer so that mismatches rarely need to touch the key itself.
+struct DictSlot {
 	hash_t hash;
+	void* key;
+	int len;
 	void* value;
 };
 
+// A table of slots.  ctrl has one byte per slot, which is either empty,
+// deleted (a tombstone), or holds the low seven bits of the hash of the
+// entry in the corresponding slot.
+struct DictSlotTable {
+	DictSlot* slots;
+	unsigned char* ctrl;
+	int num_slots;	// always a power of two
+	int shift;	// 64 - log2(num_slots)
+	int num_entries;
+	int num_deleted;
+
+	// Position of slot 0 when numbering the slots of all tables
+	// consecutively.  Iteration cookies use these positions.
+	int base;
+
+	// If the table is being emptied during a resize, the next slot
+	// to move.
+	int next_move;
+};
+
 // The value of an iteration cookie is the bucket and offset within the
 // bucket at which to start looking for the next value to return.
 class IterCookie {
@@ -49,17 +134,35 @@ public:
 	PList(DictEntry)** ttbl;
 	const int* num_buckets_p;
 	PList(DictEntry) inserted;	// inserted while iterating
+
+	// For the OPEN_ADDRESSING layout, "bucket" is the position of the
+	// next slot to look at and this holds the positions of slots filled
+	// while iterating that "bucket" had already passed.
+	vector<int> inserted_slots;
 };
 
-Dictionary::Dictionary(dict_order ordering, int initial_size)
+Dictionary::Dictionary(dict_order ordering, int initial_size,
+			dict_layout layout)
 	{
-	Init(initial_size);
-	tbl2 = 0;
+	stbls = 0;
+	num_stbls = 0;
+	resize_step = DEFAULT_DICT_RESIZE_STEP;
 
-	if ( ordering == ORDERED )
-		order = new PList(DictEntry);
+	if ( layout == OPEN_ADDRESSING && ordering == UNORDERED )
+		{
+		tbl = 0;
+		num_buckets = 0;
+		InitSlots(initial_size);
+		}
 	else
-		order = 0;
+		Init(initial_size);
+
+	tbl2 = 0;
+
+	ordered = (ordering == ORDERED);
+	order_head = order_tail = 0;
+	nth_entry = 0;
+	nth_pos = 0;
 
 	SetDensityThresh(DEFAULT_DENSITY_THRESH);
 
@@ -74,18 +177,36 @@ Dictionary::Dictionary(dict_order ordering, int initial_size)
 Dictionary::~Dictionary()
 	{
 	DeInit();
-	delete order;
 	}
 
 void Dictionary::Clear()
 	{
+	if ( stbls )
+		{
+		DeInitSlots();
+		InitSlots(2);
+		return;
+		}
+
 	DeInit();
 	Init(2);
 	tbl2 = 0;
+
+	order_head = order_tail = 0;
+	nth_entry = 0;
 	}
 
 void Dictionary::DeInit()
 	{
+	if ( stbls )
+		{
+		DeInitSlots();
+		return;
+		}
+
+	if ( tbl2 )
+		--num_resizing;
+
 	for ( int i = 0; i < num_buckets; ++i )
 		if ( tbl[i] )
 			{
@@ -95,13 +216,13 @@ void Dictionary::DeInit()
 				DictEntry* e = (*chain)[j];
 				if ( delete_func )
 					delete_func(e->value);
-				delete e;
+				DictEntry::Delete(e, ordered);
 				}
 
 			delete chain;
 			}
 
-	delete [] tbl;
+	huge_page_free(tbl, num_buckets * sizeof(PList(DictEntry)*));
 
 	if ( tbl2 == 0 )
 		return;
@@ -115,18 +236,25 @@ void Dictionary::DeInit()
 				DictEntry* e = (*chain)[j];
 				if ( delete_func )
 					delete_func(e->value);
-				delete e;
+				DictEntry::Delete(e, ordered);
 				}
 
 			delete chain;
 			}
 
-	delete [] tbl2;
+	huge_page_free(tbl2, num_buckets2 * sizeof(PList(DictEntry)*));
 	tbl2 = 0;
 	}
 
 void* Dictionary::Lookup(const void* key, int key_size, hash_t hash) const
 	{
+	if ( stbls )
+		{
+		int t;
+		int i = FindSlot(key, key_size, hash, t);
+		return i >= 0 ? stbls[t].slots[i].value : 0;
+		}
+
 	hash_t h;
 	PList(DictEntry)* chain;
 
@@ -144,7 +272,7 @@ void* Dictionary::Lookup(const void* key, int key_size, hash_t hash) const
 			DictEntry* entry = (*chain)[i];
 
 			if ( entry->hash == hash && entry->len == key_size &&
-			     ! memcmp(key, entry->key, key_size) )
+			     ! memcmp(key, entry->Key(), key_size) )
 				return entry->value;
 			}
 		}
@@ -152,20 +280,97 @@ void* Dictionary::Lookup(const void* key, int key_size, hash_t hash) const
 	return 0;
 	}
 
+void Dictionary::Prefetch(hash_t hash) const
+	{
+	if ( stbls )
+		{
+		// Where FindSlot() starts probing.
+		const DictSlotTable* t = &stbls[num_stbls - 1];
+		int i = int((hash * SLOT_HASH_MULT) >> t->shift);
+		__builtin_prefetch(&t->ctrl[i]);
+		__builtin_prefetch(&t->slots[i]);
+		return;
+		}
+
+	hash_t h = hash % num_buckets;
+
+	if ( ! tbl2 || h >= tbl_next_ind )
+		__builtin_prefetch(&tbl[h]);
+	else
+		__builtin_prefetch(&tbl2[hash % num_buckets2]);
+	}
+
+void Dictionary::PrefetchValue(hash_t hash) const
+	{
+	void* value = 0;
+
+	if ( stbls )
+		{
+		unsigned char tag = hash & 0x7f;
+
+		for ( int n = num_stbls - 1; n >= 0 && ! value; --n )
+			{
+			const DictSlotTable* t = &stbls[n];
+			int mask = t->num_slots - 1;
+
+			for ( int i = int((hash * SLOT_HASH_MULT) >> t->shift);
+			      t->ctrl[i] != SLOT_EMPTY; i = (i + 1) & mask )
+				{
+				if ( t->ctrl[i] == tag && t->slots[i].hash == hash )
+					{
+					value = t->slots[i].value;
+					break;
+					}
+				}
+			}
+		}
+
+	else
+		{
+		hash_t h = hash % num_buckets;
+		PList(DictEntry)* chain;
+
+		if ( ! tbl2 || h >= tbl_next_ind )
+			chain = tbl[h];
+		else
+			chain = tbl2[hash % num_buckets2];
+
+		for ( int i = 0; chain && i < chain->length(); ++i )
+			{
+			if ( (*chain)[i]->hash == hash )
+				{
+				value = (*chain)[i]->value;
+				break;
+				}
+			}
+		}
+
+	if ( value )
+		__builtin_prefetch(value);
+	}
+
 void* Dictionary::Insert(void* key, int key_size, hash_t hash, void* val,
 				int copy_key)
 	{
-	DictEntry* new_entry = new DictEntry(key, key_size, hash, val);
-	void* old_val = Insert(new_entry, copy_key);
+	if ( stbls )
+		return InsertIntoSlots(key, key_size, hash, val, copy_key);
+
+	DictEntry* new_entry = DictEntry::New(key, key_size, hash, val, ordered);
+
+	// The entry has its own copy now.
+	if ( ! copy_key )
+		delete [] (char*) key;
+
+	void* old_val = Insert(new_entry);
 
 	if ( old_val )
 		{
 		// We didn't need the new DictEntry, the key was already
 		// present.
-		delete new_entry;
+		DictEntry::Delete(new_entry, ordered);
 		}
-	else if ( order )
-		order->append(new_entry);
+	else if ( ordered )
+		AppendToOrder(new_entry);
 
 	// Resize logic.
 	if ( tbl2 )
@@ -179,6 +384,9 @@ void* Dictionary::Insert(void* key, int key_size, hash_t hash, void* val,
 void* Dictionary::Remove(const void* key, int key_size, hash_t hash,
 				bool dont_delete)
 	{
+	if ( stbls )
+		return RemoveFromSlots(key, key_size, hash, dont_delete);
+
 	hash_t h;
 	PList(DictEntry)* chain;
 	int* num_entries_ptr;
@@ -204,14 +412,13 @@ void* Dictionary::Remove(const void* key, int key_size, hash_t hash,
 		DictEntry* entry = (*chain)[i];
 
 		if ( entry->hash == hash && entry->len == key_size &&
-		     ! memcmp(key, entry->key, key_size) )
+		     ! memcmp(key, entry->Key(), key_size) )
 			{
 			void* entry_value = DoRemove(entry, h, chain, i);
 
-			if ( dont_delete )
-				entry->key = 0;
-
-			delete entry;
+			// The key's bytes go along with the entry regardless of
+			// dont_delete, as the caller's key can't be one of them.
+			DictEntry::Delete(entry, ordered);
 			--*num_entries_ptr;
 			return entry_value;
 			}
@@ -226,8 +433,8 @@ void* Dictionary::DoRemove(DictEntry* entry, hash_t h,
 	void* entry_value = entry->value;
 
 	chain->remove_nth(chain_offset);
-	if ( order )
-		order->remove(entry);
+	if ( ordered )
+		RemoveFromOrder(entry);
 
 	// Adjust existing cookies.
 	loop_over_list(cookies, i)
@@ -257,13 +464,70 @@ void* Dictionary::DoRemove(DictEntry* entry, hash_t h,
 	return entry_value;
 	}
 
+void Dictionary::AppendToOrder(DictEntry* entry)
+	{
+	DictOrderLinks* l = entry->Links();
+	l->prev = order_tail;
+	l->next = 0;
+
+	if ( order_tail )
+		order_tail->Links()->next = entry;
+	else
+		order_head = entry;
+
+	order_tail = entry;
+	}
+
+void Dictionary::RemoveFromOrder(DictEntry* entry)
+	{
+	DictOrderLinks* l = entry->Links();
+
+	if ( l->prev )
+		l->prev->Links()->next = l->next;
+	else
+		order_head = l->next;
+
+	if ( l->next )
+		l->next->Links()->prev = l->prev;
+	else
+		order_tail = l->prev;
+
+	// The positions of the following entries changed.
+	nth_entry = 0;
+	}
+
 void* Dictionary::NthEntry(int n, const void*& key, int& key_len) const
 	{
-	if ( ! order || n < 0 || n >= Length() )
+	if ( ! ordered || n < 0 || n >= Length() )
 		return 0;
 
-	DictEntry* entry = (*order)[n];
-	key = entry->key;
+	// Walk from whichever known position is closest: the start, the
+	// end, or the entry returned last.
+	DictEntry* entry = order_head;
+	int pos = 0;
+
+	if ( Length() - 1 - n < n )
+		{
+		entry = order_tail;
+		pos = Length() - 1;
+		}
+
+	if ( nth_entry && abs(n - nth_pos) < abs(n - pos) )
+		{
+		entry = nth_entry;
+		pos = nth_pos;
+		}
+
+	for ( ; pos < n; ++pos )
+		entry = entry->Links()->next;
+
+	for ( ; pos > n; --pos )
+		entry = entry->Links()->prev;
+
+	nth_entry = entry;
+	nth_pos = n;
+
+	key = entry->Key();
 	key_len = entry->len;
 	return entry->value;
 	}
@@ -275,15 +539,41 @@ IterCookie* Dictionary::InitForIteration() const
 
 void Dictionary::StopIteration(IterCookie* cookie) const
 	{
+	if ( cookies.length() )
+		const_cast<PList(IterCookie)*>(&cookies)->remove(cookie);
+
 	delete cookie;
 	}
 
 void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) const
 	{
+	const void* key;
+	int key_len;
+	hash_t hash;
+	void* v = NextEntry(key, key_len, hash, cookie);
+
+	if ( v && return_hash )
+		h = new HashKey(key, key_len, hash);
+
+	return v;
+	}
+
+void* Dictionary::NextEntry(const void*& key, int& key_len, IterCookie*& cookie) const
+	{
+	hash_t hash;
+	return NextEntry(key, key_len, hash, cookie);
+	}
+
+void* Dictionary::NextEntry(const void*& key, int& key_len, hash_t& hash,
+				IterCookie*& cookie) const
+	{
 	// If there are any inserted entries, return them first.
 	// That keeps the list small and helps avoiding searching
 	// a large list when deleting an entry.
 
+	if ( stbls )
+		return NextSlotEntry(key, key_len, hash, cookie);
+
 	DictEntry* entry;
 
 	if ( cookie->inserted.length() )
@@ -291,8 +581,9 @@ void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) c
 		// Return the last one. Order doesn't matter,
 		// and removing from the tail is cheaper.
 		entry = cookie->inserted.remove_nth(cookie->inserted.length()-1);
-		if ( return_hash )
-			h = new HashKey(entry->key, entry->len, entry->hash);
+		key = entry->Key();
+		key_len = entry->len;
+		hash = entry->hash;
 
 		return entry->value;
 		}
@@ -316,8 +607,9 @@ void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) c
 		{
 		entry = (*ttbl[b])[o];
 		++cookie->offset;
-		if ( return_hash )
-			h = new HashKey(entry->key, entry->len, entry->hash);
+		key = entry->Key();
+		key_len = entry->len;
+		hash = entry->hash;
 		return entry->value;
 		}
 
@@ -334,7 +626,7 @@ void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) c
 			cookie->num_buckets_p = &num_buckets2;
 			cookie->bucket = 0;
 			cookie->offset = 0;
-			return Dictionary::NextEntry(h, cookie, return_hash);
+			return Dictionary::NextEntry(key, key_len, hash, cookie);
 			}
 
 		// All done.
@@ -348,8 +640,9 @@ void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) c
 		}
 
 	entry = (*ttbl[b])[0];
-	if ( return_hash )
-		h = new HashKey(entry->key, entry->len, entry->hash);
+	key = entry->Key();
+	key_len = entry->len;
+	hash = entry->hash;
 
 	cookie->bucket = b;
 	cookie->offset = 1;
@@ -360,7 +653,7 @@ void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) c
 void Dictionary::Init(int size)
 	{
 	num_buckets = NextPrime(size);
-	tbl = new PList(DictEntry)*[num_buckets];
+	tbl = (PList(DictEntry)**) huge_page_alloc(num_buckets * sizeof(PList(DictEntry)*));
 
 	for ( int i = 0; i < num_buckets; ++i )
 		tbl[i] = 0;
@@ -371,7 +664,7 @@ void Dictionary::Init(int size)
 void Dictionary::Init2(int size)
 	{
 	num_buckets2 = NextPrime(size);
-	tbl2 = new PList(DictEntry)*[num_buckets2];
+	tbl2 = (PList(DictEntry)**) huge_page_alloc(num_buckets2 * sizeof(PList(DictEntry)*));
 
 	for ( int i = 0; i < num_buckets2; ++i )
 		tbl2[i] = 0;
@@ -380,7 +673,7 @@ void Dictionary::Init2(int size)
 	}
 
 // private
-void* Dictionary::Insert(DictEntry* new_entry, int copy_key)
+void* Dictionary::Insert(DictEntry* new_entry)
 	{
 	PList(DictEntry)** ttbl;
 	int* num_entries_ptr;
@@ -419,7 +712,7 @@ void* Dictionary::Insert(DictEntry* new_entry, int copy_key)
 
 			if ( entry->hash == new_entry->hash &&
 			     entry->len == n &&
-			     ! memcmp(entry->key, new_entry->key, n) )
+			     ! memcmp(entry->Key(), new_entry->Key(), n) )
 				{
 				void* old_value = entry->value;
 				entry->value = new_entry->value;
@@ -431,16 +724,6 @@ void* Dictionary::Insert(DictEntry* new_entry, int copy_key)
 		// Create new chain.
 		chain = ttbl[h] = new PList(DictEntry);
 
-	// If we got this far, then we couldn't use an existing copy
-	// of the key, so make a new one if necessary.
-	if ( copy_key )
-		{
-		void* old_key = new_entry->key;
-		new_entry->key = (void*) new char[n];
-		memcpy(new_entry->key, old_key, n);
-		delete (char*) old_key;
-		}
-
 	// We happen to know (:-() that appending is more efficient
 	// on lists than prepending.
 	chain->append(new_entry);
@@ -498,6 +781,7 @@ void Dictionary::StartChangeSize(int new_size)
 	Init2(new_size);
 
 	tbl_next_ind = 0;
+	++num_resizing;
 
 	// Preserve threshold density
 	SetDensityThresh2(DensityThresh());
@@ -509,8 +793,10 @@ void Dictionary::MoveChains()
 	if ( cookies.length() > 0 )
 		return;
 
-	// Attempt to move this many entries (must do at least 2)
-	int num = 8;
+	// Attempt to move this many entries (must do at least 2, so that
+	// we finish before the new table fills up).
+	int num = resize_step > 0 ? (resize_step > 2 ? resize_step : 2) :
+				num_entries + 1;
 
 	do
 		{
@@ -523,9 +809,10 @@ void Dictionary::MoveChains()
 
 		for ( int j = 0; j < chain->length(); ++j )
 			{
-			Insert((*chain)[j], 0);
+			Insert((*chain)[j]);
 			--num_entries;
 			--num;
+			++num_resize_moves;
 			}
 
 		delete chain;
@@ -546,10 +833,11 @@ void Dictionary::FinishChangeSize()
 
 	for ( int i = 0; i < num_buckets; ++i )
 		delete tbl[i];
-	delete [] tbl;
+	huge_page_free(tbl, num_buckets * sizeof(PList(DictEntry)*));
 
 	tbl = tbl2;
 	tbl2 = 0;
+	--num_resizing;
 
 	num_buckets = num_buckets2;
 	num_entries = num_entries2;
@@ -566,6 +854,9 @@ void Dictionary::FinishChangeSize()
 
 unsigned int Dictionary::MemoryAllocation() const
 	{
+	if ( stbls )
+		return SlotsMemoryAllocation();
+
 	int size = padded_sizeof(*this);
 
 	for ( int i = 0; i < num_buckets; ++i )
@@ -573,14 +864,14 @@ unsigned int Dictionary::MemoryAllocation() const
 			{
 			PList(DictEntry)* chain = tbl[i];
 			loop_over_list(*chain, j)
-				size += padded_sizeof(DictEntry) + pad_size((*chain)[j]->len);
+				size += (*chain)[j]->Size();
 			size += chain->MemoryAllocation();
 			}
 
 	size += pad_size(num_buckets * sizeof(PList(DictEntry)*));
 
-	if ( order )
-		size += order->MemoryAllocation();
+	if ( ordered )
+		size += Length() * sizeof(DictOrderLinks);
 
 	if ( tbl2 )
 		{
@@ -589,7 +880,7 @@ unsigned int Dictionary::MemoryAllocation() const
 				{
 				PList(DictEntry)* chain = tbl2[i];
 				loop_over_list(*chain, j)
-					size += padded_sizeof(DictEntry) + pad_size((*chain)[j]->len);
+					size += (*chain)[j]->Size();
 				size += chain->MemoryAllocation();
 				}
 
@@ -599,6 +890,440 @@ unsigned int Dictionary::MemoryAllocation() const
 	return size;
 	}
 
+unsigned int Dictionary::EntryMemory(int key_size)
+	{
+	return pad_size(sizeof(DictEntry) + key_size) + sizeof(DictEntry*);
+	}
+
+bool Dictionary::IsResizing() const
+	{
+	return stbls ? num_stbls > 1 : tbl2 != 0;
+	}
+
+int Dictionary::PendingResizeMoves() const
+	{
+	if ( ! stbls )
+		return tbl2 ? num_entries : 0;
+
+	int n = 0;
+	for ( int i = 0; i < num_stbls - 1; ++i )
+		n += stbls[i].num_entries;
+
+	return n;
+	}
+
+static void init_slot_table(DictSlotTable* t, int size, int base)
+	{
+	int n = 8;
+	int log_n = 3;
+
+	while ( n < size )
+		{
+		n <<= 1;
+		++log_n;
+		}
+
+	t->slots = (DictSlot*) huge_page_alloc(n * sizeof(DictSlot));
+	t->ctrl = (unsigned char*) huge_page_alloc(n);
+	memset(t->ctrl, SLOT_EMPTY, n);
+	t->num_slots = n;
+	t->shift = 64 - log_n;
+	t->num_entries = t->num_deleted = 0;
+	t->base = base;
+	t->next_move = 0;
+	}
+
+// Returns the slot holding the given key, or -1 if there's none.
+static int probe_slot_table(const DictSlotTable* t, const void* key,
+				int key_size, hash_t hash)
+	{
+	unsigned char tag = hash & 0x7f;
+	int mask = t->num_slots - 1;
+
+	for ( int i = int((hash * SLOT_HASH_MULT) >> t->shift);
+	      t->ctrl[i] != SLOT_EMPTY; i = (i + 1) & mask )
+		{
+		if ( t->ctrl[i] != tag )
+			continue;
+
+		const DictSlot& s = t->slots[i];
+
+		if ( s.hash == hash && s.len == key_size &&
+		     ! memcmp(key, s.key, key_size) )
+			return i;
+		}
+
+	return -1;
+	}
+
+// Returns the slot a new entry with the given hash goes into, which is
+// the first free one along its probe sequence.  The caller must have
+// made sure that the key isn't present yet.
+static int free_slot(DictSlotTable* t, hash_t hash)
+	{
+	int mask = t->num_slots - 1;
+	int i = int((hash * SLOT_HASH_MULT) >> t->shift);
+
+	while ( ! (t->ctrl[i] & 0x80) )
+		i = (i + 1) & mask;
+
+	if ( t->ctrl[i] == SLOT_DELETED )
+		--t->num_deleted;
+
+	return i;
+	}
+
+static bool slot_table_full(const DictSlotTable* t)
+	{
+	return t->num_entries + t->num_deleted >
+		int(t->num_slots * MAX_SLOT_LOAD);
+	}
+
+void Dictionary::InitSlots(int size)
+	{
+	stbls = new DictSlotTable[1];
+	num_stbls = 1;
+	init_slot_table(stbls, size, 0);
+
+	max_num_entries = num_entries = 0;
+	}
+
+void Dictionary::DeInitSlots()
+	{
+	for ( int t = 0; t < num_stbls; ++t )
+		{
+		DictSlotTable* st = &stbls[t];
+
+		for ( int i = 0; i < st->num_slots; ++i )
+			{
+			if ( st->ctrl[i] & 0x80 )
+				continue;
+
+			if ( delete_func )
+				delete_func(st->slots[i].value);
+
+			delete [] (char*) st->slots[i].key;
+			}
+
+		huge_page_free(st->slots, st->num_slots * sizeof(DictSlot));
+		huge_page_free(st->ctrl, st->num_slots);
+		}
+
+	if ( num_stbls > 1 )
+		--num_resizing;
+
+	delete [] stbls;
+	stbls = 0;
+	num_stbls = 0;
+	}
+
+int Dictionary::FindSlot(const void* key, int key_size, hash_t hash,
+				int& table) const
+	{
+	// New entries go into the last table, so look there first.
+	for ( table = num_stbls - 1; table >= 0; --table )
+		{
+		int i = probe_slot_table(&stbls[table], key, key_size, hash);
+
+		if ( i >= 0 )
+			return i;
+		}
+
+	return -1;
+	}
+
+void* Dictionary::InsertIntoSlots(void* key, int key_size, hash_t hash,
+					void* val, int copy_key)
+	{
+	int t;
+	int i = FindSlot(key, key_size, hash, t);
+
+	if ( i >= 0 )
+		{
+		// The key is already present, we don't need the new one.
+		if ( ! copy_key )
+			delete [] (char*) key;
+
+		DictSlot& s = stbls[t].slots[i];
+		void* old_value = s.value;
+		s.value = val;
+		return old_value;
+		}
+
+	if ( copy_key )
+		{
+		void* new_key = (void*) new char[key_size];
+		memcpy(new_key, key, key_size);
+		key = new_key;
+		}
+
+	DictSlotTable* st = &stbls[num_stbls - 1];
+	i = free_slot(st, hash);
+
+	DictSlot& s = st->slots[i];
+	s.hash = hash;
+	s.key = key;
+	s.len = key_size;
+	s.value = val;
+	st->ctrl[i] = hash & 0x7f;
+	++st->num_entries;
+
+	++cumulative_entries;
+	if ( max_num_entries < ++num_entries )
+		max_num_entries = num_entries;
+
+	// For ongoing iterations: if we already passed the slot where this
+	// entry was put, remember it in the cookie.
+	int pos = st->base + i;
+
+	loop_over_list(cookies, j)
+		{
+		IterCookie* c = cookies[j];
+		if ( pos < c->bucket )
+			c->inserted_slots.push_back(pos);
+		}
+
+	if ( slot_table_full(st) )
+		{
+		// If mostly tombstones are filling up the table, it's
+		// enough to rebuild it at the current size.
+		if ( st->num_deleted > st->num_entries / 2 )
+			StartResizeSlots(st->num_slots);
+		else
+			StartResizeSlots(st->num_slots * 2);
+		}
+
+	MoveSlots(resize_step);
+
+	return 0;
+	}
+
+void* Dictionary::RemoveFromSlots(const void* key, int key_size, hash_t hash,
+					bool dont_delete)
+	{
+	int t;
+	int i = FindSlot(key, key_size, hash, t);
+
+	if ( i < 0 )
+		return 0;
+
+	DictSlotTable* st = &stbls[t];
+	DictSlot& s = st->slots[i];
+	void* entry_value = s.value;
+
+	if ( ! dont_delete )
+		delete [] (char*) s.key;
+
+	s.key = 0;
+	s.value = 0;
+
+	// If the next slot is empty, no probe sequence can continue past
+	// this one, and there's no need to leave a tombstone.
+	if ( st->ctrl[(i + 1) & (st->num_slots - 1)] == SLOT_EMPTY )
+		st->ctrl[i] = SLOT_EMPTY;
+	else
+		{
+		st->ctrl[i] = SLOT_DELETED;
+		++st->num_deleted;
+		}
+
+	--st->num_entries;
+	--num_entries;
+
+	// Adjust existing cookies: the entry may have been inserted during
+	// the iteration.  If it's in a slot still to be visited, the
+	// cookie will skip it anyway.
+	int pos = st->base + i;
+
+	loop_over_list(cookies, j)
+		{
+		vector<int>& ins = cookies[j]->inserted_slots;
+
+		for ( size_t k = 0; k < ins.size(); ++k )
+			if ( ins[k] == pos )
+				{
+				ins.erase(ins.begin() + k);
+				break;
+				}
+		}
+
+	return entry_value;
+	}
+
+void* Dictionary::NextSlotEntry(const void*& key, int& key_len, hash_t& hash,
+				IterCookie*& cookie) const
+	{
+	const DictSlot* s = 0;
+
+	if ( cookie->inserted_slots.size() )
+		{
+		int pos = cookie->inserted_slots.back();
+		cookie->inserted_slots.pop_back();
+
+		for ( int t = num_stbls - 1; t >= 0; --t )
+			if ( pos >= stbls[t].base )
+				{
+				s = &stbls[t].slots[pos - stbls[t].base];
+				break;
+				}
+		}
+	else
+		{
+		// Tables are numbered in ascending order.
+		int pos = cookie->bucket;
+
+		for ( int t = 0; t < num_stbls && ! s; ++t )
+			{
+			const DictSlotTable* st = &stbls[t];
+			int i = pos - st->base;
+
+			if ( i >= st->num_slots )
+				continue;
+
+			if ( i < 0 )
+				i = 0;
+
+			while ( i < st->num_slots && (st->ctrl[i] & 0x80) )
+				++i;
+
+			if ( i < st->num_slots )
+				{
+				s = &st->slots[i];
+				cookie->bucket = st->base + i + 1;
+				}
+			}
+
+		if ( ! s )
+			{
+			// All done.
+			const_cast<PList(IterCookie)*>(&cookies)->remove(cookie);
+			delete cookie;
+			cookie = 0;
+			return 0;
+			}
+		}
+
+	key = s->key;
+	key_len = s->len;
+	hash = s->hash;
+
+	return s->value;
+	}
+
+void Dictionary::StartResizeSlots(int new_num_slots)
+	{
+	if ( num_stbls == 1 )
+		++num_resizing;
+
+	const DictSlotTable* last = &stbls[num_stbls - 1];
+	int base = last->base + last->num_slots;
+
+	DictSlotTable* new_stbls = new DictSlotTable[num_stbls + 1];
+	memcpy(new_stbls, stbls, num_stbls * sizeof(DictSlotTable));
+	init_slot_table(&new_stbls[num_stbls], new_num_slots, base);
+
+	delete [] stbls;
+	stbls = new_stbls;
+	++num_stbls;
+	}
+
+void Dictionary::MoveSlots(int max_moves)
+	{
+	// Moving entries around would confuse ongoing iterations.
+	if ( num_stbls == 1 || cookies.length() > 0 )
+		return;
+
+	// Besides the entries moved, also bound the number of slots we
+	// look at, as the old tables may well be sparse.
+	int max_visits = max_moves * 8;
+
+	if ( max_moves <= 0 )
+		max_moves = max_visits = INT_MAX;
+
+	int moves = 0;
+	int visits = 0;
+
+	while ( num_stbls > 1 && moves < max_moves && visits < max_visits )
+		{
+		DictSlotTable* old = &stbls[0];
+		DictSlotTable* st = &stbls[num_stbls - 1];
+
+		while ( old->num_entries > 0 && old->next_move < old->num_slots &&
+			moves < max_moves && visits < max_visits )
+			{
+			int i = old->next_move++;
+			++visits;
+
+			if ( old->ctrl[i] & 0x80 )
+				continue;
+
+			const DictSlot& s = old->slots[i];
+			int j = free_slot(st, s.hash);
+			st->slots[j] = s;
+			st->ctrl[j] = old->ctrl[i];
+			++st->num_entries;
+
+			// Leave a tombstone so that the remaining entries
+			// of the old table can still be found.
+			old->ctrl[i] = SLOT_DELETED;
+			--old->num_entries;
+
+			++moves;
+			++num_resize_moves;
+
+			if ( slot_table_full(st) )
+				{
+				// Can happen if the table filled quickly
+				// while we couldn't move any entries.
+				StartResizeSlots(st->num_slots * 2);
+				old = &stbls[0];
+				st = &stbls[num_stbls - 1];
+				}
+			}
+
+		if ( old->num_entries > 0 )
+			break;
+
+		// The old table is empty now, drop it.
+		huge_page_free(old->slots, old->num_slots * sizeof(DictSlot));
+		huge_page_free(old->ctrl, old->num_slots);
+
+		for ( int t = 1; t < num_stbls; ++t )
+			{
+			stbls[t - 1] = stbls[t];
+			stbls[t - 1].base = (t == 1) ? 0 :
+				stbls[t - 2].base + stbls[t - 2].num_slots;
+			}
+
+		if ( --num_stbls == 1 )
+			--num_resizing;
+		}
+	}
+
+unsigned int Dictionary::SlotsMemoryAllocation() const
+	{
+	int size = padded_sizeof(*this);
+
+	for ( int t = 0; t < num_stbls; ++t )
+		{
+		const DictSlotTable* st = &stbls[t];
+
+		for ( int i = 0; i < st->num_slots; ++i )
+			if ( ! (st->ctrl[i] & 0x80) )
+				size += pad_size(st->slots[i].len);
+
+		size += pad_size(st->num_slots * sizeof(DictSlot));
+		size += pad_size(st->num_slots);
+		}
+
+	size += pad_size(num_stbls * sizeof(DictSlotTable));
+
+	return size;
+	}
+
+unsigned int Dictionary::num_resizing = 0;
+uint64 Dictionary::num_resize_moves = 0;
+
 void generic_delete_func(void* v)
 	{
 	free(v);
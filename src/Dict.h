@@ -9,6 +9,8 @@
 class Dictionary;
 class DictEntry;
 class IterCookie;
+struct DictSlot;
+struct DictSlotTable;
 
 declare(PList,DictEntry);
 declare(PList,IterCookie);
@@ -17,10 +19,23 @@ declare(PList,IterCookie);
 // increase the size of the hash table as needed.
 #define DEFAULT_DICT_SIZE 16
 
+// Default number of entries that a single insertion moves
+// over to the new hash table while the dictionary is being resized.
+#define DEFAULT_DICT_RESIZE_STEP 8
+
 // Type indicating whether the dictionary should keep track of the order
 // of insertions.
 typedef enum { ORDERED, UNORDERED } dict_order;
 
+// Type indicating how the dictionary stores its entries.  CHAINED keeps
+// a list of entries per hash bucket.  OPEN_ADDRESSING keeps all entries
+// in one flat array of slots, with the hash stored next to the key and a
+// separate array of per-slot control bytes that is probed linearly
+// (similar to a Swiss table), which avoids the pointer chase through the
+// bucket lists on lookups.  Only UNORDERED dictionaries can use
+// OPEN_ADDRESSING; ORDERED ones are always CHAINED.
+typedef enum { CHAINED, OPEN_ADDRESSING } dict_layout;
+
 // Type for function to be called when deleting elements.
 typedef void (*dict_delete_func)(void*);
 
@@ -30,7 +45,8 @@ extern void generic_delete_func(void*);
 class Dictionary {
 public:
 	Dictionary(dict_order ordering = UNORDERED,
-			int initial_size = DEFAULT_DICT_SIZE);
+			int initial_size = DEFAULT_DICT_SIZE,
+			dict_layout layout = CHAINED);
 	virtual ~Dictionary();
 
 	// Member functions for looking up a key, inserting/changing its
@@ -41,9 +57,25 @@ public:
 		{ return Lookup(key->Key(), key->Size(), key->Hash()); }
 	void* Lookup(const void* key, int key_size, hash_t hash) const;
 
+	// Starts pulling the memory that a lookup of a key with the given
+	// hash touches first into the cache, so that the lookup needn't
+	// wait for it if it comes a little later.
+	void Prefetch(hash_t hash) const;
+
+	// Once that has arrived, starts fetching the value stored under the
+	// hash, for dictionaries whose values point to objects.  Looks only
+	// at the hashes, so with a collision it may fetch the wrong one.
+	void PrefetchValue(hash_t hash) const;
+
 	// Returns previous value, or 0 if none.
 	void* Insert(HashKey* key, void* val)
 		{
+		// CHAINED entries store a copy of the key's bytes right
+		// with them, so there's no point in taking them over.
+		if ( ! stbls )
+			return Insert((void*) key->Key(), key->Size(),
+					key->Hash(), val, 1);
+
 		return Insert(key->TakeKey(), key->Size(), key->Hash(), val, 0);
 		}
 	// If copy_key is true, then the key is copied, otherwise it's assumed
@@ -54,7 +86,9 @@ public:
 
 	// Removes the given element.  Returns a pointer to the element in
 	// case it needs to be deleted.  Returns 0 if no such element exists.
-	// If dontdelete is true, the key's bytes will not be deleted.
+	// If dontdelete is true, the key's bytes will not be deleted (this
+	// matters only for OPEN_ADDRESSING, as CHAINED entries keep their
+	// keys' bytes inline).
 	void* Remove(const HashKey* key)
 		{ return Remove(key->Key(), key->Size(), key->Hash()); }
 	void* Remove(const void* key, int key_size, hash_t hash,
@@ -78,7 +112,33 @@ public:
 		}
 
 	// True if the dictionary is ordered, false otherwise.
-	int IsOrdered() const		{ return order != 0; }
+	int IsOrdered() const		{ return ordered; }
+
+	// Returns the storage layout the dictionary actually uses.
+	dict_layout Layout() const
+		{ return stbls ? OPEN_ADDRESSING : CHAINED; }
+
+	// Growing the hash table doesn't happen all at once.  Rather, each
+	// subsequent insertion moves at most this many entries
+	// over to the new table, so that no single operation stalls for
+	// long.  Lookups and iterations work across all tables in the
+	// meantime.  While a robust iteration is in progress, no entries
+	// are moved.  A step of 0 moves all entries at once.
+	void SetResizeStep(int step)	{ resize_step = step; }
+	int ResizeStep() const		{ return resize_step; }
+
+	// True if the dictionary is in the middle of a resize.
+	bool IsResizing() const;
+
+	// Number of entries still waiting to be moved to the new hash
+	// table if a resize is in progress, zero otherwise.
+	int PendingResizeMoves() const;
+
+	// Number of dictionaries currently being resized, and number of
+	// entries moved in the course of resizes so far, across all
+	// dictionaries.
+	static unsigned int NumResizing()	{ return num_resizing; }
+	static uint64 NumResizeMoves()		{ return num_resize_moves; }
 
 	// If the dictionary is ordered then returns the n'th entry's value;
 	// the second method also returns the key.  The first entry inserted
@@ -106,11 +166,15 @@ public:
 	// first calling InitForIteration().
 	//
 	// If return_hash is true, a HashKey for the entry is returned in h,
-	// which should be delete'd when no longer needed.
+	// which should be delete'd when no longer needed.  The versions
+	// returning the key's bytes don't copy them; they remain valid until
+	// the entry gets removed.
 	IterCookie* InitForIteration() const;
 	void* NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) const;
 	void* NextEntry(const void*& key, int& key_len, IterCookie*& cookie)
 		const;
+	void* NextEntry(const void*& key, int& key_len, hash_t& hash,
+			IterCookie*& cookie) const;
 	void StopIteration(IterCookie* cookie) const;
 
 	void SetDeleteFunc(dict_delete_func f)		{ delete_func = f; }
@@ -129,17 +193,40 @@ public:
 
 	unsigned int MemoryAllocation() const;
 
+	// Roughly the bytes that an entry with a key of the given size
+	// adds to a dictionary.
+	static unsigned int EntryMemory(int key_size);
+
 private:
 	void Init(int size);
 	void Init2(int size);	// initialize second table for resizing
 	void DeInit();
 
 	// Internal version of Insert().
-	void* Insert(DictEntry* entry, int copy_key);
+	void* Insert(DictEntry* entry);
 
 	void* DoRemove(DictEntry* entry, hash_t h,
 			PList(DictEntry)* chain, int chain_offset);
 
+	// Maintain the insertion order of ORDERED dictionaries.
+	void AppendToOrder(DictEntry* entry);
+	void RemoveFromOrder(DictEntry* entry);
+
+	// Counterparts of the above for the OPEN_ADDRESSING layout.
+	void InitSlots(int size);
+	void DeInitSlots();
+	int FindSlot(const void* key, int key_size, hash_t hash,
+			int& table) const;
+	void* InsertIntoSlots(void* key, int key_size, hash_t hash,
+				void* val, int copy_key);
+	void* RemoveFromSlots(const void* key, int key_size, hash_t hash,
+				bool dont_delete);
+	void* NextSlotEntry(const void*& key, int& key_len, hash_t& hash,
+				IterCookie*& cookie) const;
+	void StartResizeSlots(int new_num_slots);
+	void MoveSlots(int max_moves);
+	unsigned int SlotsMemoryAllocation() const;
+
 	int NextPrime(int n) const;
 	int IsPrime(int n) const;
 	void StartChangeSize(int new_size);
@@ -186,7 +273,32 @@ private:
 
 	hash_t tbl_next_ind;
 
-	PList(DictEntry)* order;
+	// Storage for the OPEN_ADDRESSING layout, in which case tbl and
+	// tbl2 remain nil.  Normally there's just one table of slots.
+	// When resizing, new entries go into the last table, and entries
+	// are moved there from the first one until only one is left.
+	// Entries never move other than that, so slot indices are stable
+	// and can be used by iteration cookies.
+	DictSlotTable* stbls;
+	int num_stbls;
+
+	int resize_step;
+
+	static unsigned int num_resizing;
+	static uint64 num_resize_moves;
+
+	// For ORDERED dictionaries, the entries in the order of their
+	// insertion, linked through the DictOrderLinks in front of each.
+	bool ordered;
+	DictEntry* order_head;
+	DictEntry* order_tail;
+
+	// The entry that NthEntry() returned last and its position, so that
+	// going through the entries in order needn't walk the list from the
+	// start for each one.  Removals reset it.
+	mutable DictEntry* nth_entry;
+	mutable int nth_pos;
+
 	dict_delete_func delete_func;
 
 	PList(IterCookie) cookies;
@@ -198,8 +310,9 @@ private:
 class PDict(type) : public Dictionary {	\
 public:	\
 	PDict(type)(dict_order ordering = UNORDERED,	\
-			int initial_size = DEFAULT_DICT_SIZE) :	\
-		Dictionary(ordering, initial_size) {}	\
+			int initial_size = DEFAULT_DICT_SIZE,	\
+			dict_layout layout = CHAINED) :	\
+		Dictionary(ordering, initial_size, layout) {}	\
 	type* Lookup(const char* key) const	\
 		{	\
 		HashKey h(key);	\
@@ -229,6 +342,8 @@ public:	\
 		} \
 	type* NextEntry(HashKey*& h, IterCookie*& cookie) const	\
 		{ return (type*) Dictionary::NextEntry(h, cookie, 1); } \
+	type* NextEntry(const void*& key, int& key_len, IterCookie*& cookie) const \
+		{ return (type*) Dictionary::NextEntry(key, key_len, cookie); } \
 	type* RemoveEntry(const HashKey* key)	\
 		{ return (type*) Remove(key->Key(), key->Size(),	\
 					key->Hash()); } \
@@ -38,7 +38,9 @@ int Discarder::NextPacket(const IP_Hdr* ip, int len, int caplen)
 
 		try
 			{
-			discard_packet = check_ip->Call(args)->AsBool();
+			Val* v = check_ip->Call(args);
+			discard_packet = v->AsBool();
+			Unref(v);
 			}
 
 		catch ( InterpreterException& e )
@@ -94,7 +96,9 @@ int Discarder::NextPacket(const IP_Hdr* ip, int len, int caplen)
 
 			try
 				{
-				discard_packet = check_tcp->Call(args)->AsBool();
+				Val* v = check_tcp->Call(args);
+				discard_packet = v->AsBool();
+				Unref(v);
 				}
 
 			catch ( InterpreterException& e )
@@ -119,7 +123,9 @@ int Discarder::NextPacket(const IP_Hdr* ip, int len, int caplen)
 
 			try
 				{
-				discard_packet = check_udp->Call(args)->AsBool();
+				Val* v = check_udp->Call(args);
+				discard_packet = v->AsBool();
+				Unref(v);
 				}
 
 			catch ( InterpreterException& e )
@@ -142,7 +148,9 @@ int Discarder::NextPacket(const IP_Hdr* ip, int len, int caplen)
 
 			try
 				{
-				discard_packet = check_icmp->Call(args)->AsBool();
+				Val* v = check_icmp->Call(args);
+				discard_packet = v->AsBool();
+				Unref(v);
 				}
 
 			catch ( InterpreterException& e )
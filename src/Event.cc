@@ -3,15 +3,37 @@
 #include "bro-config.h"
 
 #include "Event.h"
+#include "Conn.h"
 #include "Func.h"
+#include "Metrics.h"
 #include "NetVar.h"
 #include "Trigger.h"
 #include "plugin/Manager.h"
 
 EventMgr mgr;
 
+ObjPool Event_pool("Event", sizeof(Event), 1024);
+
 uint64 num_events_queued = 0;
 uint64 num_events_dispatched = 0;
+uint64 num_events_by_args[val_list::INLINE_ENTRIES + 2];
+
+static double events_queued()	{ return num_events_queued; }
+static double events_dispatched()	{ return num_events_dispatched; }
+static double events_pending()	{ return mgr.Size(); }
+
+static metrics::CallbackMetric* events_queued_metric __attribute__((unused)) =
+	metrics::registry()->NewCallbackCounter("events.queued",
+						"Events queued.",
+						events_queued);
+static metrics::CallbackMetric* events_dispatched_metric __attribute__((unused)) =
+	metrics::registry()->NewCallbackCounter("events.dispatched",
+						"Events dispatched.",
+						events_dispatched);
+static metrics::CallbackMetric* events_pending_metric __attribute__((unused)) =
+	metrics::registry()->NewCallbackGauge("events.pending",
+					      "Events queued but not dispatched yet.",
+					      events_pending);
 
 Event::Event(EventHandlerPtr arg_handler, val_list* arg_args,
 		SourceID arg_src, analyzer::ID arg_aid, TimerMgr* arg_mgr,
@@ -76,8 +98,33 @@ EventMgr::~EventMgr()
 	Unref(src_val);
 	}
 
+// Fills in what Connection::BuildConnVal() has left for later in any
+// connection records among the arguments.
+static void complete_conn_vals(val_list* args)
+	{
+	loop_over_list(*args, i)
+		{
+		Val* v = (*args)[i];
+
+		if ( ! v || v->Type() != connection_type )
+			continue;
+
+		// Connections are the only ones setting themselves as the
+		// origin of a connection record.
+		BroObj* conn = v->AsRecordVal()->GetOrigin();
+
+		if ( conn )
+			static_cast<Connection*>(conn)->CompleteConnVal();
+		}
+	}
+
 void EventMgr::QueueEvent(Event* event)
 	{
+	EventHandler* h = event->handler.Ptr();
+
+	if ( h && h->NeedsFullConnVal() )
+		complete_conn_vals(event->args);
+
 	bool done = PLUGIN_HOOK_WITH_RESULT(HOOK_QUEUE_EVENT, HookQueueEvent(event), false);
 
 	if ( done )
@@ -91,6 +138,12 @@ void EventMgr::QueueEvent(Event* event)
 		tail = event;
 		}
 
+	int n = event->args->length();
+
+	if ( n > val_list::INLINE_ENTRIES )
+		n = val_list::INLINE_ENTRIES + 1;
+
+	++num_events_by_args[n];
 	++num_events_queued;
 	}
 
@@ -120,16 +173,35 @@ void EventMgr::Drain()
 
 		while ( current )
 			{
-			Event* next = current->NextEvent();
-
-			current_src = current->Source();
-			current_mgr = current->Mgr();
-			current_aid = current->Analyzer();
-			current->Dispatch();
-			Unref(current);
-
-			++num_events_dispatched;
-			current = next;
+			// Events often come in sequences going to the same
+			// handler, like when an analyzer raises one per
+			// element of a protocol message. We run such a
+			// sequence back to back, doing the per-handler work
+			// just once. Events still execute in the order they
+			// were queued.
+			EventHandler* h = current->handler.Ptr();
+			bool error_handler = h->ErrorHandler();
+
+			if ( error_handler )
+				reporter->BeginErrorHandler();
+
+			do
+				{
+				Event* next = current->NextEvent();
+
+				current_src = current->Source();
+				current_mgr = current->Mgr();
+				current_aid = current->Analyzer();
+				current->Call();
+				Unref(current);
+
+				++num_events_dispatched;
+				current = next;
+				}
+			while ( current && current->handler.Ptr() == h );
+
+			if ( error_handler )
+				reporter->EndErrorHandler();
 			}
 		}
 
@@ -164,10 +236,10 @@ RecordVal* EventMgr::GetLocalPeerVal()
 	if ( ! src_val )
 		{
 		src_val = new RecordVal(peer);
-		src_val->Assign(0, new Val(0, TYPE_COUNT));
+		src_val->Assign(0, val_mgr->GetCount(0));
 		src_val->Assign(1, new AddrVal("127.0.0.1"));
-		src_val->Assign(2, new PortVal(0));
-		src_val->Assign(3, new Val(true, TYPE_BOOL));
+		src_val->Assign(2, val_mgr->GetPort(0));
+		src_val->Assign(3, val_mgr->GetTrue());
 
 		Ref(peer_description);
 		src_val->Assign(4, peer_description);
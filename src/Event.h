@@ -4,6 +4,7 @@
 #define event_h
 
 #include "EventRegistry.h"
+#include "ObjPool.h"
 #include "Serializer.h"
 
 #include "analyzer/Tag.h"
@@ -11,7 +12,11 @@
 
 class EventMgr;
 
+extern ObjPool Event_pool;
+
 class Event : public BroObj {
+	DECLARE_POOL_ALLOCATION(Event)
+
 public:
 	Event(EventHandlerPtr handler, val_list* args,
 		SourceID src = SOURCE_LOCAL, analyzer::ID aid = 0,
@@ -35,6 +40,20 @@ protected:
 	// This method is protected to make sure that everybody goes through
 	// EventMgr::Dispatch().
 	void Dispatch(bool no_remote = false)
+		{
+		if ( handler->ErrorHandler() )
+			reporter->BeginErrorHandler();
+
+		Call(no_remote);
+
+		if ( handler->ErrorHandler() )
+			reporter->EndErrorHandler();
+		}
+
+	// Same as Dispatch(), but leaves the reporter's error handler state
+	// to the caller. EventMgr::Drain() uses this to take care of it once
+	// per sequence of events going to the same handler.
+	void Call(bool no_remote = false)
 		{
 		if ( event_serializer )
 			{
@@ -42,9 +61,6 @@ protected:
 			event_serializer->Serialize(&info, handler->Name(), args);
 			}
 
-		if ( handler->ErrorHandler() )
-			reporter->BeginErrorHandler();
-
 		try
 			{
 			handler->Call(args, no_remote);
@@ -58,9 +74,6 @@ protected:
 		if ( obj )
 			// obj->EventDone();
 			Unref(obj);
-
-		if ( handler->ErrorHandler() )
-			reporter->EndErrorHandler();
 		}
 
 	EventHandlerPtr handler;
@@ -75,6 +88,11 @@ protected:
 extern uint64 num_events_queued;
 extern uint64 num_events_dispatched;
 
+// Events queued by their number of arguments, the last one counting all
+// with more than fit into a val_list itself. That's to see whether
+// val_list::INLINE_ENTRIES still covers most of them.
+extern uint64 num_events_by_args[val_list::INLINE_ENTRIES + 2];
+
 class EventMgr : public BroObj {
 public:
 	EventMgr();
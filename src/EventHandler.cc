@@ -4,6 +4,12 @@
 #include "Scope.h"
 #include "RemoteSerializer.h"
 #include "NetVar.h"
+#include "Traverse.h"
+#include "plugin/Manager.h"
+
+#include <map>
+#include <set>
+#include <math.h>
 
 #ifdef ENABLE_BROKER
 #include "broker/Manager.h"
@@ -18,18 +24,22 @@ EventHandler::EventHandler(const char* arg_name)
 	type = 0;
 	error_handler = false;
 	enabled = true;
+	empty = false;
 	generate_always = false;
+	reads_conn_endpoints = -1;
+	profile = 0;
 	}
 
 EventHandler::~EventHandler()
 	{
 	Unref(local);
 	delete [] name;
+	delete profile;
 	}
 
 EventHandler::operator bool() const
 	{
-	return enabled && ((local && local->HasBodies())
+	return enabled && ((local && local->HasBodies() && ! empty)
 			   || receivers.length()
 			   || generate_always
 #ifdef ENABLE_BROKER
@@ -65,6 +75,220 @@ void EventHandler::SetLocalHandler(Func* f)
 
 	Ref(f);
 	local = f;
+	reads_conn_endpoints = -1;
+	}
+
+// Looks for places in script code that may access the endpoint records of
+// a connection, or use connection records any other way besides reading
+// other fields. It errs on the side of caution; anything that doesn't
+// obviously leave the endpoints alone counts as using them.
+class ConnEndpointFinder : public TraversalCallback {
+public:
+	ConnEndpointFinder()
+		{
+		found = false;
+		orig_field = connection_type->FieldOffset("orig");
+		resp_field = connection_type->FieldOffset("resp");
+		}
+
+	TraversalCode PreExpr(const Expr* e) override;
+
+	// Examines the given function and the ones it calls.
+	void Check(const Func* f);
+
+	bool found;
+
+private:
+	bool ContainsConn(const BroType* t);
+	bool DoContainsConn(const BroType* t);
+
+	int orig_field;
+	int resp_field;
+
+	std::set<const Func*> checked_funcs;
+	std::map<const BroType*, bool> conn_types;
+	std::set<const BroType*> active_types;
+	std::set<const Expr*> harmless;
+};
+
+void ConnEndpointFinder::Check(const Func* f)
+	{
+	if ( found || ! checked_funcs.insert(f).second )
+		return;
+
+	if ( f->GetKind() == Func::BRO_FUNC )
+		f->Traverse(this);
+	}
+
+bool ConnEndpointFinder::ContainsConn(const BroType* t)
+	{
+	std::map<const BroType*, bool>::iterator i = conn_types.find(t);
+
+	if ( i != conn_types.end() )
+		return i->second;
+
+	// Recursive types end up here again while we're still working on
+	// them; the result then comes from the other fields.
+	if ( ! active_types.insert(t).second )
+		return false;
+
+	bool result = DoContainsConn(t);
+	active_types.erase(t);
+
+	// A negative result may depend on types still in the works.
+	if ( result || active_types.empty() )
+		conn_types[t] = result;
+
+	return result;
+	}
+
+bool ConnEndpointFinder::DoContainsConn(const BroType* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_ANY:
+		return true;
+
+	case TYPE_RECORD:
+		{
+		if ( t == connection_type )
+			return true;
+
+		const RecordType* rt = t->AsRecordType();
+
+		for ( int i = 0; i < rt->NumFields(); ++i )
+			if ( ContainsConn(rt->FieldType(i)) )
+				return true;
+
+		return false;
+		}
+
+	case TYPE_TABLE:
+		{
+		const TableType* tt = t->AsTableType();
+
+		if ( ContainsConn(tt->Indices()) )
+			return true;
+
+		return tt->YieldType() && ContainsConn(tt->YieldType());
+		}
+
+	case TYPE_VECTOR:
+		return ContainsConn(t->AsVectorType()->YieldType());
+
+	case TYPE_LIST:
+		{
+		const type_list* types = t->AsTypeList()->Types();
+
+		loop_over_list(*types, i)
+			if ( ContainsConn((*types)[i]) )
+				return true;
+
+		return false;
+		}
+
+	default:
+		return false;
+	}
+	}
+
+TraversalCode ConnEndpointFinder::PreExpr(const Expr* e)
+	{
+	switch ( e->Tag() ) {
+	case EXPR_FIELD:
+	case EXPR_HAS_FIELD:
+		{
+		const Expr* op = ((const UnaryExpr*) e)->Op();
+		int field = e->Tag() == EXPR_FIELD ?
+			((const FieldExpr*) e)->Field() :
+			((const HasFieldExpr*) e)->Field();
+
+		if ( e->Tag() == EXPR_FIELD && op->Type() == connection_type &&
+		     (field == orig_field || field == resp_field) )
+			{
+			found = true;
+			return TC_ABORTALL;
+			}
+
+		harmless.insert(op);
+		break;
+		}
+
+	case EXPR_CALL:
+		{
+		// Passing connections as arguments counts as using them, so
+		// we only need to look at what the callee itself accesses.
+		const Expr* func = ((const CallExpr*) e)->Func();
+		const ID* id = func->Tag() == EXPR_NAME ?
+			((const NameExpr*) func)->Id() : 0;
+
+		// Functions that may change at run-time would need a
+		// closer look.
+		if ( ! id || ! id->IsGlobal() || ! id->HasVal() ||
+		     ! (id->IsConst() ||
+			id->Type()->AsFuncType()->Flavor() == FUNC_FLAVOR_HOOK) )
+			{
+			found = true;
+			return TC_ABORTALL;
+			}
+
+		Check(id->ID_Val()->AsFunc());
+
+		if ( found )
+			return TC_ABORTALL;
+
+		break;
+		}
+
+	case EXPR_EVENT:
+		{
+		// Events get checked on their own once raised.
+		const expr_list& args = ((const EventExpr*) e)->Args()->Exprs();
+
+		loop_over_list(args, i)
+			harmless.insert(args[i]);
+
+		harmless.insert(((const EventExpr*) e)->Args());
+		break;
+		}
+
+	default:
+		break;
+	}
+
+	if ( harmless.find(e) == harmless.end() && ContainsConn(e->Type()) )
+		{
+		found = true;
+		return TC_ABORTALL;
+		}
+
+	return TC_CONTINUE;
+	}
+
+bool EventHandler::NeedsFullConnVal()
+	{
+	// Anybody beyond our own handlers may look at all of the fields.
+	if ( receivers.length() || generate_always || new_event ||
+	     event_serializer || g_policy_debug ||
+	     plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT) ||
+	     plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION) )
+		return true;
+
+#ifdef ENABLE_BROKER
+	if ( ! auto_remote_send.empty() )
+		return true;
+#endif
+
+	if ( reads_conn_endpoints < 0 )
+		{
+		ConnEndpointFinder finder;
+
+		if ( local )
+			finder.Check(local);
+
+		reads_conn_endpoints = finder.found;
+		}
+
+	return reads_conn_endpoints;
 	}
 
 void EventHandler::Call(val_list* vl, bool no_remote)
@@ -78,10 +302,23 @@ void EventHandler::Call(val_list* vl, bool no_remote)
 
 	if ( ! no_remote )
 		{
-		loop_over_list(receivers, i)
+		if ( receivers.length() == 1 )
+			{
+			SerialInfo info(remote_serializer);
+			remote_serializer->SendCall(&info, receivers[0], name, vl);
+			}
+
+		else if ( receivers.length() )
 			{
+			// Lets peers share a serialization where they can.
+			std::vector<RemoteSerializer::PeerID> ids;
+			ids.reserve(receivers.length());
+
+			loop_over_list(receivers, i)
+				ids.push_back(receivers[i]);
+
 			SerialInfo info(remote_serializer);
-			remote_serializer->SendCall(&info, receivers[i], name, vl);
+			remote_serializer->SendCall(&info, ids, name, vl);
 			}
 
 #ifdef ENABLE_BROKER
@@ -126,8 +363,13 @@ void EventHandler::Call(val_list* vl, bool no_remote)
 		}
 
 	if ( local )
-		// No try/catch here; we pass exceptions upstream.
-		Unref(local->Call(vl));
+		{
+		if ( event_handler_profile_sample_rate > 0 )
+			CallProfiled(vl);
+		else
+			// No try/catch here; we pass exceptions upstream.
+			Unref(local->Call(vl));
+		}
 	else
 		{
 		loop_over_list(*vl, i)
@@ -135,6 +377,35 @@ void EventHandler::Call(val_list* vl, bool no_remote)
 		}
 	}
 
+void EventHandler::CallProfiled(val_list* vl)
+	{
+	if ( ! profile )
+		profile = new HandlerProfile();
+
+	if ( profile->calls++ % event_handler_profile_sample_rate )
+		{
+		Unref(local->Call(vl));
+		return;
+		}
+
+	uint64 vals = num_vals_created;
+	double start = current_time(true);
+
+	try
+		{
+		Unref(local->Call(vl));
+		}
+
+	catch ( InterpreterException& e )
+		{
+		profile->AddSample(current_time(true) - start,
+				   num_vals_created - vals);
+		throw;
+		}
+
+	profile->AddSample(current_time(true) - start, num_vals_created - vals);
+	}
+
 void EventHandler::NewEvent(val_list* vl)
 	{
 	if ( ! new_event )
@@ -195,6 +466,57 @@ void EventHandler::RemoveRemoteHandler(SourceID peer)
 	receivers.remove(peer);
 	}
 
+void HandlerProfile::Reset()
+	{
+	calls = sampled = vals = 0;
+	total_time = 0;
+
+	for ( int i = 0; i < NUM_BUCKETS; ++i )
+		buckets[i] = 0;
+	}
+
+void HandlerProfile::AddSample(double elapsed, uint64 arg_vals)
+	{
+	++sampled;
+	total_time += elapsed;
+	vals += arg_vals;
+
+	int i = 0;
+
+	for ( double usecs = elapsed * 1e6; usecs >= 1.0 && i < NUM_BUCKETS - 1;
+	      usecs /= 2 )
+		++i;
+
+	++buckets[i];
+	}
+
+double HandlerProfile::Quantile(double q) const
+	{
+	if ( ! sampled )
+		return 0;
+
+	// Find the bucket holding the quantile and interpolate linearly
+	// within it.
+	double rank = q * sampled;
+	uint64 seen = 0;
+
+	for ( int i = 0; i < NUM_BUCKETS; ++i )
+		{
+		if ( seen + buckets[i] < rank || ! buckets[i] )
+			{
+			seen += buckets[i];
+			continue;
+			}
+
+		double lo = i ? ldexp(1.0, i - 1) : 0;
+		double hi = ldexp(1.0, i);
+		double frac = (rank - seen) / buckets[i];
+		return (lo + frac * (hi - lo)) / 1e6;
+		}
+
+	return ldexp(1.0, NUM_BUCKETS - 1) / 1e6;
+	}
+
 bool EventHandler::Serialize(SerialInfo* info) const
 	{
 	return SERIALIZE(name);
@@ -15,6 +15,33 @@ class Serializer;
 class SerialInfo;
 class UnserialInfo;
 
+// Execution statistics of a handler's calls, for profiling. Only a sample
+// of the calls gets timed, as set by event_handler_profile_sample_rate.
+class HandlerProfile {
+public:
+	HandlerProfile()	{ Reset(); }
+
+	void Reset();
+
+	// Records a timed call.
+	void AddSample(double elapsed, uint64 vals);
+
+	// Estimates the given quantile (between 0 and 1) of the
+	// execution times of the timed calls.
+	double Quantile(double q) const;
+
+	uint64 calls;		// total number of calls
+	uint64 sampled;		// number of timed calls
+	double total_time;	// execution time of the timed calls
+	uint64 vals;		// values created by the timed calls
+
+private:
+	// Bucket i counts the calls taking less than 2^i microseconds
+	// (and, for i > 0, at least 2^(i-1)).
+	static const int NUM_BUCKETS = 32;
+	uint64 buckets[NUM_BUCKETS];
+};
+
 class EventHandler {
 public:
 	EventHandler(const char* name);
@@ -56,11 +83,27 @@ public:
 
 	void SetEnable(bool arg_enable)	{ enabled = arg_enable; }
 
+	// Handlers marked as empty don't count as local handlers, so that
+	// the event doesn't get generated unless somebody else wants it.
+	// See EventRegistry::SuppressEmptyHandlers().
+	void SetEmpty(bool arg_empty)	{ empty = arg_empty; }
+	bool Empty() const	{ return empty; }
+
 	// Flags the event as interesting even if there is no body defined. In
 	// particular, this will then still pass the event on to plugins.
 	void SetGenerateAlways()	{ generate_always = true; }
 	bool GenerateAlways()	{ return generate_always; }
 
+	// Returns true if raising the event may expose the fields of a
+	// connection record that Connection::BuildConnVal() leaves for
+	// later, i.e., if a handler may look at its $orig or $resp, or if
+	// the arguments get passed on beyond our own handlers.
+	bool NeedsFullConnVal();
+
+	// Returns the handler's execution statistics, or nil if it hasn't
+	// been called with profiling turned on.
+	HandlerProfile* Profile()	{ return profile; }
+
 	// We don't serialize the handler(s) itself here, but
 	// just the reference to it.
 	bool Serialize(SerialInfo* info) const;
@@ -68,14 +111,18 @@ public:
 
 private:
 	void NewEvent(val_list* vl);	// Raise new_event() meta event.
+	void CallProfiled(val_list* vl);
 
 	const char* name;
 	Func* local;
 	FuncType* type;
 	bool used;		// this handler is indeed used somewhere
 	bool enabled;
+	bool empty;	// all bodies are no-ops
 	bool error_handler;	// this handler reports error messages.
 	bool generate_always;
+	int reads_conn_endpoints;	// -1 if we don't know yet
+	HandlerProfile* profile;
 
 	declare(List, SourceID);
 	typedef List(SourceID) receiver_list;
@@ -1,6 +1,9 @@
 #include "EventRegistry.h"
 #include "RE.h"
 #include "RemoteSerializer.h"
+#include "Stmt.h"
+#include "NetVar.h"
+#include "plugin/Manager.h"
 
 void EventRegistry::Register(EventHandlerPtr handler)
 	{
@@ -71,6 +74,70 @@ EventRegistry::string_list* EventRegistry::UsedHandlers()
 	return names;
 	}
 
+// True if executing the statement can't have any effect.
+static bool is_empty_stmt(const Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_NULL:
+	case STMT_INIT:
+		return true;
+
+	case STMT_LIST:
+	case STMT_EVENT_BODY_LIST:
+		{
+		const stmt_list& stmts = s->AsStmtList()->Stmts();
+
+		loop_over_list(stmts, i)
+			if ( ! is_empty_stmt(stmts[i]) )
+				return false;
+
+		return true;
+		}
+
+	default:
+		return false;
+	}
+	}
+
+EventRegistry::string_list* EventRegistry::SuppressEmptyHandlers()
+	{
+	string_list* names = new string_list;
+
+	// The debugger may want to break on the handlers, and these want
+	// to see all events.
+	if ( g_policy_debug || new_event ||
+	     plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT) )
+		return names;
+
+	IterCookie* c = handlers.InitForIteration();
+
+	HashKey* k;
+	EventHandler* v;
+	while ( (v = handlers.NextEntry(k, c)) )
+		{
+		delete k;
+
+		Func* f = v->LocalHandler();
+
+		if ( ! f || ! f->HasBodies() || f->GetKind() != Func::BRO_FUNC )
+			continue;
+
+		const vector<Func::Body>& bodies = f->GetBodies();
+		bool empty = true;
+
+		for ( unsigned int i = 0; i < bodies.size() && empty; ++i )
+			empty = is_empty_stmt(bodies[i].stmts);
+
+		if ( empty )
+			{
+			v->SetEmpty(true);
+			names->append(v->Name());
+			}
+		}
+
+	return names;
+	}
+
 EventRegistry::string_list* EventRegistry::AllHandlers()
 	{
 	string_list* names = new string_list;
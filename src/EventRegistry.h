@@ -35,6 +35,11 @@ public:
 	string_list* UsedHandlers();
 	string_list* AllHandlers();
 
+	// Marks all handlers whose bodies don't do anything as empty, so
+	// that we don't generate their events. Returns the names of the
+	// events affected. Passes ownership of list.
+	string_list* SuppressEmptyHandlers();
+
 	void PrintDebug();
 
 private:
@@ -0,0 +1,104 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <math.h>
+
+#include "ExpireIndex.h"
+
+ExpireIndex::ExpireIndex(double arg_granularity)
+	{
+	granularity = arg_granularity > 0 ? arg_granularity : 1.0;
+	num_keys = 0;
+	}
+
+ExpireIndex::~ExpireIndex()
+	{
+	for ( bucket_map::iterator i = buckets.begin(); i != buckets.end(); ++i )
+		{
+		for ( size_t j = 0; j < i->second.size(); ++j )
+			delete i->second[j];
+		}
+	}
+
+int64 ExpireIndex::BucketFor(double t) const
+	{
+	// Rounding up, so that a bucket never comes up before its entries
+	// are due.
+	return int64(ceil(t / granularity));
+	}
+
+int ExpireIndex::Add(HashKey* key, double due, double not_before)
+	{
+	int64 b = BucketFor(due);
+
+	// A bucket that's up already would return the key right away.
+	int64 min_b = int64(floor(not_before / granularity)) + 1;
+
+	if ( b < min_b )
+		b = min_b;
+
+	buckets[b].push_back(key);
+	++num_keys;
+
+	// The low bits suffice to tell registrations apart.
+	return int(b);
+	}
+
+HashKey* ExpireIndex::NextDue(double t, int* bucket)
+	{
+	int64 now = int64(floor(t / granularity));
+
+	while ( ! buckets.empty() )
+		{
+		bucket_map::iterator i = buckets.begin();
+
+		if ( i->first > now )
+			return 0;
+
+		if ( i->second.empty() )
+			{
+			buckets.erase(i);
+			continue;
+			}
+
+		HashKey* k = i->second.back();
+		i->second.pop_back();
+		--num_keys;
+
+		*bucket = int(i->first);
+		return k;
+		}
+
+	return 0;
+	}
+
+bool ExpireIndex::HasDue(double t) const
+	{
+	int64 now = int64(floor(t / granularity));
+
+	for ( bucket_map::const_iterator i = buckets.begin();
+	      i != buckets.end() && i->first <= now; ++i )
+		{
+		if ( ! i->second.empty() )
+			return true;
+		}
+
+	return false;
+	}
+
+unsigned int ExpireIndex::MemoryAllocation() const
+	{
+	unsigned int size = padded_sizeof(*this);
+
+	for ( bucket_map::const_iterator i = buckets.begin(); i != buckets.end(); ++i )
+		{
+		size += pad_size(sizeof(*i) + 3 * sizeof(void*)) +
+			pad_size(i->second.capacity() * sizeof(HashKey*));
+
+		for ( size_t j = 0; j < i->second.size(); ++j )
+			size += padded_sizeof(HashKey) + pad_size(i->second[j]->Size());
+		}
+
+	return size;
+	}
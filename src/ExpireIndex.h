@@ -0,0 +1,56 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef expireindex_h
+#define expireindex_h
+
+#include <map>
+#include <vector>
+
+#include "Hash.h"
+
+// An index of a table's entries by when they're due to expire, so that
+// expiration need only look at the entries that are due rather than at all
+// of them.  Entries go into buckets covering a fixed stretch of time each,
+// by the time they were due when added; when their bucket comes up, they
+// get checked and, if they aren't due anymore because of an access since,
+// added again for their new time.  That way, reads don't need to update the
+// index.
+//
+// An entry's bucket number identifies which of its registrations is
+// current, so that the table can ignore stale ones left behind by entries
+// that got replaced or removed.
+class ExpireIndex {
+public:
+	// Granularity is the buckets' stretch of time, in seconds.
+	ExpireIndex(double granularity);
+	~ExpireIndex();
+
+	// Registers a key that's due at the given time, taking ownership of
+	// it.  The bucket never comes up before "not_before".  Returns the
+	// bucket's number.
+	int Add(HashKey* key, double due, double not_before = 0);
+
+	// Returns one of the keys whose bucket has come up by time t, along
+	// with the bucket's number, passing ownership to the caller.
+	// Returns nil if there are none.
+	HashKey* NextDue(double t, int* bucket);
+
+	// Returns true if there's a key that NextDue() would return.
+	bool HasDue(double t) const;
+
+	int Size() const	{ return num_keys; }
+
+	unsigned int MemoryAllocation() const;
+
+protected:
+	// The bucket that an entry due at time t goes into.
+	int64 BucketFor(double t) const;
+
+	double granularity;
+	int num_keys;
+
+	typedef std::map<int64, std::vector<HashKey*> > bucket_map;
+	bucket_map buckets;
+};
+
+#endif
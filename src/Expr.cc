@@ -15,6 +15,7 @@
 #include "Traverse.h"
 #include "Trigger.h"
 #include "IPAddr.h"
+#include "plugin/Manager.h"
 
 const char* expr_name(BroExprTag t)
 	{
@@ -49,6 +50,87 @@ const char* expr_name(BroExprTag t)
 	return expr_names[int(t)];
 	}
 
+// True if values of the given type can't be modified in place, so that
+// it's safe to share them between expressions.
+static bool is_immutable_type(const BroType* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+	case TYPE_STRING:
+	case TYPE_ENUM:
+	case TYPE_PORT:
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// True if the given operator expression can be evaluated at load time
+// once its operands are constant.
+static bool is_foldable(const Expr* e)
+	{
+	if ( e->IsError() || ! is_immutable_type(e->Type()) )
+		return false;
+
+	switch ( e->Tag() ) {
+	case EXPR_NOT:
+	case EXPR_POSITIVE:
+	case EXPR_NEGATE:
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+	case EXPR_ARITH_COERCE:
+	case EXPR_SIZE:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// Returns a constant with the value of the given expression, or the
+// expression itself if it fails to evaluate.
+static Expr* fold_expr(Expr* e)
+	{
+	Val* v = 0;
+
+	try
+		{
+		v = e->Eval(0);
+		}
+
+	catch ( InterpreterException& )
+		{
+		return e;
+		}
+
+	if ( ! v )
+		return e;
+
+	ConstExpr* c = new ConstExpr(v);
+	c->SetLocationInfo(e->GetLocationInfo());
+	return c;
+	}
+
 Expr::Expr(BroExprTag arg_tag)
 	{
 	tag = arg_tag;
@@ -116,6 +198,11 @@ int Expr::IsPure() const
 	return 1;
 	}
 
+Expr* Expr::Simplify()
+	{
+	return this;
+	}
+
 Val* Expr::InitVal(const BroType* t, Val* aggr) const
 	{
 	if ( aggr )
@@ -299,6 +386,20 @@ int NameExpr::IsPure() const
 	return id->IsConst();
 	}
 
+Expr* NameExpr::Simplify()
+	{
+	// Constants have their final values once all scripts are parsed,
+	// including any redefs.
+	if ( IsError() || ! id->IsGlobal() || ! id->IsConst() ||
+	     id->AsType() || ! id->HasVal() ||
+	     ! is_immutable_type(id->Type()) )
+		return this;
+
+	ConstExpr* c = new ConstExpr(id->ID_Val()->Ref());
+	c->SetLocationInfo(GetLocationInfo());
+	return c;
+	}
+
 TraversalCode NameExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -477,6 +578,16 @@ int UnaryExpr::IsPure() const
 	return op->IsPure();
 	}
 
+Expr* UnaryExpr::Simplify()
+	{
+	simplify_expr(op);
+
+	if ( op->IsConst() && is_foldable(this) )
+		return fold_expr(this);
+
+	return this;
+	}
+
 TraversalCode UnaryExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -573,7 +684,16 @@ Val* BinaryExpr::Eval(Frame* f) const
 			return 0;
 			}
 
-		VectorVal* v_result = new VectorVal(Type()->AsVectorType());
+		VectorVal* v_result = NumericVectorFold(v1, v2);
+
+		if ( v_result )
+			{
+			Unref(v1);
+			Unref(v2);
+			return v_result;
+			}
+
+		v_result = new VectorVal(Type()->AsVectorType());
 
 		for ( unsigned int i = 0; i < v_op1->Size(); ++i )
 			{
@@ -594,7 +714,16 @@ Val* BinaryExpr::Eval(Frame* f) const
 	if ( IsVector(Type()->Tag()) && (is_vec1 || is_vec2) )
 		{ // fold vector against scalar
 		VectorVal* vv = (is_vec1 ? v1 : v2)->AsVectorVal();
-		VectorVal* v_result = new VectorVal(Type()->AsVectorType());
+		VectorVal* v_result = NumericVectorFold(v1, v2);
+
+		if ( v_result )
+			{
+			Unref(v1);
+			Unref(v2);
+			return v_result;
+			}
+
+		v_result = new VectorVal(Type()->AsVectorType());
 
 		for ( unsigned int i = 0; i < vv->Size(); ++i )
 			{
@@ -627,6 +756,21 @@ int BinaryExpr::IsPure() const
 	return op1->IsPure() && op2->IsPure();
 	}
 
+Expr* BinaryExpr::Simplify()
+	{
+	simplify_expr(op1);
+	simplify_expr(op2);
+
+	if ( ! BothConst() || ! is_foldable(this) )
+		return this;
+
+	// Leave it to run-time to report these.
+	if ( (tag == EXPR_DIVIDE || tag == EXPR_MOD) && op2->IsZero() )
+		return this;
+
+	return fold_expr(this);
+	}
+
 TraversalCode BinaryExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -802,8 +946,246 @@ Val* BinaryExpr::Fold(Val* v1, Val* v2) const
 		return new Val(i3, ret_type->Tag());
 	}
 
+static inline void get_number(const Val* v, bro_int_t* x)	{ *x = v->InternalInt(); }
+static inline void get_number(const Val* v, bro_uint_t* x)	{ *x = v->InternalUnsigned(); }
+static inline void get_number(const Val* v, double* x)	{ *x = v->InternalDouble(); }
+
+// Copies the numbers of a vector, or a scalar n times, into an array.
+// Holes become zeros, with have[i] cleared.
+template<typename T>
+static void unbox_numbers(Val* v, unsigned int n, T* out, char* have)
+	{
+	if ( v->Type()->Tag() != TYPE_VECTOR )
+		{
+		T x;
+		get_number(v, &x);
+
+		for ( unsigned int i = 0; i < n; ++i )
+			out[i] = x;
+
+		return;
+		}
+
+	const vector<Val*>& elems = *v->AsVector();
+
+	for ( unsigned int i = 0; i < n; ++i )
+		{
+		if ( elems[i] )
+			get_number(elems[i], &out[i]);
+		else
+			{
+			out[i] = 0;
+			have[i] = 0;
+			}
+		}
+	}
+
+// The loops go over plain arrays, without branches, so that compilers
+// can vectorize them.
+template<typename T>
+static void fold_arith(BroExprTag tag, const T* a, const T* b, T* r,
+			unsigned int n)
+	{
+	switch ( tag ) {
+	case EXPR_ADD:
+		for ( unsigned int i = 0; i < n; ++i )
+			r[i] = a[i] + b[i];
+		break;
+
+	case EXPR_SUB:
+		for ( unsigned int i = 0; i < n; ++i )
+			r[i] = a[i] - b[i];
+		break;
+
+	case EXPR_TIMES:
+		for ( unsigned int i = 0; i < n; ++i )
+			r[i] = a[i] * b[i];
+		break;
+
+	case EXPR_DIVIDE:
+		for ( unsigned int i = 0; i < n; ++i )
+			r[i] = a[i] / b[i];
+		break;
+
+	default:
+		reporter->InternalError("bad tag in fold_arith");
+	}
+	}
+
+template<typename T>
+static void fold_mod(const T* a, const T* b, T* r, unsigned int n)
+	{
+	for ( unsigned int i = 0; i < n; ++i )
+		r[i] = a[i] % b[i];
+	}
+
+static void fold_mod(const double* a, const double* b, double* r,
+			unsigned int n)
+	{
+	reporter->InternalError("bad type in fold_mod");
+	}
+
+template<typename T>
+static void fold_compare(BroExprTag tag, const T* a, const T* b, char* r,
+			 unsigned int n)
+	{
+	switch ( tag ) {
+#define DO_COMPARE(op) \
+	for ( unsigned int i = 0; i < n; ++i ) \
+		r[i] = a[i] op b[i]; \
+	break;
+
+	case EXPR_LT:	DO_COMPARE(<)
+	case EXPR_LE:	DO_COMPARE(<=)
+	case EXPR_EQ:	DO_COMPARE(==)
+	case EXPR_NE:	DO_COMPARE(!=)
+	case EXPR_GE:	DO_COMPARE(>=)
+	case EXPR_GT:	DO_COMPARE(>)
+#undef DO_COMPARE
+
+	default:
+		reporter->InternalError("bad tag in fold_compare");
+	}
+	}
+
+static Val* box_number(bro_int_t x, BroType* t)
+	{
+	return t->Tag() == TYPE_INT ? val_mgr->GetInt(x) : new Val(x, t->Tag());
+	}
+
+static Val* box_number(bro_uint_t x, BroType* t)
+	{
+	return t->Tag() == TYPE_COUNT ? val_mgr->GetCount(x) : new Val(x, t->Tag());
+	}
+
+static Val* box_number(double x, BroType* t)
+	{
+	if ( t->Tag() == TYPE_INTERVAL )
+		return new IntervalVal(x, 1.0);
+
+	return new Val(x, t->Tag());
+	}
+
+template<typename T>
+static VectorVal* numeric_vector_fold(const BinaryExpr* e, BroExprTag tag,
+					Val* v1, Val* v2, unsigned int n)
+	{
+	vector<T> a(n), b(n);
+	vector<char> have(n, 1);
+	unbox_numbers(v1, n, &a[0], &have[0]);
+	unbox_numbers(v2, n, &b[0], &have[0]);
+
+	if ( tag == EXPR_DIVIDE || tag == EXPR_MOD )
+		{
+		for ( unsigned int i = 0; i < n; ++i )
+			if ( have[i] && b[i] == 0 )
+				reporter->ExprRuntimeError(e, tag == EXPR_MOD ?
+						"modulo by zero" : "division by zero");
+
+			else if ( ! have[i] )
+				b[i] = 1;	// the result's a hole anyway
+		}
+
+	VectorType* vt = e->Type()->AsVectorType();
+	BroType* yt = vt->YieldType();
+	VectorVal* result = new VectorVal(vt);
+	result->Reserve(n);
+
+	if ( yt->Tag() == TYPE_BOOL )
+		{
+		vector<char> r(n);
+		fold_compare(tag, &a[0], &b[0], &r[0], n);
+
+		for ( unsigned int i = 0; i < n; ++i )
+			result->AppendNew(have[i] ? val_mgr->GetBool(r[i]) : 0);
+		}
+
+	else
+		{
+		vector<T> r(n);
+
+		if ( tag == EXPR_MOD )
+			fold_mod(&a[0], &b[0], &r[0], n);
+		else
+			fold_arith(tag, &a[0], &b[0], &r[0], n);
+
+		for ( unsigned int i = 0; i < n; ++i )
+			result->AppendNew(have[i] ? box_number(r[i], yt) : 0);
+		}
+
+	return result;
+	}
+
+VectorVal* BinaryExpr::NumericVectorFold(Val* v1, Val* v2) const
+	{
+	switch ( tag ) {
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		break;
+
+	default:
+		return 0;
+	}
+
+	BroType* t1 = v1->Type();
+	BroType* t2 = v2->Type();
+
+	if ( t1->Tag() == TYPE_VECTOR )
+		t1 = t1->YieldType();
+
+	if ( t2->Tag() == TYPE_VECTOR )
+		t2 = t2->YieldType();
+
+	InternalTypeTag it = t1->InternalType();
+
+	if ( t2->InternalType() != it )
+		return 0;
+
+	BroType* yt = Type()->YieldType();
+	InternalTypeTag rit = yt->InternalType();
+
+	if ( yt->Tag() != TYPE_BOOL && rit != it )
+		return 0;
+
+	const Val* vv = v1->Type()->Tag() == TYPE_VECTOR ? v1 : v2;
+	unsigned int n = vv->AsVector()->size();
+
+	if ( n == 0 )
+		return new VectorVal(Type()->AsVectorType());
+
+	switch ( it ) {
+	case TYPE_INTERNAL_INT:
+		return numeric_vector_fold<bro_int_t>(this, tag, v1, v2, n);
+
+	case TYPE_INTERNAL_UNSIGNED:
+		return numeric_vector_fold<bro_uint_t>(this, tag, v1, v2, n);
+
+	case TYPE_INTERNAL_DOUBLE:
+		if ( tag == EXPR_MOD )
+			return 0;
+
+		return numeric_vector_fold<double>(this, tag, v1, v2, n);
+
+	default:
+		return 0;
+	}
+	}
+
 Val* BinaryExpr::StringFold(Val* v1, Val* v2) const
 	{
+	if ( tag == EXPR_ADD || tag == EXPR_ADD_TO )
+		// Without looking at v1's bytes, which may still be pending.
+		return StringVal::Concat(v1->AsStringVal(), v2->AsStringVal());
+
 	const BroString* s1 = v1->AsString();
 	const BroString* s2 = v2->AsString();
 	int result = 0;
@@ -819,21 +1201,11 @@ Val* BinaryExpr::StringFold(Val* v1, Val* v2) const
 	case EXPR_GE:		DO_FOLD(>=)
 	case EXPR_GT:		DO_FOLD(>)
 
-	case EXPR_ADD:
-	case EXPR_ADD_TO:
-		{
-		vector<const BroString*> strings;
-		strings.push_back(s1);
-		strings.push_back(s2);
-
-		return new StringVal(concatenate(strings));
-		}
-
 	default:
 		BadTag("BinaryExpr::StringFold", expr_name(tag));
 	}
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 Val* BinaryExpr::AddrFold(Val* v1, Val* v2) const
@@ -867,7 +1239,7 @@ Val* BinaryExpr::AddrFold(Val* v1, Val* v2) const
 		BadTag("BinaryExpr::AddrFold", expr_name(tag));
 	}
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 Val* BinaryExpr::SubNetFold(Val* v1, Val* v2) const
@@ -880,7 +1252,7 @@ Val* BinaryExpr::SubNetFold(Val* v1, Val* v2) const
 	if ( tag == EXPR_NE )
 		result = ! result;
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 void BinaryExpr::SwapOps()
@@ -1192,7 +1564,7 @@ Val* NegExpr::Fold(Val* v) const
 	else if ( v->Type()->Tag() == TYPE_INTERVAL )
 		return new IntervalVal(- v->InternalDouble(), 1.0);
 	else
-		return new Val(- v->CoerceToInt(), TYPE_INT);
+		return val_mgr->GetInt(- v->CoerceToInt());
 	}
 
 
@@ -1699,6 +2071,24 @@ Val* BoolExpr::DoSingleEval(Frame* f, Val* v1, Expr* op2) const
 		}
 	}
 
+Expr* BoolExpr::Simplify()
+	{
+	Expr* e = BinaryExpr::Simplify();
+
+	if ( e != this || ! op1->IsConst() || IsError() ||
+	     Type()->Tag() != TYPE_BOOL )
+		return e;
+
+	// Short-circuit on a constant left-hand side; the right-hand side
+	// either doesn't get evaluated at all, or decides the result.
+	bool lhs = ! op1->IsZero();
+
+	if ( (tag == EXPR_AND) == lhs )
+		return op2->Ref();
+	else
+		return op1->Ref();
+	}
+
 
 Val* BoolExpr::Eval(Frame* f) const
 	{
@@ -1786,7 +2176,7 @@ Val* BoolExpr::Eval(Frame* f) const
 				(! op1->IsZero() && ! op2->IsZero()) :
 				(! op1->IsZero() || ! op2->IsZero());
 
-			result->Assign(i, new Val(local_result, TYPE_BOOL));
+			result->Assign(i, val_mgr->GetBool(local_result));
 			}
 		else
 			result->Assign(i, 0);
@@ -1891,9 +2281,9 @@ Val* EqExpr::Fold(Val* v1, Val* v2) const
 		RE_Matcher* re = v1->AsPattern();
 		const BroString* s = v2->AsString();
 		if ( tag == EXPR_EQ )
-			return new Val(re->MatchExactly(s), TYPE_BOOL);
+			return val_mgr->GetBool(re->MatchExactly(s));
 		else
-			return new Val(! re->MatchExactly(s), TYPE_BOOL);
+			return val_mgr->GetBool(! re->MatchExactly(s));
 		}
 
 	else
@@ -2094,6 +2484,18 @@ int CondExpr::IsPure() const
 	return op1->IsPure() && op2->IsPure() && op3->IsPure();
 	}
 
+Expr* CondExpr::Simplify()
+	{
+	simplify_expr(op1);
+	simplify_expr(op2);
+	simplify_expr(op3);
+
+	if ( IsError() || ! op1->IsConst() || is_vector(op1) )
+		return this;
+
+	return op1->IsZero() ? op3->Ref() : op2->Ref();
+	}
+
 TraversalCode CondExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -2163,6 +2565,12 @@ Expr* RefExpr::MakeLvalue()
 	return this;
 	}
 
+Expr* RefExpr::Simplify()
+	{
+	// Assignment targets stay as they are.
+	return this;
+	}
+
 void RefExpr::Assign(Frame* f, Val* v, Opcode opcode)
 	{
 	op->Assign(f, v, opcode);
@@ -2570,6 +2978,12 @@ int AssignExpr::IsPure() const
 	return 0;
 	}
 
+Expr* AssignExpr::Simplify()
+	{
+	simplify_expr(op2);
+	return this;
+	}
+
 IMPLEMENT_SERIAL(AssignExpr, SER_ASSIGN_EXPR);
 
 bool AssignExpr::DoSerialize(SerialInfo* info) const
@@ -2704,12 +3118,65 @@ Expr* IndexExpr::MakeLvalue()
 	return new RefExpr(this);
 	}
 
+// For a table lookup with just one index expression, whether it can skip
+// putting the index value into a list as ListExpr::Eval() would; all of
+// TableVal's lookups take single values as well.
+static bool is_single_table_index(const Expr* table, const Expr* index)
+	{
+	return table->Type()->Tag() == TYPE_TABLE &&
+		index->Tag() == EXPR_LIST &&
+		index->AsListExpr()->Exprs().length() == 1;
+	}
+
+// Evaluates the single index of an expression passing
+// is_single_table_index(), in the form to hand to the lookup in table.
+// Returns 0 if evaluation fails.
+static Val* eval_single_table_index(const Expr* index, Frame* f)
+	{
+	Val* v = index->AsListExpr()->Exprs()[0]->Eval(f);
+
+	if ( ! v )
+		index->Error("uninitialized list value");
+
+	return v;
+	}
+
+// Returns the single index v as the lookup in table needs it, taking
+// over the reference.  Tables that propagate their accesses keep getting
+// lists, which is what the receiving end of the StateAccess expects.
+static Val* as_table_index(Val* table, Val* v)
+	{
+	if ( ! table->AsTableVal()->LoggingAccess() )
+		return v;
+
+	ListVal* lv = new ListVal(TYPE_ANY);
+	lv->Append(v);
+	return lv;
+	}
+
 Val* IndexExpr::Eval(Frame* f) const
 	{
 	Val* v1 = op1->Eval(f);
 	if ( ! v1 )
 		return 0;
 
+	if ( is_single_table_index(op1, op2) )
+		{
+		Val* index = eval_single_table_index(op2, f);
+		if ( ! index )
+			{
+			Unref(v1);
+			return 0;
+			}
+
+		index = as_table_index(v1, index);
+		Val* result = Fold(v1, index);
+
+		Unref(v1);
+		Unref(index);
+		return result;
+		}
+
 	Val* v2 = op2->Eval(f);
 	if ( ! v2 )
 		{
@@ -2784,8 +3251,22 @@ Val* IndexExpr::Fold(Val* v1, Val* v2) const
 		break;
 
 	case TYPE_TABLE:
-		v = v1->AsTableVal()->Lookup(v2);
+		{
+		TableVal* tv = v1->AsTableVal();
+
+		if ( tv->Type()->AsTableType()->IsPatternIndex() )
+			{
+			Val* s = v2->Type()->Tag() == TYPE_LIST ?
+					v2->AsListVal()->Index(0) : v2;
+
+			if ( s->Type()->Tag() == TYPE_STRING )
+				return tv->LookupPattern(s->AsStringVal(),
+							 Type()->AsVectorType());
+			}
+
+		v = tv->Lookup(v2);
 		break;
+		}
 
 	case TYPE_STRING:
 		{
@@ -3075,10 +3556,10 @@ Val* HasFieldExpr::Fold(Val* v) const
 	rec_to_look_at = v->AsRecordVal();
 
 	if ( ! rec_to_look_at )
-		return new Val(0, TYPE_BOOL);
+		return val_mgr->GetFalse();
 
 	RecordVal* r = rec_to_look_at->Ref()->AsRecordVal();
-	Val* ret = new Val(r->Lookup(field) != 0, TYPE_BOOL);
+	Val* ret = val_mgr->GetBool(r->Lookup(field) != 0);
 	Unref(r);
 
 	return ret;
@@ -3687,10 +4168,10 @@ Val* ArithCoerceExpr::FoldSingleVal(Val* v, InternalTypeTag t) const
 		return new Val(v->CoerceToDouble(), TYPE_DOUBLE);
 
 	case TYPE_INTERNAL_INT:
-		return new Val(v->CoerceToInt(), TYPE_INT);
+		return val_mgr->GetInt(v->CoerceToInt());
 
 	case TYPE_INTERNAL_UNSIGNED:
-		return new Val(v->CoerceToUnsigned(), TYPE_COUNT);
+		return val_mgr->GetCount(v->CoerceToUnsigned());
 
 	default:
 		Internal("bad type in CoerceExpr::Fold");
@@ -3768,13 +4249,15 @@ RecordCoerceExpr::RecordCoerceExpr(Expr* op, RecordType* r)
 		map_size = t_r->NumFields();
 		map = new int[map_size];
 
+		const std::vector<int>& field_map = record_field_map(sub_r, t_r);
+
 		int i;
 		for ( i = 0; i < map_size; ++i )
 			map[i] = -1;	// -1 = field is not mapped
 
 		for ( i = 0; i < sub_r->NumFields(); ++i )
 			{
-			int t_i = t_r->FieldOffset(sub_r->FieldName(i));
+			int t_i = field_map[i];
 			if ( t_i < 0 )
 				{
 				ExprError(fmt("orphaned field \"%s\" in record coercion",
@@ -4126,35 +4609,175 @@ bool FlattenExpr::DoUnserialize(UnserialInfo* info)
 	return UNSERIALIZE(&num_fields);
 	}
 
+// The pending recurring schedules, by the key of their event and
+// arguments.
+typedef std::map<std::string, ScheduleTimer*> RecurringScheduleMap;
+static RecurringScheduleMap recurring_schedules;
+
+// Appends a variable-length part of a recurring schedule's key, with
+// its length first so that different arguments can't run together into
+// the same key.
+static void append_key_bytes(std::string* key, const char* bytes, uint32 len)
+	{
+	key->append((const char*) &len, sizeof(len));
+	key->append(bytes, len);
+	}
+
+static std::string recurring_schedule_key(EventHandlerPtr event,
+						const val_list* args)
+	{
+	std::string key;
+	append_key_bytes(&key, event->Name(), strlen(event->Name()));
+
+	loop_over_list(*args, i)
+		{
+		Val* v = (*args)[i];
+
+		// Arguments of type any may come with different types.
+		key += char(v->Type()->Tag());
+
+		switch ( v->Type()->InternalType() ) {
+		case TYPE_INTERNAL_INT:
+			{
+			bro_int_t n = v->InternalInt();
+			key.append((const char*) &n, sizeof(n));
+			break;
+			}
+
+		case TYPE_INTERNAL_UNSIGNED:
+			{
+			bro_uint_t n = v->InternalUnsigned();
+			key.append((const char*) &n, sizeof(n));
+			break;
+			}
+
+		case TYPE_INTERNAL_DOUBLE:
+			{
+			double d = v->InternalDouble();
+			key.append((const char*) &d, sizeof(d));
+			break;
+			}
+
+		case TYPE_INTERNAL_STRING:
+			append_key_bytes(&key, (const char*) v->AsString()->Bytes(),
+					 v->AsString()->Len());
+			break;
+
+		case TYPE_INTERNAL_ADDR:
+			{
+			std::string a = v->AsAddr().AsString();
+			append_key_bytes(&key, a.data(), a.size());
+			break;
+			}
+
+		case TYPE_INTERNAL_SUBNET:
+			{
+			std::string sn = v->AsSubNet().AsString();
+			append_key_bytes(&key, sn.data(), sn.size());
+			break;
+			}
+
+		default:
+			// The pending timer holds a reference, so the pointer
+			// can't belong to another value meanwhile.
+			key.append((const char*) &v, sizeof(v));
+			break;
+		}
+		}
+
+	return key;
+	}
+
 ScheduleTimer::ScheduleTimer(EventHandlerPtr arg_event, val_list* arg_args,
-				double t, TimerMgr* arg_tmgr)
+				double t, TimerMgr* arg_tmgr, double arg_every)
 : Timer(t, TIMER_SCHEDULE)
 	{
 	event = arg_event;
 	args = arg_args;
 	tmgr = arg_tmgr;
+	every = arg_every;
+
+	if ( every > 0 )
+		{
+		key = recurring_schedule_key(event, args);
+		recurring_schedules[key] = this;
+		}
 	}
 
 ScheduleTimer::~ScheduleTimer()
 	{
+	if ( every > 0 )
+		{
+		recurring_schedules.erase(key);
+		delete_vals(args);
+		}
 	}
 
 void ScheduleTimer::Dispatch(double /* t */, int /* is_expire */)
 	{
-	mgr.QueueEvent(event, args, SOURCE_LOCAL, 0, tmgr);
+	if ( every <= 0 )
+		{
+		// The event takes over the arguments.
+		mgr.QueueEvent(event, args, SOURCE_LOCAL, 0, tmgr);
+		return;
+		}
+
+	val_list* vl = new val_list(args->length());
+
+	loop_over_list(*args, i)
+		vl->append((*args)[i]->Ref());
+
+	mgr.QueueEvent(event, vl, SOURCE_LOCAL, 0, tmgr);
+	}
+
+double ScheduleTimer::NextTime(double t) const
+	{
+	if ( every <= 0 || terminating )
+		return 0;
+
+	// Keep to the schedule's original phase, unless the timer expired
+	// so late that it already passed the next time.
+	double next = Time() + every;
+	return next > t ? next : t + every;
+	}
+
+ScheduleTimer* ScheduleTimer::LookupRecurring(EventHandlerPtr event,
+						const val_list* args)
+	{
+	RecurringScheduleMap::const_iterator i =
+		recurring_schedules.find(recurring_schedule_key(event, args));
+
+	return i != recurring_schedules.end() ? i->second : 0;
 	}
 
-ScheduleExpr::ScheduleExpr(Expr* arg_when, EventExpr* arg_event)
+bool ScheduleTimer::CancelRecurring(EventHandlerPtr event,
+					const val_list* args)
+	{
+	ScheduleTimer* t = LookupRecurring(event, args);
+
+	if ( ! t )
+		return false;
+
+	// This deletes the timer, which unregisters it.
+	t->tmgr->Cancel(t);
+	return true;
+	}
+
+ScheduleExpr::ScheduleExpr(Expr* arg_when, EventExpr* arg_event,
+				bool arg_recurring)
 : Expr(EXPR_SCHEDULE)
 	{
 	when = arg_when;
 	event = arg_event;
+	recurring = arg_recurring;
 
 	if ( IsError() || when->IsError() || event->IsError() )
 		return;
 
 	TypeTag bt = when->Type()->Tag();
-	if ( bt != TYPE_TIME && bt != TYPE_INTERVAL )
+	if ( recurring && bt != TYPE_INTERVAL )
+		ExprError("recurring schedule requires a time interval");
+	else if ( bt != TYPE_TIME && bt != TYPE_INTERVAL )
 		ExprError("schedule expression requires a time or time interval");
 	else
 		SetType(base_type(TYPE_TIMER));
@@ -4181,11 +4804,32 @@ Val* ScheduleExpr::Eval(Frame* f) const
 		return 0;
 
 	double dt = when_val->InternalDouble();
+	double every = 0;
+
+	if ( recurring )
+		{
+		every = dt;
+
+		if ( every <= 0 )
+			{
+			Unref(when_val);
+			RuntimeError("recurring schedule requires a positive interval");
+			}
+		}
+
 	if ( when->Type()->Tag() == TYPE_INTERVAL )
 		dt += network_time;
 
 	val_list* args = eval_list(f, event->Args());
 
+	if ( args && recurring &&
+	     ScheduleTimer::LookupRecurring(event->Handler(), args) )
+		{
+		// The same one is pending already.
+		delete_vals(args);
+		args = 0;
+		}
+
 	if ( args )
 		{
 		TimerMgr* tmgr = mgr.CurrentTimerMgr();
@@ -4193,7 +4837,8 @@ Val* ScheduleExpr::Eval(Frame* f) const
 		if ( ! tmgr )
 			tmgr = timer_mgr;
 
-		tmgr->Add(new ScheduleTimer(event->Handler(), args, dt, tmgr));
+		tmgr->Add(new ScheduleTimer(event->Handler(), args, dt, tmgr,
+						every));
 		}
 
 	Unref(when_val);
@@ -4219,8 +4864,13 @@ TraversalCode ScheduleExpr::Traverse(TraversalCallback* cb) const
 void ScheduleExpr::ExprDescribe(ODesc* d) const
 	{
 	if ( d->IsReadable() )
+		{
 		d->AddSP("schedule");
 
+		if ( recurring )
+			d->AddSP("every");
+		}
+
 	when->Describe(d);
 	d->SP();
 
@@ -4241,7 +4891,8 @@ IMPLEMENT_SERIAL(ScheduleExpr, SER_SCHEDULE_EXPR);
 bool ScheduleExpr::DoSerialize(SerialInfo* info) const
 	{
 	DO_SERIALIZE(SER_SCHEDULE_EXPR, Expr);
-	return when->Serialize(info) && event->Serialize(info);
+	return when->Serialize(info) && event->Serialize(info) &&
+		SERIALIZE(recurring);
 	}
 
 bool ScheduleExpr::DoUnserialize(UnserialInfo* info)
@@ -4253,7 +4904,7 @@ bool ScheduleExpr::DoUnserialize(UnserialInfo* info)
 		return false;
 
 	event = (EventExpr*) Expr::Unserialize(info, EXPR_EVENT);
-	return event != 0;
+	return event != 0 && UNSERIALIZE(&recurring);
 	}
 
 InExpr::InExpr(Expr* arg_op1, Expr* arg_op2)
@@ -4322,6 +4973,16 @@ InExpr::InExpr(Expr* arg_op1, Expr* arg_op2)
 				}
 			}
 
+		// Check for:	<string> in set[pattern]
+		//		<string> in table[pattern] of ...
+		if ( op1->Type()->Tag() == TYPE_STRING &&
+		     op2->Type()->Tag() == TYPE_TABLE &&
+		     op2->Type()->AsTableType()->IsPatternIndex() )
+			{
+			SetType(base_type(TYPE_BOOL));
+			return;
+			}
+
 		if ( op1->Tag() != EXPR_LIST )
 			op1 = new ListExpr(op1);
 
@@ -4337,13 +4998,37 @@ InExpr::InExpr(Expr* arg_op1, Expr* arg_op2)
 		}
 	}
 
+Val* InExpr::Eval(Frame* f) const
+	{
+	if ( IsError() || ! is_single_table_index(op2, op1) )
+		return BinaryExpr::Eval(f);
+
+	Val* index = eval_single_table_index(op1, f);
+	if ( ! index )
+		return 0;
+
+	Val* v2 = op2->Eval(f);
+	if ( ! v2 )
+		{
+		Unref(index);
+		return 0;
+		}
+
+	index = as_table_index(v2, index);
+	Val* result = Fold(index, v2);
+
+	Unref(index);
+	Unref(v2);
+	return result;
+	}
+
 Val* InExpr::Fold(Val* v1, Val* v2) const
 	{
 	if ( v1->Type()->Tag() == TYPE_PATTERN )
 		{
 		RE_Matcher* re = v1->AsPattern();
 		const BroString* s = v2->AsString();
-		return new Val(re->MatchAnywhere(s) != 0, TYPE_BOOL);
+		return val_mgr->GetBool(re->MatchAnywhere(s) != 0);
 		}
 
 	if ( v2->Type()->Tag() == TYPE_STRING )
@@ -4353,12 +5038,17 @@ Val* InExpr::Fold(Val* v1, Val* v2) const
 
 		// Could do better here - either roll our own, to deal with
 		// NULs, and/or Boyer-Moore if done repeatedly.
-		return new Val(strstr(s2->CheckString(), s1->CheckString()) != 0, TYPE_BOOL);
+		return val_mgr->GetBool(strstr(s2->CheckString(), s1->CheckString()) != 0);
 		}
 
 	if ( v1->Type()->Tag() == TYPE_ADDR &&
 	     v2->Type()->Tag() == TYPE_SUBNET )
-		return new Val(v2->AsSubNetVal()->Contains(v1->AsAddr()), TYPE_BOOL);
+		return val_mgr->GetBool(v2->AsSubNetVal()->Contains(v1->AsAddr()));
+
+	if ( v1->Type()->Tag() == TYPE_STRING &&
+	     v2->Type()->Tag() == TYPE_TABLE &&
+	     v2->Type()->AsTableType()->IsPatternIndex() )
+		return val_mgr->GetBool(v2->AsTableVal()->MatchesPattern(v1->AsStringVal()));
 
 	Val* res;
 
@@ -4368,9 +5058,9 @@ Val* InExpr::Fold(Val* v1, Val* v2) const
 		res = v2->AsTableVal()->Lookup(v1, false);
 
 	if ( res )
-		return new Val(1, TYPE_BOOL);
+		return val_mgr->GetTrue();
 	else
-		return new Val(0, TYPE_BOOL);
+		return val_mgr->GetFalse();
 	}
 
 IMPLEMENT_SERIAL(InExpr, SER_IN_EXPR);
@@ -4392,6 +5082,8 @@ CallExpr::CallExpr(Expr* arg_func, ListExpr* arg_args, bool in_hook)
 	{
 	func = arg_func;
 	args = arg_args;
+	direct_bif = 0;
+	direct_val = 0;
 
 	if ( func->IsError() || args->IsError() )
 		{
@@ -4503,6 +5195,138 @@ int CallExpr::IsPure() const
 	return pure;
 	}
 
+// If the given function always returns the same constant, returns that
+// constant; otherwise nil.
+static Val* constant_result(const ::Func* f)
+	{
+	if ( f->GetKind() != Func::BRO_FUNC ||
+	     f->Flavor() != FUNC_FLAVOR_FUNCTION ||
+	     f->GetBodies().size() != 1 )
+		return 0;
+
+	const Stmt* body = f->GetBodies()[0].stmts;
+
+	if ( body->Tag() == STMT_LIST )
+		{
+		const stmt_list& stmts = body->AsStmtList()->Stmts();
+
+		if ( stmts.length() != 1 )
+			return 0;
+
+		body = stmts[0];
+		}
+
+	if ( body->Tag() != STMT_RETURN )
+		return 0;
+
+	const Expr* e = ((const ReturnStmt*) body)->StmtExpr();
+
+	if ( ! e || ! e->IsConst() || ! is_immutable_type(e->Type()) )
+		return 0;
+
+	return e->ExprVal();
+	}
+
+// The most arguments that CallExpr::EvalDirect() passes.
+static const int MAX_DIRECT_ARGS = 8;
+
+void CallExpr::FindDirectCall()
+	{
+	direct_bif = 0;
+	direct_val = 0;
+
+	if ( IsError() || func->Tag() != EXPR_NAME )
+		return;
+
+	ID* id = ((NameExpr*) func)->Id();
+
+	if ( ! id->IsGlobal() || ! id->HasVal() || id->Type()->Tag() != TYPE_FUNC )
+		return;
+
+	const ::Func* f = id->ID_Val()->AsFunc();
+
+	if ( f->GetKind() != Func::BUILTIN_FUNC )
+		return;
+
+	const BuiltinFunc* bif = static_cast<const BuiltinFunc*>(f);
+	int n = args->Exprs().length();
+
+	// The type check guarantees the argument types, but a function
+	// type with a variable number of arguments accepts any count.
+	if ( ! bif->TheDirectFunc() || n > MAX_DIRECT_ARGS ||
+	     n != bif->FType()->Args()->NumFields() )
+		return;
+
+	direct_bif = bif;
+	direct_val = id->ID_Val();
+	}
+
+Val* CallExpr::EvalDirect(Frame* f) const
+	{
+	const expr_list& exprs = args->Exprs();
+	int n = exprs.length();
+	Val* argv[MAX_DIRECT_ARGS];
+
+	for ( int i = 0; i < n; ++i )
+		{
+		argv[i] = exprs[i]->Eval(f);
+
+		if ( ! argv[i] )
+			{
+			for ( int j = 0; j < i; ++j )
+				Unref(argv[j]);
+
+			return 0;
+			}
+		}
+
+	calling_expr = this;
+	const CallExpr* current_call = f ? f->GetCall() : 0;
+
+	if ( f )
+		f->SetCall(this);
+
+	Val* ret = direct_bif->CallDirect(argv, n, f);
+
+	if ( f )
+		f->SetCall(current_call);
+
+	calling_expr = 0;
+	return ret;
+	}
+
+Expr* CallExpr::Simplify()
+	{
+	simplify_expr(func);
+	args->Simplify();
+	FindDirectCall();
+
+	// Inline calls of functions that just return a constant. We
+	// require constant arguments so as not to skip any run-time
+	// errors evaluating them would report.
+	if ( IsError() || func->Tag() != EXPR_NAME || ! args->AllConst() )
+		return this;
+
+	ID* id = ((NameExpr*) func)->Id();
+
+	if ( ! id->IsGlobal() || ! id->IsConst() || ! id->HasVal() ||
+	     id->Type()->Tag() != TYPE_FUNC )
+		return this;
+
+	// Plugins may want to see the call.
+	if ( plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION) )
+		return this;
+
+	Val* v = constant_result(id->ID_Val()->AsFunc());
+
+	if ( ! v || ! same_type(v->Type(), Type()) )
+		return this;
+
+	ConstExpr* c = new ConstExpr(v->Ref());
+	c->SetLocationInfo(GetLocationInfo());
+	return c;
+	}
+
 Val* CallExpr::Eval(Frame* f) const
 	{
 	if ( IsError() )
@@ -4528,6 +5352,12 @@ Val* CallExpr::Eval(Frame* f) const
 			}
 		}
 
+	// Built-in functions with a direct entry point get their arguments
+	// without a val_list, unless the function got replaced since.
+	if ( direct_bif && ((NameExpr*) func)->Id()->ID_Val() == direct_val &&
+	     BuiltinFunc::CanCallDirect() )
+		return EvalDirect(f);
+
 	Val* ret = 0;
 	Val* func_val = func->Eval(f);
 	val_list* v = eval_list(f, args);
@@ -4666,6 +5496,12 @@ Val* EventExpr::Eval(Frame* f) const
 	return 0;
 	}
 
+Expr* EventExpr::Simplify()
+	{
+	args->Simplify();
+	return this;
+	}
+
 TraversalCode EventExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -4761,6 +5597,20 @@ int ListExpr::AllConst() const
 	return 1;
 	}
 
+Expr* ListExpr::Simplify()
+	{
+	loop_over_list(exprs, i)
+		{
+		Expr* e = exprs[i];
+		Expr* s = e->Simplify();
+
+		if ( s != e )
+			Unref(exprs.replace(i, s));
+		}
+
+	return this;
+	}
+
 Val* ListExpr::Eval(Frame* f) const
 	{
 	ListVal* v = new ListVal(TYPE_ANY);
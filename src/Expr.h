@@ -51,6 +51,7 @@ extern const char* expr_name(BroExprTag t);
 
 class Stmt;
 class Frame;
+class BuiltinFunc;
 class ListExpr;
 class NameExpr;
 class AssignExpr;
@@ -102,6 +103,12 @@ public:
 	// True if the expression has no side effects, false otherwise.
 	virtual int IsPure() const;
 
+	// Folds constant subexpressions in place, once all scripts have
+	// been parsed. Returns the expression to use instead of this one:
+	// either this one, or a new one whose reference passes to the
+	// caller.
+	virtual Expr* Simplify();
+
 	// True if the expression is a constant, false otherwise.
 	int IsConst() const	{ return tag == EXPR_CONST; }
 
@@ -224,6 +231,7 @@ public:
 	void Assign(Frame* f, Val* v, Opcode op = OP_ASSIGN) override;
 	Expr* MakeLvalue() override;
 	int IsPure() const override;
+	Expr* Simplify() override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -270,6 +278,7 @@ public:
 	Val* Eval(Frame* f) const override;
 
 	int IsPure() const override;
+	Expr* Simplify() override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -296,6 +305,7 @@ public:
 	Expr* Op2() const	{ return op2; }
 
 	int IsPure() const override;
+	Expr* Simplify() override;
 
 	// BinaryExpr::Eval correctly handles vector types.  Any child
 	// class that overrides Eval() should be modified to handle
@@ -328,6 +338,13 @@ protected:
 	virtual Val* AddrFold(Val* v1, Val* v2) const;
 	virtual Val* SubNetFold(Val* v1, Val* v2) const;
 
+	// Does what Fold() does for each element of vector operands, at
+	// least one of which is a vector and the other possibly a scalar,
+	// when they're numbers and the operation is arithmetic or a
+	// comparison. The numbers get unboxed into arrays for the loop.
+	// Returns nil for the generic element-by-element path otherwise.
+	VectorVal* NumericVectorFold(Val* v1, Val* v2) const;
+
 	int BothConst() const	{ return op1->IsConst() && op2->IsConst(); }
 
 	// Exchange op1 and op2.
@@ -522,6 +539,7 @@ public:
 
 	Val* Eval(Frame* f) const override;
 	Val* DoSingleEval(Frame* f, Val* v1, Expr* op2) const;
+	Expr* Simplify() override;
 
 protected:
 	friend class Expr;
@@ -567,6 +585,7 @@ public:
 
 	Val* Eval(Frame* f) const override;
 	int IsPure() const override;
+	Expr* Simplify() override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -589,6 +608,7 @@ public:
 
 	void Assign(Frame* f, Val* v, Opcode op = OP_ASSIGN) override;
 	Expr* MakeLvalue() override;
+	Expr* Simplify() override;
 
 protected:
 	friend class Expr;
@@ -610,6 +630,9 @@ public:
 	int IsRecordElement(TypeDecl* td) const override;
 	Val* InitVal(const BroType* t, Val* aggr) const override;
 	int IsPure() const override;
+	Expr* Simplify() override;
+
+	int IsInit() const	{ return is_init; }
 
 protected:
 	friend class Expr;
@@ -692,6 +715,7 @@ public:
 	~HasFieldExpr();
 
 	const char* FieldName() const	{ return field_name; }
+	int Field() const	{ return field; }
 
 protected:
 	friend class Expr;
@@ -890,21 +914,39 @@ class EventHandler;
 
 class ScheduleTimer : public Timer {
 public:
+	// If every is positive, the event recurs with that interval, and the
+	// timer keeps the arguments.
 	ScheduleTimer(EventHandlerPtr event, val_list* args, double t,
-			TimerMgr* tmgr);
+			TimerMgr* tmgr, double every = 0);
 	~ScheduleTimer();
 
 	void Dispatch(double t, int is_expire);
+	double NextTime(double t) const;
+
+	// Returns the timer of the recurring schedule of the event with
+	// these arguments, or nil if there's none pending.  Atomic arguments
+	// compare by value, others by identity.
+	static ScheduleTimer* LookupRecurring(EventHandlerPtr event,
+						const val_list* args);
+
+	// Cancels the recurring schedule of the event with these
+	// arguments.  Returns false if there's none.
+	static bool CancelRecurring(EventHandlerPtr event,
+					const val_list* args);
 
 protected:
 	EventHandlerPtr event;
 	val_list* args;
 	TimerMgr* tmgr;
+	double every;
+	std::string key;	// for recurring ones
 };
 
 class ScheduleExpr : public Expr {
 public:
-	ScheduleExpr(Expr* when, EventExpr* event);
+	// If recurring, when gives the interval at which the event repeats,
+	// starting that far from now.
+	ScheduleExpr(Expr* when, EventExpr* event, bool recurring = false);
 	~ScheduleExpr();
 
 	int IsPure() const override;
@@ -913,12 +955,13 @@ public:
 
 	Expr* When() const	{ return when; }
 	EventExpr* Event() const	{ return event; }
+	bool IsRecurring() const	{ return recurring; }
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
 	friend class Expr;
-	ScheduleExpr()	{ when = 0; event = 0; }
+	ScheduleExpr()	{ when = 0; event = 0; recurring = false; }
 
 	void ExprDescribe(ODesc* d) const override;
 
@@ -926,12 +969,17 @@ protected:
 
 	Expr* when;
 	EventExpr* event;
+	bool recurring;
 };
 
 class InExpr : public BinaryExpr {
 public:
 	InExpr(Expr* op1, Expr* op2);
 
+	// Overridden to look up single indices without putting them into
+	// a list first.
+	Val* Eval(Frame* f) const override;
+
 protected:
 	friend class Expr;
 	InExpr()	{ }
@@ -951,6 +999,7 @@ public:
 	ListExpr* Args() const	{ return args; }
 
 	int IsPure() const override;
+	Expr* Simplify() override;
 
 	Val* Eval(Frame* f) const override;
 
@@ -958,14 +1007,26 @@ public:
 
 protected:
 	friend class Expr;
-	CallExpr()	{ func = 0; args = 0; }
+	CallExpr()	{ func = 0; args = 0; direct_bif = 0; direct_val = 0; }
 
 	void ExprDescribe(ODesc* d) const override;
 
+	// Sets up calling a built-in function through its direct entry
+	// point, if it has one.
+	void FindDirectCall();
+
+	// Evaluates the arguments into an array and calls direct_bif.
+	Val* EvalDirect(Frame* f) const;
+
 	DECLARE_SERIAL(CallExpr);
 
 	Expr* func;
 	ListExpr* args;
+
+	// The built-in function to call directly, as long as its global
+	// still holds direct_val.
+	const BuiltinFunc* direct_bif;
+	const Val* direct_val;
 };
 
 class EventExpr : public Expr {
@@ -978,6 +1039,7 @@ public:
 	EventHandlerPtr Handler()  const	{ return handler; }
 
 	Val* Eval(Frame* f) const override;
+	Expr* Simplify() override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -1012,6 +1074,7 @@ public:
 	int AllConst() const;
 
 	Val* Eval(Frame* f) const override;
+	Expr* Simplify() override;
 
 	BroType* InitType() const override;
 	Val* InitVal(const BroType* t, Val* aggr) const override;
@@ -1085,4 +1148,16 @@ Expr* make_one(BroType* t);
 // True if the given Val* has a vector type
 inline bool is_vector(Expr* e)	{ return e->Type()->Tag() == TYPE_VECTOR; }
 
+// Replaces e with its simplified version; see Expr::Simplify().
+inline void simplify_expr(Expr*& e)
+	{
+	Expr* s = e->Simplify();
+
+	if ( s != e )
+		{
+		Unref(e);
+		e = s;
+		}
+	}
+
 #endif
@@ -25,6 +25,7 @@
 #include <algorithm>
 
 #include "File.h"
+#include "FileWriter.h"
 #include "Type.h"
 #include "Timer.h"
 #include "Expr.h"
@@ -34,11 +35,20 @@
 #include "Event.h"
 #include "Reporter.h"
 
-// Timer which on dispatching rotates the file.
+// Timer which on dispatching rotates the file. With by_size, it's one
+// that a file rotating automatically sets once it's grown too large, so
+// that it rotates after the current event rather than in the middle of
+// printing a line.
 class RotateTimer : public Timer {
 public:
-	RotateTimer(double t, BroFile* f, bool arg_raise) : Timer(t, TIMER_ROTATE)
-		{ file = f; raise = arg_raise; name = copy_string(f->Name()); }
+	RotateTimer(double t, BroFile* f, bool arg_raise, bool arg_by_size = false)
+		: Timer(t, TIMER_ROTATE)
+		{
+		file = f;
+		raise = arg_raise;
+		by_size = arg_by_size;
+		name = copy_string(f->Name());
+		}
 	~RotateTimer();
 
 	void Dispatch(double t, int is_expire);
@@ -46,6 +56,7 @@ public:
 protected:
 	BroFile* file;
 	bool raise;
+	bool by_size;
 	const char* name;
 };
 
@@ -54,16 +65,32 @@ RotateTimer::~RotateTimer()
 	if ( file->rotate_timer == this )
 		file->rotate_timer = 0;
 
+	if ( file->size_rotate_timer == this )
+		file->size_rotate_timer = 0;
+
 	delete [] name;
 	}
 
 void RotateTimer::Dispatch(double t, int is_expire)
 	{
+	if ( by_size )
+		{
+		file->size_rotate_timer = 0;
+
+		if ( ! is_expire )
+			file->AutoRotate();
+
+		return;
+		}
+
 	file->rotate_timer = 0;
 
 	if ( ! is_expire )
 		{
-		if ( raise )
+		if ( raise && file_rotate_automatically )
+			file->AutoRotate();
+
+		else if ( raise )
 			{
 			val_list* vl = new val_list;
 			Ref(file);
@@ -224,6 +251,16 @@ bool BroFile::Open(FILE* file, const char* mode)
 
 		InsertAtBeginning();
 		UpdateFileSize();
+
+		// Only the files we manage write through the thread, as
+		// others may get used behind our back.
+		if ( ! write_stream && FileWriter::Instance() )
+			{
+			int len = strlen(name);
+			bool gz = len > 3 && streq(name + len - 3, ".gz");
+			write_stream = FileWriter::Instance()->NewStream(
+				gz ? file_write_gzip_level : 0);
+			}
 		}
 	else
 		{
@@ -246,6 +283,7 @@ BroFile::~BroFile()
 	delete [] name;
 	delete [] access;
 	delete [] cipher_buffer;
+	delete [] write_buf;
 
 #ifdef USE_PERFTOOLS_DEBUG
 	heap_checker->UnIgnoreObject(this);
@@ -258,6 +296,7 @@ void BroFile::Init()
 	position = 0;
 	next = prev = 0;
 	rotate_timer = 0;
+	size_rotate_timer = 0;
 	rotate_interval = 0.0;
 	rotate_size = current_size = 0.0;
 	open_time = 0;
@@ -269,6 +308,9 @@ void BroFile::Init()
 	pub_key = 0;
 	cipher_ctx = 0;
 	cipher_buffer = 0;
+	write_stream = 0;
+	write_buf = 0;
+	write_buf_len = 0;
 
 #ifdef USE_PERFTOOLS_DEBUG
 	heap_checker->IgnoreObject(this);
@@ -337,6 +379,9 @@ FILE* BroFile::Seek(long new_position)
 	if ( ! File() )
 		return 0;
 
+	if ( write_stream )
+		Sync();
+
 	if ( fseek(f, new_position, SEEK_SET) < 0 )
 		reporter->Error("seek failed");
 
@@ -348,6 +393,9 @@ void BroFile::SetBuf(bool arg_buffered)
 	if ( ! f )
 		return;
 
+	if ( write_stream )
+		Sync();
+
 	if ( setvbuf(f, NULL, arg_buffered ? _IOFBF : _IOLBF, 0) != 0 )
 		reporter->Error("setvbuf failed");
 
@@ -362,11 +410,27 @@ int BroFile::Close()
 		rotate_timer = 0;
 		}
 
+	if ( size_rotate_timer )
+		{
+		timer_mgr->Cancel(size_rotate_timer);
+		size_rotate_timer = 0;
+		}
+
 	if ( ! is_open )
 		return 1;
 
 	FinishEncrypt();
 
+	if ( write_stream )
+		{
+		// A suspended file has synced already.
+		if ( f )
+			Sync();
+
+		FileWriter::Instance()->DeleteStream(write_stream);
+		write_stream = 0;
+		}
+
 	// Do not close stdin/stdout/stderr.
 	if ( f == stdin || f == stdout || f == stderr )
 		return 0;
@@ -410,6 +474,9 @@ void BroFile::Suspend()
 	if ( ! f )
 		reporter->InternalError("BroFile::Suspend() called for nil file");
 
+	if ( write_stream )
+		Sync();
+
 	if ( (position = ftell(f)) < 0 )
 		{
 		char buf[256];
@@ -558,6 +625,10 @@ RecordVal* BroFile::Rotate()
 	if ( okay_to_manage && ! is_in_cache )
 		BringIntoCache();
 
+	// The old file needs all of its output before we close it.
+	if ( write_stream )
+		Sync();
+
 	RecordVal* info = new RecordVal(rotate_info);
 	FILE* newf = rotate_file(name, info);
 
@@ -577,6 +648,30 @@ RecordVal* BroFile::Rotate()
 	return info;
 	}
 
+void BroFile::AutoRotate(bool now)
+	{
+	RecordVal* info = Rotate();
+
+	if ( ! info )
+		return;
+
+	if ( ! ::file_rotated )
+		{
+		Unref(info);
+		return;
+		}
+
+	val_list* vl = new val_list;
+	Ref(this);
+	vl->append(new Val(this));
+	vl->append(info);
+
+	if ( now )
+		mgr.Dispatch(new Event(::file_rotated, vl), true);
+	else
+		mgr.QueueEvent(::file_rotated, vl);
+	}
+
 void BroFile::InstallRotateTimer()
 	{
 	if ( terminating )
@@ -638,8 +733,15 @@ void BroFile::CloseCachedFiles()
 	BroFile* next;
 	for ( BroFile* f = head; f; f = next )
 		{
+		// Rotating moves the file to the front.
+		next = f->next;
+
 		// Send final rotate events (immediately).
-		if ( f->rotate_interval )
+		if ( file_rotate_automatically &&
+		     (f->rotate_interval || f->rotate_size) )
+			f->AutoRotate(true);
+
+		else if ( f->rotate_interval )
 			{
 			val_list* vl = new val_list;
 			Ref(f);
@@ -648,7 +750,7 @@ void BroFile::CloseCachedFiles()
 			mgr.Dispatch(event, true);
 			}
 
-		if ( f->rotate_size )
+		if ( ! file_rotate_automatically && f->rotate_size )
 			{
 			val_list* vl = new val_list;
 			Ref(f);
@@ -657,12 +759,20 @@ void BroFile::CloseCachedFiles()
 			mgr.Dispatch(event, true);
 			}
 
-		next = f->next;
 		if ( f->is_in_cache )
 			f->Close();
 		}
 	}
 
+void BroFile::SyncAll()
+	{
+	for ( BroFile* f = head; f; f = f->next )
+		{
+		if ( f->write_stream && f->f )
+			f->Sync();
+		}
+	}
+
 void BroFile::InitEncrypt(const char* keyfile)
 	{
 	if ( ! (pub_key || keyfile) )
@@ -712,6 +822,9 @@ void BroFile::InitEncrypt(const char* keyfile)
 
 	secret_len = htonl(secret_len);
 
+	if ( write_stream )
+		Sync();
+
 	if ( fwrite("BROENC1", 7, 1, f) < 1 ||
 		fwrite(&secret_len, sizeof(secret_len), 1, f) < 1 ||
 		fwrite(secret, ntohl(secret_len), 1, f) < 1 ||
@@ -740,7 +853,7 @@ void BroFile::FinishEncrypt()
 		int outl;
 		EVP_SealFinal(cipher_ctx, cipher_buffer, &outl);
 
-		if ( outl && fwrite(cipher_buffer, outl, 1, f) < 1 )
+		if ( outl && ! Output((const char*) cipher_buffer, outl) )
 			{
 			reporter->Error("write error for %s: %s",
 					name, strerror(errno));
@@ -781,7 +894,7 @@ int BroFile::Write(const char* data, int len)
 				return 0;
 				}
 
-			if ( outl && fwrite(cipher_buffer, outl, 1, f) < 1 )
+			if ( outl && ! Output((const char*) cipher_buffer, outl) )
 				{
 				reporter->Error("write error for %s: %s",
 						name, strerror(errno));
@@ -796,14 +909,26 @@ int BroFile::Write(const char* data, int len)
 		return 1;
 		}
 
-	if ( fwrite(data, len, 1, f) < 1 )
+	if ( ! Output(data, len) )
 		return false;
 
 	if ( rotate_size && current_size < rotate_size && current_size + len >= rotate_size )
 		{
-		val_list* vl = new val_list;
-		vl->append(new Val(this));
-		mgr.QueueEvent(::rotate_size, vl);
+		if ( file_rotate_automatically )
+			{
+			if ( ! size_rotate_timer )
+				{
+				size_rotate_timer = new RotateTimer(network_time, this, false, true);
+				timer_mgr->Add(size_rotate_timer);
+				}
+			}
+
+		else
+			{
+			val_list* vl = new val_list;
+			vl->append(new Val(this));
+			mgr.QueueEvent(::rotate_size, vl);
+			}
 		}
 
 	// This does not work if we seek around. But none of the logs does that
@@ -813,6 +938,91 @@ int BroFile::Write(const char* data, int len)
 	return true;
 	}
 
+bool BroFile::Output(const char* data, int len)
+	{
+	if ( ! write_stream )
+		return fwrite(data, len, 1, f) == 1;
+
+	if ( ! f )
+		return false;
+
+	while ( len )
+		{
+		if ( ! write_buf )
+			write_buf = new char[FileWriter::CHUNK_SIZE];
+
+		int n = min(FileWriter::CHUNK_SIZE - write_buf_len, len);
+		memcpy(write_buf + write_buf_len, data, n);
+		write_buf_len += n;
+		data += n;
+		len -= n;
+
+		if ( write_buf_len == FileWriter::CHUNK_SIZE )
+			Handoff(false);
+		}
+
+	// Line-buffered output goes out right away.
+	if ( ! buffered )
+		Handoff(true);
+
+	return true;
+	}
+
+void BroFile::Handoff(bool flush)
+	{
+	if ( ! write_buf_len && ! flush )
+		return;
+
+	// The writer frees the buffer.
+	std::string err = FileWriter::Instance()->Write(write_stream, f,
+						write_buf, write_buf_len, flush);
+	write_buf = 0;
+	write_buf_len = 0;
+
+	if ( err.size() )
+		WriteError(err);
+	}
+
+void BroFile::Sync()
+	{
+	Handoff(false);
+
+	std::string err = FileWriter::Instance()->Sync(write_stream, f);
+
+	if ( err.size() )
+		WriteError(err);
+	}
+
+void BroFile::WriteError(const std::string& err)
+	{
+	reporter->Error("write error for %s: %s", name, err.c_str());
+	}
+
+void BroFile::Flush()
+	{
+	if ( write_stream )
+		{
+		if ( f )
+			Handoff(true);
+		}
+	else
+		fflush(f);
+	}
+
+double BroFile::Size()
+	{
+	if ( write_stream )
+		{
+		if ( f )
+			Sync();
+		}
+	else
+		fflush(f);
+
+	UpdateFileSize();
+	return current_size;
+	}
+
 void BroFile::RaiseOpenEvent()
 	{
 	if ( ! ::file_opened )
@@ -4,6 +4,7 @@
 #define file_h
 
 #include <fcntl.h>
+#include <string>
 #include "util.h"
 #include "Obj.h"
 #include "Attr.h"
@@ -19,6 +20,7 @@ typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
 
 class BroType;
 class RotateTimer;
+struct FileWriteStream;
 
 class BroFile : public BroObj {
 public:
@@ -32,7 +34,7 @@ public:
 	// Returns false if an error occured.
 	int Write(const char* data, int len = 0);
 
-	void Flush()	{ fflush(f); }
+	void Flush();
 
 	FILE* Seek(long position);	// seek to absolute position
 
@@ -56,12 +58,17 @@ public:
 	// Rotates the logfile. Returns rotate_info.
 	RecordVal* Rotate();
 
+	// Rotates the file on its own, as file_rotate_automatically asks
+	// for, and raises file_rotated. If now is true, the event gets
+	// dispatched right away.
+	void AutoRotate(bool now = false);
+
 	// Set &rotate_interval, &rotate_size,
 	// and &raw_output attributes.
 	void SetAttrs(Attributes* attrs);
 
 	// Returns the current size of the file, after fresh stat'ing.
-	double Size()	{ fflush(f); UpdateFileSize(); return current_size; }
+	double Size();
 
 	// Set rotate/postprocessor for all files that don't define them
 	// by their own. (interval/max_size=0 for no rotation; size in bytes).
@@ -70,6 +77,10 @@ public:
 	// Close all files which are managed by us.
 	static void CloseCachedFiles();
 
+	// Waits for the writer thread to finish what's queued for the
+	// files managed by us.
+	static void SyncAll();
+
 	// Get the file with the given name, opening it if it doesn't yet exist.
 	static BroFile* GetFile(const char* name);
 
@@ -124,6 +135,20 @@ protected:
 	// Finalize encryption.
 	void FinishEncrypt();
 
+	// Writes out data, passing it on to the writer thread if there's
+	// one. Returns false if an error occured.
+	bool Output(const char* data, int len);
+
+	// Passes the collected output on to the writer thread.
+	void Handoff(bool flush);
+
+	// Waits for the writer thread to finish the file's output, so that
+	// we may use the FILE ourselves.
+	void Sync();
+
+	// Reports an error of the writer thread's.
+	void WriteError(const std::string& err);
+
 	DECLARE_SERIAL(BroFile);
 
 	FILE* f;
@@ -146,6 +171,7 @@ protected:
 	double current_size;
 
 	Timer* rotate_timer;
+	Timer* size_rotate_timer;	// for rotating automatically
 	double open_time;
 	bool print_hook;
 	bool raw_output;
@@ -159,6 +185,10 @@ protected:
 	static const int MIN_BUFFER_SIZE = 1024;
 	unsigned char* cipher_buffer;
 
+	// With a writer thread, output collects here before going to it.
+	FileWriteStream* write_stream;
+	char* write_buf;
+	int write_buf_len;
 };
 
 #endif
@@ -0,0 +1,290 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "FileWriter.h"
+#include "Metrics.h"
+#include "NetVar.h"
+#include "Reporter.h"
+
+struct FileWriteStream {
+	int gzip_level;
+	bool deflating;	// whether a gzip member is open
+	z_stream z;
+	int queued;	// jobs not performed yet
+	std::string error;
+};
+
+static const int ZBUF_SIZE = 65536;
+
+static FileWriter* file_writer = 0;
+static bool file_writer_failed = false;
+
+static double writer_pending()
+	{
+	return file_writer ? file_writer->Pending() : 0;
+	}
+
+FileWriter* FileWriter::Instance()
+	{
+	if ( file_writer || file_writer_failed || file_write_buffer <= 0 )
+		return file_writer;
+
+	FileWriter* w = new FileWriter();
+
+	if ( ! w->Start() )
+		{
+		reporter->Error("cannot create file writer thread, writing files directly");
+		delete w;
+		file_writer_failed = true;
+		return 0;
+		}
+
+	file_writer = w;
+
+	metrics::registry()->NewCallbackGauge("file_writer.pending_bytes",
+					      "File output waiting for the writer thread, in bytes.",
+					      writer_pending);
+
+	return file_writer;
+	}
+
+FileWriter::FileWriter()
+	{
+	pending = 0;
+	limit = file_write_buffer;
+	zbuf = new char[ZBUF_SIZE];
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&has_work, 0);
+	pthread_cond_init(&done, 0);
+	}
+
+FileWriter::~FileWriter()
+	{
+	// Only deleted when the thread couldn't start; otherwise it runs
+	// until the process exits, as files get closed last.
+	pthread_cond_destroy(&done);
+	pthread_cond_destroy(&has_work);
+	pthread_mutex_destroy(&mutex);
+	delete [] zbuf;
+	}
+
+bool FileWriter::Start()
+	{
+	return pthread_create(&thread, 0, Launcher, this) == 0;
+	}
+
+void* FileWriter::Launcher(void* arg)
+	{
+	// Signals are for the main thread to handle, except for those which
+	// POSIX leaves undefined when blocked.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	((FileWriter*) arg)->Run();
+	return 0;
+	}
+
+FileWriteStream* FileWriter::NewStream(int gzip_level)
+	{
+	FileWriteStream* s = new FileWriteStream;
+	s->gzip_level = gzip_level;
+	s->deflating = false;
+	s->queued = 0;
+	return s;
+	}
+
+void FileWriter::DeleteStream(FileWriteStream* s)
+	{
+	if ( s->queued )
+		reporter->InternalError("deleting file write stream with queued data");
+
+	// Sync() ended the gzip member.
+	delete s;
+	}
+
+uint64 FileWriter::Pending()
+	{
+	pthread_mutex_lock(&mutex);
+	uint64 p = pending;
+	pthread_mutex_unlock(&mutex);
+	return p;
+	}
+
+void FileWriter::Enqueue(const Job& job)
+	{
+	pthread_mutex_lock(&mutex);
+
+	// Something larger than the whole buffer still goes through once
+	// everything else is out.
+	while ( pending > 0 && pending + job.len > limit )
+		pthread_cond_wait(&done, &mutex);
+
+	pending += job.len;
+	++job.stream->queued;
+	jobs.push_back(job);
+
+	pthread_cond_signal(&has_work);
+	pthread_mutex_unlock(&mutex);
+	}
+
+std::string FileWriter::Write(FileWriteStream* s, FILE* f, char* data,
+				int len, bool flush)
+	{
+	Job job;
+	job.stream = s;
+	job.f = f;
+	job.data = data;
+	job.len = len;
+	job.flush = flush;
+	job.finish = false;
+	Enqueue(job);
+
+	pthread_mutex_lock(&mutex);
+	std::string err;
+	err.swap(s->error);
+	pthread_mutex_unlock(&mutex);
+
+	return err;
+	}
+
+std::string FileWriter::Sync(FileWriteStream* s, FILE* f)
+	{
+	Job job;
+	job.stream = s;
+	job.f = f;
+	job.data = 0;
+	job.len = 0;
+	job.flush = true;
+	job.finish = true;
+	Enqueue(job);
+
+	pthread_mutex_lock(&mutex);
+
+	while ( s->queued )
+		pthread_cond_wait(&done, &mutex);
+
+	std::string err;
+	err.swap(s->error);
+	pthread_mutex_unlock(&mutex);
+
+	return err;
+	}
+
+void FileWriter::Run()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( true )
+		{
+		while ( jobs.empty() )
+			pthread_cond_wait(&has_work, &mutex);
+
+		Job job = jobs.front();
+		jobs.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		Perform(job);
+		delete [] job.data;
+
+		pthread_mutex_lock(&mutex);
+		pending -= job.len;
+		--job.stream->queued;
+		pthread_cond_broadcast(&done);
+		}
+	}
+
+void FileWriter::Perform(const Job& job)
+	{
+	FileWriteStream* s = job.stream;
+	bool ok = true;
+
+	if ( s->gzip_level )
+		{
+		if ( job.len && ! s->deflating )
+			{
+			memset(&s->z, 0, sizeof(s->z));
+
+			// A window of 15 bits, plus 16 for a gzip header.
+			if ( deflateInit2(&s->z, s->gzip_level, Z_DEFLATED,
+					  15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+				{
+				pthread_mutex_lock(&mutex);
+				if ( s->error.empty() )
+					s->error = "cannot initialize compression";
+				pthread_mutex_unlock(&mutex);
+				return;
+				}
+
+			s->deflating = true;
+			}
+
+		if ( s->deflating )
+			{
+			int zflush = job.finish ? Z_FINISH :
+					(job.flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+			ok = Deflate(s, job.f, job.data, job.len, zflush);
+
+			if ( job.finish )
+				{
+				deflateEnd(&s->z);
+				s->deflating = false;
+				}
+			}
+		}
+
+	else if ( job.len && fwrite(job.data, job.len, 1, job.f) < 1 )
+		ok = false;
+
+	if ( ok && job.flush && fflush(job.f) != 0 )
+		ok = false;
+
+	if ( ! ok )
+		{
+		char buf[256];
+		strerror_r(errno, buf, sizeof(buf));
+
+		pthread_mutex_lock(&mutex);
+		if ( s->error.empty() )
+			s->error = buf;
+		pthread_mutex_unlock(&mutex);
+		}
+	}
+
+bool FileWriter::Deflate(FileWriteStream* s, FILE* f, const char* data,
+			 int len, int zflush)
+	{
+	s->z.next_in = (Bytef*) data;
+	s->z.avail_in = len;
+
+	do
+		{
+		s->z.next_out = (Bytef*) zbuf;
+		s->z.avail_out = ZBUF_SIZE;
+
+		if ( deflate(&s->z, zflush) == Z_STREAM_ERROR )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		size_t n = ZBUF_SIZE - s->z.avail_out;
+
+		if ( n && fwrite(zbuf, n, 1, f) < 1 )
+			return false;
+		}
+	while ( s->z.avail_out == 0 );
+
+	return true;
+	}
@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef filewriter_h
+#define filewriter_h
+
+#include <pthread.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+#include "util.h"
+
+struct FileWriteStream;
+
+/**
+ * A thread writing the output of script-level files, i.e., those that
+ * print and open() use, so that the main thread doesn't wait on the disk.
+ * The data waiting to be written is bounded by file_write_buffer. Once
+ * that's full, the main thread waits for room, as script output mustn't
+ * get lost.
+ *
+ * Each file writing through the thread has a stream with the thread's
+ * state for it: its gzip compression, if any, and the first error it ran
+ * into. While a stream has data queued, the thread is the only one using
+ * its FILE; Sync() hands that back.
+ */
+class FileWriter {
+public:
+	/**
+	 * Bytes that a file collects before passing them on.
+	 */
+	static const int CHUNK_SIZE = 65536;
+
+	/**
+	 * Returns the writer, starting it on first use. Returns null if
+	 * files should write on the main thread, because file_write_buffer
+	 * is zero or the thread couldn't be started.
+	 */
+	static FileWriter* Instance();
+
+	/**
+	 * Returns a new stream.
+	 *
+	 * @param gzip_level If non-zero, the stream compresses its data
+	 * with gzip at this level.
+	 */
+	FileWriteStream* NewStream(int gzip_level);
+
+	/**
+	 * Frees a stream. It must have been synced since the last write.
+	 */
+	void DeleteStream(FileWriteStream* s);
+
+	/**
+	 * Queues data for writing to a stream's file and takes ownership of
+	 * it, waiting for room if the buffer is full.
+	 *
+	 * @param data The data, allocated with new[]. May be null if \a len
+	 * is zero.
+	 *
+	 * @param flush If true, the file gets flushed afterwards.
+	 *
+	 * @return The first error that writing the stream ran into since
+	 * the last call, if any.
+	 */
+	std::string Write(FileWriteStream* s, FILE* f, char* data, int len, bool flush);
+
+	/**
+	 * Finishes all of a stream's queued writes and flushes its file,
+	 * ending the current gzip member. Afterwards, the caller may use the
+	 * file itself until writing again.
+	 *
+	 * @return The first error that writing the stream ran into since
+	 * the last call, if any.
+	 */
+	std::string Sync(FileWriteStream* s, FILE* f);
+
+	/**
+	 * Returns the number of bytes waiting to be written.
+	 */
+	uint64 Pending();
+
+private:
+	struct Job {
+		FileWriteStream* stream;
+		FILE* f;
+		char* data;
+		int len;
+		bool flush;
+		bool finish;	// end the gzip member, for syncing
+	};
+
+	FileWriter();
+	~FileWriter();
+
+	bool Start();
+
+	static void* Launcher(void* arg);
+
+	void Run();
+	void Enqueue(const Job& job);
+	void Perform(const Job& job);
+
+	// Runs data through a stream's compressor and writes what comes out.
+	bool Deflate(FileWriteStream* s, FILE* f, const char* data, int len,
+		     int zflush);
+
+	std::deque<Job> jobs;
+	uint64 pending;	// bytes queued, but not written yet
+	uint64 limit;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t has_work;
+	pthread_cond_t done;	// signals room, and finished syncs
+	pthread_t thread;
+
+	char* zbuf;	// compressor output, used by the thread only
+};
+
+#endif
@@ -11,20 +11,6 @@
 #define MIN_ACCEPTABLE_FRAG_SIZE 64
 #define MAX_ACCEPTABLE_FRAG_SIZE 64000
 
-FragTimer::~FragTimer()
-	{
-	if ( f )
-		f->ClearTimer();
-	}
-
-void FragTimer::Dispatch(double t, int /* is_expire */)
-	{
-	if ( f )
-		f->Expire(t);
-	else
-		reporter->InternalWarning("fragment timer dispatched w/o reassembler");
-	}
-
 FragReassembler::FragReassembler(NetSessions* arg_s,
 			const IP_Hdr* ip, const u_char* pkt,
 			HashKey* k, double t)
@@ -32,6 +18,8 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 	{
 	s = arg_s;
 	key = k;
+	src = ip->SrcAddr();
+	accounted_mem = 0;
 
 	const struct ip* ip4 = ip->IP4_Hdr();
 	if ( ip4 )
@@ -52,25 +40,59 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 	frag_size = 0;	// flag meaning "not known"
 	next_proto = ip->NextProto();
 
-	if ( frag_timeout != 0.0 )
-		{
-		expire_timer = new FragTimer(this, t + frag_timeout);
-		timer_mgr->Add(expire_timer);
-		}
-	else
-		expire_timer = 0;
+	// The NetSessions take care of the expiration, without a timer
+	// for each reassembler.
+	expire_time = frag_timeout != 0.0 ? t + frag_timeout : 0.0;
 
 	AddFragment(t, ip, pkt);
 	}
 
 FragReassembler::~FragReassembler()
 	{
-	DeleteTimer();
 	delete [] proto_hdr;
 	delete reassembled_pkt;
 	delete key;
 	}
 
+HashKey* FragReassembler::BuildKey(const IP_Hdr* ip)
+	{
+	const IPAddr& src = ip->SrcAddr();
+	const IPAddr& dst = ip->DstAddr();
+
+	if ( src.GetFamily() == IPv4 && dst.GetFamily() == IPv4 )
+		{
+		// As for connections, IPv4 keys only need the last four
+		// bytes of each address; HashKeys of different sizes never
+		// match.
+		struct {
+			uint32 src;
+			uint32 dst;
+			uint32 id;
+		} key;
+
+		const uint32_t* bytes;
+		src.GetBytes(&bytes);
+		memcpy(&key.src, bytes, sizeof(key.src));
+		dst.GetBytes(&bytes);
+		memcpy(&key.dst, bytes, sizeof(key.dst));
+		key.id = ip->ID();
+
+		return new HashKey(&key, sizeof(key));
+		}
+
+	struct {
+		in6_addr src;
+		in6_addr dst;
+		uint32 id;
+	} key;
+
+	src.CopyIPv6(&key.src);
+	dst.CopyIPv6(&key.dst);
+	key.id = ip->ID();
+
+	return new HashKey(&key, sizeof(key));
+	}
+
 void FragReassembler::AddFragment(double t, const IP_Hdr* ip, const u_char* pkt)
 	{
 	const struct ip* ip4 = ip->IP4_Hdr();
@@ -186,6 +208,16 @@ void FragReassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 		Weird("fragment_overlap");
 	}
 
+void FragReassembler::ReleaseBlocks()
+	{
+	// We can't deliver anything without a complete packet, so all
+	// we can do is drop what we have.
+	Weird("fragment_memory_limit_exceeded");
+	ClearBlocks();
+	ClearOldBlocks();
+	s->AccountFragmentMemory(this);
+	}
+
 void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 	{
 	if ( blocks->seq > 0 || ! frag_size )
@@ -258,7 +290,6 @@ void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 		if ( b->upper > n )
 			{
 			reporter->InternalWarning("bad fragment reassembly");
-			DeleteTimer();
 			Expire(network_time);
 			delete [] pkt_start;
 			return;
@@ -278,7 +309,6 @@ void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 		struct ip* reassem4 = (struct ip*) pkt_start;
 		reassem4->ip_len = htons(frag_size + proto_hdr_len);
 		reassembled_pkt = new IP_Hdr(reassem4, true);
-		DeleteTimer();
 		}
 
 	else if ( version == 6 )
@@ -287,7 +317,6 @@ void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 		reassem6->ip6_plen = htons(frag_size + proto_hdr_len - 40);
 		const IPv6_Hdr_Chain* chain = new IPv6_Hdr_Chain(reassem6, next_proto, n);
 		reassembled_pkt = new IP_Hdr(reassem6, true, n, chain);
-		DeleteTimer();
 		}
 
 	else
@@ -300,25 +329,6 @@ void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 
 void FragReassembler::Expire(double t)
 	{
-	while ( blocks )
-		{
-		DataBlock* b = blocks->next;
-		delete blocks;
-		blocks = b;
-		}
-
-	expire_timer->ClearReassembler();
-	expire_timer = 0;	// timer manager will delete it
-
-	sessions->Remove(this);
-	}
-
-void FragReassembler::DeleteTimer()
-	{
-	if ( expire_timer )
-		{
-		expire_timer->ClearReassembler();
-		timer_mgr->Cancel(expire_timer);
-		expire_timer = 0;	// timer manager will delete it
-		}
+	ClearBlocks();
+	s->Remove(this);
 	}
@@ -7,34 +7,47 @@
 #include "IP.h"
 #include "Net.h"
 #include "Reassem.h"
-#include "Timer.h"
+
+#include <list>
 
 class HashKey;
 class NetSessions;
 
-class FragReassembler;
-class FragTimer;
-
-typedef void (FragReassembler::*frag_timer_func)(double t);
-
 class FragReassembler : public Reassembler {
 public:
 	FragReassembler(NetSessions* s, const IP_Hdr* ip, const u_char* pkt,
 			HashKey* k, double t);
 	~FragReassembler();
 
+	// Returns the key identifying the datagram the fragment belongs to:
+	// its addresses and ID, packed into 12 bytes for IPv4 and 36 for
+	// IPv6.
+	static HashKey* BuildKey(const IP_Hdr* ip);
+
 	void AddFragment(double t, const IP_Hdr* ip, const u_char* pkt);
 
 	void Expire(double t);
-	void DeleteTimer();
-	void ClearTimer()	{ expire_timer = 0; }
 
 	const IP_Hdr* ReassembledPkt()	{ return reassembled_pkt; }
 	HashKey* Key() const	{ return key; }
+	const IPAddr& Src() const	{ return src; }
+
+	// When the reassembler times out, or 0 if it doesn't.
+	double ExpireTime() const	{ return expire_time; }
+
+	// The NetSessions keep the reassemblers that time out in a list
+	// ordered by their expiration times; this is our position in it.
+	typedef std::list<FragReassembler*> expire_list;
+	expire_list::iterator expire_pos;
+
+	// The memory of this reassembler that NetSessions counts towards
+	// its source's and the global fragment limits.
+	uint64 accounted_mem;
 
 protected:
 	void BlockInserted(DataBlock* start_block);
 	void Overlap(const u_char* b1, const u_char* b2, uint64 n);
+	void ReleaseBlocks();
 	void Weird(const char* name) const;
 
 	u_char* proto_hdr;
@@ -44,24 +57,8 @@ protected:
 	uint64 frag_size;	// size of fully reassembled fragment
 	uint16 next_proto; // first IPv6 fragment header's next proto field
 	HashKey* key;
-
-	FragTimer* expire_timer;
-};
-
-class FragTimer : public Timer {
-public:
-	FragTimer(FragReassembler* arg_f, double arg_t)
-		: Timer(arg_t, TIMER_FRAG)
-			{ f = arg_f; }
-	~FragTimer();
-
-	void Dispatch(double t, int is_expire);
-
-	// Break the association between this timer and its creator.
-	void ClearReassembler()	{ f = 0; }
-
-protected:
-	FragReassembler* f;
+	IPAddr src;
+	double expire_time;
 };
 
 #endif
@@ -41,6 +41,24 @@ void Frame::Release()
 	delete [] frame;
 	}
 
+void Frame::Reset(const val_list* fn_args)
+	{
+	for ( int i = 0; i < size; ++i )
+		{
+		Unref(frame[i]);
+		frame[i] = 0;
+		}
+
+	func_args = fn_args;
+	next_stmt = 0;
+	break_before_next_stmt = false;
+	break_on_return = false;
+
+	ClearTrigger();
+	call = 0;
+	delayed = false;
+	}
+
 void Frame::Describe(ODesc* d) const
 	{
 	if ( ! d->IsBinary() )
@@ -26,6 +26,13 @@ public:
 
 	void Release();
 
+	// Releases all values, the trigger, and the call, and rewinds the
+	// frame's state, so that it can serve another call of the same
+	// function with the given arguments.
+	void Reset(const val_list* fn_args);
+
+	int Size() const	{ return size; }
+
 	void Describe(ODesc* d) const;
 
 	// For which function is this stack frame.
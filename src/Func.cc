@@ -36,6 +36,8 @@
 #include "NetVar.h"
 #include "File.h"
 #include "Func.h"
+#include "ScriptCode.h"
+#include "ScriptProfiler.h"
 #include "Frame.h"
 #include "Var.h"
 #include "analyzer/protocol/login/Login.h"
@@ -56,6 +58,10 @@ bool did_builtin_init = false;
 vector<Func*> Func::unique_ids;
 static const std::pair<bool, Val*> empty_hook_result(false, NULL);
 
+// Number of frames a BroFunc keeps around for reuse.  More are only
+// needed while the function recurses.
+static const unsigned int MAX_POOLED_FRAMES = 4;
+
 Func::Func() : scope(0), type(0)
 	{
 	unique_id = unique_ids.size();
@@ -158,6 +164,8 @@ bool Func::DoUnserialize(UnserialInfo* info)
 		if ( ! b.stmts )
 			return false;
 
+		b.code = ScriptCode::Compile(b.stmts);
+
 		if ( ! UNSERIALIZE(&b.priority) )
 			return false;
 
@@ -312,6 +320,7 @@ BroFunc::BroFunc(ID* arg_id, Stmt* arg_body, id_list* aggr_inits,
 		{
 		Body b;
 		b.stmts = AddInits(arg_body, aggr_inits);
+		b.code = ScriptCode::Compile(b.stmts);
 		b.priority = priority;
 		bodies.push_back(b);
 		}
@@ -319,8 +328,14 @@ BroFunc::BroFunc(ID* arg_id, Stmt* arg_body, id_list* aggr_inits,
 
 BroFunc::~BroFunc()
 	{
+	for ( unsigned int i = 0; i < frame_pool.size(); ++i )
+		Unref(frame_pool[i]);
+
 	for ( unsigned int i = 0; i < bodies.size(); ++i )
+		{
+		delete bodies[i].code;
 		Unref(bodies[i].stmts);
+		}
 	}
 
 int BroFunc::IsPure() const
@@ -343,6 +358,9 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 	if ( sample_logger )
 		sample_logger->FunctionSeen(this);
 
+	// Whatever runs now may modify tables that loops are iterating over.
+	ForStmt::MakeIterationsRobust();
+
 	std::pair<bool, Val*> plugin_result = PLUGIN_HOOK_WITH_RESULT(HOOK_CALL_FUNCTION, HookCallFunction(this, parent, args), empty_hook_result);
 
 	plugin_result = HandlePluginResult(plugin_result, args, Flavor());
@@ -360,10 +378,10 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 		loop_over_list(*args, i)
 			Unref((*args)[i]);
 
-		return Flavor() == FUNC_FLAVOR_HOOK ? new Val(true, TYPE_BOOL) : 0;
+		return Flavor() == FUNC_FLAVOR_HOOK ? val_mgr->GetTrue() : 0;
 		}
 
-	Frame* f = new Frame(frame_size, this, args);
+	Frame* f = NewFrame(args);
 
 	// Hand down any trigger.
 	if ( parent )
@@ -374,6 +392,9 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 
 	g_frame_stack.push_back(f);	// used for backtracing
 
+	if ( script_profiler )
+		script_profiler->PushFrame(f);
+
 	if ( g_trace_state.DoTrace() )
 		{
 		ODesc d;
@@ -400,7 +421,10 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 
 		try
 			{
-			result = bodies[i].stmts->Exec(f, flow);
+			if ( bodies[i].code )
+				result = bodies[i].code->Exec(f, flow);
+			else
+				result = bodies[i].stmts->Exec(f, flow);
 			}
 
 		catch ( InterpreterException& e )
@@ -427,7 +451,7 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 			if ( flow == FLOW_BREAK )
 				{
 				// Short-circuit execution of remaining hook handler bodies.
-				result = new Val(false, TYPE_BOOL);
+				result = val_mgr->GetFalse();
 				break;
 				}
 			}
@@ -436,7 +460,7 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 	if ( Flavor() == FUNC_FLAVOR_HOOK )
 		{
 		if ( ! result )
-			result = new Val(true, TYPE_BOOL);
+			result = val_mgr->GetTrue();
 		}
 
 	// Warn if the function returns something, but we returned from
@@ -456,12 +480,41 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 		g_trace_state.LogTrace("Function return: %s\n", d.Description());
 		}
 
+	if ( script_profiler )
+		script_profiler->PopFrame();
+
 	g_frame_stack.pop_back();
-	Unref(f);
+	ReleaseFrame(f);
 
 	return result;
 	}
 
+Frame* BroFunc::NewFrame(val_list* args) const
+	{
+	if ( frame_pool.empty() )
+		return new Frame(frame_size, this, args);
+
+	Frame* f = frame_pool.back();
+	frame_pool.pop_back();
+	f->Reset(args);
+
+	return f;
+	}
+
+void BroFunc::ReleaseFrame(Frame* f) const
+	{
+	if ( f->RefCnt() > 1 || f->Size() != frame_size ||
+	     frame_pool.size() >= MAX_POOLED_FRAMES )
+		{
+		Unref(f);
+		return;
+		}
+
+	// Let go of the values now rather than with the next call.
+	f->Reset(0);
+	frame_pool.push_back(f);
+	}
+
 void BroFunc::AddBody(Stmt* new_body, id_list* new_inits, int new_frame_size,
 		int priority)
 	{
@@ -475,18 +528,35 @@ void BroFunc::AddBody(Stmt* new_body, id_list* new_inits, int new_frame_size,
 		// For functions, we replace the old body with the new one.
 		assert(bodies.size() <= 1);
 		for ( unsigned int i = 0; i < bodies.size(); ++i )
+			{
+			delete bodies[i].code;
 			Unref(bodies[i].stmts);
+			}
 		bodies.clear();
 		}
 
 	Body b;
 	b.stmts = new_body;
+	b.code = ScriptCode::Compile(new_body);
 	b.priority = priority;
 
 	bodies.push_back(b);
 	sort(bodies.begin(), bodies.end());
 	}
 
+void BroFunc::SimplifyBodies()
+	{
+	for ( unsigned int i = 0; i < bodies.size(); ++i )
+		{
+		simplify_stmt(bodies[i].stmts);
+
+		// The compiled version refers to the statements it has
+		// been compiled from.
+		delete bodies[i].code;
+		bodies[i].code = ScriptCode::Compile(bodies[i].stmts);
+		}
+	}
+
 void BroFunc::Describe(ODesc* d) const
 	{
 	d->Add(Name());
@@ -528,10 +598,11 @@ bool BroFunc::DoUnserialize(UnserialInfo* info)
 	}
 
 BuiltinFunc::BuiltinFunc(built_in_func arg_func, const char* arg_name,
-			int arg_is_pure)
+			int arg_is_pure, built_in_direct_func arg_direct_func)
 : Func(BUILTIN_FUNC)
 	{
 	func = arg_func;
+	direct_func = arg_direct_func;
 	name = make_full_var_name(GLOBAL_MODULE_NAME, arg_name);
 	is_pure = arg_is_pure;
 
@@ -599,6 +670,13 @@ Val* BuiltinFunc::Call(val_list* args, Frame* parent) const
 	return result;
 	}
 
+bool BuiltinFunc::CanCallDirect()
+	{
+	return ! segment_logger && ! sample_logger &&
+		! plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION) &&
+		! g_trace_state.DoTrace();
+	}
+
 void BuiltinFunc::Describe(ODesc* d) const
 	{
 	d->Add(Name());
@@ -631,11 +709,13 @@ void builtin_error(const char* msg, BroObj* arg)
 #include "stats.bif.func_h"
 #include "reporter.bif.func_h"
 #include "strings.bif.func_h"
+#include "intel.bif.func_h"
 
 #include "bro.bif.func_def"
 #include "stats.bif.func_def"
 #include "reporter.bif.func_def"
 #include "strings.bif.func_def"
+#include "intel.bif.func_def"
 
 #include "__all__.bif.cc" // Autogenerated for compiling in the bif_target() code.
 #include "__all__.bif.register.cc" // Autogenerated for compiling in the bif_target() code.
@@ -650,16 +730,28 @@ void init_builtin_funcs()
 	DNSStats = internal_type("DNSStats")->AsRecordType();
 	GapStats = internal_type("GapStats")->AsRecordType();
 	EventStats = internal_type("EventStats")->AsRecordType();
+	EventHandlerStats = internal_type("EventHandlerStats")->AsRecordType();
+	EventHandlerStatsTable = internal_type("EventHandlerStatsTable")->AsTableType();
+	AnalyzerStats = internal_type("AnalyzerStats")->AsRecordType();
+	AnalyzerStatsTable = internal_type("AnalyzerStatsTable")->AsTableType();
+	MetricValue = internal_type("MetricValue")->AsRecordType();
+	MetricTable = internal_type("MetricTable")->AsTableType();
 	TimerStats = internal_type("TimerStats")->AsRecordType();
+	TriggerStats = internal_type("TriggerStats")->AsRecordType();
 	FileAnalysisStats = internal_type("FileAnalysisStats")->AsRecordType();
 	ThreadStats = internal_type("ThreadStats")->AsRecordType();
+	NUMAStats = internal_type("NUMAStats")->AsRecordType();
+	HugePageStats = internal_type("HugePageStats")->AsRecordType();
 
 	var_sizes = internal_type("var_sizes")->AsTableType();
+	table_size = internal_type("table_size")->AsRecordType();
+	table_sizes = internal_type("table_sizes")->AsTableType();
 
 #include "bro.bif.func_init"
 #include "stats.bif.func_init"
 #include "reporter.bif.func_init"
 #include "strings.bif.func_init"
+#include "intel.bif.func_init"
 
 	did_builtin_init = true;
 	}
@@ -721,3 +813,31 @@ bool check_built_in_call(BuiltinFunc* f, CallExpr* call)
 
 	return true;
 	}
+
+void simplify_script_functions()
+	{
+	// The debugger needs to see the statements as written.
+	if ( g_policy_debug || getenv("BRO_NO_SCRIPT_OPTIMIZATION") )
+		return;
+
+	PDict(ID)* globals = global_scope()->Vars();
+
+	// Two passes, so that calls to one-line functions get inlined
+	// regardless of the order in which we come across the functions.
+	for ( int pass = 0; pass < 2; ++pass )
+		{
+		IterCookie* c = globals->InitForIteration();
+		ID* id;
+
+		while ( (id = globals->NextEntry(c)) )
+			{
+			if ( ! id->HasVal() || id->Type()->Tag() != TYPE_FUNC )
+				continue;
+
+			Func* f = id->ID_Val()->AsFunc();
+
+			if ( f->GetKind() == Func::BRO_FUNC )
+				((BroFunc*) f)->SimplifyBodies();
+			}
+		}
+	}
@@ -16,6 +16,7 @@ class Stmt;
 class Frame;
 class ID;
 class CallExpr;
+class ScriptCode;
 
 class Func : public BroObj {
 public:
@@ -31,6 +32,7 @@ public:
 
 	struct Body {
 		Stmt* stmts;
+		ScriptCode* code;	// compiled version of stmts, if any
 		int priority;
 		bool operator<(const Body& other) const
 			{ return priority > other.priority; } // reverse sort
@@ -100,36 +102,79 @@ public:
 
 	int FrameSize() const {	return frame_size; }
 
+	// Simplifies the bodies once all scripts have been parsed; see
+	// Stmt::Simplify().
+	void SimplifyBodies();
+
 	void Describe(ODesc* d) const override;
 
 protected:
 	BroFunc() : Func(BRO_FUNC)	{}
 	Stmt* AddInits(Stmt* body, id_list* inits);
 
+	// Returns a frame for a call, reusing one of an earlier call if
+	// possible.
+	Frame* NewFrame(val_list* args) const;
+
+	// Called when a call has finished with its frame.  Keeps it around
+	// for reuse unless somebody else holds on to it, too.
+	void ReleaseFrame(Frame* f) const;
+
 	DECLARE_SERIAL(BroFunc);
 
 	int frame_size;
+
+	// Frames of finished calls, ready for reuse.  With recursion, there
+	// can be more than one call active at a time.
+	mutable std::vector<Frame*> frame_pool;
 };
 
 typedef Val* (*built_in_func)(Frame* frame, val_list* args);
 
+// A built-in function's entry point taking its arguments as an array,
+// for calls whose argument count is known to match. bifcl generates one
+// for each function with fixed arguments whose body doesn't access the
+// argument list as such.
+typedef Val* (*built_in_direct_func)(Frame* frame, Val** args);
+
 class BuiltinFunc : public Func {
 public:
-	BuiltinFunc(built_in_func func, const char* name, int is_pure);
+	BuiltinFunc(built_in_func func, const char* name, int is_pure,
+		    built_in_direct_func direct_func = 0);
 	~BuiltinFunc();
 
 	int IsPure() const override;
 	Val* Call(val_list* args, Frame* parent) const override;
 	built_in_func TheFunc() const	{ return func; }
+	built_in_direct_func TheDirectFunc() const	{ return direct_func; }
+
+	// Calls the direct entry point, which must exist, with as many
+	// arguments as the function's type has. Takes over the arguments'
+	// references, like Call() does.
+	Val* CallDirect(Val** args, int num_args, Frame* parent) const
+		{
+		Val* result = direct_func(parent, args);
+
+		for ( int i = 0; i < num_args; ++i )
+			Unref(args[i]);
+
+		return result;
+		}
+
+	// Returns false if calls need to go through Call() because
+	// something else wants to see them, like plugins, tracing, or
+	// profiling.
+	static bool CanCallDirect();
 
 	void Describe(ODesc* d) const override;
 
 protected:
-	BuiltinFunc()	{ func = 0; is_pure = 0; }
+	BuiltinFunc()	{ func = 0; direct_func = 0; is_pure = 0; }
 
 	DECLARE_SERIAL(BuiltinFunc);
 
 	built_in_func func;
+	built_in_direct_func direct_func;
 	int is_pure;
 };
 
@@ -140,6 +185,11 @@ extern void init_builtin_funcs_subdirs();
 
 extern bool check_built_in_call(BuiltinFunc* f, CallExpr* call);
 
+// Simplifies the bodies of all script functions, events, and hooks.
+// This needs to run after all scripts have been parsed, and before
+// executing any of them.
+extern void simplify_script_functions();
+
 // This global is set prior to the interpreter making a function call.
 // It's there so that built-in functions can access the location information
 // associated with a call when reporting error messages.
@@ -14,6 +14,14 @@
 // length. MD5 is used as a scrambling scheme so that it is difficult
 // for the adversary to construct conflicts, though I do not know if
 // HMAC/MD5 is provably universal.
+//
+// [Bro] The above is historic: short data now goes through SipHash-2-4.
+// Optionally, SipHash-1-3 takes care of data of any length instead. It
+// does one compression round per word and three finalization rounds
+// instead of two and four, which makes it about twice as fast for the
+// short keys that dominate session and script tables. It's a keyed PRF
+// just the same, though with a smaller security margin, so it still
+// keeps attackers from constructing collisions.
 
 #include "bro-config.h"
 
@@ -22,11 +30,84 @@
 
 #include "siphash24.h"
 
+HashFunction hash_function = HASH_FN_SIPHASH24;
+
 void init_hash_function()
 	{
 	// Make sure we have already called init_random_seed().
 	if ( ! (hmac_key_set && siphash_key_set) )
 		reporter->InternalError("Bro's hash functions aren't fully initialized");
+
+	const char* fn = getenv("BRO_HASH_FUNCTION");
+
+	if ( ! fn || ! *fn || streq(fn, "siphash24") )
+		hash_function = HASH_FN_SIPHASH24;
+
+	else if ( streq(fn, "siphash13") )
+		hash_function = HASH_FN_SIPHASH13;
+
+	else
+		reporter->FatalError("unknown hash function '%s' in $BRO_HASH_FUNCTION", fn);
+	}
+
+#define SIP_ROTL(x, b) (uint64) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND \
+	do { \
+		v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+		v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+	} while ( 0 )
+
+// SipHash-1-3. The hash only needs to be consistent within the process,
+// so this reads words in host byte order, rather than little-endian as the
+// reference implementation does.
+static hash_t siphash13(const void* bytes, int size)
+	{
+	uint64 k0, k1;
+	memcpy(&k0, shared_siphash_key, sizeof(k0));
+	memcpy(&k1, shared_siphash_key + sizeof(k0), sizeof(k1));
+
+	uint64 v0 = k0 ^ 0x736f6d6570736575ULL;
+	uint64 v1 = k1 ^ 0x646f72616e646f6dULL;
+	uint64 v2 = k0 ^ 0x6c7967656e657261ULL;
+	uint64 v3 = k1 ^ 0x7465646279746573ULL;
+
+	const u_char* p = (const u_char*) bytes;
+	const u_char* end = p + (size & ~7);
+
+	for ( ; p < end; p += 8 )
+		{
+		uint64 m;
+		memcpy(&m, p, sizeof(m));
+		v3 ^= m;
+		SIP_ROUND;
+		v0 ^= m;
+		}
+
+	uint64 b = uint64(size) << 56;
+
+	switch ( size & 7 ) {
+	case 7: b |= uint64(p[6]) << 48;
+	case 6: b |= uint64(p[5]) << 40;
+	case 5: b |= uint64(p[4]) << 32;
+	case 4: b |= uint64(p[3]) << 24;
+	case 3: b |= uint64(p[2]) << 16;
+	case 2: b |= uint64(p[1]) << 8;
+	case 1: b |= uint64(p[0]);
+	}
+
+	v3 ^= b;
+	SIP_ROUND;
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIP_ROUND;
+	SIP_ROUND;
+	SIP_ROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
 	}
 
 HashKey::HashKey(bro_int_t i)
@@ -164,6 +245,9 @@ void* HashKey::CopyKey(const void* k, int s) const
 
 hash_t HashKey::HashBytes(const void* bytes, int size)
 	{
+	if ( hash_function == HASH_FN_SIPHASH13 )
+		return siphash13(bytes, size);
+
 	if ( size <= UHASH_KEY_SIZE )
 		{
 		hash_t digest;
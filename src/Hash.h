@@ -85,6 +85,18 @@ protected:
 	hash_t hash;
 };
 
+// The functions HashKey::HashBytes() can use. They're all keyed with a
+// per-process random key (see init_random_seed()).
+typedef enum {
+	HASH_FN_SIPHASH24,	// SipHash-2-4, and HMAC/MD5 for longer data
+	HASH_FN_SIPHASH13,	// SipHash-1-3, for data of any length
+} HashFunction;
+
+// The one in use. It must not change once anything has been hashed.
+extern HashFunction hash_function;
+
+// Picks the hash function according to $BRO_HASH_FUNCTION, which may be
+// "siphash24" (the default) or "siphash13".
 extern void init_hash_function();
 
 #endif
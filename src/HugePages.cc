@@ -0,0 +1,143 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include <map>
+
+#include "HugePages.h"
+#include "Metrics.h"
+#include "NetVar.h"
+
+uint64 huge_page_bytes_mapped = 0;
+uint64 huge_page_bytes_explicit = 0;
+
+// The allocations with their own mappings, and whether they're from
+// explicit huge pages.  Only these large ones are ever in here, so it's
+// small.  Other threads may allocate too.
+static std::map<void*, bool> mappings;
+static pthread_mutex_t mappings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double huge_page_bytes()
+	{
+	return huge_page_bytes_mapped;
+	}
+
+static metrics::CallbackMetric* huge_page_metric =
+	metrics::registry()->NewCallbackGauge("memory.huge_page_bytes",
+		"Bytes of tables allocated to be backed by huge pages.",
+		huge_page_bytes);
+
+// Rounds up to full huge pages.
+static size_t mapping_size(size_t size)
+	{
+	return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	}
+
+void* huge_page_alloc(size_t size)
+	{
+	// The options are still unset while parsing the scripts, so what
+	// gets allocated then always comes from malloc().
+	if ( ! BifConst::huge_pages || size < HUGE_PAGE_SIZE )
+		return safe_malloc(size);
+
+	size_t mapped = mapping_size(size);
+	bool is_explicit = false;
+	void* p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if ( BifConst::explicit_huge_pages )
+		{
+		// Fails if not enough of them are reserved.
+		p = mmap(0, mapped, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		is_explicit = (p != MAP_FAILED);
+		}
+#endif
+
+	if ( p == MAP_FAILED )
+		{
+		p = mmap(0, mapped, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if ( p == MAP_FAILED )
+			return safe_malloc(size);
+
+#ifdef MADV_HUGEPAGE
+		madvise(p, mapped, MADV_HUGEPAGE);
+#endif
+		}
+
+	pthread_mutex_lock(&mappings_mutex);
+
+	mappings[p] = is_explicit;
+	huge_page_bytes_mapped += mapped;
+
+	if ( is_explicit )
+		huge_page_bytes_explicit += mapped;
+
+	pthread_mutex_unlock(&mappings_mutex);
+
+	return p;
+	}
+
+void huge_page_free(void* p, size_t size)
+	{
+	if ( ! p )
+		return;
+
+	if ( size >= HUGE_PAGE_SIZE )
+		{
+		pthread_mutex_lock(&mappings_mutex);
+
+		std::map<void*, bool>::iterator i = mappings.find(p);
+
+		if ( i != mappings.end() )
+			{
+			size_t mapped = mapping_size(size);
+			huge_page_bytes_mapped -= mapped;
+
+			if ( i->second )
+				huge_page_bytes_explicit -= mapped;
+
+			mappings.erase(i);
+			pthread_mutex_unlock(&mappings_mutex);
+
+			munmap(p, mapped);
+			return;
+			}
+
+		pthread_mutex_unlock(&mappings_mutex);
+		}
+
+	free(p);
+	}
+
+uint64 huge_page_bytes_backed()
+	{
+	FILE* f = fopen("/proc/self/smaps", "r");
+
+	if ( ! f )
+		return 0;
+
+	char line[256];
+	uint64 kbytes = 0;
+
+	while ( fgets(line, sizeof(line), f) )
+		{
+		unsigned long long n;
+
+		if ( sscanf(line, "AnonHugePages: %llu kB", &n) == 1 ||
+		     sscanf(line, "Private_Hugetlb: %llu kB", &n) == 1 ||
+		     sscanf(line, "Shared_Hugetlb: %llu kB", &n) == 1 )
+			kbytes += n;
+		}
+
+	fclose(f);
+	return kbytes * 1024;
+	}
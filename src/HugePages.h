@@ -0,0 +1,37 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef hugepages_h
+#define hugepages_h
+
+#include <stddef.h>
+
+#include "util.h"
+
+// Allocation of large, randomly accessed tables, such as the Dictionary
+// bucket and slot arrays, from huge pages to save TLB misses.  With
+// huge_pages set, allocations of at least HUGE_PAGE_SIZE get their own
+// mapping, which the kernel is advised to back with transparent huge
+// pages; with explicit_huge_pages also set, that tries the pages reserved
+// through vm.nr_hugepages first.  Smaller allocations, and all of them if
+// the option is off, come from malloc() as usual.
+//
+// The memory isn't initialized.  It must be released with
+// huge_page_free(), passing the same size, which works for either kind.
+
+extern void* huge_page_alloc(size_t size);
+extern void huge_page_free(void* p, size_t size);
+
+// The size of the huge pages we assume, which is the one of x86-64.
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Bytes currently allocated through huge_page_alloc() in their own
+// mappings, and how many of those are explicit huge pages.
+extern uint64 huge_page_bytes_mapped;
+extern uint64 huge_page_bytes_explicit;
+
+// Returns how much of the process' memory the kernel actually backs with
+// huge pages, transparent ones and explicit ones together, in bytes.
+// Returns 0 where this isn't known.
+extern uint64 huge_page_bytes_backed();
+
+#endif
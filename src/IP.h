@@ -39,6 +39,11 @@ public:
 	 */
 	IPv6_Hdr(uint8 t, const u_char* d) : type(t), data(d) {}
 
+	/**
+	 * Construct an empty header, for chains to fill in.
+	 */
+	IPv6_Hdr() : type(0), data(0) {}
+
 	/**
 	 * Replace the value of the next protocol field.
 	 */
@@ -136,26 +141,19 @@ protected:
 	const u_char* data;
 };
 
+/**
+ * The chain of headers of an IPv6 packet, from the main header through the
+ * last extension header. The common chains fit into the object itself, so
+ * that parsing a packet doesn't allocate anything; only unusually long ones
+ * spill over onto the heap. Script-layer values only get built on request.
+ */
 class IPv6_Hdr_Chain {
 public:
 	/**
 	 * Initializes the header chain from an IPv6 header structure.
 	 */
-	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, int len) :
-#ifdef ENABLE_MOBILE_IPV6
-		homeAddr(0),
-#endif
-		finalDst(0)
-		{ Init(ip6, len, false); }
-
-	~IPv6_Hdr_Chain()
-		{
-		for ( size_t i = 0; i < chain.size(); ++i ) delete chain[i];
-#ifdef ENABLE_MOBILE_IPV6
-		delete homeAddr;
-#endif
-		delete finalDst;
-		}
+	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, int len)
+		{ Reset(); Init(ip6, len, false); }
 
 	/**
 	 * @return a copy of the header chain, but with pointers to individual
@@ -166,7 +164,7 @@ public:
 	/**
 	 * Returns the number of headers in the chain.
 	 */
-	size_t Size() const { return chain.size(); }
+	size_t Size() const { return num_hdrs; }
 
 	/**
 	 * Returns the sum of the length of all headers in the chain in bytes.
@@ -176,20 +174,24 @@ public:
 	/**
 	 * Accesses the header at the given location in the chain.
 	 */
-	const IPv6_Hdr* operator[](const size_t i) const { return chain[i]; }
+	const IPv6_Hdr* operator[](const size_t i) const
+		{
+		return i < MAX_INLINE_HDRS ?
+			&inline_hdrs[i] : &more_hdrs[i - MAX_INLINE_HDRS];
+		}
 
 	/**
 	 * Returns whether the header chain indicates a fragmented packet.
 	 */
 	bool IsFragment() const
 		{
-		if ( chain.empty() )
+		if ( num_hdrs == 0 )
 			{
 			reporter->InternalWarning("empty IPv6 header chain");
 			return false;
 			}
 
-		return chain[chain.size()-1]->Type() == IPPROTO_FRAGMENT;
+		return (*this)[num_hdrs-1]->Type() == IPPROTO_FRAGMENT;
 		}
 
 	/**
@@ -197,7 +199,7 @@ public:
 	 */
 	const struct ip6_frag* GetFragHdr() const
 		{ return IsFragment() ?
-				(const struct ip6_frag*)chain[chain.size()-1]->Data(): 0; }
+				(const struct ip6_frag*)(*this)[num_hdrs-1]->Data(): 0; }
 
 	/**
 	 * If the header chain is a fragment, returns the offset in number of bytes
@@ -228,16 +230,16 @@ public:
 	IPAddr SrcAddr() const
 		{
 #ifdef ENABLE_MOBILE_IPV6
-		if ( homeAddr )
-			return IPAddr(*homeAddr);
+		if ( have_home_addr )
+			return homeAddr;
 #endif
-		if ( chain.empty() )
+		if ( num_hdrs == 0 )
 			{
 			reporter->InternalWarning("empty IPv6 header chain");
 			return IPAddr();
 			}
 
-		return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_src);
+		return IPAddr(((const struct ip6_hdr*)(inline_hdrs[0].Data()))->ip6_src);
 		}
 
 	/**
@@ -247,16 +249,16 @@ public:
 	 */
 	IPAddr DstAddr() const
 		{
-		if ( finalDst )
-			return IPAddr(*finalDst);
+		if ( have_final_dst )
+			return finalDst;
 
-		if ( chain.empty() )
+		if ( num_hdrs == 0 )
 			{
 			reporter->InternalWarning("empty IPv6 header chain");
 			return IPAddr();
 			}
 
-		return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_dst);
+		return IPAddr(((const struct ip6_hdr*)(inline_hdrs[0].Data()))->ip6_dst);
 		}
 
 	/**
@@ -270,24 +272,31 @@ protected:
 	// point to a fragment
 	friend class FragReassembler;
 
-	IPv6_Hdr_Chain() :
-		length(0),
-#ifdef ENABLE_MOBILE_IPV6
-		homeAddr(0),
-#endif
-		finalDst(0)
-		{}
+	// for keeping a chain inside of each header, and filling it in
+	friend class IP_Hdr;
+
+	IPv6_Hdr_Chain()
+		{ Reset(); }
 
 	/**
 	 * Initializes the header chain from an IPv6 header structure, and replaces
 	 * the first next protocol pointer field that points to a fragment header.
 	 */
-	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, uint16 next, int len) :
+	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, uint16 next, int len)
+		{ Reset(); Init(ip6, len, true, next); }
+
+	/**
+	 * Empties the chain.
+	 */
+	void Reset()
+		{
+		num_hdrs = 0;
+		length = 0;
 #ifdef ENABLE_MOBILE_IPV6
-		homeAddr(0),
+		have_home_addr = false;
 #endif
-		finalDst(0)
-		{ Init(ip6, len, true, next); }
+		have_final_dst = false;
+		}
 
 	/**
 	 * Initializes the header chain from an IPv6 header structure of a given
@@ -298,8 +307,21 @@ protected:
 	          uint16 next = 0);
 
 	/**
-	 * Process a routing header and allocate/remember the final destination
-	 * address if it has segments left and is a valid routing header.
+	 * Adds a header to the end of the chain.
+	 */
+	void Append(const IPv6_Hdr& h)
+		{
+		if ( num_hdrs < MAX_INLINE_HDRS )
+			inline_hdrs[num_hdrs] = h;
+		else
+			more_hdrs.push_back(h);
+
+		++num_hdrs;
+		}
+
+	/**
+	 * Process a routing header and remember the final destination address
+	 * if it has segments left and is a valid routing header.
 	 */
 	void ProcessRoutingHeader(const struct ip6_rthdr* r, uint16 len);
 
@@ -311,7 +333,20 @@ protected:
 	void ProcessDstOpts(const struct ip6_dest* d, uint16 len);
 #endif
 
-	vector<IPv6_Hdr*> chain;
+	/**
+	 * The number of headers kept inside the chain itself. That's the main
+	 * header plus more extension headers than packets usually carry.
+	 */
+	static const size_t MAX_INLINE_HDRS = 8;
+
+	IPv6_Hdr inline_hdrs[MAX_INLINE_HDRS];
+
+	/**
+	 * The headers beyond the first MAX_INLINE_HDRS, if any.
+	 */
+	vector<IPv6_Hdr> more_hdrs;
+
+	size_t num_hdrs;
 
 	/**
 	 * The summation of all header lengths in the chain in bytes.
@@ -321,15 +356,18 @@ protected:
 #ifdef ENABLE_MOBILE_IPV6
 	/**
 	 * Home Address of the packet's source as defined by Mobile IPv6 (RFC 6275).
+	 * Valid iff have_home_addr is true.
 	 */
-	IPAddr* homeAddr;
+	IPAddr homeAddr;
+	bool have_home_addr;
 #endif
 
 	/**
 	 * The final destination address in chain's first Routing header that has
-	 * non-zero segments left.
+	 * non-zero segments left. Valid iff have_final_dst is true.
 	 */
-	IPAddr* finalDst;
+	IPAddr finalDst;
+	bool have_final_dst;
 };
 
 /**
@@ -359,12 +397,17 @@ public:
 	 * @param arg_del whether to take ownership of \a arg_ip6 pointer's memory.
 	 * @param len the packet's length in bytes.
 	 * @param c an already-constructed header chain to take ownership of.
+	 * Without one, the header gets parsed into a chain of our own.
 	 */
 	IP_Hdr(const struct ip6_hdr* arg_ip6, bool arg_del, int len,
 	       const IPv6_Hdr_Chain* c = 0)
-		: ip4(0), ip6(arg_ip6), del(arg_del),
-		  ip6_hdrs(c ? c : new IPv6_Hdr_Chain(ip6, len))
+		: ip4(0), ip6(arg_ip6), del(arg_del), ip6_hdrs(c)
 		{
+		if ( ! ip6_hdrs )
+			{
+			ip6_chain.Init(ip6, len, false);
+			ip6_hdrs = &ip6_chain;
+			}
 		}
 
 	/**
@@ -379,7 +422,8 @@ public:
 	 */
 	~IP_Hdr()
 		{
-		delete ip6_hdrs;
+		if ( ip6_hdrs != &ip6_chain )
+			delete ip6_hdrs;
 
 		if ( del )
 			{
@@ -585,6 +629,10 @@ private:
 	const struct ip6_hdr* ip6;
 	bool del;
 	const IPv6_Hdr_Chain* ip6_hdrs;
+
+	// Where IPv6 headers get parsed into, unless we've been handed an
+	// existing chain.
+	IPv6_Hdr_Chain ip6_chain;
 };
 
 #endif
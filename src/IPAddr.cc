@@ -14,14 +14,62 @@ const uint8_t IPAddr::v4_mapped_prefix[12] = { 0, 0, 0, 0,
                                                0, 0, 0, 0,
                                                0, 0, 0xff, 0xff };
 
-HashKey* BuildConnIDHashKey(const ConnID& id)
-	{
+// The key under which connections get stored: 12 bytes for IPv4, and 36
+// for IPv6.
+union conn_id_key {
+	struct {
+		uint32 ip1;
+		uint32 ip2;
+		uint16 port1;
+		uint16 port2;
+	} v4;
+
 	struct {
 		in6_addr ip1;
 		in6_addr ip2;
 		uint16 port1;
 		uint16 port2;
-	} key;
+	} v6;
+};
+
+// Fills in the key for the given ConnID and returns its size.
+static int build_conn_id_key(const ConnID& id, const in6_addr& src_in6,
+			     const in6_addr& dst_in6, conn_id_key* key)
+	{
+	if ( id.src_addr.GetFamily() == IPv4 && id.dst_addr.GetFamily() == IPv4 )
+		{
+		// Most connections are IPv4, and for them only the last
+		// four bytes of each address make a difference, so the key
+		// gets by with 12 bytes rather than 36.  HashKeys of different
+		// sizes never match, so this can't collide with the IPv6 keys
+		// below.
+		uint32 src, dst;
+		memcpy(&src, &src_in6.s6_addr[12], sizeof(src));
+		memcpy(&dst, &dst_in6.s6_addr[12], sizeof(dst));
+
+		// Same ordering as addr_port_canon_lt(), which compares the
+		// addresses in network byte order.
+		uint32 src_h = ntohl(src);
+		uint32 dst_h = ntohl(dst);
+
+		if ( id.is_one_way || src_h < dst_h ||
+		     (src_h == dst_h && id.src_port < id.dst_port) )
+			{
+			key->v4.ip1 = src;
+			key->v4.ip2 = dst;
+			key->v4.port1 = id.src_port;
+			key->v4.port2 = id.dst_port;
+			}
+		else
+			{
+			key->v4.ip1 = dst;
+			key->v4.ip2 = src;
+			key->v4.port1 = id.dst_port;
+			key->v4.port2 = id.src_port;
+			}
+
+		return sizeof(key->v4);
+		}
 
 	// Lookup up connection based on canonical ordering, which is
 	// the smaller of <src addr, src port> and <dst addr, dst port>
@@ -30,20 +78,41 @@ HashKey* BuildConnIDHashKey(const ConnID& id)
 	     addr_port_canon_lt(id.src_addr, id.src_port, id.dst_addr, id.dst_port)
 	   )
 		{
-		key.ip1 = id.src_addr.in6;
-		key.ip2 = id.dst_addr.in6;
-		key.port1 = id.src_port;
-		key.port2 = id.dst_port;
+		key->v6.ip1 = src_in6;
+		key->v6.ip2 = dst_in6;
+		key->v6.port1 = id.src_port;
+		key->v6.port2 = id.dst_port;
 		}
 	else
 		{
-		key.ip1 = id.dst_addr.in6;
-		key.ip2 = id.src_addr.in6;
-		key.port1 = id.dst_port;
-		key.port2 = id.src_port;
+		key->v6.ip1 = dst_in6;
+		key->v6.ip2 = src_in6;
+		key->v6.port1 = id.dst_port;
+		key->v6.port2 = id.src_port;
 		}
 
-	return new HashKey(&key, sizeof(key));
+	return sizeof(key->v6);
+	}
+
+HashKey* BuildConnIDHashKey(const ConnID& id)
+	{
+	conn_id_key key;
+	int size = build_conn_id_key(id, id.src_addr.in6, id.dst_addr.in6, &key);
+	return new HashKey(&key, size);
+	}
+
+HashKey* BuildConnIDHashKey(const ConnID& id, hash_t hash)
+	{
+	conn_id_key key;
+	int size = build_conn_id_key(id, id.src_addr.in6, id.dst_addr.in6, &key);
+	return new HashKey(&key, size, hash);
+	}
+
+hash_t ConnIDHash(const ConnID& id)
+	{
+	conn_id_key key;
+	int size = build_conn_id_key(id, id.src_addr.in6, id.dst_addr.in6, &key);
+	return HashKey::HashBytes(&key, size);
 	}
 
 static inline uint32_t bit_mask32(int bottom_bits)
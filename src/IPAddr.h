@@ -363,6 +363,8 @@ public:
 	void ConvertToThreadingValue(threading::Value::addr_t* v) const;
 
 	friend HashKey* BuildConnIDHashKey(const ConnID& id);
+	friend HashKey* BuildConnIDHashKey(const ConnID& id, hash_t hash);
+	friend hash_t ConnIDHash(const ConnID& id);
 
 	unsigned int MemoryAllocation() const { return padded_sizeof(*this); }
 
@@ -451,6 +453,18 @@ inline void IPAddr::ConvertToThreadingValue(threading::Value::addr_t* v) const
   */
 HashKey* BuildConnIDHashKey(const ConnID& id);
 
+/**
+  * Same, but uses a hash already computed by ConnIDHash() rather than
+  * computing it again.
+  */
+HashKey* BuildConnIDHashKey(const ConnID& id, hash_t hash);
+
+/**
+  * Returns the hash of the key that BuildConnIDHashKey() returns for a
+  * given ConnID, without allocating one.
+  */
+hash_t ConnIDHash(const ConnID& id);
+
 /**
  * Class storing both IPv4 and IPv6 prefixes
  * (i.e., \c 192.168.1.1/16 and \c FD00::/8.
@@ -0,0 +1,157 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <ctype.h>
+
+#include "IntelIndex.h"
+#include "Type.h"
+#include "Var.h"
+#include "Metrics.h"
+
+static double intel_indicators()
+	{
+	return intel_index()->Size();
+	}
+
+IntelIndex::IntelIndex()
+	{
+	EnumType* t = internal_type("Intel::Type")->AsEnumType();
+	domain_type = t->Lookup("Intel", "DOMAIN");
+
+	metrics::registry()->NewCallbackGauge("intel.indicators",
+					      "Indicators in the intelligence index.",
+					      intel_indicators);
+	}
+
+void IntelIndex::AddrKey(const IPAddr& a, std::string* key)
+	{
+	uint32_t bytes[4];
+	a.CopyIPv6(bytes);
+	key->assign((const char*) bytes, sizeof(bytes));
+	}
+
+void IntelIndex::StringKey(const char* indicator, int len, std::string* key)
+	{
+	key->assign(indicator, len);
+
+	for ( std::string::iterator i = key->begin(); i != key->end(); ++i )
+		*i = tolower(*i);
+	}
+
+bool IntelIndex::InsertAddr(const IPAddr& a)
+	{
+	std::string key;
+	AddrKey(a, &key);
+	return addrs.insert(key).second;
+	}
+
+bool IntelIndex::InsertSubnet(const IPPrefix& p)
+	{
+	return ! subnets.Insert(p.Prefix(), p.LengthIPv6());
+	}
+
+bool IntelIndex::InsertString(const char* indicator, int len, int type)
+	{
+	std::string key;
+	StringKey(indicator, len, &key);
+	return strings[type].insert(key).second;
+	}
+
+bool IntelIndex::RemoveAddr(const IPAddr& a)
+	{
+	std::string key;
+	AddrKey(a, &key);
+	return addrs.erase(key);
+	}
+
+bool IntelIndex::RemoveSubnet(const IPPrefix& p)
+	{
+	return subnets.Remove(p.Prefix(), p.LengthIPv6());
+	}
+
+bool IntelIndex::RemoveString(const char* indicator, int len, int type)
+	{
+	std::unordered_map<int, string_set>::iterator i = strings.find(type);
+
+	if ( i == strings.end() )
+		return false;
+
+	std::string key;
+	StringKey(indicator, len, &key);
+	return i->second.erase(key);
+	}
+
+void IntelIndex::Clear()
+	{
+	addrs.clear();
+	subnets.Clear();
+	strings.clear();
+	}
+
+bool IntelIndex::FindAddr(const IPAddr& a) const
+	{
+	// Kept across calls so that lookups don't allocate.
+	static std::string key;
+
+	if ( ! addrs.empty() )
+		{
+		AddrKey(a, &key);
+
+		if ( addrs.find(key) != addrs.end() )
+			return true;
+		}
+
+	return subnets.Size() && subnets.Lookup(a, 128);
+	}
+
+bool IntelIndex::FindString(const char* indicator, int len, int type,
+				bool subdomains) const
+	{
+	std::unordered_map<int, string_set>::const_iterator i = strings.find(type);
+
+	if ( i == strings.end() || i->second.empty() )
+		return false;
+
+	const string_set& s = i->second;
+
+	static std::string key;
+	StringKey(indicator, len, &key);
+
+	if ( s.find(key) != s.end() )
+		return true;
+
+	if ( ! subdomains || type != domain_type )
+		return false;
+
+	// Walks up the parent domains, one label at a time.
+	static std::string parent;
+
+	for ( size_t dot = key.find('.'); dot != std::string::npos;
+	      dot = key.find('.', dot + 1) )
+		{
+		parent.assign(key, dot + 1, std::string::npos);
+
+		if ( ! parent.empty() && s.find(parent) != s.end() )
+			return true;
+		}
+
+	return false;
+	}
+
+uint64 IntelIndex::Size() const
+	{
+	uint64 n = addrs.size() + subnets.Size();
+
+	for ( std::unordered_map<int, string_set>::const_iterator i = strings.begin();
+	      i != strings.end(); ++i )
+		n += i->second.size();
+
+	return n;
+	}
+
+IntelIndex* intel_index()
+	{
+	static IntelIndex* index = new IntelIndex();
+	return index;
+	}
@@ -0,0 +1,124 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef intelindex_h
+#define intelindex_h
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "IPAddr.h"
+#include "PrefixTable.h"
+
+/**
+ * A native index of the intelligence framework's indicators, so that
+ * checking whatever's seen against them takes a single call into the core,
+ * without building any values along the way. Most of what's seen doesn't
+ * match, so that's the path this optimizes; the framework's scripts still
+ * keep the items' metadata and take care of hits.
+ *
+ * Addresses go into a hash set, subnets into a PrefixTable, and all other
+ * indicators into a hash set per indicator type, in lower case, as the
+ * framework matches them case-insensitively. Domains can also match by
+ * suffix, label by label, so that an indicator covers all subdomains.
+ */
+class IntelIndex {
+public:
+	/**
+	 * Constructor.
+	 */
+	IntelIndex();
+
+	/**
+	 * Adds an address.
+	 *
+	 * @return True if it's new.
+	 */
+	bool InsertAddr(const IPAddr& a);
+
+	/**
+	 * Adds a subnet.
+	 *
+	 * @return True if it's new.
+	 */
+	bool InsertSubnet(const IPPrefix& p);
+
+	/**
+	 * Adds an indicator of another type.
+	 *
+	 * @param type The indicator's Intel::Type value.
+	 *
+	 * @return True if it's new.
+	 */
+	bool InsertString(const char* indicator, int len, int type);
+
+	/**
+	 * Removes an address.
+	 *
+	 * @return True if it was there.
+	 */
+	bool RemoveAddr(const IPAddr& a);
+
+	/**
+	 * Removes a subnet.
+	 *
+	 * @return True if it was there.
+	 */
+	bool RemoveSubnet(const IPPrefix& p);
+
+	/**
+	 * Removes an indicator of another type.
+	 *
+	 * @return True if it was there.
+	 */
+	bool RemoveString(const char* indicator, int len, int type);
+
+	/**
+	 * Removes all indicators.
+	 */
+	void Clear();
+
+	/**
+	 * Returns true if the address is an indicator, or falls into one of
+	 * the subnets.
+	 */
+	bool FindAddr(const IPAddr& a) const;
+
+	/**
+	 * Returns true if the string is an indicator of the given type,
+	 * ignoring case.
+	 *
+	 * @param subdomains For domains, whether to look for its parent
+	 * domains as well.
+	 */
+	bool FindString(const char* indicator, int len, int type,
+			bool subdomains) const;
+
+	/**
+	 * Returns the number of indicators.
+	 */
+	uint64 Size() const;
+
+private:
+	typedef std::unordered_set<std::string> string_set;
+
+	// Sets key to the address's bytes.
+	static void AddrKey(const IPAddr& a, std::string* key);
+
+	// Sets key to the indicator in lower case.
+	static void StringKey(const char* indicator, int len, std::string* key);
+
+	string_set addrs;
+	PrefixTable subnets;
+	std::unordered_map<int, string_set> strings;
+
+	int domain_type;	// Intel::DOMAIN
+};
+
+/**
+ * Returns the index. It comes into existence on first use, which must be
+ * after the intelligence framework's scripts have been loaded.
+ */
+IntelIndex* intel_index();
+
+#endif
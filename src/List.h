@@ -21,6 +21,8 @@
 //	sizeof(data) <= sizeof(void*).
 
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include "util.h"
 
 typedef void* ent;
@@ -181,6 +183,288 @@ PList(type)::PList(type)(type* ep1 ...) : BaseList()			\
 	}
 
 
+// InlineList -- a typed list with the same interface as the ones that
+//	the macros above declare, but as a template, and with room for its
+//	first N entries inside the object itself.  Short lists, like most
+//	event arguments, thus don't allocate anything, and the entries sit
+//	right next to the rest of the list.  Longer ones move to the heap
+//	and grow like a BaseList does.  Lists can be moved, which takes
+//	over the other list's heap entries rather than copying them.
+//
+//	Like with BaseList, entries must be pointers or other plain values
+//	that can be copied around bytewise.
+
+template <typename T, int N = 4>
+class InlineList {
+public:
+	// The number of entries that fit into the list itself.
+	static const int INLINE_ENTRIES = N;
+
+	InlineList(int size = 0)
+		{
+		entry = inline_entries;
+		max_entries = N;
+		num_entries = 0;
+		chunk_size = size > 0 ? size : DEFAULT_CHUNK;
+
+		if ( size > N )
+			resize(size);
+		}
+
+	InlineList(const InlineList& l)
+		{
+		entry = inline_entries;
+		max_entries = N;
+		num_entries = 0;
+		CopyFrom(l);
+		}
+
+	InlineList(InlineList&& l)
+		{
+		entry = inline_entries;
+		max_entries = N;
+		num_entries = 0;
+		MoveFrom(l);
+		}
+
+	~InlineList()		{ FreeEntries(); }
+
+	InlineList& operator=(const InlineList& l)
+		{
+		if ( this != &l )
+			{
+			clear();
+			CopyFrom(l);
+			}
+
+		return *this;
+		}
+
+	InlineList& operator=(InlineList&& l)
+		{
+		if ( this != &l )
+			{
+			clear();
+			MoveFrom(l);
+			}
+
+		return *this;
+		}
+
+	void clear()		// remove all entries
+		{
+		FreeEntries();
+		entry = inline_entries;
+		max_entries = N;
+		num_entries = 0;
+		chunk_size = DEFAULT_CHUNK;
+		}
+
+	int length() const	{ return num_entries; }
+	int chunk() const	{ return chunk_size; }
+	int max() const		{ return max_entries; }
+
+	int resize(int new_size = 0)	// 0 => size to fit current number of entries
+		{
+		if ( new_size < num_entries )
+			new_size = num_entries;	// do not lose any entries
+
+		if ( new_size <= N )
+			{
+			if ( entry != inline_entries )
+				{
+				memcpy(inline_entries, entry, num_entries * sizeof(T));
+				free(entry);
+				entry = inline_entries;
+				max_entries = N;
+				}
+
+			return max_entries;
+			}
+
+		if ( new_size == max_entries )
+			return max_entries;
+
+		if ( entry == inline_entries )
+			{
+			entry = (T*) safe_malloc(new_size * sizeof(T));
+			memcpy(entry, inline_entries, num_entries * sizeof(T));
+			}
+		else
+			entry = (T*) safe_realloc((void*) entry, new_size * sizeof(T));
+
+		max_entries = new_size;
+		return max_entries;
+		}
+
+	void sort(list_cmp_func cmp_func)
+		{ qsort(entry, num_entries, sizeof(T), cmp_func); }
+
+	int MemoryAllocation() const
+		{
+		return padded_sizeof(*this) +
+			(entry == inline_entries ? 0 : pad_size(max_entries * sizeof(T)));
+		}
+
+	void insert(T a)	// add at head of list
+		{
+		Grow();
+		memmove(entry + 1, entry, num_entries * sizeof(T));
+		++num_entries;
+		entry[0] = a;
+		}
+
+	// Assumes that the list is sorted and inserts at correct position.
+	void sortedinsert(T a, list_cmp_func cmp_func)
+		{
+		// We optimize for the case that the new element is
+		// larger than most of the current entries.
+		Grow();
+		entry[num_entries++] = a;
+
+		for ( int i = num_entries - 1; i > 0; --i )
+			{
+			if ( cmp_func((const void*) entry[i], (const void*) entry[i-1]) <= 0 )
+				break;
+
+			T tmp = entry[i];
+			entry[i] = entry[i-1];
+			entry[i-1] = tmp;
+			}
+		}
+
+	void append(T a)	// add to end of list
+		{
+		Grow();
+		entry[num_entries++] = a;
+		}
+
+	T remove(T a)		// delete entry from list
+		{ return remove_nth(member_pos(a)); }
+
+	T remove_nth(int n)	// delete nth entry from list
+		{
+		if ( n < 0 || n >= num_entries )
+			return 0;
+
+		T old_ent = entry[n];
+		--num_entries;
+		memmove(entry + n, entry + n + 1, (num_entries - n) * sizeof(T));
+		return old_ent;
+		}
+
+	T get()			// return and remove entry at end of list
+		{
+		if ( num_entries == 0 )
+			return 0;
+
+		return entry[--num_entries];
+		}
+
+	T last()		// return at end of list
+		{ return entry[num_entries-1]; }
+
+	T replace(int i, T new_ent)	// replace entry #i with a new value
+		{
+		if ( i < 0 )
+			return 0;
+
+		if ( i >= num_entries )
+			{ // replacement beyond the end of the list
+			if ( i >= max_entries )
+				resize(i + 1);
+
+			for ( int j = num_entries; j < i; ++j )
+				entry[j] = 0;
+
+			num_entries = i + 1;
+			entry[i] = new_ent;
+			return 0;
+			}
+
+		T old_ent = entry[i];
+		entry[i] = new_ent;
+		return old_ent;
+		}
+
+	// Return 0 if e is not in the list, e otherwise.
+	T is_member(T e) const
+		{ return member_pos(e) < 0 ? 0 : e; }
+
+	// Returns -1 if e is not in the list, otherwise its position.
+	int member_pos(T e) const
+		{
+		for ( int i = 0; i < num_entries; ++i )
+			if ( entry[i] == e )
+				return i;
+
+		return -1;
+		}
+
+	// Return nth entry of list (do not remove).
+	T operator[](int i) const
+		{
+#ifdef SAFE_LISTS
+		if ( i < 0 || i > num_entries-1 )
+			return 0;
+		else
+#endif
+			return entry[i];
+		}
+
+private:
+	static const int DEFAULT_CHUNK = 10;
+
+	void Grow()
+		{
+		if ( num_entries < max_entries )
+			return;
+
+		resize(max_entries + chunk_size);	// make more room
+		chunk_size *= 2;
+		}
+
+	void FreeEntries()
+		{
+		if ( entry != inline_entries )
+			free(entry);
+		}
+
+	void CopyFrom(const InlineList& l)
+		{
+		chunk_size = l.chunk_size;
+		resize(l.num_entries);
+		memcpy(entry, l.entry, l.num_entries * sizeof(T));
+		num_entries = l.num_entries;
+		}
+
+	// Expects this list to be empty, with its entries inline.
+	void MoveFrom(InlineList& l)
+		{
+		chunk_size = l.chunk_size;
+		num_entries = l.num_entries;
+
+		if ( l.entry == l.inline_entries )
+			memcpy(inline_entries, l.inline_entries, num_entries * sizeof(T));
+		else
+			{
+			entry = l.entry;
+			max_entries = l.max_entries;
+			}
+
+		l.entry = l.inline_entries;
+		l.max_entries = N;
+		l.num_entries = 0;
+		l.chunk_size = DEFAULT_CHUNK;
+		}
+
+	T* entry;
+	int chunk_size;		// increase size by this amount when necessary
+	int max_entries;
+	int num_entries;
+	T inline_entries[N];
+};
+
 #define declare(metatype,type) metatype ## declare (type)
 
 // Popular type of list: list of strings.
@@ -0,0 +1,383 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <queue>
+
+#include "LiteralMatcher.h"
+
+// Skips over a character class starting at p (which points to the '['),
+// returning a pointer to just past its closing bracket.
+static const char* skip_ccl(const char* p)
+	{
+	++p;
+
+	if ( *p == '^' )
+		++p;
+
+	// A leading bracket is part of the class.
+	if ( *p == ']' )
+		++p;
+
+	while ( *p && *p != ']' )
+		{
+		if ( *p == '\\' && p[1] )
+			++p;
+
+		else if ( *p == '[' && p[1] == ':' )
+			{ // [:alpha:] and friends
+			const char* end = strstr(p, ":]");
+			if ( end )
+				p = end + 1;
+			}
+
+		++p;
+		}
+
+	return *p ? p + 1 : p;
+	}
+
+// Skips over a parenthesized group starting at p (which points to the
+// '('), returning a pointer to just past the closing parenthesis, or nil
+// if the group contains something we don't understand.
+static const char* skip_group(const char* p)
+	{
+	int depth = 0;
+
+	while ( *p )
+		{
+		switch ( *p ) {
+		case '(':
+			++depth;
+			++p;
+			break;
+
+		case ')':
+			++p;
+			if ( --depth == 0 )
+				return p;
+			break;
+
+		case '[':
+			p = skip_ccl(p);
+			break;
+
+		case '"':
+			for ( ++p; *p && *p != '"'; ++p )
+				if ( *p == '\\' && p[1] )
+					++p;
+			if ( *p )
+				++p;
+			break;
+
+		case '\\':
+			p += p[1] ? 2 : 1;
+			break;
+
+		default:
+			++p;
+		}
+		}
+
+	return 0;
+	}
+
+// If p points to a quantifier, returns its minimum number of repetitions
+// and advances p past it. Otherwise, returns -1.
+static int quantifier(const char*& p)
+	{
+	switch ( *p ) {
+	case '*':
+	case '?':
+		++p;
+		return 0;
+
+	case '+':
+		++p;
+		return 1;
+
+	case '{':
+		{
+		if ( ! isdigit(p[1]) )
+			return -1;
+
+		int min = atoi(p + 1);
+
+		while ( *p && *p != '}' )
+			++p;
+
+		if ( *p )
+			++p;
+
+		return min;
+		}
+
+	default:
+		return -1;
+	}
+	}
+
+std::string required_literal(const char* pattern)
+	{
+	std::string best;
+	std::string current;
+
+	const char* p = pattern;
+
+	while ( *p )
+		{
+		std::string atom;	// literal text of the next item, if any
+		bool is_literal = true;
+
+		switch ( *p ) {
+		case '|':
+			// Alternatives on the top level; no telling what
+			// needs to be there.
+			return "";
+
+		case '(':
+			p = skip_group(p);
+			if ( ! p )
+				return "";
+
+			is_literal = false;
+			break;
+
+		case ')':
+			return "";
+
+		case '[':
+			p = skip_ccl(p);
+			is_literal = false;
+			break;
+
+		case '{':
+			if ( isdigit(p[1]) )
+				return "";	// quantifier without something to repeat
+
+			// A name definition.
+			while ( *p && *p != '}' )
+				++p;
+			if ( *p )
+				++p;
+
+			is_literal = false;
+			break;
+
+		case '.':
+		case '^':
+		case '$':
+			++p;
+			is_literal = false;
+			break;
+
+		case '*':
+		case '+':
+		case '?':
+			return "";
+
+		case '"':
+			for ( ++p; *p && *p != '"'; )
+				{
+				if ( *p == '\\' && p[1] )
+					{
+					++p;
+					atom += char(expand_escape(p));
+					}
+				else
+					atom += *p++;
+				}
+
+			if ( *p )
+				++p;
+			break;
+
+		case '\\':
+			if ( ! p[1] )
+				return "";
+
+			++p;
+			atom = char(expand_escape(p));
+			break;
+
+		default:
+			atom = *p++;
+		}
+
+		int min = quantifier(p);
+
+		if ( ! is_literal || min == 0 )
+			{
+			// The item may be missing or may be more than a
+			// fixed string, so the literal ends before it.
+			if ( current.size() > best.size() )
+				best = current;
+
+			current.clear();
+			}
+
+		else
+			{
+			current += atom;
+
+			if ( min > 0 )
+				{
+				// Repeated; what follows may not come right
+				// after the first instance.
+				if ( current.size() > best.size() )
+					best = current;
+
+				current.clear();
+				}
+			}
+
+		// Another quantifier right away would make things
+		// complicated.
+		if ( min >= 0 && quantifier(p) >= 0 )
+			return "";
+		}
+
+	if ( current.size() > best.size() )
+		best = current;
+
+	return best;
+	}
+
+LiteralMatcher::LiteralMatcher()
+	{
+	num_literals = 0;
+	num_classes = 1;
+
+	for ( int i = 0; i < 256; ++i )
+		{
+		byte_class[i] = 0;
+		starts_literal[i] = false;
+		}
+	}
+
+void LiteralMatcher::Add(const std::string& literal, int id)
+	{
+	if ( literal.empty() )
+		return;
+
+	literals.push_back(literal);
+	literal_ids.push_back(id);
+	++num_literals;
+	}
+
+void LiteralMatcher::Compile()
+	{
+	// Bytes not in any literal all go to class 0.
+	for ( unsigned int i = 0; i < literals.size(); ++i )
+		for ( unsigned int j = 0; j < literals[i].size(); ++j )
+			{
+			u_char c = literals[i][j];
+
+			if ( ! byte_class[c] )
+				byte_class[c] = num_classes++;
+			}
+
+	// Build the trie, with 0 marking missing children.
+	std::vector<int> trie(num_classes, 0);
+	outputs.clear();
+	outputs.push_back(std::vector<int>());
+
+	for ( unsigned int i = 0; i < literals.size(); ++i )
+		{
+		int s = 0;
+
+		for ( unsigned int j = 0; j < literals[i].size(); ++j )
+			{
+			u_char c = literals[i][j];
+			int cls = byte_class[c];
+
+			if ( j == 0 )
+				starts_literal[c] = true;
+
+			if ( ! trie[s * num_classes + cls] )
+				{
+				trie[s * num_classes + cls] = outputs.size();
+				outputs.push_back(std::vector<int>());
+				trie.resize(outputs.size() * num_classes, 0);
+				}
+
+			s = trie[s * num_classes + cls];
+			}
+
+		outputs[s].push_back(literal_ids[i]);
+		}
+
+	// Turn the trie into the full automaton, going breadth-first to
+	// follow the failure links.
+	int num_states = outputs.size();
+	std::vector<int> fail(num_states, 0);
+	xtions = trie;
+
+	std::queue<int> todo;
+
+	for ( int cls = 0; cls < num_classes; ++cls )
+		{
+		int next = trie[cls];
+
+		if ( next )
+			todo.push(next);
+		}
+
+	while ( ! todo.empty() )
+		{
+		int s = todo.front();
+		todo.pop();
+
+		const std::vector<int>& fail_out = outputs[fail[s]];
+		outputs[s].insert(outputs[s].end(), fail_out.begin(), fail_out.end());
+
+		for ( int cls = 0; cls < num_classes; ++cls )
+			{
+			int next = trie[s * num_classes + cls];
+			int fallback = xtions[fail[s] * num_classes + cls];
+
+			if ( next )
+				{
+				fail[next] = fallback;
+				todo.push(next);
+				}
+			else
+				xtions[s * num_classes + cls] = fallback;
+			}
+		}
+
+	literals.clear();
+	literal_ids.clear();
+	}
+
+int LiteralMatcher::Scan(int state, const u_char* data, int len,
+				std::vector<int>* ids) const
+	{
+	const u_char* end = data + len;
+
+	while ( data < end )
+		{
+		if ( state == 0 )
+			{
+			// Nothing in progress, so skip to where a literal
+			// may start.
+			while ( data < end && ! starts_literal[*data] )
+				++data;
+
+			if ( data == end )
+				break;
+			}
+
+		state = xtions[state * num_classes + byte_class[*data++]];
+
+		const std::vector<int>& out = outputs[state];
+
+		if ( ! out.empty() )
+			ids->insert(ids->end(), out.begin(), out.end());
+		}
+
+	return state;
+	}
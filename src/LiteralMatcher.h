@@ -0,0 +1,61 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Multi-literal string search used to prefilter signature matching.
+// A signature's patterns often contain literal strings that any match
+// needs to include. Scanning for all of them at once is much cheaper than
+// running the combined regular expressions, so the RuleMatcher defers
+// running a pattern set's DFA until one of its literals shows up.
+//
+// The search is an Aho-Corasick automaton with a full transition table
+// over byte classes (bytes not occurring in any literal share a class),
+// so that scanning costs one table lookup per byte. While in the initial
+// state, we skip ahead to the next byte that can start a literal.
+
+#ifndef literal_matcher_h
+#define literal_matcher_h
+
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+// Returns the longest literal string that all matches of the given
+// pattern (in the syntax of re-scan.l) contain, or an empty string if we
+// can't tell. This errs on the side of returning less.
+extern std::string required_literal(const char* pattern);
+
+class LiteralMatcher {
+public:
+	LiteralMatcher();
+
+	// Adds a literal to search for, identified by the given ID.
+	// Multiple literals may share an ID.
+	void Add(const std::string& literal, int id);
+
+	// Builds the automaton. Needs to be called after adding all
+	// literals and before scanning.
+	void Compile();
+
+	int NumLiterals() const	{ return num_literals; }
+	int NumStates() const	{ return outputs.size(); }
+
+	// Scans the data, continuing from the given state, which is zero
+	// at the start of a stream. Appends the IDs of the literals found
+	// to ids (possibly multiple times) and returns the state to
+	// continue from.
+	int Scan(int state, const u_char* data, int len,
+			std::vector<int>* ids) const;
+
+private:
+	int num_literals;
+	int num_classes;
+	int byte_class[256];
+	bool starts_literal[256];
+
+	std::vector<int> xtions;	// NumStates() x num_classes
+	std::vector<std::vector<int> > outputs;	// IDs found in each state
+	std::vector<std::string> literals;
+	std::vector<int> literal_ids;
+};
+
+#endif
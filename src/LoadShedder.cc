@@ -0,0 +1,183 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include "LoadShedder.h"
+#include "Conn.h"
+#include "Event.h"
+#include "Metrics.h"
+#include "Net.h"
+#include "NetVar.h"
+#include "Var.h"
+#include "iosource/Manager.h"
+#include "iosource/PktSrc.h"
+
+LoadShedder* load_shedder = 0;
+
+static double shedding_active()
+	{
+	return load_shedder && load_shedder->Active() ? 1 : 0;
+	}
+
+static double shedding_activations()
+	{
+	return load_shedder ? load_shedder->NumActivations() : 0;
+	}
+
+static uint64 port_key(uint32 port, TransportProto proto)
+	{
+	return (uint64(proto) << 32) | port;
+	}
+
+LoadShedder* LoadShedder::Create()
+	{
+	if ( internal_const_val("LoadShedding::max_lag")->AsInterval() <= 0 &&
+	     internal_const_val("LoadShedding::max_queued_events")->AsCount() == 0 &&
+	     internal_const_val("LoadShedding::max_drop_fraction")->AsDouble() <= 0 )
+		return 0;
+
+	return new LoadShedder();
+	}
+
+LoadShedder::LoadShedder()
+	{
+	check_interval = internal_const_val("LoadShedding::check_interval")->AsInterval();
+	max_lag = internal_const_val("LoadShedding::max_lag")->AsInterval();
+	max_queued_events = internal_const_val("LoadShedding::max_queued_events")->AsCount();
+	max_drop_fraction = internal_const_val("LoadShedding::max_drop_fraction")->AsDouble();
+	recovery_checks = internal_const_val("LoadShedding::recovery_checks")->AsCount();
+	shunt_bytes = internal_const_val("LoadShedding::shunt_bytes")->AsCount();
+
+	double rate = internal_const_val("LoadShedding::new_flow_sample_rate")->AsDouble();
+
+	if ( rate >= 1 )
+		flow_sample_threshold = uint64(1) << 32;
+	else if ( rate <= 0 )
+		flow_sample_threshold = 0;
+	else
+		flow_sample_threshold = uint64(rate * 4294967296.0);
+
+	ListVal* lv = internal_const_val("LoadShedding::shed_ports")->AsTableVal()->ConvertToPureList();
+
+	for ( int i = 0; i < lv->Length(); ++i )
+		{
+		PortVal* p = lv->Index(i)->AsPortVal();
+		shed_ports.insert(port_key(p->Port(), p->PortType()));
+		}
+
+	Unref(lv);
+
+	active = false;
+	good_checks = 0;
+	next_check = 0;
+	max_queued_events_seen = 0;
+	last_received = last_dropped = 0;
+	num_activations = 0;
+
+	metrics::registry()->NewCallbackGauge("load_shedding.active",
+					      "Whether Bro is shedding load right now.",
+					      shedding_active);
+	metrics::registry()->NewCallbackCounter("load_shedding.activations",
+						"How many times Bro started shedding load.",
+						shedding_activations);
+	}
+
+bool LoadShedder::AdmitConnection(uint32 resp_port, TransportProto proto,
+				  uint32 flow_hash) const
+	{
+	if ( ! shed_ports.empty() &&
+	     shed_ports.find(port_key(resp_port, proto)) != shed_ports.end() )
+		return false;
+
+	return flow_hash < flow_sample_threshold;
+	}
+
+bool LoadShedder::ShuntConnection(const Connection* c) const
+	{
+	return shunt_bytes && c->IPBytes() > shunt_bytes;
+	}
+
+void LoadShedder::Check(double t)
+	{
+	bool first = (next_check == 0);
+	next_check = t + check_interval;
+
+	double lag = 0;
+
+	if ( reading_live && ! pseudo_realtime )
+		lag = current_time() - network_time;
+
+	uint64 received = 0;
+	uint64 dropped = 0;
+
+	const iosource::Manager::PktSrcList& srcs = iosource_mgr->GetPktSrcs();
+
+	for ( iosource::Manager::PktSrcList::const_iterator i = srcs.begin();
+	      i != srcs.end(); ++i )
+		{
+		iosource::PktSrc::Stats s;
+		(*i)->Statistics(&s);
+		received += s.received;
+		dropped += s.dropped;
+		}
+
+	// The counters may wrap, or start over with a new source.
+	uint64 new_received = received >= last_received ? received - last_received : received;
+	uint64 new_dropped = dropped >= last_dropped ? dropped - last_dropped : dropped;
+	last_received = received;
+	last_dropped = dropped;
+
+	double drop_fraction = 0;
+
+	if ( new_received + new_dropped > 0 )
+		drop_fraction = double(new_dropped) / (new_received + new_dropped);
+
+	int queued = max_queued_events_seen;
+	max_queued_events_seen = 0;
+
+	// The first check only sets the baselines; the counters cover the
+	// time before we started.
+	if ( first )
+		return;
+
+	const char* reason = 0;
+
+	if ( max_lag > 0 && lag > max_lag )
+		reason = "processing lag";
+	else if ( max_queued_events && queued >= max_queued_events )
+		reason = "event queue";
+	else if ( max_drop_fraction > 0 && drop_fraction > max_drop_fraction )
+		reason = "packet drops";
+
+	if ( reason )
+		{
+		good_checks = 0;
+
+		if ( active )
+			return;
+
+		active = true;
+		++num_activations;
+		}
+
+	else
+		{
+		if ( ! active || ++good_checks < recovery_checks )
+			return;
+
+		active = false;
+		good_checks = 0;
+		reason = "";
+		}
+
+	if ( load_shedding_changed )
+		{
+		val_list* vl = new val_list(5);
+		vl->append(new Val(active, TYPE_BOOL));
+		vl->append(new StringVal(reason));
+		vl->append(new Val(lag, TYPE_INTERVAL));
+		vl->append(new Val(queued, TYPE_COUNT));
+		vl->append(new Val(drop_fraction, TYPE_DOUBLE));
+		mgr.QueueEvent(load_shedding_changed, vl);
+		}
+	}
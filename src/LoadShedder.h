@@ -0,0 +1,102 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef loadshedder_h
+#define loadshedder_h
+
+#include <set>
+
+#include "util.h"
+#include "net_util.h"
+
+class Connection;
+
+/**
+ * Watches whether Bro keeps up with its input, and while it doesn't, sheds
+ * load in the ways that the LoadShedding options configure: refusing new
+ * connections to some ports, sampling new connections, and bypassing large
+ * ones. Rather than the kernel dropping packets of all connections, that
+ * keeps the ones which get analyzed complete.
+ */
+class LoadShedder {
+public:
+	/**
+	 * Returns a new instance if any of the limits is set, or null
+	 * otherwise.
+	 */
+	static LoadShedder* Create();
+
+	~LoadShedder()	{ }
+
+	/**
+	 * Notes a packet, before draining the events it queued. Once per
+	 * *check_interval*, this checks the load.
+	 *
+	 * @param t The packet's time.
+	 *
+	 * @param queued_events The number of events waiting.
+	 */
+	void NextPacket(double t, int queued_events)
+		{
+		if ( queued_events > max_queued_events_seen )
+			max_queued_events_seen = queued_events;
+
+		if ( t >= next_check )
+			Check(t);
+		}
+
+	/**
+	 * Returns true while shedding load.
+	 */
+	bool Active() const	{ return active; }
+
+	/**
+	 * Returns whether to create a new connection while shedding load.
+	 *
+	 * @param resp_port The responder's port, in host order.
+	 *
+	 * @param proto The transport protocol.
+	 *
+	 * @param flow_hash A hash of the connection's endpoints that doesn't
+	 * depend on their direction.
+	 */
+	bool AdmitConnection(uint32 resp_port, TransportProto proto,
+			     uint32 flow_hash) const;
+
+	/**
+	 * Returns whether to bypass an existing connection while shedding
+	 * load.
+	 */
+	bool ShuntConnection(const Connection* c) const;
+
+	/**
+	 * Returns how many times shedding started so far.
+	 */
+	uint64 NumActivations() const	{ return num_activations; }
+
+private:
+	LoadShedder();
+
+	void Check(double t);
+
+	// Options.
+	double check_interval;
+	double max_lag;
+	int max_queued_events;
+	double max_drop_fraction;
+	int recovery_checks;
+	std::set<uint64> shed_ports;	// protocol in the upper half
+	uint64 flow_sample_threshold;	// admits flow hashes below it
+	uint64 shunt_bytes;
+
+	bool active;
+	int good_checks;	// consecutive ones since the last bad
+	double next_check;
+	int max_queued_events_seen;
+	uint64 last_received;
+	uint64 last_dropped;
+	uint64 num_activations;
+};
+
+extern LoadShedder* load_shedder;
+
+#endif
@@ -0,0 +1,258 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Metrics.h"
+
+using namespace metrics;
+
+__thread std::atomic<uint64>* Registry::tls_slots = 0;
+
+double Metric::Value() const
+	{
+	return Sum(0);
+	}
+
+uint64 Metric::Sum(int i) const
+	{
+	return registry()->Sum(slot + i);
+	}
+
+double Gauge::Value() const
+	{
+	return int64(Sum(0));
+	}
+
+double Histogram::Value() const
+	{
+	uint64 n = 0;
+
+	for ( size_t i = 0; i <= bounds.size(); ++i )
+		n += BucketCount(i);
+
+	return n;
+	}
+
+uint64 Histogram::Quantile(double q) const
+	{
+	std::vector<uint64> counts;
+	uint64 n = 0;
+
+	for ( size_t i = 0; i <= bounds.size(); ++i )
+		{
+		counts.push_back(BucketCount(i));
+		n += counts.back();
+		}
+
+	if ( n == 0 || bounds.empty() )
+		return 0;
+
+	uint64 rank = uint64(q * n);
+	uint64 seen = 0;
+
+	for ( size_t i = 0; i < bounds.size(); ++i )
+		{
+		seen += counts[i];
+
+		if ( seen > rank )
+			return bounds[i];
+		}
+
+	return bounds.back();
+	}
+
+Registry::Registry()
+	{
+	num_slots = 0;
+	memset(retired, 0, sizeof(retired));
+	pthread_mutex_init(&mutex, 0);
+	pthread_key_create(&key, RetireThread);
+	}
+
+Metric* Registry::Find(const std::string& name, Kind kind) const
+	{
+	std::map<std::string, Metric*>::const_iterator i = metrics.find(name);
+
+	if ( i == metrics.end() )
+		return 0;
+
+	if ( i->second->GetKind() != kind )
+		{
+		// This is a programming error, and we may be running before
+		// the reporter exists.
+		fprintf(stderr, "metric %s registered with different kinds\n",
+			name.c_str());
+		abort();
+		}
+
+	return i->second;
+	}
+
+void Registry::Add(Metric* m, int n)
+	{
+	if ( num_slots + n > MAX_SLOTS )
+		{
+		fprintf(stderr, "too many metrics, can't register %s\n",
+			m->Name().c_str());
+		abort();
+		}
+
+	m->slot = num_slots;
+	num_slots += n;
+	metrics[m->Name()] = m;
+	}
+
+Counter* Registry::NewCounter(const std::string& name, const std::string& help)
+	{
+	pthread_mutex_lock(&mutex);
+
+	Counter* c = (Counter*) Find(name, COUNTER);
+
+	if ( ! c )
+		{
+		c = new Counter(name, help);
+		Add(c, 1);
+		}
+
+	pthread_mutex_unlock(&mutex);
+	return c;
+	}
+
+Gauge* Registry::NewGauge(const std::string& name, const std::string& help)
+	{
+	pthread_mutex_lock(&mutex);
+
+	Gauge* g = (Gauge*) Find(name, GAUGE);
+
+	if ( ! g )
+		{
+		g = new Gauge(name, help);
+		Add(g, 1);
+		}
+
+	pthread_mutex_unlock(&mutex);
+	return g;
+	}
+
+CallbackMetric* Registry::NewCallback(Kind kind, const std::string& name,
+				const std::string& help,
+				CallbackMetric::callback func)
+	{
+	pthread_mutex_lock(&mutex);
+
+	CallbackMetric* m = (CallbackMetric*) Find(name, kind);
+
+	if ( ! m )
+		{
+		m = new CallbackMetric(kind, name, help, func);
+		Add(m, 0);
+		}
+
+	pthread_mutex_unlock(&mutex);
+	return m;
+	}
+
+CallbackMetric* Registry::NewCallbackCounter(const std::string& name,
+					const std::string& help,
+					CallbackMetric::callback func)
+	{
+	return NewCallback(COUNTER, name, help, func);
+	}
+
+CallbackMetric* Registry::NewCallbackGauge(const std::string& name,
+					const std::string& help,
+					CallbackMetric::callback func)
+	{
+	return NewCallback(GAUGE, name, help, func);
+	}
+
+Histogram* Registry::NewHistogram(const std::string& name,
+				const std::string& help,
+				const std::vector<uint64>& bounds)
+	{
+	pthread_mutex_lock(&mutex);
+
+	Histogram* h = (Histogram*) Find(name, HISTOGRAM);
+
+	if ( ! h )
+		{
+		h = new Histogram(name, help, bounds);
+
+		// The sum, then one per bucket.
+		Add(h, 1 + bounds.size() + 1);
+		}
+
+	pthread_mutex_unlock(&mutex);
+	return h;
+	}
+
+std::atomic<uint64>* Registry::NewThreadSlots()
+	{
+	std::atomic<uint64>* slots = new std::atomic<uint64>[MAX_SLOTS];
+
+	for ( int i = 0; i < MAX_SLOTS; ++i )
+		slots[i].store(0, std::memory_order_relaxed);
+
+	pthread_mutex_lock(&mutex);
+	threads.push_back(slots);
+	pthread_mutex_unlock(&mutex);
+
+	// Gets the slots back to RetireThread() when the thread ends.
+	pthread_setspecific(key, slots);
+	tls_slots = slots;
+
+	return slots;
+	}
+
+void Registry::RetireThread(void* arg)
+	{
+	std::atomic<uint64>* slots = (std::atomic<uint64>*) arg;
+	Registry* r = registry();
+
+	pthread_mutex_lock(&r->mutex);
+
+	for ( int i = 0; i < MAX_SLOTS; ++i )
+		r->retired[i] += slots[i].load(std::memory_order_relaxed);
+
+	for ( size_t i = 0; i < r->threads.size(); ++i )
+		{
+		if ( r->threads[i] == slots )
+			{
+			r->threads.erase(r->threads.begin() + i);
+			break;
+			}
+		}
+
+	pthread_mutex_unlock(&r->mutex);
+
+	// In case another thread-specific destructor still updates a
+	// metric, which then gets a fresh copy.
+	tls_slots = 0;
+	delete [] slots;
+	}
+
+uint64 Registry::Sum(int slot) const
+	{
+	pthread_mutex_lock(&mutex);
+
+	uint64 sum = retired[slot];
+
+	for ( size_t i = 0; i < threads.size(); ++i )
+		sum += threads[i][slot].load(std::memory_order_relaxed);
+
+	pthread_mutex_unlock(&mutex);
+
+	return sum;
+	}
+
+Registry* metrics::registry()
+	{
+	// Never deleted, so that metrics stay usable from other objects'
+	// destructors at exit.
+	static Registry* r = new Registry();
+	return r;
+	}
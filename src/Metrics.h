@@ -0,0 +1,270 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef metrics_h
+#define metrics_h
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "util.h"
+
+/**
+ * A registry of named counters, gauges, and histograms that core
+ * subsystems update on their hot paths. Updates are cheap: each thread
+ * keeps its own copy of every metric's values, which it alone writes to
+ * (without atomic read-modify-write instructions or locks), and the
+ * registry adds them up only when asked for a snapshot.
+ *
+ * Subsystems usually get their handles once, at static initialization:
+ *
+ *     static metrics::Counter* packets =
+ *         metrics::registry()->NewCounter("sessions.packets",
+ *                                         "Packets processed.");
+ *     ...
+ *     packets->Inc();
+ *
+ * Registering a name that exists already returns the existing metric,
+ * so that several instances of a class can share one.
+ */
+namespace metrics {
+
+enum Kind { COUNTER, GAUGE, HISTOGRAM };
+
+class Registry;
+
+/**
+ * Base class for the metrics.
+ */
+class Metric {
+public:
+	virtual ~Metric()	{ }
+
+	const std::string& Name() const	{ return name; }
+	const std::string& Help() const	{ return help; }
+	Kind GetKind() const	{ return kind; }
+
+	/**
+	 * Returns the metric's current value, summed up over all threads:
+	 * the total for counters, the level for gauges, and the number of
+	 * observations for histograms.
+	 */
+	virtual double Value() const;
+
+protected:
+	friend class Registry;
+
+	Metric(Kind arg_kind, const std::string& arg_name,
+	       const std::string& arg_help)
+		: name(arg_name), help(arg_help)
+		{ kind = arg_kind; slot = 0; }
+
+	// Adds n to one of the metric's values for the current thread.
+	inline void Add(int i, uint64 n);
+
+	// Returns one of the metric's values, summed up over all threads.
+	uint64 Sum(int i) const;
+
+	std::string name;
+	std::string help;
+	Kind kind;
+	int slot;	// first of the values in the threads' slot arrays
+};
+
+/**
+ * A count of events that only ever goes up.
+ */
+class Counter : public Metric {
+public:
+	void Inc(uint64 n = 1)	{ Add(0, n); }
+
+protected:
+	friend class Registry;
+
+	Counter(const std::string& name, const std::string& help)
+		: Metric(COUNTER, name, help)	{ }
+};
+
+/**
+ * A level that goes up and down, such as a queue's length. It's the sum of
+ * all threads' increments and decrements.
+ */
+class Gauge : public Metric {
+public:
+	void Inc(int64 n = 1)	{ Add(0, uint64(n)); }
+	void Dec(int64 n = 1)	{ Add(0, uint64(-n)); }
+
+	virtual double Value() const;
+
+protected:
+	friend class Registry;
+
+	Gauge(const std::string& name, const std::string& help)
+		: Metric(GAUGE, name, help)	{ }
+};
+
+/**
+ * A counter or gauge whose value comes from a function that gets called
+ * when taking a snapshot, for values that a subsystem tracks anyway.
+ */
+class CallbackMetric : public Metric {
+public:
+	typedef double (*callback)();
+
+	virtual double Value() const	{ return func(); }
+
+protected:
+	friend class Registry;
+
+	CallbackMetric(Kind kind, const std::string& name,
+		       const std::string& help, callback arg_func)
+		: Metric(kind, name, help)	{ func = arg_func; }
+
+	callback func;
+};
+
+/**
+ * A distribution of observed values, counted into buckets with fixed upper
+ * bounds.
+ */
+class Histogram : public Metric {
+public:
+	/**
+	 * Records one observation.
+	 */
+	void Observe(uint64 v)
+		{
+		size_t i = 0;
+
+		while ( i < bounds.size() && v > bounds[i] )
+			++i;
+
+		Add(1 + i, 1);
+		Add(0, v);
+		}
+
+	/**
+	 * Returns the bucket bounds; the last bucket, beyond them, is
+	 * unbounded.
+	 */
+	const std::vector<uint64>& Bounds() const	{ return bounds; }
+
+	/**
+	 * Returns the number of observations in bucket i, summed over all
+	 * threads.
+	 */
+	uint64 BucketCount(int i) const	{ return Sum(1 + i); }
+
+	/**
+	 * Returns the sum of all observations.
+	 */
+	uint64 Total() const	{ return Sum(0); }
+
+	/**
+	 * Estimates the q'th quantile as the upper bound of the bucket it
+	 * falls into (or the last bound, if it's beyond them).
+	 */
+	uint64 Quantile(double q) const;
+
+	virtual double Value() const;
+
+protected:
+	friend class Registry;
+
+	Histogram(const std::string& name, const std::string& help,
+		  const std::vector<uint64>& arg_bounds)
+		: Metric(HISTOGRAM, name, help), bounds(arg_bounds)	{ }
+
+	std::vector<uint64> bounds;
+};
+
+/**
+ * The registry of all metrics.
+ */
+class Registry {
+public:
+	Registry();
+
+	Counter* NewCounter(const std::string& name, const std::string& help);
+	Gauge* NewGauge(const std::string& name, const std::string& help);
+	CallbackMetric* NewCallbackCounter(const std::string& name,
+					   const std::string& help,
+					   CallbackMetric::callback func);
+	CallbackMetric* NewCallbackGauge(const std::string& name,
+					 const std::string& help,
+					 CallbackMetric::callback func);
+
+	/**
+	 * @param bounds The buckets' upper bounds, in increasing order.
+	 */
+	Histogram* NewHistogram(const std::string& name, const std::string& help,
+				const std::vector<uint64>& bounds);
+
+	/**
+	 * Returns all metrics, ordered by name.
+	 */
+	const std::map<std::string, Metric*>& Metrics() const
+		{ return metrics; }
+
+	// The most values that metrics may take up in total.
+	static const int MAX_SLOTS = 4096;
+
+protected:
+	friend class Metric;
+
+	// Looks up a metric of the given kind, making sure that it isn't
+	// registered as another one.
+	Metric* Find(const std::string& name, Kind kind) const;
+
+	void Add(Metric* m, int num_slots);
+
+	CallbackMetric* NewCallback(Kind kind, const std::string& name,
+				    const std::string& help,
+				    CallbackMetric::callback func);
+
+	// Sets up the current thread's copy of the values.
+	std::atomic<uint64>* NewThreadSlots();
+
+	uint64 Sum(int slot) const;
+
+	// Folds a terminating thread's values into the retired ones.
+	static void RetireThread(void* arg);
+
+	// The current thread's copy of the values, or null if it hasn't
+	// updated any metric yet.
+	static __thread std::atomic<uint64>* tls_slots;
+
+	std::map<std::string, Metric*> metrics;
+	int num_slots;
+
+	mutable pthread_mutex_t mutex;
+	pthread_key_t key;
+	std::vector<std::atomic<uint64>*> threads;
+	uint64 retired[MAX_SLOTS];
+};
+
+/**
+ * Returns the registry. It comes into existence on first use, so this is
+ * safe to call from static initializers.
+ */
+Registry* registry();
+
+inline void Metric::Add(int i, uint64 n)
+	{
+	std::atomic<uint64>* slots = Registry::tls_slots;
+
+	if ( ! slots )
+		slots = registry()->NewThreadSlots();
+
+	// Only this thread writes to its slot, so a plain load and store
+	// suffice; they're atomic just so that snapshots read whole values.
+	std::atomic<uint64>& s = slots[slot + i];
+	s.store(s.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+}
+
+#endif
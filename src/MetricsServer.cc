@@ -0,0 +1,513 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "MetricsServer.h"
+#include "Metrics.h"
+#include "Reporter.h"
+#include "Timer.h"
+#include "modp_numtoa.h"
+#include "iosource/Manager.h"
+#include "iosource/PktSrc.h"
+#include "threading/Manager.h"
+#include "analyzer/Manager.h"
+
+MetricsServer* metrics_server = 0;
+
+// Turns a registry name like "sessions.packets" into a valid Prometheus
+// one, "bro_sessions_packets".
+static std::string metric_name(const std::string& name)
+	{
+	std::string n("bro_");
+
+	for ( size_t i = 0; i < name.size(); ++i )
+		n += isalnum(name[i]) ? name[i] : '_';
+
+	return n;
+	}
+
+static std::string escape(const std::string& s, bool quotes)
+	{
+	std::string e;
+
+	for ( size_t i = 0; i < s.size(); ++i )
+		{
+		if ( s[i] == '\\' )
+			e += "\\\\";
+		else if ( s[i] == '\n' )
+			e += "\\n";
+		else if ( s[i] == '"' && quotes )
+			e += "\\\"";
+		else
+			e += s[i];
+		}
+
+	return e;
+	}
+
+static void add_header(std::string* out, const std::string& name,
+			const char* type, const std::string& help)
+	{
+	*out += "# HELP " + name + " " + escape(help, false) + "\n";
+	*out += "# TYPE " + name + " " + type + "\n";
+	}
+
+static void add_sample(std::string* out, const std::string& name,
+			const std::string& labels, double value)
+	{
+	*out += name;
+
+	if ( labels.size() )
+		*out += "{" + labels + "}";
+
+	*out += fmt(" %.17g\n", value);
+	}
+
+static std::string label(const char* name, const std::string& value)
+	{
+	return std::string(name) + "=\"" + escape(value, true) + "\"";
+	}
+
+static void render_registry(std::string* out)
+	{
+	const std::map<std::string, metrics::Metric*>& all =
+		metrics::registry()->Metrics();
+
+	for ( std::map<std::string, metrics::Metric*>::const_iterator i = all.begin();
+	      i != all.end(); ++i )
+		{
+		const metrics::Metric* m = i->second;
+		std::string name = metric_name(m->Name());
+
+		switch ( m->GetKind() ) {
+		case metrics::COUNTER:
+			name += "_total";
+			add_header(out, name, "counter", m->Help());
+			add_sample(out, name, "", m->Value());
+			break;
+
+		case metrics::GAUGE:
+			add_header(out, name, "gauge", m->Help());
+			add_sample(out, name, "", m->Value());
+			break;
+
+		case metrics::HISTOGRAM:
+			{
+			const metrics::Histogram* h = (const metrics::Histogram*) m;
+			const std::vector<uint64>& bounds = h->Bounds();
+			uint64 n = 0;
+
+			add_header(out, name, "histogram", m->Help());
+
+			// Prometheus' buckets are cumulative.
+			for ( size_t j = 0; j < bounds.size(); ++j )
+				{
+				char le[32];
+				modp_ulitoa10(bounds[j], le);
+				n += h->BucketCount(j);
+				add_sample(out, name + "_bucket", label("le", le), n);
+				}
+
+			n += h->BucketCount(bounds.size());
+			add_sample(out, name + "_bucket", label("le", "+Inf"), n);
+			add_sample(out, name + "_sum", "", h->Total());
+			add_sample(out, name + "_count", "", n);
+			break;
+			}
+		}
+		}
+	}
+
+static void render_pkt_srcs(std::string* out)
+	{
+	const iosource::Manager::PktSrcList& srcs = iosource_mgr->GetPktSrcs();
+
+	if ( srcs.empty() )
+		return;
+
+	std::vector<iosource::PktSrc::Stats> stats(srcs.size());
+	std::vector<std::string> labels;
+	int n = 0;
+
+	for ( iosource::Manager::PktSrcList::const_iterator i = srcs.begin();
+	      i != srcs.end(); ++i, ++n )
+		{
+		(*i)->Statistics(&stats[n]);
+		labels.push_back(label("source", (*i)->Path()));
+		}
+
+	add_header(out, "bro_pktsrc_received_total", "counter",
+		   "Packets received by the packet source after filtering.");
+	for ( size_t i = 0; i < stats.size(); ++i )
+		add_sample(out, "bro_pktsrc_received_total", labels[i], stats[i].received);
+
+	add_header(out, "bro_pktsrc_dropped_total", "counter",
+		   "Packets the packet source dropped.");
+	for ( size_t i = 0; i < stats.size(); ++i )
+		add_sample(out, "bro_pktsrc_dropped_total", labels[i], stats[i].dropped);
+
+	add_header(out, "bro_pktsrc_link_total", "counter",
+		   "Packets on the link before filtering, where available.");
+	for ( size_t i = 0; i < stats.size(); ++i )
+		add_sample(out, "bro_pktsrc_link_total", labels[i], stats[i].link);
+
+	add_header(out, "bro_pktsrc_received_bytes_total", "counter",
+		   "Bytes received by the packet source after filtering.");
+	for ( size_t i = 0; i < stats.size(); ++i )
+		add_sample(out, "bro_pktsrc_received_bytes_total", labels[i],
+			   stats[i].bytes_received);
+	}
+
+static void render_timers(std::string* out)
+	{
+	const unsigned int* current = TimerMgr::CurrentTimers();
+
+	add_header(out, "bro_timers_active", "gauge",
+		   "Timers currently scheduled, by type.");
+
+	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
+		add_sample(out, "bro_timers_active",
+			   label("type", timer_type_to_string((TimerType) i)),
+			   current[i]);
+	}
+
+static void render_memory(std::string* out)
+	{
+	uint64 total, malloced;
+	get_memory_usage(&total, &malloced);
+
+	add_header(out, "bro_memory_bytes", "gauge",
+		   "Memory in use by the process.");
+	add_sample(out, "bro_memory_bytes", "", total);
+
+	add_header(out, "bro_memory_malloced_bytes", "gauge",
+		   "Memory allocated through malloc(), where available.");
+	add_sample(out, "bro_memory_malloced_bytes", "", malloced);
+	}
+
+static void render_analyzers(std::string* out)
+	{
+	std::list<analyzer::Component*> comps = analyzer_mgr->GetComponents();
+
+	add_header(out, "bro_analyzer_created_total", "counter",
+		   "Analyzer instances created, by type.");
+
+	for ( std::list<analyzer::Component*>::const_iterator i = comps.begin();
+	      i != comps.end(); ++i )
+		add_sample(out, "bro_analyzer_created_total",
+			   label("analyzer", (*i)->CanonicalName()),
+			   analyzer_mgr->NumCreated((*i)->Tag()));
+
+	add_header(out, "bro_analyzer_active", "gauge",
+		   "Analyzer instances currently in use, by type.");
+
+	for ( std::list<analyzer::Component*>::const_iterator i = comps.begin();
+	      i != comps.end(); ++i )
+		add_sample(out, "bro_analyzer_active",
+			   label("analyzer", (*i)->CanonicalName()),
+			   analyzer_mgr->NumActive((*i)->Tag()));
+	}
+
+static void render_threads(std::string* out)
+	{
+	typedef threading::Manager::msg_stats_list msg_stats_list;
+	const msg_stats_list& stats = thread_mgr->GetMsgThreadStats();
+
+	if ( stats.empty() )
+		return;
+
+	add_header(out, "bro_thread_messages_pending", "gauge",
+		   "Messages queued between the main thread and a child thread. "
+		   "For log writers, direction \"in\" is the backlog of writes.");
+
+	for ( msg_stats_list::const_iterator i = stats.begin(); i != stats.end(); ++i )
+		{
+		std::string thread = label("thread", i->first);
+		add_sample(out, "bro_thread_messages_pending",
+			   thread + "," + label("direction", "in"),
+			   i->second.pending_in);
+		add_sample(out, "bro_thread_messages_pending",
+			   thread + "," + label("direction", "out"),
+			   i->second.pending_out);
+		}
+
+	add_header(out, "bro_thread_messages_total", "counter",
+		   "Messages sent between the main thread and a child thread.");
+
+	for ( msg_stats_list::const_iterator i = stats.begin(); i != stats.end(); ++i )
+		{
+		std::string thread = label("thread", i->first);
+		add_sample(out, "bro_thread_messages_total",
+			   thread + "," + label("direction", "in"),
+			   i->second.sent_in);
+		add_sample(out, "bro_thread_messages_total",
+			   thread + "," + label("direction", "out"),
+			   i->second.sent_out);
+		}
+	}
+
+std::string MetricsServer::Render()
+	{
+	std::string out;
+
+	render_registry(&out);
+	render_pkt_srcs(&out);
+	render_timers(&out);
+	render_memory(&out);
+	render_analyzers(&out);
+	render_threads(&out);
+
+	return out;
+	}
+
+MetricsServer::MetricsServer()
+	{
+	// We only ever have something to do when a descriptor is ready.
+	SetIdle(true);
+	}
+
+MetricsServer::~MetricsServer()
+	{
+	for ( size_t i = 0; i < listen_fds.size(); ++i )
+		safe_close(listen_fds[i]);
+
+	for ( std::list<Client*>::iterator i = clients.begin();
+	      i != clients.end(); ++i )
+		{
+		safe_close((*i)->fd);
+		delete *i;
+		}
+	}
+
+static bool set_nonblocking(int fd)
+	{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+	}
+
+bool MetricsServer::Listen(const std::string& addr, uint32 port)
+	{
+	struct addrinfo hints;
+	struct addrinfo* res0;
+	const int on = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+
+	char port_str[16];
+	modp_uitoa10(port, port_str);
+
+	int status = getaddrinfo(addr.size() ? addr.c_str() : 0, port_str,
+				 &hints, &res0);
+
+	if ( status != 0 )
+		{
+		reporter->Error("metrics server: bad address %s: %s",
+				addr.c_str(), gai_strerror(status));
+		return false;
+		}
+
+	for ( struct addrinfo* res = res0; res; res = res->ai_next )
+		{
+		int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+		if ( fd < 0 )
+			{
+			reporter->Error("metrics server: can't create socket: %s",
+					strerror(errno));
+			continue;
+			}
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		// As for communication, don't rely on dual binding.
+		if ( res->ai_family == AF_INET6 )
+			setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+
+		if ( ::bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
+		     listen(fd, 16) < 0 || ! set_nonblocking(fd) )
+			{
+			reporter->Error("metrics server: can't listen on port %s: %s",
+					port_str, strerror(errno));
+			safe_close(fd);
+			continue;
+			}
+
+		listen_fds.push_back(fd);
+		}
+
+	freeaddrinfo(res0);
+
+	return listen_fds.size() > 0;
+	}
+
+void MetricsServer::GetFds(iosource::FD_Set* read, iosource::FD_Set* write,
+			   iosource::FD_Set* except)
+	{
+	for ( size_t i = 0; i < listen_fds.size(); ++i )
+		read->Insert(listen_fds[i]);
+
+	for ( std::list<Client*>::const_iterator i = clients.begin();
+	      i != clients.end(); ++i )
+		{
+		if ( (*i)->response.empty() )
+			read->Insert((*i)->fd);
+		else
+			write->Insert((*i)->fd);
+		}
+	}
+
+double MetricsServer::NextTimestamp(double* network_time)
+	{
+	// Like DNS_Mgr, we don't have timestamps of our own; the main loop
+	// asks only once a descriptor is ready.
+	double t = timer_mgr->Time();
+	return t > 0 ? t : current_time();
+	}
+
+void MetricsServer::Process()
+	{
+	// We don't know which descriptor is ready, but trying all of them is
+	// cheap and won't block.
+	for ( size_t i = 0; i < listen_fds.size(); ++i )
+		Accept(listen_fds[i]);
+
+	double now = current_time();
+
+	for ( std::list<Client*>::iterator i = clients.begin(); i != clients.end(); )
+		{
+		Client* c = *i;
+
+		if ( Serve(c) && now - c->start < CLIENT_TIMEOUT )
+			{
+			++i;
+			continue;
+			}
+
+		safe_close(c->fd);
+		delete c;
+		i = clients.erase(i);
+		}
+	}
+
+void MetricsServer::Accept(int listen_fd)
+	{
+	while ( true )
+		{
+		int fd = accept(listen_fd, 0, 0);
+
+		if ( fd < 0 )
+			{
+			if ( errno != EAGAIN && errno != EWOULDBLOCK &&
+			     errno != EINTR && errno != ECONNABORTED )
+				reporter->Error("metrics server: accept failed: %s",
+						strerror(errno));
+			return;
+			}
+
+		if ( clients.size() >= MAX_CLIENTS || ! set_nonblocking(fd) )
+			{
+			safe_close(fd);
+			continue;
+			}
+
+		Client* c = new Client;
+		c->fd = fd;
+		c->start = current_time();
+		c->sent = 0;
+		clients.push_back(c);
+		}
+	}
+
+bool MetricsServer::Serve(Client* c)
+	{
+	while ( c->response.empty() )
+		{
+		char buf[1024];
+		ssize_t n = read(c->fd, buf, sizeof(buf));
+
+		if ( n == 0 )
+			return false;
+
+		if ( n < 0 )
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+		c->request.append(buf, n);
+
+		if ( c->request.find("\r\n\r\n") != std::string::npos ||
+		     c->request.find("\n\n") != std::string::npos ||
+		     c->request.size() > MAX_REQUEST_SIZE )
+			c->response = Respond(c->request);
+		}
+
+	while ( c->sent < c->response.size() )
+		{
+		ssize_t n = write(c->fd, c->response.data() + c->sent,
+				  c->response.size() - c->sent);
+
+		if ( n < 0 )
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+		c->sent += n;
+		}
+
+	// All written; we close the connection after each response.
+	return false;
+	}
+
+static std::string http_response(const char* status, const char* content_type,
+				 const std::string& body, bool with_body)
+	{
+	return fmt("HTTP/1.0 %s\r\n"
+		   "Content-Type: %s\r\n"
+		   "Content-Length: %zu\r\n"
+		   "Connection: close\r\n"
+		   "\r\n", status, content_type, body.size()) +
+		(with_body ? body : std::string());
+	}
+
+std::string MetricsServer::Respond(const std::string& request)
+	{
+	if ( request.size() > MAX_REQUEST_SIZE )
+		return http_response("413 Request Entity Too Large", "text/plain",
+				     "request too large\n", true);
+
+	// Request line: method, target, version.
+	std::string line = request.substr(0, request.find_first_of("\r\n"));
+	size_t sp1 = line.find(' ');
+	size_t sp2 = line.find(' ', sp1 + 1);
+
+	if ( sp1 == std::string::npos || sp2 == std::string::npos )
+		return http_response("400 Bad Request", "text/plain",
+				     "bad request\n", true);
+
+	std::string method = line.substr(0, sp1);
+	std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+	target = target.substr(0, target.find('?'));
+
+	bool head = (method == "HEAD");
+
+	if ( method != "GET" && ! head )
+		return http_response("405 Method Not Allowed", "text/plain",
+				     "only GET is supported\n", true);
+
+	if ( target != "/metrics" )
+		return http_response("404 Not Found", "text/plain",
+				     "metrics are at /metrics\n", ! head);
+
+	return http_response("200 OK", "text/plain; version=0.0.4",
+			     Render(), ! head);
+	}
@@ -0,0 +1,94 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef metricsserver_h
+#define metricsserver_h
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "iosource/IOSource.h"
+
+/**
+ * A minimal HTTP server that answers ``GET /metrics`` with Bro's current
+ * metrics in the Prometheus text exposition format, so that monitoring
+ * systems can scrape each process directly. It's an IOSource, with all
+ * sockets non-blocking, so a slow client never holds up packet
+ * processing; the main loop gets to it only when one of its descriptors
+ * is ready.
+ *
+ * Besides everything in the metrics::Registry, the output includes the
+ * packet sources' statistics, timer counts by type, memory usage, the
+ * analyzers' instance counts, and the threads' message queue depths
+ * (which for log writers is their backlog of pending writes).
+ */
+class MetricsServer : public iosource::IOSource {
+public:
+	/**
+	 * Constructor.
+	 */
+	MetricsServer();
+
+	/**
+	 * Destructor. Closes all sockets.
+	 */
+	virtual ~MetricsServer();
+
+	/**
+	 * Starts listening.
+	 *
+	 * @param addr The address to listen on; empty for all of them.
+	 *
+	 * @param port The TCP port to listen on.
+	 *
+	 * @return True if listening on at least one address; otherwise the
+	 * errors went to the reporter.
+	 */
+	bool Listen(const std::string& addr, uint32 port);
+
+	/**
+	 * Returns the current metrics in the Prometheus text format.
+	 */
+	static std::string Render();
+
+	// IOSource interface.
+	virtual void GetFds(iosource::FD_Set* read, iosource::FD_Set* write,
+	                    iosource::FD_Set* except);
+	virtual double NextTimestamp(double* network_time);
+	virtual void Process();
+	virtual const char* Tag()	{ return "MetricsServer"; }
+
+protected:
+	struct Client {
+		int fd;
+		double start;		// when accepted, for timing out
+		std::string request;	// received so far
+		std::string response;	// once the request is complete
+		size_t sent;		// bytes of response written so far
+	};
+
+	void Accept(int fd);
+
+	// Reads or writes what's possible without blocking. Returns false
+	// once the client is done with.
+	bool Serve(Client* c);
+
+	// Builds the response to a complete request.
+	static std::string Respond(const std::string& request);
+
+	// Most concurrent clients; more get turned away.
+	static const size_t MAX_CLIENTS = 16;
+
+	// Longest request we accept.
+	static const size_t MAX_REQUEST_SIZE = 8192;
+
+	// Seconds a client gets to send its request and take the response.
+	static const int CLIENT_TIMEOUT = 10;
+
+	std::vector<int> listen_fds;
+	std::list<Client*> clients;
+};
+
+extern MetricsServer* metrics_server;
+
+#endif
@@ -2,6 +2,9 @@
 
 #include "bro-config.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "NFA.h"
 #include "EquivClass.h"
 
@@ -207,6 +210,35 @@ void NFA_Machine::LinkCopies(int n)
 	delete [] copies;
 	}
 
+int NFA_Machine::NumStates() const
+	{
+	NFA_state_list states;
+	states.append(first_state);
+	first_state->SetMark(first_state);
+
+	int i;
+	for ( i = 0; i < states.length(); ++i )
+		{
+		NFA_state_list* x = states[i]->Transitions();
+
+		for ( int j = 0; j < x->length(); ++j )
+			{
+			NFA_State* nxt = (*x)[j];
+
+			if ( ! nxt->Mark() )
+				{
+				states.append(nxt);
+				nxt->SetMark(nxt);
+				}
+			}
+		}
+
+	for ( i = 0; i < states.length(); ++i )
+		states[i]->SetMark(0);
+
+	return states.length();
+	}
+
 NFA_Machine* NFA_Machine::DuplicateMachine()
 	{
 	NFA_State* new_first_state = first_state->DeepCopy();
@@ -262,18 +294,31 @@ void NFA_Machine::MakeRepl(int lower, int upper)
 		return;
 		}
 
-	while ( upper > lower )
+	// The optional copies nest, as in x(x(x)?)?, rather than follow
+	// each other, as in xx?x?. Both accept the same, but with nesting
+	// there's just one way to have matched a given number of copies, so
+	// the DFA's states consist of a few NFA states each rather than of
+	// one per copy still to come.
+	NFA_Machine* tail = 0;
+
+	for ( int n = upper - lower; n > 0; --n )
 		{
-		NFA_Machine* dup2;
-		if ( --upper == lower )
-			// Don't need "dup" for any further copies
-			dup2 = dup;
+		NFA_Machine* m;
+		if ( n == 1 )
+			// Don't need "dup" for any further copies.
+			m = dup;
 		else
-			dup2 = dup->DuplicateMachine();
+			m = dup->DuplicateMachine();
+
+		if ( tail )
+			m->AppendMachine(tail);
 
-		dup2->MakeOptional();
-		AppendMachine(dup2);
+		m->MakeOptional();
+		tail = m;
 		}
+
+	if ( tail )
+		AppendMachine(tail);
 	}
 
 void NFA_Machine::Describe(ODesc* d) const
@@ -308,13 +353,19 @@ NFA_Machine* make_alternate(NFA_Machine* m1, NFA_Machine* m2)
 	}
 
 
+static bool nfa_state_id_greater(const NFA_State* n1, const NFA_State* n2)
+	{
+	return n1->ID() > n2->ID();
+	}
+
 NFA_state_list* epsilon_closure(NFA_state_list* states)
 	{
-	// We just keep one of this as it may get quite large.
+	// We just keep one of each as they may get quite large. The bitmap
+	// spans all NFA states, so rather than clearing all of it, we remove
+	// just what we've inserted.
 	static IntSet closuremap;
-	closuremap.Clear();
-
-	NFA_state_list* closure = new NFA_state_list;
+	static std::vector<NFA_State*> members;
+	members.clear();
 
 	for ( int i = 0; i < states->length(); ++i )
 		{
@@ -326,13 +377,21 @@ NFA_state_list* epsilon_closure(NFA_state_list* states)
 			if ( ! closuremap.Contains(ns->ID()) )
 				{
 				closuremap.Insert(ns->ID());
-				closure->sortedinsert(ns, NFA_state_cmp_neg);
+				members.push_back(ns);
 				}
 			}
 		}
 
-	// Make it fit.
-	closure->resize(0);
+	// Sorting once beats inserting each state at its place.
+	std::sort(members.begin(), members.end(), nfa_state_id_greater);
+
+	NFA_state_list* closure = new NFA_state_list(members.size());
+
+	for ( size_t i = 0; i < members.size(); ++i )
+		{
+		closure->append(members[i]);
+		closuremap.Remove(members[i]->ID());
+		}
 
 	delete states;
 
@@ -97,6 +97,10 @@ public:
 
 	NFA_Machine* DuplicateMachine();
 	void LinkCopies(int n);
+
+	// Returns the number of states reachable from the first one.
+	int NumStates() const;
+
 	void InsertEpsilon();
 	void AppendEpsilon();
 
@@ -21,6 +21,7 @@
 
 #include "NetVar.h"
 #include "Sessions.h"
+#include "LoadShedder.h"
 #include "Event.h"
 #include "Timer.h"
 #include "Var.h"
@@ -33,6 +34,7 @@
 #include "iosource/PktSrc.h"
 #include "iosource/PktDumper.h"
 #include "plugin/Manager.h"
+#include "threading/Manager.h"
 
 #ifdef ENABLE_BROKER
 #include "broker/Manager.h"
@@ -47,6 +49,7 @@ extern int select(int, fd_set *, fd_set *, fd_set *, struct timeval *);
 }
 
 iosource::PktDumper* pkt_dumper = 0;
+iosource::PktMerger* pkt_merger = 0;
 
 int reading_live = 0;
 int reading_traces = 0;
@@ -56,6 +59,7 @@ bool using_communication = false;
 
 double network_time = 0.0;	// time according to last packet timestamp
 				// (or current time)
+int64 network_time_ns = 0;	// ditto, in nanoseconds
 double processing_start_time = 0.0;	// time started working on current pkt
 double bro_start_time = 0.0; // time Bro started.
 double bro_start_network_time;	// timestamp of first packet
@@ -109,23 +113,39 @@ RETSIGTYPE watchdog(int /* signo */)
 
 			if ( current_pkt )
 				{
-				if ( ! pkt_dumper )
+				iosource::PktDumper* dumper = pkt_dumper;
+
+				// If a thread writes the dump, what we
+				// interrupted may hold its lock, so we can't
+				// add to it.
+				if ( dumper && dumper->WritesBehind() )
+					dumper = 0;
+
+				if ( ! dumper )
 					{
 					// We aren't dumping packets; however,
 					// saving the packet which caused the
 					// watchdog to trigger may be helpful,
 					// so we'll save that one nevertheless.
-					pkt_dumper = iosource_mgr->OpenPktDumper("watchdog-pkt.pcap", false);
-					if ( ! pkt_dumper || pkt_dumper->IsError() )
+					// Nothing else uses this dumper, so even
+					// with a thread of its own, it's safe.
+					dumper = iosource_mgr->OpenPktDumper("watchdog-pkt.pcap", false);
+					if ( ! dumper || dumper->IsError() )
 						{
 						reporter->Error("watchdog: can't open watchdog-pkt.pcap for writing");
-						pkt_dumper = 0;
+						dumper = 0;
 						}
 					}
 
-				if ( pkt_dumper )
-					pkt_dumper->Dump(current_pkt);
+				if ( dumper )
+					{
+					dumper->Dump(current_pkt);
 
+					// Writes out what its thread may
+					// still have queued.
+					if ( dumper != pkt_dumper )
+						dumper->Close();
+					}
 				}
 
 			net_get_final_stats();
@@ -145,8 +165,14 @@ RETSIGTYPE watchdog(int /* signo */)
 	}
 
 void net_update_time(double new_network_time)
+	{
+	net_update_time(new_network_time, int64(new_network_time * 1e9 + 0.5));
+	}
+
+void net_update_time(double new_network_time, int64 new_network_time_ns)
 	{
 	network_time = new_network_time;
+	network_time_ns = new_network_time_ns;
 	PLUGIN_HOOK_VOID(HOOK_UPDATE_NETWORK_TIME, HookUpdateNetworkTime(new_network_time));
 	}
 
@@ -185,6 +211,22 @@ void net_init(name_list& interfaces, name_list& readfiles,
 						     interfaces[i],
 						     ps->ErrorMsg());
 			}
+
+		if ( interfaces.length() > 1 && BifConst::live_merge_skew > 0 )
+			{
+			pkt_merger = new iosource::PktMerger(BifConst::live_merge_skew);
+
+			const iosource::Manager::PktSrcList& pkt_srcs =
+				iosource_mgr->GetPktSrcs();
+
+			for ( iosource::Manager::PktSrcList::const_iterator i = pkt_srcs.begin();
+			      i != pkt_srcs.end(); ++i )
+				pkt_merger->AddSource(*i);
+
+			// The manager owns it now; it doesn't keep us running
+			// on its own.
+			iosource_mgr->Register(pkt_merger, true);
+			}
 		}
 
 	else
@@ -234,6 +276,16 @@ void expire_timers(iosource::PktSrc* src_ps)
 				max_timer_expires - current_dispatched);
 	}
 
+// Packets look up their timer manager anyway, so this takes it directly.
+static void expire_packet_timers(TimerMgr* tmgr)
+	{
+	SegmentProfiler prof(segment_logger, "expiring-timers");
+	current_dispatched +=
+		tmgr->AdvanceQuantized(network_time,
+				       max_timer_expires - current_dispatched,
+				       timer_advance_quantum);
+	}
+
 void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 	{
 	if ( ! bro_start_network_time )
@@ -242,13 +294,23 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 	TimerMgr* tmgr = sessions->LookupTimerMgr(src_ps->GetCurrentTag());
 
 	// network_time never goes back.
-	net_update_time(tmgr->Time() < t ? t : tmgr->Time());
+	if ( tmgr->Time() < t )
+		{
+		// Unless in pseudo-realtime mode, t is the packet's
+		// timestamp, which we then take to the nanosecond.
+		if ( t == pkt->time )
+			net_update_time(t, pkt->time_ns);
+		else
+			net_update_time(t);
+		}
+	else
+		net_update_time(tmgr->Time());
 
 	current_pktsrc = src_ps;
 	current_iosrc = src_ps;
 	processing_start_time = t;
 
-	expire_timers(src_ps);
+	expire_packet_timers(tmgr);
 
 	SegmentProfiler* sp = 0;
 
@@ -271,6 +333,10 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 		}
 
 	sessions->NextPacket(t, pkt);
+
+	if ( load_shedder )
+		load_shedder->NextPacket(t, mgr.Size());
+
 	mgr.Drain();
 
 	if ( sp )
@@ -363,6 +429,8 @@ void net_run()
 			// Use nanosleep(2) or setitimer(2) instead.
 			}
 
+		thread_mgr->CheckHeartbeat(network_time);
+
 		mgr.Drain();
 
 		processing_start_time = 0.0;	// = "we're not processing now"
@@ -11,6 +11,7 @@
 #include "iosource/IOSource.h"
 #include "iosource/PktSrc.h"
 #include "iosource/PktDumper.h"
+#include "iosource/PktMerger.h"
 
 extern void net_init(name_list& interfaces, name_list& readfiles,
 		const char* writefile, int do_watchdog);
@@ -19,6 +20,7 @@ extern void net_get_final_stats();
 extern void net_finish(int drain_events);
 extern void net_delete();	// Reclaim all memory, etc.
 extern void net_update_time(double new_network_time);
+extern void net_update_time(double new_network_time, int64 new_network_time_ns);
 extern void net_packet_dispatch(double t, const Packet* pkt,
 			iosource::PktSrc* src_ps);
 extern void expire_timers(iosource::PktSrc* src_ps = 0);
@@ -76,7 +78,13 @@ extern double current_timestamp;
 extern iosource::PktSrc* current_pktsrc;
 extern iosource::IOSource* current_iosrc;
 
+// True if the packet being processed had its checksums verified by the
+// network card already.
+inline bool current_checksums_verified()
+	{ return current_pkt && current_pkt->checksums_verified; }
+
 extern iosource::PktDumper* pkt_dumper;	// where to save packets
+extern iosource::PktMerger* pkt_merger;	// null if not merging sources
 
 extern char* writefile;
 
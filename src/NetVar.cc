@@ -30,6 +30,7 @@ RecordType* mime_match;
 int watchdog_interval;
 
 int max_timer_expires;
+double timer_advance_quantum;
 int max_remote_events_processed;
 
 int ignore_checksums;
@@ -53,6 +54,8 @@ int tcp_max_initial_window;
 int tcp_max_above_hole_without_any_acks;
 int tcp_excessive_data_without_further_acks;
 int tcp_max_old_segments;
+int tcp_coalesce_max_bytes;
+double tcp_coalesce_max_delay;
 
 RecordType* socks_address;
 
@@ -150,6 +153,7 @@ TableVal* generate_OS_version_event;
 double table_expire_interval;
 double table_expire_delay;
 int table_incremental_step;
+int table_expire_index;
 
 RecordType* packet_type;
 
@@ -177,6 +181,7 @@ int forward_remote_state_changes;
 int forward_remote_events;
 int remote_check_sync_consistency;
 bro_uint_t chunked_io_buffer_soft_cap;
+bro_uint_t remote_shm_size;
 
 StringVal* ssl_ca_certificate;
 StringVal* ssl_private_key;
@@ -186,6 +191,7 @@ Val* profiling_file;
 double profiling_interval;
 int expensive_profiling_multiple;
 int segment_profiling;
+int track_container_origins;
 int pkt_profile_mode;
 double pkt_profile_freq;
 Val* pkt_profile_file;
@@ -212,10 +218,26 @@ int dpd_ignore_ports;
 TableVal* likely_server_ports;
 
 double remote_trace_sync_interval;
+double remote_access_batch_interval;
 int remote_trace_sync_peers;
 
 int check_for_unused_event_handlers;
 int dump_used_event_handlers;
+int report_empty_event_handlers;
+int event_handler_profile_sample_rate;
+int analyzer_profiling;
+int dfa_state_cache_size;
+int sig_prefilter_max_buffer;
+int sig_compile_on_demand;
+int file_hash_threads;
+int file_extract_buffer;
+int file_extract_drop_on_overflow;
+int file_fingerprint_cache_size;
+int file_write_buffer;
+int file_write_gzip_level;
+int async_bif_threads;
+bro_uint_t async_bif_min_bytes;
+int file_rotate_automatically;
 
 int suppress_local_output;
 
@@ -253,6 +275,7 @@ void init_general_global_var()
 	table_expire_interval = opt_internal_double("table_expire_interval");
 	table_expire_delay = opt_internal_double("table_expire_delay");
 	table_incremental_step = opt_internal_int("table_incremental_step");
+	table_expire_index = opt_internal_int("table_expire_index");
 
 	state_dir = internal_val("state_dir")->AsStringVal();
 	state_write_delay = opt_internal_double("state_write_delay");
@@ -273,6 +296,7 @@ void init_general_global_var()
 	remote_check_sync_consistency =
 		opt_internal_int("remote_check_sync_consistency");
 	chunked_io_buffer_soft_cap = opt_internal_unsigned("chunked_io_buffer_soft_cap");
+	remote_shm_size = opt_internal_unsigned("remote_shm_size");
 
 	ssl_ca_certificate = internal_val("ssl_ca_certificate")->AsStringVal();
 	ssl_private_key = internal_val("ssl_private_key")->AsStringVal();
@@ -287,6 +311,26 @@ void init_general_global_var()
 		opt_internal_int("check_for_unused_event_handlers");
 	dump_used_event_handlers =
 		opt_internal_int("dump_used_event_handlers");
+	report_empty_event_handlers =
+		opt_internal_int("report_empty_event_handlers");
+	event_handler_profile_sample_rate =
+		opt_internal_int("event_handler_profile_sample_rate");
+	analyzer_profiling = opt_internal_int("analyzer_profiling");
+	dfa_state_cache_size = opt_internal_int("dfa_state_cache_size");
+	sig_prefilter_max_buffer = opt_internal_int("sig_prefilter_max_buffer");
+	sig_compile_on_demand = opt_internal_int("sig_compile_on_demand");
+	file_hash_threads = opt_internal_int("file_hash_threads");
+	file_extract_buffer = opt_internal_int("file_extract_buffer");
+	file_extract_drop_on_overflow =
+		opt_internal_int("file_extract_drop_on_overflow");
+	file_fingerprint_cache_size =
+		opt_internal_int("file_fingerprint_cache_size");
+	file_write_buffer = opt_internal_int("file_write_buffer");
+	file_write_gzip_level = opt_internal_int("file_write_gzip_level");
+	async_bif_threads = opt_internal_int("async_bif_threads");
+	async_bif_min_bytes = opt_internal_unsigned("async_bif_min_bytes");
+	file_rotate_automatically =
+		opt_internal_int("file_rotate_automatically");
 
 	suppress_local_output = opt_internal_int("suppress_local_output");
 
@@ -352,6 +396,8 @@ void init_net_var()
 	tcp_excessive_data_without_further_acks =
 		opt_internal_int("tcp_excessive_data_without_further_acks");
 	tcp_max_old_segments = opt_internal_int("tcp_max_old_segments");
+	tcp_coalesce_max_bytes = opt_internal_int("tcp_coalesce_max_bytes");
+	tcp_coalesce_max_delay = opt_internal_double("tcp_coalesce_max_delay");
 
 	socks_address = internal_type("SOCKS::Address")->AsRecordType();
 
@@ -394,6 +440,7 @@ void init_net_var()
 	watchdog_interval = int(opt_internal_double("watchdog_interval"));
 
 	max_timer_expires = opt_internal_int("max_timer_expires");
+	timer_advance_quantum = opt_internal_double("timer_advance_quantum");
 	max_remote_events_processed =
 		opt_internal_int("max_remote_events_processed");
 
@@ -484,6 +531,7 @@ void init_net_var()
 		opt_internal_int("expensive_profiling_multiple");
 	profiling_interval = opt_internal_double("profiling_interval");
 	segment_profiling = opt_internal_int("segment_profiling");
+	track_container_origins = opt_internal_int("track_container_origins");
 
 	pkt_profile_mode = opt_internal_int("pkt_profile_mode");
 	pkt_profile_freq = opt_internal_double("pkt_profile_freq");
@@ -500,6 +548,8 @@ void init_net_var()
 	remote_trace_sync_interval =
 		opt_internal_double("remote_trace_sync_interval");
 	remote_trace_sync_peers = opt_internal_int("remote_trace_sync_peers");
+	remote_access_batch_interval =
+		opt_internal_double("remote_access_batch_interval");
 
 	dpd_reassemble_first_packets =
 		opt_internal_int("dpd_reassemble_first_packets");
@@ -33,6 +33,7 @@ extern RecordType* mime_match;
 extern int watchdog_interval;
 
 extern int max_timer_expires;
+extern double timer_advance_quantum;
 extern int max_remote_events_processed;
 
 extern int ignore_checksums;
@@ -56,6 +57,8 @@ extern int tcp_max_initial_window;
 extern int tcp_max_above_hole_without_any_acks;
 extern int tcp_excessive_data_without_further_acks;
 extern int tcp_max_old_segments;
+extern int tcp_coalesce_max_bytes;
+extern double tcp_coalesce_max_delay;
 
 extern RecordType* socks_address;
 
@@ -153,6 +156,7 @@ extern TableVal* generate_OS_version_event;
 extern double table_expire_interval;
 extern double table_expire_delay;
 extern int table_incremental_step;
+extern int table_expire_index;
 
 extern RecordType* packet_type;
 
@@ -180,6 +184,7 @@ extern int forward_remote_state_changes;
 extern int forward_remote_events;
 extern int remote_check_sync_consistency;
 extern bro_uint_t chunked_io_buffer_soft_cap;
+extern bro_uint_t remote_shm_size;
 
 extern StringVal* ssl_ca_certificate;
 extern StringVal* ssl_private_key;
@@ -190,6 +195,7 @@ extern double profiling_interval;
 extern int expensive_profiling_multiple;
 
 extern int segment_profiling;
+extern int track_container_origins;
 extern int pkt_profile_mode;
 extern double pkt_profile_freq;
 extern Val* pkt_profile_file;
@@ -215,9 +221,25 @@ extern TableVal* likely_server_ports;
 
 extern double remote_trace_sync_interval;
 extern int remote_trace_sync_peers;
+extern double remote_access_batch_interval;
 
 extern int check_for_unused_event_handlers;
 extern int dump_used_event_handlers;
+extern int report_empty_event_handlers;
+extern int event_handler_profile_sample_rate;
+extern int analyzer_profiling;
+extern int dfa_state_cache_size;
+extern int sig_prefilter_max_buffer;
+extern int sig_compile_on_demand;
+extern int file_hash_threads;
+extern int file_extract_buffer;
+extern int file_extract_drop_on_overflow;
+extern int file_fingerprint_cache_size;
+extern int file_write_buffer;
+extern int file_write_gzip_level;
+extern int async_bif_threads;
+extern bro_uint_t async_bif_min_bytes;
+extern int file_rotate_automatically;
 
 extern int suppress_local_output;
 
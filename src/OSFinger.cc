@@ -39,7 +39,7 @@ OSFingerprint::OSFingerprint(FingerprintMode arg_mode)
   char* fname;
 
   memset(sig, 0, sizeof(struct fp_entry)*MAXSIGS);
-  memset(bh, 0, sizeof(struct fp_entry*)*OSHSIZE);
+  cache=0;
 
   os_matches.SetDeleteFunc(int_delete_func);
 
@@ -63,6 +63,38 @@ OSFingerprint::OSFingerprint(FingerprintMode arg_mode)
     }
 }
 
+// FNV-1a, over the low n bytes of v.
+static uint64 fnv_add(uint64 h, uint32 v, int n)
+  {
+  for (int i=0;i<n;i++)
+    {
+    h ^= (v >> (8*i)) & 0xff;
+    h *= 1099511628211ULL;
+    }
+  return h;
+  }
+
+static uint64 sig_key(uint16 size, uint8 optcnt, const uint8* opt,
+		      uint32 quirks, uint8 df, uint8 zero_stamp)
+  {
+  uint64 h = 14695981039346656037ULL;
+  h = fnv_add(h,size,2);
+  h = fnv_add(h,optcnt,1);
+  h = fnv_add(h,quirks,4);
+  h = fnv_add(h,df | (zero_stamp << 1),1);
+  for (int j=0;j<optcnt;j++) h = fnv_add(h,opt[j],1);
+  return h;
+  }
+
+struct fp_entry* OSFingerprint::lookup_sigs(uint16 size, uint8 optcnt,
+				const uint8* opt, uint32 quirks, uint8 df,
+				uint8 zero_stamp) const
+  {
+  std::unordered_map<uint64, struct fp_entry*>::const_iterator i =
+    sig_index.find(sig_key(size,optcnt,opt,quirks,df,zero_stamp));
+  return i == sig_index.end() ? 0 : i->second;
+  }
+
 bool OSFingerprint::CacheMatch(const IPAddr& addr, int id)
   {
   HashKey* key = addr.GetHashKey();
@@ -492,11 +524,14 @@ reparse_ptr:
         default: Error("OS fingerprinting: Bad quirk in line",(uint32)ln);
 	}
 
-    e = bh[SIGHASH(s,sig[sigcnt].optcnt,sig[sigcnt].quirks,d)];
+    struct fp_entry*& head =
+      sig_index[sig_key(sig[sigcnt].size,sig[sigcnt].optcnt,sig[sigcnt].opt,
+			sig[sigcnt].quirks,sig[sigcnt].df,sig[sigcnt].zero_stamp)];
+    e = head;
 
     if (!e)
       {
-      bh[SIGHASH(s,sig[sigcnt].optcnt,sig[sigcnt].quirks,d)] = &sig[sigcnt];
+      head = &sig[sigcnt];
       }
     else
       {
@@ -517,6 +552,64 @@ reparse_ptr:
 
   }
 
+// Hosts tend to send the same SYNs over and over, so we remember the last
+// one of each and what it matched. The timestamp's value only feeds the
+// uptime, which gets recomputed.
+int OSFingerprint::FindMatch(const IPAddr& src, struct os_type* retval,
+			      uint16 tot,uint8 df,uint8 ttl,uint16 wss,
+			      uint8 ocnt,uint8* op,uint16 mss,uint8 wsc,
+			      uint32 tstamp,uint32 quirks,uint8 ecn) const
+  {
+  if (ocnt > MAXOPT)
+    return FindMatch(retval,tot,df,ttl,wss,ocnt,op,mss,wsc,tstamp,quirks,ecn);
+
+  if (!cache)
+    {
+    cache = new struct cache_entry[OSCACHESIZE];
+    for (int i=0;i<OSCACHESIZE;i++) cache[i].valid = false;
+    }
+
+  const uint32_t* words;
+  int n = src.GetBytes(&words);
+  uint64 h = 14695981039346656037ULL;
+  for (int i=0;i<n;i++) h = fnv_add(h,words[i],4);
+
+  struct cache_entry* c = &cache[h % OSCACHESIZE];
+  uint8 zero_stamp = !tstamp;
+
+  if (c->valid && c->addr == src && c->tot == tot && c->df == df &&
+      c->ttl == ttl && c->wss == wss && c->ocnt == ocnt && c->mss == mss &&
+      c->wsc == wsc && c->zero_stamp == zero_stamp &&
+      c->quirks == quirks && c->ecn == ecn &&
+      !memcmp(c->op,op,ocnt))
+    {
+    *retval = c->result;
+    if (c->has_uptime) retval->uptime=tstamp/360000;
+    return c->id;
+    }
+
+  int id = FindMatch(retval,tot,df,ttl,wss,ocnt,op,mss,wsc,tstamp,quirks,ecn);
+
+  c->valid = true;
+  c->addr = src;
+  c->tot = tot;
+  c->df = df;
+  c->ttl = ttl;
+  c->wss = wss;
+  c->ocnt = ocnt;
+  memcpy(c->op,op,ocnt);
+  c->mss = mss;
+  c->wsc = wsc;
+  c->zero_stamp = zero_stamp;
+  c->quirks = quirks;
+  c->ecn = ecn;
+  c->id = id;
+  c->result = *retval;
+  c->has_uptime = (retval->gadgets & GADGETUPTIME) != 0;
+
+  return id;
+  }
+
 // Does the actual match between the packet and the signature database.
 // Modifies retval and contains OS Type and other useful information.
 // Returns config-file line of the matching signature as id.
@@ -527,6 +620,8 @@ int OSFingerprint::FindMatch(struct os_type* retval, uint16 tot,uint8 df,
   {
   uint32 j; //used for counter in loops
   struct fp_entry* p;
+  struct fp_entry* exact;
+  struct fp_entry* big;
   uint8  orig_df  = df;
 
   struct fp_entry* fuzzy = 0;
@@ -541,60 +636,67 @@ int OSFingerprint::FindMatch(struct os_type* retval, uint16 tot,uint8 df,
 
 re_lookup:
 
-  p = bh[SIGHASH(tot,ocnt,quirks,df)];
+  /* Candidates of the exact size, and those for any size >= PACKET_BIG,
+     both in config file order; the first match wins. */
+  exact = lookup_sigs(tot,ocnt,op,quirks,df,!tstamp);
+  big = tot >= PACKET_BIG ? lookup_sigs(0,ocnt,op,quirks,df,!tstamp) : 0;
+  if (big == exact) big = 0;
 
-  while (p)
+  while (exact || big)
     {
+    if (exact && (!big || exact < big)) { p = exact; exact = exact->next; }
+    else { p = big; big = big->next; }
+
     /* Cheap and specific checks first... */
     /* psize set to zero means >= PACKET_BIG */
-    if (p->size) { if (tot ^ p->size) { p = p->next; continue; } }
-      else if (tot < PACKET_BIG) { p = p->next; continue; }
+    if (p->size) { if (tot ^ p->size) continue; }
+      else if (tot < PACKET_BIG) continue;
 
-    if (ocnt ^ p->optcnt) { p = p->next; continue; }
+    if (ocnt ^ p->optcnt) continue;
 
-    if (p->zero_stamp ^ (!tstamp)) { p = p->next; continue; }
-    if (p->df ^ df) { p = p->next; continue; }
-    if (p->quirks ^ quirks) { p = p->next; continue; }
+    if (p->zero_stamp ^ (!tstamp)) continue;
+    if (p->df ^ df) continue;
+    if (p->quirks ^ quirks) continue;
 
     /* Check MSS and WSCALE... */
     if (!p->mss_mod) {
-      if (mss ^ p->mss) { p = p->next; continue; }
-    } else if (mss % p->mss) { p = p->next; continue; }
+      if (mss ^ p->mss) continue;
+    } else if (mss % p->mss) continue;
 
     if (!p->wsc_mod) {
-      if (wsc ^ p->wsc) { p = p->next; continue; }
-    } else if (wsc % p->wsc) { p = p->next; continue; }
+      if (wsc ^ p->wsc) continue;
+    } else if (wsc % p->wsc) continue;
 
     /* Then proceed with the most complex WSS check... */
     switch (p->wsize_mod)
       {
       case 0:
-        if (wss ^ p->wsize) { p = p->next; continue; }
+        if (wss ^ p->wsize) continue;
         break;
       case MOD_CONST:
-        if (wss % p->wsize) { p = p->next; continue; }
+        if (wss % p->wsize) continue;
         break;
       case MOD_MSS:
         if (mss && !(wss % mss))
 	  {
-          if ((wss / mss) ^ p->wsize) { p = p->next; continue; }
+          if ((wss / mss) ^ p->wsize) continue;
 	  }
 	else if (!(wss % 1460))
 	  {
-          if ((wss / 1460) ^ p->wsize) { p = p->next; continue; }
+          if ((wss / 1460) ^ p->wsize) continue;
 	  }
-	else { p = p->next; continue; }
+	else continue;
         break;
       case MOD_MTU:
         if (mss && !(wss % (mss+40)))
 	  {
-          if ((wss / (mss+40)) ^ p->wsize) { p = p->next; continue; }
+          if ((wss / (mss+40)) ^ p->wsize) continue;
 	  }
 	else if (!(wss % 1500))
 	  {
-          if ((wss / 1500) ^ p->wsize) { p = p->next; continue; }
+          if ((wss / 1500) ^ p->wsize) continue;
 	  }
-	else { p = p->next; continue; }
+	else continue;
         break;
       }
 
@@ -606,7 +708,6 @@ re_lookup:
     if (p->ttl < ttl)
       {
       if ( mode != RST_FINGERPRINT_MODE )fuzzy = p;
-      p = p->next;
       continue;
       }
 
@@ -615,7 +716,6 @@ re_lookup:
       if (p->ttl - ttl > MAXDIST)
 	{
         if (mode != RST_FINGERPRINT_MODE ) fuzzy = p;
-        p = p->next;
         continue;
 	}
 
@@ -654,9 +754,7 @@ continue_fuzzy:
     return id;
 
 continue_search:
-
-    p = p->next;
-
+    ;
     }
 
   if (!df) { df = 1; goto re_lookup; } //not found with df=0 do df=1
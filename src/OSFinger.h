@@ -11,6 +11,8 @@
 #ifndef osfinger_h
 #define osfinger_h
 
+#include <unordered_map>
+
 #include "util.h"
 #include "Dict.h"
 #include "Reporter.h"
@@ -36,6 +38,9 @@
 // We err on the safe side.
 #define MAXOPT 64
 
+// Number of entries of the cache of the latest match per source address.
+#define OSCACHESIZE 4096
+
 declare(PDict,int);
 
 struct os_type {
@@ -82,10 +87,17 @@ enum FingerprintMode {
 class OSFingerprint {
 public:
 	OSFingerprint(FingerprintMode mode);
-	~OSFingerprint()	{}
+	~OSFingerprint()	{ delete [] cache; }
 
 	bool Error() const	{ return err; }
 
+	// Looks up the packet's fingerprint, first in the cache of the last
+	// one that its source sent, and then in the signatures.
+	int FindMatch(const IPAddr& src, struct os_type* retval, uint16 tot,
+		uint8 DF_flag, uint8 TTL, uint16 WSS, uint8 ocnt, uint8* op,
+		uint16 MSS, uint8 win_scale, uint32 tstamp, uint32 quirks,
+		uint8 ECN) const;
+
 	int FindMatch(struct os_type* retval, uint16 tot, uint8 DF_flag,
 		uint8 TTL, uint16 WSS, uint8 ocnt, uint8* op, uint16 MSS,
 		uint8 win_scale, uint32 tstamp, uint32 quirks, uint8 ECN) const;
@@ -102,6 +114,13 @@ public:
 protected:
 	void collide(uint32 id);
 
+	// Returns the first signature with the given fields that need to
+	// match exactly, or nil.  Those with the same are chained through
+	// their next fields, in the order of the config file.
+	struct fp_entry* lookup_sigs(uint16 size, uint8 optcnt,
+				const uint8* opt, uint32 quirks, uint8 df,
+				uint8 zero_stamp) const;
+
 	void Error(const char* msg)
 		{
 		reporter->Error("%s", msg);
@@ -127,16 +146,36 @@ private:
 	uint8 problems;
 	struct fp_entry sig[MAXSIGS];
 
-	/* By hash */
-#define OSHSIZE 16
-	struct fp_entry* bh[OSHSIZE];
+	// Signatures by a hash of the fields that need to match exactly: the
+	// packet size (zero for >= PACKET_BIG), option layout, quirks, DF,
+	// and whether there's a zero timestamp.
+	std::unordered_map<uint64, struct fp_entry*> sig_index;
+
+	struct cache_entry {
+		bool valid;
+		IPAddr addr;
+		uint16 tot;
+		uint8 df, ttl;
+		uint16 wss;
+		uint8 ocnt;
+		uint8 op[MAXOPT];
+		uint16 mss;
+		uint8 wsc;
+		uint8 zero_stamp;
+		uint32 quirks;
+		uint8 ecn;
+
+		int id;
+		struct os_type result;
+		bool has_uptime;	// whether the uptime is the timestamp's
+	};
+
+	// Direct-mapped by source address, allocated on first use.
+	mutable struct cache_entry* cache;
 
 	PDict(int) os_matches;
 };
 
-#define SIGHASH(tsize, optcnt, q, df) \
-	((uint8(((tsize) << 1) ^ ((optcnt) << 1) ^ (df) ^ (q) )) & 0x0f)
-
 #define MOD_NONE	0
 #define MOD_CONST	1
 #define MOD_MSS		2
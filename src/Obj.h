@@ -157,6 +157,13 @@ public:
 
 	int RefCnt() const	{ return ref_cnt; }
 
+	// Marks the object as living until the end of the process.  Ref()
+	// and Unref() then leave its reference count alone, so that objects
+	// shared by a lot of code, like constants, don't get written to on
+	// every use.  The object must not be deleted anywhere but at exit.
+	void MakeImmortal()	{ ref_cnt = IMMORTAL_REF_CNT; }
+	bool IsImmortal() const	{ return ref_cnt == IMMORTAL_REF_CNT; }
+
 	// Helper class to temporarily suppress errors
 	// as long as there exist any instances.
 	class SuppressErrors {
@@ -185,6 +192,10 @@ private:
 	friend inline void Ref(BroObj* o);
 	friend inline void Unref(BroObj* o);
 
+	// Reference count of immortal objects.  Regular ones never get
+	// there, as Ref() treats that as an overflow.
+	static const int IMMORTAL_REF_CNT = INT_MAX;
+
 	bool notify_plugins;
 	int ref_cnt;
 
@@ -207,6 +218,9 @@ inline void Error(const BroObj* o, const char* msg)
 
 inline void Ref(BroObj* o)
 	{
+	if ( o->ref_cnt == BroObj::IMMORTAL_REF_CNT )
+		return;
+
 	if ( ++o->ref_cnt <= 1 )
 		bad_ref(0);
 	if ( o->ref_cnt == INT_MAX )
@@ -215,7 +229,8 @@ inline void Ref(BroObj* o)
 
 inline void Unref(BroObj* o)
 	{
-	if ( o && --o->ref_cnt <= 0 )
+	if ( o && o->ref_cnt != BroObj::IMMORTAL_REF_CNT &&
+	     --o->ref_cnt <= 0 )
 		{
 		if ( o->ref_cnt < 0 )
 			bad_ref(2);
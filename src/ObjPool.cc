@@ -0,0 +1,73 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include "ObjPool.h"
+
+typedef std::vector<ObjPool*> pool_list;
+
+static pool_list& all_pools()
+	{
+	// Function-local so that it's set up before the first pool, no
+	// matter in which order static instances get initialized.
+	static pool_list pools;
+	return pools;
+	}
+
+ObjPool::ObjPool(const char* arg_name, size_t arg_obj_size, int arg_objs_per_chunk)
+	{
+	name = arg_name;
+	obj_size = arg_obj_size;
+	objs_per_chunk = arg_objs_per_chunk;
+	free_list = 0;
+	in_use = 0;
+
+	// Make sure we can link freed objects.
+	if ( obj_size < sizeof(FreeObj) )
+		obj_size = sizeof(FreeObj);
+
+	// Leak checking needs to see individual objects, and pooled ones
+	// would never show up as leaked.
+#ifdef USE_PERFTOOLS_DEBUG
+	enabled = false;
+#else
+	enabled = (getenv("BRO_NO_OBJ_POOLS") == 0);
+#endif
+
+	all_pools().push_back(this);
+	}
+
+void ObjPool::Grow()
+	{
+	// Malloc returns memory aligned sufficiently for any type, and
+	// obj_size is itself a multiple of the object's alignment.
+	char* chunk = (char*) safe_malloc(objs_per_chunk * obj_size);
+	chunks.push_back(chunk);
+
+	for ( int i = objs_per_chunk - 1; i >= 0; --i )
+		{
+		FreeObj* o = (FreeObj*) (chunk + i * obj_size);
+		o->next = free_list;
+		free_list = o;
+		}
+	}
+
+void ObjPool::GetStats(Stats* s) const
+	{
+	s->name = name;
+	s->obj_size = obj_size;
+	s->in_use = in_use;
+	s->total = uint64(chunks.size()) * objs_per_chunk;
+	}
+
+void ObjPool::GetAllStats(std::vector<Stats>* stats)
+	{
+	const pool_list& pools = all_pools();
+
+	for ( pool_list::const_iterator i = pools.begin(); i != pools.end(); ++i )
+		{
+		Stats s;
+		(*i)->GetStats(&s);
+		stats->push_back(s);
+		}
+	}
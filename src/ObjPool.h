@@ -0,0 +1,99 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Free-list allocators for objects that get created and destroyed at high
+// rates, like those making up a connection. Objects of a pooled class come
+// out of larger chunks, and freed objects are kept for reuse rather than
+// going back to malloc. That saves the malloc overhead per object and keeps
+// the heap from fragmenting over time. Chunks are never given back, as
+// pools live until termination.
+
+#ifndef objpool_h
+#define objpool_h
+
+#include <stdlib.h>
+#include <vector>
+
+#include "util.h"
+
+class ObjPool {
+public:
+	// The name is for statistics only. obj_size is the size of the
+	// objects handed out; requests for any other size (i.e., for
+	// derived classes) go to malloc.
+	ObjPool(const char* name, size_t obj_size, int objs_per_chunk = 256);
+
+	void* Alloc(size_t size)
+		{
+		if ( size != obj_size || ! enabled )
+			return safe_malloc(size);
+
+		if ( ! free_list )
+			Grow();
+
+		FreeObj* o = free_list;
+		free_list = o->next;
+		++in_use;
+		return o;
+		}
+
+	void Free(void* p, size_t size)
+		{
+		if ( ! p )
+			return;
+
+		if ( size != obj_size || ! enabled )
+			{
+			free(p);
+			return;
+			}
+
+		FreeObj* o = (FreeObj*) p;
+		o->next = free_list;
+		free_list = o;
+		--in_use;
+		}
+
+	struct Stats {
+		const char* name;
+		size_t obj_size;
+		uint64 in_use;	// Objects currently handed out.
+		uint64 total;	// Objects allocated, including free ones.
+	};
+
+	void GetStats(Stats* s) const;
+
+	// Returns the bytes allocated by the pool.
+	uint64 MemoryAllocation() const
+		{ return chunks.size() * objs_per_chunk * obj_size; }
+
+	// Returns statistics of all pools.
+	static void GetAllStats(std::vector<Stats>* stats);
+
+private:
+	struct FreeObj {
+		FreeObj* next;
+	};
+
+	void Grow();
+
+	const char* name;
+	size_t obj_size;
+	int objs_per_chunk;
+	bool enabled;
+
+	FreeObj* free_list;
+	uint64 in_use;
+	std::vector<char*> chunks;
+};
+
+// Put this into a class declaration to take its instances from a pool,
+// which then needs to be instantiated in the class' source file with
+// the name <class>_pool. The class must have a virtual destructor if
+// derived classes may get deleted through it.
+#define DECLARE_POOL_ALLOCATION(T) \
+	public: \
+	static void* operator new(size_t size)	{ return T##_pool.Alloc(size); } \
+	static void operator delete(void* p, size_t size) \
+		{ T##_pool.Free(p, size); }
+
+#endif
@@ -6,6 +6,7 @@
 #include "Serializer.h"
 #include "probabilistic/BloomFilter.h"
 #include "probabilistic/CardinalityCounter.h"
+#include "probabilistic/CuckooFilter.h"
 
 bool HashVal::IsValid() const
 	{
@@ -24,7 +25,7 @@ bool HashVal::Init()
 StringVal* HashVal::Get()
 	{
 	if ( ! valid )
-		return new StringVal("");
+		return val_mgr->GetEmptyString();
 
 	StringVal* result = DoGet();
 	valid = false;
@@ -55,7 +56,7 @@ bool HashVal::DoFeed(const void*, size_t)
 StringVal* HashVal::DoGet()
 	{
 	assert(! "missing implementation of DoGet()");
-	return new StringVal("");
+	return val_mgr->GetEmptyString();
 	}
 
 HashVal::HashVal(OpaqueType* t) : OpaqueVal(t)
@@ -135,7 +136,7 @@ bool MD5Val::DoFeed(const void* data, size_t size)
 StringVal* MD5Val::DoGet()
 	{
 	if ( ! IsValid() )
-		return new StringVal("");
+		return val_mgr->GetEmptyString();
 
 	u_char digest[MD5_DIGEST_LENGTH];
 	md5_final(&ctx, digest);
@@ -245,7 +246,7 @@ bool SHA1Val::DoFeed(const void* data, size_t size)
 StringVal* SHA1Val::DoGet()
 	{
 	if ( ! IsValid() )
-		return new StringVal("");
+		return val_mgr->GetEmptyString();
 
 	u_char digest[SHA_DIGEST_LENGTH];
 	sha1_final(&ctx, digest);
@@ -357,7 +358,7 @@ bool SHA256Val::DoFeed(const void* data, size_t size)
 StringVal* SHA256Val::DoGet()
 	{
 	if ( ! IsValid() )
-		return new StringVal("");
+		return val_mgr->GetEmptyString();
 
 	u_char digest[SHA256_DIGEST_LENGTH];
 	sha256_final(&ctx, digest);
@@ -431,6 +432,11 @@ EntropyVal::EntropyVal() : OpaqueVal(entropy_type)
 	{
 	}
 
+EntropyVal::EntropyVal(bool histogram_only)
+	: OpaqueVal(entropy_type), state(histogram_only)
+	{
+	}
+
 bool EntropyVal::Feed(const void* data, size_t size)
 	{
 	state.add(data, size);
@@ -520,6 +526,104 @@ bool EntropyVal::DoUnserialize(UnserialInfo* info)
 	return true;
 	}
 
+MomentsVal::MomentsVal() : OpaqueVal(moments_type)
+	{
+	n = 0;
+	sum = min = max = mean = prev_mean = var_s = 0.0;
+	}
+
+double MomentsVal::Add(double v)
+	{
+	++n;
+	sum += v;
+
+	if ( n == 1 )
+		{
+		min = max = mean = v;
+		prev_mean = mean;
+		return mean;
+		}
+
+	if ( v < min )
+		min = v;
+
+	if ( v > max )
+		max = v;
+
+	mean += (v - mean) / n;
+	var_s += (v - prev_mean) * (v - mean);
+	prev_mean = mean;
+
+	return mean;
+	}
+
+void MomentsVal::Merge(const MomentsVal* other)
+	{
+	if ( ! other->n )
+		return;
+
+	if ( ! n )
+		{
+		n = other->n;
+		sum = other->sum;
+		min = other->min;
+		max = other->max;
+		mean = other->mean;
+		prev_mean = other->prev_mean;
+		var_s = other->var_s;
+		return;
+		}
+
+	uint64 total = n + other->n;
+	double new_mean = (mean * n + other->mean * other->n) / total;
+
+	// Each side's squared differences, shifted to the combined mean.
+	double d1 = mean - new_mean;
+	double d2 = other->mean - new_mean;
+	var_s = n * (var_s / n + d1 * d1) +
+		other->n * (other->var_s / other->n + d2 * d2);
+
+	prev_mean = (prev_mean * n + other->prev_mean * other->n) / total;
+	mean = new_mean;
+	sum += other->sum;
+
+	if ( other->min < min )
+		min = other->min;
+
+	if ( other->max > max )
+		max = other->max;
+
+	n = total;
+	}
+
+IMPLEMENT_SERIAL(MomentsVal, SER_MOMENTS_VAL);
+
+bool MomentsVal::DoSerialize(SerialInfo* info) const
+	{
+	DO_SERIALIZE(SER_MOMENTS_VAL, OpaqueVal);
+
+	return SERIALIZE(n) &&
+		SERIALIZE(sum) &&
+		SERIALIZE(min) &&
+		SERIALIZE(max) &&
+		SERIALIZE(mean) &&
+		SERIALIZE(prev_mean) &&
+		SERIALIZE(var_s);
+	}
+
+bool MomentsVal::DoUnserialize(UnserialInfo* info)
+	{
+	DO_UNSERIALIZE(OpaqueVal);
+
+	return UNSERIALIZE(&n) &&
+		UNSERIALIZE(&sum) &&
+		UNSERIALIZE(&min) &&
+		UNSERIALIZE(&max) &&
+		UNSERIALIZE(&mean) &&
+		UNSERIALIZE(&prev_mean) &&
+		UNSERIALIZE(&var_s);
+	}
+
 BloomFilterVal::BloomFilterVal()
 	: OpaqueVal(bloomfilter_type)
 	{
@@ -676,6 +780,160 @@ bool BloomFilterVal::DoUnserialize(UnserialInfo* info)
 	return bloom_filter != 0;
 	}
 
+CuckooFilterVal::CuckooFilterVal()
+	: OpaqueVal(cuckoofilter_type)
+	{
+	type = 0;
+	hash = 0;
+	cuckoo_filter = 0;
+	}
+
+CuckooFilterVal::CuckooFilterVal(probabilistic::CuckooFilter* cf)
+	: OpaqueVal(cuckoofilter_type)
+	{
+	type = 0;
+	hash = 0;
+	cuckoo_filter = cf;
+	}
+
+CuckooFilterVal::~CuckooFilterVal()
+	{
+	Unref(type);
+	delete hash;
+	delete cuckoo_filter;
+	}
+
+bool CuckooFilterVal::Typify(BroType* arg_type)
+	{
+	if ( type )
+		return false;
+
+	type = arg_type;
+	type->Ref();
+
+	TypeList* tl = new TypeList(type);
+	tl->Append(type->Ref());
+	hash = new CompositeHash(tl);
+	Unref(tl);
+
+	return true;
+	}
+
+BroType* CuckooFilterVal::Type() const
+	{
+	return type;
+	}
+
+bool CuckooFilterVal::Add(const Val* val)
+	{
+	HashKey* key = hash->ComputeHash(val, 1);
+	bool added = cuckoo_filter->Add(key);
+	delete key;
+	return added;
+	}
+
+bool CuckooFilterVal::Remove(const Val* val)
+	{
+	HashKey* key = hash->ComputeHash(val, 1);
+	bool removed = cuckoo_filter->Remove(key);
+	delete key;
+	return removed;
+	}
+
+size_t CuckooFilterVal::Count(const Val* val) const
+	{
+	HashKey* key = hash->ComputeHash(val, 1);
+	size_t cnt = cuckoo_filter->Count(key);
+	delete key;
+	return cnt;
+	}
+
+void CuckooFilterVal::Clear()
+	{
+	cuckoo_filter->Clear();
+	}
+
+bool CuckooFilterVal::Empty() const
+	{
+	return cuckoo_filter->Empty();
+	}
+
+string CuckooFilterVal::InternalState() const
+	{
+	return cuckoo_filter->InternalState();
+	}
+
+CuckooFilterVal* CuckooFilterVal::Merge(const CuckooFilterVal* x,
+					const CuckooFilterVal* y)
+	{
+	if ( x->Type() && // any one 0 is ok here
+	     y->Type() &&
+	     ! same_type(x->Type(), y->Type()) )
+		{
+		reporter->Error("cannot merge cuckoo filters with different types");
+		return 0;
+		}
+
+	probabilistic::CuckooFilter* copy = x->cuckoo_filter->Clone();
+
+	if ( ! copy->Merge(y->cuckoo_filter) )
+		{
+		reporter->Error("failed to merge cuckoo filter");
+		delete copy;
+		return 0;
+		}
+
+	CuckooFilterVal* merged = new CuckooFilterVal(copy);
+	BroType* t = x->Type() ? x->Type() : y->Type();
+
+	if ( t && ! merged->Typify(t) )
+		{
+		reporter->Error("failed to set type on merged cuckoo filter");
+		Unref(merged);
+		return 0;
+		}
+
+	return merged;
+	}
+
+IMPLEMENT_SERIAL(CuckooFilterVal, SER_CUCKOOFILTER_VAL);
+
+bool CuckooFilterVal::DoSerialize(SerialInfo* info) const
+	{
+	DO_SERIALIZE(SER_CUCKOOFILTER_VAL, OpaqueVal);
+
+	bool is_typed = (type != 0);
+
+	if ( ! SERIALIZE(is_typed) )
+		return false;
+
+	if ( is_typed && ! type->Serialize(info) )
+		return false;
+
+	return cuckoo_filter->Serialize(info);
+	}
+
+bool CuckooFilterVal::DoUnserialize(UnserialInfo* info)
+	{
+	DO_UNSERIALIZE(OpaqueVal);
+
+	bool is_typed;
+	if ( ! UNSERIALIZE(&is_typed) )
+		return false;
+
+	if ( is_typed )
+		{
+		BroType* t = BroType::Unserialize(info);
+		if ( ! Typify(t) )
+			return false;
+
+		Unref(t);
+		}
+
+	cuckoo_filter = probabilistic::CuckooFilter::Unserialize(info);
+	return cuckoo_filter != 0;
+	}
+
 CardinalityVal::CardinalityVal() : OpaqueVal(cardinality_type)
 	{
 	c = 0;
@@ -11,6 +11,7 @@
 
 namespace probabilistic {
 	class BloomFilter;
+	class CuckooFilter;
 	class CardinalityCounter;
 }
 
@@ -99,6 +100,7 @@ private:
 class EntropyVal : public OpaqueVal {
 public:
 	EntropyVal();
+	explicit EntropyVal(bool histogram_only);
 
 	bool Feed(const void* data, size_t size);
 	bool Get(double *r_ent, double *r_chisq, double *r_mean,
@@ -114,6 +116,41 @@ private:
 	RandTest state;
 };
 
+// The running moments of a series of numbers: count, sum, extremes, mean and
+// variance. They're updated incrementally, and two series merge exactly,
+// so that partial results from several nodes combine into the ones for all.
+class MomentsVal : public OpaqueVal {
+public:
+	MomentsVal();
+
+	// Adds an observation and returns the new mean.
+	double Add(double v);
+
+	// Adds all of another series' observations.
+	void Merge(const MomentsVal* other);
+
+	uint64 Count() const	{ return n; }
+	double Sum() const	{ return sum; }
+	double Min() const	{ return min; }
+	double Max() const	{ return max; }
+	double Mean() const	{ return mean; }
+
+	// The sample variance; zero for fewer than two observations.
+	double Variance() const	{ return n > 1 ? var_s / (n - 1) : 0.0; }
+
+protected:
+	DECLARE_SERIAL(MomentsVal);
+
+private:
+	uint64 n;
+	double sum;
+	double min;
+	double max;
+	double mean;
+	double prev_mean;	// before the latest observation
+	double var_s;	// sum of squared differences from the mean
+};
+
 class BloomFilterVal : public OpaqueVal {
 public:
 	explicit BloomFilterVal(probabilistic::BloomFilter* bf);
@@ -148,6 +185,40 @@ private:
 	probabilistic::BloomFilter* bloom_filter;
 	};
 
+class CuckooFilterVal : public OpaqueVal {
+public:
+	explicit CuckooFilterVal(probabilistic::CuckooFilter* cf);
+	virtual ~CuckooFilterVal();
+
+	BroType* Type() const;
+	bool Typify(BroType* type);
+
+	bool Add(const Val* val);
+	bool Remove(const Val* val);
+	size_t Count(const Val* val) const;
+	void Clear();
+	bool Empty() const;
+	string InternalState() const;
+
+	static CuckooFilterVal* Merge(const CuckooFilterVal* x,
+				      const CuckooFilterVal* y);
+
+protected:
+	friend class Val;
+	CuckooFilterVal();
+
+	DECLARE_SERIAL(CuckooFilterVal);
+
+private:
+	// Disable.
+	CuckooFilterVal(const CuckooFilterVal&);
+	CuckooFilterVal& operator=(const CuckooFilterVal&);
+
+	BroType* type;
+	CompositeHash* hash;
+	probabilistic::CuckooFilter* cuckoo_filter;
+	};
+
 
 class CardinalityVal: public OpaqueVal {
 public:
@@ -1,58 +1,88 @@
 #include "PacketFilter.h"
 
-void PacketFilter::AddSrc(const IPAddr& src, uint32 tcp_flags, double probability)
+PacketFilter::~PacketFilter()
+	{
+	Clear(&src_filter);
+	Clear(&dst_filter);
+	}
+
+IPPrefix PacketFilter::ToPrefix(Val* v)
+	{
+	if ( v->Type()->Tag() == TYPE_SUBNET )
+		return v->AsSubNet();
+
+	return IPPrefix(v->AsAddr(), 128, true);
+	}
+
+void PacketFilter::Add(PrefixTable* t, const IPPrefix& p, uint32 tcp_flags,
+			double probability)
 	{
 	Filter* f = new Filter;
+	f->prefix = p;
 	f->tcp_flags = tcp_flags;
 	f->probability = uint32(probability * RAND_MAX);
-	src_filter.Insert(src, 128, f);
+	delete (Filter*) t->Insert(p.Prefix(), p.LengthIPv6(), f);
+	}
+
+bool PacketFilter::Remove(PrefixTable* t, const IPPrefix& p)
+	{
+	Filter* f = (Filter*) t->Remove(p.Prefix(), p.LengthIPv6());
+	delete f;
+	return f != 0;
+	}
+
+void PacketFilter::Clear(PrefixTable* t)
+	{
+	PrefixTable::iterator i = t->InitIterator();
+	Filter* f;
+
+	while ( (f = (Filter*) t->GetNext(&i)) )
+		delete f;
+
+	t->Clear();
+	}
+
+void PacketFilter::AddSrc(const IPAddr& src, uint32 tcp_flags, double probability)
+	{
+	Add(&src_filter, IPPrefix(src, 128, true), tcp_flags, probability);
 	}
 
 void PacketFilter::AddSrc(Val* src, uint32 tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = uint32(probability * RAND_MAX);
-	src_filter.Insert(src, f);
+	Add(&src_filter, ToPrefix(src), tcp_flags, probability);
 	}
 
 void PacketFilter::AddDst(const IPAddr& dst, uint32 tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = uint32(probability * RAND_MAX);
-	dst_filter.Insert(dst, 128, f);
+	Add(&dst_filter, IPPrefix(dst, 128, true), tcp_flags, probability);
 	}
 
 void PacketFilter::AddDst(Val* dst, uint32 tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = uint32(probability * RAND_MAX);
-	dst_filter.Insert(dst, f);
+	Add(&dst_filter, ToPrefix(dst), tcp_flags, probability);
 	}
 
 bool PacketFilter::RemoveSrc(const IPAddr& src)
 	{
-	return src_filter.Remove(src, 128) != 0;
+	return Remove(&src_filter, IPPrefix(src, 128, true));
 	}
 
 bool PacketFilter::RemoveSrc(Val* src)
 	{
-	return src_filter.Remove(src) != NULL;
+	return Remove(&src_filter, ToPrefix(src));
 	}
 
 bool PacketFilter::RemoveDst(const IPAddr& dst)
 	{
-	return dst_filter.Remove(dst, 128) != NULL;
+	return Remove(&dst_filter, IPPrefix(dst, 128, true));
 	}
 
 bool PacketFilter::RemoveDst(Val* dst)
 	{
-	return dst_filter.Remove(dst) != NULL;
+	return Remove(&dst_filter, ToPrefix(dst));
 	}
 
-bool PacketFilter::Match(const IP_Hdr* ip, int len, int caplen)
+bool PacketFilter::DoMatch(const IP_Hdr* ip, int len, int caplen)
 	{
 	Filter* f = (Filter*) src_filter.Lookup(ip->SrcAddr(), 128);
 	if ( f )
@@ -89,3 +119,85 @@ bool PacketFilter::MatchFilter(const Filter& f, const IP_Hdr& ip,
 
 	return uint32(bro_random()) < f.probability;
 	}
+
+std::string PacketFilter::PushdownFilter()
+	{
+	if ( default_match )
+		return "";
+
+	// A packet matching any source filter is up to that one, so the
+	// destination filters only apply to the others.
+	std::string srcs;
+	PrefixTable::iterator i = src_filter.InitIterator();
+	Filter* f;
+
+	while ( (f = (Filter*) src_filter.GetNext(&i)) )
+		{
+		if ( srcs.size() )
+			srcs += " or ";
+
+		srcs += "src net " + f->prefix.AsString();
+		}
+
+	std::string exprs;
+
+	if ( ! PushdownFilters(&src_filter, true, "", &exprs) ||
+	     ! PushdownFilters(&dst_filter, false, srcs, &exprs) )
+		return "";
+
+	return exprs;
+	}
+
+bool PacketFilter::PushdownFilters(PrefixTable* t, bool src,
+				   const std::string& exclude, std::string* exprs)
+	{
+	const char* dir = src ? "src" : "dst";
+	PrefixTable::iterator i = t->InitIterator();
+	Filter* f;
+
+	while ( (f = (Filter*) t->GetNext(&i)) )
+		{
+		if ( f->probability == 0 )
+			// Never drops anything, but it still shadows the
+			// less specific filters, see below.
+			continue;
+
+		if ( f->probability < uint32(RAND_MAX) )
+			return false;
+
+		std::string expr = fmt("%s net %s", dir, f->prefix.AsString().c_str());
+
+		// Lookups pick the longest matching prefix, so the more
+		// specific filters inside of this one take precedence.
+		PrefixTable::iterator j = t->InitIterator();
+		Filter* g;
+
+		while ( (g = (Filter*) t->GetNext(&j)) )
+			{
+			if ( g->prefix.LengthIPv6() > f->prefix.LengthIPv6() &&
+			     f->prefix.Contains(g->prefix.Prefix()) )
+				expr += fmt(" and not %s net %s", dir,
+					    g->prefix.AsString().c_str());
+			}
+
+		if ( exclude.size() )
+			expr += " and not (" + exclude + ")";
+
+		if ( f->tcp_flags )
+			{
+			if ( f->prefix.Prefix().GetFamily() != IPv4 ||
+			     f->tcp_flags > 0xff )
+				return false;
+
+			expr += fmt(" and not (tcp and tcp[13] & %u != 0)",
+				    f->tcp_flags);
+			}
+
+		if ( exprs->size() )
+			*exprs += " or ";
+
+		*exprs += "(" + expr + ")";
+		}
+
+	return true;
+	}
@@ -3,13 +3,15 @@
 #ifndef PACKETFILTER_H
 #define PACKETFILTER_H
 
+#include <string>
+
 #include "IP.h"
 #include "PrefixTable.h"
 
 class PacketFilter {
 public:
 	PacketFilter(bool arg_default)	{ default_match = arg_default; }
-	~PacketFilter()	{}
+	~PacketFilter();
 
 	// Drops all packets from a particular source (which may be given
 	// as an AddrVal or a SubnetVal) which hasn't any of TCP flags set
@@ -27,16 +29,45 @@ public:
 	bool RemoveDst(Val* dst);
 
 	// Returns true if packet matches a drop filter
-	bool Match(const IP_Hdr* ip, int len, int caplen);
+	bool Match(const IP_Hdr* ip, int len, int caplen)
+		{
+		if ( ! src_filter.Size() && ! dst_filter.Size() )
+			return default_match;
+
+		return DoMatch(ip, len, caplen);
+		}
+
+	// Returns a BPF expression matching the packets that the filters
+	// drop, for excluding them in the capture filter so that they don't
+	// even reach us.  (Packets inside of tunnels still get filtered
+	// here.)  That works only if no filter drops probabilistically, the
+	// default isn't to drop, and TCP flags come only with IPv4 filters,
+	// as libpcap can't look into IPv6 TCP headers.  Otherwise, returns
+	// an empty string.
+	std::string PushdownFilter();
 
 private:
 	struct Filter {
+		IPPrefix prefix;
 		uint32 tcp_flags;
 		uint32 probability;
 	};
 
+	static IPPrefix ToPrefix(Val* v);
+
+	void Add(PrefixTable* t, const IPPrefix& p, uint32 tcp_flags,
+		 double probability);
+	bool Remove(PrefixTable* t, const IPPrefix& p);
+	void Clear(PrefixTable* t);
+
+	bool DoMatch(const IP_Hdr* ip, int len, int caplen);
 	bool MatchFilter(const Filter& f, const IP_Hdr& ip, int len, int caplen);
 
+	// Adds the BPF expressions for the filters of a table to exprs.
+	// Returns false if one of them can't be expressed.
+	bool PushdownFilters(PrefixTable* t, bool src, const std::string& exclude,
+			     std::string* exprs);
+
 	bool default_match;
 	PrefixTable src_filter;
 	PrefixTable dst_filter;
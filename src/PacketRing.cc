@@ -0,0 +1,406 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include "bro-config.h"
+
+#include "PacketRing.h"
+#include "Metrics.h"
+#include "Reporter.h"
+#include "iosource/Packet.h"
+
+#include "NetVar.h"
+#include "iosource/pcap/pcap.bif.h"
+
+uint64 PacketRing::total_bytes = 0;
+uint64 PacketRing::num_dropped = 0;
+
+PacketRingWriter* packet_ring_writer = 0;
+
+// A packet's header as a trace file stores it, which unlike struct
+// pcap_pkthdr doesn't depend on the size of a timeval.
+struct pcap_record_hdr {
+	uint32 ts_sec;
+	uint32 ts_usec;
+	uint32 caplen;
+	uint32 len;
+};
+
+static double ring_bytes()
+	{
+	return PacketRing::TotalBytes();
+	}
+
+static double ring_drops()
+	{
+	return PacketRing::NumDropped() +
+		(packet_ring_writer ? packet_ring_writer->NumDropped() : 0);
+	}
+
+PacketRing::PacketRing(size_t arg_max_packets)
+	{
+	max_packets = arg_max_packets;
+	bytes = 0;
+	}
+
+PacketRing::~PacketRing()
+	{
+	total_bytes -= bytes;
+	}
+
+void PacketRing::Add(const Packet* pkt)
+	{
+	uint64 limit = BifConst::packet_ring_memory;
+	BufferedPacket p;
+
+	// Once it's full, or we're out of memory, the ring makes room with
+	// its own oldest packets. We hold on to the buffer of the last one
+	// to go.
+	while ( ! packets.empty() &&
+		(packets.size() >= max_packets ||
+		 (limit && total_bytes + pkt->cap_len > limit)) )
+		{
+		p = std::move(packets.front());
+		packets.pop_front();
+		bytes -= p.data.size();
+		total_bytes -= p.data.size();
+		}
+
+	if ( limit && total_bytes + pkt->cap_len > limit )
+		{
+		++num_dropped;
+		return;
+		}
+
+	p.ts = pkt->ts;
+	p.len = pkt->len;
+	p.data.assign(pkt->data, pkt->data + pkt->cap_len);
+
+	bytes += pkt->cap_len;
+	total_bytes += pkt->cap_len;
+	packets.push_back(std::move(p));
+	}
+
+void PacketRing::Take(std::deque<BufferedPacket>* out)
+	{
+	for ( size_t i = 0; i < packets.size(); ++i )
+		out->push_back(std::move(packets[i]));
+
+	packets.clear();
+	total_bytes -= bytes;
+	bytes = 0;
+	}
+
+PacketRingWriter::PacketRingWriter()
+	{
+	queued_bytes = 0;
+	stopping = false;
+	running = false;
+	num_dropped = 0;
+	error[0] = '\0';
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&cond, 0);
+
+	metrics::registry()->NewCallbackGauge("packet_ring.bytes",
+					      "Packets buffered in connection rings, in bytes.",
+					      ring_bytes);
+	metrics::registry()->NewCallbackCounter("packet_ring.dropped",
+						"Packets that didn't fit into packet_ring_memory.",
+						ring_drops);
+	}
+
+PacketRingWriter::~PacketRingWriter()
+	{
+	Finish();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+	}
+
+void PacketRingWriter::Start()
+	{
+	if ( running || stopping )
+		return;
+
+	if ( pthread_create(&thread, 0, Launcher, this) != 0 )
+		reporter->FatalError("cannot create packet ring writer thread");
+
+	running = true;
+	}
+
+void PacketRingWriter::Finish()
+	{
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	if ( ! running )
+		return;
+
+	pthread_join(thread, 0);
+	running = false;
+
+	ReportError();
+	}
+
+void PacketRingWriter::ReportError()
+	{
+	pthread_mutex_lock(&mutex);
+	std::string err = error;
+	error[0] = '\0';
+	pthread_mutex_unlock(&mutex);
+
+	if ( err.size() )
+		reporter->Error("packet ring writer: %s", err.c_str());
+	}
+
+PacketDumpFile* PacketRingWriter::Open(const std::string& path)
+	{
+	Start();
+
+	if ( stopping )
+		return 0;
+
+	pthread_mutex_lock(&mutex);
+
+	std::map<std::string, PacketDumpFile*>::iterator i = files.find(path);
+
+	if ( i != files.end() )
+		{
+		++i->second->refs;
+		pthread_mutex_unlock(&mutex);
+		return i->second;
+		}
+
+	pthread_mutex_unlock(&mutex);
+
+	// Only we add files, so nobody else can in the meantime.
+	FILE* f = fopen(path.c_str(), "a");
+
+	if ( ! f )
+		return 0;
+
+	struct stat st;
+
+	if ( fstat(fileno(f), &st) < 0 )
+		{
+		fclose(f);
+		return 0;
+		}
+
+	if ( st.st_size == 0 )
+		{
+		// A new file needs the header that pcap_dump_open() would
+		// write.
+		struct pcap_file_header hdr;
+		hdr.magic = 0xa1b2c3d4;
+		hdr.version_major = PCAP_VERSION_MAJOR;
+		hdr.version_minor = PCAP_VERSION_MINOR;
+		hdr.thiszone = 0;
+		hdr.sigfigs = 0;
+		hdr.snaplen = BifConst::Pcap::snaplen;
+		hdr.linktype = DLT_EN10MB;
+
+		if ( fwrite(&hdr, sizeof(hdr), 1, f) != 1 )
+			{
+			fclose(f);
+			return 0;
+			}
+		}
+
+	PacketDumpFile* file = new PacketDumpFile;
+	file->path = path;
+	file->file = f;
+	file->refs = 1;
+
+	pthread_mutex_lock(&mutex);
+	files[path] = file;
+	pthread_mutex_unlock(&mutex);
+
+	return file;
+	}
+
+void PacketRingWriter::Close(PacketDumpFile* file)
+	{
+	pthread_mutex_lock(&mutex);
+
+	// Once the writer has stopped, it has closed all files itself.
+	for ( std::map<std::string, PacketDumpFile*>::iterator i = files.begin();
+	      i != files.end(); ++i )
+		{
+		if ( i->second != file )
+			continue;
+
+		if ( --file->refs == 0 && ! stopping )
+			{
+			Item item;
+			item.file = file;
+			item.close = true;
+			queue.push_back(std::move(item));
+			pthread_cond_broadcast(&cond);
+			}
+
+		break;
+		}
+
+	pthread_mutex_unlock(&mutex);
+	}
+
+void PacketRingWriter::Write(PacketDumpFile* file, const Packet* pkt)
+	{
+	Item item;
+	item.file = file;
+	item.close = false;
+	item.pkt.ts = pkt->ts;
+	item.pkt.len = pkt->len;
+	item.pkt.data.assign(pkt->data, pkt->data + pkt->cap_len);
+	Enqueue(&item);
+	}
+
+void PacketRingWriter::Write(PacketDumpFile* file,
+			     std::deque<BufferedPacket>* pkts)
+	{
+	for ( size_t i = 0; i < pkts->size(); ++i )
+		{
+		Item item;
+		item.file = file;
+		item.close = false;
+		item.pkt = std::move((*pkts)[i]);
+		Enqueue(&item);
+		}
+
+	pkts->clear();
+	}
+
+void PacketRingWriter::Enqueue(Item* item)
+	{
+	uint64 limit = BifConst::packet_ring_memory;
+	size_t len = item->pkt.data.size();
+	bool failed = false;
+
+	pthread_mutex_lock(&mutex);
+
+	if ( error[0] )
+		failed = true;
+
+	if ( stopping || (limit && queued_bytes + len > limit) )
+		++num_dropped;
+	else
+		{
+		queued_bytes += len;
+		queue.push_back(std::move(*item));
+		pthread_cond_broadcast(&cond);
+		}
+
+	pthread_mutex_unlock(&mutex);
+
+	if ( failed )
+		ReportError();
+	}
+
+void* PacketRingWriter::Launcher(void* arg)
+	{
+	// Signals are for the main thread to handle, except for those which
+	// POSIX leaves undefined when blocked.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	((PacketRingWriter*) arg)->Run();
+	return 0;
+	}
+
+void PacketRingWriter::Run()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( true )
+		{
+		while ( queue.empty() && ! stopping )
+			pthread_cond_wait(&cond, &mutex);
+
+		// Even when stopping, we write out what's queued.
+		if ( queue.empty() )
+			break;
+
+		Item item = std::move(queue.front());
+		queue.pop_front();
+		queued_bytes -= item.pkt.data.size();
+
+		if ( item.close )
+			{
+			// Unless the file got opened again since.
+			if ( item.file->refs > 0 )
+				continue;
+
+			files.erase(item.file->path);
+			pthread_mutex_unlock(&mutex);
+			CloseFile(item.file);
+			pthread_mutex_lock(&mutex);
+			continue;
+			}
+
+		pthread_mutex_unlock(&mutex);
+		WritePacket(item.file, item.pkt);
+		pthread_mutex_lock(&mutex);
+		}
+
+	// Nothing's going to write to what's still open.
+	std::map<std::string, PacketDumpFile*> left;
+	left.swap(files);
+	pthread_mutex_unlock(&mutex);
+
+	for ( std::map<std::string, PacketDumpFile*>::iterator i = left.begin();
+	      i != left.end(); ++i )
+		CloseFile(i->second);
+	}
+
+void PacketRingWriter::WritePacket(PacketDumpFile* file, const BufferedPacket& pkt)
+	{
+	pcap_record_hdr hdr;
+	hdr.ts_sec = pkt.ts.tv_sec;
+	hdr.ts_usec = pkt.ts.tv_usec;
+	hdr.caplen = pkt.data.size();
+	hdr.len = pkt.len;
+
+	if ( fwrite(&hdr, sizeof(hdr), 1, file->file) == 1 &&
+	     (pkt.data.empty() ||
+	      fwrite(pkt.data.data(), pkt.data.size(), 1, file->file) == 1) )
+		return;
+
+	char buf[128];
+	strerror_r(errno, buf, sizeof(buf));
+
+	pthread_mutex_lock(&mutex);
+	snprintf(error, sizeof(error), "can't write %s: %s",
+		 file->path.c_str(), buf);
+	pthread_mutex_unlock(&mutex);
+	}
+
+void PacketRingWriter::CloseFile(PacketDumpFile* file)
+	{
+	if ( fclose(file->file) != 0 )
+		{
+		char buf[128];
+		strerror_r(errno, buf, sizeof(buf));
+
+		pthread_mutex_lock(&mutex);
+		snprintf(error, sizeof(error), "can't close %s: %s",
+			 file->path.c_str(), buf);
+		pthread_mutex_unlock(&mutex);
+		}
+
+	delete file;
+	}
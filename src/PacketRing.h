@@ -0,0 +1,184 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef packetring_h
+#define packetring_h
+
+#include <pthread.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+class Packet;
+
+/**
+ * A copy of a packet that's waiting to be written out. The packet source's
+ * buffer gets reused with the next read, so the data can't stay there.
+ */
+struct BufferedPacket {
+	struct timeval ts;
+	uint32 len;
+	std::vector<u_char> data;
+};
+
+/**
+ * Keeps the most recent packets of a connection in memory, so that they
+ * can still be written out once something about the connection turns out
+ * to be interesting. All rings together stay within packet_ring_memory;
+ * once that's used up, a ring gives up its own oldest packets for new
+ * ones.
+ */
+class PacketRing {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param max_packets The number of packets to keep at most.
+	 */
+	PacketRing(size_t max_packets);
+
+	/**
+	 * Destructor.
+	 */
+	~PacketRing();
+
+	/**
+	 * Adds a copy of a packet, dropping the oldest one if the ring is
+	 * full. The dropped packet's buffer gets reused for the new one.
+	 */
+	void Add(const Packet* pkt);
+
+	/**
+	 * Moves all buffered packets to the end of a queue, oldest first,
+	 * leaving the ring empty.
+	 */
+	void Take(std::deque<BufferedPacket>* out);
+
+	/**
+	 * Returns the number of buffered packets.
+	 */
+	size_t Size() const	{ return packets.size(); }
+
+	/**
+	 * Returns the number of bytes that all rings buffer together.
+	 */
+	static uint64 TotalBytes()	{ return total_bytes; }
+
+	/**
+	 * Returns how many packets didn't make it into any ring because of
+	 * packet_ring_memory.
+	 */
+	static uint64 NumDropped()	{ return num_dropped; }
+
+private:
+	std::deque<BufferedPacket> packets;
+	size_t max_packets;
+	size_t bytes;
+
+	static uint64 total_bytes;
+	static uint64 num_dropped;
+};
+
+/**
+ * A trace file that PacketRingWriter writes packets to.
+ */
+struct PacketDumpFile {
+	std::string path;
+	FILE* file;
+	int refs;	// protected by the writer's mutex
+};
+
+/**
+ * Writes packets to trace files in a thread of its own, so that dumping a
+ * connection's packets doesn't hold up the analysis. The main thread opens
+ * the files and writes their headers; from then on, only the writer uses
+ * them, up to closing them. It writes the packet records itself rather
+ * than going through a PktDumper, whose code isn't safe to run outside of
+ * the main thread.
+ */
+class PacketRingWriter {
+public:
+	PacketRingWriter();
+	~PacketRingWriter();
+
+	/**
+	 * Opens a file to write to, or returns the one already open for the
+	 * same path. Each call needs to be matched by one to Close().
+	 *
+	 * @return The file, or null if it couldn't be opened.
+	 */
+	PacketDumpFile* Open(const std::string& path);
+
+	/**
+	 * Releases a file returned by Open(). The last release closes it
+	 * once all packets queued for it have been written.
+	 */
+	void Close(PacketDumpFile* file);
+
+	/**
+	 * Queues a copy of a packet for writing.
+	 */
+	void Write(PacketDumpFile* file, const Packet* pkt);
+
+	/**
+	 * Queues packets for writing, moving them out of *pkts*.
+	 */
+	void Write(PacketDumpFile* file, std::deque<BufferedPacket>* pkts);
+
+	/**
+	 * Writes out everything still queued and stops the thread.
+	 */
+	void Finish();
+
+	/**
+	 * Returns how many packets didn't get written because the queue
+	 * exceeded packet_ring_memory.
+	 */
+	uint64 NumDropped() const	{ return num_dropped; }
+
+private:
+	struct Item {
+		PacketDumpFile* file;
+		bool close;	// if set, closes the file instead of a packet
+		BufferedPacket pkt;
+	};
+
+	static void* Launcher(void* arg);
+
+	void Run();
+	void Start();
+	void Enqueue(Item* item);
+
+	// Called by the writer thread only.
+	void WritePacket(PacketDumpFile* file, const BufferedPacket& pkt);
+	void CloseFile(PacketDumpFile* file);
+
+	// Reports an error that the writer thread ran into, if any.
+	void ReportError();
+
+	// Only ever touched with the mutex held. A file stays in the map
+	// until the writer has closed it, so that opening it again in the
+	// meantime keeps it open instead.
+	std::map<std::string, PacketDumpFile*> files;
+	std::deque<Item> queue;
+	uint64 queued_bytes;
+	bool stopping;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool running;
+
+	uint64 num_dropped;
+
+	// The writer can't use the reporter, so it leaves its last error
+	// here for the main thread. Protected by the mutex.
+	char error[256];
+};
+
+extern PacketRingWriter* packet_ring_writer;
+
+#endif
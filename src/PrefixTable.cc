@@ -1,6 +1,42 @@
 #include "PrefixTable.h"
 #include "Reporter.h"
 
+// Returns the six bits of a 128-bit address starting at bit *depth*,
+// counting from the most significant one. Bits past the end read as zero.
+static inline int trie_slot(uint64 hi, uint64 lo, int depth)
+	{
+	if ( depth <= 58 )
+		return (hi >> (58 - depth)) & 0x3f;
+
+	if ( depth < 64 )
+		return ((hi << (depth - 58)) | (lo >> (122 - depth))) & 0x3f;
+
+	depth -= 64;
+
+	if ( depth <= 58 )
+		return (lo >> (58 - depth)) & 0x3f;
+
+	return (lo << (depth - 58)) & 0x3f;
+	}
+
+// Counts the set bits of a bitmap up to and including bit *slot*.
+static inline int trie_rank(uint64 bitmap, int slot)
+	{
+	return __builtin_popcountll(bitmap << (63 - slot));
+	}
+
+static inline void trie_mask(uint64* hi, uint64* lo, int len)
+	{
+	if ( len < 64 )
+		{
+		*hi &= len ? ~uint64(0) << (64 - len) : 0;
+		*lo = 0;
+		}
+
+	else if ( len < 128 )
+		*lo &= len > 64 ? ~uint64(0) << (128 - len) : 0;
+	}
+
 prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
 	{
 	prefix_t* prefix = (prefix_t*) safe_malloc(sizeof(prefix_t));
@@ -36,6 +72,11 @@ void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	// node itself.
 	node->data = data ? data : node;
 
+	if ( ! old )
+		++num_prefixes;
+
+	Invalidate();
+
 	return old;
 	}
 
@@ -87,15 +128,29 @@ list<tuple<IPPrefix,void*>> PrefixTable::FindAll(const SubNetVal* value) const
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
-	prefix_t* prefix = MakePrefix(addr, width);
-	patricia_node_t* node =
-		exact ? patricia_search_exact(tree, prefix) :
-			patricia_search_best(tree, prefix);
+	if ( ! exact && width == 128 )
+		{
+		// Compile once enough lookups came in to pay for it.
+		if ( ! compiled && num_prefixes >= 16 &&
+		     ++lookups_since_change >= num_prefixes )
+			Build();
 
-	int elems = 0;
-	patricia_node_t** list = nullptr;
+		if ( compiled )
+			return CompiledLookup(addr);
+		}
+
+	// The search doesn't hold on to the prefix, so it doesn't need to
+	// go on the heap.
+	prefix_t prefix;
+	addr.CopyIPv6(&prefix.add.sin6);
+	prefix.family = AF_INET6;
+	prefix.bitlen = width;
+	prefix.ref_count = 0;
+
+	patricia_node_t* node =
+		exact ? patricia_search_exact(tree, &prefix) :
+			patricia_search_best(tree, &prefix);
 
-	Deref_Prefix(prefix);
 	return node ? node->data : 0;
 	}
 
@@ -135,6 +190,9 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 	void* old = node->data;
 	patricia_remove(tree, node);
 
+	--num_prefixes;
+	Invalidate();
+
 	return old;
 	}
 
@@ -201,3 +259,228 @@ void* PrefixTable::GetNext(iterator* i)
 
 	// Not reached.
 	}
+
+void PrefixTable::Build() const
+	{
+	nodes.clear();
+	leaves.clear();
+	values.clear();
+	values.push_back(0);
+
+	std::vector<TriePrefix> prefixes;
+	prefixes.reserve(num_prefixes);
+
+	std::vector<patricia_node_t*> stack;
+
+	if ( tree->head )
+		stack.push_back(tree->head);
+
+	while ( ! stack.empty() )
+		{
+		patricia_node_t* n = stack.back();
+		stack.pop_back();
+
+		if ( n->l )
+			stack.push_back(n->l);
+
+		if ( n->r )
+			stack.push_back(n->r);
+
+		if ( ! n->prefix )
+			continue;
+
+		const u_char* b = reinterpret_cast<const u_char*>(&n->prefix->add.sin6);
+		TriePrefix p;
+		p.hi = p.lo = 0;
+
+		for ( int i = 0; i < 8; ++i )
+			{
+			p.hi = (p.hi << 8) | b[i];
+			p.lo = (p.lo << 8) | b[i + 8];
+			}
+
+		p.len = n->prefix->bitlen;
+		trie_mask(&p.hi, &p.lo, p.len);
+		p.value = values.size();
+		values.push_back(n->data);
+		prefixes.push_back(p);
+		}
+
+	// IPv4 addresses get a trie of their own, so that their lookups
+	// don't have to walk through the 96 bits of the mapping prefix.
+	// Prefixes within the mapping's range move there, the others
+	// stay in the IPv6 one.
+	std::vector<TriePrefix> prefixes4;
+	std::vector<const TriePrefix*> list4;
+	std::vector<const TriePrefix*> list6;
+	uint32 default4 = 0;
+	uint32 default6 = 0;
+	int default4_len = -1;
+
+	for ( size_t i = 0; i < prefixes.size(); ++i )
+		{
+		const TriePrefix& p = prefixes[i];
+		bool v4 = (p.hi == 0 && (p.lo >> 32) == 0xffff);
+
+		if ( v4 && p.len > 96 )
+			{
+			TriePrefix p4 = p;
+			p4.hi = p.lo << 32;
+			p4.lo = 0;
+			p4.len = p.len - 96;
+			prefixes4.push_back(p4);
+			continue;
+			}
+
+		if ( p.len == 0 )
+			default6 = p.value;
+		else
+			list6.push_back(&p);
+
+		// The longest prefix covering all of IPv4 matches for IPv4
+		// addresses that nothing better matches.
+		uint64 hi = 0;
+		uint64 lo = uint64(0xffff) << 32;
+		trie_mask(&hi, &lo, p.len);
+
+		if ( p.len <= 96 && hi == p.hi && lo == p.lo && p.len > default4_len )
+			{
+			default4 = p.value;
+			default4_len = p.len;
+			}
+		}
+
+	for ( size_t i = 0; i < prefixes4.size(); ++i )
+		list4.push_back(&prefixes4[i]);
+
+	nodes.resize(2);
+	root6 = 0;
+	root4 = 1;
+	BuildNode(root6, 0, list6, default6);
+	BuildNode(root4, 0, list4, default4);
+
+	compiled = true;
+	}
+
+void PrefixTable::BuildNode(uint32 node, int depth,
+			    const std::vector<const TriePrefix*>& prefixes,
+			    uint32 inherited) const
+	{
+	uint32 match[64];
+	int match_len[64];
+	std::vector<const TriePrefix*> below[64];
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		match[i] = inherited;
+		match_len[i] = -1;
+		}
+
+	for ( size_t i = 0; i < prefixes.size(); ++i )
+		{
+		const TriePrefix* p = prefixes[i];
+		int slot = trie_slot(p->hi, p->lo, depth);
+
+		if ( p->len > depth + 6 )
+			{
+			below[slot].push_back(p);
+			continue;
+			}
+
+		// A shorter prefix covers a range of slots.
+		int span = 1 << (depth + 6 - p->len);
+		slot &= ~(span - 1);
+
+		for ( int j = slot; j < slot + span; ++j )
+			{
+			if ( p->len > match_len[j] )
+				{
+				match[j] = p->value;
+				match_len[j] = p->len;
+				}
+			}
+		}
+
+	uint64 children = 0;
+	uint64 leaf_runs = 0;
+	uint32 first_leaf = leaves.size();
+	bool have_leaf = false;
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		if ( ! below[i].empty() )
+			{
+			children |= uint64(1) << i;
+			continue;
+			}
+
+		if ( ! have_leaf || leaves.back() != match[i] )
+			{
+			leaf_runs |= uint64(1) << i;
+			leaves.push_back(match[i]);
+			have_leaf = true;
+			}
+		}
+
+	uint32 first_child = nodes.size();
+	nodes.resize(first_child + __builtin_popcountll(children));
+
+	nodes[node].children = children;
+	nodes[node].leaves = leaf_runs;
+	nodes[node].first_child = first_child;
+	nodes[node].first_leaf = first_leaf;
+
+	uint32 child = first_child;
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		if ( ! below[i].empty() )
+			BuildNode(child++, depth + 6, below[i], match[i]);
+		}
+	}
+
+void* PrefixTable::CompiledLookup(const IPAddr& addr) const
+	{
+	const uint32_t* bytes;
+	addr.GetBytes(&bytes);
+
+	uint64 hi;
+	uint64 lo;
+	const TrieNode* n;
+
+	if ( addr.GetFamily() == IPv4 )
+		{
+		hi = uint64(ntohl(bytes[3])) << 32;
+		lo = 0;
+		n = &nodes[root4];
+		}
+	else
+		{
+		hi = (uint64(ntohl(bytes[0])) << 32) | ntohl(bytes[1]);
+		lo = (uint64(ntohl(bytes[2])) << 32) | ntohl(bytes[3]);
+		n = &nodes[root6];
+		}
+
+	for ( int depth = 0; ; depth += 6 )
+		{
+		int slot = trie_slot(hi, lo, depth);
+
+		if ( n->children & (uint64(1) << slot) )
+			{
+			n = &nodes[n->first_child + trie_rank(n->children, slot) - 1];
+			continue;
+			}
+
+		return values[leaves[n->first_leaf + trie_rank(n->leaves, slot) - 1]];
+		}
+	}
+
+unsigned int PrefixTable::MemoryAllocation() const
+	{
+	return padded_sizeof(*this) +
+		tree->num_active_node * (padded_sizeof(patricia_node_t) +
+					 padded_sizeof(prefix_t)) +
+		nodes.capacity() * sizeof(TrieNode) +
+		leaves.capacity() * sizeof(uint32) +
+		values.capacity() * sizeof(void*);
+	}
@@ -1,6 +1,8 @@
 #ifndef PREFIXTABLE_H
 #define PREFIXTABLE_H
 
+#include <vector>
+
 #include "Val.h"
 #include "net_util.h"
 #include "IPAddr.h"
@@ -10,7 +12,8 @@ extern "C" {
 }
 
 class PrefixTable {
-private:
+public:
+	// Position of an iteration over the table, see InitIterator().
 	struct iterator {
 		patricia_node_t* Xstack[PATRICIA_MAXBITS+1];
 		patricia_node_t** Xsp;
@@ -18,8 +21,14 @@ private:
 		patricia_node_t* Xnode;
 	};
 
-public:
-	PrefixTable()	{ tree = New_Patricia(128); }
+	PrefixTable()
+		{
+		tree = New_Patricia(128);
+		num_prefixes = 0;
+		compiled = false;
+		lookups_since_change = 0;
+		}
+
 	~PrefixTable()	{ Destroy_Patricia(tree, 0); }
 
 	// Addr in network byte order. If data is zero, acts like a set.
@@ -44,16 +53,80 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const Val* value);
 
-	void Clear()	{ Clear_Patricia(tree, 0); }
+	void Clear()
+		{
+		Clear_Patricia(tree, 0);
+		num_prefixes = 0;
+		Invalidate();
+		}
 
 	iterator InitIterator();
 	void* GetNext(iterator* i);
 
+	// Compiles the current prefixes into a compact multibit trie that
+	// then serves longest-prefix matches of single addresses, until
+	// the next change. Lookups do this by themselves once they have
+	// been frequent enough since the last change to amortize the
+	// build; calling it directly makes sense after loading a large
+	// set of prefixes at once.
+	void Build() const;
+
+	// Returns the number of prefixes in the table.
+	uint64 Size() const	{ return num_prefixes; }
+
+	unsigned int MemoryAllocation() const;
+
 private:
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	// A node of the compiled trie. Each node consumes six bits of the
+	// address, and so has 64 slots. Slots either lead to a child node
+	// or end in a leaf holding the longest match. The children of a
+	// node are stored adjacently, as are its leaves, with runs of slots
+	// sharing the same leaf collapsed into one. Bitmaps then locate a
+	// slot's child or leaf by counting set bits.
+	struct TrieNode {
+		uint64 children;	// slots that have a child node
+		uint64 leaves;	// slots that start a new run of leaves
+		uint32 first_child;	// index into nodes
+		uint32 first_leaf;	// index into leaves
+	};
+
+	// A prefix while compiling, with its address as two 64-bit halves.
+	struct TriePrefix {
+		uint64 hi;
+		uint64 lo;
+		int len;
+		uint32 value;	// index into values
+	};
+
+	void Invalidate()
+		{
+		compiled = false;
+		lookups_since_change = 0;
+		std::vector<TrieNode>().swap(nodes);
+		std::vector<uint32>().swap(leaves);
+		std::vector<void*>().swap(values);
+		}
+
+	void BuildNode(uint32 node, int depth,
+		       const std::vector<const TriePrefix*>& prefixes,
+		       uint32 inherited) const;
+	void* CompiledLookup(const IPAddr& addr) const;
+
 	patricia_tree_t* tree;
+	uint64 num_prefixes;
+
+	// The compiled trie, if compiled is true. It has one root for
+	// IPv4 addresses and one for the rest.
+	mutable bool compiled;
+	mutable uint64 lookups_since_change;
+	mutable std::vector<TrieNode> nodes;
+	mutable std::vector<uint32> leaves;	// indices into values
+	mutable std::vector<void*> values;	// values[0] means no match
+	mutable uint32 root4;
+	mutable uint32 root6;
 };
 
 #endif
@@ -14,6 +14,7 @@ public:
 	virtual ~PQ_Element()	{ }
 
 	double Time() const	{ return time; }
+	void SetTime(double t)	{ time = t; }
 
 	int Offset() const	{ return offset; }
 	void SetOffset(int off)	{ offset = off; }
@@ -4,12 +4,16 @@
 
 #include <stdlib.h>
 #include <utility>
+#include <list>
+#include <string>
+#include <unordered_map>
 
 #include "RE.h"
 #include "DFA.h"
 #include "CCL.h"
 #include "EquivClass.h"
 #include "Serializer.h"
+#include "Metrics.h"
 
 CCL* curr_ccl = 0;
 
@@ -30,6 +34,7 @@ Specific_RE_Matcher::Specific_RE_Matcher(match_type arg_mt, int arg_multiline)
 	dfa = 0;
 	ecs = 0;
 	accepted = new AcceptingSet();
+	ref_cnt = 1;
 	}
 
 Specific_RE_Matcher::~Specific_RE_Matcher()
@@ -37,7 +42,7 @@ Specific_RE_Matcher::~Specific_RE_Matcher()
 	for ( int i = 0; i < ccl_list.length(); ++i )
 		delete ccl_list[i];
 
-	Unref(dfa);
+	::Unref(dfa);
 	delete [] pattern_text;
 	delete accepted;
 	}
@@ -119,7 +124,7 @@ int Specific_RE_Matcher::Compile(int lazy)
 
 	dfa = new DFA_Machine(nfa, EC());
 
-	Unref(nfa); 
+	::Unref(nfa); 
 	nfa = 0;
 
 	ecs = EC()->EquivClasses();
@@ -226,6 +231,39 @@ int Specific_RE_Matcher::MatchAll(const u_char* bv, int n)
 	}
 
 
+int Specific_RE_Matcher::MatchSet(const BroString* s, AcceptingSet* matches)
+	{
+	if ( ! dfa )
+		return 0;
+
+	size_t old_size = matches->size();
+	const u_char* bv = s->Bytes();
+	int n = s->Len();
+
+	DFA_State* d = dfa->StartState();
+	d = d->Xtion(ecs[SYM_BOL], dfa);
+
+	for ( int i = 0; d; ++i )
+		{
+		if ( d->Accept() )
+			matches->insert(d->Accept()->begin(), d->Accept()->end());
+
+		if ( i == n )
+			{
+			d = d->Xtion(ecs[SYM_EOL], dfa);
+
+			if ( d && d->Accept() )
+				matches->insert(d->Accept()->begin(), d->Accept()->end());
+
+			break;
+			}
+
+		d = d->Xtion(ecs[bv[i]], dfa);
+		}
+
+	return matches->size() - old_size;
+	}
+
 int Specific_RE_Matcher::Match(const u_char* bv, int n)
 	{
 	if ( ! dfa )
@@ -264,6 +302,19 @@ void Specific_RE_Matcher::Dump(FILE* f)
 	dfa->Dump(f);
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	Unref(current_state);
+	current_state = 0;
+	accepted_matches.clear();
+	}
+
 inline void RE_Match_State::AddMatches(const AcceptingSet& as,
                                        MatchPos position)
 	{
@@ -276,6 +327,8 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 bool RE_Match_State::Match(const u_char* bv, int n,
 				bool bol, bool eol, bool clear)
 	{
+	DFA_State* old_state = current_state;
+
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
@@ -296,7 +349,10 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 		current_state = dfa->StartState();
 
 	if ( ! current_state )
+		{
+		Unref(old_state);
 		return false;
+		}
 
 	current_pos = 0;
 
@@ -333,6 +389,14 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 		current_state = next_state;
 		}
 
+	if ( current_state != old_state )
+		{
+		if ( current_state )
+			Ref(current_state);
+
+		Unref(old_state);
+		}
+
 	return accepted_matches.size() != old_matches;
 	}
 
@@ -408,10 +472,19 @@ RE_Matcher::RE_Matcher(const char* pat)
 	AddPat(pat);
 	}
 
+RE_Matcher::RE_Matcher(const char* exact_pat, const char* anywhere_pat)
+	{
+	re_anywhere = new Specific_RE_Matcher(MATCH_ANYWHERE);
+	re_anywhere->SetPat(anywhere_pat);
+
+	re_exact = new Specific_RE_Matcher(MATCH_EXACTLY);
+	re_exact->SetPat(exact_pat);
+	}
+
 RE_Matcher::~RE_Matcher()
 	{
-	delete re_anywhere;
-	delete re_exact;
+	re_anywhere->Unref();
+	re_exact->Unref();
 	}
 
 void RE_Matcher::AddPat(const char* new_pat)
@@ -420,9 +493,150 @@ void RE_Matcher::AddPat(const char* new_pat)
 	re_exact->AddPat(new_pat);
 	}
 
+// Compiled matchers by their pattern text, so that patterns that scripts
+// build over and over, say from strings, get compiled just once. It's
+// bounded, with the least recently used ones going first; they stay
+// around as long as RE_Matchers still use them.
+class RE_Cache {
+public:
+	RE_Cache();
+
+	// Replaces *m, uncompiled, with a compiled matcher for the same
+	// pattern. Returns false if the pattern doesn't compile.
+	bool Compile(Specific_RE_Matcher** m, int lazy);
+
+	void GetStats(RE_Matcher::CacheStats* stats) const
+		{
+		stats->size = entries.size();
+		stats->hits = hits;
+		stats->misses = misses;
+		stats->evictions = evictions;
+		}
+
+protected:
+	typedef std::pair<std::string, Specific_RE_Matcher*> Entry;
+	typedef std::list<Entry> EntryList;
+
+	static const size_t MAX_ENTRIES = 1024;
+
+	EntryList entries;	// most recently used first
+	std::unordered_map<std::string, EntryList::iterator> index;
+
+	uint64 hits;
+	uint64 misses;
+	uint64 evictions;
+};
+
+static RE_Cache* re_cache();
+
+static double re_cache_size()
+	{
+	RE_Matcher::CacheStats s;
+	re_cache()->GetStats(&s);
+	return s.size;
+	}
+
+static double re_cache_hits()
+	{
+	RE_Matcher::CacheStats s;
+	re_cache()->GetStats(&s);
+	return s.hits;
+	}
+
+static double re_cache_misses()
+	{
+	RE_Matcher::CacheStats s;
+	re_cache()->GetStats(&s);
+	return s.misses;
+	}
+
+static double re_cache_evictions()
+	{
+	RE_Matcher::CacheStats s;
+	re_cache()->GetStats(&s);
+	return s.evictions;
+	}
+
+RE_Cache::RE_Cache()
+	{
+	hits = misses = evictions = 0;
+
+	metrics::registry()->NewCallbackGauge("patterns.cache_size",
+					      "Compiled patterns in the cache.",
+					      re_cache_size);
+	metrics::registry()->NewCallbackCounter("patterns.cache_hits",
+						"Pattern compilations saved by the cache.",
+						re_cache_hits);
+	metrics::registry()->NewCallbackCounter("patterns.cache_misses",
+						"Patterns compiled and added to the cache.",
+						re_cache_misses);
+	metrics::registry()->NewCallbackCounter("patterns.cache_evictions",
+						"Compiled patterns dropped from the cache.",
+						re_cache_evictions);
+	}
+
+bool RE_Cache::Compile(Specific_RE_Matcher** m, int lazy)
+	{
+	Specific_RE_Matcher* sm = *m;
+
+	if ( ! sm->PatternText() )
+		return sm->Compile(lazy);
+
+	std::string key;
+	key += char('0' + sm->MatchType());
+	key += char('0' + sm->Multiline());
+	key += sm->PatternText();
+
+	auto i = index.find(key);
+
+	if ( i != index.end() )
+		{
+		entries.splice(entries.begin(), entries, i->second);
+
+		sm->Unref();
+		*m = i->second->second;
+		(*m)->Ref();
+
+		++hits;
+		return true;
+		}
+
+	if ( ! sm->Compile(lazy) )
+		return false;
+
+	++misses;
+
+	sm->Ref();
+	entries.push_front(Entry(key, sm));
+	index[key] = entries.begin();
+
+	if ( entries.size() > MAX_ENTRIES )
+		{
+		index.erase(entries.back().first);
+		entries.back().second->Unref();
+		entries.pop_back();
+		++evictions;
+		}
+
+	return true;
+	}
+
+// Never deleted, since patterns may go away late during termination.
+static RE_Cache* re_cache()
+	{
+	static RE_Cache* c = new RE_Cache();
+	return c;
+	}
+
 int RE_Matcher::Compile(int lazy)
 	{
-	return re_anywhere->Compile(lazy) && re_exact->Compile(lazy);
+	return re_cache()->Compile(&re_anywhere, lazy) &&
+		re_cache()->Compile(&re_exact, lazy);
+	}
+
+void RE_Matcher::GetCacheStats(CacheStats* stats)
+	{
+	re_cache()->GetStats(stats);
 	}
 
 bool RE_Matcher::Serialize(SerialInfo* info) const
@@ -52,6 +52,14 @@ public:
 	Specific_RE_Matcher(match_type mt, int multiline=0);
 	~Specific_RE_Matcher();
 
+	// Compiled matchers that RE_Matchers share through the cache of
+	// them are reference-counted; all others just get deleted.
+	void Ref()	{ ++ref_cnt; }
+	void Unref()	{ if ( --ref_cnt == 0 ) delete this; }
+
+	match_type MatchType() const	{ return mt; }
+	int Multiline() const	{ return multiline; }
+
 	void AddPat(const char* pat);
 
 	void SetPat(const char* pat)	{ pattern_text = copy_string(pat); }
@@ -84,6 +92,11 @@ public:
 	// to the matching expressions.  (idx must not contain zeros).
 	int CompileSet(const string_list& set, const int_list& idx);
 
+	// For a matcher built with CompileSet(), scans all of s and adds
+	// the indices of all expressions that match somewhere in it to
+	// matches. Returns the number of indices added.
+	int MatchSet(const BroString* s, AcceptingSet* matches);
+
 	// Returns the position in s just beyond where the first match
 	// occurs, or 0 if there is no such position in s.  Note that
 	// if the pattern matches empty strings, matching continues
@@ -129,6 +142,7 @@ protected:
 	DFA_Machine* dfa;
 	CCL* any_ccl;
 	AcceptingSet* accepted;
+	int ref_cnt;
 };
 
 class RE_Match_State {
@@ -141,22 +155,24 @@ public:
 		current_state = 0;
 		}
 
+	~RE_Match_State();
+
 	const AcceptingMatchSet& AcceptedMatches() const
 		{ return accepted_matches; }
 
 	// Returns the number of bytes feeded into the matcher so far
 	int Length()	{ return current_pos; }
 
+	// Returns true if no further input can lead to a match, short of
+	// starting over.
+	bool Exhausted() const
+		{ return ! dfa || (current_pos >= 0 && ! current_state); }
+
 	// Returns true if this inputs leads to at least one new match.
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = 0;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
@@ -165,6 +181,9 @@ protected:
 	int* ecs;
 
 	AcceptingMatchSet accepted_matches;
+
+	// We hold a reference to the current state between calls to
+	// Match(), so that it stays around if evicted from the DFA's cache.
 	DFA_State* current_state;
 	int current_pos;
 };
@@ -173,13 +192,29 @@ class RE_Matcher : SerialObj {
 public:
 	RE_Matcher();
 	RE_Matcher(const char* pat);
+
+	// Sets up a matcher from the texts that PatternText() and
+	// AnywherePatternText() return; it still needs compiling.
+	RE_Matcher(const char* exact_pat, const char* anywhere_pat);
+
 	virtual ~RE_Matcher();
 
 	void AddDef(const char* defn_name, const char* defn_val);
 	void AddPat(const char* pat);
 
+	// Compiles the pattern, or takes a compiled copy from the cache
+	// that all RE_Matchers share if it's been compiled before.
 	int Compile(int lazy = 0);
 
+	struct CacheStats {
+		uint64 size;		// compiled matchers in the cache
+		uint64 hits;		// by Compile()
+		uint64 misses;
+		uint64 evictions;	// to stay within the cache's bound
+	};
+
+	static void GetCacheStats(CacheStats* stats);
+
 	// Returns true if s exactly matches the pattern, false otherwise.
 	int MatchExactly(const char* s)
 		{ return re_exact->MatchAll(s); }
@@ -13,6 +13,7 @@
 */
 
 #include <math.h>
+#include <string.h>
 #include "RandTest.h"
 
 #define log2of10 3.32192809488736234787
@@ -25,8 +26,9 @@ static double rt_log2(double x)
 // RT_INCIRC = pow(pow(256.0, (double) (RT_MONTEN / 2)) - 1, 2.0);
 #define RT_INCIRC 281474943156225.0
 
-RandTest::RandTest()
+RandTest::RandTest(bool arg_histogram_only)
 	{
+	histogram_only = arg_histogram_only;
 	totalc = 0;
 	mp = 0;
 	sccfirst = 1;
@@ -42,51 +44,141 @@ RandTest::RandTest()
 void RandTest::add(const void *buf, int bufl)
 	{
 	const unsigned char *bp = static_cast<const unsigned char*>(buf);
-	int oc;
 
-	while (bufl-- > 0)
+	if (bufl <= 0)
+		return;
+
+	add_counts(bp, bufl);
+	totalc += bufl;
+
+	if (histogram_only)
+		return;
+
+	add_monte(bp, bufl);
+	add_scc(bp, bufl);
+	}
+
+// Below this, setting up separate bins costs more than it saves.
+#define RT_SPLIT_BINS_MIN 1024
+
+void RandTest::add_counts(const unsigned char* bp, int bufl)
+	{
+	if (bufl < RT_SPLIT_BINS_MIN)
 		{
-		oc = *bp++;
-		ccount[oc]++;   /* Update counter for this bin */
-		totalc++;
-
-		/* Update inside / outside circle counts for Monte Carlo
- 		   computation of PI */
-		monte[mp++] = oc;  /* Save character for Monte Carlo */
-		if (mp >= RT_MONTEN)  /* Calculate every RT_MONTEN character */
-			{
-			mp = 0;
-			mcount++;
-			montex = 0;
-			montey = 0;
-			for (int mj=0; mj < RT_MONTEN/2; mj++)
-				{
-				montex = (montex * 256.0) + monte[mj];
-				montey = (montey * 256.0) + monte[(RT_MONTEN / 2) + mj];
-				}
-			if (montex*montex + montey*montey <= RT_INCIRC)
-				{
-				inmont++;
-				}
-			}
+		while (bufl-- > 0)
+			ccount[*bp++]++;
 
-		/* Update calculation of serial correlation coefficient */
-		if (sccfirst)
-			{
-			sccfirst = 0;
-			scclast = 0;
-			sccu0 = oc;
-			}
-		else
-			{
-			scct1 = scct1 + scclast * oc;
-			}
+		return;
+		}
+
+	/* Count into four sets of bins in turn, so that runs of the same
+	   value don't keep waiting on the same counter.  As bufl is an
+	   int, 32 bits per bin are enough. */
+	uint32 c[4][256];
+	memset(c, 0, sizeof(c));
 
-		scct2 = scct2 + oc;
-		scct3 = scct3 + (oc * oc);
-		scclast = oc;
-		oc <<= 1;
+	int i = 0;
+
+	for (; i + 4 <= bufl; i += 4)
+		{
+		c[0][bp[i]]++;
+		c[1][bp[i + 1]]++;
+		c[2][bp[i + 2]]++;
+		c[3][bp[i + 3]]++;
+		}
+
+	for (; i < bufl; i++)
+		c[0][bp[i]]++;
+
+	for (i = 0; i < 256; i++)
+		ccount[i] += (int64) c[0][i] + c[1][i] + c[2][i] + c[3][i];
+	}
+
+/* Takes RT_MONTEN bytes as a point's co-ordinates, and returns whether
+   the point falls into the circle.  The co-ordinates have at most 24 bits
+   each, so the integer arithmetic is exact, like the floating point one
+   it replaces. */
+static inline bool rt_in_circle(const unsigned char* p, double* x, double* y)
+	{
+	uint64 mx = 0, my = 0;
+
+	for (int mj = 0; mj < RT_MONTEN / 2; mj++)
+		{
+		mx = (mx << 8) | p[mj];
+		my = (my << 8) | p[(RT_MONTEN / 2) + mj];
 		}
+
+	*x = mx;
+	*y = my;
+	return mx * mx + my * my <= (uint64) RT_INCIRC;
+	}
+
+void RandTest::add_monte(const unsigned char* bp, int bufl)
+	{
+	unsigned char point[RT_MONTEN];
+	int i = 0;
+
+	/* Complete the point left over from the previous call. */
+	if (mp > 0)
+		{
+		while (mp < RT_MONTEN && i < bufl)
+			monte[mp++] = bp[i++];
+
+		if (mp < RT_MONTEN)
+			return;
+
+		for (int mj = 0; mj < RT_MONTEN; mj++)
+			point[mj] = monte[mj];
+
+		mp = 0;
+		mcount++;
+
+		if (rt_in_circle(point, &montex, &montey))
+			inmont++;
+		}
+
+	/* Then take the points straight from the buffer. */
+	for (; i + RT_MONTEN <= bufl; i += RT_MONTEN)
+		{
+		mcount++;
+
+		if (rt_in_circle(bp + i, &montex, &montey))
+			inmont++;
+		}
+
+	/* Save the rest for next time. */
+	while (i < bufl)
+		monte[mp++] = bp[i++];
+	}
+
+void RandTest::add_scc(const unsigned char* bp, int bufl)
+	{
+	/* The sums stay exact in 64 bits for any int bufl. */
+	uint64 t1 = 0, t2, t3;
+
+	if (sccfirst)
+		{
+		sccfirst = 0;
+		sccu0 = bp[0];
+		}
+	else
+		t1 = (uint64) scclast * bp[0];
+
+	t2 = bp[0];
+	t3 = bp[0] * bp[0];
+
+	for (int i = 1; i < bufl; i++)
+		{
+		unsigned int oc = bp[i];
+		t1 += bp[i - 1] * oc;
+		t2 += oc;
+		t3 += oc * oc;
+		}
+
+	scct1 += t1;
+	scct2 += t2;
+	scct3 += t3;
+	scclast = bp[bufl - 1];
 	}
 
 void RandTest::end(double* r_ent, double* r_chisq,
@@ -134,6 +226,12 @@ void RandTest::end(double* r_ent, double* r_chisq,
 	   within the circle */
 	montepi = 4.0 * (((double) inmont) / mcount);
 
+	if (histogram_only)
+		{
+		montepi = 0.0;
+		scc = 0.0;
+		}
+
 	/* Return results through arguments */
 	*r_ent = ent;
 	*r_chisq = chisq;
@@ -12,7 +12,10 @@ class EntropyVal;
 
 class RandTest {
 	public:
-		RandTest();
+		// With histogram_only, only the entropy, chi-square and mean
+		// get computed, which is a good deal cheaper; the Monte Carlo
+		// value for pi and the serial correlation then come out as 0.
+		RandTest(bool histogram_only = false);
 		void add(const void* buf, int bufl);
 		void end(double* r_ent, double* r_chisq, double* r_mean,
 		         double* r_montepicalc, double* r_scc);
@@ -20,6 +23,12 @@ class RandTest {
 	private:
 	  friend class EntropyVal;
 
+		void add_counts(const unsigned char* bp, int bufl);
+		void add_monte(const unsigned char* bp, int bufl);
+		void add_scc(const unsigned char* bp, int bufl);
+
+		bool histogram_only;
+
 		int64 ccount[256];  /* Bins to count occurrences of values */
 		int64 totalc;       /* Total bytes counted */
 		int mp;
@@ -10,13 +10,47 @@
 
 static const bool DEBUG_reassem = false;
 
+// Chunks start small so that connections with little data don't pay for
+// much more than they use, and double up to this size.
+static const uint64 MIN_CHUNK_SIZE = 1024;
+static const uint64 MAX_CHUNK_SIZE = 65536;
+
+DataChunk::DataChunk(uint64 arg_size, ReassemblerType reassem_type)
+	{
+	size = arg_size;
+	used = 0;
+	refs = 1;
+	rtype = reassem_type;
+	data = new u_char[size];
+
+	Reassembler::sizes[rtype] += pad_size(size);
+	Reassembler::total_size += pad_size(size);
+	}
+
+DataChunk::~DataChunk()
+	{
+	Reassembler::sizes[rtype] -= pad_size(size);
+	Reassembler::total_size -= pad_size(size);
+	delete [] data;
+	}
+
 DataBlock::DataBlock(const u_char* data, uint64 size, uint64 arg_seq,
 		     DataBlock* arg_prev, DataBlock* arg_next,
-		     ReassemblerType reassem_type)
+		     ReassemblerType reassem_type, DataChunk* arg_chunk)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
+	chunk = arg_chunk;
+
+	uint64 mem = padded_sizeof(DataBlock);
+
+	if ( chunk )
+		block = chunk->Alloc(size);
+	else
+		{
+		block = new u_char[size];
+		mem += pad_size(size);
+		}
 
 	memcpy((void*) block, (const void*) data, size);
 
@@ -29,12 +63,25 @@ DataBlock::DataBlock(const u_char* data, uint64 size, uint64 arg_seq,
 		next->prev = this;
 
 	rtype = reassem_type;
-	Reassembler::sizes[rtype] += pad_size(size) + padded_sizeof(DataBlock);
-	Reassembler::total_size += pad_size(size) + padded_sizeof(DataBlock);
+	Reassembler::sizes[rtype] += mem;
+	Reassembler::total_size += mem;
 	}
 
 uint64 Reassembler::total_size = 0;
 uint64 Reassembler::sizes[REASSEM_NUM];
+uint64 Reassembler::num_releases = 0;
+uint64 Reassembler::bytes_released = 0;
+Reassembler* Reassembler::buffering = 0;
+
+Reassembler::Reassembler()
+	{
+	blocks = last_block = 0;
+	old_blocks = last_old_block = 0;
+	total_old_blocks = max_old_blocks = 0;
+	chunk = 0;
+	mem_size = 0;
+	prev_buffering = next_buffering = 0;
+	}
 
 Reassembler::Reassembler(uint64 init_seq, ReassemblerType reassem_type)
 	{
@@ -43,12 +90,18 @@ Reassembler::Reassembler(uint64 init_seq, ReassemblerType reassem_type)
 	total_old_blocks = max_old_blocks = 0;
 	trim_seq = last_reassem_seq = init_seq;
 	rtype = reassem_type;
+	chunk = 0;
+	mem_size = 0;
+	prev_buffering = next_buffering = 0;
 	}
 
 Reassembler::~Reassembler()
 	{
 	ClearBlocks();
 	ClearOldBlocks();
+
+	if ( chunk )
+		chunk->Unref();
 	}
 
 void Reassembler::CheckOverlap(DataBlock *head, DataBlock *tail,
@@ -66,7 +119,8 @@ void Reassembler::CheckOverlap(DataBlock *head, DataBlock *tail,
 		const u_char* ndata = data;
 
 		if ( nupper <= b->seq )
-			continue;
+			// Blocks are ordered, so none of the others overlap.
+			break;
 
 		if ( nseq >= b->upper )
 			continue;
@@ -101,7 +155,7 @@ void Reassembler::NewBlock(double t, uint64 seq, uint64 len, const u_char* data)
 		// Old data, don't do any work for it.
 		return;
 
-	CheckOverlap(blocks, last_block, seq, len, data);
+	CheckOverlap(FindBlock(seq), last_block, seq, len, data);
 
 	if ( seq < trim_seq )
 		{ // Partially old data, just keep the good stuff.
@@ -116,7 +170,7 @@ void Reassembler::NewBlock(double t, uint64 seq, uint64 len, const u_char* data)
 
 	if ( ! blocks )
 		blocks = last_block = start_block =
-			new DataBlock(data, len, seq, 0, 0, rtype);
+			NewDataBlock(data, len, seq, 0, 0);
 	else
 		start_block = AddAndCheck(blocks, seq, upper_seq, data);
 
@@ -169,6 +223,8 @@ uint64 Reassembler::TrimToSeq(uint64 seq)
 				num_missing += seq - blocks->upper;
 			}
 
+		block_index.erase(blocks->seq);
+
 		if ( max_old_blocks )
 			{
 			// Move block over to old_blocks queue.
@@ -191,14 +247,14 @@ uint64 Reassembler::TrimToSeq(uint64 seq)
 			while ( old_blocks && total_old_blocks > max_old_blocks )
 				{
 				DataBlock* next = old_blocks->next;
-				delete old_blocks;
+				DeleteBlock(old_blocks);
 				old_blocks = next;
 				total_old_blocks--;
 				}
 			}
 
 		else
-			delete blocks;
+			DeleteBlock(blocks);
 
 		blocks = b;
 		}
@@ -228,11 +284,12 @@ void Reassembler::ClearBlocks()
 	while ( blocks )
 		{
 		DataBlock* b = blocks->next;
-		delete blocks;
+		DeleteBlock(blocks);
 		blocks = b;
 		}
 
 	last_block = 0;
+	block_index.clear();
 	}
 
 void Reassembler::ClearOldBlocks()
@@ -240,11 +297,12 @@ void Reassembler::ClearOldBlocks()
 	while ( old_blocks )
 		{
 		DataBlock* b = old_blocks->next;
-		delete old_blocks;
+		DeleteBlock(old_blocks);
 		old_blocks = b;
 		}
 
 	last_old_block = 0;
+	total_old_blocks = 0;
 	}
 
 uint64 Reassembler::TotalSize() const
@@ -280,21 +338,18 @@ DataBlock* Reassembler::AddAndCheck(DataBlock* b, uint64 seq, uint64 upper,
 	// Special check for the common case of appending to the end.
 	if ( last_block && seq == last_block->upper )
 		{
-		last_block = new DataBlock(data, upper - seq, seq,
-					   last_block, 0, rtype);
+		last_block = NewDataBlock(data, upper - seq, seq, last_block, 0);
 		return last_block;
 		}
 
 	// Find the first block that doesn't come completely before the
 	// new data.
-	while ( b->next && b->upper <= seq )
-		b = b->next;
+	b = FindBlock(seq);
 
-	if ( b->upper <= seq )
+	if ( ! b )
 		{
-		// b is the last block, and it comes completely before
-		// the new block.
-		last_block = new DataBlock(data, upper - seq, seq, b, 0, rtype);
+		// The last block comes completely before the new block.
+		last_block = NewDataBlock(data, upper - seq, seq, last_block, 0);
 		return last_block;
 		}
 
@@ -303,7 +358,7 @@ DataBlock* Reassembler::AddAndCheck(DataBlock* b, uint64 seq, uint64 upper,
 	if ( upper <= b->seq )
 		{
 		// The new block comes completely before b.
-		new_b = new DataBlock(data, upper - seq, seq, b->prev, b, rtype);
+		new_b = NewDataBlock(data, upper - seq, seq, b->prev, b);
 		if ( b == blocks )
 			blocks = new_b;
 		return new_b;
@@ -314,7 +369,7 @@ DataBlock* Reassembler::AddAndCheck(DataBlock* b, uint64 seq, uint64 upper,
 		{
 		// The new block has a prefix that comes before b.
 		uint64 prefix_len = b->seq - seq;
-		new_b = new DataBlock(data, prefix_len, seq, b->prev, b, rtype);
+		new_b = NewDataBlock(data, prefix_len, seq, b->prev, b);
 		if ( b == blocks )
 			blocks = new_b;
 
@@ -348,11 +403,182 @@ DataBlock* Reassembler::AddAndCheck(DataBlock* b, uint64 seq, uint64 upper,
 	return new_b;
 	}
 
+DataBlock* Reassembler::NewDataBlock(const u_char* data, uint64 size,
+					uint64 seq, DataBlock* prev, DataBlock* next)
+	{
+	if ( next )
+		{
+		// Out of order, which we expect to be rare enough to not
+		// bother with chunks.
+		DataBlock* b = new DataBlock(data, size, seq, prev, next, rtype);
+		block_index[seq] = b;
+		AddMemory(b);
+		return b;
+		}
+
+	if ( size > MAX_CHUNK_SIZE / 2 )
+		// Not worth sharing a chunk.
+		return NewIndexedBlock(new DataBlock(data, size, seq, prev, 0, rtype));
+
+	if ( ! chunk || chunk->Available() < size )
+		{
+		uint64 chunk_size = chunk ? 2 * chunk->Size() : MIN_CHUNK_SIZE;
+
+		while ( chunk_size < size )
+			chunk_size *= 2;
+
+		if ( chunk_size > MAX_CHUNK_SIZE )
+			chunk_size = MAX_CHUNK_SIZE;
+
+		if ( chunk )
+			chunk->Unref();
+
+		chunk = new DataChunk(chunk_size, rtype);
+		}
+
+	return NewIndexedBlock(new DataBlock(data, size, seq, prev, 0, rtype, chunk));
+	}
+
+DataBlock* Reassembler::NewIndexedBlock(DataBlock* b)
+	{
+	// Appending, which the hint makes constant time.
+	block_index.insert(block_index.end(), block_map::value_type(b->seq, b));
+	AddMemory(b);
+	return b;
+	}
+
+void Reassembler::AddMemory(const DataBlock* b)
+	{
+	if ( ! mem_size )
+		{
+		// Starts buffering.
+		prev_buffering = 0;
+		next_buffering = buffering;
+
+		if ( buffering )
+			buffering->prev_buffering = this;
+
+		buffering = this;
+		}
+
+	mem_size += padded_sizeof(DataBlock) + pad_size(b->Size());
+	}
+
+void Reassembler::DeleteBlock(DataBlock* b)
+	{
+	mem_size -= padded_sizeof(DataBlock) + pad_size(b->Size());
+
+	if ( ! mem_size )
+		{
+		if ( prev_buffering )
+			prev_buffering->next_buffering = next_buffering;
+		else
+			buffering = next_buffering;
+
+		if ( next_buffering )
+			next_buffering->prev_buffering = prev_buffering;
+
+		prev_buffering = next_buffering = 0;
+		}
+
+	delete b;
+	}
+
+void Reassembler::ReleaseBlocks()
+	{
+	// Give up on all holes, delivering whatever we have.
+	if ( last_block && last_block->upper > trim_seq )
+		TrimToSeq(last_block->upper);
+
+	ClearBlocks();
+	ClearOldBlocks();
+	}
+
+void Reassembler::EnforceMemoryLimit(uint64 limit)
+	{
+	if ( ! limit || total_size <= limit )
+		return;
+
+	// Go a bit below the limit so that we don't end up here again
+	// right away.
+	uint64 target = limit - limit / 10;
+
+	while ( total_size > target && buffering )
+		{
+		Reassembler* victim = buffering;
+
+		for ( Reassembler* r = buffering->next_buffering; r;
+		      r = r->next_buffering )
+			{
+			if ( r->mem_size > victim->mem_size )
+				victim = r;
+			}
+
+		uint64 size = victim->mem_size;
+
+		++num_releases;
+		bytes_released += size;
+		victim->ReleaseBlocks();
+
+		if ( victim->mem_size )
+			{
+			// Delivery may have added data again; make sure we
+			// don't pick it forever.
+			victim->ClearBlocks();
+			victim->ClearOldBlocks();
+			}
+
+		// Its chunk isn't needed anymore either.
+		if ( victim->chunk )
+			{
+			victim->chunk->Unref();
+			victim->chunk = 0;
+			}
+		}
+	}
+
+DataBlock* Reassembler::FindBlock(uint64 seq) const
+	{
+	// The last block starting at or before seq is the only one that
+	// may contain it; otherwise it's the one after.
+	block_map::const_iterator i = block_index.upper_bound(seq);
+
+	if ( i != block_index.begin() )
+		{
+		block_map::const_iterator j = i;
+		--j;
+
+		if ( j->second->upper > seq )
+			return j->second;
+		}
+
+	return i == block_index.end() ? 0 : i->second;
+	}
+
 uint64 Reassembler::MemoryAllocation(ReassemblerType rtype)
 	{
 	return Reassembler::sizes[rtype];
 	}
 
+uint64 Reassembler::MemoryAllocation() const
+	{
+	// We count block data at its size even if it's in a chunk, which
+	// leaves just the chunk's unused space.
+	uint64 mem = padded_sizeof(*this) +
+		block_index.size() * padded_sizeof(block_map::value_type);
+
+	for ( DataBlock* b = blocks; b; b = b->next )
+		mem += padded_sizeof(DataBlock) + pad_size(b->Size());
+
+	for ( DataBlock* b = old_blocks; b; b = b->next )
+		mem += padded_sizeof(DataBlock) + pad_size(b->Size());
+
+	if ( chunk )
+		mem += chunk->Available();
+
+	return mem;
+	}
+
 bool Reassembler::Serialize(SerialInfo* info) const
 	{
 	return SerialObj::Serialize(info);
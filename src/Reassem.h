@@ -3,6 +3,8 @@
 #ifndef reassem_h
 #define reassem_h
 
+#include <map>
+
 #include "Obj.h"
 #include "IPAddr.h"
 
@@ -18,11 +20,47 @@ enum ReassemblerType {
 	REASSEM_NUM,
 };
 
+// Storage shared by the blocks of data that arrive in sequence. Their data
+// gets carved out of the chunk one after the other, rather than each
+// block having its own buffer. The chunk goes away with the last block
+// referencing it.
+class DataChunk {
+public:
+	DataChunk(uint64 size, ReassemblerType reassem_type);
+	~DataChunk();
+
+	uint64 Size() const	{ return size; }
+	uint64 Available() const	{ return size - used; }
+
+	// Returns n bytes of the chunk, which must have that much
+	// available. Each call adds a reference.
+	u_char* Alloc(uint64 n)
+		{
+		u_char* p = data + used;
+		used += n;
+		++refs;
+		return p;
+		}
+
+	void Ref()	{ ++refs; }
+	void Unref()	{ if ( --refs == 0 ) delete this; }
+
+private:
+	u_char* data;
+	uint64 size;
+	uint64 used;
+	int refs;
+	ReassemblerType rtype;
+};
+
 class DataBlock {
 public:
+	// If chunk is given, the data is stored there rather than in a
+	// buffer of its own.
 	DataBlock(const u_char* data, uint64 size, uint64 seq,
 		  DataBlock* prev, DataBlock* next,
-		  ReassemblerType reassem_type = REASSEM_UNKNOWN);
+		  ReassemblerType reassem_type = REASSEM_UNKNOWN,
+		  DataChunk* chunk = 0);
 
 	~DataBlock();
 
@@ -32,6 +70,7 @@ public:
 	DataBlock* prev;	// previous block with lower seq #
 	uint64 seq, upper;
 	u_char* block;
+	DataChunk* chunk;	// where block lives, or null if it's our own
 	ReassemblerType rtype;
 };
 
@@ -66,29 +105,82 @@ public:
 	// Data buffered by type of reassembler.
 	static uint64 MemoryAllocation(ReassemblerType rtype);
 
+	// Memory used by this reassembler, including its buffered data.
+	uint64 MemoryAllocation() const;
+
+	// Memory held by our blocks, which unlike MemoryAllocation() comes
+	// at no cost.
+	uint64 BlockMemory() const	{ return mem_size; }
+
+	// If the data buffered by all reassemblers exceeds limit, releases
+	// the largest buffers until it's well below. A limit of zero means
+	// no limit.
+	static void EnforceMemoryLimit(uint64 limit);
+
+	// Number of reassemblers that EnforceMemoryLimit() had to release,
+	// and how much they had buffered.
+	static uint64 NumReleases()	{ return num_releases; }
+	static uint64 BytesReleased()	{ return bytes_released; }
+
 	void SetMaxOldBlocks(uint32 count)	{ max_old_blocks = count; }
 
 protected:
-	Reassembler()	{ }
+	Reassembler();
 
 	DECLARE_ABSTRACT_SERIAL(Reassembler);
 
 	friend class DataBlock;
+	friend class DataChunk;
 
 	virtual void Undelivered(uint64 up_to_seq);
 
 	virtual void BlockInserted(DataBlock* b) = 0;
 	virtual void Overlap(const u_char* b1, const u_char* b2, uint64 n) = 0;
 
+	// Called when we need to free this reassembler's memory to stay
+	// within the global limit. The default gives up on all holes,
+	// delivering what's there, and then drops all blocks.
+	virtual void ReleaseBlocks();
+
 	DataBlock* AddAndCheck(DataBlock* b, uint64 seq,
 				uint64 upper, const u_char* data);
 
 	void CheckOverlap(DataBlock *head, DataBlock *tail,
 				uint64 seq, uint64 len, const u_char* data);
 
+	// Creates a new block linked in between prev and next, and adds it
+	// to the index.
+	DataBlock* NewDataBlock(const u_char* data, uint64 size, uint64 seq,
+				DataBlock* prev, DataBlock* next);
+	DataBlock* NewIndexedBlock(DataBlock* b);
+
+	// Accounts for a new block, and for one going away. The latter
+	// deletes the block, too.
+	void AddMemory(const DataBlock* b);
+	void DeleteBlock(DataBlock* b);
+
+	// Returns the first block that doesn't end at or before seq, or
+	// null if there's none.
+	DataBlock* FindBlock(uint64 seq) const;
+
 	DataBlock* blocks;
 	DataBlock* last_block;
 
+	// Indexes the blocks by their starting sequence number so that we
+	// can find the place for out-of-order data without walking the
+	// list. As blocks never overlap, that's sufficient to locate them.
+	typedef std::map<uint64, DataBlock*> block_map;
+	block_map block_index;
+
+	// Where data appended in sequence goes.
+	DataChunk* chunk;
+
+	// The memory held by our blocks. All reassemblers with a non-zero
+	// amount are linked into a list starting at buffering.
+	uint64 mem_size;
+	Reassembler* prev_buffering;
+	Reassembler* next_buffering;
+
 	DataBlock* old_blocks;
 	DataBlock* last_old_block;
 
@@ -101,13 +193,25 @@ protected:
 
 	static uint64 total_size;
 	static uint64 sizes[REASSEM_NUM];
+	static uint64 num_releases;
+	static uint64 bytes_released;
+	static Reassembler* buffering;
 };
 
 inline DataBlock::~DataBlock()
 	{
-	Reassembler::total_size -= pad_size(upper - seq) + padded_sizeof(DataBlock);
-	Reassembler::sizes[rtype] -= pad_size(upper - seq) + padded_sizeof(DataBlock);
-	delete [] block;
+	uint64 mem = padded_sizeof(DataBlock);
+
+	if ( chunk )
+		chunk->Unref();
+	else
+		{
+		mem += pad_size(upper - seq);
+		delete [] block;
+		}
+
+	Reassembler::total_size -= mem;
+	Reassembler::sizes[rtype] -= mem;
 	}
 
 #endif
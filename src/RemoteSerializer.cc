@@ -192,7 +192,9 @@
 #include "bro_inet_ntop.h"
 #include "iosource/Manager.h"
 #include "logging/Manager.h"
+#include "logging/WriterFrontend.h"
 #include "logging/logging.bif.h"
+#include "Metrics.h"
 
 extern "C" {
 #include "setsignal.h"
@@ -229,9 +231,10 @@ static const char MSG_REMOTE_PRINT = 0x17;
 static const char MSG_LOG_CREATE_WRITER = 0x18;
 static const char MSG_LOG_WRITE = 0x19;
 static const char MSG_REQUEST_LOGS = 0x20;
+static const char MSG_SHM = 0x21;
 
 // Update this one whenever adding a new ID:
-static const char MSG_ID_MAX = MSG_REQUEST_LOGS;
+static const char MSG_ID_MAX = MSG_SHM;
 
 static const uint32 FINAL_SYNC_POINT = /* UINT32_MAX */ 4294967295U;
 
@@ -322,6 +325,7 @@ static const char* msgToStr(int msg)
 	MSG_STR(MSG_LOG_CREATE_WRITER)
 	MSG_STR(MSG_LOG_WRITE)
 	MSG_STR(MSG_REQUEST_LOGS)
+	MSG_STR(MSG_SHM)
 	default:
 		return "UNKNOWN_MSG";
 	}
@@ -494,7 +498,8 @@ static inline bool is_peer_msg(int msg)
 		msg == MSG_REMOTE_PRINT ||
 		msg == MSG_LOG_CREATE_WRITER ||
 		msg == MSG_LOG_WRITE ||
-		msg == MSG_REQUEST_LOGS;
+		msg == MSG_REQUEST_LOGS ||
+		msg == MSG_SHM;
 	}
 
 bool RemoteSerializer::IsConnectedPeer(PeerID id)
@@ -522,6 +527,32 @@ public:
 	RemoteSerializer::Peer* peer;
 };
 
+class AccessBatchTimer : public Timer {
+public:
+	AccessBatchTimer(double t) : Timer(t, TIMER_REMOTE_ACCESS_BATCH)	{}
+
+	virtual void Dispatch(double t, int is_expire)
+		{
+		remote_serializer->access_timer_pending = false;
+		remote_serializer->FlushAccesses();
+		}
+};
+
+static double events_shared()
+	{
+	return remote_serializer ? remote_serializer->EventsShared() : 0;
+	}
+
+static double event_bytes_shared()
+	{
+	return remote_serializer ? remote_serializer->EventBytesShared() : 0;
+	}
+
+static double accesses_merged()
+	{
+	return remote_serializer ? remote_serializer->AccessesMerged() : 0;
+	}
+
 RemoteSerializer::RemoteSerializer()
 	{
 	initialized = false;
@@ -542,6 +573,17 @@ RemoteSerializer::RemoteSerializer()
 	current_msgtype = 0;
 	current_args = 0;
 	source_peer = 0;
+	access_timer_pending = false;
+
+	metrics::registry()->NewCallbackCounter("remote.events_shared",
+						"Events sent to a peer without serializing them for it.",
+						events_shared);
+	metrics::registry()->NewCallbackCounter("remote.event_bytes_shared",
+						"Bytes of event serializations shared between peers.",
+						event_bytes_shared);
+	metrics::registry()->NewCallbackCounter("remote.accesses_merged",
+						"Accesses to synchronized state merged into an earlier one.",
+						accesses_merged);
 
 	// Register as a "dont-count" source first, we may change that later.
 	iosource_mgr->Register(this, true);
@@ -742,6 +784,8 @@ bool RemoteSerializer::CloseConnection(PeerID id)
 
 bool RemoteSerializer::CloseConnection(Peer* peer)
 	{
+	FlushAccesses();
+
 	if ( peer->suspended_processing )
 		{
 		net_continue_processing();
@@ -919,6 +963,8 @@ bool RemoteSerializer::SendCall(SerialInfo* info, PeerID id,
 bool RemoteSerializer::SendCall(SerialInfo* info, Peer* peer,
 					const char* name, val_list* vl)
 	{
+	FlushAccesses();
+
 	if ( peer->phase != Peer::RUNNING || terminating )
 		return false;
 
@@ -935,24 +981,108 @@ bool RemoteSerializer::SendCall(SerialInfo* info, Peer* peer,
 	return true;
 	}
 
+bool RemoteSerializer::SendCall(SerialInfo* info, const std::vector<PeerID>& ids,
+				const char* name, val_list* vl)
+	{
+	if ( ! using_communication || terminating )
+		return true;
+
+	std::vector<Peer*> to;
+	to.reserve(ids.size());
+
+	for ( size_t i = 0; i < ids.size(); ++i )
+		{
+		Peer* peer = LookupPeer(ids[i], true);
+		if ( peer && peer->phase == Peer::RUNNING )
+			to.push_back(peer);
+		}
+
+	return SendCall(info, to, name, vl);
+	}
+
+int RemoteSerializer::ShareKey(const SerialInfo* info, const Peer* peer) const
+	{
+	// With caching, a serialization refers to what the peer's cache
+	// holds, so it's the peer's alone.
+	if ( info->cache && ! (peer->caps & Peer::NO_CACHING) )
+		return -1;
+
+	// Otherwise it only depends on what SetupSerialInfo() takes from
+	// the capabilities.
+	return ((peer->caps & Peer::PID_64BIT) ? 1 : 0) |
+		((peer->caps & Peer::NEW_CACHE_STRATEGY) ? 2 : 0) |
+		((peer->caps & Peer::BROCCOLI_PEER) ? 4 : 0);
+	}
+
+bool RemoteSerializer::SendCall(SerialInfo* info, const std::vector<Peer*>& to,
+				const char* name, val_list* vl)
+	{
+	// The first peer for each key serializes, the others get its chunk.
+	ChunkedIO::Chunk* shared[8] = { 0 };
+	bool result = true;
+
+	for ( size_t i = 0; i < to.size(); ++i )
+		{
+		Peer* peer = to[i];
+		int key = ShareKey(info, peer);
+
+		if ( key >= 0 && shared[key] && peer->phase == Peer::RUNNING )
+			{
+			++stats.events.out;
+			++stats.events_shared;
+			stats.event_bytes_shared += shared[key]->len;
+
+			if ( ! io->Write(makeSerialMsg(peer->id)) ||
+			     ! io->Write(shared[key]->Share()) )
+				{
+				FatalError(io->Error());
+				result = false;
+				break;
+				}
+
+			continue;
+			}
+
+		SerialInfo new_info(*info);
+		new_info.share_chunk = (key >= 0);
+
+		bool ok = SendCall(&new_info, peer, name, vl);
+
+		if ( key >= 0 )
+			shared[key] = new_info.shared_chunk;
+
+		if ( ! ok )
+			{
+			result = false;
+			break;
+			}
+		}
+
+	for ( int i = 0; i < 8; ++i )
+		delete shared[i];
+
+	return result;
+	}
+
 bool RemoteSerializer::SendCall(SerialInfo* info, const char* name,
 				val_list* vl)
 	{
 	if ( ! IsOpen() || ! PropagateAccesses() || terminating )
 		return true;
 
+	std::vector<Peer*> to;
+	to.reserve(peers.length());
+
 	loop_over_list(peers, i)
 		{
 		// Do not send event back to originating peer.
 		if ( peers[i] == current_peer )
 			continue;
 
-		SerialInfo new_info(*info);
-		if ( ! SendCall(&new_info, peers[i], name, vl) )
-			return false;
+		to.push_back(peers[i]);
 		}
 
-	return true;
+	return SendCall(info, to, name, vl);
 	}
 
 bool RemoteSerializer::SendAccess(SerialInfo* info, Peer* peer,
@@ -984,6 +1114,8 @@ bool RemoteSerializer::SendAccess(SerialInfo* info, Peer* peer,
 bool RemoteSerializer::SendAccess(SerialInfo* info, PeerID pid,
 					const StateAccess& access)
 	{
+	FlushAccesses();
+
 	Peer* p = LookupPeer(pid, false);
 	if ( ! p )
 		return true;
@@ -996,13 +1128,100 @@ bool RemoteSerializer::SendAccess(SerialInfo* info, const StateAccess& access)
 	if ( ! IsOpen() || ! PropagateAccesses() || terminating )
 		return true;
 
+	if ( remote_access_batch_interval > 0 && access.Deferrable() )
+		{
+		QueueAccess(access);
+		return true;
+		}
+
+	if ( ! FlushAccesses() )
+		return false;
+
+	return BroadcastAccess(info, access, source_peer ? source_peer->id : PEER_NONE);
+	}
+
+void RemoteSerializer::QueueAccess(const StateAccess& access)
+	{
+	PeerID source = source_peer ? source_peer->id : PEER_NONE;
+	const ID* target = access.Target();
+
+	HashKey* k = access.TableIndex();
+	std::string index = k ? std::string((const char*) k->Key(), k->Size()) : "";
+	delete k;
+
+	access_index& indices = pending_access_index[target];
+	access_index::iterator i = indices.find(index);
+
+	if ( i != indices.end() )
+		{
+		// That's the latest access to the same place, so nothing in
+		// between depends on it.
+		PendingAccess& p = pending_accesses[i->second];
+
+		if ( p.source == source && p.access->Absorb(access) )
+			{
+			++stats.accesses_merged;
+			return;
+			}
+		}
+
+	if ( index.empty() )
+		// An access to the target as a whole; none to any of its
+		// indices may go before it anymore.
+		indices.clear();
+
+	PendingAccess p = { new StateAccess(access), source };
+	indices[index] = pending_accesses.size();
+	pending_accesses.push_back(p);
+
+	if ( pending_accesses.size() >= MAX_PENDING_ACCESSES )
+		{
+		SendPendingAccesses();
+		return;
+		}
+
+	if ( ! access_timer_pending )
+		{
+		timer_mgr->Add(new AccessBatchTimer(network_time + remote_access_batch_interval));
+		access_timer_pending = true;
+		}
+	}
+
+bool RemoteSerializer::SendPendingAccesses()
+	{
+	// Sending may log accesses of its own, which then go into a new
+	// batch.
+	std::vector<PendingAccess> accesses;
+	accesses.swap(pending_accesses);
+	pending_access_index.clear();
+
+	bool result = true;
+
+	for ( size_t i = 0; i < accesses.size(); ++i )
+		{
+		if ( result && IsOpen() && ! terminating )
+			{
+			SerialInfo info(this);
+			result = BroadcastAccess(&info, *accesses[i].access,
+						 accesses[i].source);
+			}
+
+		delete accesses[i].access;
+		}
+
+	return result;
+	}
+
+bool RemoteSerializer::BroadcastAccess(SerialInfo* info, const StateAccess& access,
+					PeerID source)
+	{
 	// A real broadcast would be nice here. But the different peers have
 	// different serialization caches, so we cannot simply send the same
 	// serialization to all of them ...
 	loop_over_list(peers, i)
 		{
 		// Do not send access back to originating peer.
-		if ( peers[i] == source_peer )
+		if ( peers[i]->id == source )
 			continue;
 
 		// Only sent accesses for fully setup peers.
@@ -1019,6 +1238,8 @@ bool RemoteSerializer::SendAccess(SerialInfo* info, const StateAccess& access)
 
 bool RemoteSerializer::SendAllSynchronized(Peer* peer, SerialInfo* info)
 	{
+	FlushAccesses();
+
 	// FIXME: When suspending ID serialization works, remove!
 	DisableSuspend suspend(info);
 
@@ -1088,6 +1309,8 @@ bool RemoteSerializer::SendAllSynchronized(Peer* peer, SerialInfo* info)
 
 bool RemoteSerializer::SendID(SerialInfo* info, Peer* peer, const ID& id)
 	{
+	FlushAccesses();
+
 	if ( terminating )
 		return true;
 
@@ -1130,6 +1353,8 @@ bool RemoteSerializer::SendID(SerialInfo* info, PeerID pid, const ID& id)
 bool RemoteSerializer::SendConnection(SerialInfo* info, PeerID id,
 					const Connection& c)
 	{
+	FlushAccesses();
+
 	if ( ! using_communication || terminating )
 		return true;
 
@@ -1204,6 +1429,8 @@ bool RemoteSerializer::SendPacket(SerialInfo* info, PeerID id, const Packet& p)
 
 bool RemoteSerializer::SendPacket(SerialInfo* info, Peer* peer, const Packet& p)
 	{
+	FlushAccesses();
+
 	++stats.packets.out;
 	SetCache(peer->cache_out);
 	SetupSerialInfo(info, peer);
@@ -1252,6 +1479,9 @@ bool RemoteSerializer::SendCapabilities(Peer* peer)
 	caps |= Peer::PID_64BIT;
 	caps |= Peer::NEW_CACHE_STRATEGY;
 
+	if ( remote_shm_size > 0 )
+		caps |= Peer::SHARED_MEMORY;
+
 	return SendToChild(MSG_CAPS, peer, 3, caps, 0, 0);
 	}
 
@@ -1285,6 +1515,8 @@ bool RemoteSerializer::Listen(const IPAddr& ip, uint16 port, bool expect_ssl,
 
 void RemoteSerializer::SendSyncPoint(uint32 point)
 	{
+	FlushAccesses();
+
 	if ( ! (remote_trace_sync_interval && pseudo_realtime) || terminating )
 		return;
 
@@ -1328,6 +1560,8 @@ void RemoteSerializer::SendFinalSyncPoint()
 
 bool RemoteSerializer::Terminate()
 	{
+	FlushAccesses();
+
 	loop_over_list(peers, i)
 	    {
 	    FlushPrintBuffer(peers[i]);
@@ -1485,6 +1719,8 @@ void RemoteSerializer::Process()
 
 void RemoteSerializer::Finish()
 	{
+	FlushAccesses();
+
 	if ( ! using_communication )
 		return;
 
@@ -1806,12 +2042,12 @@ void RemoteSerializer::PeerConnected(Peer* peer)
 RecordVal* RemoteSerializer::MakePeerVal(Peer* peer)
 	{
 	RecordVal* v = new RecordVal(::peer);
-	v->Assign(0, new Val(uint32(peer->id), TYPE_COUNT));
+	v->Assign(0, val_mgr->GetCount(uint32(peer->id)));
 	// Sic! Network order for AddrVal, host order for PortVal.
 	v->Assign(1, new AddrVal(peer->ip));
-	v->Assign(2, new PortVal(peer->port, TRANSPORT_TCP));
-	v->Assign(3, new Val(false, TYPE_BOOL));
-	v->Assign(4, new StringVal(""));	// set when received
+	v->Assign(2, val_mgr->GetPort(peer->port, TRANSPORT_TCP));
+	v->Assign(3, val_mgr->GetFalse());
+	v->Assign(4, val_mgr->GetEmptyString());	// set when received
 	v->Assign(5, peer->peer_class.size() ?
 			new StringVal(peer->peer_class.c_str()) : 0);
 	return v;
@@ -1843,8 +2079,8 @@ RemoteSerializer::Peer* RemoteSerializer::AddPeer(const IPAddr& ip, uint16 port,
 	peer->sync_point = 0;
 	peer->print_buffer = 0;
 	peer->print_buffer_used = 0;
-	peer->log_buffer = new char[LOG_BUFFER_SIZE];
-	peer->log_buffer_used = 0;
+	peer->log_buffer = new BinarySerializationFormat();
+	peer->log_buffer->StartWrite();
 
 	peers.append(peer);
 	Log(LogInfo, "added peer", peer);
@@ -1877,7 +2113,7 @@ void RemoteSerializer::RemovePeer(Peer* peer)
 	int id = peer->id;
 	Unref(peer->val);
 	delete [] peer->print_buffer;
-	delete [] peer->log_buffer;
+	delete peer->log_buffer;
 	delete peer->cache_in;
 	delete peer->cache_out;
 	delete peer;
@@ -1960,6 +2196,8 @@ bool RemoteSerializer::ProcessVersionMsg()
 
 bool RemoteSerializer::EnterPhaseRunning(Peer* peer)
 	{
+	FlushAccesses();
+
 	if ( in_sync == peer )
 		in_sync = 0;
 
@@ -2147,7 +2385,17 @@ bool RemoteSerializer::ProcessPhaseDone()
 
 bool RemoteSerializer::HandshakeDone(Peer* peer)
 	{
-	if ( peer->caps & Peer::COMPRESSION && peer->comp_level > 0 )
+	// Peers on the same host may talk through shared memory instead.
+	// Both sides check this, and skip compression if both support it.
+	// The side that connected sets it up.
+	bool shm = (peer->caps & Peer::SHARED_MEMORY) && remote_shm_size > 0 &&
+		peer->ip.IsLoopback();
+
+	if ( shm && peer->orig )
+		if ( ! SendToChild(MSG_SHM, peer, 1, uint32(remote_shm_size)) )
+			return false;
+
+	if ( ! shm && peer->caps & Peer::COMPRESSION && peer->comp_level > 0 )
 		if ( ! SendToChild(MSG_COMPRESS, peer, 1, peer->comp_level) )
 			return false;
 
@@ -2262,7 +2510,7 @@ bool RemoteSerializer::ProcessPongMsg()
 
 	val_list* vl = new val_list;
 	vl->append(current_peer->val->Ref());
-	vl->append(new Val((unsigned int) ntohl(args->seq), TYPE_COUNT));
+	vl->append(val_mgr->GetCount((unsigned int) ntohl(args->seq)));
 	vl->append(new Val(current_time(true) - ntohd(args->time1),
 				TYPE_INTERVAL));
 	vl->append(new Val(ntohd(args->time2), TYPE_INTERVAL));
@@ -2602,55 +2850,32 @@ bool RemoteSerializer::SendLogWrite(Peer* peer, EnumVal* id, EnumVal* writer, st
 		// Peer shutting down.
 		return false;
 
-	// Serialize the log record entry.
-
-	BinarySerializationFormat fmt;
+	// Serialize the log record entry, right behind the ones already
+	// buffered. The buffer then goes to the child as it is.
 
-	fmt.StartWrite();
+	BinarySerializationFormat* fmt = peer->log_buffer;
+	int start = fmt->BytesWritten();
 
-	bool success = fmt.Write(id->AsEnum(), "id") &&
-		fmt.Write(writer->AsEnum(), "writer") &&
-		fmt.Write(path, "path") &&
-		fmt.Write(num_fields, "num_fields");
+	bool success = fmt->Write(id->AsEnum(), "id") &&
+		fmt->Write(writer->AsEnum(), "writer") &&
+		fmt->Write(path, "path") &&
+		fmt->Write(num_fields, "num_fields");
 
 	if ( ! success )
 		goto error;
 
 	for ( int i = 0; i < num_fields; i++ )
 		{
-		if ( ! vals[i]->Write(&fmt) )
+		if ( ! vals[i]->Write(fmt) )
 			goto error;
 		}
 
-	// Ok, we have the binary data now.
-	char* data;
-	int len;
-
-	len = fmt.EndWrite(&data);
-
-	assert(len > 10);
-
-	// Do we have not enough space in the buffer, or was the last flush a
-	// while ago? If so, flush first.
-	if ( len > (LOG_BUFFER_SIZE - peer->log_buffer_used) || (network_time - last_flush > 1.0) )
-		{
-		if ( ! FlushLogBuffer(peer) )
-			{
-			free(data);
-			return false;
-			}
-		}
-
-	// If the data is actually larger than our complete buffer, just send it out.
-	if ( len > LOG_BUFFER_SIZE )
-		return SendToChild(MSG_LOG_WRITE, peer, data, len, true);
-
-	// Now we have space in the buffer, copy it into there.
-	memcpy(peer->log_buffer + peer->log_buffer_used, data, len);
-	peer->log_buffer_used += len;
-	assert(peer->log_buffer_used <= LOG_BUFFER_SIZE);
+	assert(fmt->BytesWritten() - start > 10);
 
-	free(data);
+	// Is the buffer full, or was the last flush a while ago? If so,
+	// flush.
+	if ( fmt->BytesWritten() >= LOG_BUFFER_SIZE || (network_time - last_flush > 1.0) )
+		return FlushLogBuffer(peer);
 
 	return true;
 
@@ -2669,14 +2894,14 @@ bool RemoteSerializer::FlushLogBuffer(Peer* p)
 	if ( p->state == Peer::CLOSING )
 		return false;
 
-	if ( ! (p->log_buffer && p->log_buffer_used) )
+	if ( ! (p->log_buffer && p->log_buffer->BytesWritten()) )
 		return true;
 
-	char* data = new char[p->log_buffer_used];
-	memcpy(data, p->log_buffer, p->log_buffer_used);
-	SendToChild(MSG_LOG_WRITE, p, data, p->log_buffer_used);
+	char* data;
+	int len = p->log_buffer->EndWrite(&data);
+	p->log_buffer->StartWrite();
 
-	p->log_buffer_used = 0;
+	SendToChild(MSG_LOG_WRITE, p, data, len, true);
 	return true;
 	}
 
@@ -2765,11 +2990,17 @@ bool RemoteSerializer::ProcessLogWrite()
 	BinarySerializationFormat fmt;
 	fmt.StartRead(current_args->data, current_args->len);
 
+	// A batch of rows usually goes to the same writer, which we then
+	// look up only once. Nothing runs in between that could remove it.
+	logging::WriterFrontend* frontend = 0;
+	bool have_frontend = false;
+	int last_id = 0;
+	int last_writer = 0;
+	string last_path;
+
 	while ( fmt.BytesRead() != (int)current_args->len )
 		{
 		// Unserialize one entry.
-		EnumVal* id_val = 0;
-		EnumVal* writer_val = 0;
 		threading::Value** vals = 0;
 
 		int id, writer;
@@ -2800,17 +3031,34 @@ bool RemoteSerializer::ProcessLogWrite()
 				}
 			}
 
-		id_val = new EnumVal(id, internal_type("Log::ID")->AsEnumType());
-		writer_val = new EnumVal(writer, internal_type("Log::Writer")->AsEnumType());
+		if ( ! have_frontend || id != last_id || writer != last_writer ||
+		     path != last_path )
+			{
+			EnumVal* id_val = new EnumVal(id, internal_type("Log::ID")->AsEnumType());
+			EnumVal* writer_val = new EnumVal(writer, internal_type("Log::Writer")->AsEnumType());
 
-		success = log_mgr->Write(id_val, writer_val, path, num_fields, vals);
+			success = log_mgr->LookupWriter(id_val, writer_val, path, &frontend);
 
-		Unref(id_val);
-		Unref(writer_val);
+			Unref(id_val);
+			Unref(writer_val);
 
-		if ( ! success )
-			goto error;
+			if ( ! success )
+				{
+				log_mgr->DeleteVals(num_fields, vals);
+				goto error;
+				}
+
+			have_frontend = true;
+			last_id = id;
+			last_writer = writer;
+			last_path = path;
+			}
 
+		if ( frontend )
+			frontend->Write(num_fields, vals);
+		else
+			// The stream is disabled.
+			log_mgr->DeleteVals(num_fields, vals);
 		}
 
 	fmt.EndRead();
@@ -3008,16 +3256,16 @@ void RemoteSerializer::Log(LogLevel level, const char* msg, Peer* peer,
 		{
 		val_list* vl = new val_list();
 		vl->append(peer->val->Ref());
-		vl->append(new Val(level, TYPE_COUNT));
-		vl->append(new Val(src, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(level));
+		vl->append(val_mgr->GetCount(src));
 		vl->append(new StringVal(msg));
 		mgr.QueueEvent(remote_log_peer, vl);
 		}
 	else
 		{
 		val_list* vl = new val_list();
-		vl->append(new Val(level, TYPE_COUNT));
-		vl->append(new Val(src, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(level));
+		vl->append(val_mgr->GetCount(src));
 		vl->append(new StringVal(msg));
 		mgr.QueueEvent(remote_log, vl);
 		}
@@ -3071,9 +3319,9 @@ void RemoteSerializer::LogStats()
 
 	char buffer[512];
 	io->Stats(buffer, 512);
-	Log(LogInfo, fmt("parent statistics: %s events=%lu/%lu operations=%lu/%lu",
-		buffer, stats.events.in, stats.events.out,
-		stats.accesses.in, stats.accesses.out));
+	Log(LogInfo, fmt("parent statistics: %s events=%lu/%lu (%lu shared) operations=%lu/%lu (%lu merged)",
+		buffer, stats.events.in, stats.events.out, stats.events_shared,
+		stats.accesses.in, stats.accesses.out, stats.accesses_merged));
 	}
 
 RecordVal* RemoteSerializer::GetPeerVal(PeerID id)
@@ -3201,9 +3449,10 @@ void RemoteSerializer::FatalError(const char* msg)
 		{
 		// Make perftools happy.
 		Peer* p = peers[i];
-		delete [] p->log_buffer;
+		delete p->log_buffer;
 		delete [] p->print_buffer;
-		p->log_buffer = p->print_buffer = 0;
+		p->log_buffer = 0;
+		p->print_buffer = 0;
 		}
 	}
 
@@ -3558,6 +3807,7 @@ bool SocketComm::ProcessParentMessage()
 		case MSG_LISTEN:
 		case MSG_CONNECT_TO:
 		case MSG_COMPRESS:
+		case MSG_SHM:
 		case MSG_PING:
 		case MSG_PONG:
 		case MSG_REQUEST_EVENTS:
@@ -3672,6 +3922,9 @@ bool SocketComm::DoParentMessage()
 	case MSG_COMPRESS:
 		return ProcessParentCompress();
 
+	case MSG_SHM:
+		return ProcessParentShm();
+
 	case MSG_PING:
 		{
 		// Set time2.
@@ -3901,6 +4154,18 @@ bool SocketComm::ProcessRemoteMessage(SocketComm::Peer* peer)
 		ProcessPeerCompress(peer);
 		break;
 
+	case MSG_SHM:
+		{
+		ChunkedIO::Chunk* c;
+		READ_CHUNK(peer->io, c,
+			(CloseConnection(peer, true), peer))
+
+		peer->state = MSG_NONE;
+		bool result = ProcessPeerShm(peer, c);
+		delete c;
+		return result;
+		}
+
 	case MSG_PING:
 		{
 		// Messages with one further argument block which we simply
@@ -3990,6 +4255,139 @@ bool SocketComm::ProcessPeerCompress(Peer* peer)
 	return true;
 	}
 
+// Where to put the files backing shared memory between peers.
+static const char* shm_directory()
+	{
+	return access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+	}
+
+bool SocketComm::ProcessParentShm()
+	{
+	assert(parent_args);
+	uint32* args = (uint32*) parent_args->data;
+
+	uint32 size = ntohl(args[0]);
+	Peer* peer = parent_peer;
+
+	if ( ! (peer && peer->connected) || peer->ssl || peer->compressor ||
+	     peer->shared_memory || peer->shm )
+		return true;
+
+	ChunkedIOShm* shm = new ChunkedIOShm(shm_directory(), size);
+
+	if ( ! shm->Init() )
+		{
+		Log(fmt("can't set up shared memory, staying with TCP: %s",
+			shm->Error()), peer);
+		delete shm;
+		return true;
+		}
+
+	// Offer it to the peer. We keep using the connection until it
+	// accepts.
+	if ( ! SendToPeer(peer, MSG_SHM, copy_string(fmt("O%s", shm->Path()))) )
+		{
+		delete shm;
+		return false;
+		}
+
+	peer->shm = shm;
+	return true;
+	}
+
+// Switching a connection over to shared memory takes three messages:
+// the side that connected offers it ("O" and the file's path), the other
+// side accepts ("A") or refuses ("R"), and finally the first side
+// confirms ("S"). Each side writes to the ring once it has sent its last
+// message over the connection, and reads from the ring once it has seen
+// the other side's.
+bool SocketComm::ProcessPeerShm(Peer* peer, ChunkedIO::Chunk* c)
+	{
+	if ( c->len < 2 || c->data[c->len - 1] != '\0' )
+		{
+		Error("invalid shared memory message", peer);
+		return true;
+		}
+
+	switch ( c->data[0] ) {
+	case 'O':
+		{
+		if ( peer->ssl || peer->compressor || peer->shared_memory )
+			return SendToPeer(peer, MSG_SHM, copy_string("R"));
+
+		ChunkedIOShm* shm = new ChunkedIOShm(c->data + 1, 0);
+
+		if ( ! shm->Init() )
+			{
+			Log(fmt("can't use shared memory, staying with TCP: %s",
+				shm->Error()), peer);
+			delete shm;
+			return SendToPeer(peer, MSG_SHM, copy_string("R"));
+			}
+
+		if ( ! SendToPeer(peer, MSG_SHM, copy_string("A")) )
+			{
+			delete shm;
+			return false;
+			}
+
+		shm->SetConnection(peer->io);
+		shm->EnableWrites();
+		peer->io = shm;
+		peer->shared_memory = true;
+		return true;
+		}
+
+	case 'A':
+		{
+		if ( ! peer->shm )
+			break;
+
+		ChunkedIOShm* shm = peer->shm;
+		peer->shm = 0;
+
+		if ( ! SendToPeer(peer, MSG_SHM, copy_string("S")) )
+			{
+			delete shm;
+			return false;
+			}
+
+		shm->SetConnection(peer->io);
+		shm->EnableReads();
+		shm->EnableWrites();
+		peer->io = shm;
+		peer->shared_memory = true;
+		Log("using shared memory", peer);
+		return true;
+		}
+
+	case 'R':
+		{
+		if ( ! peer->shm )
+			break;
+
+		delete peer->shm;
+		peer->shm = 0;
+		Log("peer can't use shared memory, staying with TCP", peer);
+		return true;
+		}
+
+	case 'S':
+		{
+		if ( ! peer->shared_memory )
+			break;
+
+		// This cast is safe.
+		((ChunkedIOShm*) peer->io)->EnableReads();
+		Log("using shared memory", peer);
+		return true;
+		}
+	}
+
+	Error("unexpected shared memory message", peer);
+	return true;
+	}
+
 bool SocketComm::Connect(Peer* peer)
 	{
 	int status;
@@ -4060,6 +4458,7 @@ bool SocketComm::Connect(Peer* peer)
 	peer->state = MSG_NONE;
 	peer->io = 0;
 	peer->compressor = false;
+	peer->shared_memory = false;
 
 	if ( connected )
 		{
@@ -4103,12 +4502,15 @@ bool SocketComm::CloseConnection(Peer* peer, bool reconnect)
 		{
 		peers.remove(peer);
 		delete peer->io; // This will close the fd.
+		delete peer->shm;
 		delete peer;
 		}
 	else
 		{
 		delete peer->io; // This will close the fd.
 		peer->io = 0;
+		delete peer->shm;
+		peer->shm = 0;
 		peer->connected = false;
 		peer->next_try = time(0) + peer->retry;
 		}
@@ -4274,6 +4676,7 @@ bool SocketComm::AcceptConnection(int fd)
 	peer->connected = true;
 	peer->ssl = listen_ssl;
 	peer->compressor = false;
+	peer->shared_memory = false;
 
 	if ( peer->ssl )
 		peer->io = new ChunkedIOSSL(clientfd, true);
@@ -11,6 +11,7 @@
 #include "File.h"
 #include "logging/WriterBackend.h"
 
+#include <map>
 #include <vector>
 #include <string>
 
@@ -77,9 +78,21 @@ public:
 	// Send the event/function call (only if handshake completed).
 	bool SendCall(SerialInfo* info, PeerID peer, const char* name, val_list* vl);
 
-	// Broadcasts the access (only if handshake completed).
+	// Sends to each of the given peers. Peers that would end up with the
+	// same serialization share it, rather than each getting their own.
+	bool SendCall(SerialInfo* info, const std::vector<PeerID>& ids,
+			const char* name, val_list* vl);
+
+	// Broadcasts the access (only if handshake completed). With
+	// remote_access_batch_interval, it may wait for others to go out
+	// with.
 	bool SendAccess(SerialInfo* info, const StateAccess& access);
 
+	// Sends out all accesses still waiting. This happens before anything
+	// else goes to the peers, so that they see everything in order.
+	bool FlushAccesses()
+		{ return pending_accesses.empty() || SendPendingAccesses(); }
+
 	// Send the access.
 	bool SendAccess(SerialInfo* info, PeerID pid, const StateAccess& access);
 
@@ -135,6 +148,15 @@ public:
 	// Log some statistics.
 	void LogStats();
 
+	// Returns how many events went out to a peer without serializing
+	// them for it, and how many bytes that saved serializing.
+	unsigned long EventsShared() const	{ return stats.events_shared; }
+	uint64 EventBytesShared() const	{ return stats.event_bytes_shared; }
+
+	// Returns how many accesses got merged into an earlier one instead
+	// of going out on their own.
+	unsigned long AccessesMerged() const	{ return stats.accesses_merged; }
+
 	// Tries to sent out all remaining data.
 	// FIXME: Do we still need this?
 	void Finish();
@@ -168,10 +190,15 @@ public:
 protected:
 	friend class PersistenceSerializer;
 	friend class IncrementalSendTimer;
+	friend class AccessBatchTimer;
 
 	// Maximum size of serialization caches.
 	static const unsigned int MAX_CACHE_SIZE = 3000;
 
+	// Maximum number of accesses waiting to be sent, regardless of
+	// remote_access_batch_interval.
+	static const unsigned int MAX_PENDING_ACCESSES = 10000;
+
 	// When syncing traces in pseudo-realtime mode, we wait this many
 	// seconds after the final sync-point to make sure that all
 	// remaining I/O gets propagated.
@@ -204,6 +231,7 @@ protected:
 		static const int PID_64BIT = 4;
 		static const int NEW_CACHE_STRATEGY = 8;
 		static const int BROCCOLI_PEER = 16;
+		static const int SHARED_MEMORY = 32;
 
 		// Constants to remember to who did something.
 		static const int NONE = 0;
@@ -235,8 +263,8 @@ protected:
 		uint32 sync_point;	// Highest sync-point received so far
 		char* print_buffer;	// Buffer for remote print or null.
 		int print_buffer_used;	// Number of bytes used in buffer.
-		char* log_buffer;	// Buffer for remote log or null.
-		int log_buffer_used;	// Number of bytes used in buffer.
+		// Log entries get serialized right into this, or null.
+		BinarySerializationFormat* log_buffer;
 	};
 
 	// Shuts down remote serializer.
@@ -301,7 +329,12 @@ protected:
 
 	bool SendAllSynchronized(Peer* peer, SerialInfo* info);
 	bool SendCall(SerialInfo* info, Peer* peer, const char* name, val_list* vl);
+	bool SendCall(SerialInfo* info, const std::vector<Peer*>& to, const char* name, val_list* vl);
+	int ShareKey(const SerialInfo* info, const Peer* peer) const;
 	bool SendAccess(SerialInfo* info, Peer* peer, const StateAccess& access);
+	bool BroadcastAccess(SerialInfo* info, const StateAccess& access, PeerID source);
+	void QueueAccess(const StateAccess& access);
+	bool SendPendingAccesses();
 	bool SendID(SerialInfo* info, Peer* peer, const ID& id);
 	bool SendCapabilities(Peer* peer);
 	bool SendPacket(SerialInfo* info, Peer* peer, const Packet& p);
@@ -354,6 +387,20 @@ private:
 	Peer* in_sync; // Peer we're currently syncing state with.
 	peer_list sync_pending; // List of peers waiting to sync state.
 
+	// Accesses waiting to be broadcast, with the peer each came from.
+	// For merging, we keep where the latest one for each target (and
+	// table index) is.
+	struct PendingAccess {
+		StateAccess* access;
+		PeerID source;
+	};
+
+	typedef std::map<std::string, size_t> access_index;
+
+	std::vector<PendingAccess> pending_accesses;
+	std::map<const ID*, access_index> pending_access_index;
+	bool access_timer_pending;
+
 	// Event buffer
 	struct BufferedEvent {
 		time_t time;
@@ -384,11 +431,22 @@ private:
 			unsigned long out;
 			};
 
+		Statistics() : events_shared(0), event_bytes_shared(0),
+			accesses_merged(0)	{}
+
 		Pair events; // actually events and function calls
 		Pair accesses;
 		Pair conns;
 		Pair packets;
 		Pair ids;
+
+		// Events that went out without serializing them once more,
+		// as another peer's serialization could be shared.
+		unsigned long events_shared;
+		uint64 event_bytes_shared;
+
+		// Accesses merged into an earlier one before going out.
+		unsigned long accesses_merged;
 	} stats;
 
 };
@@ -422,6 +480,8 @@ protected:
 			retry = 0;
 			next_try = 0;
 			compressor = false;
+			shared_memory = false;
+			shm = 0;
 			}
 
 		RemoteSerializer::PeerID id;
@@ -438,6 +498,10 @@ protected:
 		time_t next_try;
 		// True if io is a CompressedChunkedIO.
 		bool compressor;
+		// True if io is a ChunkedIOShm.
+		bool shared_memory;
+		// Shared memory we offered the peer, until it answers.
+		ChunkedIOShm* shm;
 	};
 
 	bool Listen();
@@ -481,6 +545,8 @@ protected:
 	bool SendToPeer(Peer* peer, ChunkedIO::Chunk* c);
 	bool ProcessParentCompress();
 	bool ProcessPeerCompress(Peer* peer);
+	bool ProcessParentShm();
+	bool ProcessPeerShm(Peer* peer, ChunkedIO::Chunk* c);
 	bool ForwardChunkToParent(Peer* p, ChunkedIO::Chunk* c);
 	bool ForwardChunkToPeer();
 	const char* MakeLogString(const char* msg, Peer *peer);
@@ -10,6 +10,8 @@
 #include "NetVar.h"
 #include "Net.h"
 #include "Conn.h"
+#include "Timer.h"
+#include "Metrics.h"
 
 #ifdef SYSLOG_INT
 extern "C" {
@@ -21,6 +23,38 @@ int closelog();
 
 Reporter* reporter = 0;
 
+// Timers that end the sampling windows of net and flow weirds. Those of
+// connection weirds just go away with the connection.
+class NetWeirdTimer : public Timer {
+public:
+	NetWeirdTimer(double t, const char* arg_name)
+		: Timer(t, TIMER_NET_WEIRD_EXPIRE), name(arg_name)	{ }
+
+	void Dispatch(double t, int is_expire)
+		{ reporter->ResetNetWeird(name); }
+
+protected:
+	std::string name;
+};
+
+class FlowWeirdTimer : public Timer {
+public:
+	FlowWeirdTimer(double t, const IPAddr& arg_orig, const IPAddr& arg_resp)
+		: Timer(t, TIMER_FLOW_WEIRD_EXPIRE), orig(arg_orig), resp(arg_resp)	{ }
+
+	void Dispatch(double t, int is_expire)
+		{ reporter->ResetFlowWeird(orig, resp); }
+
+protected:
+	IPAddr orig;
+	IPAddr resp;
+};
+
+static double suppressed_weirds()
+	{
+	return reporter->SuppressedWeirds();
+	}
+
 Reporter::Reporter()
 	{
 	errors = 0;
@@ -34,6 +68,16 @@ Reporter::Reporter()
 	warnings_to_stderr = true;
 	errors_to_stderr = true;
 
+	// No sampling until the scripts say otherwise.
+	weird_sampling_threshold = 0;
+	weird_sampling_rate = 0;
+	weird_sampling_duration = 0;
+	suppressed_weirds = 0;
+
+	metrics::registry()->NewCallbackCounter("reporter.weirds_suppressed",
+						"Weirds that sampling suppressed.",
+						::suppressed_weirds);
+
 	openlog("bro", 0, LOG_LOCAL5);
 	}
 
@@ -47,6 +91,20 @@ void Reporter::InitOptions()
 	info_to_stderr = internal_const_val("Reporter::info_to_stderr")->AsBool();
 	warnings_to_stderr = internal_const_val("Reporter::warnings_to_stderr")->AsBool();
 	errors_to_stderr = internal_const_val("Reporter::errors_to_stderr")->AsBool();
+
+	weird_sampling_threshold = internal_const_val("Weird::sampling_threshold")->AsCount();
+	weird_sampling_rate = internal_const_val("Weird::sampling_rate")->AsCount();
+	weird_sampling_duration = internal_const_val("Weird::sampling_duration")->AsInterval();
+
+	ListVal* lv = internal_const_val("Weird::sampling_whitelist")->AsTableVal()->ConvertToPureList();
+
+	for ( int i = 0; i < lv->Length(); ++i )
+		{
+		const BroString* name = lv->Index(i)->AsString();
+		weird_sampling_whitelist.insert(std::string((const char*) name->Bytes(), name->Len()));
+		}
+
+	Unref(lv);
 	}
 
 void Reporter::Info(const char* fmt, ...)
@@ -219,24 +277,102 @@ void Reporter::WeirdFlowHelper(const IPAddr& orig, const IPAddr& resp, const cha
 	delete vl;
 	}
 
+bool Reporter::SampleWeird(uint64 count)
+	{
+	if ( count <= weird_sampling_threshold )
+		return true;
+
+	if ( weird_sampling_rate &&
+	     (count - weird_sampling_threshold) % weird_sampling_rate == 0 )
+		return true;
+
+	++suppressed_weirds;
+	return false;
+	}
+
+bool Reporter::PermitNetWeird(const char* name)
+	{
+	if ( ! SampledWeird(name) )
+		return true;
+
+	uint64& count = net_weird_state[name];
+
+	if ( ++count == 1 && timer_mgr )
+		timer_mgr->Add(new NetWeirdTimer(network_time + weird_sampling_duration, name));
+
+	return SampleWeird(count);
+	}
+
+bool Reporter::PermitFlowWeird(const char* name, const IPAddr& orig,
+			       const IPAddr& resp)
+	{
+	if ( ! SampledWeird(name) )
+		return true;
+
+	WeirdStateMap& wsm = flow_weird_state[std::make_pair(orig, resp)];
+
+	if ( wsm.empty() && timer_mgr )
+		timer_mgr->Add(new FlowWeirdTimer(network_time + weird_sampling_duration, orig, resp));
+
+	return SampleWeird(++wsm[name].count);
+	}
+
+bool Reporter::PermitConnWeird(const char* name, Connection* conn)
+	{
+	if ( ! SampledWeird(name) )
+		return true;
+
+	WeirdState& state = (*conn->GetWeirdState())[name];
+
+	// Connections don't get timers, so their windows restart as the
+	// next weird comes in.
+	if ( state.count == 0 ||
+	     network_time >= state.sampling_start_time + weird_sampling_duration )
+		{
+		state.count = 0;
+		state.sampling_start_time = network_time;
+		}
+
+	return SampleWeird(++state.count);
+	}
+
+void Reporter::ResetNetWeird(const std::string& name)
+	{
+	net_weird_state.erase(name);
+	}
+
+void Reporter::ResetFlowWeird(const IPAddr& orig, const IPAddr& resp)
+	{
+	flow_weird_state.erase(std::make_pair(orig, resp));
+	}
+
 void Reporter::Weird(const char* name)
 	{
-	WeirdHelper(net_weird, 0, 0, "%s", name);
+	if ( PermitNetWeird(name) )
+		WeirdHelper(net_weird, 0, 0, "%s", name);
 	}
 
 void Reporter::Weird(Connection* conn, const char* name, const char* addl)
 	{
-	WeirdHelper(conn_weird, conn->BuildConnVal(), addl, "%s", name);
+	// Checked before building the connection record, which comes with
+	// its cost.
+	if ( PermitConnWeird(name, conn) )
+		WeirdHelper(conn_weird, conn->BuildConnVal(), addl, "%s", name);
 	}
 
 void Reporter::Weird(Val* conn_val, const char* name, const char* addl)
 	{
-	WeirdHelper(conn_weird, conn_val, addl, "%s", name);
+	// Without the connection, this samples like a net_weird.
+	if ( PermitNetWeird(name) )
+		WeirdHelper(conn_weird, conn_val, addl, "%s", name);
+	else
+		Unref(conn_val);
 	}
 
 void Reporter::Weird(const IPAddr& orig, const IPAddr& resp, const char* name)
 	{
-	WeirdFlowHelper(orig, resp, "%s", name);
+	if ( PermitFlowWeird(name, orig, resp) )
+		WeirdFlowHelper(orig, resp, "%s", name);
 	}
 
 void Reporter::DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
@@ -6,11 +6,16 @@
 #include <stdarg.h>
 
 #include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include "util.h"
 #include "EventHandler.h"
 #include "IPAddr.h"
+#include "WeirdState.h"
 
 namespace analyzer { class Analyzer; }
 class Connection;
@@ -120,6 +125,17 @@ public:
 	// Signals that we're done processing an error handler event.
 	void EndErrorHandler()	{ --in_error_handler; }
 
+	// Forgets about a net_weird for sampling, once its time window has
+	// passed.
+	void ResetNetWeird(const std::string& name);
+
+	// Forgets about a flow's flow_weirds for sampling, once their time
+	// window has passed.
+	void ResetFlowWeird(const IPAddr& orig, const IPAddr& resp);
+
+	// Returns the number of weirds that sampling suppressed so far.
+	uint64 SuppressedWeirds() const	{ return suppressed_weirds; }
+
 private:
 	void DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
 		   Connection* conn, val_list* addl, bool location, bool time,
@@ -130,6 +146,22 @@ private:
 	void WeirdHelper(EventHandlerPtr event, Val* conn_val, const char* addl, const char* fmt_name, ...) __attribute__((format(printf, 5, 6)));;
 	void WeirdFlowHelper(const IPAddr& orig, const IPAddr& resp, const char* fmt_name, ...) __attribute__((format(printf, 4, 5)));;
 
+	// Weird sampling, see Weird::sampling_threshold. These return true
+	// if a weird is to be reported, counting it along the way.
+	bool PermitNetWeird(const char* name);
+	bool PermitFlowWeird(const char* name, const IPAddr& orig, const IPAddr& resp);
+	bool PermitConnWeird(const char* name, Connection* conn);
+
+	// Returns true if a weird is subject to sampling at all.
+	bool SampledWeird(const char* name) const
+		{
+		return weird_sampling_threshold &&
+			weird_sampling_whitelist.find(name) == weird_sampling_whitelist.end();
+		}
+
+	// Decides on a weird, given how often its seen in the current window.
+	bool SampleWeird(uint64 count);
+
 	int errors;
 	bool via_events;
 	int in_error_handler;
@@ -137,6 +169,15 @@ private:
 	bool warnings_to_stderr;
 	bool errors_to_stderr;
 
+	std::unordered_set<std::string> weird_sampling_whitelist;
+	uint64 weird_sampling_threshold;
+	uint64 weird_sampling_rate;
+	double weird_sampling_duration;
+	uint64 suppressed_weirds;
+
+	std::unordered_map<std::string, uint64> net_weird_state;
+	std::map<std::pair<IPAddr, IPAddr>, WeirdStateMap> flow_weird_state;
+
 	std::list<std::pair<const Location*, const Location*> > locations;
 };
 
@@ -4,6 +4,7 @@
 #include "bro-config.h"
 
 #include "analyzer/Analyzer.h"
+#include "Conn.h"
 #include "RuleMatcher.h"
 #include "DFA.h"
 #include "NetVar.h"
@@ -25,6 +26,9 @@
 
 uint32 RuleHdrTest::idcounter = 0;
 
+// Shorter literals would show up too often to be worth prefiltering on.
+static const unsigned int MIN_PREFILTER_LITERAL = 3;
+
 RuleHdrTest::RuleHdrTest(Prot arg_prot, uint32 arg_offset, uint32 arg_size,
 				Comp arg_comp, maskedvalue_list* arg_vals)
 	{
@@ -65,8 +69,9 @@ Val* RuleMatcher::BuildRuleStateValue(const Rule* rule,
 	RecordVal* val = new RecordVal(signature_state);
 	val->Assign(0, new StringVal(rule->ID()));
 	val->Assign(1, state->GetAnalyzer()->BuildConnVal());
-	val->Assign(2, new Val(state->is_orig, TYPE_BOOL));
-	val->Assign(3, new Val(state->payload_size, TYPE_COUNT));
+	state->GetAnalyzer()->Conn()->CompleteConnVal();
+	val->Assign(2, val_mgr->GetBool(state->is_orig));
+	val->Assign(3, val_mgr->GetCount(state->payload_size));
 	return val;
 	}
 
@@ -176,16 +181,36 @@ RuleEndpointState::RuleEndpointState(analyzer::Analyzer* arg_analyzer, bool arg_
 
 RuleEndpointState::~RuleEndpointState()
 	{
-	loop_over_list(matchers, i)
-		{
-		delete matchers[i]->state;
-		delete matchers[i];
-		}
+	for ( unsigned int i = 0; i < matchers.size(); ++i )
+		delete matchers[i].state;
 
 	loop_over_list(matched_text, j)
 		delete matched_text[j];
 	}
 
+bool RuleEndpointState::Exhausted(Rule::PatternType type) const
+	{
+	// Rules whose patterns have all matched get another chance at the
+	// end of the connection.
+	loop_over_list(matched_by_patterns, i)
+		if ( ! matched_rules.is_member(matched_by_patterns[i]->Index()) )
+			return false;
+
+	if ( prefilters[type].num_deferred )
+		return false;
+
+	for ( unsigned int j = 0; j < matchers.size(); ++j )
+		{
+		const Matcher& m = matchers[j];
+
+		// One that hasn't seen any data yet may still match.
+		if ( m.type == type && ! (m.state && m.state->Exhausted()) )
+			return false;
+		}
+
+	return true;
+	}
+
 RuleFileMagicState::~RuleFileMagicState()
 	{
 	loop_over_list(matchers, i)
@@ -200,6 +225,10 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	root = new RuleHdrTest(RuleHdrTest::NOPROT, 0, 0, RuleHdrTest::EQ,
 				new maskedvalue_list);
 	RE_level = arg_RE_level;
+	num_prefiltered_sets = 0;
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		literals[i] = 0;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -211,6 +240,9 @@ RuleMatcher::~RuleMatcher()
 
 	loop_over_list(rules, i)
 		delete rules[i];
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		delete literals[i];
 	}
 
 void RuleMatcher::Delete(RuleHdrTest* node)
@@ -258,6 +290,10 @@ bool RuleMatcher::ReadFiles(const name_list& files)
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
 
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		if ( literals[i] )
+			literals[i]->Compile();
+
 	return ! parse_error;
 	}
 
@@ -358,7 +394,8 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+						 (Rule::PatternType) i);
 		}
 
 	// Get the patterns on all of our children.
@@ -385,18 +422,45 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+						 (Rule::PatternType) i);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
+Specific_RE_Matcher* RuleHdrTest::PatternSet::Matcher()
+	{
+	if ( ! re )
+		{
+		re = new Specific_RE_Matcher(MATCH_EXACTLY, 1);
+		re->CompileSet(patterns, ids);
+		}
+
+	return re;
+	}
+
+bool RuleHdrTest::PatternSet::MatchesAtStart()
+	{
+	if ( matches_at_start < 0 )
+		{
+		RE_Match_State s(Matcher());
+		s.Match((const u_char*) "", 0, true, false, false);
+		matches_at_start = ! s.AcceptedMatches().empty();
+		}
+
+	return matches_at_start;
+	}
+
 void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids)
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type)
 	{
 	assert(exprs.length() == ids.length());
 
-	// We build groups of at most sig_max_group_size regexps.
+	// We build groups of at most sig_max_group_size regexps. File magic
+	// gets a single one, so that sniffing a file runs one DFA, which
+	// stops as soon as no signature can match anymore.
 
 	string_list group_exprs;
 	int_list group_ids;
@@ -409,17 +473,49 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 			group_ids.append(ids[i]);
 			}
 
-		if ( group_exprs.length() > sig_max_group_size ||
+		if ( (type != Rule::FILE_MAGIC &&
+		      group_exprs.length() > sig_max_group_size) ||
 		     i == exprs.length() )
 			{
 			RuleHdrTest::PatternSet* set =
 				new RuleHdrTest::PatternSet;
-			set->re = new Specific_RE_Matcher(MATCH_EXACTLY, 1);
-			set->re->CompileSet(group_exprs, group_ids);
 			set->patterns = group_exprs;
 			set->ids = group_ids;
 			dst->append(set);
 
+			// Otherwise it gets compiled once a connection
+			// first needs it.
+			if ( ! sig_compile_on_demand )
+				set->Matcher();
+
+			// File magic gets matched separately, without
+			// prefiltering.
+			if ( type != Rule::FILE_MAGIC && sig_prefilter_max_buffer > 0 )
+				{
+				std::vector<std::string> lits;
+
+				loop_over_list(group_exprs, j)
+					{
+					std::string l = required_literal(group_exprs[j]);
+
+					if ( l.size() < MIN_PREFILTER_LITERAL )
+						break;
+
+					lits.push_back(l);
+					}
+
+				if ( int(lits.size()) == group_exprs.length() )
+					{
+					if ( ! literals[type] )
+						literals[type] = new LiteralMatcher();
+
+					set->prefilter_id = num_prefiltered_sets++;
+
+					for ( unsigned int j = 0; j < lits.size(); ++j )
+						literals[type]->Add(lits[j], set->prefilter_id);
+					}
+				}
+
 			group_exprs.clear();
 			group_ids.clear();
 			}
@@ -580,9 +676,8 @@ RuleFileMagicState* RuleMatcher::InitFileMagic() const
 	loop_over_list(root->psets[Rule::FILE_MAGIC], i)
 		{
 		RuleHdrTest::PatternSet* set = root->psets[Rule::FILE_MAGIC][i];
-		assert(set->re);
 		RuleFileMagicState::Matcher* m = new RuleFileMagicState::Matcher;
-		m->state = new RE_Match_State(set->re);
+		m->state = new RE_Match_State(set->Matcher());
 		state->matchers.append(m);
 		}
 
@@ -739,13 +834,16 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 					RuleHdrTest::PatternSet* set =
 						hdr_test->psets[i][j];
 
-					assert(set->re);
+					RuleEndpointState::Matcher m;
+					m.state = 0;
+					m.set = set;
+					m.type = (Rule::PatternType) i;
+					m.deferred = (set->prefilter_id >= 0);
+					m.pending_bol = false;
+					state->matchers.push_back(m);
 
-					RuleEndpointState::Matcher* m =
-						new RuleEndpointState::Matcher;
-					m->state = new RE_Match_State(set->re);
-					m->type = (Rule::PatternType) i;
-					state->matchers.append(m);
+					if ( m.deferred )
+						++state->prefilters[i].num_deferred;
 					}
 				}
 			}
@@ -805,7 +903,7 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 		}
 	// Save some memory.
 	state->hdr_tests.resize(0);
-	state->matchers.resize(0);
+	state->matchers.shrink_to_fit();
 
 	// Send BOL to payload matchers.
 	Match(state, Rule::PAYLOAD, (const u_char *) "", 0, true, false, false);
@@ -854,13 +952,36 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 			state->payload_size = 0;
 		}
 
+	if ( state->prefilters[type].num_deferred &&
+	     Prefilter(state, type, data, data_len, bol, eol, clear) )
+		newmatch = true;
+
 	// Feed data into all relevant matchers.
-	loop_over_list(state->matchers, x)
+	for ( unsigned int x = 0; x < state->matchers.size(); ++x )
 		{
-		RuleEndpointState::Matcher* m = state->matchers[x];
-		if ( m->type == type &&
-		     m->state->Match((const u_char*) data, data_len,
-					bol, eol, clear) )
+		RuleEndpointState::Matcher* m = &state->matchers[x];
+
+		if ( m->type != type || m->deferred )
+			continue;
+
+		bool m_bol = bol;
+
+		if ( ! m->state )
+			{
+			// Without any data, there's nothing to do for a
+			// matcher that hasn't started yet, unless it can match
+			// already.
+			if ( data_len == 0 && ! eol && ! m->set->MatchesAtStart() )
+				{
+				m->pending_bol = m->pending_bol || bol;
+				continue;
+				}
+
+			m_bol = bol || m->pending_bol;
+			}
+
+		if ( MatchState(m)->Match((const u_char*) data, data_len,
+					  m_bol, eol, clear) )
 			newmatch = true;
 		}
 
@@ -872,10 +993,14 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 
 	AcceptingMatchSet accepted_matches;
 
-	loop_over_list(state->matchers, y )
+	for ( unsigned int y = 0; y < state->matchers.size(); ++y )
 		{
-		RuleEndpointState::Matcher* m = state->matchers[y];
-		const AcceptingMatchSet& ams = m->state->AcceptedMatches();
+		const RuleEndpointState::Matcher& m = state->matchers[y];
+
+		if ( ! m.state )
+			continue;
+
+		const AcceptingMatchSet& ams = m.state->AcceptedMatches();
 		accepted_matches.insert(ams.begin(), ams.end());
 		}
 
@@ -942,6 +1067,84 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 		}
 	}
 
+bool RuleMatcher::Prefilter(RuleEndpointState* state, Rule::PatternType type,
+				const u_char* data, int data_len,
+				bool bol, bool eol, bool clear)
+	{
+	RuleEndpointState::Prefilter* pf = &state->prefilters[type];
+	bool newmatch = false;
+
+	if ( clear )
+		{
+		// The deferred matchers couldn't have matched anything
+		// before, so they may as well start with this chunk.
+		pf->literal_state = 0;
+		pf->chunks.clear();
+		pf->size = 0;
+		}
+
+	std::vector<int> found;
+	pf->literal_state = literals[type]->Scan(pf->literal_state, data,
+						  data_len, &found);
+
+	bool overflow = pf->size + data_len > sig_prefilter_max_buffer;
+
+	for ( unsigned int i = 0; i < state->matchers.size(); ++i )
+		{
+		RuleEndpointState::Matcher* m = &state->matchers[i];
+
+		if ( m->type != type || ! m->deferred )
+			continue;
+
+		if ( overflow ||
+		     std::find(found.begin(), found.end(), m->set->prefilter_id) != found.end() )
+			{
+			// If we've kept too much data, we stop waiting.
+			if ( CatchUp(state, m) )
+				newmatch = true;
+			}
+		}
+
+	if ( ! pf->num_deferred )
+		{
+		pf->chunks = RuleEndpointState::chunk_list();
+		pf->size = 0;
+		return newmatch;
+		}
+
+	RuleEndpointState::DeferredChunk c;
+	c.data.assign((const char*) data, data_len);
+	c.bol = bol;
+	c.eol = eol;
+	c.clear = clear;
+
+	pf->chunks.push_back(c);
+	pf->size += data_len;
+
+	return newmatch;
+	}
+
+bool RuleMatcher::CatchUp(RuleEndpointState* state,
+				RuleEndpointState::Matcher* m)
+	{
+	RuleEndpointState::Prefilter* pf = &state->prefilters[m->type];
+	bool newmatch = false;
+
+	for ( unsigned int i = 0; i < pf->chunks.size(); ++i )
+		{
+		const RuleEndpointState::DeferredChunk& c = pf->chunks[i];
+
+		if ( MatchState(m)->Match((const u_char*) c.data.data(), c.data.size(),
+					  c.bol, c.eol, c.clear) )
+			newmatch = true;
+		}
+
+	m->deferred = false;
+	--pf->num_deferred;
+
+	return newmatch;
+	}
+
 void RuleMatcher::FinishEndpoint(RuleEndpointState* state)
 	{
 	// Send EOL to payload matchers.
@@ -1099,8 +1302,17 @@ void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 
 	ExecPureRules(state, 1);
 
-	loop_over_list(state->matchers, j)
-		state->matchers[j]->state->Clear();
+	for ( unsigned int j = 0; j < state->matchers.size(); ++j )
+		if ( state->matchers[j].state )
+			state->matchers[j].state->Clear();
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		{
+		RuleEndpointState::Prefilter* pf = &state->prefilters[i];
+		pf->literal_state = 0;
+		pf->chunks.clear();
+		pf->size = 0;
+		}
 	}
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
@@ -1174,6 +1386,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->mem = 0;
 		stats->hits = 0;
 		stats->misses = 0;
+		stats->evictions = 0;
 		stats->nfa_states = 0;
 		hdr_test = root;
 		}
@@ -1185,9 +1398,13 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		loop_over_list(hdr_test->psets[i], j)
 			{
 			RuleHdrTest::PatternSet* set = hdr_test->psets[i][j];
-			assert(set->re);
 
 			++stats->matchers;
+
+			// Not needed by any connection yet.
+			if ( ! set->re )
+				continue;
+
 			set->re->DFA()->Cache()->GetStats(&cstats);
 
 			stats->dfa_states += cstats.dfa_states;
@@ -1195,6 +1412,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			stats->mem += cstats.mem;
 			stats->hits += cstats.hits;
 			stats->misses += cstats.misses;
+			stats->evictions += cstats.evictions;
 			stats->nfa_states += cstats.nfa_states;
 			}
 		}
@@ -1212,8 +1430,9 @@ void RuleMatcher::DumpStats(BroFile* f)
 			"computed trans. = %d; matchers = %d; mem = %d\n",
 			network_time, stats.dfa_states, stats.computed,
 			stats.matchers, stats.mem));
-	f->Write(fmt("%.6f DFA cache hits = %d; misses = %d\n", network_time,
-			stats.hits, stats.misses));
+	f->Write(fmt("%.6f DFA cache hits = %d; misses = %d; evictions = %d\n",
+			network_time, stats.hits, stats.misses,
+			stats.evictions));
 
 	DumpStateStats(f, root);
 	}
@@ -1228,10 +1447,9 @@ void RuleMatcher::DumpStateStats(BroFile* f, RuleHdrTest* hdr_test)
 		loop_over_list(hdr_test->psets[i], j)
 			{
 			RuleHdrTest::PatternSet* set = hdr_test->psets[i][j];
-			assert(set->re);
 
 			f->Write(fmt("%.6f %d DFA states in %s group %d from sigs ", network_time,
-					 set->re->DFA()->NumStates(),
+					 set->re ? set->re->DFA()->NumStates() : 0,
 					 Rule::TypeToString((Rule::PatternType)i), j));
 
 			loop_over_list(set->ids, k)
@@ -1476,3 +1694,10 @@ void RuleMatcherState::ClearMatchState(bool orig)
 	else if ( resp_match_state )
 		rule_matcher->ClearEndpointState(resp_match_state);
 	}
+
+bool RuleMatcherState::PayloadExhausted() const
+	{
+	return orig_match_state && resp_match_state &&
+		orig_match_state->Exhausted(Rule::PAYLOAD) &&
+		resp_match_state->Exhausted(Rule::PAYLOAD);
+	}
@@ -19,6 +19,7 @@
 #include "Rule.h"
 #include "RuleAction.h"
 #include "RuleCondition.h"
+#include "LiteralMatcher.h"
 
 //#define MATCHER_PRINT_STATS
 
@@ -103,19 +104,35 @@ private:
 
 	// The following are all set by RuleMatcher::BuildRulesTree().
 	friend class RuleMatcher;
+	friend class RuleEndpointState;
 
 	struct PatternSet {
-		PatternSet() : re() {}
+		PatternSet() : re(), prefilter_id(-1), matches_at_start(-1) {}
 
 		// If we're above the 'RE_level' (see RuleMatcher), this
 		// expr contains all patterns on this node. If we're on
 		// 'RE_level', it additionally contains all patterns
-		// of any of its children.
+		// of any of its children. With sig_compile_on_demand,
+		// it stays null until the first Matcher() call.
 		Specific_RE_Matcher* re;
 
+		// Returns re, compiling it first if necessary.
+		Specific_RE_Matcher* Matcher();
+
+		// Returns true if any of the patterns matches right at the
+		// beginning of the data, before seeing any of it.
+		bool MatchesAtStart();
+
 		// All the patterns and their rule indices.
 		string_list patterns;
 		int_list ids;	// (only needed for debugging)
+
+		// If each of the patterns contains a literal, the ID the
+		// RuleMatcher's LiteralMatcher reports when finding one of
+		// them; otherwise -1.
+		int prefilter_id;
+
+		int matches_at_start;	// cached by MatchesAtStart(), or -1
 	};
 
 	declare(PList, PatternSet);
@@ -158,6 +175,11 @@ public:
 
 	analyzer::pia::PIA* PIA() const	{ return pia; }
 
+	// Returns true if no rule can fire anymore because of patterns of
+	// the given type. That's the case once all of their matchers have
+	// failed, with no rule left waiting for other conditions.
+	bool Exhausted(Rule::PatternType type) const;
+
 private:
 	friend class RuleMatcher;
 
@@ -166,13 +188,46 @@ private:
 	RuleEndpointState(analyzer::Analyzer* arg_analyzer, bool arg_is_orig,
 			  RuleEndpointState* arg_opposite, analyzer::pia::PIA* arg_PIA);
 
+	// One per pattern group of the header tests that the endpoint
+	// passed. Most endpoints never match anything, so these stay small
+	// and get the actual matching state only once data arrives for
+	// them (see RuleMatcher::MatchState()).
 	struct Matcher {
-		RE_Match_State* state;
+		RE_Match_State* state;	// null until the first data
+		RuleHdrTest::PatternSet* set;
 		Rule::PatternType type;
+
+		// True as long as we haven't seen any of the literals the
+		// patterns need. We don't run such a matcher, but keep the
+		// data for it until we do.
+		bool deferred;
+
+		// True if we've skipped the beginning of the data while it
+		// had no state yet.
+		bool pending_bol;
 	};
 
-	declare(PList, Matcher);
-	typedef PList(Matcher) matcher_list;
+	typedef std::vector<Matcher> matcher_list;
+
+	// A chunk of data kept for deferred matchers, along with the
+	// arguments RuleMatcher::Match() got for it.
+	struct DeferredChunk {
+		std::string data;
+		bool bol;
+		bool eol;
+		bool clear;
+	};
+
+	typedef std::vector<DeferredChunk> chunk_list;
+
+	struct Prefilter {
+		Prefilter() : literal_state(0), num_deferred(0), size(0) {}
+
+		int literal_state;	// of the RuleMatcher's LiteralMatcher
+		int num_deferred;	// number of deferred matchers
+		int size;		// total size of the chunks
+		chunk_list chunks;
+	};
 
 	bool is_orig;
 	analyzer::Analyzer* analyzer;
@@ -182,6 +237,8 @@ private:
 	matcher_list matchers;
 	rule_hdr_test_list hdr_tests;
 
+	Prefilter prefilters[Rule::TYPES];
+
 	// The follow tracks which rules for which all patterns have matched,
 	// and in a parallel list the (first instance of the) corresponding
 	// matched text.
@@ -308,6 +365,7 @@ public:
 		// # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
 		unsigned int hits;
 		unsigned int misses;	// # cache misses
+		unsigned int evictions;	// # DFA states evicted from caches
 	};
 
 	Val* BuildRuleStateValue(const Rule* rule,
@@ -332,7 +390,27 @@ private:
 
 	// Build groups of regular epxressions.
 	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids);
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type);
+
+	// Looks for the literals of the endpoint's deferred matchers in
+	// the data, and catches up with the matchers that have one now.
+	// Returns true if that leads to a new match.
+	bool Prefilter(RuleEndpointState* state, Rule::PatternType type,
+			const u_char* data, int data_len,
+			bool bol, bool eol, bool clear);
+
+	// Feeds the data kept for a deferred matcher into it.
+	bool CatchUp(RuleEndpointState* state, RuleEndpointState::Matcher* m);
+
+	// Returns the matcher's matching state, setting it up on first use.
+	static RE_Match_State* MatchState(RuleEndpointState::Matcher* m)
+		{
+		if ( ! m->state )
+			m->state = new RE_Match_State(m->set->Matcher());
+
+		return m->state;
+		}
 
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
@@ -365,6 +443,11 @@ private:
 	int RE_level;
 	bool parse_error;
 	RuleHdrTest* root;
+
+	// Literals of the pattern sets, per pattern type.
+	LiteralMatcher* literals[Rule::TYPES];
+	int num_prefiltered_sets;
+
 	rule_list rules;
 	rule_dict rules_by_id;
 };
@@ -391,6 +474,10 @@ public:
 	bool MatcherInitialized(bool orig)
 		{ return orig ? orig_match_state : resp_match_state; }
 
+	// Returns true if payload can't make any signature fire anymore,
+	// for neither of the two endpoints.
+	bool PayloadExhausted() const;
+
 private:
 	RuleEndpointState* orig_match_state;
 	RuleEndpointState* resp_match_state;
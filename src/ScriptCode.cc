@@ -0,0 +1,1128 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <stdlib.h>
+
+#include "ScriptCode.h"
+#include "Expr.h"
+#include "Frame.h"
+#include "ID.h"
+#include "Reporter.h"
+#include "Debug.h"
+
+// The instruction set. Suffixes give the kind of registers an instruction
+// works on: _I for signed and _U for unsigned integers, _D for doubles,
+// and _V for boxed values. Unless noted otherwise, "a" is the destination
+// register and "b" and "c" are the source registers.
+#define SCRIPT_OPS(X) \
+	/* a = constant */ \
+	X(CONST_I) X(CONST_U) X(CONST_D) X(CONST_V) \
+	/* a = local at offset b, global of e; jump to c if not set */ \
+	X(LOCAL_I) X(LOCAL_U) X(LOCAL_D) X(LOCAL_V) \
+	X(GLOBAL_I) X(GLOBAL_U) X(GLOBAL_D) X(GLOBAL_V) \
+	/* a = e->Eval(); jump to c if nil */ \
+	X(EVAL_I) X(EVAL_U) X(EVAL_D) X(EVAL_V) \
+	/* unboxes value b into a, or boxes a scalar b into a */ \
+	X(UNBOX_I) X(UNBOX_U) X(UNBOX_D) X(BOX) \
+	/* a = field of record b; a = whether record b has field c */ \
+	X(FIELD) X(HAS_FIELD) \
+	X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(MOD_I) \
+	X(ADD_U) X(SUB_U) X(MUL_U) X(DIV_U) X(MOD_U) \
+	X(ADD_D) X(SUB_D) X(MUL_D) X(DIV_D) \
+	X(LT_I) X(LE_I) X(EQ_I) X(NE_I) \
+	X(LT_U) X(LE_U) X(EQ_U) X(NE_U) \
+	X(LT_D) X(LE_D) X(EQ_D) X(NE_D) \
+	X(NOT) X(NEG_I) X(NEG_D) \
+	X(I2U) X(I2D) X(U2I) X(U2D) X(D2I) X(D2U) \
+	X(MOV_S) X(MOV_V) \
+	/* jump to c, if b is false/true */ \
+	X(JMP) X(JMP_IF_FALSE) X(JMP_IF_TRUE) \
+	/* assigns b to local at offset a, or to global of e */ \
+	X(STORE_LOCAL) X(STORE_GLOBAL) \
+	/* runs s through the AST interpreter */ \
+	X(EXEC) \
+	X(CHECK_DELAYED) X(RET) X(RET_NULL) X(END)
+
+enum ScriptOp {
+#define SCRIPT_OP_ENUM(name) SC_##name,
+	SCRIPT_OPS(SCRIPT_OP_ENUM)
+#undef SCRIPT_OP_ENUM
+	NUM_SCRIPT_OPS
+};
+
+// The kinds of registers.
+enum RegKind { K_INT, K_UNS, K_DBL, K_VAL };
+
+// Returns the kind of register values of the given type are kept in.
+static RegKind reg_kind(const BroType* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		return K_INT;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		return K_UNS;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return K_DBL;
+
+	default:
+		return K_VAL;
+	}
+	}
+
+// Returns the kind of register values of the given type can be unboxed
+// into. That's a superset of the above, as it includes enums and ports.
+static RegKind internal_kind(const BroType* t)
+	{
+	if ( IsVector(t->Tag()) )
+		return K_VAL;
+
+	switch ( t->InternalType() ) {
+	case TYPE_INTERNAL_INT:		return K_INT;
+	case TYPE_INTERNAL_UNSIGNED:	return K_UNS;
+	case TYPE_INTERNAL_DOUBLE:	return K_DBL;
+	default:			return K_VAL;
+	}
+	}
+
+// Returns true if evaluating the expression a second time can't have any
+// visible effects.
+static bool is_pure_chain(const Expr* e)
+	{
+	if ( e->Tag() == EXPR_FIELD )
+		return is_pure_chain(((const FieldExpr*) e)->Op());
+
+	return e->Tag() == EXPR_NAME;
+	}
+
+class ScriptCompiler {
+public:
+	ScriptCompiler(ScriptCode* arg_sc);
+
+	// Returns false if compilation failed, or isn't worth it.
+	bool CompileBody(const Stmt* body);
+
+private:
+	struct Operand {
+		Operand(RegKind arg_kind, int arg_reg)
+			{ kind = arg_kind; reg = arg_reg; }
+
+		RegKind kind;
+		int reg;
+	};
+
+	void CompileStmt(const Stmt* s);
+	void CompileIf(const IfStmt* s);
+	void CompileAssign(const ExprStmt* s, const AssignExpr* e);
+	void CompileReturn(const ReturnStmt* s);
+	void CompileFallback(const Stmt* s);
+
+	// Compiles an expression into whatever kind of register suits it.
+	Operand CompileExpr(const Expr* e);
+
+	// Compiles an expression into a register of the given kind, which
+	// must be the internal kind of its type.
+	int CompileScalar(const Expr* e, RegKind k);
+
+	// Compiles an expression into a boxed register.
+	int CompileVal(const Expr* e);
+
+	Operand CompileName(const NameExpr* e, bool boxed);
+	Operand CompileConst(const ConstExpr* e, bool boxed);
+	Operand CompileArith(const BinaryExpr* e);
+	Operand CompileCompare(const BinaryExpr* e);
+	Operand CompileBool(const BinaryExpr* e);
+	Operand CompileNot(const UnaryExpr* e);
+	Operand CompileNeg(const UnaryExpr* e);
+	Operand CompileCoerce(const UnaryExpr* e);
+	Operand CompileField(const FieldExpr* e);
+	Operand CompileHasField(const HasFieldExpr* e);
+	Operand CompileCond(const CondExpr* e);
+	Operand CompileEval(const Expr* e);
+
+	int NewReg(RegKind k);
+
+	int Emit(int op, int a = 0, int b = 0, int c = 0);
+
+	// Emits an instruction that jumps to the current statement's nil
+	// target if there's no value.
+	int EmitFail(int op, int a, int b, const Expr* e);
+
+	ScriptCode::Instr& Last()	{ return sc->code.back(); }
+	int Here() const	{ return sc->code.size(); }
+	void SetTarget(int instr, int target)	{ sc->code[instr].c = target; }
+
+	// A statement's registers are free again once it's done, so we
+	// reset them with each new one.
+	void BeginStmt();
+
+	// Points the statement's nil jumps to the current position and
+	// checks for the frame getting delayed there.
+	void FinishFails(const std::vector<int>& stmt_fails, bool stmt_may_delay);
+
+	ScriptCode* sc;
+	bool ok;
+	int num_compiled;	// statements not just handed to the interpreter
+
+	int num_sregs;
+	int num_vregs;
+	std::vector<int> fails;	// nil jumps of the current statement
+	bool may_delay;	// whether the current statement may call a function
+};
+
+ScriptCompiler::ScriptCompiler(ScriptCode* arg_sc)
+	{
+	sc = arg_sc;
+	ok = true;
+	num_compiled = 0;
+	num_sregs = num_vregs = 0;
+	may_delay = false;
+	}
+
+bool ScriptCompiler::CompileBody(const Stmt* body)
+	{
+	CompileStmt(body);
+	Emit(SC_END);
+
+	return ok && num_compiled > 0;
+	}
+
+void ScriptCompiler::CompileStmt(const Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		{
+		const stmt_list& stmts = ((const StmtList*) s)->Stmts();
+
+		loop_over_list(stmts, i)
+			CompileStmt(stmts[i]);
+		}
+		break;
+
+	case STMT_IF:
+		CompileIf((const IfStmt*) s);
+		break;
+
+	case STMT_EXPR:
+		{
+		const Expr* e = ((const ExprStmt*) s)->StmtExpr();
+
+		if ( e->Tag() == EXPR_ASSIGN )
+			CompileAssign((const ExprStmt*) s, (const AssignExpr*) e);
+		else
+			CompileFallback(s);
+		}
+		break;
+
+	case STMT_RETURN:
+		CompileReturn((const ReturnStmt*) s);
+		break;
+
+	case STMT_NULL:
+		break;
+
+	default:
+		CompileFallback(s);
+		break;
+	}
+	}
+
+void ScriptCompiler::CompileIf(const IfStmt* s)
+	{
+	const Expr* cond = s->StmtExpr();
+
+	if ( cond->Type()->Tag() != TYPE_BOOL )
+		{
+		CompileFallback(s);
+		return;
+		}
+
+	BeginStmt();
+	int r = CompileScalar(cond, K_INT);
+	int to_false = Emit(SC_JMP_IF_FALSE, 0, r);
+
+	// The branches start statements of their own.
+	std::vector<int> cond_fails = fails;
+	bool cond_may_delay = may_delay;
+
+	CompileStmt(s->TrueBranch());
+	int to_end = Emit(SC_JMP);
+
+	SetTarget(to_false, Here());
+	CompileStmt(s->FalseBranch());
+
+	if ( cond_fails.size() )
+		{
+		int skip_fails = Emit(SC_JMP);
+		FinishFails(cond_fails, cond_may_delay);
+		SetTarget(skip_fails, Here());
+		}
+
+	SetTarget(to_end, Here());
+	++num_compiled;
+	}
+
+void ScriptCompiler::CompileAssign(const ExprStmt* s, const AssignExpr* e)
+	{
+	const Expr* lhs = e->Op1();
+
+	if ( e->IsError() || e->IsInit() || lhs->Tag() != EXPR_REF ||
+	     ((const RefExpr*) lhs)->Op()->Tag() != EXPR_NAME )
+		{
+		CompileFallback(s);
+		return;
+		}
+
+	const NameExpr* n = (const NameExpr*) ((const RefExpr*) lhs)->Op();
+
+	BeginStmt();
+	int r = CompileVal(e->Op2());
+
+	if ( n->Id()->IsGlobal() )
+		{
+		Emit(SC_STORE_GLOBAL, 0, r);
+		Last().e = n;
+		}
+	else
+		Emit(SC_STORE_LOCAL, n->Id()->Offset(), r);
+
+	FinishFails(fails, may_delay);
+	++num_compiled;
+	}
+
+void ScriptCompiler::CompileReturn(const ReturnStmt* s)
+	{
+	const Expr* e = s->StmtExpr();
+
+	if ( ! e )
+		{
+		Emit(SC_RET_NULL);
+		return;
+		}
+
+	BeginStmt();
+	Emit(SC_RET, 0, CompileVal(e));
+
+	if ( fails.size() )
+		{
+		for ( size_t i = 0; i < fails.size(); ++i )
+			SetTarget(fails[i], Here());
+
+		Emit(SC_RET_NULL);
+		}
+
+	++num_compiled;
+	}
+
+void ScriptCompiler::CompileFallback(const Stmt* s)
+	{
+	Emit(SC_EXEC);
+	Last().s = s;
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileExpr(const Expr* e)
+	{
+	if ( e->IsError() )
+		return CompileEval(e);
+
+	switch ( e->Tag() ) {
+	case EXPR_NAME:
+		return CompileName((const NameExpr*) e, false);
+
+	case EXPR_CONST:
+		return CompileConst((const ConstExpr*) e, false);
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+		return CompileArith((const BinaryExpr*) e);
+
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		return CompileCompare((const BinaryExpr*) e);
+
+	case EXPR_AND:
+	case EXPR_OR:
+		return CompileBool((const BinaryExpr*) e);
+
+	case EXPR_NOT:
+		return CompileNot((const UnaryExpr*) e);
+
+	case EXPR_NEGATE:
+		return CompileNeg((const UnaryExpr*) e);
+
+	case EXPR_ARITH_COERCE:
+		return CompileCoerce((const UnaryExpr*) e);
+
+	case EXPR_FIELD:
+		return CompileField((const FieldExpr*) e);
+
+	case EXPR_HAS_FIELD:
+		return CompileHasField((const HasFieldExpr*) e);
+
+	case EXPR_COND:
+		return CompileCond((const CondExpr*) e);
+
+	default:
+		return CompileEval(e);
+	}
+	}
+
+int ScriptCompiler::CompileScalar(const Expr* e, RegKind k)
+	{
+	Operand o = CompileExpr(e);
+
+	if ( o.kind == k )
+		return o.reg;
+
+	if ( o.kind != K_VAL || internal_kind(e->Type()) != k )
+		{
+		reporter->InternalWarning("bad register kind in script compiler");
+		ok = false;
+		return 0;
+		}
+
+	static const int unbox_ops[] = { SC_UNBOX_I, SC_UNBOX_U, SC_UNBOX_D };
+
+	int r = NewReg(k);
+	Emit(unbox_ops[k], r, o.reg);
+	return r;
+	}
+
+int ScriptCompiler::CompileVal(const Expr* e)
+	{
+	// Variables and constants are already boxed.
+	if ( ! e->IsError() && e->Tag() == EXPR_NAME )
+		return CompileName((const NameExpr*) e, true).reg;
+
+	if ( ! e->IsError() && e->Tag() == EXPR_CONST )
+		return CompileConst((const ConstExpr*) e, true).reg;
+
+	Operand o = CompileExpr(e);
+
+	if ( o.kind == K_VAL )
+		return o.reg;
+
+	int r = NewReg(K_VAL);
+	Emit(SC_BOX, r, o.reg);
+	Last().t = e->Type()->Tag();
+	return r;
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileName(const NameExpr* e, bool boxed)
+	{
+	const ID* id = e->Id();
+
+	if ( id->AsType() )
+		return CompileEval(e);
+
+	static const int local_ops[] =
+		{ SC_LOCAL_I, SC_LOCAL_U, SC_LOCAL_D, SC_LOCAL_V };
+	static const int global_ops[] =
+		{ SC_GLOBAL_I, SC_GLOBAL_U, SC_GLOBAL_D, SC_GLOBAL_V };
+
+	RegKind k = boxed ? K_VAL : reg_kind(e->Type());
+	int r = NewReg(k);
+
+	if ( id->IsGlobal() )
+		EmitFail(global_ops[k], r, 0, e);
+	else
+		EmitFail(local_ops[k], r, id->Offset(), e);
+
+	return Operand(k, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileConst(const ConstExpr* e, bool boxed)
+	{
+	Val* v = e->Value();
+	RegKind k = boxed ? K_VAL : reg_kind(e->Type());
+	int r = NewReg(k);
+
+	switch ( k ) {
+	case K_INT:
+		Emit(SC_CONST_I, r);
+		Last().k.i = v->InternalInt();
+		break;
+
+	case K_UNS:
+		Emit(SC_CONST_U, r);
+		Last().k.u = v->InternalUnsigned();
+		break;
+
+	case K_DBL:
+		Emit(SC_CONST_D, r);
+		Last().k.d = v->InternalDouble();
+		break;
+
+	case K_VAL:
+		Emit(SC_CONST_V, r);
+		Last().v = v->Ref();
+		break;
+	}
+
+	return Operand(k, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileArith(const BinaryExpr* e)
+	{
+	const Expr* op1 = e->Op1();
+	const Expr* op2 = e->Op2();
+	RegKind k = internal_kind(op1->Type());
+
+	// BinaryExpr::Fold() computes in the kind of the operands, so they
+	// need to agree with the result.
+	if ( k == K_VAL || internal_kind(op2->Type()) != k ||
+	     reg_kind(e->Type()) != k || (e->Tag() == EXPR_MOD && k == K_DBL) )
+		return CompileEval(e);
+
+	static const int ops[][3] = {
+		{ SC_ADD_I, SC_ADD_U, SC_ADD_D },
+		{ SC_SUB_I, SC_SUB_U, SC_SUB_D },
+		{ SC_MUL_I, SC_MUL_U, SC_MUL_D },
+		{ SC_DIV_I, SC_DIV_U, SC_DIV_D },
+		{ SC_MOD_I, SC_MOD_U, -1 },
+	};
+
+	int row;
+
+	switch ( e->Tag() ) {
+	case EXPR_ADD:		row = 0; break;
+	case EXPR_SUB:		row = 1; break;
+	case EXPR_TIMES:	row = 2; break;
+	case EXPR_DIVIDE:	row = 3; break;
+	default:		row = 4; break;
+	}
+
+	int r1 = CompileScalar(op1, k);
+	int r2 = CompileScalar(op2, k);
+	int r = NewReg(k);
+
+	Emit(ops[row][k], r, r1, r2);
+	Last().e = e;	// for reporting division by zero
+
+	return Operand(k, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileCompare(const BinaryExpr* e)
+	{
+	const Expr* op1 = e->Op1();
+	const Expr* op2 = e->Op2();
+	RegKind k = internal_kind(op1->Type());
+
+	if ( k == K_VAL || internal_kind(op2->Type()) != k ||
+	     e->Type()->Tag() != TYPE_BOOL )
+		return CompileEval(e);
+
+	static const int ops[][3] = {
+		{ SC_LT_I, SC_LT_U, SC_LT_D },
+		{ SC_LE_I, SC_LE_U, SC_LE_D },
+		{ SC_EQ_I, SC_EQ_U, SC_EQ_D },
+		{ SC_NE_I, SC_NE_U, SC_NE_D },
+	};
+
+	int row;
+	bool swap = false;
+
+	switch ( e->Tag() ) {
+	case EXPR_LT:	row = 0; break;
+	case EXPR_LE:	row = 1; break;
+	case EXPR_EQ:	row = 2; break;
+	case EXPR_NE:	row = 3; break;
+	case EXPR_GT:	row = 0; swap = true; break;
+	default:	row = 1; swap = true; break;
+	}
+
+	int r1 = CompileScalar(op1, k);
+	int r2 = CompileScalar(op2, k);
+	int r = NewReg(K_INT);
+
+	if ( swap )
+		Emit(ops[row][k], r, r2, r1);
+	else
+		Emit(ops[row][k], r, r1, r2);
+
+	return Operand(K_INT, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileBool(const BinaryExpr* e)
+	{
+	const Expr* op1 = e->Op1();
+	const Expr* op2 = e->Op2();
+
+	if ( e->Type()->Tag() != TYPE_BOOL ||
+	     op1->Type()->Tag() != TYPE_BOOL || op2->Type()->Tag() != TYPE_BOOL )
+		return CompileEval(e);
+
+	// Short-circuits just like BoolExpr::DoSingleEval().
+	int r = NewReg(K_INT);
+	Emit(SC_MOV_S, r, CompileScalar(op1, K_INT));
+
+	int skip = Emit(e->Tag() == EXPR_AND ? SC_JMP_IF_FALSE : SC_JMP_IF_TRUE,
+			0, r);
+
+	Emit(SC_MOV_S, r, CompileScalar(op2, K_INT));
+	SetTarget(skip, Here());
+
+	return Operand(K_INT, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileNot(const UnaryExpr* e)
+	{
+	if ( e->Type()->Tag() != TYPE_BOOL || e->Op()->Type()->Tag() != TYPE_BOOL )
+		return CompileEval(e);
+
+	int r1 = CompileScalar(e->Op(), K_INT);
+	int r = NewReg(K_INT);
+	Emit(SC_NOT, r, r1);
+
+	return Operand(K_INT, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileNeg(const UnaryExpr* e)
+	{
+	const Expr* op = e->Op();
+	RegKind k = internal_kind(op->Type());
+
+	// Same result types as NegExpr::Fold().
+	if ( k == K_DBL && e->Type()->Tag() == op->Type()->Tag() &&
+	     reg_kind(e->Type()) == K_DBL )
+		{
+		int r1 = CompileScalar(op, K_DBL);
+		int r = NewReg(K_DBL);
+		Emit(SC_NEG_D, r, r1);
+		return Operand(K_DBL, r);
+		}
+
+	if ( (k == K_INT || k == K_UNS) && e->Type()->Tag() == TYPE_INT )
+		{
+		int r1 = CompileScalar(op, k);
+
+		if ( k == K_UNS )
+			{
+			int r2 = NewReg(K_INT);
+			Emit(SC_U2I, r2, r1);
+			r1 = r2;
+			}
+
+		int r = NewReg(K_INT);
+		Emit(SC_NEG_I, r, r1);
+		return Operand(K_INT, r);
+		}
+
+	return CompileEval(e);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileCoerce(const UnaryExpr* e)
+	{
+	RegKind from = internal_kind(e->Op()->Type());
+	RegKind to = reg_kind(e->Type());
+
+	if ( from == K_VAL || to == K_VAL )
+		return CompileEval(e);
+
+	int r1 = CompileScalar(e->Op(), from);
+
+	if ( from == to )
+		return Operand(to, r1);
+
+	static const int ops[][3] = {
+		{ -1, SC_I2U, SC_I2D },
+		{ SC_U2I, -1, SC_U2D },
+		{ SC_D2I, SC_D2U, -1 },
+	};
+
+	int r = NewReg(to);
+	Emit(ops[from][to], r, r1);
+
+	return Operand(to, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileField(const FieldExpr* e)
+	{
+	// If the field isn't set, we let FieldExpr::Eval() sort out the
+	// &default or the error, which means evaluating the record again.
+	if ( e->Field() < 0 || ! is_pure_chain(e->Op()) )
+		return CompileEval(e);
+
+	int r1 = CompileVal(e->Op());
+	int r = NewReg(K_VAL);
+	EmitFail(SC_FIELD, r, r1, e);
+
+	return Operand(K_VAL, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileHasField(const HasFieldExpr* e)
+	{
+	if ( e->Field() < 0 )
+		return CompileEval(e);
+
+	int r1 = CompileVal(e->Op());
+	int r = NewReg(K_INT);
+	Emit(SC_HAS_FIELD, r, r1, e->Field());
+
+	return Operand(K_INT, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileCond(const CondExpr* e)
+	{
+	const Expr* op1 = e->Op1();
+	const Expr* op2 = e->Op2();
+	const Expr* op3 = e->Op3();
+	RegKind k = reg_kind(e->Type());
+
+	if ( op1->Type()->Tag() != TYPE_BOOL || IsVector(e->Type()->Tag()) ||
+	     reg_kind(op2->Type()) != k || reg_kind(op3->Type()) != k )
+		return CompileEval(e);
+
+	int r = NewReg(k);
+	int to_false = Emit(SC_JMP_IF_FALSE, 0, CompileScalar(op1, K_INT));
+
+	if ( k == K_VAL )
+		Emit(SC_MOV_V, r, CompileVal(op2));
+	else
+		Emit(SC_MOV_S, r, CompileScalar(op2, k));
+
+	int to_end = Emit(SC_JMP);
+	SetTarget(to_false, Here());
+
+	if ( k == K_VAL )
+		Emit(SC_MOV_V, r, CompileVal(op3));
+	else
+		Emit(SC_MOV_S, r, CompileScalar(op3, k));
+
+	SetTarget(to_end, Here());
+
+	return Operand(k, r);
+	}
+
+ScriptCompiler::Operand ScriptCompiler::CompileEval(const Expr* e)
+	{
+	static const int ops[] = { SC_EVAL_I, SC_EVAL_U, SC_EVAL_D, SC_EVAL_V };
+
+	RegKind k = reg_kind(e->Type());
+	int r = NewReg(k);
+	EmitFail(ops[k], r, 0, e);
+
+	// Any function call in there may end up delaying the frame.
+	may_delay = true;
+
+	return Operand(k, r);
+	}
+
+int ScriptCompiler::NewReg(RegKind k)
+	{
+	int& n = (k == K_VAL ? num_vregs : num_sregs);
+	int& max = (k == K_VAL ? sc->num_vregs : sc->num_sregs);
+
+	if ( n >= ScriptCode::MAX_REGS )
+		{
+		ok = false;
+		return 0;
+		}
+
+	if ( ++n > max )
+		max = n;
+
+	return n - 1;
+	}
+
+int ScriptCompiler::Emit(int op, int a, int b, int c)
+	{
+	ScriptCode::Instr i;
+	i.op = op;
+	i.a = a;
+	i.b = b;
+	i.c = c;
+	i.e = 0;
+
+	sc->code.push_back(i);
+	return sc->code.size() - 1;
+	}
+
+int ScriptCompiler::EmitFail(int op, int a, int b, const Expr* e)
+	{
+	int i = Emit(op, a, b);
+	Last().e = e;
+	fails.push_back(i);
+	return i;
+	}
+
+void ScriptCompiler::BeginStmt()
+	{
+	num_sregs = num_vregs = 0;
+	fails.clear();
+	may_delay = false;
+	}
+
+void ScriptCompiler::FinishFails(const std::vector<int>& stmt_fails,
+				 bool stmt_may_delay)
+	{
+	if ( ! stmt_fails.size() )
+		return;
+
+	for ( size_t i = 0; i < stmt_fails.size(); ++i )
+		SetTarget(stmt_fails[i], Here());
+
+	// Like StmtList::Exec(), we stop once the frame is delayed.
+	if ( stmt_may_delay )
+		Emit(SC_CHECK_DELAYED);
+	}
+
+ScriptCode::ScriptCode()
+	{
+	num_sregs = num_vregs = 0;
+	}
+
+ScriptCode::~ScriptCode()
+	{
+	for ( size_t i = 0; i < code.size(); ++i )
+		if ( code[i].op == SC_CONST_V )
+			Unref(code[i].v);
+	}
+
+bool ScriptCode::Enabled()
+	{
+	return getenv("BRO_COMPILE_SCRIPTS") && ! g_policy_debug;
+	}
+
+ScriptCode* ScriptCode::Compile(const Stmt* body)
+	{
+	if ( ! Enabled() )
+		return 0;
+
+	ScriptCode* sc = new ScriptCode();
+	ScriptCompiler c(sc);
+
+	if ( ! c.CompileBody(body) )
+		{
+		delete sc;
+		return 0;
+		}
+
+	return sc;
+	}
+
+Val* ScriptCode::Exec(Frame* f, stmt_flow_type& flow) const
+	{
+	// With GCC and clang we use computed gotos, so that each instruction
+	// dispatches to the next one by itself. That's easier on the branch
+	// predictor than the single jump of a switch.
+#ifdef __GNUC__
+	static void* const labels[] = {
+#define SCRIPT_OP_LABEL(name) &&L_##name,
+		SCRIPT_OPS(SCRIPT_OP_LABEL)
+#undef SCRIPT_OP_LABEL
+	};
+
+#define VM_CASE(name)	L_##name:
+#define VM_DISPATCH()	goto *labels[ip->op]
+#else
+#define VM_CASE(name)	case SC_##name:
+#define VM_DISPATCH()	continue
+#endif
+
+#define VM_NEXT()	{ ++ip; VM_DISPATCH(); }
+#define VM_JUMP(target)	{ ip = &code[0] + (target); VM_DISPATCH(); }
+
+// Fills a boxed register, releasing what it held before. That can be
+// left over from a statement that stopped halfway because of a nil value.
+#define VM_SET_V(r, val)	{ Unref(v[r]); v[r] = (val); }
+#define VM_TAKE_V(r, dst)	{ dst = v[r]; v[r] = 0; }
+
+#define VM_LOAD(name, load, init)	\
+	VM_CASE(name)	\
+		{	\
+		Val* x = load;	\
+		if ( ! x )	\
+			{	\
+			/* Evaluate once more for the error message. */	\
+			Unref(ip->e->Eval(f));	\
+			VM_JUMP(ip->c);	\
+			}	\
+		init;	\
+		}	\
+		VM_NEXT();
+
+#define VM_EVAL(name, init)	\
+	VM_CASE(name)	\
+		{	\
+		Val* x = ip->e->Eval(f);	\
+		if ( ! x )	\
+			VM_JUMP(ip->c);	\
+		init;	\
+		}	\
+		VM_NEXT();
+
+#define VM_BINARY(name, dst, src, op)	\
+	VM_CASE(name)	\
+		s[ip->a].dst = s[ip->b].src op s[ip->c].src;	\
+		VM_NEXT();
+
+#define VM_DIVIDE(name, src, op, what)	\
+	VM_CASE(name)	\
+		if ( s[ip->c].src == 0 )	\
+			reporter->ExprRuntimeError(ip->e, what);	\
+		s[ip->a].src = s[ip->b].src op s[ip->c].src;	\
+		VM_NEXT();
+
+#define VM_CONVERT(name, dst, dst_type, src)	\
+	VM_CASE(name)	\
+		s[ip->a].dst = static_cast<dst_type>(s[ip->b].src);	\
+		VM_NEXT();
+
+#define GLOBAL_VAL	(((const NameExpr*) ip->e)->Id()->ID_Val())
+
+	Scalar s[MAX_REGS];
+	Val* v[MAX_REGS];
+
+	for ( int i = 0; i < num_vregs; ++i )
+		v[i] = 0;
+
+	const Instr* ip = &code[0];
+	Val* result = 0;
+	flow = FLOW_NEXT;
+
+	try
+	{
+#ifdef __GNUC__
+	VM_DISPATCH();
+#else
+	for ( ;; )
+	switch ( ip->op ) {
+#endif
+
+	VM_CASE(CONST_I)
+		s[ip->a].i = ip->k.i;
+		VM_NEXT();
+	VM_CASE(CONST_U)
+		s[ip->a].u = ip->k.u;
+		VM_NEXT();
+	VM_CASE(CONST_D)
+		s[ip->a].d = ip->k.d;
+		VM_NEXT();
+	VM_CASE(CONST_V)
+		VM_SET_V(ip->a, ip->v->Ref());
+		VM_NEXT();
+
+	VM_LOAD(LOCAL_I, f->NthElement(ip->b), s[ip->a].i = x->InternalInt())
+	VM_LOAD(LOCAL_U, f->NthElement(ip->b), s[ip->a].u = x->InternalUnsigned())
+	VM_LOAD(LOCAL_D, f->NthElement(ip->b), s[ip->a].d = x->InternalDouble())
+	VM_LOAD(LOCAL_V, f->NthElement(ip->b), VM_SET_V(ip->a, x->Ref()))
+	VM_LOAD(GLOBAL_I, GLOBAL_VAL, s[ip->a].i = x->InternalInt())
+	VM_LOAD(GLOBAL_U, GLOBAL_VAL, s[ip->a].u = x->InternalUnsigned())
+	VM_LOAD(GLOBAL_D, GLOBAL_VAL, s[ip->a].d = x->InternalDouble())
+	VM_LOAD(GLOBAL_V, GLOBAL_VAL, VM_SET_V(ip->a, x->Ref()))
+
+	VM_EVAL(EVAL_I, s[ip->a].i = x->InternalInt(); Unref(x))
+	VM_EVAL(EVAL_U, s[ip->a].u = x->InternalUnsigned(); Unref(x))
+	VM_EVAL(EVAL_D, s[ip->a].d = x->InternalDouble(); Unref(x))
+	VM_EVAL(EVAL_V, VM_SET_V(ip->a, x))
+
+	VM_CASE(UNBOX_I)
+		s[ip->a].i = v[ip->b]->InternalInt();
+		VM_SET_V(ip->b, 0);
+		VM_NEXT();
+	VM_CASE(UNBOX_U)
+		s[ip->a].u = v[ip->b]->InternalUnsigned();
+		VM_SET_V(ip->b, 0);
+		VM_NEXT();
+	VM_CASE(UNBOX_D)
+		s[ip->a].d = v[ip->b]->InternalDouble();
+		VM_SET_V(ip->b, 0);
+		VM_NEXT();
+	VM_CASE(BOX)
+		{
+		Val* x;
+
+		switch ( ip->t ) {
+		case TYPE_BOOL:
+		case TYPE_INT:
+			x = new Val(s[ip->b].i, ip->t);
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_COUNTER:
+			x = new Val(s[ip->b].u, ip->t);
+			break;
+
+		case TYPE_INTERVAL:
+			x = new IntervalVal(s[ip->b].d, 1.0);
+			break;
+
+		default:
+			x = new Val(s[ip->b].d, ip->t);
+			break;
+		}
+
+		VM_SET_V(ip->a, x);
+		}
+		VM_NEXT();
+
+	VM_CASE(FIELD)
+		{
+		const FieldExpr* fe = (const FieldExpr*) ip->e;
+		Val* x = v[ip->b]->AsRecordVal()->Lookup(fe->Field());
+
+		if ( x )
+			x->Ref();
+		else
+			{
+			x = fe->Eval(f);
+
+			if ( ! x )
+				VM_JUMP(ip->c);
+			}
+
+		VM_SET_V(ip->b, 0);
+		VM_SET_V(ip->a, x);
+		}
+		VM_NEXT();
+
+	VM_CASE(HAS_FIELD)
+		s[ip->a].i = v[ip->b]->AsRecordVal()->Lookup(ip->c) != 0;
+		VM_SET_V(ip->b, 0);
+		VM_NEXT();
+
+	VM_BINARY(ADD_I, i, i, +)
+	VM_BINARY(SUB_I, i, i, -)
+	VM_BINARY(MUL_I, i, i, *)
+	VM_DIVIDE(DIV_I, i, /, "division by zero")
+	VM_DIVIDE(MOD_I, i, %, "modulo by zero")
+	VM_BINARY(ADD_U, u, u, +)
+	VM_BINARY(SUB_U, u, u, -)
+	VM_BINARY(MUL_U, u, u, *)
+	VM_DIVIDE(DIV_U, u, /, "division by zero")
+	VM_DIVIDE(MOD_U, u, %, "modulo by zero")
+	VM_BINARY(ADD_D, d, d, +)
+	VM_BINARY(SUB_D, d, d, -)
+	VM_BINARY(MUL_D, d, d, *)
+	VM_DIVIDE(DIV_D, d, /, "division by zero")
+
+	VM_BINARY(LT_I, i, i, <)
+	VM_BINARY(LE_I, i, i, <=)
+	VM_BINARY(EQ_I, i, i, ==)
+	VM_BINARY(NE_I, i, i, !=)
+	VM_BINARY(LT_U, i, u, <)
+	VM_BINARY(LE_U, i, u, <=)
+	VM_BINARY(EQ_U, i, u, ==)
+	VM_BINARY(NE_U, i, u, !=)
+	VM_BINARY(LT_D, i, d, <)
+	VM_BINARY(LE_D, i, d, <=)
+	VM_BINARY(EQ_D, i, d, ==)
+	VM_BINARY(NE_D, i, d, !=)
+
+	VM_CASE(NOT)
+		s[ip->a].i = ! s[ip->b].i;
+		VM_NEXT();
+	VM_CASE(NEG_I)
+		s[ip->a].i = - s[ip->b].i;
+		VM_NEXT();
+	VM_CASE(NEG_D)
+		s[ip->a].d = - s[ip->b].d;
+		VM_NEXT();
+
+	VM_CONVERT(I2U, u, bro_uint_t, i)
+	VM_CONVERT(I2D, d, double, i)
+	VM_CONVERT(U2I, i, bro_int_t, u)
+	VM_CONVERT(U2D, d, double, u)
+	VM_CONVERT(D2I, i, bro_int_t, d)
+	VM_CONVERT(D2U, u, bro_uint_t, d)
+
+	VM_CASE(MOV_S)
+		s[ip->a] = s[ip->b];
+		VM_NEXT();
+	VM_CASE(MOV_V)
+		{
+		Val* x;
+		VM_TAKE_V(ip->b, x);
+		VM_SET_V(ip->a, x);
+		}
+		VM_NEXT();
+
+	VM_CASE(JMP)
+		VM_JUMP(ip->c);
+	VM_CASE(JMP_IF_FALSE)
+		if ( ! s[ip->b].i )
+			VM_JUMP(ip->c);
+		VM_NEXT();
+	VM_CASE(JMP_IF_TRUE)
+		if ( s[ip->b].i )
+			VM_JUMP(ip->c);
+		VM_NEXT();
+
+	VM_CASE(STORE_LOCAL)
+		{
+		Val* x;
+		VM_TAKE_V(ip->b, x);
+		f->SetElement(ip->a, x);
+		}
+		VM_NEXT();
+	VM_CASE(STORE_GLOBAL)
+		{
+		Val* x;
+		VM_TAKE_V(ip->b, x);
+		const_cast<Expr*>(ip->e)->Assign(f, x);
+		}
+		VM_NEXT();
+
+	VM_CASE(EXEC)
+		{
+		// Same as StmtList::Exec().
+		Val* x = ip->s->Exec(f, flow);
+
+		if ( flow != FLOW_NEXT || x || f->HasDelayed() )
+			{
+			result = x;
+			goto done;
+			}
+		}
+		VM_NEXT();
+
+	VM_CASE(CHECK_DELAYED)
+		if ( f->HasDelayed() )
+			goto done;
+		VM_NEXT();
+
+	VM_CASE(RET)
+		flow = FLOW_RETURN;
+		VM_TAKE_V(ip->b, result);
+		goto done;
+
+	VM_CASE(RET_NULL)
+		flow = FLOW_RETURN;
+		goto done;
+
+	VM_CASE(END)
+		goto done;
+
+#ifndef __GNUC__
+	}
+#endif
+	}
+
+	catch ( ... )
+		{
+		for ( int i = 0; i < num_vregs; ++i )
+			Unref(v[i]);
+
+		throw;
+		}
+
+done:
+	for ( int i = 0; i < num_vregs; ++i )
+		Unref(v[i]);
+
+	return result;
+	}
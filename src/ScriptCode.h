@@ -0,0 +1,81 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Function bodies lowered into a register-based bytecode. The AST
+// interpreter evaluates every expression through virtual Eval() calls and
+// boxes each intermediate result into a new Val; the bytecode instead keeps
+// bools, integers, counts, doubles, times and intervals unboxed in
+// registers and only creates a Val once a value gets stored or returned.
+//
+// Only the common, simple constructs get compiled: statement lists, ifs,
+// assignments to variables, and returns, along with the arithmetic,
+// logical and comparison operators, record field accesses, and constants
+// and variables feeding into them. Everything else stays with the AST
+// interpreter: a statement or expression the compiler doesn't know about
+// becomes a single instruction that calls its Exec() or Eval(). That way,
+// any body can be compiled, and the semantics (including error reporting)
+// are the same as without compilation.
+//
+// Compilation is turned on by setting BRO_COMPILE_SCRIPTS in the
+// environment. It's always off when running the script debugger, as
+// compiled statements don't go through the debugger's hooks.
+
+#ifndef scriptcode_h
+#define scriptcode_h
+
+#include <vector>
+
+#include "Stmt.h"
+
+class ScriptCompiler;
+
+class ScriptCode {
+public:
+	~ScriptCode();
+
+	// Compiles a function body. Returns nil if compilation is turned
+	// off, or if the body wouldn't benefit from it since there's nothing
+	// but constructs left to the AST interpreter.
+	static ScriptCode* Compile(const Stmt* body);
+
+	// Returns true if bodies get compiled.
+	static bool Enabled();
+
+	// Same semantics as Stmt::Exec() of the compiled body.
+	Val* Exec(Frame* f, stmt_flow_type& flow) const;
+
+	int NumInstructions() const	{ return code.size(); }
+
+protected:
+	friend class ScriptCompiler;
+
+	// Upper bound on the registers of each kind. Bodies needing more
+	// don't get compiled, so that all registers fit onto the stack.
+	static const int MAX_REGS = 64;
+
+	union Scalar {
+		bro_int_t i;
+		bro_uint_t u;
+		double d;
+	};
+
+	struct Instr {
+		int op;
+		int a, b, c;	// registers, offsets, or jump targets
+
+		union {
+			Scalar k;	// constant operand
+			Val* v;	// constant operand; we hold a reference
+			const Expr* e;	// for fallback and error reporting
+			const Stmt* s;	// for fallback
+			TypeTag t;	// type of a register to box
+		};
+	};
+
+	ScriptCode();
+
+	std::vector<Instr> code;
+	int num_sregs;	// unboxed registers
+	int num_vregs;	// boxed registers, each holding a reference
+};
+
+#endif
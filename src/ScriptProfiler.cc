@@ -0,0 +1,185 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "ScriptProfiler.h"
+#include "Frame.h"
+#include "Func.h"
+#include "Stmt.h"
+#include "Reporter.h"
+
+ScriptProfiler* script_profiler = 0;
+
+ScriptProfiler::ScriptProfiler(const std::string& arg_file)
+	: file(arg_file)
+	{
+	depth = 0;
+	ring = new Sample[RING_SIZE];
+	head = tail = 0;
+	num_samples = core_samples = dropped_samples = 0;
+	}
+
+ScriptProfiler::~ScriptProfiler()
+	{
+	delete [] ring;
+	}
+
+ScriptProfiler* ScriptProfiler::Start(const std::string& file,
+				      unsigned int frequency)
+	{
+	if ( script_profiler )
+		{
+		reporter->Error("script profiler is already running");
+		return 0;
+		}
+
+	if ( frequency == 0 || frequency > 1000000 )
+		{
+		reporter->Error("bad script profiler frequency: %u", frequency);
+		return 0;
+		}
+
+	ScriptProfiler* p = new ScriptProfiler(file);
+
+	// Pick up the calls that are already in progress.
+	for ( unsigned int i = 0; i < g_frame_stack.size(); ++i )
+		p->PushFrame(g_frame_stack[i]);
+
+	struct sigaction action;
+	action.sa_handler = SignalHandler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	if ( sigaction(SIGPROF, &action, &p->old_action) < 0 )
+		{
+		reporter->Error("cannot install script profiler: %s", strerror(errno));
+		delete p;
+		return 0;
+		}
+
+	script_profiler = p;
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / frequency;
+	timer.it_value = timer.it_interval;
+
+	if ( setitimer(ITIMER_PROF, &timer, 0) < 0 )
+		{
+		reporter->Error("cannot start script profiler: %s", strerror(errno));
+		script_profiler = 0;
+		sigaction(SIGPROF, &p->old_action, 0);
+		delete p;
+		return 0;
+		}
+
+	return p;
+	}
+
+bool ScriptProfiler::Stop()
+	{
+	struct itimerval timer;
+	timerclear(&timer.it_interval);
+	timerclear(&timer.it_value);
+	setitimer(ITIMER_PROF, &timer, 0);
+	sigaction(SIGPROF, &old_action, 0);
+
+	script_profiler = 0;
+	Drain();
+
+	if ( dropped_samples )
+		reporter->Warning("script profiler dropped %" PRIu64 " of %" PRIu64 " samples",
+				  uint64(dropped_samples), uint64(num_samples));
+
+	bool ok = true;
+	FILE* f = fopen(file.c_str(), "w");
+
+	if ( f )
+		{
+		if ( core_samples )
+			fprintf(f, "[core] %" PRIu64 "\n", uint64(core_samples));
+
+		std::map<std::string, uint64>::const_iterator i;
+		for ( i = stacks.begin(); i != stacks.end(); ++i )
+			fprintf(f, "%s %" PRIu64 "\n", i->first.c_str(), i->second);
+
+		if ( fclose(f) != 0 )
+			ok = false;
+		}
+	else
+		ok = false;
+
+	if ( ! ok )
+		reporter->Error("cannot write script profile to %s: %s",
+				file.c_str(), strerror(errno));
+
+	delete this;
+	return ok;
+	}
+
+void ScriptProfiler::Drain()
+	{
+	while ( tail != head )
+		{
+		const Sample& s = ring[tail % RING_SIZE];
+		std::string stack;
+
+		for ( int i = 0; i < s.depth; ++i )
+			{
+			if ( i > 0 )
+				stack += ";";
+
+			stack += s.funcs[i] ? s.funcs[i]->Name() : "<unknown>";
+			}
+
+		const Location* loc = s.stmt ? s.stmt->GetLocationInfo() : 0;
+
+		if ( loc && loc->filename )
+			stack += fmt(";%s:%d", loc->filename, loc->first_line);
+
+		++stacks[stack];
+		tail = tail + 1;
+		}
+	}
+
+void ScriptProfiler::SignalHandler(int signo)
+	{
+	ScriptProfiler* p = script_profiler;
+
+	if ( ! p )
+		return;
+
+	p->num_samples = p->num_samples + 1;
+
+	int depth = p->depth;
+
+	if ( depth == 0 )
+		{
+		p->core_samples = p->core_samples + 1;
+		return;
+		}
+
+	if ( p->head - p->tail >= RING_SIZE )
+		{
+		p->dropped_samples = p->dropped_samples + 1;
+		return;
+		}
+
+	Sample* s = &p->ring[p->head % RING_SIZE];
+	int n = depth < MAX_DEPTH ? depth : MAX_DEPTH;
+
+	for ( int i = 0; i < n; ++i )
+		s->funcs[i] = p->stack[i]->GetFunction();
+
+	s->depth = n;
+
+	// The statement only belongs to the sample's innermost call if
+	// that's where the stack actually ends.
+	s->stmt = depth <= MAX_DEPTH ? p->stack[depth - 1]->GetNextStmt() : 0;
+
+	p->head = p->head + 1;
+	}
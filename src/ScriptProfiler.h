@@ -0,0 +1,126 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef SCRIPTPROFILER_H
+#define SCRIPTPROFILER_H
+
+#include <signal.h>
+#include <string>
+#include <map>
+
+#include "util.h"
+
+class Frame;
+class BroFunc;
+class Stmt;
+
+/**
+ * A sampling profiler for script code.  While running, a SIGPROF timer
+ * interrupts Bro at a fixed rate of CPU time, and each interruption
+ * records the stack of script functions currently executing, along with
+ * the statement the innermost one is at.  When stopped, the profiler
+ * writes the samples as "folded stacks", one line per distinct stack
+ * with the number of times it was seen, which flame graph tools take
+ * as input.  Samples taken while no script code was running count
+ * towards a single "[core]" stack.
+ *
+ * The signal handler only copies pointers into a preallocated ring of
+ * samples; turning them into names happens later, outside of it.
+ */
+class ScriptProfiler {
+public:
+	/**
+	 * Starts profiling.  Afterwards, the global script_profiler points to
+	 * the new instance.
+	 *
+	 * @param file The file to write the folded stacks to when stopping.
+	 *
+	 * @param frequency The number of samples to take per second of CPU
+	 * time.
+	 *
+	 * @return The profiler, or null with an error reported if one is
+	 * already running or the timer can't be set up.
+	 */
+	static ScriptProfiler* Start(const std::string& file,
+				     unsigned int frequency);
+
+	/**
+	 * Stops profiling, writes the output file, and deletes the profiler.
+	 *
+	 * @return False if the output file couldn't be written, with an error
+	 * reported.
+	 */
+	bool Stop();
+
+	/**
+	 * Tells the profiler that a function call got its frame and is
+	 * about to execute.
+	 */
+	void PushFrame(const Frame* f)
+		{
+		if ( depth < MAX_DEPTH )
+			stack[depth] = f;
+
+		depth = depth + 1;
+
+		if ( head - tail >= RING_SIZE / 2 )
+			Drain();
+		}
+
+	/**
+	 * Tells the profiler that the innermost call has returned.
+	 */
+	void PopFrame()
+		{
+		if ( depth > 0 )
+			depth = depth - 1;
+		}
+
+	/**
+	 * @return The number of samples taken so far.
+	 */
+	uint64 NumSamples() const	{ return num_samples; }
+
+private:
+	ScriptProfiler(const std::string& file);
+	~ScriptProfiler();
+
+	// Turns the samples in the ring into entries of the stacks map.
+	void Drain();
+
+	static void SignalHandler(int signo);
+
+	// Samples record at most this many frames, the outermost ones.
+	static const int MAX_DEPTH = 64;
+
+	// Number of samples the ring holds until they get drained.
+	static const unsigned int RING_SIZE = 1024;
+
+	struct Sample {
+		int depth;
+		const BroFunc* funcs[MAX_DEPTH];
+		const Stmt* stmt;
+	};
+
+	std::string file;
+
+	// The frames of the calls in progress, as far as they fit.  All of
+	// the state that the signal handler touches is volatile.
+	const Frame* volatile stack[MAX_DEPTH];
+	volatile int depth;
+
+	Sample* ring;
+	volatile unsigned int head;	// written only by the handler
+	volatile unsigned int tail;	// written only outside of it
+	volatile uint64 num_samples;
+	volatile uint64 core_samples;
+	volatile uint64 dropped_samples;
+
+	std::map<std::string, uint64> stacks;
+
+	struct sigaction old_action;
+};
+
+// The running profiler, or null if there's none.
+extern ScriptProfiler* script_profiler;
+
+#endif
@@ -16,6 +16,8 @@ public:
 		include_locations = true;
 		new_cache_strategy = false;
 		broccoli_peer = false;
+		share_chunk = false;
+		shared_chunk = 0;
 		}
 
 	SerialInfo(const SerialInfo& info)
@@ -31,6 +33,8 @@ public:
 		include_locations = info.include_locations;
 		new_cache_strategy = info.new_cache_strategy;
 		broccoli_peer = info.broccoli_peer;
+		share_chunk = info.share_chunk;
+		shared_chunk = 0;
 		}
 
 	// Parameters that control serialization.
@@ -56,6 +60,12 @@ public:
 
 	ChunkedIO::Chunk* chunk; // chunk written right before the serialization
 
+	// If true, shared_chunk receives a chunk sharing the serialization's
+	// data (see ChunkedIO::Chunk::Share()), to write out again without
+	// serializing once more. The caller then owns it.
+	bool share_chunk;
+	ChunkedIO::Chunk* shared_chunk;
+
 	// Attributes set during serialization.
 	SerialType type;	// type of currently serialized object
 
@@ -53,6 +53,7 @@ SERIAL_IS(BITVECTOR, 0x1500)
 SERIAL_IS(COUNTERVECTOR, 0x1600)
 SERIAL_IS(BLOOMFILTER, 0x1700)
 SERIAL_IS(HASHER, 0x1800)
+SERIAL_IS(CUCKOOFILTER, 0x1900)
 
 // These are the externally visible types.
 const SerialType SER_NONE = 0;
@@ -115,6 +116,8 @@ SERIAL_VAL(CARDINALITY_VAL, 22)
 SERIAL_VAL(X509_VAL, 23)
 SERIAL_VAL(COMM_STORE_HANDLE_VAL, 24)
 SERIAL_VAL(COMM_DATA_VAL, 25)
+SERIAL_VAL(MOMENTS_VAL, 26)
+SERIAL_VAL(CUCKOOFILTER_VAL, 27)
 
 #define SERIAL_EXPR(name, val) SERIAL_CONST(name, val, EXPR)
 SERIAL_EXPR(EXPR, 1)
@@ -213,11 +216,13 @@ SERIAL_FUNC(BUILTIN_FUNC, 4)
 SERIAL_BLOOMFILTER(BLOOMFILTER, 1)
 SERIAL_BLOOMFILTER(BASICBLOOMFILTER, 2)
 SERIAL_BLOOMFILTER(COUNTINGBLOOMFILTER, 3)
+SERIAL_BLOOMFILTER(BLOCKEDBLOOMFILTER, 4)
 
 #define SERIAL_HASHER(name, val) SERIAL_CONST(name, val, HASHER)
 SERIAL_HASHER(HASHER, 1)
 SERIAL_HASHER(DEFAULTHASHER, 2)
 SERIAL_HASHER(DOUBLEHASHER, 3)
+SERIAL_HASHER(FASTHASHER, 4)
 
 SERIAL_CONST2(ID)
 SERIAL_CONST2(STATE_ACCESS)
@@ -226,5 +231,6 @@ SERIAL_CONST2(LOCATION)
 SERIAL_CONST2(RE_MATCHER)
 SERIAL_CONST2(BITVECTOR)
 SERIAL_CONST2(COUNTERVECTOR)
+SERIAL_CONST2(CUCKOOFILTER)
 
 #endif
@@ -84,6 +84,9 @@ bool Serializer::EndSerialization(SerialInfo* info)
 	chunk->len = format->EndWrite(&chunk->data);
 	chunk->free_func = ChunkedIO::Chunk::free_func_free;
 
+	if ( info->share_chunk )
+		info->shared_chunk = chunk->Share();
+
 	if ( ! io->Write(chunk) )
 		{
 		Error(io->Error());
@@ -125,7 +125,7 @@ protected:
 
 	// This will be increased whenever there is an incompatible change
 	// in the data format.
-	static const uint32 DATA_FORMAT_VERSION = 26;
+	static const uint32 DATA_FORMAT_VERSION = 27;
 
 	ChunkedIO* io;
 
@@ -28,6 +28,9 @@
 #include "analyzer/protocol/arp/ARP.h"
 #include "analyzer/protocol/arp/events.bif.h"
 #include "Discard.h"
+#include "ConnCompressor.h"
+#include "Metrics.h"
+#include "LoadShedder.h"
 #include "RuleMatcher.h"
 
 #include "TunnelEncapsulation.h"
@@ -44,6 +47,29 @@ enum NetBIOS_Service {
 
 NetSessions* sessions;
 
+static double current_connections()
+	{
+	return sessions ? sessions->CurrentConnections() : 0;
+	}
+
+static double reassembly_bytes()
+	{
+	return Reassembler::TotalMemoryAllocation();
+	}
+
+static double encapsulation_stacks()
+	{
+	return EncapsulationStack::Interned();
+	}
+
+static metrics::Counter* packets_metric =
+	metrics::registry()->NewCounter("sessions.packets",
+					"Packets processed.");
+static metrics::Histogram* packet_size_metric =
+	metrics::registry()->NewHistogram("sessions.packet_size",
+					  "Sizes of the packets processed, in bytes.",
+					  {64, 128, 256, 512, 1024, 1518, 9018});
+
 void TimerMgrExpireTimer::Dispatch(double t, int is_expire)
 	{
 	if ( mgr->LastAdvance() + timer_mgr_inactivity_timeout < timer_mgr->Time() )
@@ -90,7 +116,17 @@ void IPTunnelTimer::Dispatch(double t, int is_expire)
 		timer_mgr->Add(new IPTunnelTimer(t, tunnel_idx));
 	}
 
+static dict_layout session_dict_layout()
+	{
+	return BifConst::session_tables_open_addressing ?
+		OPEN_ADDRESSING : CHAINED;
+	}
+
 NetSessions::NetSessions()
+	: tcp_conns(UNORDERED, DEFAULT_DICT_SIZE, session_dict_layout()),
+	  udp_conns(UNORDERED, DEFAULT_DICT_SIZE, session_dict_layout()),
+	  icmp_conns(UNORDERED, DEFAULT_DICT_SIZE, session_dict_layout()),
+	  fragments(UNORDERED, DEFAULT_DICT_SIZE, session_dict_layout())
 	{
 	TypeList* t = new TypeList();
 	t->Append(base_type(TYPE_ADDR));	// source IP address
@@ -120,6 +156,17 @@ NetSessions::NetSessions()
 
 	packet_filter = 0;
 
+	if ( BifConst::lazy_inactivity_timeouts )
+		inactivity_sweeper = new InactivitySweeper(timer_mgr,
+					BifConst::inactivity_sweep_interval);
+	else
+		inactivity_sweeper = 0;
+
+	if ( BifConst::conn_compressor )
+		conn_compressor = new ConnCompressor();
+	else
+		conn_compressor = 0;
+
 	build_backdoor_analyzer =
 		backdoor_stats || rlogin_signature_found ||
 		telnet_signature_found || ssh_signature_found ||
@@ -129,6 +176,36 @@ NetSessions::NetSessions()
 
 	dump_this_packet = 0;
 	num_packets_processed = 0;
+	num_packets_other_shard = 0;
+	num_packets_unsampled = 0;
+	num_packets_bypassed = 0;
+	num_packets_shed = 0;
+
+	frag_memory = 0;
+	num_fragments_expired = 0;
+	num_fragments_dropped_source = 0;
+	num_fragments_dropped_total = 0;
+
+	metrics::registry()->NewCallbackGauge("sessions.connections",
+					      "Connections in memory.",
+					      current_connections);
+	metrics::registry()->NewCallbackGauge("reassembly.bytes_buffered",
+					      "Data buffered by all reassemblers, in bytes.",
+					      reassembly_bytes);
+	metrics::registry()->NewCallbackGauge("tunnels.encapsulation_stacks",
+					      "Distinct tunnel encapsulations in use.",
+					      encapsulation_stacks);
+
+	if ( BifConst::flow_shards > 1 &&
+	     BifConst::flow_shard >= BifConst::flow_shards )
+		reporter->FatalError("flow_shard must be less than flow_shards");
+
+	if ( BifConst::flow_sample_rate >= 1 )
+		flow_sample_threshold = uint64(1) << 32;
+	else if ( BifConst::flow_sample_rate <= 0 )
+		flow_sample_threshold = 0;
+	else
+		flow_sample_threshold = uint64(BifConst::flow_sample_rate * 4294967296.0);
 
 	if ( OS_version_found )
 		{
@@ -155,6 +232,8 @@ NetSessions::~NetSessions()
 	{
 	delete ch;
 	delete packet_filter;
+	delete inactivity_sweeper;
+	delete conn_compressor;
 	delete SYN_OS_Fingerprinter;
 	delete pkt_profiler;
 	Unref(arp_analyzer);
@@ -181,6 +260,18 @@ void NetSessions::NextPacket(double t, const Packet* pkt)
 		pkt_profiler->ProfilePkt(t, pkt->cap_len);
 
 	++num_packets_processed;
+	packets_metric->Inc();
+	packet_size_metric->Observe(pkt->len);
+
+	// Done here, in between packets, as releasing delivers data to the
+	// analyzers.
+	Reassembler::EnforceMemoryLimit(BifConst::reassembly_memory_limit);
+
+	if ( ! frag_expire_list.empty() )
+		ExpireFragments(t);
+
+	if ( conn_compressor )
+		conn_compressor->Expire(t);
 
 	dump_this_packet = 0;
 
@@ -315,6 +406,97 @@ static unsigned int gre_header_len(uint16 flags)
 	return len;
 	}
 
+void NetSessions::Prefetch(Packet* pkt)
+	{
+	pkt->conn_hash_valid = false;
+
+	if ( ! pkt->Layer2Valid() || pkt->hdr_size > pkt->cap_len )
+		return;
+
+	const u_char* l3 = pkt->data + pkt->hdr_size;
+	uint32 caplen = pkt->cap_len - pkt->hdr_size;
+	const u_char* l4;
+	int proto;
+	ConnID id;
+
+	// Only what DoNextPacket() gets to without reassembling or
+	// unwrapping anything, so that the ConnID comes out the same.
+	if ( pkt->l3_proto == L3_IPV4 )
+		{
+		if ( caplen < sizeof(struct ip) )
+			return;
+
+		const struct ip* ip = (const struct ip*) l3;
+		uint32 hdr_len = ip->ip_hl * 4;
+
+		if ( ip->ip_v != 4 || hdr_len < sizeof(struct ip) ||
+		     (ntohs(ip->ip_off) & 0x3fff) )
+			return;
+
+		id.src_addr = IPAddr(ip->ip_src);
+		id.dst_addr = IPAddr(ip->ip_dst);
+		proto = ip->ip_p;
+		l4 = l3 + hdr_len;
+		caplen = caplen > hdr_len ? caplen - hdr_len : 0;
+		}
+
+	else if ( pkt->l3_proto == L3_IPV6 )
+		{
+		if ( caplen < sizeof(struct ip6_hdr) )
+			return;
+
+		// No extension headers, which may change the addresses.
+		const struct ip6_hdr* ip6 = (const struct ip6_hdr*) l3;
+		id.src_addr = IPAddr(ip6->ip6_src);
+		id.dst_addr = IPAddr(ip6->ip6_dst);
+		proto = ip6->ip6_nxt;
+		l4 = l3 + sizeof(struct ip6_hdr);
+		caplen -= sizeof(struct ip6_hdr);
+		}
+
+	else
+		return;
+
+	if ( proto == IPPROTO_TCP && caplen >= sizeof(struct tcphdr) )
+		{
+		const struct tcphdr* tp = (const struct tcphdr*) l4;
+		id.src_port = tp->th_sport;
+		id.dst_port = tp->th_dport;
+		}
+
+	else if ( proto == IPPROTO_UDP && caplen >= sizeof(struct udphdr) )
+		{
+		const struct udphdr* up = (const struct udphdr*) l4;
+		id.src_port = up->uh_sport;
+		id.dst_port = up->uh_dport;
+		}
+
+	else
+		return;
+
+	id.is_one_way = 0;
+
+	pkt->conn_hash = ConnIDHash(id);
+	pkt->conn_hash_valid = true;
+	pkt->conn_proto = proto;
+
+	if ( proto == IPPROTO_TCP )
+		tcp_conns.Prefetch(pkt->conn_hash);
+	else
+		udp_conns.Prefetch(pkt->conn_hash);
+	}
+
+void NetSessions::PrefetchConnection(const Packet* pkt)
+	{
+	if ( ! pkt->conn_hash_valid )
+		return;
+
+	if ( pkt->conn_proto == IPPROTO_TCP )
+		tcp_conns.PrefetchValue(pkt->conn_hash);
+	else
+		udp_conns.PrefetchValue(pkt->conn_hash);
+	}
+
 void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr,
 			       const EncapsulationStack* encapsulation)
 	{
@@ -342,7 +524,7 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		 return;
 
 	int ip_hdr_len = ip_hdr->HdrLen();
-	if ( ! ignore_checksums && ip4 &&
+	if ( ! ignore_checksums && ip4 && ! pkt->checksums_verified &&
 	     ones_complement_checksum((void*) ip4, ip_hdr_len, 0) != 0xffff )
 		{
 		Weird("bad_IP_checksum", pkt, encapsulation);
@@ -371,6 +553,10 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		else
 			{
 			f = NextFragment(t, ip_hdr, pkt->data + pkt->hdr_size);
+			if ( ! f )
+				// Dropped.
+				return;
+
 			const IP_Hdr* ih = f->ReassembledPkt();
 			if ( ! ih )
 				// It didn't reassemble into anything yet.
@@ -664,7 +850,36 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		return;
 	}
 
-	HashKey* h = BuildConnIDHashKey(id);
+	if ( BifConst::flow_shards > 1 || flow_sample_threshold <= 0xffffffff )
+		{
+		uint32 flow_hash = FlowHash(id, proto);
+
+		if ( BifConst::flow_shards > 1 &&
+		     flow_hash % BifConst::flow_shards != BifConst::flow_shard )
+			{
+			// Another process takes care of this one.
+			++num_packets_other_shard;
+			return;
+			}
+
+		// The shard depends on the low bits, and sampling on the high
+		// ones, so each shard samples its fair share.
+		if ( flow_hash >= flow_sample_threshold )
+			{
+			++num_packets_unsampled;
+			return;
+			}
+		}
+
+	// Prefetch() may have computed the hash already, from the same
+	// headers unless we're looking at a reassembled fragment.
+	HashKey* h;
+
+	if ( pkt->conn_hash_valid && ! f && ! encapsulation )
+		h = BuildConnIDHashKey(id, pkt->conn_hash);
+	else
+		h = BuildConnIDHashKey(id);
+
 	if ( ! h )
 		reporter->InternalError("hash computation failed");
 
@@ -673,6 +888,29 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 	// FIXME: The following is getting pretty complex. Need to split up
 	// into separate functions.
 	conn = (Connection*) d->Lookup(h);
+
+	if ( ! conn && conn_compressor && proto == IPPROTO_TCP &&
+	     ! encapsulation )
+		{
+		ConnCompressor::Pending* p;
+
+		if ( conn_compressor->NextPacket(t, h, pkt, ip_hdr,
+					(const struct tcphdr*) data, &p) )
+			{
+			delete h;
+			return;
+			}
+
+		if ( p )
+			{
+			// The attempt got something other than a SYN, so
+			// now it's worth a connection.
+			ReplaySYN(p);
+			delete p;
+			conn = (Connection*) d->Lookup(h);
+			}
+		}
+
 	if ( ! conn )
 		{
 		conn = NewConn(h, t, &id, data, proto, ip_hdr->FlowLabel(), pkt, encapsulation);
@@ -712,12 +950,32 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		return;
 		}
 
-	int record_packet = 1;	// whether to record the packet at all
-	int record_content = 1;	// whether to record its data
-
 	int is_orig = (id.src_addr == conn->OrigAddr()) &&
 			(id.src_port == conn->OrigPort());
 
+	if ( conn->IsBypassed() )
+		{
+		// Nothing's interested in the packet anymore; all that's
+		// left is keeping the connection from timing out.
+		++num_packets_bypassed;
+		conn->BypassedPacket(t, is_orig, ip_hdr->TotalLen());
+		return;
+		}
+
+	if ( load_shedder && load_shedder->Active() &&
+	     load_shedder->ShuntConnection(conn) )
+		{
+		++num_packets_shed;
+		conn->Bypass();
+		conn->BypassedPacket(t, is_orig, ip_hdr->TotalLen());
+		return;
+		}
+
+	conn->CountBytes(ip_hdr->TotalLen());
+
+	int record_packet = 1;	// whether to record the packet at all
+	int record_content = 1;	// whether to record its data
+
 	conn->CheckFlowLabel(is_orig, ip_hdr->FlowLabel());
 
 	Val* pkt_hdr_val = 0;
@@ -732,16 +990,14 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		conn->Event(new_packet, 0,
 		        pkt_hdr_val ? pkt_hdr_val->Ref() : ip_hdr->BuildPktHdrVal());
 
+	conn->BufferPacket(pkt);
+
 	conn->NextPacket(t, is_orig, ip_hdr, len, caplen, data,
 				record_packet, record_content, pkt);
 
-	if ( f )
-		{
-		// Above we already recorded the fragment in its entirety.
-		f->DeleteTimer();
-		}
-
-	else if ( record_packet )
+	// For fragments, above we already recorded the packet in its
+	// entirety.
+	if ( ! f && record_packet )
 		{
 		if ( record_content )
 			dump_this_packet = 1;	// save the whole thing
@@ -787,9 +1043,7 @@ void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
 		l3_proto = L3_IPV6;
 		}
 
-	EncapsulationStack* outer = prev ?
-			new EncapsulationStack(*prev) : new EncapsulationStack();
-	outer->Add(ec);
+	EncapsulationStack* outer = EncapsulationStack::Intern(prev, ec);
 
 	// Construct fake packet for DoNextPacket
 	Packet p;
@@ -797,7 +1051,7 @@ void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
 	DoNextPacket(t, &p, inner, outer);
 
 	delete inner;
-	delete outer;
+	Unref(outer);
 	}
 
 int NetSessions::ParseIPPacket(int caplen, const u_char* const pkt, int proto,
@@ -880,41 +1134,136 @@ bool NetSessions::CheckHeaderTrunc(int proto, uint32 len, uint32 caplen,
 FragReassembler* NetSessions::NextFragment(double t, const IP_Hdr* ip,
 					const u_char* pkt)
 	{
-	uint32 frag_id = ip->ID();
-
-	ListVal* key = new ListVal(TYPE_ANY);
-	key->Append(new AddrVal(ip->SrcAddr()));
-	key->Append(new AddrVal(ip->DstAddr()));
-	key->Append(new Val(frag_id, TYPE_COUNT));
-
-	HashKey* h = ch->ComputeHash(key, 1);
-	if ( ! h )
-		reporter->InternalError("hash computation failed");
+	if ( ! FragmentFits(ip) )
+		return 0;
 
+	HashKey* h = FragReassembler::BuildKey(ip);
 	FragReassembler* f = fragments.Lookup(h);
+
 	if ( ! f )
 		{
 		f = new FragReassembler(this, ip, pkt, h, t);
 		fragments.Insert(h, f);
-		Unref(key);
+
+		if ( f->ExpireTime() )
+			f->expire_pos = frag_expire_list.insert(frag_expire_list.end(), f);
+		else
+			f->expire_pos = frag_expire_list.end();
+
+		AccountFragmentMemory(f);
 		return f;
 		}
 
 	delete h;
-	Unref(key);
 
 	f->AddFragment(t, ip, pkt);
+	AccountFragmentMemory(f);
 	return f;
 	}
 
-int NetSessions::Get_OS_From_SYN(struct os_type* retval,
+bool NetSessions::FragmentFits(const IP_Hdr* ip)
+	{
+	// The fragment's payload is about what it adds to the buffers.
+	uint64 len = ip->TotalLen();
+
+	if ( BifConst::frag_max_memory &&
+	     frag_memory + len > BifConst::frag_max_memory )
+		{
+		++num_fragments_dropped_total;
+		Weird("excessive_fragment_memory", ip);
+		return false;
+		}
+
+	if ( BifConst::frag_max_memory_per_source )
+		{
+		frag_memory_map::const_iterator i =
+			frag_source_memory.find(ip->SrcAddr());
+
+		if ( i != frag_source_memory.end() &&
+		     i->second + len > BifConst::frag_max_memory_per_source )
+			{
+			++num_fragments_dropped_source;
+			Weird("excessive_fragment_memory_for_source", ip);
+			return false;
+			}
+		}
+
+	return true;
+	}
+
+void NetSessions::SetFragmentMemory(FragReassembler* f, uint64 mem)
+	{
+	if ( mem == f->accounted_mem )
+		return;
+
+	frag_memory = frag_memory - f->accounted_mem + mem;
+
+	frag_memory_map::iterator i = frag_source_memory.find(f->Src());
+
+	if ( i == frag_source_memory.end() )
+		i = frag_source_memory.insert(frag_memory_map::value_type(f->Src(), 0)).first;
+
+	i->second = i->second - f->accounted_mem + mem;
+
+	if ( i->second == 0 )
+		frag_source_memory.erase(i);
+
+	f->accounted_mem = mem;
+	}
+
+void NetSessions::ReplaySYN(const ConnCompressor::Pending* p)
+	{
+	const Packet* syn = p->syn;
+	const u_char* ip_data = syn->data + syn->hdr_size;
+
+	int dump = dump_this_packet;
+	dump_this_packet = 0;
+
+	conn_compressor->SetReplaying(true);
+
+	if ( syn->l3_proto == L3_IPV4 )
+		{
+		IP_Hdr ip_hdr((const struct ip*) ip_data, false);
+		DoNextPacket(p->first_seen, syn, &ip_hdr, 0);
+		}
+	else
+		{
+		IP_Hdr ip_hdr((const struct ip6_hdr*) ip_data, false,
+			      syn->cap_len - syn->hdr_size);
+		DoNextPacket(p->first_seen, syn, &ip_hdr, 0);
+		}
+
+	conn_compressor->SetReplaying(false);
+
+	// With record_all_packets, the SYN got recorded when it arrived.
+	if ( dump_this_packet && ! record_all_packets )
+		DumpPacket(syn);
+
+	dump_this_packet = dump;
+	}
+
+void NetSessions::ExpireFragments(double t)
+	{
+	while ( ! frag_expire_list.empty() )
+		{
+		FragReassembler* f = frag_expire_list.front();
+
+		if ( f->ExpireTime() > t )
+			break;
+
+		++num_fragments_expired;
+		f->Expire(t);	// removes it from the list
+		}
+	}
+
+int NetSessions::Get_OS_From_SYN(const IPAddr& src, struct os_type* retval,
 		  uint16 tot, uint8 DF_flag, uint8 TTL, uint16 WSS,
 		  uint8 ocnt, uint8* op, uint16 MSS, uint8 win_scale,
 		  uint32 tstamp, /* uint8 TOS, */ uint32 quirks,
 		  uint8 ECN) const
 	{
 	return SYN_OS_Fingerprinter ?
-		SYN_OS_Fingerprinter->FindMatch(retval, tot, DF_flag, TTL,
+		SYN_OS_Fingerprinter->FindMatch(src, retval, tot, DF_flag, TTL,
 				WSS, ocnt, op, MSS, win_scale, tstamp,
 				quirks, ECN) : 0;
 	}
@@ -1065,6 +1414,14 @@ void NetSessions::Remove(FragReassembler* f)
 	if ( ! f )
 		return;
 
+	SetFragmentMemory(f, 0);
+
+	if ( f->expire_pos != frag_expire_list.end() )
+		{
+		frag_expire_list.erase(f->expire_pos);
+		f->expire_pos = frag_expire_list.end();
+		}
+
 	HashKey* k = f->Key();
 
 	if ( k )
@@ -1151,6 +1508,9 @@ void NetSessions::Drain()
 		ic->Event(connection_state_remove, 0);
 		}
 
+	if ( conn_compressor )
+		conn_compressor->Drain();
+
 	ExpireTimerMgrs();
 	}
 
@@ -1163,12 +1523,81 @@ void NetSessions::GetStats(SessionStats& s) const
 	s.num_ICMP_conns = icmp_conns.Length();
 	s.cumulative_ICMP_conns = icmp_conns.NumCumulativeInserts();
 	s.num_fragments = fragments.Length();
+	s.fragment_memory = frag_memory;
+	s.num_fragments_expired = num_fragments_expired;
+	s.num_fragments_dropped_source = num_fragments_dropped_source;
+	s.num_fragments_dropped_total = num_fragments_dropped_total;
 	s.num_packets = num_packets_processed;
+	s.num_packets_other_shard = num_packets_other_shard;
+	s.num_packets_unsampled = num_packets_unsampled;
+	s.num_packets_bypassed = num_packets_bypassed;
+	s.num_packets_shed = num_packets_shed;
+
+	if ( conn_compressor )
+		{
+		s.num_pending_attempts = conn_compressor->NumPending();
+		s.num_promoted_attempts = conn_compressor->NumPromoted();
+		s.num_summarized_attempts = conn_compressor->NumSummarized();
+		}
+	else
+		{
+		s.num_pending_attempts = 0;
+		s.num_promoted_attempts = s.num_summarized_attempts = 0;
+		}
 
 	s.max_TCP_conns = tcp_conns.MaxLength();
 	s.max_UDP_conns = udp_conns.MaxLength();
 	s.max_ICMP_conns = icmp_conns.MaxLength();
 	s.max_fragments = fragments.MaxLength();
+
+	s.pending_resize_moves = tcp_conns.PendingResizeMoves() +
+		udp_conns.PendingResizeMoves() +
+		icmp_conns.PendingResizeMoves() +
+		fragments.PendingResizeMoves();
+	}
+
+static inline uint32 mix_flow_hash(uint32 h, uint32 v)
+	{
+	// FNV-1a over 32-bit words, which is plenty for spreading flows.
+	return (h ^ v) * 16777619u;
+	}
+
+uint32 NetSessions::FlowHash(const ConnID& id, int proto)
+	{
+	// Order the endpoints so that both directions hash the same.
+	const IPAddr* a1 = &id.src_addr;
+	const IPAddr* a2 = &id.dst_addr;
+	uint32 p1 = id.src_port;
+	uint32 p2 = id.dst_port;
+
+	if ( addr_port_canon_lt(*a2, p2, *a1, p1) )
+		{
+		std::swap(a1, a2);
+		std::swap(p1, p2);
+		}
+
+	const uint32_t* b1;
+	const uint32_t* b2;
+	int n1 = a1->GetBytes(&b1);
+	int n2 = a2->GetBytes(&b2);
+
+	uint32 h = 2166136261u;
+
+	for ( int i = 0; i < n1; ++i )
+		h = mix_flow_hash(h, b1[i]);
+
+	for ( int i = 0; i < n2; ++i )
+		h = mix_flow_hash(h, b2[i]);
+
+	h = mix_flow_hash(h, (p1 << 16) | (p2 & 0xffff));
+	h = mix_flow_hash(h, proto);
+
+	// Final avalanche so that the low bits depend on all input.
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+
+	return h;
 	}
 
 Connection* NetSessions::NewConn(HashKey* k, double t, const ConnID* id,
@@ -1229,6 +1658,14 @@ Connection* NetSessions::NewConn(HashKey* k, double t, const ConnID* id,
 		id = &flip_id;
 		}
 
+	if ( load_shedder && load_shedder->Active() &&
+	     ! load_shedder->AdmitConnection(ntohs(id->dst_port), tproto,
+					     FlowHash(*id, proto)) )
+		{
+		++num_packets_shed;
+		return 0;
+		}
+
 	Connection* conn = new Connection(this, k, t, id, flow_label, pkt, encapsulation);
 	conn->SetTransport(tproto);
 
@@ -1444,6 +1881,27 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 	return mem;
 	}
 
+void NetSessions::AnalyzerMemoryUsage(std::vector<uint64>* by_type)
+	{
+	if ( terminating )
+		// Connections have been flushed already.
+		return;
+
+	PDict(Connection)* dicts[] = { &tcp_conns, &udp_conns, &icmp_conns };
+
+	for ( int i = 0; i < 3; ++i )
+		{
+		IterCookie* cookie = dicts[i]->InitForIteration();
+		Connection* c;
+
+		while ( (c = dicts[i]->NextEntry(cookie)) )
+			{
+			if ( c->GetRootAnalyzer() )
+				analyzer_mgr->AddMemoryUsage(c->GetRootAnalyzer(), by_type);
+			}
+		}
+	}
+
 unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 	{
 	unsigned int mem = 0;
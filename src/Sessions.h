@@ -11,14 +11,15 @@
 #include "Stats.h"
 #include "NetVar.h"
 #include "TunnelEncapsulation.h"
+#include "ConnCompressor.h"
 #include "analyzer/protocol/tcp/Stats.h"
 
 #include <utility>
 
 class EncapsulationStack;
 class Connection;
+class InactivitySweeper;
 class OSFingerprint;
-class ConnCompressor;
 struct ConnID;
 
 declare(PDict,Connection);
@@ -45,7 +46,23 @@ struct SessionStats {
 
 	int num_fragments;
 	int max_fragments;
+	uint64 fragment_memory;
+	uint64 num_fragments_expired;
+	uint64 num_fragments_dropped_source;	// over frag_max_memory_per_source
+	uint64 num_fragments_dropped_total;	// over frag_max_memory
 	uint64 num_packets;
+	uint64 num_packets_other_shard;
+	uint64 num_packets_unsampled;	// because of flow_sample_rate
+	uint64 num_packets_bypassed;
+	uint64 num_packets_shed;	// of connections refused or shunted
+
+	// Connection attempts held back by conn_compressor.
+	int num_pending_attempts;
+	uint64 num_promoted_attempts;
+	uint64 num_summarized_attempts;
+
+	// Entries still to be moved by ongoing resizes of the tables above.
+	int pending_resize_moves;
 };
 
 // Drains and deletes a timer manager if it hasn't seen any advances
@@ -70,14 +87,32 @@ public:
 	// Main entry point for packet processing.
 	void NextPacket(double t, const Packet* pkt);
 
+	// Classifies a packet that's about to be processed soon, such as
+	// a later one of a batch. For plain TCP and UDP packets, this
+	// records the hash of their connection's key in the packet and
+	// starts fetching the connection table's entry for it into the
+	// cache, so that NextPacket() finds both ready.
+	void Prefetch(Packet* pkt);
+
+	// Second step for a packet that Prefetch() has classified a while
+	// ago: starts fetching its Connection, which requires the table
+	// entry to give the pointer.
+	void PrefetchConnection(const Packet* pkt);
+
 	void Done();	// call to drain events before destructing
 
-	// Returns a reassembled packet, or nil if there are still
-	// some missing fragments.
+	// Returns the fragment's reassembler, which has the reassembled
+	// packet once there are no missing fragments anymore.  Returns nil
+	// if the fragment got dropped for exceeding a memory limit.
 	FragReassembler* NextFragment(double t, const IP_Hdr* ip,
 				const u_char* pkt);
 
-	int Get_OS_From_SYN(struct os_type* retval,
+	// Updates the memory counted for the reassembler's source and in
+	// total after it has changed.
+	void AccountFragmentMemory(FragReassembler* f)
+		{ SetFragmentMemory(f, f->BlockMemory()); }
+
+	int Get_OS_From_SYN(const IPAddr& src, struct os_type* retval,
 			uint16 tot, uint8 DF_flag, uint8 TTL, uint16 WSS,
 			uint8 ocnt, uint8* op, uint16 MSS, uint8 win_scale,
 			uint32 tstamp, /* uint8 TOS, */ uint32 quirks,
@@ -113,6 +148,25 @@ public:
 		return packet_filter;
 		}
 
+	// Returns a hash of the connection's endpoints that's the same for
+	// both directions. This selects the flow shard a packet belongs to.
+	static uint32 FlowHash(const ConnID& id, int proto);
+
+	// Extrapolates a count of connections seen to all traffic, for when
+	// flow_sample_rate has us analyze only some.
+	uint64 ScaleBySampling(uint64 n) const
+		{
+		if ( BifConst::flow_sample_rate >= 1 || BifConst::flow_sample_rate <= 0 )
+			return n;
+
+		return uint64(n / BifConst::flow_sample_rate + 0.5);
+		}
+
+	// Returns the sweeper handling connection inactivity timeouts if
+	// lazy_inactivity_timeouts is set, or null otherwise.
+	InactivitySweeper* GetInactivitySweeper() const
+		{ return inactivity_sweeper; }
+
 	// Looks up timer manager associated with tag.  If tag is unknown and
 	// "create" is true, creates new timer manager and stores it.  Returns
 	// global timer manager if tag is nil.
@@ -174,6 +228,10 @@ public:
 
 	unsigned int ConnectionMemoryUsage();
 	unsigned int ConnectionMemoryUsageConnVals();
+
+	// Adds up the memory that the connections' analyzers use, per analyzer
+	// type; see analyzer::Manager::AddMemoryUsage().
+	void AnalyzerMemoryUsage(std::vector<uint64>* by_type);
 	unsigned int MemoryAllocation();
 	analyzer::tcp::TCPStateStats tcp_stats;	// keeps statistics on TCP states
 
@@ -223,12 +281,37 @@ protected:
 	bool CheckHeaderTrunc(int proto, uint32 len, uint32 caplen,
 			      const Packet *pkt, const EncapsulationStack* encap);
 
+	// Returns false, reporting a weird, if buffering the fragment would
+	// exceed frag_max_memory_per_source or frag_max_memory.
+	bool FragmentFits(const IP_Hdr* ip);
+
+	void SetFragmentMemory(FragReassembler* f, uint64 mem);
+
+	// Expires the fragment reassemblers that have timed out by t, in a
+	// batch from the front of frag_expire_list.
+	void ExpireFragments(double t);
+
+	// Instantiates the connection of an attempt that ConnCompressor held
+	// back, by processing its SYN.
+	void ReplaySYN(const ConnCompressor::Pending* p);
+
 	CompositeHash* ch;
 	PDict(Connection) tcp_conns;
 	PDict(Connection) udp_conns;
 	PDict(Connection) icmp_conns;
 	PDict(FragReassembler) fragments;
 
+	// The reassemblers that time out, oldest first.  As they all have
+	// the same timeout, that's also the order they expire in.
+	FragReassembler::expire_list frag_expire_list;
+
+	typedef std::map<IPAddr, uint64> frag_memory_map;
+	frag_memory_map frag_source_memory;
+	uint64 frag_memory;
+	uint64 num_fragments_expired;
+	uint64 num_fragments_dropped_source;
+	uint64 num_fragments_dropped_total;
+
 	typedef pair<IPAddr, IPAddr> IPPair;
 	typedef pair<EncapsulatingConn, double> TunnelActivity;
 	typedef std::map<IPPair, TunnelActivity> IPTunnelMap;
@@ -239,10 +322,19 @@ protected:
 	analyzer::stepping_stone::SteppingStoneManager* stp_manager;
 	Discarder* discarder;
 	PacketFilter* packet_filter;
+	InactivitySweeper* inactivity_sweeper;
+	ConnCompressor* conn_compressor;
 	OSFingerprint* SYN_OS_Fingerprinter;
 	int build_backdoor_analyzer;
 	int dump_this_packet;	// if true, current packet should be recorded
 	uint64 num_packets_processed;
+	uint64 num_packets_other_shard;
+	uint64 num_packets_unsampled;
+	uint64 num_packets_bypassed;
+	uint64 num_packets_shed;
+
+	// Flow hashes below this get analyzed, see flow_sample_rate.
+	uint64 flow_sample_threshold;
 	PacketProfiler* pkt_profiler;
 
 	// We may use independent timer managers for different sets of related
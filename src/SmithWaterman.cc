@@ -94,13 +94,13 @@ VectorVal* BroSubstring::VecToPolicy(Vec* vec)
 
 				RecordVal* align_val = new RecordVal(sw_align_type);
 				align_val->Assign(0, new StringVal(new BroString(*align.string)));
-				align_val->Assign(1, new Val(align.index, TYPE_COUNT));
+				align_val->Assign(1, val_mgr->GetCount(align.index));
 
 				aligns->Assign(j+1, align_val);
 				}
 
 			st_val->Assign(1, aligns);
-			st_val->Assign(2, new Val(bst->IsNewAlignment(), TYPE_BOOL));
+			st_val->Assign(2, val_mgr->GetBool(bst->IsNewAlignment()));
 			result->Assign(i+1, st_val);
 			}
 		}
@@ -188,58 +188,38 @@ bool BroSubstringCmp::operator()(const BroSubstring* bst1,
 		return false;
 		}
 
-	if ( bst1->GetAlignments()[_index].index <=
-	     bst2->GetAlignments()[_index].index )
-		return true;
-
-	return false;
+	// This needs to be a strict ordering for sort().
+	return bst1->GetAlignments()[_index].index <
+	       bst2->GetAlignments()[_index].index;
 	}
 
-// A node in Smith-Waterman's dynamic programming matrix.  Each node
-// contains the byte it represents in the case of a match, the score
-// at this point, and a pointer to the previous cell. Previous means
-// one up and left in case of a match, or a jump somewhere above and
-// left in case of a gap.
-//
-struct SWNode {
-	// ID field for the cell, for debugging purposes.
-	int id;
-
-	u_char swn_byte;
-	bool swn_byte_assigned;
-	bool swn_visited;
-
-	// The score in this cell. The cell with the globally best score
-	// marks the end of the alignment.
-	int swn_score;
-
-	// Pointer to previous match, walking back yields subsequence.
-	SWNode* swn_prev;
-};
-
-// A matrix of Smith-Waterman nodes.
+// Smith-Waterman's dynamic programming matrix.  While filling it in, we
+// need the scores of the current and the previous row only, so the
+// matrix itself just keeps what traceback needs: one byte per cell,
+// saying whether the bytes matched there and which neighbor the cell's
+// predecessor is.  A match continues from the cell up and left; a gap
+// from the one above or the one to the left.  Row and column 0 have no
+// predecessor.
 //
 class SWNodeMatrix {
 public:
+	enum {
+		SWN_MATCH = 1,		// the bytes match; predecessor is up-left
+		SWN_UP = 2,		// gap; predecessor is above (else left)
+		SWN_VISITED = 4,	// traceback has been here
+	};
+
 	SWNodeMatrix(const BroString* s1, const BroString* s2)
 	: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1)
 		{
-		_nodes = new SWNode[_cols * _rows];
-		memset(_nodes, 0, sizeof(SWNode) * _cols * _rows);
+		_nodes = new u_char[_cols * _rows];
+		memset(_nodes, 0, _cols * _rows);
 		}
 
 	~SWNodeMatrix()	{ delete [] _nodes; }
 
-	SWNode* operator()(int row, int col)
-		{
-		// Make sure access is in allowed range.
-		if ( row < 0 || row >= _rows )
-			return 0;
-		if ( col < 0 || col >= _cols )
-			return 0;
-
-		return &(_nodes[row * _cols + col]);
-		}
+	u_char& operator()(int row, int col)
+		{ return _nodes[row * _cols + col]; }
 
 	const BroString* GetRowsString() const	{ return _s1; }
 	const BroString* GetColsString() const	{ return _s2; }
@@ -247,55 +227,44 @@ public:
 	int GetHeight() const	{ return _rows; }
 	int GetWidth() const	{ return _cols; }
 
-	// Quick helper function that calculates the coordinates of a
-	// node in the matrix via pointer arithmetic.
-	//
-	void GetNodeIndices(SWNode* node, int& row, int& col)
-		{
-		SWNode* base = &_nodes[0];
-		int offset = (node - base);
-		col = (offset % _cols);
-		row = (offset / _cols);
-		}
-
 private:
 	const BroString* _s1;
 	const BroString* _s2;
 
 	int _rows, _cols;
-	SWNode* _nodes;
+	u_char* _nodes;
 };
 
 // Returns the common subsequence starting from a given node.
 // @result: vector holding results on return.
 // @matrix: SW matrix.
-// @node: starting node.
+// @i, @j: starting node.
 // @params: SW parameters.
 //
 static void sw_collect_single(BroSubstring::Vec* result, SWNodeMatrix& matrix,
-			      SWNode* node, SWParams& params)
+			      int i, int j, SWParams& params)
 	{
 	string substring("");
 	int row = 0, col = 0;
+	const u_char* bytes = matrix.GetRowsString()->Bytes();
 
-	while ( node )
+	while ( true )
 		{
-//		printf("NODE: %i\n", node->id);
-		node->swn_visited = true;
+		u_char& node = matrix(i, j);
+		node |= SWNodeMatrix::SWN_VISITED;
 
 		// Once we hit a gap, terminate the string and prepend
 		// it to our result vector, IF it has at least the length
 		// requested through the params._min_toklen parameter.
 		//
-		if ( node->swn_byte_assigned )
+		if ( node & SWNodeMatrix::SWN_MATCH )
 			{
-			matrix.GetNodeIndices(node, row, col);
-			substring += node->swn_byte;
-//			printf("SUBSTRING: %s\n", substring.c_str());
+			row = i;
+			col = j;
+			substring += bytes[i-1];
 			}
 		else
 			{
-//			printf("GAP\n");
 			if ( substring.size() >= params._min_toklen )
 				{
 				reverse(substring.begin(), substring.end());
@@ -308,7 +277,18 @@ static void sw_collect_single(BroSubstring::Vec* result, SWNodeMatrix& matrix,
 			substring = "";
 			}
 
-		node = node->swn_prev;
+		if ( i == 0 || j == 0 )
+			break;
+
+		if ( node & SWNodeMatrix::SWN_MATCH )
+			{
+			--i;
+			--j;
+			}
+		else if ( node & SWNodeMatrix::SWN_UP )
+			--i;
+		else
+			--j;
 		}
 
 	// Anything left over now is the first string of an alignment and is
@@ -345,13 +325,14 @@ static void sw_collect_multiple(BroSubstring::Vec* result,
 		{
 		for ( int j = matrix.GetWidth() - 1; j > 0; --j )
 			{
-			SWNode* node = matrix(i, j);
+			u_char node = matrix(i, j);
 
-			if ( ! (node->swn_byte_assigned && ! node->swn_visited) )
+			if ( ! ((node & SWNodeMatrix::SWN_MATCH) &&
+				! (node & SWNodeMatrix::SWN_VISITED)) )
 				continue;
 
 			BroSubstring::Vec* new_al = new BroSubstring::Vec();
-			sw_collect_single(new_al, matrix, node, params);
+			sw_collect_single(new_al, matrix, i, j, params);
 
 			for ( vector<BroSubstring::Vec*>::iterator it = als.begin();
 			      it != als.end(); ++it )
@@ -425,14 +406,16 @@ BroSubstring::Vec* smith_waterman(const BroString* s1, const BroString* s2,
 	int i, len1 = s1->Len() + 1;
 	int j, len2 = s2->Len() + 1;
 
-	int row = 0, col = 0;
-
 	byte_vec string1 = s1->Bytes();
 	byte_vec string2 = s2->Bytes();
 
 	SWNodeMatrix matrix(s1, s2);	// dynamic programming matrix.
-	SWNode* node_max = 0;	// pointer to the best score's node
-	SWNode* node_br_max = 0;	// pointer to lowest-right matching node
+	int max_i = 0, max_j = 0;	// the best score's node
+
+	// The scores of the previous and the current row.  Row and column 0
+	// stay at 0.
+	vector<int> scores_t(len2, 0);
+	vector<int> scores(len2, 0);
 
 	// The highest score in the matrix, globally.  We initialize to 1
 	// because we are only interested in real scores (initializing to
@@ -440,121 +423,74 @@ BroSubstring::Vec* smith_waterman(const BroString* s1, const BroString* s2,
 	// structure in the matrix).
 	//
 	int matrix_max = 1;
-	int br_max_r = 0;
-	int br_max_b = 0;
-
-
-	// Matrix initialization ----------------------------------------------
-
-	// Assign IDs to each cell -- this is only for debugging purposes
-	// and can go later.
-
-	int counter = 1;
-
-	for ( i = 1; i < len1; ++i )
-		for ( j = 1; j < len2; ++j )
-			matrix(i, j)->id = counter++;
 
 	// Subsequence calculation --------------------------------------------
 
 	for ( i = 1; i < len1; ++i )
 		{
+		u_char byte1 = string1[i-1];
+
 		for ( j = 1; j < len2; ++j )
 			{
-			// Current node, top/left neighbours.
-			//
-			SWNode* current = matrix(i, j);
-			SWNode* node_tl = matrix(i-1, j-1);
-			SWNode* node_l  = matrix(i, j-1);
-			SWNode* node_t  = matrix(i-1, j);
-
 			// Scores of neighbouring nodes.
 			//
-			int score_t = node_t->swn_score;
-			int score_l = node_l->swn_score;
-			int score_tl = node_tl->swn_score;
+			int score_t = scores_t[j];
+			int score_l = scores[j-1];
+			int score_tl = scores_t[j-1];
+			int score;
+			u_char node;
 
 			// If strings at current indices match, assign new
 			// score to current node.  Minus-one adjustments
 			// are necessary since matrix has one extra
 			// row + column.
 			//
-			if ( string1[i-1] == string2[j-1] )
+			if ( byte1 == string2[j-1] )
 				{
 				// We have a match: improve previous score.
-				//
-				score_tl += 1;
-
 				// If we're continuing a chain of matches, rate
 				// higher.  This favours longer consecutive
 				// substrings.
 				//
-				if ( node_tl->swn_byte_assigned )
-					score_tl += 99;
+				score = score_tl + 1;
 
-				// Store the byte we've matched in the node for
-				// easier access.
-				//
-				current->swn_byte = string1[i-1];
-				current->swn_byte_assigned = true;
+				if ( matrix(i-1, j-1) & SWNodeMatrix::SWN_MATCH )
+					score += 99;
+
+				node = SWNodeMatrix::SWN_MATCH;
 				}
 
-			// Pick the score among the neighbours that is now highest.
-			// This is the core of Smith-Waterman.
-			//
-			if ( current->swn_byte_assigned )
-				current->swn_score = score_tl;
 			else
-				current->swn_score = max(max(score_t, score_l), score_tl);
-
-			// Establish predecessor chain according to neighbor
-			// with best score.
-			//
-			if ( current->swn_score == score_tl &&
-			     current->swn_byte_assigned )
 				{
-				// If we had matched bytes (*and* it's the
-				// best neighbor), marke the node accordingly
+				// Pick the score among the neighbours that is
+				// now highest.  This is the core of
+				// Smith-Waterman.
 				//
-				if ( i >= br_max_b && j >= br_max_r )
-					{
-					node_br_max = current;
-					br_max_b = i;
-					br_max_r = j;
-					}
+				score = max(max(score_t, score_l), score_tl);
 
-				current->swn_prev = node_tl;
+				// Establish predecessor according to neighbor
+				// with best score.
+				//
+				node = (score == score_t) ? SWNodeMatrix::SWN_UP : 0;
 				}
-			else if ( current->swn_score == score_t )
-				current->swn_prev = node_t;
-			else
-				current->swn_prev = node_l;
+
+			matrix(i, j) = node;
+			scores[j] = score;
 
 			// Check if we have a new global maximum -- we
 			// specifically track the node that is the global
 			// maximum so we now from where to backtrack at
 			// the end of the matrix iteration.
 			//
-			if ( current->swn_score > matrix_max )
+			if ( score > matrix_max )
 				{
-				node_max = current;
-				matrix_max = current->swn_score;
+				max_i = i;
+				max_j = j;
+				matrix_max = score;
 				}
-
-#if 0
-			printf("%4i/%.5i%c/%.5i[%c%c] ",
-				current->swn_score,
-		 		current->id,
-				current->swn_byte_assigned ? '*' : ' ',
-		 		current->swn_prev ? current->swn_prev->id : 0,
-			       string1[i-1], string2[j-1]);
-#endif
-			//printf("%.5i ", current->swn_score); 
 			}
 
-#if 0
-		printf("\n");
-#endif
+		scores_t.swap(scores);
 		}
 
 	// Result generation.
@@ -566,8 +502,8 @@ BroSubstring::Vec* smith_waterman(const BroString* s1, const BroString* s2,
 
 	if ( params._sw_variant == SW_MULTIPLE )
 		sw_collect_multiple(result, matrix, params);
-	else
-		sw_collect_single(result, matrix, node_max, params);
+	else if ( matrix_max > 1 )
+		sw_collect_single(result, matrix, max_i, max_j, params);
 
 	if ( len1 > len2 )
 		sort(result->begin(), result->end(), BroSubstringCmp(0));
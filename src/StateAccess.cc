@@ -540,6 +540,131 @@ ID* StateAccess::Target() const
 	return target_type == TYPE_ID ? target.id : target.val->UniqueID();
 	}
 
+static bool deferrable_val(const Val* v)
+	{
+	if ( ! v )
+		return true;
+
+	if ( v->Type()->Tag() == TYPE_LIST )
+		{
+		// An index.
+		const val_list* vals = v->AsListVal()->Vals();
+
+		loop_over_list(*vals, i)
+			if ( ! is_atomic_val((*vals)[i]) )
+				return false;
+
+		return true;
+		}
+
+	return is_atomic_val(v);
+	}
+
+bool StateAccess::Deferrable() const
+	{
+	if ( target_type != TYPE_ID || opcode == OP_PRINT )
+		return false;
+
+	if ( op1_type == TYPE_VAL && ! deferrable_val(op1.val) )
+		return false;
+
+	return deferrable_val(op2) && deferrable_val(op3);
+	}
+
+// Drops our reference to *old_val* in favor of one to *new_val*.
+static Val* replace_val(Val* old_val, Val* new_val)
+	{
+	Unref(old_val);
+	return new_val ? new_val->Ref() : 0;
+	}
+
+bool StateAccess::Absorb(const StateAccess& later)
+	{
+	if ( later.opcode != opcode || target_type != TYPE_ID ||
+	     later.target_type != TYPE_ID || later.target.id != target.id )
+		return false;
+
+	if ( opcode == OP_ASSIGN_IDX || opcode == OP_INCR_IDX )
+		{
+		HashKey* k1 = TableIndex();
+		HashKey* k2 = later.TableIndex();
+		bool same = k1 && k2 && k1->Size() == k2->Size() &&
+			memcmp(k1->Key(), k2->Key(), k1->Size()) == 0;
+		delete k1;
+		delete k2;
+
+		if ( ! same )
+			return false;
+		}
+
+	switch ( opcode ) {
+	case OP_ASSIGN:
+		// new old
+		if ( op1_type != TYPE_VAL || later.op1_type != TYPE_VAL )
+			return false;
+
+		op1.val = replace_val(op1.val, later.op1.val);
+		return true;
+
+	case OP_ASSIGN_IDX:
+		// idx new old
+		op2 = replace_val(op2, later.op2);
+		return true;
+
+	case OP_INCR:
+		// new old. The receiver adds the difference, so ours has to
+		// end where the later one starts.
+		if ( op1_type != TYPE_VAL || later.op1_type != TYPE_VAL ||
+		     ! (op1.val && later.op1.val && later.op2) ||
+		     ! IsIntegral(op1.val->Type()->Tag()) ||
+		     op1.val->CoerceToInt() != later.op2->CoerceToInt() )
+			return false;
+
+		op1.val = replace_val(op1.val, later.op1.val);
+		return true;
+
+	case OP_INCR_IDX:
+		// idx new old, same as above.
+		if ( ! (op2 && later.op2 && later.op3) ||
+		     op2->CoerceToInt() != later.op3->CoerceToInt() )
+			return false;
+
+		op2 = replace_val(op2, later.op2);
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+HashKey* StateAccess::TableIndex() const
+	{
+	switch ( opcode ) {
+	case OP_ASSIGN_IDX:
+	case OP_ADD:
+	case OP_INCR_IDX:
+	case OP_DEL:
+	case OP_EXPIRE:
+	case OP_READ_IDX:
+		break;
+
+	default:
+		return 0;
+	}
+
+	Val* v = target_type == TYPE_ID ? target.id->ID_Val() : target.val;
+
+	if ( ! v || v->Type()->Tag() != TYPE_TABLE )
+		return 0;
+
+	if ( op1_type == TYPE_KEY )
+		return op1.key ?
+			new HashKey(op1.key->Key(), op1.key->Size(),
+				    op1.key->Hash()) : 0;
+
+	return op1.val ? v->AsTableVal()->ComputeHash(op1.val) : 0;
+	}
+
 bool StateAccess::Serialize(SerialInfo* info) const
 	{
 	return SerialObj::Serialize(info);
@@ -921,11 +1046,8 @@ void StateAccess::Log(StateAccess* access)
 
 NotifierRegistry notifiers;
 
-void NotifierRegistry::Register(ID* id, NotifierRegistry::Notifier* notifier)
+void NotifierRegistry::Track(ID* id)
 	{
-	DBG_LOG(DBG_NOTIFIERS, "registering ID %s for notifier %s",
-		id->Name(), notifier->Name());
-
 	Attr* attr = new Attr(ATTR_TRACKED);
 
 	if ( id->Attrs() )
@@ -941,6 +1063,15 @@ void NotifierRegistry::Register(ID* id, NotifierRegistry::Notifier* notifier)
 		}
 
 	Unref(attr);
+	Ref(id);
+	}
+
+void NotifierRegistry::Register(ID* id, NotifierRegistry::Notifier* notifier)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "registering ID %s for notifier %s",
+		id->Name(), notifier->Name());
+
+	Track(id);
 
 	NotifierMap::iterator i = ids.find(id->Name());
 
@@ -952,8 +1083,6 @@ void NotifierRegistry::Register(ID* id, NotifierRegistry::Notifier* notifier)
 		s->insert(notifier);
 		ids.insert(NotifierMap::value_type(id->Name(), s));
 		}
-
-	Ref(id);
 	}
 
 void NotifierRegistry::Register(Val* val, NotifierRegistry::Notifier* notifier)
@@ -994,18 +1123,62 @@ void NotifierRegistry::Unregister(Val* val, NotifierRegistry::Notifier* notifier
 		Unregister(val->AsMutableVal()->UniqueID(), notifier);
 	}
 
-void NotifierRegistry::AccessPerformed(const StateAccess& sa)
+void NotifierRegistry::Register(TableVal* val, const HashKey* index,
+				NotifierRegistry::Notifier* notifier)
 	{
-	ID* id = sa.Target();
+	ID* id = val->UniqueID();
 
-	NotifierMap::iterator i = ids.find(id->Name());
+	DBG_LOG(DBG_NOTIFIERS, "registering index of %s for notifier %s",
+		id->Name(), notifier->Name());
 
-	if ( i == ids.end() )
-		return;
+	Track(id);
 
-	DBG_LOG(DBG_NOTIFIERS, "modification to tracked ID %s", id->Name());
+	IndexName name(id->Name(), std::string((const char*) index->Key(),
+						index->Size()));
+	IndexNotifierMap::iterator i = indices.find(name);
+
+	if ( i != indices.end() )
+		i->second->insert(notifier);
+	else
+		{
+		NotifierSet* s = new NotifierSet;
+		s->insert(notifier);
+		indices.insert(IndexNotifierMap::value_type(name, s));
+		}
+	}
+
+void NotifierRegistry::Unregister(TableVal* val, const HashKey* index,
+				NotifierRegistry::Notifier* notifier)
+	{
+	ID* id = val->UniqueID();
+
+	DBG_LOG(DBG_NOTIFIERS, "unregistering index of %s for notifier %s",
+		id->Name(), notifier->Name());
+
+	IndexName name(id->Name(), std::string((const char*) index->Key(),
+						index->Size()));
+	IndexNotifierMap::iterator i = indices.find(name);
+
+	if ( i == indices.end() )
+		return;
 
 	NotifierSet* s = i->second;
+	s->erase(notifier);
+
+	if ( s->size() == 0 )
+		{
+		delete s;
+		indices.erase(i);
+		}
+
+	// Unlike with whole IDs, we leave the tracking in place, as other
+	// indices of the same table may still be watched.
+	Unref(id);
+	}
+
+void NotifierRegistry::Notify(NotifierSet* s, ID* id, const StateAccess& sa)
+	{
+	num_notifications += s->size();
 
 	if ( id->IsInternalGlobal() )
 		for ( NotifierSet::iterator j = s->begin(); j != s->end(); j++ )
@@ -1015,6 +1188,57 @@ void NotifierRegistry::AccessPerformed(const StateAccess& sa)
 			(*j)->Access(id, sa);
 	}
 
+void NotifierRegistry::AccessPerformed(const StateAccess& sa)
+	{
+	ID* id = sa.Target();
+
+	NotifierMap::iterator i = ids.find(id->Name());
+	IndexNotifierMap::iterator j =
+		indices.lower_bound(IndexName(id->Name(), std::string()));
+	bool have_indices = j != indices.end() && j->first.first == id->Name();
+
+	if ( i == ids.end() && ! have_indices )
+		return;
+
+	DBG_LOG(DBG_NOTIFIERS, "modification to tracked ID %s", id->Name());
+
+	++num_modifications;
+
+	// Collected into one set so that each notifier hears of the
+	// access just once.
+	NotifierSet s;
+
+	if ( i != ids.end() )
+		s = *i->second;
+
+	if ( have_indices )
+		{
+		HashKey* k = sa.TableIndex();
+
+		if ( k )
+			{
+			IndexName name(id->Name(),
+				       std::string((const char*) k->Key(),
+						   k->Size()));
+			IndexNotifierMap::iterator m = indices.find(name);
+
+			if ( m != indices.end() )
+				s.insert(m->second->begin(), m->second->end());
+
+			delete k;
+			}
+		else
+			{
+			// Concerns the table as a whole.
+			for ( ; j != indices.end() && j->first.first == id->Name();
+			      ++j )
+				s.insert(j->second->begin(), j->second->end());
+			}
+		}
+
+	Notify(&s, id, sa);
+	}
+
 const char* NotifierRegistry::Notifier::Name() const
 	{
 	return fmt("%p", this);
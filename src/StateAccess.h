@@ -56,8 +56,23 @@ public:
 	// Returns target ID which may be an internal one for unbound vals.
 	ID* Target() const;
 
+	// If this is an access to a single index of a table, returns the
+	// index's hash key, which the caller then owns. Otherwise, returns
+	// nil.
+	HashKey* TableIndex() const;
+
 	void Describe(ODesc* d) const;
 
+	// Returns true if the access may be sent out later than it happens,
+	// along with others, i.e. if it's to a global and refers only to
+	// atomic values, which can't change in the meantime.
+	bool Deferrable() const;
+
+	// If this access and a later one to the same ID (and index) can be
+	// sent as one, changes this one to have the effect of both, and
+	// returns true. The old value, if any, remains this one's.
+	bool Absorb(const StateAccess& later);
+
 	bool Serialize(SerialInfo* info) const;
 	static StateAccess* Unserialize(UnserialInfo* info);
 
@@ -125,17 +140,34 @@ public:
 		virtual const char* Name() const;	// for debugging
 	};
 
-	NotifierRegistry()	{ }
+	NotifierRegistry()	{ num_modifications = num_notifications = 0; }
 	~NotifierRegistry()	{ }
 
 	// Inform the given notifier if ID/Val changes.
 	void Register(ID* id, Notifier* notifier);
 	void Register(Val* val, Notifier* notifier);
 
+	// Inform the given notifier only of changes to the given index of
+	// a table (or to the table as a whole, such as when it's cleared).
+	void Register(TableVal* val, const HashKey* index, Notifier* notifier);
+	void Unregister(TableVal* val, const HashKey* index,
+			Notifier* notifier);
+
 	// Cancel notification for this ID/Val.
 	void Unregister(ID* id, Notifier* notifier);
 	void Unregister(Val* val, Notifier* notifier);
 
+	struct Stats {
+		unsigned long modifications;	// of tracked IDs/Vals
+		unsigned long notifications;	// calls to notifiers
+	};
+
+	void GetStats(Stats* stats) const
+		{
+		stats->modifications = num_modifications;
+		stats->notifications = num_notifications;
+		}
+
 private:
 	friend class StateAccess;
 	void AccessPerformed(const StateAccess& sa);
@@ -143,6 +175,20 @@ private:
 	typedef std::set<Notifier*> NotifierSet;
 	typedef std::map<std::string, NotifierSet*> NotifierMap;
 	NotifierMap ids;
+
+	// Notifiers of a single index, by the table's ID name and the bytes
+	// of the index's hash key.
+	typedef std::pair<std::string, std::string> IndexName;
+	typedef std::map<IndexName, NotifierSet*> IndexNotifierMap;
+	IndexNotifierMap indices;
+
+	// Makes sure that accesses to the ID get logged.
+	void Track(ID* id);
+
+	void Notify(NotifierSet* s, ID* id, const StateAccess& sa);
+
+	unsigned long num_modifications;
+	unsigned long num_notifications;
 };
 
 extern NotifierRegistry notifiers;
@@ -8,7 +8,12 @@
 #include "cq.h"
 #include "DNS_Mgr.h"
 #include "Trigger.h"
+#include "ObjPool.h"
+#include "Metrics.h"
+#include "LoadShedder.h"
 #include "threading/Manager.h"
+#include "iosource/Manager.h"
+#include "analyzer/protocol/pia/PIA.h"
 
 #ifdef ENABLE_BROKER
 #include "broker/Manager.h"
@@ -142,6 +147,61 @@ void ProfileLogger::Log()
 		s.num_ICMP_conns, s.max_ICMP_conns
 		));
 
+	if ( BifConst::flow_shards > 1 )
+		file->Write(fmt("%.06f Shards: shard=%d/%d other=%" PRIu64 "\n",
+			network_time,
+			int(BifConst::flow_shard), int(BifConst::flow_shards),
+			s.num_packets_other_shard
+			));
+
+	if ( BifConst::flow_sample_rate < 1 )
+		file->Write(fmt("%.06f Sampling: rate=%.4f unsampled=%" PRIu64 " est-conns: tcp=%" PRIu64 " udp=%" PRIu64 " icmp=%" PRIu64 "\n",
+			network_time, double(BifConst::flow_sample_rate),
+			s.num_packets_unsampled,
+			sessions->ScaleBySampling(s.cumulative_TCP_conns),
+			sessions->ScaleBySampling(s.cumulative_UDP_conns),
+			sessions->ScaleBySampling(s.cumulative_ICMP_conns)
+			));
+
+	file->Write(fmt("%.06f Fragments: current=%d/%d mem=%" PRIu64 "K expired=%" PRIu64 " dropped-source=%" PRIu64 " dropped-total=%" PRIu64 "\n",
+		network_time,
+		s.num_fragments, s.max_fragments,
+		s.fragment_memory / 1024,
+		s.num_fragments_expired,
+		s.num_fragments_dropped_source,
+		s.num_fragments_dropped_total
+		));
+
+	if ( pkt_merger )
+		{
+		iosource::PktMerger::Stats ms;
+		pkt_merger->Statistics(&ms);
+		file->Write(fmt("%.06f Merge: packets=%" PRIu64 " reordered=%" PRIu64 " late=%" PRIu64 " max-buffered=%" PRIu64 "\n",
+			network_time, ms.merged, ms.reordered, ms.late,
+			ms.max_buffered));
+		}
+
+	if ( BifConst::conn_compressor )
+		file->Write(fmt("%.06f Attempts: pending=%d promoted=%" PRIu64 " summarized=%" PRIu64 "\n",
+			network_time, s.num_pending_attempts,
+			s.num_promoted_attempts, s.num_summarized_attempts));
+
+	if ( s.num_packets_bypassed )
+		file->Write(fmt("%.06f Bypassed: packets=%" PRIu64 "\n",
+			network_time, s.num_packets_bypassed));
+
+	if ( load_shedder )
+		file->Write(fmt("%.06f Shedding: active=%d activations=%" PRIu64 " packets=%" PRIu64 "\n",
+			network_time, load_shedder->Active(),
+			load_shedder->NumActivations(), s.num_packets_shed));
+
+	file->Write(fmt("%.06f Dictionaries: resizing=%u moved=%" PRIu64 " conns_pending=%d\n",
+		network_time,
+		Dictionary::NumResizing(),
+		Dictionary::NumResizeMoves(),
+		s.pending_resize_moves
+		));
+
 	sessions->tcp_stats.PrintStats(file,
 			fmt("%.06f TCP-States:", network_time));
 
@@ -167,6 +227,28 @@ void ProfileLogger::Log()
 	file->Write(fmt("%.06f Total reassembler data: %" PRIu64 "K\n", network_time,
 		Reassembler::TotalMemoryAllocation() / 1024));
 
+	if ( BifConst::reassembly_memory_limit )
+		file->Write(fmt("%.06f Reassembler releases: num=%" PRIu64 " data=%" PRIu64 "K\n",
+			network_time, Reassembler::NumReleases(),
+			Reassembler::BytesReleased() / 1024));
+
+	std::vector<ObjPool::Stats> pstats;
+	ObjPool::GetAllStats(&pstats);
+
+	for ( size_t i = 0; i < pstats.size(); ++i )
+		file->Write(fmt("%.06f Pool %s: in_use=%" PRIu64 " total=%" PRIu64 " mem=%" PRIu64 "K\n",
+			network_time, pstats[i].name, pstats[i].in_use,
+			pstats[i].total,
+			pstats[i].total * pstats[i].obj_size / 1024));
+
+	file->Write(fmt("%.06f Event arguments:", network_time));
+
+	for ( int i = 0; i <= val_list::INLINE_ENTRIES; ++i )
+		file->Write(fmt(" %d=%" PRIu64, i, num_events_by_args[i]));
+
+	file->Write(fmt(" more=%" PRIu64 "\n",
+		num_events_by_args[val_list::INLINE_ENTRIES + 1]));
+
 	// Signature engine.
 	if ( expensive && rule_matcher )
 		{
@@ -178,6 +260,12 @@ void ProfileLogger::Log()
 			stats.nfa_states, stats.dfa_states, stats.computed, stats.mem / 1024));
 		}
 
+	const analyzer::pia::PIA::Stats& pia_stats = analyzer::pia::PIA::GetStats();
+
+	file->Write(fmt("%.06f DPD: pias=%" PRIu64 " activated=%" PRIu64 " exhausted=%" PRIu64 " overflowed=%" PRIu64 "\n",
+		network_time, pia_stats.pias, pia_stats.activated,
+		pia_stats.exhausted, pia_stats.overflowed));
+
 	file->Write(fmt("%.06f Timers: current=%d max=%d mem=%dK lag=%.2fs\n",
 		network_time,
 		timer_mgr->Size(), timer_mgr->PeakSize(),
@@ -188,15 +276,18 @@ void ProfileLogger::Log()
 	DNS_Mgr::Stats dstats;
 	dns_mgr->GetStats(&dstats);
 
-	file->Write(fmt("%.06f DNS_Mgr: requests=%lu succesful=%lu failed=%lu pending=%lu cached_hosts=%lu cached_addrs=%lu\n",
+	file->Write(fmt("%.06f DNS_Mgr: requests=%lu succesful=%lu failed=%lu pending=%lu cached_hosts=%lu cached_addrs=%lu negative_hits=%lu evicted=%lu\n",
 					network_time,
 					dstats.requests, dstats.successful, dstats.failed, dstats.pending,
-					dstats.cached_hosts, dstats.cached_addresses));
+					dstats.cached_hosts, dstats.cached_addresses,
+					dstats.negative_hits, dstats.evicted));
 
 	Trigger::Stats tstats;
 	Trigger::GetStats(&tstats);
 
-	file->Write(fmt("%.06f Triggers: total=%lu pending=%lu\n", network_time, tstats.total, tstats.pending));
+	file->Write(fmt("%.06f Triggers: total=%lu pending=%lu evaluations=%lu modifications=%lu\n",
+			network_time, tstats.total, tstats.pending,
+			tstats.evaluations, tstats.modifications));
 
 	unsigned int* current_timers = TimerMgr::CurrentTimers();
 	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
@@ -207,6 +298,18 @@ void ProfileLogger::Log()
 					current_timers[i]));
 		}
 
+	file->Write(fmt("%0.6f IOSources: current=%d backend=%s\n", network_time,
+			iosource_mgr->Size(), iosource_mgr->PollBackend()));
+
+	iosource::Manager::source_stats_list source_stats;
+	iosource_mgr->GetSourceStats(&source_stats);
+
+	for ( iosource::Manager::source_stats_list::const_iterator i = source_stats.begin();
+	      i != source_stats.end(); ++i )
+		file->Write(fmt("%0.6f   %-25s polled=%" PRIu64 " ready=%" PRIu64 "\n",
+				network_time, i->first.c_str(),
+				i->second.polled, i->second.ready));
+
 	file->Write(fmt("%0.6f Threads: current=%d\n", network_time, thread_mgr->NumThreads()));
 
 	const threading::Manager::msg_stats_list& thread_stats = thread_mgr->GetMsgThreadStats();
@@ -216,16 +319,30 @@ void ProfileLogger::Log()
 		threading::MsgThread::Stats s = i->second;
 		file->Write(fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
 				" (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+				" (#queue peak/stalls: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
 			        "\n",
 			    network_time,
 			    i->first.c_str(),
 			    s.sent_in, s.sent_out,
 			    s.pending_in, s.pending_out,
 			    s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes
+			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes,
+			    s.queue_in_stats.max_size, s.queue_in_stats.num_stalls,
+			    s.queue_out_stats.max_size, s.queue_out_stats.num_stalls
 			    ));
 		}
 
+	const std::map<std::string, metrics::Metric*>& all_metrics =
+		metrics::registry()->Metrics();
+
+	file->Write(fmt("%0.6f Metrics: current=%d\n", network_time,
+			int(all_metrics.size())));
+
+	for ( std::map<std::string, metrics::Metric*>::const_iterator i = all_metrics.begin();
+	      i != all_metrics.end(); ++i )
+		file->Write(fmt("%0.6f   %-25s %.0f\n", network_time,
+				i->first.c_str(), i->second->Value()));
+
 #ifdef ENABLE_BROKER
 	auto cs = broker_mgr->ConsumeStatistics();
 
@@ -238,12 +355,28 @@ void ProfileLogger::Log()
 	                cs.outgoing_conn_status_count, cs.incoming_conn_status_count,
 	                cs.report_count));
 
+	file->Write(fmt("%0.6f Comm: store_answered=%zu store_latency_avg=%.6f "
+	                "store_latency_max=%.6f store_cache_hits=%zu\n",
+	                network_time, cs.answered_query_count,
+	                cs.answered_query_count ?
+	                        cs.query_latency_total / cs.answered_query_count : 0.0,
+	                cs.query_latency_max, cs.cache_hit_count));
+
 	for ( const auto& s : cs.print_count )
 		file->Write(fmt("    %-25s prints dequeued=%zu\n", s.first.data(), s.second));
 	for ( const auto& s : cs.event_count )
 		file->Write(fmt("    %-25s events dequeued=%zu\n", s.first.data(), s.second));
 	for ( const auto& s : cs.log_count )
 		file->Write(fmt("    %-25s logs dequeued=%zu\n", s.first.data(), s.second));
+	for ( const auto& s : cs.sent_count )
+		file->Write(fmt("    %-25s messages sent=%zu\n", s.first.data(), s.second));
+	for ( const auto& s : cs.event_batch_count )
+		file->Write(fmt("    %-25s event batches=%zu events=%zu max=%zu "
+		                "delay_avg=%.6f delay_max=%.6f\n", s.first.data(),
+		                s.second.batches, s.second.events, s.second.max_events,
+		                s.second.events ?
+		                        s.second.delay_total / s.second.events : 0.0,
+		                s.second.delay_max));
 #endif
 
 	// Script-level state.
@@ -268,7 +401,7 @@ void ProfileLogger::Log()
 				{
 				Val* v = id->ID_Val();
 
-				size = id->ID_Val()->MemoryAllocation();
+				size = id->ID_Val()->ApproxMemory();
 				mem += size;
 
 				bool print = false;
@@ -322,7 +455,7 @@ void ProfileLogger::Log()
 		val_list* vl = new val_list;
 		Ref(file);
 		vl->append(new Val(file));
-		vl->append(new Val(expensive, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(expensive));
 		mgr.Dispatch(new Event(profiling_update, vl));
 		}
 	}
@@ -381,7 +514,7 @@ void SampleLogger::SegmentProfile(const char* /* name */,
 	val_list* vl = new val_list(2);
 	vl->append(load_samples->Ref());
 	vl->append(new IntervalVal(dtime, Seconds));
-	vl->append(new Val(dmem, TYPE_INT));
+	vl->append(val_mgr->GetInt(dmem));
 
 	mgr.QueueEvent(load_sample, vl);
 	}
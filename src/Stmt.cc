@@ -84,6 +84,11 @@ int Stmt::IsPure() const
 	return 0;
 	}
 
+Stmt* Stmt::Simplify()
+	{
+	return this;
+	}
+
 void Stmt::Describe(ODesc* d) const
 	{
 	if ( ! d->IsReadable() || Tag() != STMT_EXPR )
@@ -180,6 +185,12 @@ ExprListStmt::~ExprListStmt()
 	Unref(l);
 	}
 
+Stmt* ExprListStmt::Simplify()
+	{
+	l->Simplify();
+	return this;
+	}
+
 Val* ExprListStmt::Exec(Frame* f, stmt_flow_type& flow) const
 	{
 	last_access = network_time;
@@ -371,6 +382,14 @@ int ExprStmt::IsPure() const
 	return ! e || e->IsPure();
 	}
 
+Stmt* ExprStmt::Simplify()
+	{
+	if ( e )
+		simplify_expr(e);
+
+	return this;
+	}
+
 void ExprStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -467,6 +486,18 @@ int IfStmt::IsPure() const
 	return e->IsPure() && s1->IsPure() && s2->IsPure();
 	}
 
+Stmt* IfStmt::Simplify()
+	{
+	simplify_expr(e);
+	simplify_stmt(s1);
+	simplify_stmt(s2);
+
+	if ( e->IsError() || ! e->IsConst() )
+		return this;
+
+	return e->IsZero() ? s2->Ref() : s1->Ref();
+	}
+
 void IfStmt::Describe(ODesc* d) const
 	{
 	ExprStmt::Describe(d);
@@ -561,6 +592,11 @@ Case::~Case()
 	Unref(s);
 	}
 
+void Case::Simplify()
+	{
+	simplify_stmt(s);
+	}
+
 void Case::Describe(ODesc* d) const
 	{
 	if ( ! Cases() )
@@ -848,6 +884,16 @@ int SwitchStmt::IsPure() const
 	return 1;
 	}
 
+Stmt* SwitchStmt::Simplify()
+	{
+	simplify_expr(e);
+
+	loop_over_list(*cases, i)
+		(*cases)[i]->Simplify();
+
+	return this;
+	}
+
 void SwitchStmt::Describe(ODesc* d) const
 	{
 	ExprStmt::Describe(d);
@@ -1107,6 +1153,13 @@ int WhileStmt::IsPure() const
 	return loop_condition->IsPure() && body->IsPure();
 	}
 
+Stmt* WhileStmt::Simplify()
+	{
+	simplify_expr(loop_condition);
+	simplify_stmt(body);
+	return this;
+	}
+
 void WhileStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -1202,6 +1255,7 @@ ForStmt::ForStmt(id_list* arg_loop_vars, Expr* loop_expr)
 	{
 	loop_vars = arg_loop_vars;
 	body = 0;
+	may_modify_tables = true;
 
 	if ( e->Type()->Tag() == TYPE_TABLE )
 		{
@@ -1284,6 +1338,103 @@ ForStmt::~ForStmt()
 	Unref(body);
 	}
 
+// Looks for anything in a loop body that may add or remove the entries of
+// a table while the loop iterates. Anything calling a function could.
+class TableModificationFinder : public TraversalCallback {
+public:
+	TableModificationFinder()	{ found = false; }
+
+	virtual TraversalCode PreStmt(const Stmt* stmt);
+	virtual TraversalCode PreExpr(const Expr* expr);
+
+	bool found;
+};
+
+TraversalCode TableModificationFinder::PreStmt(const Stmt* stmt)
+	{
+	if ( stmt->Tag() == STMT_ADD || stmt->Tag() == STMT_DELETE )
+		{
+		found = true;
+		return TC_ABORTALL;
+		}
+
+	return TC_CONTINUE;
+	}
+
+TraversalCode TableModificationFinder::PreExpr(const Expr* expr)
+	{
+	switch ( expr->Tag() ) {
+	case EXPR_ASSIGN:
+		// Assigning to a variable leaves the table it held alone.
+		if ( static_cast<const BinaryExpr*>(expr)->Op1()->Tag() == EXPR_NAME )
+			return TC_CONTINUE;
+
+		found = true;
+		return TC_ABORTALL;
+
+	case EXPR_ADD_TO:
+	case EXPR_REMOVE_FROM:
+	case EXPR_CALL:
+		found = true;
+		return TC_ABORTALL;
+
+	case EXPR_INDEX:
+		{
+		// Reading a missing entry runs a &default function. For
+		// tables whose attributes we don't know here,
+		// MakeIterationsRobust() takes care of that.
+		const Expr* op1 = static_cast<const BinaryExpr*>(expr)->Op1();
+
+		if ( op1->Tag() != EXPR_NAME || op1->Type()->Tag() != TYPE_TABLE )
+			return TC_CONTINUE;
+
+		const Attributes* attrs = static_cast<const NameExpr*>(op1)->Id()->Attrs();
+		const Attr* def = attrs ? attrs->FindAttr(ATTR_DEFAULT) : 0;
+
+		if ( def && def->AttrExpr()->Type()->Tag() == TYPE_FUNC )
+			{
+			found = true;
+			return TC_ABORTALL;
+			}
+
+		return TC_CONTINUE;
+		}
+
+	default:
+		return TC_CONTINUE;
+	}
+	}
+
+std::vector<ForStmt::Iteration> ForStmt::fragile_iterations;
+
+void ForStmt::DoMakeIterationsRobust()
+	{
+	// Nothing has changed the tables yet, or we'd have come here
+	// before, so it's not too late.
+	for ( size_t i = 0; i < fragile_iterations.size(); ++i )
+		{
+		const Iteration& it = fragile_iterations[i];
+		const_cast<PDict(TableEntryVal)*>(it.first)->MakeRobustCookie(it.second);
+		}
+
+	fragile_iterations.clear();
+	}
+
+void ForStmt::EndFragileIteration(const IterCookie* c)
+	{
+	if ( ! fragile_iterations.empty() && fragile_iterations.back().second == c )
+		fragile_iterations.pop_back();
+	}
+
+void ForStmt::AddBody(Stmt* arg_body)
+	{
+	body = arg_body;
+
+	TableModificationFinder cb;
+	body->Traverse(&cb);
+	may_modify_tables = cb.found;
+	}
+
 Val* ForStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 	{
 	Val* ret = 0;
@@ -1293,28 +1444,55 @@ Val* ForStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 		TableVal* tv = v->AsTableVal();
 		const PDict(TableEntryVal)* loop_vals = tv->AsTable();
 
-		HashKey* k;
 		IterCookie* c = loop_vals->InitForIteration();
-		while ( loop_vals->NextEntry(k, c) )
+
+		// NextEntry() resets c once done.
+		const IterCookie* cookie = c;
+
+		if ( may_modify_tables )
+			const_cast<PDict(TableEntryVal)*>(loop_vals)->MakeRobustCookie(c);
+		else
+			fragile_iterations.push_back(Iteration(loop_vals, c));
+
+		// The index gets decoded right into the loop variables,
+		// from the entry's key bytes.
+		std::vector<Val*> ind(loop_vars->length());
+		const void* key;
+		int key_len;
+
+		while ( loop_vals->NextEntry(key, key_len, c) )
 			{
-			ListVal* ind_lv = tv->RecoverIndex(k);
-			delete k;
+			tv->RecoverIndex(key, key_len, &ind[0]);
 
-			for ( int i = 0; i < ind_lv->Length(); i++ )
-				f->SetElement((*loop_vars)[i]->Offset(), ind_lv->Index(i)->Ref());
-			Unref(ind_lv);
+			for ( size_t i = 0; i < ind.size(); i++ )
+				f->SetElement((*loop_vars)[i]->Offset(), ind[i]);
 
 			flow = FLOW_NEXT;
-			ret = body->Exec(f, flow);
+
+			try
+				{
+				ret = body->Exec(f, flow);
+				}
+
+			catch ( InterpreterException& )
+				{
+				// A robust cookie mustn't stay registered.
+				EndFragileIteration(cookie);
+				loop_vals->StopIteration(c);
+				throw;
+				}
 
 			if ( flow == FLOW_BREAK || flow == FLOW_RETURN )
 				{
 				// If we broke or returned from inside a for loop,
 				// the cookie may still exist.
+				EndFragileIteration(cookie);
 				loop_vals->StopIteration(c);
 				break;
 				}
 			}
+
+		EndFragileIteration(cookie);
 		}
 
 	else if ( v->Type()->Tag() == TYPE_VECTOR )
@@ -1330,7 +1508,7 @@ Val* ForStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 			// Set the loop variable to the current index, and make
 			// another pass over the loop body.
 			f->SetElement((*loop_vars)[0]->Offset(),
-					new Val(i, TYPE_INT));
+					val_mgr->GetInt(i));
 			flow = FLOW_NEXT;
 			ret = body->Exec(f, flow);
 
@@ -1371,6 +1549,13 @@ int ForStmt::IsPure() const
 	return e->IsPure() && body->IsPure();
 	}
 
+Stmt* ForStmt::Simplify()
+	{
+	simplify_expr(e);
+	simplify_stmt(body);
+	return this;
+	}
+
 void ForStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -1466,7 +1651,15 @@ bool ForStmt::DoUnserialize(UnserialInfo* info)
 		}
 
 	body = Stmt::Unserialize(info);
-	return body != 0;
+
+	if ( ! body )
+		return false;
+
+	TableModificationFinder cb;
+	body->Traverse(&cb);
+	may_modify_tables = cb.found;
+
+	return true;
 	}
 
 Val* NextStmt::Exec(Frame* /* f */, stmt_flow_type& flow) const
@@ -1717,6 +1910,20 @@ int StmtList::IsPure() const
 	return 1;
 	}
 
+Stmt* StmtList::Simplify()
+	{
+	loop_over_list(stmts, i)
+		{
+		Stmt* s = stmts[i];
+		Stmt* n = s->Simplify();
+
+		if ( n != s )
+			Unref(stmts.replace(i, n));
+		}
+
+	return this;
+	}
+
 void StmtList::Describe(ODesc* d) const
 	{
 	if ( ! d->IsReadable() )
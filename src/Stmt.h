@@ -5,6 +5,8 @@
 
 // BRO statements.
 
+#include <vector>
+
 #include "BroList.h"
 #include "Obj.h"
 #include "Expr.h"
@@ -36,6 +38,12 @@ public:
 	// True if the statement has no side effects, false otherwise.
 	virtual int IsPure() const;
 
+	// Folds constants and prunes branches that can't be taken, once
+	// all scripts have been parsed. Returns the statement to use
+	// instead of this one: either this one, or another one whose
+	// reference passes to the caller. See also Expr::Simplify().
+	virtual Stmt* Simplify();
+
 	StmtList* AsStmtList()
 		{
 		CHECK_TAG(tag, STMT_LIST, "Stmt::AsStmtList", stmt_name)
@@ -97,6 +105,8 @@ class ExprListStmt : public Stmt {
 public:
 	const ListExpr* ExprList() const	{ return l; }
 
+	Stmt* Simplify() override;
+
 	TraversalCode Traverse(TraversalCallback* cb) const;
 
 protected:
@@ -138,6 +148,8 @@ public:
 
 	const Expr* StmtExpr() const	{ return e; }
 
+	Stmt* Simplify() override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -164,6 +176,8 @@ public:
 	const Stmt* TrueBranch() const	{ return s1; }
 	const Stmt* FalseBranch() const	{ return s2; }
 
+	Stmt* Simplify() override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -192,6 +206,9 @@ public:
 	const Stmt* Body() const	{ return s; }
 	Stmt* Body()			{ return s; }
 
+	// Simplifies the body; see Stmt::Simplify().
+	void Simplify();
+
 	void Describe(ODesc* d) const override;
 
 	bool Serialize(SerialInfo* info) const;
@@ -216,6 +233,8 @@ public:
 
 	const case_list* Cases() const	{ return cases; }
 
+	Stmt* Simplify() override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -304,6 +323,7 @@ public:
 	~WhileStmt();
 
 	int IsPure() const override;
+	Stmt* Simplify() override;
 
 	void Describe(ODesc* d) const override;
 
@@ -328,21 +348,36 @@ public:
 	ForStmt(id_list* loop_vars, Expr* loop_expr);
 	~ForStmt();
 
-	void AddBody(Stmt* arg_body)	{ body = arg_body; }
+	void AddBody(Stmt* arg_body);
 
 	const id_list* LoopVar() const	{ return loop_vars; }
 	const Expr* LoopExpr() const	{ return e; }
 	const Stmt* LoopBody() const	{ return body; }
 
 	int IsPure() const override;
+	Stmt* Simplify() override;
 
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
+	// Makes the cookies of the table iterations in progress robust
+	// that didn't expect their table to change.  BroFunc::Call() does
+	// this before running any script code, which a loop body can get
+	// to in ways that AddBody() can't see, e.g. through the &default
+	// function of a table that came in as a parameter.
+	static void MakeIterationsRobust()
+		{
+		if ( ! fragile_iterations.empty() )
+			DoMakeIterationsRobust();
+		}
+
 protected:
 	friend class Stmt;
-	ForStmt()	{ loop_vars = 0; body = 0; }
+	ForStmt()	{ loop_vars = 0; body = 0; may_modify_tables = true; }
+
+	static void DoMakeIterationsRobust();
+	static void EndFragileIteration(const IterCookie* c);
 
 	Val* DoExec(Frame* f, Val* v, stmt_flow_type& flow) const override;
 
@@ -350,6 +385,15 @@ protected:
 
 	id_list* loop_vars;
 	Stmt* body;
+
+	// False if the body can't add or remove table entries, so that
+	// iterating over a table doesn't need a robust cookie.
+	bool may_modify_tables;
+
+	// The tables and cookies of the iterations in progress without a
+	// robust cookie, innermost last.
+	typedef std::pair<const PDict(TableEntryVal)*, IterCookie*> Iteration;
+	static std::vector<Iteration> fragile_iterations;
 };
 
 class NextStmt : public Stmt {
@@ -422,6 +466,8 @@ public:
 	const stmt_list& Stmts() const	{ return stmts; }
 	stmt_list& Stmts()		{ return stmts; }
 
+	Stmt* Simplify() override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -527,4 +573,16 @@ protected:
 	bool is_return;
 };
 
+// Replaces s with its simplified version; see Stmt::Simplify().
+inline void simplify_stmt(Stmt*& s)
+	{
+	Stmt* n = s->Simplify();
+
+	if ( n != s )
+		{
+		Unref(s);
+		s = n;
+		}
+	}
+
 #endif
@@ -2,30 +2,37 @@
 
 #include "bro-config.h"
 
+#include <algorithm>
+
 #include "util.h"
 #include "Timer.h"
 #include "Desc.h"
 #include "Serializer.h"
+#include "Metrics.h"
 
 // Names of timers in same order than in TimerType.
 const char* TimerNames[] = {
 	"BackdoorTimer",
 	"BreakpointTimer",
+	"BrokerEventBatchTimer",
 	"ConnectionDeleteTimer",
 	"ConnectionExpireTimer",
 	"ConnectionInactivityTimer",
 	"ConnectionStatusUpdateTimer",
 	"DNSExpireTimer",
 	"FileAnalysisInactivityTimer",
+	"FlowWeirdTimer",
 	"FragTimer",
 	"IncrementalSendTimer",
 	"IncrementalWriteTimer",
 	"InterconnTimer",
 	"IPTunnelInactivityTimer",
 	"NetbiosExpireTimer",
+	"NetWeirdTimer",
 	"NetworkTimer",
 	"NTPExpireTimer",
 	"ProfileTimer",
+	"RemoteAccessBatchTimer",
 	"RotateTimer",
 	"RemoveConnection",
 	"RPCExpireTimer",
@@ -89,6 +96,19 @@ bool Timer::DoUnserialize(UnserialInfo* info)
 
 unsigned int TimerMgr::current_timers[NUM_TIMER_TYPES];
 
+static double pending_timers()
+	{
+	return timer_mgr ? timer_mgr->Size() : 0;
+	}
+
+static metrics::Counter* timers_expired_metric =
+	metrics::registry()->NewCounter("timers.expired",
+					"Timers expired by advancing the clock.");
+static metrics::CallbackMetric* timers_pending_metric __attribute__((unused)) =
+	metrics::registry()->NewCallbackGauge("timers.pending",
+					      "Timers pending in the global timer manager.",
+					      pending_timers);
+
 TimerMgr::~TimerMgr()
 	{
 	DBG_LOG(DBG_TM, "deleting timer mgr %p", this);
@@ -104,7 +124,25 @@ int TimerMgr::Advance(double arg_t, int max_expire)
 	num_expired = 0;
 	last_advance = timer_mgr->Time();
 
-	return DoAdvance(t, max_expire);
+	int n = DoAdvance(t, max_expire);
+	timers_expired_metric->Inc(n);
+
+	return n;
+	}
+
+int TimerMgr::AdvanceQuantized(double arg_t, int max_expire, double quantum)
+	{
+	if ( arg_t < next_expire && ! expire_cut_short )
+		{
+		t = arg_t;
+		last_advance = timer_mgr->Time();
+		return 0;
+		}
+
+	int n = Advance(arg_t, max_expire);
+	next_expire = arg_t + quantum;
+	expire_cut_short = (max_expire > 0 && n >= max_expire);
+	return n;
 	}
 
 
@@ -162,7 +200,7 @@ int PQ_TimerMgr::DoAdvance(double new_t, int max_expire)
 		DBG_LOG(DBG_TM, "Dispatching timer %s in TimeMgr %p",
 				timer_type_to_string(timer->Type()), this);
 		timer->Dispatch(new_t, 0);
-		delete timer;
+		Dispatched(timer, new_t);
 
 		timer = Top();
 		}
@@ -238,7 +276,7 @@ int CQ_TimerMgr::DoAdvance(double new_t, int max_expire)
 				timer_type_to_string(timer->Type()), this);
 		timer->Dispatch(new_t, 0);
 		--current_timers[timer->Type()];
-		delete timer;
+		Dispatched(timer, new_t);
 		++num_expired;
 		}
 
@@ -261,3 +299,378 @@ void CQ_TimerMgr::Remove(Timer* timer)
 		delete timer;
 		}
 	}
+
+TW_TimerMgr::TW_TimerMgr(const Tag& tag, double arg_resolution) : TimerMgr(tag)
+	{
+	resolution = arg_resolution;
+	now_tick = 0;
+	next_seq = 0;
+	free_nodes = -1;
+
+	for ( int i = 0; i <= OVERFLOW_SLOT; ++i )
+		slots[i] = -1;
+
+	for ( int i = 0; i <= NUM_LEVELS; ++i )
+		level_size[i] = 0;
+
+	num_timers = peak_num_timers = 0;
+	cumulative_num = 0;
+	}
+
+TW_TimerMgr::~TW_TimerMgr()
+	{
+	// Same as the other managers, we don't delete pending timers
+	// here; their owners may still refer to them.
+	}
+
+uint64 TW_TimerMgr::TimeToTick(double t) const
+	{
+	if ( t <= 0.0 )
+		return 0;
+
+	double tick = t / resolution;
+
+	// Beyond any time we'll ever see, but keep it well-defined.
+	if ( tick >= 1.8e19 )
+		return UINT64_MAX;
+
+	return uint64(tick);
+	}
+
+int TW_TimerMgr::NewNode(Timer* timer)
+	{
+	int n = free_nodes;
+
+	if ( n >= 0 )
+		free_nodes = nodes[n].next;
+	else
+		{
+		n = nodes.size();
+		nodes.push_back(Node());
+		}
+
+	Node& node = nodes[n];
+	node.timer = timer;
+	node.time = timer->Time();
+	node.tick = TimeToTick(node.time);
+	node.seq = next_seq++;
+	node.prev = node.next = node.slot = -1;
+	node.state = NODE_FREE;
+
+	timer->SetOffset(n);
+	return n;
+	}
+
+void TW_TimerMgr::FreeNode(int n)
+	{
+	Node& node = nodes[n];
+
+	if ( node.timer && node.timer->Offset() == n )
+		node.timer->SetOffset(-1);
+
+	node.timer = 0;
+	node.state = NODE_FREE;
+	node.next = free_nodes;
+	free_nodes = n;
+	}
+
+void TW_TimerMgr::Link(int n, int slot)
+	{
+	Node& node = nodes[n];
+	node.state = NODE_WHEEL;
+	node.slot = slot;
+	node.prev = -1;
+	node.next = slots[slot];
+
+	if ( node.next >= 0 )
+		nodes[node.next].prev = n;
+
+	slots[slot] = n;
+	++level_size[slot / SLOTS_PER_LEVEL];
+	}
+
+void TW_TimerMgr::Unlink(int n)
+	{
+	Node& node = nodes[n];
+
+	if ( node.prev >= 0 )
+		nodes[node.prev].next = node.next;
+	else
+		slots[node.slot] = node.next;
+
+	if ( node.next >= 0 )
+		nodes[node.next].prev = node.prev;
+
+	--level_size[node.slot / SLOTS_PER_LEVEL];
+	node.prev = node.next = node.slot = -1;
+	}
+
+bool TW_TimerMgr::ReadyCmp::operator()(int a, int b) const
+	{
+	// std::*_heap() keep the largest element on top.
+	const Node& na = (*nodes)[a];
+	const Node& nb = (*nodes)[b];
+
+	if ( na.time != nb.time )
+		return na.time > nb.time;
+
+	return na.seq > nb.seq;
+	}
+
+void TW_TimerMgr::PushReady(int n)
+	{
+	nodes[n].state = NODE_READY;
+
+	ReadyCmp cmp;
+	cmp.nodes = &nodes;
+	ready.push_back(n);
+	std::push_heap(ready.begin(), ready.end(), cmp);
+	}
+
+int TW_TimerMgr::PopReady()
+	{
+	ReadyCmp cmp;
+	cmp.nodes = &nodes;
+	std::pop_heap(ready.begin(), ready.end(), cmp);
+
+	int n = ready.back();
+	ready.pop_back();
+	return n;
+	}
+
+void TW_TimerMgr::Schedule(int n)
+	{
+	uint64 tick = nodes[n].tick;
+
+	if ( tick <= now_tick )
+		{
+		PushReady(n);
+		return;
+		}
+
+	uint64 delta = tick - now_tick;
+
+	for ( int level = 0; level < NUM_LEVELS; ++level )
+		{
+		int shift = LEVEL_BITS * (level + 1);
+
+		if ( delta < (uint64(1) << shift) )
+			{
+			int idx = (tick >> (LEVEL_BITS * level)) & (SLOTS_PER_LEVEL - 1);
+			Link(n, level * SLOTS_PER_LEVEL + idx);
+			return;
+			}
+		}
+
+	Link(n, OVERFLOW_SLOT);
+	}
+
+void TW_TimerMgr::Cascade(int slot)
+	{
+	int n = slots[slot];
+
+	while ( n >= 0 )
+		{
+		int next = nodes[n].next;
+		Unlink(n);
+		Schedule(n);
+		n = next;
+		}
+	}
+
+void TW_TimerMgr::Forward(uint64 target)
+	{
+	while ( now_tick < target )
+		{
+		// Find the lowest level with timers, and skip ahead to where
+		// it next needs attention. Timers of a level can't come due
+		// before the next wrap of the level below it.
+		int level = 0;
+
+		while ( level <= NUM_LEVELS && ! level_size[level] )
+			++level;
+
+		if ( level > NUM_LEVELS )
+			{
+			now_tick = target;
+			break;
+			}
+
+		if ( level > 0 )
+			{
+			uint64 mask = (uint64(1) << (LEVEL_BITS * level)) - 1;
+			uint64 boundary = (now_tick | mask) + 1;
+
+			if ( boundary == 0 || boundary > target )
+				{
+				now_tick = target;
+				break;
+				}
+
+			now_tick = boundary - 1;
+			}
+
+		uint64 tick = ++now_tick;
+
+		// Going from the top, redistribute the slots which this tick
+		// starts.
+		for ( int l = NUM_LEVELS; l > 0; --l )
+			{
+			uint64 mask = (uint64(1) << (LEVEL_BITS * l)) - 1;
+
+			if ( tick & mask )
+				continue;
+
+			if ( l == NUM_LEVELS )
+				Cascade(OVERFLOW_SLOT);
+			else
+				{
+				int idx = (tick >> (LEVEL_BITS * l)) & (SLOTS_PER_LEVEL - 1);
+				Cascade(l * SLOTS_PER_LEVEL + idx);
+				}
+			}
+
+		int slot = tick & (SLOTS_PER_LEVEL - 1);
+		int n = slots[slot];
+
+		while ( n >= 0 )
+			{
+			int next = nodes[n].next;
+			Unlink(n);
+			PushReady(n);
+			n = next;
+			}
+		}
+	}
+
+void TW_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s to TimeMgr %p",
+			timer_type_to_string(timer->Type()), this);
+
+	// Same as for PQ_TimerMgr, already expired timers get added as
+	// well so that they execute in sorted order.
+	Schedule(NewNode(timer));
+
+	++current_timers[timer->Type()];
+	++cumulative_num;
+
+	if ( ++num_timers > peak_num_timers )
+		peak_num_timers = num_timers;
+	}
+
+void TW_TimerMgr::Expire()
+	{
+	while ( num_timers > 0 )
+		{
+		// Make everything due, including whatever the dispatching
+		// adds.
+		for ( int i = 0; i <= OVERFLOW_SLOT; ++i )
+			{
+			while ( slots[i] >= 0 )
+				{
+				int n = slots[i];
+				Unlink(n);
+				PushReady(n);
+				}
+			}
+
+		while ( ! ready.empty() )
+			{
+			int n = PopReady();
+			Timer* timer = nodes[n].timer;
+			bool canceled = nodes[n].state == NODE_CANCELED;
+			FreeNode(n);
+
+			if ( canceled )
+				continue;
+
+			--num_timers;
+
+			DBG_LOG(DBG_TM, "Dispatching timer %s in TimeMgr %p",
+					timer_type_to_string(timer->Type()), this);
+			timer->Dispatch(t, 1);
+			--current_timers[timer->Type()];
+			delete timer;
+			}
+		}
+	}
+
+int TW_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	uint64 target = TimeToTick(new_t);
+
+	if ( target > now_tick )
+		Forward(target);
+
+	while ( (num_expired < max_expire || max_expire == 0) && ! ready.empty() )
+		{
+		int n = ready.front();
+
+		if ( nodes[n].state == NODE_CANCELED )
+			{
+			FreeNode(PopReady());
+			continue;
+			}
+
+		if ( nodes[n].time > new_t )
+			break;
+
+		PopReady();
+		Timer* timer = nodes[n].timer;
+		FreeNode(n);
+
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+		--num_timers;
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s in TimeMgr %p",
+				timer_type_to_string(timer->Type()), this);
+		timer->Dispatch(new_t, 0);
+		Dispatched(timer, new_t);
+
+		++num_expired;
+		}
+
+	return num_expired;
+	}
+
+void TW_TimerMgr::Remove(Timer* timer)
+	{
+	int n = timer->Offset();
+
+	// Same as for CQ_TimerMgr, the timer may be gone already, in which
+	// case we mustn't delete it.
+	if ( n < 0 || n >= int(nodes.size()) || nodes[n].timer != timer )
+		return;
+
+	Node& node = nodes[n];
+
+	if ( node.state == NODE_CANCELED )
+		return;
+
+	if ( node.state == NODE_WHEEL )
+		{
+		Unlink(n);
+		FreeNode(n);
+		}
+	else
+		{
+		// Still referenced by the heap, which releases the node
+		// once it gets to the top.
+		node.state = NODE_CANCELED;
+		node.timer = 0;
+		timer->SetOffset(-1);
+		}
+
+	--num_timers;
+	--current_timers[timer->Type()];
+	delete timer;
+	}
+
+unsigned int TW_TimerMgr::MemoryUsage() const
+	{
+	return padded_sizeof(*this) +
+		nodes.capacity() * sizeof(Node) +
+		ready.capacity() * sizeof(int);
+	}
@@ -6,6 +6,7 @@
 #include <string>
 
 #include <string>
+#include <vector>
 #include "SerialObj.h"
 #include "PriorityQueue.h"
 
@@ -17,21 +18,25 @@ extern "C" {
 enum TimerType {
 	TIMER_BACKDOOR,
 	TIMER_BREAKPOINT,
+	TIMER_BROKER_EVENT_BATCH,
 	TIMER_CONN_DELETE,
 	TIMER_CONN_EXPIRE,
 	TIMER_CONN_INACTIVITY,
 	TIMER_CONN_STATUS_UPDATE,
 	TIMER_DNS_EXPIRE,
 	TIMER_FILE_ANALYSIS_INACTIVITY,
+	TIMER_FLOW_WEIRD_EXPIRE,
 	TIMER_FRAG,
 	TIMER_INCREMENTAL_SEND,
 	TIMER_INCREMENTAL_WRITE,
 	TIMER_INTERCONN,
 	TIMER_IP_TUNNEL_INACTIVITY,
 	TIMER_NB_EXPIRE,
+	TIMER_NET_WEIRD_EXPIRE,
 	TIMER_NETWORK,
 	TIMER_NTP_EXPIRE,
 	TIMER_PROFILE,
+	TIMER_REMOTE_ACCESS_BATCH,
 	TIMER_ROTATE,
 	TIMER_REMOVE_CONNECTION,
 	TIMER_RPC_EXPIRE,
@@ -65,6 +70,11 @@ public:
 	// pending timers.
 	virtual void Dispatch(double t, int is_expire) = 0;
 
+	// For a timer that recurs, returns when it's due next after having
+	// been dispatched at time t, or 0 if it's done.  The timer manager
+	// then adds the same timer again rather than deleting it.
+	virtual double NextTime(double t) const	{ return 0; }
+
 	void Describe(ODesc* d) const;
 
 	bool Serialize(SerialInfo* info) const;
@@ -88,6 +98,12 @@ public:
 	// Returns number of timers expired.
 	int Advance(double t, int max_expire);
 
+	// Like Advance(), but after expiring timers, only expires them again
+	// once t is at least quantum past that, or if the limit of
+	// max_expire cut the last time short.  In between, it just moves
+	// the clock, so timers expire at most a quantum late.
+	int AdvanceQuantized(double t, int max_expire, double quantum);
+
 	// Returns the number of timers expired (so far) during the current
 	// or most recent advance.
 	int NumExpiredDuringCurrentAdvance()	{ return num_expired; }
@@ -123,15 +139,34 @@ protected:
  		t = 0.0;
  		num_expired = 0;
  		last_advance = last_timestamp = 0;
+		next_expire = 0;
+		expire_cut_short = false;
  		tag = arg_tag;
  		}
 
 	virtual int DoAdvance(double t, int max_expire) = 0;
 	virtual void Remove(Timer* timer) = 0;
 
+	// Called by DoAdvance() once a timer has been dispatched at time t,
+	// and removed.  Adds it again if it recurs, or deletes it.
+	void Dispatched(Timer* timer, double t)
+		{
+		double next = timer->NextTime(t);
+
+		if ( next > 0 )
+			{
+			timer->SetTime(next);
+			Add(timer);
+			}
+		else
+			delete timer;
+		}
+
 	double t;
 	double last_timestamp;
 	double last_advance;
+	double next_expire;	// for AdvanceQuantized()
+	bool expire_cut_short;
 	Tag tag;
 
 	int num_expired;
@@ -182,6 +217,97 @@ protected:
 	struct cq_handle *cq;
 };
 
+// A hierarchical timing wheel: timers are hashed into slots by their
+// expiration time, with each level covering a coarser range of times
+// than the one below it. Adding and canceling are O(1); as time advances,
+// slots of the higher levels get redistributed into the lower ones.
+//
+// Timers that come due are moved into a small heap so that they still
+// get dispatched in order of their times (and, for the same time, in
+// order of their addition).
+class TW_TimerMgr : public TimerMgr {
+public:
+	// resolution is the time covered by a slot of the lowest level.
+	TW_TimerMgr(const Tag& arg_tag, double resolution = 0.01);
+	~TW_TimerMgr();
+
+	void Add(Timer* timer);
+	void Expire();
+
+	int Size() const	{ return num_timers; }
+	int PeakSize() const	{ return peak_num_timers; }
+	uint64 CumulativeNum() const	{ return cumulative_num; }
+	unsigned int MemoryUsage() const;
+
+protected:
+	int DoAdvance(double t, int max_expire);
+	void Remove(Timer* timer);
+
+	static const int LEVEL_BITS = 8;
+	static const int SLOTS_PER_LEVEL = 1 << LEVEL_BITS;
+	static const int NUM_LEVELS = 4;
+
+	// Slot holding timers beyond the range of the highest level.
+	static const int OVERFLOW_SLOT = NUM_LEVELS * SLOTS_PER_LEVEL;
+
+	enum NodeState { NODE_FREE, NODE_WHEEL, NODE_READY, NODE_CANCELED };
+
+	// We keep the bookkeeping outside of the Timer so that we don't
+	// grow all timers; a Timer's PQ_Element offset indexes its node.
+	struct Node {
+		Timer* timer;
+		double time;
+		uint64 tick;
+		uint64 seq;	// for ordering timers with the same time
+		int prev;
+		int next;	// also links free nodes
+		int slot;
+		NodeState state;
+	};
+
+	uint64 TimeToTick(double t) const;
+
+	int NewNode(Timer* timer);
+	void FreeNode(int n);
+
+	// Hooks the node into the slot for its tick, or into the ready
+	// heap if it's already due.
+	void Schedule(int n);
+	void Link(int n, int slot);
+	void Unlink(int n);
+
+	void PushReady(int n);
+	int PopReady();
+
+	// Moves the wheel forward to the given tick, moving all timers
+	// that come due into the ready heap.
+	void Forward(uint64 target);
+
+	// Redistributes the timers of the slot into the lower levels.
+	void Cascade(int slot);
+
+	struct ReadyCmp {
+		const std::vector<Node>* nodes;
+		bool operator()(int a, int b) const;
+	};
+
+	double resolution;
+	uint64 now_tick;	// Last tick whose slot we've processed.
+	uint64 next_seq;
+
+	std::vector<Node> nodes;
+	int free_nodes;
+
+	int slots[OVERFLOW_SLOT + 1];	// Heads of node lists.
+	int level_size[NUM_LEVELS + 1];	// Timers per level (plus overflow).
+
+	std::vector<int> ready;	// Heap of due nodes.
+
+	int num_timers;
+	int peak_num_timers;
+	uint64 cumulative_num;
+};
+
 extern TimerMgr* timer_mgr;
 
 #endif
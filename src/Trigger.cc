@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <set>
 
 #include "Trigger.h"
 #include "Traverse.h"
@@ -17,7 +18,15 @@ public:
 	virtual TraversalCode PreExpr(const Expr*);
 
 private:
+	// Registers a lookup of a single index in a global table, which
+	// needs to be reevaluated only if that index changes rather than
+	// with every modification of the table.
+	void RegisterIndex(const Expr* table, const Expr* index);
+
 	Trigger* trigger;
+
+	// Names of the tables registered that way.
+	std::set<const Expr*> indexed;
 };
 
 TraversalCode TriggerTraversalCallback::PreExpr(const Expr* expr)
@@ -33,7 +42,7 @@ TraversalCode TriggerTraversalCallback::PreExpr(const Expr* expr)
 			trigger->Register(e->Id());
 
 		Val* v = e->Id()->ID_Val();
-		if ( v && v->IsMutableVal() )
+		if ( v && v->IsMutableVal() && indexed.find(e) == indexed.end() )
 			trigger->Register(v);
 		break;
 		};
@@ -48,6 +57,15 @@ TraversalCode TriggerTraversalCallback::PreExpr(const Expr* expr)
 			trigger->Register(v);
 			Unref(v);
 			}
+
+		RegisterIndex(e->Op1(), e->Op2());
+		break;
+		}
+
+	case EXPR_IN:
+		{
+		const InExpr* e = static_cast<const InExpr*>(expr);
+		RegisterIndex(e->Op2(), e->Op1());
 		break;
 		}
 
@@ -59,6 +77,42 @@ TraversalCode TriggerTraversalCallback::PreExpr(const Expr* expr)
 	return TC_CONTINUE;
 	}
 
+void TriggerTraversalCallback::RegisterIndex(const Expr* table,
+						const Expr* index)
+	{
+	if ( table->Tag() != EXPR_NAME || index->Tag() != EXPR_LIST )
+		return;
+
+	const NameExpr* e = static_cast<const NameExpr*>(table);
+	Val* v = e->Id()->ID_Val();
+
+	if ( ! v || v->Type()->Tag() != TYPE_TABLE )
+		return;
+
+	TableVal* tv = v->AsTableVal();
+
+	// Lookups in subnet tables match any prefix containing the index.
+	if ( tv->Type()->AsTableType()->IsSubNetIndex() )
+		return;
+
+	BroObj::SuppressErrors no_errors;
+	Val* idx = index->Eval(trigger->frame);
+
+	if ( ! idx )
+		return;
+
+	HashKey* k = tv->ComputeHash(idx);
+	Unref(idx);
+
+	if ( ! k )
+		return;
+
+	trigger->Register(tv, k);
+	delete k;
+
+	indexed.insert(e);
+	}
+
 class TriggerTimer : public Timer {
 public:
 	TriggerTimer(double arg_timeout, Trigger* arg_trigger)
@@ -178,6 +232,7 @@ void Trigger::Init()
 
 Trigger::TriggerList* Trigger::pending = 0;
 unsigned long Trigger::total_triggers = 0;
+unsigned long Trigger::total_evaluations = 0;
 
 bool Trigger::Eval()
 	{
@@ -296,6 +351,7 @@ void Trigger::EvaluatePending()
 	for ( TriggerList::iterator i = orig->begin(); i != orig->end(); ++i )
 		{
 		Trigger* t = *i;
+		++total_evaluations;
 		(*i)->Eval();
 		Unref(t);
 		}
@@ -370,6 +426,17 @@ void Trigger::Register(Val* val)
 	vals.insert(val);
 	}
 
+void Trigger::Register(TableVal* table, const HashKey* index)
+	{
+	assert(! disabled);
+	notifiers.Register(table, index, this);
+
+	Ref(table);
+	indices.push_back(IndexList::value_type(table,
+				new HashKey(index->Key(), index->Size(),
+					    index->Hash())));
+	}
+
 void Trigger::UnregisterAll()
 	{
 	loop_over_list(ids, i)
@@ -387,6 +454,15 @@ void Trigger::UnregisterAll()
 		}
 
 	vals.clear();
+
+	for ( IndexList::iterator i = indices.begin(); i != indices.end(); ++i )
+		{
+		notifiers.Unregister(i->first, i->second, this);
+		Unref(i->first);
+		delete i->second;
+		}
+
+	indices.clear();
 	}
 
 void Trigger::Attach(Trigger *trigger)
@@ -453,4 +529,9 @@ void Trigger::GetStats(Stats* stats)
 	{
 	stats->total = total_triggers;
 	stats->pending = pending ? pending->size() : 0;
+	stats->evaluations = total_evaluations;
+
+	NotifierRegistry::Stats nstats;
+	notifiers.GetStats(&nstats);
+	stats->modifications = nstats.modifications;
 	}
@@ -76,6 +76,8 @@ public:
 	struct Stats {
 		unsigned long total;
 		unsigned long pending;
+		unsigned long evaluations;	// of queued triggers
+		unsigned long modifications;	// of what triggers watch
 	};
 
 	static void GetStats(Stats* stats);
@@ -87,6 +89,7 @@ private:
 	void Init();
 	void Register(ID* id);
 	void Register(Val* val);
+	void Register(TableVal* table, const HashKey* index);
 	void UnregisterAll();
 
 	Expr* cond;
@@ -107,6 +110,10 @@ private:
 	val_list vals;
 	id_list ids;
 
+	// Single indices of tables that the condition looks up.
+	typedef list<pair<TableVal*, HashKey*> > IndexList;
+	IndexList indices;
+
 	typedef map<const CallExpr*, Val*> ValCache;
 	ValCache cache;
 
@@ -114,6 +121,7 @@ private:
 	static TriggerList* pending;
 
 	static unsigned long total_triggers;
+	static unsigned long total_evaluations;
 };
 
 #endif
@@ -4,6 +4,8 @@
 #include "util.h"
 #include "Conn.h"
 
+#include <unordered_map>
+
 EncapsulatingConn::EncapsulatingConn(Connection* c, BifEnum::Tunnel::Type t)
 		: src_addr(c->OrigAddr()), dst_addr(c->RespAddr()),
 		  src_port(c->OrigPort()), dst_port(c->RespPort()),
@@ -22,33 +24,98 @@ RecordVal* EncapsulatingConn::GetRecordVal() const
 
 	RecordVal* id_val = new RecordVal(conn_id);
 	id_val->Assign(0, new AddrVal(src_addr));
-	id_val->Assign(1, new PortVal(ntohs(src_port), proto));
+	id_val->Assign(1, val_mgr->GetPort(ntohs(src_port), proto));
 	id_val->Assign(2, new AddrVal(dst_addr));
-	id_val->Assign(3, new PortVal(ntohs(dst_port), proto));
+	id_val->Assign(3, val_mgr->GetPort(ntohs(dst_port), proto));
 	rv->Assign(0, id_val);
 	rv->Assign(1, new EnumVal(type, BifType::Enum::Tunnel::Type));
 
-	rv->Assign(2, new StringVal(uid.Base62("C").c_str()));
+	rv->Assign(2, new StringVal(uid.Base62("C")));
 
 	return rv;
 	}
 
-bool operator==(const EncapsulationStack& e1, const EncapsulationStack& e2)
+namespace {
+
+// Identifies a stack by its outer stack and its inner-most tunnel.
+struct StackKey {
+	const EncapsulationStack* outer;
+	const EncapsulatingConn* conn;
+
+	bool operator==(const StackKey& other) const
+		{ return outer == other.outer && *conn == *other.conn; }
+};
+
+struct StackKeyHash {
+	size_t operator()(const StackKey& k) const
+		{ return k.conn->Hash() ^ reinterpret_cast<uintptr_t>(k.outer); }
+};
+
+typedef std::unordered_map<StackKey, EncapsulationStack*, StackKeyHash> StackMap;
+
+// Doesn't hold references; stacks remove themselves once they go away.
+StackMap& interned_stacks()
+	{
+	static StackMap stacks;
+	return stacks;
+	}
+
+}
+
+EncapsulationStack::EncapsulationStack(const EncapsulationStack* arg_outer,
+                                       const EncapsulatingConn& c)
+	: outer(arg_outer), conn(c)
 	{
-	if ( ! e1.conns )
-		return e2.conns;
+	depth = outer ? outer->depth + 1 : 1;
 
-	if ( ! e2.conns )
-		return false;
+	if ( outer )
+		Ref(const_cast<EncapsulationStack*>(outer));
+	}
 
-	if ( e1.conns->size() != e2.conns->size() )
-		return false;
+EncapsulationStack::~EncapsulationStack()
+	{
+	StackKey k = { outer, &conn };
+	interned_stacks().erase(k);
+
+	if ( outer )
+		Unref(const_cast<EncapsulationStack*>(outer));
+	}
 
-	for ( size_t i = 0; i < e1.conns->size(); ++i )
+EncapsulationStack* EncapsulationStack::Intern(const EncapsulationStack* outer,
+                                               const EncapsulatingConn& c)
+	{
+	StackKey k = { outer, &c };
+	StackMap& stacks = interned_stacks();
+	StackMap::iterator it = stacks.find(k);
+
+	if ( it != stacks.end() )
 		{
-		if ( (*e1.conns)[i] != (*e2.conns)[i] )
-			return false;
+		Ref(it->second);
+		return it->second;
 		}
 
-	return true;
+	EncapsulationStack* stack = new EncapsulationStack(outer, c);
+	k.conn = &stack->conn;
+	stacks[k] = stack;
+	return stack;
+	}
+
+size_t EncapsulationStack::Interned()
+	{
+	return interned_stacks().size();
+	}
+
+VectorVal* EncapsulationStack::GetVectorVal() const
+	{
+	VectorVal* vv = GetEmptyVectorVal();
+
+	for ( const EncapsulationStack* s = this; s; s = s->outer )
+		vv->Assign(s->depth - 1, s->conn.GetRecordVal());
+
+	return vv;
+	}
+
+VectorVal* EncapsulationStack::GetEmptyVectorVal()
+	{
+	return new VectorVal(internal_type("EncapsulatingConnVector")->AsVectorType());
 	}
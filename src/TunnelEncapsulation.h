@@ -8,6 +8,7 @@
 #include "IPAddr.h"
 #include "Val.h"
 #include "UID.h"
+#include "Obj.h"
 #include <vector>
 
 class Connection;
@@ -76,6 +77,16 @@ public:
 	BifEnum::Tunnel::Type Type() const
 		{ return type; }
 
+	/**
+	 * Returns a hash value consistent with the equality operator.
+	 */
+	hash_t Hash() const
+		{
+		// The endpoints are left out, as IP tunnels compare equal either
+		// way around; the UID tells tunnels apart well enough.
+		return uid.Hash() ^ (hash_t(type) << 8) ^ hash_t(proto);
+		}
+
 	/**
 	 * Returns record value of type "EncapsulatingConn" representing the tunnel.
 	 */
@@ -117,49 +128,33 @@ protected:
 
 /**
  * Abstracts an arbitrary amount of nested tunneling.
+ *
+ * Stacks are immutable and interned: all packets of a tunnel share the same,
+ * reference-counted stack, so that comparing two stacks amounts to comparing
+ * their pointers. A stack links to the next outer one rather than holding
+ * copies of all its tunnels.
  */
-class EncapsulationStack {
+class EncapsulationStack : public BroObj {
 public:
-	EncapsulationStack() : conns(0)
-		{}
-
-	EncapsulationStack(const EncapsulationStack& other)
-		{
-		if ( other.conns )
-			conns = new vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = 0;
-		}
-
-	EncapsulationStack& operator=(const EncapsulationStack& other)
-		{
-		if ( this == &other )
-			return *this;
-
-		delete conns;
-
-		if ( other.conns )
-			conns = new vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = 0;
-
-		return *this;
-		}
-
-	~EncapsulationStack() { delete conns; }
-
 	/**
-	 * Add a new inner-most tunnel to the EncapsulationStack.
+	 * Returns the stack for a new inner-most tunnel nested inside an
+	 * existing stack, creating it if it doesn't exist yet.
+	 *
+	 * @param outer The stack to nest the tunnel inside, or null if it's
+	 *        the outer-most one.
+	 * @param c The new inner-most tunnel.
 	 *
-	 * @param c The new inner-most tunnel to append to the tunnel chain.
+	 * @return The stack, with a reference owned by the caller.
 	 */
-	void Add(const EncapsulatingConn& c)
-		{
-		if ( ! conns )
-			conns = new vector<EncapsulatingConn>();
+	static EncapsulationStack* Intern(const EncapsulationStack* outer,
+	                                  const EncapsulatingConn& c);
 
-		conns->push_back(c);
-		}
+	/**
+	 * Returns the number of stacks currently in use.
+	 */
+	static size_t Interned();
+
+	~EncapsulationStack();
 
 	/**
 	 * Return how many nested tunnels are involved in a encapsulation, zero
@@ -167,7 +162,7 @@ public:
 	 */
 	size_t Depth() const
 		{
-		return conns ? conns->size() : 0;
+		return depth;
 		}
 
 	/**
@@ -175,29 +170,27 @@ public:
 	 */
 	BifEnum::Tunnel::Type LastType() const
 		{
-		return conns ? (*conns)[conns->size()-1].Type() : BifEnum::Tunnel::NONE;
+		return conn.Type();
 		}
 
 	/**
 	 * Get the value of type "EncapsulatingConnVector" represented by the
 	 * entire encapsulation chain.
 	 */
-	VectorVal* GetVectorVal() const
-		{
-		VectorVal* vv = new VectorVal(
-		    internal_type("EncapsulatingConnVector")->AsVectorType());
+	VectorVal* GetVectorVal() const;
 
-		if ( conns )
-			{
-			for ( size_t i = 0; i < conns->size(); ++i )
-				vv->Assign(i, (*conns)[i].GetRecordVal());
-			}
-
-		return vv;
-		}
+	/**
+	 * Get the value of type "EncapsulatingConnVector" for the lack of any
+	 * tunnels.
+	 */
+	static VectorVal* GetEmptyVectorVal();
 
+	// As stacks are interned, equal ones are identical.
 	friend bool operator==(const EncapsulationStack& e1,
-	                       const EncapsulationStack& e2);
+	                       const EncapsulationStack& e2)
+		{
+		return &e1 == &e2;
+		}
 
 	friend bool operator!=(const EncapsulationStack& e1,
 	                       const EncapsulationStack& e2)
@@ -206,7 +199,12 @@ public:
 		}
 
 protected:
-	vector<EncapsulatingConn>* conns;
+	EncapsulationStack(const EncapsulationStack* outer,
+	                   const EncapsulatingConn& c);
+
+	const EncapsulationStack* outer;
+	EncapsulatingConn conn;
+	size_t depth;
 };
 
 #endif
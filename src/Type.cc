@@ -14,8 +14,42 @@
 #include <string>
 #include <list>
 #include <map>
+#include <unordered_map>
 
 BroType::TypeAliasMap BroType::type_aliases;
+uint64 BroType::num_types = 0;
+
+namespace {
+
+// Two types being compared or mapped onto each other, plus the flags
+// the result depends on.
+struct TypePair {
+	uint64 t1;
+	uint64 t2;
+	int flags;
+
+	bool operator==(const TypePair& other) const
+		{ return t1 == other.t1 && t2 == other.t2 && flags == other.flags; }
+};
+
+struct TypePairHash {
+	size_t operator()(const TypePair& p) const
+		{ return (p.t1 * 0x9e3779b97f4a7c15ULL) ^ (p.t2 << 1) ^ p.flags; }
+};
+
+}
+
+// The keys are types' serial numbers rather than their addresses since
+// addresses get reused once types go away.
+typedef std::unordered_map<TypePair, bool, TypePairHash> SameTypeCache;
+typedef std::unordered_map<TypePair, std::vector<int>, TypePairHash> FieldMapCache;
+
+static SameTypeCache same_type_cache;
+static FieldMapCache field_map_cache;
+
+// Beyond this, we start over; most entries then belong to types that
+// are long gone.
+static const size_t MAX_SAME_TYPE_CACHE = 65536;
 
 // Note: This function must be thread-safe.
 const char* type_name(TypeTag t)
@@ -60,6 +94,8 @@ BroType::BroType(TypeTag t, bool arg_base_type)
 	tag = t;
 	is_network_order = 0;
 	base_type = arg_base_type;
+	serial = ++num_types;
+	in_type_cache = false;
 
 	switch ( tag ) {
 	case TYPE_VOID:
@@ -122,6 +158,18 @@ BroType::BroType(TypeTag t, bool arg_base_type)
 
 	}
 
+void BroType::Modified()
+	{
+	if ( ! in_type_cache )
+		return;
+
+	// Other types' results may depend on this one's, so we don't try
+	// to be selective.
+	same_type_cache.clear();
+	field_map_cache.clear();
+	in_type_cache = false;
+	}
+
 BroType* BroType::Clone() const
 	{
 	SerializationFormat* form = new BinarySerializationFormat();
@@ -343,6 +391,7 @@ void TypeList::Append(BroType* t)
 		reporter->InternalError("pure type-list violation");
 
 	types.append(t);
+	Modified();
 	}
 
 void TypeList::AppendEvenIfNotPure(BroType* t)
@@ -354,6 +403,7 @@ void TypeList::AppendEvenIfNotPure(BroType* t)
 		}
 
 	types.append(t);
+	Modified();
 	}
 
 void TypeList::Describe(ODesc* d) const
@@ -440,6 +490,12 @@ int IndexType::MatchesIndex(ListExpr*& index) const
 	     exprs.length() == 1 && exprs[0]->Type()->Tag() == TYPE_ADDR )
 		return MATCHES_INDEX_SCALAR;
 
+	// A table indexed by patterns, with a string, yields the values of
+	// all patterns that match it.
+	if ( types->length() == 1 && (*types)[0]->Tag() == TYPE_PATTERN &&
+	     exprs.length() == 1 && exprs[0]->Type()->Tag() == TYPE_STRING )
+		return yield_type ? MATCHES_INDEX_VECTOR : DOES_NOT_MATCH_INDEX;
+
 	return check_and_promote_exprs(index, Indices()) ?
 			MATCHES_INDEX_SCALAR : DOES_NOT_MATCH_INDEX;
 	}
@@ -530,6 +586,12 @@ bool IndexType::IsSubNetIndex() const
 	return false;
 	}
 
+bool IndexType::IsPatternIndex() const
+	{
+	const type_list* types = indices->Types();
+	return types->length() == 1 && (*types)[0]->Tag() == TYPE_PATTERN;
+	}
+
 IMPLEMENT_SERIAL(IndexType, SER_INDEX_TYPE);
 
 bool IndexType::DoSerialize(SerialInfo* info) const
@@ -566,9 +628,10 @@ TableType::TableType(TypeList* ind, BroType* yield)
 			break;
 
 		// Allow functions, since they can be compared
-		// for Func* pointer equality.
+		// for Func* pointer equality, and patterns, which
+		// get compared by their text.
 		if ( t == TYPE_INTERNAL_OTHER && tli->Tag() != TYPE_FUNC &&
-		     tli->Tag() != TYPE_RECORD )
+		     tli->Tag() != TYPE_RECORD && tli->Tag() != TYPE_PATTERN )
 			{
 			tli->Error("bad index type");
 			SetError();
@@ -979,6 +1042,8 @@ RecordType::RecordType(type_decl_list* arg_types) : BroType(TYPE_RECORD)
 
 RecordType::~RecordType()
 	{
+	ClearFieldInits();
+
 	if ( types )
 		{
 		loop_over_list(*types, i)
@@ -1016,6 +1081,66 @@ Val* RecordType::FieldDefault(int field) const
 	return def_attr ? def_attr->AttrExpr()->Eval(0) : 0;
 	}
 
+const std::vector<RecordType::FieldInit>& RecordType::FieldInits() const
+	{
+	if ( int(field_inits.size()) == num_fields )
+		return field_inits;
+
+	ClearFieldInits();
+	field_inits.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const TypeDecl* td = FieldDecl(i);
+		const Attributes* a = td->attrs;
+		const Attr* def_attr = a ? a->FindAttr(ATTR_DEFAULT) : 0;
+		TypeTag tag = td->type->Tag();
+
+		FieldInit fi;
+		fi.kind = FieldInit::UNSET;
+		fi.val = 0;
+
+		if ( def_attr )
+			{
+			Expr* e = def_attr->AttrExpr();
+
+			// A constant's value gets shared by all records anyway.
+			// Records of a different type need coercing each time.
+			if ( e->IsConst() &&
+			     (tag != TYPE_RECORD ||
+			      same_type(e->Type(), td->type)) )
+				{
+				fi.kind = FieldInit::CONSTANT;
+				fi.val = ((ConstExpr*) e)->Value()->Ref();
+				}
+			else
+				fi.kind = FieldInit::DEFAULT;
+			}
+
+		else if ( ! (a && a->FindAttr(ATTR_OPTIONAL)) )
+			{
+			if ( tag == TYPE_RECORD )
+				fi.kind = FieldInit::NEW_RECORD;
+			else if ( tag == TYPE_TABLE )
+				fi.kind = FieldInit::NEW_TABLE;
+			else if ( tag == TYPE_VECTOR )
+				fi.kind = FieldInit::NEW_VECTOR;
+			}
+
+		field_inits.push_back(fi);
+		}
+
+	return field_inits;
+	}
+
+void RecordType::ClearFieldInits() const
+	{
+	for ( unsigned int i = 0; i < field_inits.size(); ++i )
+		Unref(field_inits[i].val);
+
+	field_inits.clear();
+	}
+
 int RecordType::FieldOffset(const char* field) const
 	{
 	loop_over_list(*types, i)
@@ -1120,6 +1245,8 @@ const char* RecordType::AddFields(type_decl_list* others, attr_list* attr)
 	delete others;
 
 	num_fields = types->length();
+	ClearFieldInits();
+	Modified();
 	return 0;
 	}
 
@@ -1830,6 +1957,9 @@ static int is_init_compat(const BroType* t1, const BroType* t2)
 	return 0;
 	}
 
+static int compare_types(const BroType* t1, const BroType* t2, int is_init,
+			 bool match_record_field_names);
+
 int same_type(const BroType* t1, const BroType* t2, int is_init, bool match_record_field_names)
 	{
 	if ( t1 == t2 ||
@@ -1837,6 +1967,9 @@ int same_type(const BroType* t1, const BroType* t2, int is_init, bool match_reco
 	     t2->Tag() == TYPE_ANY )
 		return 1;
 
+	const BroType* orig_t1 = t1;
+	const BroType* orig_t2 = t2;
+
 	t1 = flatten_type(t1);
 	t2 = flatten_type(t2);
 	if ( t1 == t2 )
@@ -1850,6 +1983,44 @@ int same_type(const BroType* t1, const BroType* t2, int is_init, bool match_reco
 		return 0;
 		}
 
+	switch ( t1->Tag() ) {
+	case TYPE_TABLE:
+	case TYPE_FUNC:
+	case TYPE_RECORD:
+	case TYPE_LIST:
+	case TYPE_VECTOR:
+		break;
+
+	default:
+		// Nothing to gain from caching.
+		return compare_types(t1, t2, is_init, match_record_field_names);
+	}
+
+	TypePair key = { t1->serial, t2->serial,
+			 (is_init ? 1 : 0) | (match_record_field_names ? 2 : 0) };
+
+	SameTypeCache::const_iterator i = same_type_cache.find(key);
+
+	if ( i != same_type_cache.end() )
+		return i->second;
+
+	int result = compare_types(t1, t2, is_init, match_record_field_names);
+
+	if ( same_type_cache.size() >= MAX_SAME_TYPE_CACHE )
+		same_type_cache.clear();
+
+	same_type_cache[key] = result;
+
+	// Appending to a one-element list changes what it flattens to.
+	t1->in_type_cache = t2->in_type_cache = true;
+	orig_t1->in_type_cache = orig_t2->in_type_cache = true;
+
+	return result;
+	}
+
+static int compare_types(const BroType* t1, const BroType* t2, int is_init,
+			 bool match_record_field_names)
+	{
 	switch ( t1->Tag() ) {
 	case TYPE_VOID:
 	case TYPE_BOOL:
@@ -1990,9 +2161,11 @@ int same_attrs(const Attributes* a1, const Attributes* a2)
 int record_promotion_compatible(const RecordType* super_rec,
 				const RecordType* sub_rec)
 	{
+	const std::vector<int>& field_map = record_field_map(sub_rec, super_rec);
+
 	for ( int i = 0; i < sub_rec->NumFields(); ++i )
 		{
-		int o = super_rec->FieldOffset(sub_rec->FieldName(i));
+		int o = field_map[i];
 
 		if ( o < 0 )
 			// Orphaned field.
@@ -2018,6 +2191,29 @@ int record_promotion_compatible(const RecordType* super_rec,
 	return 1;
 	}
 
+const std::vector<int>& record_field_map(const RecordType* from,
+					const RecordType* to)
+	{
+	TypePair key = { from->serial, to->serial, 0 };
+
+	FieldMapCache::const_iterator i = field_map_cache.find(key);
+
+	if ( i != field_map_cache.end() )
+		return i->second;
+
+	// Not bounded like the same_type() cache: callers hold on to the
+	// result, and records that get coerced are few and long-lived.
+	std::vector<int>& map = field_map_cache[key];
+	map.reserve(from->NumFields());
+
+	for ( int j = 0; j < from->NumFields(); ++j )
+		map.push_back(to->FieldOffset(from->FieldName(j)));
+
+	from->in_type_cache = to->in_type_cache = true;
+
+	return map;
+	}
+
 const BroType* flatten_type(const BroType* t)
 	{
 	if ( t->Tag() != TYPE_LIST )
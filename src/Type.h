@@ -7,6 +7,7 @@
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
 
 #include "Obj.h"
 #include "Attr.h"
@@ -268,11 +269,18 @@ public:
 	static void AddAlias(const std::string type_name, BroType* type)
 		{ BroType::type_aliases[type_name].insert(type); }
 
+	// A number unique to this type, for caching results about it.
+	uint64 Serial() const	{ return serial; }
+
 protected:
-	BroType()	{ }
+	BroType()	{ serial = ++num_types; in_type_cache = false; }
 
 	void SetError();
 
+	// To be called when the type changes in a way that may affect
+	// same_type(); drops cached comparisons that involved it.
+	void Modified();
+
 	DECLARE_SERIAL(BroType)
 
 private:
@@ -282,6 +290,17 @@ private:
 	bool base_type;
 	string name;
 
+	friend int same_type(const BroType* t1, const BroType* t2, int is_init,
+			     bool match_record_field_names);
+	friend const std::vector<int>& record_field_map(const RecordType* from,
+						       const RecordType* to);
+
+	uint64 serial;
+
+	// True if a cached result may depend on this type.
+	mutable bool in_type_cache;
+
+	static uint64 num_types;
 	static TypeAliasMap type_aliases;
 };
 
@@ -343,6 +362,7 @@ public:
 
 	// Returns true if this table is solely indexed by subnet.
 	bool IsSubNetIndex() const;
+	bool IsPatternIndex() const;
 
 protected:
 	IndexType(){ indices = 0; yield_type = 0; }
@@ -484,6 +504,25 @@ public:
 
 	int NumFields() const			{ return num_fields; }
 
+	// How a new RecordVal initializes one of the fields.
+	struct FieldInit {
+		enum Kind {
+			UNSET,		// &optional without &default
+			CONSTANT,	// shared default value in val
+			DEFAULT,	// &default that needs evaluating
+			NEW_RECORD,	// an empty record, table, or vector
+			NEW_TABLE,
+			NEW_VECTOR
+		} kind;
+
+		Val* val;
+	};
+
+	// Returns how to initialize each field, in order.  These get worked
+	// out from the field's attributes on first use, so that RecordVal's
+	// constructor doesn't need to examine them for every new record.
+	const std::vector<FieldInit>& FieldInits() const;
+
 	// Returns 0 if all is ok, otherwise a pointer to an error message.
 	// Takes ownership of list.
 	const char* AddFields(type_decl_list* types, attr_list* attr);
@@ -498,8 +537,12 @@ protected:
 
 	DECLARE_SERIAL(RecordType)
 
+	void ClearFieldInits() const;
+
 	int num_fields;
 	type_decl_list* types;
+
+	mutable std::vector<FieldInit> field_inits;
 };
 
 class SubNetType : public BroType {
@@ -624,9 +667,11 @@ extern OpaqueType* md5_type;
 extern OpaqueType* sha1_type;
 extern OpaqueType* sha256_type;
 extern OpaqueType* entropy_type;
+extern OpaqueType* moments_type;
 extern OpaqueType* cardinality_type;
 extern OpaqueType* topk_type;
 extern OpaqueType* bloomfilter_type;
+extern OpaqueType* cuckoofilter_type;
 extern OpaqueType* x509_opaque_type;
 
 // Returns the Bro basic (non-parameterized) type with the given type.
@@ -644,6 +689,8 @@ inline BroType* error_type()	{ return base_type(TYPE_ERROR); }
 // True if the two types are equivalent.  If is_init is true then the test is
 // done in the context of an initialization. If match_record_field_names is
 // true then for record types the field names have to match, too.
+// Results for tables, records, functions, lists and vectors are cached,
+// so comparing the same two types again is cheap.
 extern int same_type(const BroType* t1, const BroType* t2, int is_init=0, bool match_record_field_names=true);
 
 // True if the two attribute lists are equivalent.
@@ -654,6 +701,12 @@ extern int same_attrs(const Attributes* a1, const Attributes* a2);
 extern int record_promotion_compatible(const RecordType* super_rec,
 					const RecordType* sub_rec);
 
+// Returns, for each field of the record from, the offset of the field
+// with the same name in the record to, or -1 if there's none. The result
+// is cached; it stays valid until either type gets redef'd.
+extern const std::vector<int>& record_field_map(const RecordType* from,
+						const RecordType* to);
+
 // If the given BroType is a TypeList with just one element, returns
 // that element, otherwise returns the type.
 extern const BroType* flatten_type(const BroType* t);
@@ -64,6 +64,13 @@ public:
 	operator bool() const
 		{ return initialized; }
 
+	/**
+	 * Returns a hash of the UID. Its bits are random already, so it's
+	 * just the first of them.
+	 */
+	uint64 Hash() const
+		{ return uid[0]; }
+
 	/**
 	 * Assignment operator.
 	 */
@@ -104,10 +111,25 @@ inline std::string UID::Base62(std::string prefix) const
 	if ( ! initialized )
 		reporter->InternalError("use of uninitialized UID");
 
-	char tmp[sizeof(uid) * 8 + 1];  // enough for even binary representation
+	// Same digits, least significant first, as uitoa_n() produces, but
+	// with a constant base the divisions come down to multiplications.
+	static const char digits[] =
+		"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+	char tmp[BRO_UID_LEN * 11];	// 62^11 > 2^64
+	size_t n = 0;
+
 	for ( size_t i = 0; i < BRO_UID_LEN; ++i )
-		prefix.append(uitoa_n(uid[i], tmp, sizeof(tmp), 62));
+		{
+		uint64 v = uid[i];
+
+		do {
+			tmp[n++] = digits[v % 62];
+			v /= 62;
+		} while ( v );
+		}
 
+	prefix.append(tmp, n);
 	return prefix;
 	}
 
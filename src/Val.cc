@@ -11,11 +11,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <unordered_map>
 
 #include "Val.h"
 #include "Net.h"
 #include "File.h"
 #include "Func.h"
+#include "Frame.h"
+#include "Stmt.h"
 #include "RE.h"
 #include "Scope.h"
 #include "NetVar.h"
@@ -23,15 +27,20 @@
 #include "Serializer.h"
 #include "RemoteSerializer.h"
 #include "PrefixTable.h"
+#include "ExpireIndex.h"
+#include "Metrics.h"
 #include "Conn.h"
 #include "Reporter.h"
 #include "IPAddr.h"
 
+uint64 num_vals_created = 0;
+
 Val::Val(Func* f)
 	{
 	val.func_val = f;
 	::Ref(val.func_val);
 	type = f->FType()->Ref();
+	++num_vals_created;
 #ifdef DEBUG
 	bound_id = 0;
 #endif
@@ -48,6 +57,7 @@ Val::Val(BroFile* f)
 	assert(f->FType()->Tag() == TYPE_STRING);
 	type = string_file_type->Ref();
 
+	++num_vals_created;
 #ifdef DEBUG
 	bound_id = 0;
 #endif
@@ -71,6 +81,66 @@ Val::~Val()
 	}
 
 Val* Val::Clone() const
+	{
+	CloneState state;
+	return Clone(&state);
+	}
+
+Val* Val::Clone(CloneState* state) const
+	{
+	CloneState::const_iterator i = state->find(this);
+
+	if ( i != state->end() )
+		return i->second->Ref();
+
+	return DoClone(state);
+	}
+
+Val* Val::NewClone(CloneState* state, const Val* src, Val* dst)
+	{
+	state->insert(std::make_pair(src, dst));
+	return dst;
+	}
+
+Val* Val::DoClone(CloneState* state) const
+	{
+	Val* self = const_cast<Val*>(this);
+
+	switch ( type->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+	case TYPE_INTERNAL_UNSIGNED:
+	case TYPE_INTERNAL_DOUBLE:
+	case TYPE_INTERNAL_ADDR:
+	case TYPE_INTERNAL_SUBNET:
+		// Immutable.
+		return self->Ref();
+
+	case TYPE_INTERNAL_STRING:
+		return NewClone(state, this,
+				new StringVal(new BroString(*AsString())));
+
+	case TYPE_INTERNAL_OTHER:
+		switch ( type->Tag() ) {
+		case TYPE_FUNC:
+		case TYPE_FILE:
+		case TYPE_PATTERN:
+		case TYPE_TYPE:
+			// Copies would refer to the same thing anyway.
+			return self->Ref();
+
+		default:
+			break;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return SerialClone();
+	}
+
+Val* Val::SerialClone() const
 	{
 	SerializationFormat* form = new BinarySerializationFormat();
 	form->StartWrite();
@@ -203,8 +273,8 @@ bool Val::DoSerialize(SerialInfo* info) const
 		return SERIALIZE(val.double_val);
 
 	case TYPE_INTERNAL_STRING:
-		return SERIALIZE_STR((const char*) val.string_val->Bytes(),
-				val.string_val->Len());
+		return SERIALIZE_STR((const char*) AsString()->Bytes(),
+				AsString()->Len());
 
 	case TYPE_INTERNAL_ADDR:
 		return SERIALIZE(*val.addr_val);
@@ -415,19 +485,19 @@ Val* Val::SizeVal() const
 		// Return abs value. However abs() only works on ints and llabs
 		// doesn't work on Mac OS X 10.5. So we do it by hand
 		if ( val.int_val < 0 )
-			return new Val(-val.int_val, TYPE_COUNT);
+			return val_mgr->GetCount(-val.int_val);
 		else
-			return new Val(val.int_val, TYPE_COUNT);
+			return val_mgr->GetCount(val.int_val);
 
 	case TYPE_INTERNAL_UNSIGNED:
-		return new Val(val.uint_val, TYPE_COUNT);
+		return val_mgr->GetCount(val.uint_val);
 
 	case TYPE_INTERNAL_DOUBLE:
 		return new Val(fabs(val.double_val), TYPE_DOUBLE);
 
 	case TYPE_INTERNAL_OTHER:
 		if ( type->Tag() == TYPE_FUNC )
-			return new Val(val.func_val->FType()->ArgTypes()->Types()->length(), TYPE_COUNT);
+			return val_mgr->GetCount(val.func_val->FType()->ArgTypes()->Types()->length());
 
 		if ( type->Tag() == TYPE_FILE )
 			return new Val(val.file_val->Size(), TYPE_DOUBLE);
@@ -437,7 +507,7 @@ Val* Val::SizeVal() const
 		break;
 	}
 
-	return new Val(0, TYPE_COUNT);
+	return val_mgr->GetCount(0);
 	}
 
 unsigned int Val::MemoryAllocation() const
@@ -485,7 +555,7 @@ void Val::ValDescribe(ODesc* d) const
 	case TYPE_INTERNAL_INT:		d->Add(val.int_val); break;
 	case TYPE_INTERNAL_UNSIGNED:	d->Add(val.uint_val); break;
 	case TYPE_INTERNAL_DOUBLE:	d->Add(val.double_val); break;
-	case TYPE_INTERNAL_STRING:	d->AddBytes(val.string_val); break;
+	case TYPE_INTERNAL_STRING:	d->AddBytes(AsString()); break;
 	case TYPE_INTERNAL_ADDR:	d->Add(val.addr_val->AsString().c_str()); break;
 
 	case TYPE_INTERNAL_SUBNET:
@@ -527,8 +597,47 @@ void Val::ValDescribeReST(ODesc* d) const
 	}
 	}
 
+// With track_container_origins, where the containers alive got created.
+typedef std::unordered_map<const MutableVal*, const Location*> CreationSiteMap;
+static CreationSiteMap creation_sites;
+
+void MutableVal::InitMutableVal()
+	{
+	props = 0;
+	id = 0;
+	last_modified = SerialObj::ALWAYS;
+	approx_mem = 0;
+
+	if ( track_container_origins && ! g_frame_stack.empty() )
+		{
+		const Stmt* s = g_frame_stack.back()->GetNextStmt();
+
+		if ( s )
+			creation_sites[this] = s->GetLocationInfo();
+		}
+	}
+
+const Location* MutableVal::CreationSite() const
+	{
+	CreationSiteMap::const_iterator i = creation_sites.find(this);
+	return i != creation_sites.end() ? i->second : 0;
+	}
+
+void MutableVal::ForEachCreationSite(void (*f)(const MutableVal* v,
+						const Location* loc,
+						void* cookie),
+				      void* cookie)
+	{
+	for ( CreationSiteMap::const_iterator i = creation_sites.begin();
+	      i != creation_sites.end(); ++i )
+		f(i->first, i->second, cookie);
+	}
+
 MutableVal::~MutableVal()
 	{
+	if ( ! creation_sites.empty() )
+		creation_sites.erase(this);
+
 	for ( list<ID*>::iterator i = aliases.begin(); i != aliases.end(); ++i )
 		{
 		if ( global_scope() )
@@ -808,6 +917,11 @@ uint32 PortVal::Port() const
 	return p & ~PORT_SPACE_MASK;
 	}
 
+Val* PortVal::SizeVal() const
+	{
+	return val_mgr->GetInt(val.uint_val);
+	}
+
 int PortVal::IsTCP() const
 	{
 	return (val.uint_val & PORT_SPACE_MASK) == TCP_PORT_MASK;
@@ -885,9 +999,9 @@ unsigned int AddrVal::MemoryAllocation() const
 Val* AddrVal::SizeVal() const
 	{
 	if ( val.addr_val->GetFamily() == IPv4 )
-		return new Val(32, TYPE_COUNT);
+		return val_mgr->GetCount(32);
 	else
-		return new Val(128, TYPE_COUNT);
+		return val_mgr->GetCount(128);
 	}
 
 IMPLEMENT_SERIAL(AddrVal, SER_ADDR_VAL);
@@ -1028,45 +1142,152 @@ bool SubNetVal::DoUnserialize(UnserialInfo* info)
 	return true;
 	}
 
+// The bytes of a chain of concatenations, shared by the StringVals along
+// it, each of which is a prefix.
+class StringBuffer {
+public:
+	StringBuffer(const u_char* bytes, int len)
+		: data((const char*) bytes, len)	{ ref_cnt = 1; }
+
+	void Ref()	{ ++ref_cnt; }
+	void Unref()	{ if ( --ref_cnt == 0 ) delete this; }
+
+	const u_char* Bytes() const	{ return (const u_char*) data.data(); }
+	int Len() const		{ return data.size(); }
+
+	// std::string grows its capacity geometrically.
+	void Append(const u_char* bytes, int len)
+		{ data.append((const char*) bytes, len); }
+
+	unsigned int MemoryAllocation() const
+		{ return padded_sizeof(*this) + pad_size(data.capacity()); }
+
+private:
+	std::string data;
+	int ref_cnt;
+};
+
 StringVal::StringVal(BroString* s) : Val(TYPE_STRING)
 	{
 	val.string_val = s;
+	buffer = 0;
+	buffer_len = 0;
 	}
 
 StringVal::StringVal(int length, const char* s) : Val(TYPE_STRING)
 	{
 	// The following adds a NUL at the end.
 	val.string_val = new BroString((const u_char*)  s, length, 1);
+	buffer = 0;
+	buffer_len = 0;
 	}
 
 StringVal::StringVal(const char* s) : Val(TYPE_STRING)
 	{
 	val.string_val = new BroString(s);
+	buffer = 0;
+	buffer_len = 0;
 	}
 
 StringVal::StringVal(const string& s) : Val(TYPE_STRING)
 	{
 	val.string_val = new BroString(s.c_str());
+	buffer = 0;
+	buffer_len = 0;
+	}
+
+StringVal::StringVal(StringBuffer* arg_buffer, int len) : Val(TYPE_STRING)
+	{
+	val.string_val = 0;
+	buffer = arg_buffer;
+	buffer->Ref();
+	buffer_len = len;
+	}
+
+StringVal::~StringVal()
+	{
+	if ( buffer )
+		buffer->Unref();
+	}
+
+void Val::FlattenString() const
+	{
+	StringVal* sv = const_cast<StringVal*>(static_cast<const StringVal*>(this));
+
+	// The following adds a NUL at the end.
+	sv->val.string_val = new BroString(sv->buffer->Bytes(),
+					   sv->buffer_len, 1);
+	sv->buffer->Unref();
+	sv->buffer = 0;
+	sv->buffer_len = 0;
+	}
+
+StringVal* StringVal::Concat(StringVal* a, StringVal* b)
+	{
+	const BroString* bs = b->AsString();
+	int len = a->Len() + bs->Len();
+
+	if ( len < MIN_BUFFERED_LEN )
+		{
+		vector<const BroString*> strings;
+		strings.push_back(a->AsString());
+		strings.push_back(bs);
+
+		return new StringVal(concatenate(strings));
+		}
+
+	StringBuffer* buf;
+
+	if ( a->buffer && a->buffer->Len() == a->buffer_len )
+		{
+		// a is the latest in its chain, so we can just continue it.
+		buf = a->buffer;
+		buf->Append(bs->Bytes(), bs->Len());
+		}
+	else
+		{
+		buf = a->buffer ?
+			new StringBuffer(a->buffer->Bytes(), a->buffer_len) :
+			new StringBuffer(a->Bytes(), a->Len());
+		buf->Append(bs->Bytes(), bs->Len());
+		}
+
+	StringVal* result = new StringVal(buf, len);
+
+	if ( buf != a->buffer )
+		buf->Unref();
+
+	return result;
 	}
 
 StringVal* StringVal::ToUpper()
 	{
-	val.string_val->ToUpper();
+	AsString()->ToUpper();
 	return this;
 	}
 
+Val* StringVal::SizeVal() const
+	{
+	return val_mgr->GetCount(buffer ? buffer_len :
+				 val.string_val->Len());
+	}
+
 void StringVal::ValDescribe(ODesc* d) const
 	{
 	// Should reintroduce escapes ? ###
 	if ( d->WantQuotes() )
 		d->Add("\"");
-	d->AddBytes(val.string_val);
+	d->AddBytes(AsString());
 	if ( d->WantQuotes() )
 		d->Add("\"");
 	}
 
 unsigned int StringVal::MemoryAllocation() const
 	{
+	if ( buffer )
+		// The buffer is shared along the chain; we count our part.
+		return padded_sizeof(*this) + pad_size(buffer_len);
+
 	return padded_sizeof(*this) + val.string_val->MemoryAllocation();
 	}
 
@@ -1248,6 +1469,18 @@ bool ListVal::DoSerialize(SerialInfo* info) const
 	return true;
 	}
 
+Val* ListVal::DoClone(CloneState* state) const
+	{
+	ListVal* lv = new ListVal(tag);
+	lv->vals.resize(vals.length());
+	NewClone(state, this, lv);
+
+	loop_over_list(vals, i)
+		lv->Append(vals[i]->Clone(state));
+
+	return lv;
+	}
+
 bool ListVal::DoUnserialize(UnserialInfo* info)
 	{
 	DO_UNSERIALIZE(Val);
@@ -1306,11 +1539,131 @@ void TableValTimer::Dispatch(double t, int is_expire)
 		}
 	}
 
+TableEntryVal::TimedEntry::TimedEntry(Val* v) : TableEntryVal(v, true)
+	{
+	times.last_access_time = network_time;
+	times.expire_access_time = times.last_read_update =
+		int(network_time - bro_start_network_time);
+	times.expire_bucket = 0;
+	}
+
+TableEntryVal* TableEntryVal::New(Val* v, bool with_times)
+	{
+	if ( with_times )
+		return new TimedEntry(v);
+
+	return new TableEntryVal(v, false);
+	}
+
+void TableEntryVal::Delete(TableEntryVal* e)
+	{
+	if ( ! e )
+		return;
+
+	if ( e->has_times )
+		delete static_cast<TimedEntry*>(e);
+	else
+		delete e;
+	}
+
+unsigned int TableEntryVal::MemoryAllocation() const
+	{
+	return has_times ? padded_sizeof(TimedEntry) :
+				padded_sizeof(TableEntryVal);
+	}
+
 static void table_entry_val_delete_func(void* val)
 	{
 	TableEntryVal* tv = (TableEntryVal*) val;
 	tv->Unref();
-	delete tv;
+	TableEntryVal::Delete(tv);
+	}
+
+// Matches strings against all patterns of a set[pattern]/table[pattern]
+// at once, with a DFA that combines them. It's built from the table's
+// current patterns on first use after they've changed; its states get
+// computed lazily, like those of any pattern, as lookups need them.
+class TablePatternMatcher {
+public:
+	TablePatternMatcher(TableVal* arg_table)
+		{ table = arg_table; matcher = 0; }
+
+	~TablePatternMatcher()	{ Clear(); }
+
+	// To be called when patterns come or go.
+	void Clear();
+
+	// Adds the indices of all patterns that match somewhere in s.
+	void Match(const BroString* s, std::vector<ListVal*>* matches);
+
+	unsigned int MemoryAllocation() const
+		{
+		return padded_sizeof(*this) +
+			(matcher ? matcher->MemoryAllocation() : 0) +
+			pad_size(indices.capacity() * sizeof(ListVal*));
+		}
+
+protected:
+	void Build();
+
+	TableVal* table;
+	Specific_RE_Matcher* matcher;
+
+	// The patterns' indices, by their accept index minus one.
+	std::vector<ListVal*> indices;
+};
+
+void TablePatternMatcher::Clear()
+	{
+	delete matcher;
+	matcher = 0;
+
+	for ( size_t i = 0; i < indices.size(); ++i )
+		Unref(indices[i]);
+
+	indices.clear();
+	}
+
+void TablePatternMatcher::Build()
+	{
+	string_list patterns;
+	int_list accept_idx;
+
+	const PDict(TableEntryVal)* tbl = table->AsTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	while ( tbl->NextEntry(k, c) )
+		{
+		ListVal* index = table->RecoverIndex(k);
+		delete k;
+
+		const RE_Matcher* re = index->Index(0)->AsPattern();
+		patterns.append(const_cast<char*>(re->AnywherePatternText()));
+		indices.push_back(index);
+
+		// Accept indices must not be zero.
+		accept_idx.append(indices.size());
+		}
+
+	matcher = new Specific_RE_Matcher(MATCH_ANYWHERE);
+
+	if ( indices.size() && ! matcher->CompileSet(patterns, accept_idx) )
+		reporter->Error("failed to compile the patterns of a table[pattern]");
+	}
+
+void TablePatternMatcher::Match(const BroString* s,
+				std::vector<ListVal*>* matches)
+	{
+	if ( ! matcher )
+		Build();
+
+	AcceptingSet accepted;
+	matcher->MatchSet(s, &accepted);
+
+	for ( AcceptingSet::const_iterator i = accepted.begin();
+	      i != accepted.end(); ++i )
+		matches->push_back(indices[*i - 1]);
 	}
 
 TableVal::TableVal(TableType* t, Attributes* a) : MutableVal(t)
@@ -1319,6 +1672,11 @@ TableVal::TableVal(TableType* t, Attributes* a) : MutableVal(t)
 	SetAttrs(a);
 	}
 
+static dict_layout table_dict_layout()
+	{
+	return BifConst::table_open_addressing ? OPEN_ADDRESSING : CHAINED;
+	}
+
 void TableVal::Init(TableType* t)
 	{
 	::Ref(t);
@@ -1326,6 +1684,7 @@ void TableVal::Init(TableType* t)
 	expire_func = 0;
 	expire_time = 0;
 	expire_cookie = 0;
+	expire_index = 0;
 	timer = 0;
 	def_val = 0;
 
@@ -1334,9 +1693,16 @@ void TableVal::Init(TableType* t)
 	else
 		subnets = 0;
 
+	if ( t->IsPatternIndex() )
+		pattern_matcher = new TablePatternMatcher(this);
+	else
+		pattern_matcher = 0;
+
 	table_hash = new CompositeHash(table_type->Indices());
-	val.table_val = new PDict(TableEntryVal);
+	val.table_val = new PDict(TableEntryVal)(UNORDERED, DEFAULT_DICT_SIZE,
+						table_dict_layout());
 	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+	ResetMemory();
 	}
 
 TableVal::~TableVal()
@@ -1347,7 +1713,9 @@ TableVal::~TableVal()
 	Unref(table_type);
 	delete table_hash;
 	delete AsTable();
+	delete expire_index;
 	delete subnets;
+	delete pattern_matcher;
 	Unref(attrs);
 	Unref(def_val);
 	Unref(expire_func);
@@ -1357,9 +1725,85 @@ TableVal::~TableVal()
 void TableVal::RemoveAll()
 	{
 	// Here we take the brute force approach.
+	InvalidateExpireIndex();
 	delete AsTable();
-	val.table_val = new PDict(TableEntryVal);
+	val.table_val = new PDict(TableEntryVal)(UNORDERED, DEFAULT_DICT_SIZE,
+						table_dict_layout());
 	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+	ResetMemory();
+
+	if ( pattern_matcher )
+		pattern_matcher->Clear();
+	}
+
+// The bytes that a value counts for inside of a container.
+static inline int64 contained_memory(const Val* v)
+	{
+	return v ? v->ApproxMemory() : 0;
+	}
+
+void TableVal::AccountEntry(TableEntryVal* e, int key_size)
+	{
+	unsigned int bytes = e->MemoryAllocation() +
+				Dictionary::EntryMemory(key_size) +
+				contained_memory(e->Value());
+
+	e->SetAccounted(bytes);
+	AdjustMemory(bytes);
+	key_mem += key_size;
+	}
+
+void TableVal::UnaccountEntry(const TableEntryVal* e, int key_size)
+	{
+	AdjustMemory(-int64(e->Accounted()));
+	key_mem -= key_size;
+	}
+
+void TableVal::ResetMemory()
+	{
+	approx_mem = padded_sizeof(*this) + padded_sizeof(*val.table_val) +
+			table_hash->MemoryAllocation();
+	key_mem = 0;
+	}
+
+void TableVal::SwapContents(TableVal* other)
+	{
+	assert(same_type(Type(), other->Type()));
+
+	// Expiration passes that are underway start over on the new
+	// contents.
+	if ( expire_cookie )
+		{
+		AsTable()->StopIteration(expire_cookie);
+		expire_cookie = 0;
+		}
+
+	if ( other->expire_cookie )
+		{
+		other->AsTable()->StopIteration(other->expire_cookie);
+		other->expire_cookie = 0;
+		}
+
+	InvalidateExpireIndex();
+	other->InvalidateExpireIndex();
+
+	std::swap(val.table_val, other->val.table_val);
+	std::swap(subnets, other->subnets);
+	std::swap(approx_mem, other->approx_mem);
+	std::swap(key_mem, other->key_mem);
+
+	// Bulk-loaded prefixes tend to be looked up a lot.
+	if ( subnets )
+		subnets->Build();
+
+	if ( pattern_matcher )
+		{
+		pattern_matcher->Clear();
+		other->pattern_matcher->Clear();
+		}
+
+	Modified();
+	other->Modified();
 	}
 
 int TableVal::RecursiveSize() const
@@ -1403,6 +1847,43 @@ void TableVal::SetAttrs(Attributes* a)
 		expire_func = ef->AttrExpr();
 		expire_func->Ref();
 		}
+
+	if ( ExpirationEnabled() )
+		AddEntryTimes();
+	}
+
+void TableVal::AddEntryTimes()
+	{
+	PDict(TableEntryVal)* tbl = AsNonConstTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	TableEntryVal* v;
+	while ( (v = tbl->NextEntry(k, c)) )
+		{
+		if ( v->HasTimes() )
+			{
+			delete k;
+			continue;
+			}
+
+		// Replacing the value of an existing key doesn't disturb
+		// the iteration.
+		TableEntryVal* nv = TableEntryVal::New(v->Value(), true);
+		UnaccountEntry(v, k->Size());
+		AccountEntry(nv, k->Size());
+		tbl->Insert(k, nv);
+
+		if ( subnets )
+			{
+			ListVal* index = table_hash->RecoverVals(k);
+			subnets->Insert(index, nv);
+			Unref(index);
+			}
+
+		TableEntryVal::Delete(v);
+		delete k;
+		}
 	}
 
 void TableVal::CheckExpireAttr(attr_tag at)
@@ -1470,7 +1951,8 @@ int TableVal::Assign(Val* index, HashKey* k, Val* new_val, Opcode op)
 			}
 		}
 
-	TableEntryVal* new_entry_val = new TableEntryVal(new_val);
+	TableEntryVal* new_entry_val =
+		TableEntryVal::New(new_val, ExpirationEnabled());
 	HashKey k_copy(k->Key(), k->Size(), k->Hash());
 	TableEntryVal* old_entry_val = AsNonConstTable()->Insert(k, new_entry_val);
 
@@ -1480,6 +1962,25 @@ int TableVal::Assign(Val* index, HashKey* k, Val* new_val, Opcode op)
 	delete k;
 	k = 0;
 
+	if ( old_entry_val )
+		UnaccountEntry(old_entry_val, k_copy.Size());
+
+	AccountEntry(new_entry_val, k_copy.Size());
+
+	if ( expire_index )
+		{
+		// A replaced entry is due no earlier than its predecessor,
+		// so it can take over its place in the index, which then
+		// moves it along later.
+		if ( old_entry_val )
+			new_entry_val->SetExpireBucket(old_entry_val->ExpireBucket());
+		else
+			new_entry_val->SetExpireBucket(
+				expire_index->Add(new HashKey(k_copy.Key(), k_copy.Size(),
+							      k_copy.Hash()),
+						  new_entry_val->ExpireAccessTime()));
+		}
+
 	if ( subnets )
 		{
 		if ( ! index )
@@ -1492,6 +1993,10 @@ int TableVal::Assign(Val* index, HashKey* k, Val* new_val, Opcode op)
 			subnets->Insert(index, new_entry_val);
 		}
 
+	// Only new patterns matter, not new values for existing ones.
+	if ( pattern_matcher && ! old_entry_val )
+		pattern_matcher->Clear();
+
 	if ( LoggingAccess() && op != OP_NONE )
 		{
 		Val* rec_index = 0;
@@ -1534,7 +2039,7 @@ int TableVal::Assign(Val* index, HashKey* k, Val* new_val, Opcode op)
 			// A set.
 			if ( old_entry_val && remote_check_sync_consistency )
 				{
-				Val* has_old_val = new Val(1, TYPE_INT);
+				Val* has_old_val = val_mgr->GetInt(1);
 				StateAccess::Log(
 					new StateAccess(OP_ADD, this, index,
 							has_old_val));
@@ -1557,7 +2062,7 @@ int TableVal::Assign(Val* index, HashKey* k, Val* new_val, Opcode op)
 	if ( old_entry_val )
 		{
 		old_entry_val->Unref();
-		delete old_entry_val;
+		TableEntryVal::Delete(old_entry_val);
 		}
 
 	Modified();
@@ -1810,27 +2315,20 @@ Val* TableVal::Lookup(Val* index, bool use_default_val)
 		return def;
 		}
 
-	const PDict(TableEntryVal)* tbl = AsTable();
-
-	if ( tbl->Length() > 0 )
+	if ( AsTable()->Length() > 0 )
 		{
-		HashKey* k = ComputeHash(index);
-		if ( k )
-			{
-			TableEntryVal* v = AsTable()->Lookup(k);
-			delete k;
+		TableEntryVal* v = LookupEntry(index);
 
-			if ( v )
+		if ( v )
+			{
+			if ( attrs && attrs->FindAttr(ATTR_EXPIRE_READ) )
 				{
-				if ( attrs && attrs->FindAttr(ATTR_EXPIRE_READ) )
-					{
-					v->SetExpireAccess(network_time);
-					if ( LoggingAccess() && ExpirationEnabled() )
-						ReadOperation(index, v);
-					}
-
-				return v->Value() ? v->Value() : this;
+				v->SetExpireAccess(network_time);
+				if ( LoggingAccess() && ExpirationEnabled() )
+					ReadOperation(index, v);
 				}
+
+			return v->Value() ? v->Value() : this;
 			}
 		}
 
@@ -1843,6 +2341,28 @@ Val* TableVal::Lookup(Val* index, bool use_default_val)
 	return def;
 	}
 
+TableEntryVal* TableVal::LookupEntry(const Val* index) const
+	{
+	CompositeHash::RawKeyBuffer buf;
+	const void* key;
+	int size;
+
+	if ( table_hash->ComputeRawKey(index, 1, &buf, key, size) )
+		{
+		HashKey k(key, size, HashKey::HashBytes(key, size), true);
+		return AsTable()->Lookup(&k);
+		}
+
+	HashKey* k = ComputeHash(index);
+	if ( ! k )
+		return 0;
+
+	TableEntryVal* v = AsTable()->Lookup(k);
+	delete k;
+
+	return v;
+	}
+
 VectorVal* TableVal::LookupSubnets(const SubNetVal* search)
 	{
 	if ( ! subnets )
@@ -1894,23 +2414,64 @@ TableVal* TableVal::LookupSubnetValues(const SubNetVal* search)
 	return nt;
 	}
 
-bool TableVal::UpdateTimestamp(Val* index)
+VectorVal* TableVal::LookupPattern(const StringVal* s, VectorType* t)
 	{
-	TableEntryVal* v;
+	if ( ! pattern_matcher || ! table_type->YieldType() )
+		reporter->InternalError("LookupPattern called on wrong table type");
 
-	if ( subnets )
-		v = (TableEntryVal*) subnets->Lookup(index);
-	else
-		{
-		HashKey* k = ComputeHash(index);
-		if ( ! k )
-			return false;
+	VectorVal* result = new VectorVal(t);
 
-		v = AsTable()->Lookup(k);
+	std::vector<ListVal*> matches;
+	pattern_matcher->Match(s->AsString(), &matches);
 
-		delete k;
+	for ( size_t i = 0; i < matches.size(); ++i )
+		{
+		// Goes through Lookup() for the sake of &read_expire.
+		Val* v = Lookup(matches[i], false);
+
+		if ( v )
+			result->Assign(result->Size(), v->Ref());
 		}
 
+	return result;
+	}
+
+TableVal* TableVal::LookupPatternIndices(const StringVal* s)
+	{
+	if ( ! pattern_matcher )
+		reporter->InternalError("LookupPatternIndices called on wrong table type");
+
+	TableVal* result = new TableVal(internal_type("pattern_set")->AsTableType());
+
+	std::vector<ListVal*> matches;
+	pattern_matcher->Match(s->AsString(), &matches);
+
+	for ( size_t i = 0; i < matches.size(); ++i )
+		result->Assign(matches[i], 0);
+
+	return result;
+	}
+
+bool TableVal::MatchesPattern(const StringVal* s)
+	{
+	if ( ! pattern_matcher )
+		reporter->InternalError("MatchesPattern called on wrong table type");
+
+	std::vector<ListVal*> matches;
+	pattern_matcher->Match(s->AsString(), &matches);
+
+	return matches.size() > 0;
+	}
+
+bool TableVal::UpdateTimestamp(Val* index)
+	{
+	TableEntryVal* v;
+
+	if ( subnets )
+		v = (TableEntryVal*) subnets->Lookup(index);
+	else
+		v = LookupEntry(index);
+
 	if ( ! v )
 		return false;
 
@@ -1926,15 +2487,26 @@ ListVal* TableVal::RecoverIndex(const HashKey* k) const
 	return table_hash->RecoverVals(k);
 	}
 
+void TableVal::RecoverIndex(const void* key, int size, Val** vals) const
+	{
+	table_hash->RecoverVals(key, size, vals);
+	}
+
 Val* TableVal::Delete(const Val* index)
 	{
 	HashKey* k = ComputeHash(index);
 	TableEntryVal* v = k ? AsNonConstTable()->RemoveEntry(k) : 0;
 	Val* va = v ? (v->Value() ? v->Value() : this->Ref()) : 0;
 
+	if ( v )
+		UnaccountEntry(v, k->Size());
+
 	if ( subnets && ! subnets->Remove(index) )
 		reporter->InternalWarning("index not in prefix table");
 
+	if ( pattern_matcher && v )
+		pattern_matcher->Clear();
+
 	if ( LoggingAccess() )
 		{
 		if ( v )
@@ -1947,7 +2519,7 @@ Val* TableVal::Delete(const Val* index)
 			else
 				{
 				// A set.
-				Val* has_old_val = new Val(1, TYPE_INT);
+				Val* has_old_val = val_mgr->GetInt(1);
 				StateAccess::Log(
 					new StateAccess(OP_DEL, this, index,
 							has_old_val));
@@ -1960,7 +2532,7 @@ Val* TableVal::Delete(const Val* index)
 		}
 
 	delete k;
-	delete v;
+	TableEntryVal::Delete(v);
 
 	Modified();
 	return va;
@@ -1971,6 +2543,9 @@ Val* TableVal::Delete(const HashKey* k)
 	TableEntryVal* v = AsNonConstTable()->RemoveEntry(k);
 	Val* va = v ? (v->Value() ? v->Value() : this->Ref()) : 0;
 
+	if ( v )
+		UnaccountEntry(v, k->Size());
+
 	if ( subnets )
 		{
 		Val* index = table_hash->RecoverVals(k);
@@ -1979,7 +2554,10 @@ Val* TableVal::Delete(const HashKey* k)
 		Unref(index);
 		}
 
-	delete v;
+	if ( pattern_matcher && v )
+		pattern_matcher->Clear();
+
+	TableEntryVal::Delete(v);
 
 	if ( LoggingAccess() )
 		StateAccess::Log(new StateAccess(OP_DEL, this, k));
@@ -2177,8 +2755,6 @@ void TableVal::DoExpire(double t)
 	if ( ! type )
 		return; // FIX ME ###
 
-	PDict(TableEntryVal)* tbl = AsNonConstTable();
-
 	double timeout = GetExpireTime();
 
 	if ( timeout < 0 )
@@ -2186,6 +2762,16 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
+	if ( table_expire_index )
+		DoExpireIndexed(t, timeout);
+	else
+		DoExpireScan(t, timeout);
+	}
+
+void TableVal::DoExpireScan(double t, double timeout)
+	{
+	PDict(TableEntryVal)* tbl = AsNonConstTable();
+
 	if ( ! expire_cookie )
 		{
 		expire_cookie = tbl->InitForIteration();
@@ -2208,64 +2794,147 @@ void TableVal::DoExpire(double t)
 			}
 
 		else if ( v->ExpireAccessTime() + timeout < t )
-			{
-			Val* val = v->Value();
+			ExpireEntry(k, v, timeout);
 
-			if ( expire_func )
-				{
-				Val* idx = RecoverIndex(k);
-				double secs = CallExpireFunc(idx);
+		delete k;
+		}
 
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v = tbl->Lookup(k);
+	if ( ! v )
+		{
+		expire_cookie = 0;
+		InitTimer(table_expire_interval);
+		}
+	else
+		InitTimer(table_expire_delay);
+	}
 
-				if ( ! v )
-					{ // user-provided function deleted it
-					delete k;
-					continue;
-					}
+void TableVal::DoExpireIndexed(double t, double timeout)
+	{
+	PDict(TableEntryVal)* tbl = AsNonConstTable();
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(network_time - timeout + secs);
-					delete k;
-					continue;
-					}
+	if ( expire_cookie )
+		{
+		// The option can't change, but a scan may have been underway
+		// when the table got its contents swapped.
+		tbl->StopIteration(expire_cookie);
+		expire_cookie = 0;
+		}
 
-				}
+	if ( ! expire_index )
+		{
+		// Registering each entry by its last access rather than by
+		// when it's due saves evaluating the timeout for each
+		// insertion; the first check then moves it along.
+		expire_index = new ExpireIndex(table_expire_interval);
 
-			if ( subnets )
-				{
-				Val* index = RecoverIndex(k);
-				if ( ! subnets->Remove(index) )
-					reporter->InternalWarning("index not in prefix table");
-				Unref(index);
-				}
+		IterCookie* c = tbl->InitForIteration();
+		HashKey* k;
+		TableEntryVal* v;
 
-			if ( LoggingAccess() )
-				StateAccess::Log(
-					new StateAccess(OP_EXPIRE, this, k));
+		while ( (v = tbl->NextEntry(k, c)) )
+			v->SetExpireBucket(expire_index->Add(k, v->ExpireAccessTime()));
+		}
+
+	HashKey* k;
+	int bucket;
 
-			tbl->RemoveEntry(k);
-			delete v;
-			Unref(val);
-			Modified();
+	for ( int i = 0; i < table_incremental_step &&
+			 (k = expire_index->NextDue(t, &bucket)); )
+		{
+		TableEntryVal* v = tbl->Lookup(k);
+
+		if ( ! v || v->ExpireBucket() != bucket )
+			{
+			// Removed or replaced since; the replacement
+			// has its own registration.
+			delete k;
+			continue;
+			}
+
+		++i;
+
+		if ( v->ExpireAccessTime() == 0 )
+			{
+			// See DoExpireScan(); check again next time.
+			v->SetExpireBucket(expire_index->Add(k, 0, t));
+			continue;
+			}
+
+		double due = v->ExpireAccessTime() + timeout;
+
+		if ( due >= t || (v = ExpireEntry(k, v, timeout)) )
+			{
+			// Accessed since it got registered, or kept by
+			// &expire_func.
+			due = v->ExpireAccessTime() + timeout;
+			v->SetExpireBucket(expire_index->Add(k, due, t));
+			continue;
 			}
 
 		delete k;
 		}
 
-	if ( ! v )
+	InitTimer(expire_index->HasDue(t) ?
+		  table_expire_delay : table_expire_interval);
+	}
+
+TableEntryVal* TableVal::ExpireEntry(HashKey* k, TableEntryVal* v,
+				     double timeout)
+	{
+	PDict(TableEntryVal)* tbl = AsNonConstTable();
+	Val* val = v->Value();
+
+	if ( expire_func )
 		{
-		expire_cookie = 0;
-		InitTimer(table_expire_interval);
+		Val* idx = RecoverIndex(k);
+		double secs = CallExpireFunc(idx);
+
+		// It's possible that the user-provided
+		// function modified or deleted the table
+		// value, so look it up again.
+		v = tbl->Lookup(k);
+
+		if ( ! v )
+			// user-provided function deleted it
+			return 0;
+
+		if ( secs > 0 )
+			{
+			// User doesn't want us to expire
+			// this now.
+			v->SetExpireAccess(network_time - timeout + secs);
+			return v;
+			}
 		}
-	else
-		InitTimer(table_expire_delay);
+
+	if ( subnets )
+		{
+		Val* index = RecoverIndex(k);
+		if ( ! subnets->Remove(index) )
+			reporter->InternalWarning("index not in prefix table");
+		Unref(index);
+		}
+
+	if ( pattern_matcher )
+		pattern_matcher->Clear();
+
+	if ( LoggingAccess() )
+		StateAccess::Log(
+			new StateAccess(OP_EXPIRE, this, k));
+
+	tbl->RemoveEntry(k);
+	UnaccountEntry(v, k->Size());
+	TableEntryVal::Delete(v);
+	Unref(val);
+	Modified();
+
+	return 0;
+	}
+
+void TableVal::InvalidateExpireIndex()
+	{
+	delete expire_index;
+	expire_index = 0;
 	}
 
 double TableVal::GetExpireTime()
@@ -2481,7 +3150,7 @@ bool TableVal::DoSerialize(SerialInfo* info) const
 			{
 			info->cont.SaveState(state);
 			info->cont.SaveContext();
-			bool result = state->v->val->Serialize(info);
+			bool result = state->v->Value()->Serialize(info);
 			info->cont.RestoreContext();
 
 			if ( ! result )
@@ -2493,7 +3162,7 @@ bool TableVal::DoSerialize(SerialInfo* info) const
 
 		double eat = state->v->ExpireAccessTime();
 
-		if ( ! (SERIALIZE(state->v->last_access_time) &&
+		if ( ! (SERIALIZE(state->v->LastAccessTime()) &&
 			SERIALIZE(eat)) )
 			return false;
 
@@ -2523,6 +3192,40 @@ bool TableVal::DoSerialize(SerialInfo* info) const
 	return true;
 	}
 
+Val* TableVal::DoClone(CloneState* state) const
+	{
+	TableVal* tv = new TableVal(table_type, attrs);
+	NewClone(state, this, tv);
+
+	const PDict(TableEntryVal)* tbl = AsTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	TableEntryVal* v;
+	while ( (v = tbl->NextEntry(k, c)) )
+		{
+		TableEntryVal* nv =
+			TableEntryVal::New(v->Value() ? v->Value()->Clone(state) : 0,
+					   v->HasTimes());
+		nv->SetLastAccess(v->LastAccessTime());
+		nv->SetExpireAccess(v->ExpireAccessTime());
+
+		tv->AsNonConstTable()->Insert(k, nv);
+		tv->AccountEntry(nv, k->Size());
+
+		if ( subnets )
+			{
+			ListVal* index = table_hash->RecoverVals(k);
+			tv->subnets->Insert(index, nv);
+			Unref(index);
+			}
+
+		delete k;
+		}
+
+	return tv;
+	}
+
 bool TableVal::DoUnserialize(UnserialInfo* info)
 	{
 	DO_UNSERIALIZE(MutableVal);
@@ -2560,25 +3263,30 @@ bool TableVal::DoUnserialize(UnserialInfo* info)
 		else
 			entry = 0;
 
-		TableEntryVal* entry_val = new TableEntryVal(entry);
+		TableEntryVal* entry_val =
+			TableEntryVal::New(entry, ExpirationEnabled());
 
-		double eat;
+		double lat, eat;
 
-		if ( ! UNSERIALIZE(&entry_val->last_access_time) ||
-		     ! UNSERIALIZE(&eat) )
+		if ( ! UNSERIALIZE(&lat) || ! UNSERIALIZE(&eat) )
 			{
 			entry_val->Unref();
-			delete entry_val;
+			TableEntryVal::Delete(entry_val);
 			return false;
 			}
 
+		entry_val->SetLastAccess(lat);
 		entry_val->SetExpireAccess(eat);
 
+		// The index doesn't know about the new entry.
+		InvalidateExpireIndex();
+
 		HashKey* key = ComputeHash(index);
 		TableEntryVal* old_entry_val =
 			AsNonConstTable()->Insert(key, entry_val);
 		assert(! old_entry_val);
 
+		AccountEntry(entry_val, key->Size());
 		delete key;
 
 		if ( subnets )
@@ -2652,59 +3360,89 @@ unsigned int TableVal::MemoryAllocation() const
 		{
 		if ( tv->Value() )
 			size += tv->Value()->MemoryAllocation();
-		size += padded_sizeof(TableEntryVal);
+		size += tv->MemoryAllocation();
 		}
 
+	if ( subnets )
+		size += subnets->MemoryAllocation();
+
+	if ( pattern_matcher )
+		size += pattern_matcher->MemoryAllocation();
+
+	if ( expire_index )
+		size += expire_index->MemoryAllocation();
+
 	return size + padded_sizeof(*this) + val.table_val->MemoryAllocation()
 		+ table_hash->MemoryAllocation();
 	}
 
-RecordVal::RecordVal(RecordType* t) : MutableVal(t)
+RecordVal::RecordVal(RecordType* t, bool init_fields) : MutableVal(t)
 	{
 	origin = 0;
 	record_type = t;
 	int n = record_type->NumFields();
 	val_list* vl = val.val_list_val = new val_list(n);
 
+	if ( ! init_fields )
+		{
+		for ( int i = 0; i < n; ++i )
+			vl->append(0);
+
+		RecountMemory();
+		return;
+		}
+
+	const std::vector<RecordType::FieldInit>& inits = record_type->FieldInits();
+
 	// Initialize to default values from RecordType (which are nil
 	// by default).
 	for ( int i = 0; i < n; ++i )
 		{
-		Attributes* a = record_type->FieldDecl(i)->attrs;
-		Attr* def_attr = a ? a->FindAttr(ATTR_DEFAULT) : 0;
-		Val* def = def_attr ? def_attr->AttrExpr()->Eval(0) : 0;
 		BroType* type = record_type->FieldDecl(i)->type;
+		Val* def = 0;
 
-		if ( def && type->Tag() == TYPE_RECORD &&
-		     def->Type()->Tag() == TYPE_RECORD &&
-		     ! same_type(def->Type(), type) )
-			{
-			Val* tmp = def->AsRecordVal()->CoerceTo(type->AsRecordType());
-			if ( tmp )
-				{
-				Unref(def);
-				def = tmp;
-				}
-			}
+		switch ( inits[i].kind ) {
+		case RecordType::FieldInit::UNSET:
+			break;
 
-		if ( ! def && ! (a && a->FindAttr(ATTR_OPTIONAL)) )
-			{
-			TypeTag tag = type->Tag();
+		case RecordType::FieldInit::CONSTANT:
+			def = inits[i].val->Ref();
+			break;
 
-			if ( tag == TYPE_RECORD )
-				def = new RecordVal(type->AsRecordType());
+		case RecordType::FieldInit::DEFAULT:
+			def = record_type->FieldDefault(i);
 
-			else if ( tag == TYPE_TABLE )
-				def = new TableVal(type->AsTableType(), a);
+			if ( def && type->Tag() == TYPE_RECORD &&
+			     def->Type()->Tag() == TYPE_RECORD &&
+			     ! same_type(def->Type(), type) )
+				{
+				Val* tmp = def->AsRecordVal()->CoerceTo(type->AsRecordType());
+				if ( tmp )
+					{
+					Unref(def);
+					def = tmp;
+					}
+				}
+			break;
 
-			else if ( tag == TYPE_VECTOR )
-				def = new VectorVal(type->AsVectorType());
-			}
+		case RecordType::FieldInit::NEW_RECORD:
+			def = new RecordVal(type->AsRecordType());
+			break;
 
-		vl->append(def ? def->Ref() : 0);
+		case RecordType::FieldInit::NEW_TABLE:
+			def = new TableVal(type->AsTableType(),
+					   record_type->FieldDecl(i)->attrs);
+			break;
+
+		case RecordType::FieldInit::NEW_VECTOR:
+			def = new VectorVal(type->AsVectorType());
+			break;
+		}
 
-		Unref(def);
+		vl->append(def);
 		}
+
+	RecountMemory();
 	}
 
 RecordVal::~RecordVal()
@@ -2736,6 +3474,7 @@ void RecordVal::Assign(int field, Val* new_val, Opcode op)
 		}
 
 	Val* old_val = AsNonConstRecord()->replace(field, new_val);
+	AdjustMemory(contained_memory(new_val) - contained_memory(old_val));
 
 	if ( LoggingAccess() && op != OP_NONE )
 		{
@@ -2791,11 +3530,12 @@ RecordVal* RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool allow_orphan
 	RecordType* ar_t = aggr->Type()->AsRecordType();
 
 	const RecordType* rv_t = Type()->AsRecordType();
+	const std::vector<int>& field_map = record_field_map(rv_t, ar_t);
 
 	int i;
 	for ( i = 0; i < rv_t->NumFields(); ++i )
 		{
-		int t_i = ar_t->FieldOffset(rv_t->FieldName(i));
+		int t_i = field_map[i];
 
 		if ( t_i < 0 )
 			{
@@ -2822,6 +3562,7 @@ RecordVal* RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool allow_orphan
 			Expr* rhs = new ConstExpr(v->Ref());
 			Expr* e = new RecordCoerceExpr(rhs, ar_t->FieldType(t_i)->AsRecordType());
 			ar->Assign(t_i, e->Eval(0));
+			Unref(e);
 			continue;
 			}
 
@@ -2945,6 +3686,22 @@ bool RecordVal::DoSerialize(SerialInfo* info) const
 	return true;
 	}
 
+Val* RecordVal::DoClone(CloneState* state) const
+	{
+	RecordVal* rv = new RecordVal(record_type, false);
+	NewClone(state, this, rv);
+
+	const val_list* vl = AsRecord();
+	loop_over_list(*vl, i)
+		{
+		Val* v = (*vl)[i];
+		rv->val.val_list_val->replace(i, v ? v->Clone(state) : 0);
+		}
+
+	rv->RecountMemory();
+	return rv;
+	}
+
 bool RecordVal::DoUnserialize(UnserialInfo* info)
 	{
 	DO_UNSERIALIZE(MutableVal);
@@ -2968,6 +3725,7 @@ bool RecordVal::DoUnserialize(UnserialInfo* info)
 		AsNonConstRecord()->append(v);	// correct for v==0, too.
 		}
 
+	RecountMemory();
 	return true;
 	}
 
@@ -3022,6 +3780,15 @@ unsigned int RecordVal::MemoryAllocation() const
 	return size + padded_sizeof(*this) + val.val_list_val->MemoryAllocation();
 	}
 
+void RecordVal::RecountMemory()
+	{
+	const val_list* vl = AsRecord();
+	approx_mem = padded_sizeof(*this) + vl->MemoryAllocation();
+
+	loop_over_list(*vl, i)
+		approx_mem += contained_memory((*vl)[i]);
+	}
+
 void EnumVal::ValDescribe(ODesc* d) const
 	{
 	const char* ename = type->AsEnumType()->Lookup(val.int_val);
@@ -3082,7 +3849,7 @@ bool VectorVal::Assign(unsigned int index, Val* element, Opcode op)
 			{
 			if ( LoggingAccess() && op != OP_NONE )
 				{
-				Val* ival = new Val(index, TYPE_COUNT);
+				Val* ival = val_mgr->GetCount(index);
 				StateAccess::Log(new StateAccess(OP_ASSIGN_IDX,
 						this, ival, element,
 						(*val.vector_val)[index]));
@@ -3100,14 +3867,14 @@ bool VectorVal::Assign(unsigned int index, Val* element, Opcode op)
 	if ( index < val.vector_val->size() )
 		val_at_index = (*val.vector_val)[index];
 	else
-		val.vector_val->resize(index + 1);
+		ResizeAtLeast(index + 1);
 
 	if ( LoggingAccess() && op != OP_NONE )
 		{
 		if ( element->IsMutableVal() )
 			element->AsMutableVal()->AddProperties(GetProperties());
 
-		Val* ival = new Val(index, TYPE_COUNT);
+		Val* ival = val_mgr->GetCount(index);
 
 		StateAccess::Log(new StateAccess(op == OP_INCR ?
 				OP_INCR_IDX : OP_ASSIGN_IDX,
@@ -3115,6 +3882,7 @@ bool VectorVal::Assign(unsigned int index, Val* element, Opcode op)
 		Unref(ival);
 		}
 
+	AdjustMemory(contained_memory(element) - contained_memory(val_at_index));
 	Unref(val_at_index);
 
 	// Note: we do *not* Ref() the element, if any, at this point.
@@ -3150,11 +3918,26 @@ Val* VectorVal::Lookup(unsigned int index) const
 unsigned int VectorVal::Resize(unsigned int new_num_elements)
 	{
 	unsigned int oldsize = val.vector_val->size();
-	val.vector_val->reserve(new_num_elements);
+
+	// Growing at least geometrically keeps appending element by
+	// element (v[|v|] = x) linear overall.
+	if ( new_num_elements > val.vector_val->capacity() )
+		Reserve(max(new_num_elements, 2 * oldsize));
+
+	for ( unsigned int i = new_num_elements; i < oldsize; ++i )
+		AdjustMemory(-contained_memory((*val.vector_val)[i]));
+
 	val.vector_val->resize(new_num_elements);
 	return oldsize;
 	}
 
+unsigned int VectorVal::Reserve(unsigned int num_elements)
+	{
+	unsigned int old_capacity = val.vector_val->capacity();
+	val.vector_val->reserve(num_elements);
+	return old_capacity;
+	}
+
 unsigned int VectorVal::ResizeAtLeast(unsigned int new_num_elements)
 	 {
 	 unsigned int old_size = val.vector_val->size();
@@ -3218,6 +4001,44 @@ bool VectorVal::DoSerialize(SerialInfo* info) const
 	return true;
 	}
 
+Val* VectorVal::DoClone(CloneState* state) const
+	{
+	VectorVal* vv = new VectorVal(vector_type);
+	vv->val.vector_val->reserve(val.vector_val->size());
+	NewClone(state, this, vv);
+
+	for ( unsigned int i = 0; i < val.vector_val->size(); ++i )
+		{
+		Val* v = (*val.vector_val)[i];
+		vv->AppendNew(v ? v->Clone(state) : 0);
+		}
+
+	return vv;
+	}
+
+unsigned int VectorVal::MemoryAllocation() const
+	{
+	unsigned int size = 0;
+
+	for ( unsigned int i = 0; i < val.vector_val->size(); ++i )
+		{
+		Val* v = (*val.vector_val)[i];
+		if ( v )
+			size += v->MemoryAllocation();
+		}
+
+	return size + padded_sizeof(*this) + padded_sizeof(*val.vector_val) +
+		pad_size(val.vector_val->capacity() * sizeof(Val*));
+	}
+
+unsigned int VectorVal::ApproxMemory() const
+	{
+	// The elements are kept count of, the slots are cheap to add.
+	return MutableVal::ApproxMemory() + padded_sizeof(*this) +
+		padded_sizeof(*val.vector_val) +
+		pad_size(val.vector_val->capacity() * sizeof(Val*));
+	}
+
 bool VectorVal::DoUnserialize(UnserialInfo* info)
 	{
 	DO_UNSERIALIZE(MutableVal);
@@ -3266,6 +4087,11 @@ OpaqueVal::~OpaqueVal()
 	{
 	}
 
+Val* OpaqueVal::DoClone(CloneState* state) const
+	{
+	return NewClone(state, this, SerialClone());
+	}
+
 IMPLEMENT_SERIAL(OpaqueVal, SER_OPAQUE_VAL);
 
 bool OpaqueVal::DoSerialize(SerialInfo* info) const
@@ -3432,3 +4258,186 @@ void delete_vals(val_list* vals)
 		delete vals;
 		}
 	}
+
+ValManager* val_mgr = 0;
+
+static double interned_strings()
+	{
+	ValManager::InternStats s;
+	val_mgr->GetInternStats(&s);
+	return s.size;
+	}
+
+static double intern_hits()
+	{
+	ValManager::InternStats s;
+	val_mgr->GetInternStats(&s);
+	return s.hits;
+	}
+
+static double intern_misses()
+	{
+	ValManager::InternStats s;
+	val_mgr->GetInternStats(&s);
+	return s.misses;
+	}
+
+ValManager::ValManager()
+	{
+	// All of these are shared by everybody until termination, so
+	// they're immortal.
+	b_true = new Val(true, TYPE_BOOL);
+	b_true->MakeImmortal();
+	b_false = new Val(false, TYPE_BOOL);
+	b_false->MakeImmortal();
+
+	int num_ints = PREALLOCATED_INT_HIGHEST - PREALLOCATED_INT_LOWEST + 1;
+	ints = new Val*[num_ints];
+
+	for ( int i = 0; i < num_ints; ++i )
+		{
+		ints[i] = new Val(PREALLOCATED_INT_LOWEST + i, TYPE_INT);
+		ints[i]->MakeImmortal();
+		}
+
+	counts = new Val*[PREALLOCATED_COUNTS];
+
+	for ( bro_uint_t i = 0; i < PREALLOCATED_COUNTS; ++i )
+		{
+		counts[i] = new Val(i, TYPE_COUNT);
+		counts[i]->MakeImmortal();
+		}
+
+	empty_string = new StringVal("");
+	empty_string->MakeImmortal();
+
+	ports = new PortVal*[65536 * NUM_PORT_SPACES]();
+
+	intern_hits = intern_misses = 0;
+
+	metrics::registry()->NewCallbackGauge("values.interned_strings",
+					      "Strings in the intern pool.",
+					      interned_strings);
+	metrics::registry()->NewCallbackCounter("values.intern_hits",
+						"Interned string lookups that found one.",
+						::intern_hits);
+	metrics::registry()->NewCallbackCounter("values.intern_misses",
+						"Interned string lookups that created one.",
+						::intern_misses);
+	}
+
+ValManager::~ValManager()
+	{
+	// Unref() doesn't delete immortal values.
+	delete b_true;
+	delete b_false;
+
+	int num_ints = PREALLOCATED_INT_HIGHEST - PREALLOCATED_INT_LOWEST + 1;
+
+	for ( int i = 0; i < num_ints; ++i )
+		delete ints[i];
+
+	for ( bro_uint_t i = 0; i < PREALLOCATED_COUNTS; ++i )
+		delete counts[i];
+
+	for ( int i = 0; i < 65536 * NUM_PORT_SPACES; ++i )
+		delete ports[i];
+
+	delete empty_string;
+
+	for ( std::unordered_map<std::string, StringVal*>::iterator i =
+		interned.begin(); i != interned.end(); ++i )
+		delete i->second;
+
+	delete [] ints;
+	delete [] counts;
+	delete [] ports;
+	}
+
+StringVal* ValManager::GetEmptyString() const
+	{
+	::Ref(empty_string);
+	return empty_string;
+	}
+
+StringVal* ValManager::GetInternedString(int len, const char* s,
+					 bool to_upper)
+	{
+	if ( len > MAX_INTERNED_LEN )
+		{
+		++intern_misses;
+		StringVal* sv = new StringVal(len, s);
+		return to_upper ? sv->ToUpper() : sv;
+		}
+
+	std::string key(s, len);
+
+	if ( to_upper )
+		for ( size_t i = 0; i < key.size(); ++i )
+			if ( islower((unsigned char) key[i]) )
+				key[i] = toupper((unsigned char) key[i]);
+
+	std::unordered_map<std::string, StringVal*>::iterator i =
+		interned.find(key);
+
+	if ( i != interned.end() )
+		{
+		++intern_hits;
+		::Ref(i->second);
+		return i->second;
+		}
+
+	++intern_misses;
+
+	StringVal* sv = new StringVal(key.size(), key.data());
+
+	if ( interned.size() >= MAX_INTERNED_STRINGS )
+		return sv;
+
+	sv->MakeImmortal();
+	interned[key] = sv;
+
+	return sv;
+	}
+
+PortVal* ValManager::GetPort(uint32 port_num, TransportProto port_type)
+	{
+	if ( port_num >= 65536 )
+		// Let the constructor complain.
+		return new PortVal(port_num, port_type);
+
+	switch ( port_type ) {
+	case TRANSPORT_TCP:
+		port_num |= TCP_PORT_MASK;
+		break;
+
+	case TRANSPORT_UDP:
+		port_num |= UDP_PORT_MASK;
+		break;
+
+	case TRANSPORT_ICMP:
+		port_num |= ICMP_PORT_MASK;
+		break;
+
+	default:
+		break;	// "other"
+	}
+
+	return GetPort(port_num);
+	}
+
+PortVal* ValManager::GetPort(uint32 port_num)
+	{
+	if ( port_num >= 65536 * NUM_PORT_SPACES )
+		return new PortVal(port_num);
+
+	PortVal*& p = ports[port_num];
+
+	if ( ! p )
+		{
+		p = new PortVal(port_num);
+		p->MakeImmortal();
+		}
+
+	return p;
+	}
@@ -7,6 +7,9 @@
 
 #include <vector>
 #include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
 
 #include "net_util.h"
 #include "Type.h"
@@ -25,6 +28,7 @@ class Func;
 class BroFile;
 class RE_Matcher;
 class PrefixTable;
+class TablePatternMatcher;
 class SerialInfo;
 
 class PortVal;
@@ -74,12 +78,16 @@ typedef union {
 
 } BroValUnion;
 
+// Number of values created so far, for profiling.
+extern uint64 num_vals_created;
+
 class Val : public BroObj {
 public:
 	Val(bool b, TypeTag t)
 		{
 		val.int_val = b;
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -89,6 +97,7 @@ public:
 		{
 		val.int_val = bro_int_t(i);
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -98,6 +107,7 @@ public:
 		{
 		val.uint_val = bro_uint_t(u);
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -107,6 +117,7 @@ public:
 		{
 		val.int_val = i;
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -116,6 +127,7 @@ public:
 		{
 		val.uint_val = u;
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -125,6 +137,7 @@ public:
 		{
 		val.double_val = d;
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -139,6 +152,7 @@ public:
 	Val(BroType* t, bool type_type) // Extra arg to differentiate from protected version.
 		{
 		type = new TypeType(t->Ref());
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -148,6 +162,7 @@ public:
 		{
 		val.int_val = 0;
 		type = base_type(TYPE_ERROR);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -156,7 +171,23 @@ public:
 	virtual ~Val();
 
 	Val* Ref()			{ ::Ref(this); return this; }
-	virtual Val* Clone() const;
+
+	// Returns a deep copy of the value, or 0 if it can't be copied.
+	// Values that it references more than once are copied just once,
+	// so the copy shares them the same way.  Immutable values are
+	// shared with the original rather than copied.
+	Val* Clone() const;
+
+	// Maps the values copied so far within one Clone() to their copies.
+	typedef std::map<const Val*, Val*> CloneState;
+
+	// For use by DoClone(): copies the value as part of the Clone()
+	// tracked by state.
+	Val* Clone(CloneState* state) const;
+
+	// Copies the value by serializing and unserializing it.  Clone()
+	// falls back to this for types that have no more direct way.
+	Val* SerialClone() const;
 
 	int IsZero() const;
 	int IsOne() const;
@@ -176,6 +207,12 @@ public:
 	// Bytes in total value object.
 	virtual unsigned int MemoryAllocation() const;
 
+	// An estimate of MemoryAllocation() that's cheap to get: containers
+	// keep theirs up to date as they change, rather than adding up
+	// their elements each time. A nested container counts with the
+	// size it had when it got put in.
+	virtual unsigned int ApproxMemory() const	{ return MemoryAllocation(); }
+
 	// Add this value to the given value (if appropriate).
 	// Returns true if succcessful.  is_first_init is true only if
 	// this is the *first* initialization of the value, not
@@ -211,7 +248,18 @@ public:
 	CONST_ACCESSOR2(TYPE_TIME, double, double_val, AsTime)
 	CONST_ACCESSOR2(TYPE_INTERVAL, double, double_val, AsInterval)
 	CONST_ACCESSOR2(TYPE_ENUM, int, int_val, AsEnum)
-	CONST_ACCESSOR(TYPE_STRING, BroString*, string_val, AsString)
+	// Strings that concatenations produced get their bytes put
+	// together only here, once needed; see StringVal::Concat().
+	BroString* AsString() const
+		{
+		CHECK_TAG(type->Tag(), TYPE_STRING, "Val::CONST_ACCESSOR", type_name)
+
+		if ( ! val.string_val )
+			FlattenString();
+
+		return val.string_val;
+		}
+
 	CONST_ACCESSOR(TYPE_FUNC, Func*, func_val, AsFunc)
 	CONST_ACCESSOR(TYPE_TABLE, PDict(TableEntryVal)*, table_val, AsTable)
 	CONST_ACCESSOR(TYPE_RECORD, val_list*, val_list_val, AsRecord)
@@ -356,6 +404,7 @@ protected:
 		{
 		val.string_val = s;
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -364,9 +413,13 @@ protected:
 	virtual void ValDescribe(ODesc* d) const;
 	virtual void ValDescribeReST(ODesc* d) const;
 
+	// Gives a StringVal still pending concatenation its BroString.
+	void FlattenString() const;
+
 	Val(TypeTag t)
 		{
 		type = base_type(t);
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -375,6 +428,7 @@ protected:
 	Val(BroType* t)
 		{
 		type = t->Ref();
+		++num_vals_created;
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -383,6 +437,14 @@ protected:
 	ACCESSOR(TYPE_TABLE, PDict(TableEntryVal)*, table_val, AsNonConstTable)
 	ACCESSOR(TYPE_RECORD, val_list*, val_list_val, AsNonConstRecord)
 
+	// Makes the copy for Clone().  Derived classes holding other
+	// values copy them with Clone(state), after recording their own
+	// copy with NewClone() so that references back to it resolve.
+	virtual Val* DoClone(CloneState* state) const;
+
+	// Records that dst is the copy of src, and returns dst.
+	static Val* NewClone(CloneState* state, const Val* src, Val* dst);
+
 	// Just an internal helper.
 	static Val* Unserialize(UnserialInfo* info, TypeTag type,
 			const BroType* exact_type);
@@ -451,12 +513,33 @@ public:
 		last_modified = IncreaseTimeCounter();
 		}
 
+	unsigned int ApproxMemory() const override
+		{ return approx_mem > 0 ? approx_mem : 0; }
+
+	// With track_container_origins, the script location that created
+	// the value; null otherwise, or if created outside of a script.
+	const Location* CreationSite() const;
+
+	// With track_container_origins, calls the function for each
+	// container alive that knows the location creating it.
+	static void ForEachCreationSite(void (*f)(const MutableVal* v,
+						  const Location* loc,
+						  void* cookie),
+					void* cookie);
+
 protected:
 	MutableVal(BroType* t) : Val(t)
-		{ props = 0; id = 0; last_modified = SerialObj::ALWAYS; }
-	MutableVal()	{ props = 0; id = 0; last_modified = SerialObj::ALWAYS; }
+		{ InitMutableVal(); }
+	MutableVal()	{ InitMutableVal(); }
 	~MutableVal();
 
+	void InitMutableVal();
+
+	// Containers call this as their content changes, keeping
+	// ApproxMemory() current. The estimate may drift below the real
+	// one when nested containers change, so it can go negative.
+	void AdjustMemory(int64 delta)	{ approx_mem += delta; }
+
 	friend class ID;
 	friend class Val;
 
@@ -471,6 +554,9 @@ private:
 	list<ID*> aliases;
 	Properties props;
 	uint64 last_modified;
+
+protected:
+	int64 approx_mem;
 };
 
 #define Microseconds 1e-6
@@ -509,7 +595,7 @@ public:
 	PortVal(uint32 p, TransportProto port_type);
 	PortVal(uint32 p);	// used for already-massaged port value.
 
-	Val* SizeVal() const override	{ return new Val(val.uint_val, TYPE_INT); }
+	Val* SizeVal() const override;
 
 	// Returns the port number in host order (not including the mask).
 	uint32 Port() const;
@@ -592,17 +678,28 @@ protected:
 	DECLARE_SERIAL(SubNetVal);
 };
 
+class StringBuffer;
+
 class StringVal : public Val {
 public:
 	StringVal(BroString* s);
 	StringVal(const char* s);
 	StringVal(const string& s);
 	StringVal(int length, const char* s);
+	~StringVal() override;
 
-	Val* SizeVal() const override
-		{ return new Val(val.string_val->Len(), TYPE_COUNT); }
+	// Returns a new string of a's bytes followed by b's. For longer
+	// ones, these don't get copied right away: the result goes into a
+	// buffer shared with a (if a came out of a concatenation as well,
+	// and nothing has been appended to it since), which then grows
+	// geometrically, so that a chain of concatenations like s = s + x
+	// takes linear time overall. The result's bytes become a BroString
+	// of their own only when they get read.
+	static StringVal* Concat(StringVal* a, StringVal* b);
 
-	int Len()		{ return AsString()->Len(); }
+	Val* SizeVal() const override;
+
+	int Len()		{ return buffer ? buffer_len : AsString()->Len(); }
 	const u_char* Bytes()	{ return AsString()->Bytes(); }
 	const char* CheckString() { return AsString()->CheckString(); }
 
@@ -617,7 +714,17 @@ public:
 
 protected:
 	friend class Val;
-	StringVal()	{}
+	StringVal()	{ buffer = 0; buffer_len = 0; }
+
+	StringVal(StringBuffer* buffer, int len);
+
+	// Concatenations that are shorter than this are copied right away.
+	static const int MIN_BUFFERED_LEN = 128;
+
+	// If still pending, the buffer holding the string's bytes (as many
+	// as buffer_len of its first ones); otherwise nil.
+	StringBuffer* buffer;
+	int buffer_len;
 
 	void ValDescribe(ODesc* d) const override;
 
@@ -685,6 +792,8 @@ protected:
 	friend class Val;
 	ListVal()	{}
 
+	Val* DoClone(CloneState* state) const override;
+
 	DECLARE_SERIAL(ListVal);
 
 	val_list vals;
@@ -693,47 +802,114 @@ protected:
 
 extern double bro_start_network_time;
 
+// The access times that the entries of tables with expiration keep.
+struct TableEntryTimes {
+	double last_access_time;
+
+	// The next two entries store seconds since Bro's start.  We use
+	// ints here to save a few bytes, as we do not need a high resolution
+	// for these anyway.
+	int expire_access_time;
+	int last_read_update;
+
+	// With the table's ExpireIndex, the bucket of the entry's current
+	// registration there.
+	int expire_bucket;
+};
+
+// An entry of a TableVal. Only tables with expiration attributes need the
+// access times that drive it, so all others get a compact base entry that
+// holds just the value (null for sets); the times come with TimedEntry.
+// As there are no virtual methods, entries get created and deleted through
+// New() and Delete(), which know which one they're dealing with.
 class TableEntryVal {
 public:
-	TableEntryVal(Val* v)
-		{
-		val = v;
-		last_access_time = network_time;
-		expire_access_time = last_read_update =
-			int(network_time - bro_start_network_time);
-		}
-	~TableEntryVal()	{ }
+	static TableEntryVal* New(Val* v, bool with_times);
+	static void Delete(TableEntryVal* e);
 
 	Val* Value()	{ return val; }
 	void Ref()	{ val->Ref(); }
 	void Unref()	{ ::Unref(val); }
 
+	// True if the entry keeps the access times below. Without them,
+	// they all read as zero, and setting them does nothing.
+	bool HasTimes() const	{ return has_times; }
+
+	// Returns/sets the time of the last access of any kind.
+	double LastAccessTime() const
+		{ return has_times ? Times()->last_access_time : 0; }
+	void SetLastAccess(double time)
+		{ if ( has_times ) Times()->last_access_time = time; }
+
 	// Returns/sets time of last expiration relevant access to this value.
 	double ExpireAccessTime() const
-		{ return bro_start_network_time + expire_access_time; }
+		{
+		return has_times ?
+			bro_start_network_time + Times()->expire_access_time : 0;
+		}
 	void SetExpireAccess(double time)
-		{ expire_access_time = int(time - bro_start_network_time); }
+		{
+		if ( has_times )
+			Times()->expire_access_time =
+				int(time - bro_start_network_time);
+		}
 
 	// Returns/sets time of when we propagated the last OP_READ_IDX
 	// for this item.
 	double LastReadUpdate() const
-		{ return bro_start_network_time + last_read_update; }
+		{
+		return has_times ?
+			bro_start_network_time + Times()->last_read_update : 0;
+		}
 	void SetLastReadUpdate(double time)
-		{ last_read_update = int(time - bro_start_network_time); }
+		{
+		if ( has_times )
+			Times()->last_read_update =
+				int(time - bro_start_network_time);
+		}
+
+	// With the table's ExpireIndex, the bucket of the entry's current
+	// registration there.
+	int ExpireBucket() const
+		{ return has_times ? Times()->expire_bucket : 0; }
+	void SetExpireBucket(int bucket)
+		{ if ( has_times ) Times()->expire_bucket = bucket; }
+
+	// The number of bytes that an entry takes up.
+	unsigned int MemoryAllocation() const;
+
+	// The bytes that the table counted for the entry in its
+	// ApproxMemory(), key and value included.
+	unsigned int Accounted() const	{ return accounted; }
+	void SetAccounted(unsigned int bytes)	{ accounted = bytes; }
 
 protected:
-	friend class TableVal;
+	struct TimedEntry;
+
+	TableEntryVal(Val* v, bool arg_has_times)
+		{ val = v; has_times = arg_has_times; accounted = 0; }
+	~TableEntryVal()	{ }
+
+	inline TableEntryTimes* Times();
+	inline const TableEntryTimes* Times() const;
 
 	Val* val;
-	double last_access_time;
+	bool has_times;
+	unsigned int accounted;	// fits into the padding after has_times
+};
 
-	// The next two entries store seconds since Bro's start.  We use
-	// ints here to save a few bytes, as we do not need a high resolution
-	// for these anyway.
-	int expire_access_time;
-	int last_read_update;
+struct TableEntryVal::TimedEntry : public TableEntryVal {
+	TimedEntry(Val* v);
+
+	TableEntryTimes times;
 };
 
+inline TableEntryTimes* TableEntryVal::Times()
+	{ return &static_cast<TimedEntry*>(this)->times; }
+
+inline const TableEntryTimes* TableEntryVal::Times() const
+	{ return &static_cast<const TimedEntry*>(this)->times; }
+
 class TableValTimer : public Timer {
 public:
 	TableValTimer(TableVal* val, double t);
@@ -748,6 +924,7 @@ protected:
 };
 
 class CompositeHash;
+class ExpireIndex;
 class TableVal : public MutableVal {
 public:
 	TableVal(TableType* t, Attributes* attrs = 0);
@@ -776,6 +953,10 @@ public:
 	// Remove the entire contents.
 	void RemoveAll();
 
+	// Exchanges the entire contents with those of another table of the
+	// same type, but keeps the attributes of both.
+	void SwapContents(TableVal* other);
+
 	// Remove the entire contents of the table from the given value.
 	// which must also be a TableVal.
 	// Returns true if the addition typechecked, false if not.
@@ -800,6 +981,23 @@ public:
 	// Causes an internal error if called for any other kind of table.
 	TableVal* LookupSubnetValues(const SubNetVal* s);
 
+	// For a table[pattern], returns a vector of type t holding the
+	// values of all entries whose pattern matches somewhere in s. All
+	// patterns get compiled into one DFA, so this takes a single pass
+	// over s; changes to the set of patterns make it get rebuilt on the
+	// next lookup.
+	// Causes an internal error if called for any other kind of table.
+	VectorVal* LookupPattern(const StringVal* s, VectorType* t);
+
+	// For a set[pattern]/table[pattern], returns a new set of all
+	// patterns matching somewhere in s, found the same way.
+	// Causes an internal error if called for any other kind of table.
+	TableVal* LookupPatternIndices(const StringVal* s);
+
+	// For a set[pattern]/table[pattern], returns true if any of the
+	// patterns matches somewhere in s.
+	bool MatchesPattern(const StringVal* s);
+
 	// Sets the timestamp for the given index to network time.
 	// Returns false if index does not exist.
 	bool UpdateTimestamp(Val* index);
@@ -807,6 +1005,10 @@ public:
 	// Returns the index corresponding to the given HashKey.
 	ListVal* RecoverIndex(const HashKey* k) const;
 
+	// Same, for the bytes of a key, without a ListVal: stores the
+	// index's values into vals, passing their references to the caller.
+	void RecoverIndex(const void* key, int size, Val** vals) const;
+
 	// Returns the element if it was in the table, false otherwise.
 	Val* Delete(const Val* index);
 	Val* Delete(const HashKey* k);
@@ -836,6 +1038,10 @@ public:
 
 	unsigned int MemoryAllocation() const override;
 
+	// Bytes that the keys of the entries take up, kept current like
+	// ApproxMemory().
+	uint64 KeyMemory() const	{ return key_mem; }
+
 	void ClearTimer(Timer* t)
 		{
 		if ( timer == t )
@@ -853,6 +1059,10 @@ protected:
 	void Init(TableType* t);
 
 	void CheckExpireAttr(attr_tag at);
+
+	// Gives the compact entries that the table has gathered while
+	// without expiration the access times it now needs.
+	void AddEntryTimes();
 	int ExpandCompoundAndInit(val_list* vl, int k, Val* new_val);
 	int CheckAndAssign(Val* index, Val* new_val, Opcode op = OP_ASSIGN);
 
@@ -862,6 +1072,10 @@ protected:
 	// Calculates default value for index.  Returns 0 if none.
 	Val* Default(Val* index);
 
+	// Returns the entry for the given index from the hash table, or 0
+	// if there's none.  Doesn't allocate a key unless the index is large.
+	TableEntryVal* LookupEntry(const Val* index) const;
+
 	// Returns true if item expiration is enabled.
 	bool ExpirationEnabled()	{ return expire_time != 0; }
 
@@ -874,9 +1088,32 @@ protected:
 	// takes ownership of the reference.
 	double CallExpireFunc(Val *idx);
 
+	// Expires an entry that's due, unless &expire_func says otherwise.
+	// Returns the entry if it's still there afterwards, else nil.
+	TableEntryVal* ExpireEntry(HashKey* k, TableEntryVal* v,
+				   double timeout);
+
+	// The two ways of finding the entries due: walking the whole table
+	// a chunk at a time, or, with table_expire_index, asking the index.
+	void DoExpireScan(double t, double timeout);
+	void DoExpireIndexed(double t, double timeout);
+
+	// Drops the expiration index after the table's contents changed
+	// outside of Assign(), so that the next round builds it anew.
+	void InvalidateExpireIndex();
+
 	// Propagates a read operation if necessary.
 	void ReadOperation(Val* index, TableEntryVal *v);
 
+	// Count an entry going into/out of the table for ApproxMemory().
+	void AccountEntry(TableEntryVal* e, int key_size);
+	void UnaccountEntry(const TableEntryVal* e, int key_size);
+
+	// Sets ApproxMemory() for the table when it's empty.
+	void ResetMemory();
+
+	Val* DoClone(CloneState* state) const override;
+
 	DECLARE_SERIAL(TableVal);
 
 	TableType* table_type;
@@ -886,13 +1123,18 @@ protected:
 	Expr* expire_func;
 	TableValTimer* timer;
 	IterCookie* expire_cookie;
+	ExpireIndex* expire_index;
 	PrefixTable* subnets;
+	TablePatternMatcher* pattern_matcher;
 	Val* def_val;
+	uint64 key_mem;
 };
 
 class RecordVal : public MutableVal {
 public:
-	RecordVal(RecordType* t);
+	// If init_fields is false, all fields start out unset rather than
+	// with their defaults.
+	RecordVal(RecordType* t, bool init_fields = true);
 	~RecordVal();
 
 	Val* SizeVal() const override
@@ -944,6 +1186,11 @@ protected:
 	bool AddProperties(Properties arg_state) override;
 	bool RemoveProperties(Properties arg_state) override;
 
+	// Sets ApproxMemory() from the fields.
+	void RecountMemory();
+
+	Val* DoClone(CloneState* state) const override;
+
 	DECLARE_SERIAL(RecordVal);
 
 	RecordType* record_type;
@@ -1016,6 +1263,27 @@ public:
 	// Won't shrink size.
 	unsigned int ResizeAtLeast(unsigned int new_num_elements);
 
+	// Makes room for at least the given number of elements without
+	// changing the size, so that appending up to there doesn't need
+	// to reallocate. The return value is the old capacity.
+	unsigned int Reserve(unsigned int num_elements);
+
+	unsigned int Capacity() const { return val.vector_val->capacity(); }
+
+	// Appends an element, or a hole for nil, for filling a new vector in
+	// bulk. It must have the yield type; unlike Assign(), this doesn't
+	// check or log anything. Takes ownership.
+	void AppendNew(Val* element)
+		{
+		val.vector_val->push_back(element);
+
+		if ( element )
+			AdjustMemory(element->ApproxMemory());
+		}
+
+	unsigned int MemoryAllocation() const override;
+	unsigned int ApproxMemory() const override;
+
 protected:
 	friend class Val;
 	VectorVal()	{ }
@@ -1024,6 +1292,8 @@ protected:
 	bool RemoveProperties(Properties arg_state) override;
 	void ValDescribe(ODesc* d) const override;
 
+	Val* DoClone(CloneState* state) const override;
+
 	DECLARE_SERIAL(VectorVal);
 
 	VectorType* vector_type;
@@ -1041,6 +1311,8 @@ protected:
 	friend class Val;
 	OpaqueVal() { }
 
+	Val* DoClone(CloneState* state) const override;
+
 	DECLARE_SERIAL(OpaqueVal);
 };
 
@@ -1066,4 +1338,85 @@ extern void delete_vals(val_list* vals);
 // True if the given Val* has a vector type.
 inline bool is_vector(Val* v)	{ return  v->Type()->Tag() == TYPE_VECTOR; }
 
+// Hands out shared instances of frequently used atomic values, so that
+// we don't need to allocate a new one each time. Such values never change
+// once created, so it's safe to share them. All methods return a new
+// reference that the caller needs to Unref() as usual.
+class ValManager {
+public:
+	// Range of integers and counts that we keep instances for.
+	static const bro_int_t PREALLOCATED_INT_LOWEST = -255;
+	static const bro_int_t PREALLOCATED_INT_HIGHEST = 256;
+	static const bro_uint_t PREALLOCATED_COUNTS = 4096;
+
+	ValManager();
+	~ValManager();
+
+	Val* GetTrue() const	{ return b_true->Ref(); }
+	Val* GetFalse() const	{ return b_false->Ref(); }
+	Val* GetBool(bool b) const	{ return b ? GetTrue() : GetFalse(); }
+
+	Val* GetInt(int64 i) const
+		{
+		if ( i < PREALLOCATED_INT_LOWEST || i > PREALLOCATED_INT_HIGHEST )
+			return new Val(i, TYPE_INT);
+
+		return ints[i - PREALLOCATED_INT_LOWEST]->Ref();
+		}
+
+	Val* GetCount(uint64 u) const
+		{
+		if ( u >= PREALLOCATED_COUNTS )
+			return new Val(u, TYPE_COUNT);
+
+		return counts[u]->Ref();
+		}
+
+	StringVal* GetEmptyString() const;
+
+	// Most strings that GetInternedString() keeps, and the longest.
+	static const size_t MAX_INTERNED_STRINGS = 4096;
+	static const int MAX_INTERNED_LEN = 64;
+
+	// Returns a shared StringVal for a string from a small vocabulary
+	// that analyzers see over and over, such as HTTP methods and header
+	// names, optionally converted to upper case first. The value must
+	// not be modified. Once the pool is full, or for longer strings,
+	// this returns new values.
+	StringVal* GetInternedString(int len, const char* s,
+				     bool to_upper = false);
+
+	struct InternStats {
+		uint64 size;	// strings in the pool
+		uint64 hits;	// lookups that found one there
+		uint64 misses;	// those that didn't
+	};
+
+	void GetInternStats(InternStats* stats) const
+		{
+		stats->size = interned.size();
+		stats->hits = intern_hits;
+		stats->misses = intern_misses;
+		}
+
+	// Same as the corresponding PortVal constructors. Ports get
+	// instantiated on first use.
+	PortVal* GetPort(uint32 port_num, TransportProto port_type);
+	PortVal* GetPort(uint32 port_num);
+
+private:
+	Val* b_true;
+	Val* b_false;
+	Val** ints;
+	Val** counts;
+	StringVal* empty_string;
+	PortVal** ports;	// indexed by masked port number
+
+	std::unordered_map<std::string, StringVal*> interned;
+	uint64 intern_hits;
+	uint64 intern_misses;
+};
+
+extern ValManager* val_mgr;
+
 #endif
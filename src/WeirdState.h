@@ -0,0 +1,22 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef weirdstate_h
+#define weirdstate_h
+
+#include <string>
+#include <unordered_map>
+
+#include "util.h"
+
+// How often a weird has occurred for whatever it's tracked by, within
+// the current sampling window.
+struct WeirdState {
+	WeirdState()	{ count = 0; sampling_start_time = 0; }
+
+	uint64 count;
+	double sampling_start_time;
+};
+
+typedef std::unordered_map<std::string, WeirdState> WeirdStateMap;
+
+#endif
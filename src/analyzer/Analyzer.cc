@@ -8,6 +8,8 @@
 
 #include "analyzer/protocol/pia/PIA.h"
 #include "../Event.h"
+#include "../Metrics.h"
+#include "../NetVar.h"
 
 namespace analyzer {
 
@@ -73,6 +75,15 @@ void AnalyzerTimer::Init(Analyzer* arg_analyzer, analyzer_timer_func arg_timer,
 
 analyzer::ID Analyzer::id_counter = 0;
 
+AnalyzerProfileScope* AnalyzerProfileScope::current = 0;
+
+// Returns the profile to charge a delivery to, or null if we aren't
+// profiling.
+static inline AnalyzerProfile* profile_for(const analyzer::Tag& tag)
+	{
+	return analyzer_profiling ? analyzer_mgr->Profile(tag) : 0;
+	}
+
 const char* Analyzer::GetAnalyzerName() const
 	{
 	assert(tag);
@@ -82,6 +93,10 @@ const char* Analyzer::GetAnalyzerName() const
 void Analyzer::SetAnalyzerTag(const Tag& arg_tag)
 	{
 	assert(! tag || tag == arg_tag);
+
+	if ( ! tag && arg_tag )
+		analyzer_mgr->CountInstance(arg_tag, true);
+
 	tag = arg_tag;
 	}
 
@@ -134,6 +149,9 @@ void Analyzer::CtorInit(const Tag& arg_tag, Connection* arg_conn)
 	resp_supporters = 0;
 	signature = 0;
 	output_handler = 0;
+
+	if ( tag )
+		analyzer_mgr->CountInstance(tag, true);
 	}
 
 Analyzer::~Analyzer()
@@ -158,6 +176,9 @@ Analyzer::~Analyzer()
 		}
 
 	delete output_handler;
+
+	if ( tag && analyzer_mgr )
+		analyzer_mgr->CountInstance(tag, false);
 	}
 
 void Analyzer::Init()
@@ -217,6 +238,8 @@ void Analyzer::NextPacket(int len, const u_char* data, bool is_orig, uint64 seq,
 
 	else
 		{
+		AnalyzerProfileScope profile(profile_for(tag), len);
+
 		try
 			{
 			DeliverPacket(len, data, is_orig, seq, ip, caplen);
@@ -240,6 +263,8 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 
 	else
 		{
+		AnalyzerProfileScope profile(profile_for(tag), len);
+
 		try
 			{
 			DeliverStream(len, data, is_orig);
@@ -263,6 +288,8 @@ void Analyzer::NextUndelivered(uint64 seq, int len, bool is_orig)
 
 	else
 		{
+		AnalyzerProfileScope profile(profile_for(tag), 0);
+
 		try
 			{
 			Undelivered(seq, len, is_orig);
@@ -284,7 +311,10 @@ void Analyzer::NextEndOfData(bool is_orig)
 	if ( next_sibling )
 		next_sibling->NextEndOfData(is_orig);
 	else
+		{
+		AnalyzerProfileScope profile(profile_for(tag), 0);
 		EndOfData(is_orig);
+		}
 	}
 
 void Analyzer::ForwardPacket(int len, const u_char* data, bool is_orig,
@@ -657,18 +687,27 @@ void Analyzer::FlipRoles()
 	resp_supporters = tmp;
 	}
 
+static metrics::Counter* confirmations_metric =
+	metrics::registry()->NewCounter("analyzer.confirmations",
+					"Analyzers that confirmed their protocol.");
+static metrics::Counter* violations_metric =
+	metrics::registry()->NewCounter("analyzer.violations",
+					"Protocol violations that analyzers reported.");
+
 void Analyzer::ProtocolConfirmation(Tag arg_tag)
 	{
 	if ( protocol_confirmed )
 		return;
 
+	confirmations_metric->Inc();
+
 	EnumVal* tval = arg_tag ? arg_tag.AsEnumVal() : tag.AsEnumVal();
 	Ref(tval);
 
 	val_list* vl = new val_list;
 	vl->append(BuildConnVal());
 	vl->append(tval);
-	vl->append(new Val(id, TYPE_COUNT));
+	vl->append(val_mgr->GetCount(id));
 	mgr.QueueEvent(protocol_confirmation, vl);
 
 	protocol_confirmed = true;
@@ -676,6 +715,8 @@ void Analyzer::ProtocolConfirmation(Tag arg_tag)
 
 void Analyzer::ProtocolViolation(const char* reason, const char* data, int len)
 	{
+	violations_metric->Inc();
+
 	StringVal* r;
 
 	if ( data && len )
@@ -695,7 +736,7 @@ void Analyzer::ProtocolViolation(const char* reason, const char* data, int len)
 	val_list* vl = new val_list;
 	vl->append(BuildConnVal());
 	vl->append(tval);
-	vl->append(new Val(id, TYPE_COUNT));
+	vl->append(val_mgr->GetCount(id));
 	vl->append(r);
 	mgr.QueueEvent(protocol_violation, vl);
 	}
@@ -739,6 +780,35 @@ void Analyzer::AppendNewChildren()
 	new_children.clear();
 	}
 
+int Analyzer::ChildrenStreamCoalescing() const
+	{
+	if ( output_handler )
+		return 0;
+
+	int bound = -1;
+
+	for ( int k = 0; k < 2; ++k )
+		{
+		const analyzer_list& kids = k ? new_children : children;
+
+		LOOP_OVER_GIVEN_CONST_CHILDREN(i, kids)
+			{
+			if ( (*i)->finished || (*i)->removing )
+				continue;
+
+			int b = (*i)->StreamCoalescing();
+
+			if ( b == 0 )
+				return 0;
+
+			if ( b > 0 && (bound < 0 || b < bound) )
+				bound = b;
+			}
+		}
+
+	return bound > 0 ? bound : 0;
+	}
+
 unsigned int Analyzer::MemoryAllocation() const
 	{
 	unsigned int mem = padded_sizeof(*this)
@@ -817,8 +887,11 @@ void SupportAnalyzer::ForwardPacket(int len, const u_char* data, bool is_orig,
 		// Pass to next in chain.
 		next_sibling->NextPacket(len, data, is_orig, seq, ip, caplen);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		AnalyzerProfileScope profile(profile_for(Parent()->GetAnalyzerTag()), len);
 		Parent()->DeliverPacket(len, data, is_orig, seq, ip, caplen);
+		}
 	}
 
 void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
@@ -837,8 +910,11 @@ void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
 		// Pass to next in chain.
 		next_sibling->NextStream(len, data, is_orig);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		AnalyzerProfileScope profile(profile_for(Parent()->GetAnalyzerTag()), len);
 		Parent()->DeliverStream(len, data, is_orig);
+		}
 	}
 
 void SupportAnalyzer::ForwardUndelivered(uint64 seq, int len, bool is_orig)
@@ -857,8 +933,11 @@ void SupportAnalyzer::ForwardUndelivered(uint64 seq, int len, bool is_orig)
 		// Pass to next in chain.
 		next_sibling->NextUndelivered(seq, len, is_orig);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		AnalyzerProfileScope profile(profile_for(Parent()->GetAnalyzerTag()), 0);
 		Parent()->Undelivered(seq, len, is_orig);
+		}
 	}
 
 
@@ -509,9 +509,9 @@ public:
 	/**
 	 * Called whenever the connection value is updated. Per default, this
 	 * method will be called for each analyzer in the tree. Analyzers can
-	 * use this method to attach additional data to the connections. A
-	 * call to BuildConnVal() will in turn trigger a call to
-	 * UpdateConnVal().
+	 * use this method to update the connection's endpoint records. This
+	 * happens only once script code may look at them; see
+	 * Connection::CompleteConnVal().
 	 *
 	 * @param conn_val The connenction value being updated.
 	 */
@@ -547,6 +547,24 @@ public:
 	 */
 	void Weird(const char* name, const char* addl = "");
 
+	/**
+	 * Returns up to how many bytes of in-order stream data the analyzer
+	 * is fine with getting in one piece, rather than segment by segment.
+	 * If all children of the TCP analyzer agree, the reassembler then
+	 * coalesces small segments, see \c tcp_coalesce_max_bytes. Zero asks
+	 * for each segment as it comes, which is what application analyzers
+	 * do by default, as some go by the segment sizes. A negative value,
+	 * the default otherwise, leaves it to the others.
+	 */
+	virtual int StreamCoalescing() const	{ return -1; }
+
+	/**
+	 * Returns what the children's StreamCoalescing() amounts to: the
+	 * smallest positive value if none of them asks for zero, and zero
+	 * otherwise.
+	 */
+	int ChildrenStreamCoalescing() const;
+
 	/**
 	 * Internal method.
 	 */
@@ -6,7 +6,6 @@
 #include "Val.h"
 
 #include "protocol/backdoor/BackDoor.h"
-#include "protocol/conn-size/ConnSize.h"
 #include "protocol/icmp/ICMP.h"
 #include "protocol/interconn/InterConn.h"
 #include "protocol/pia/PIA.h"
@@ -88,7 +87,6 @@ void Manager::InitPreScript()
 	{
 	// Cache these tags.
 	analyzer_backdoor = GetComponentTag("BACKDOOR");
-	analyzer_connsize = GetComponentTag("CONNSIZE");
 	analyzer_interconn = GetComponentTag("INTERCONN");
 	analyzer_stepping = GetComponentTag("STEPPINGSTONE");
 	analyzer_tcpstats = GetComponentTag("TCPSTATS");
@@ -98,6 +96,36 @@ void Manager::InitPostScript()
 	{
 	}
 
+void Manager::AddMemoryUsage(const Analyzer* a, std::vector<uint64>* by_type) const
+	{
+	uint64 mem = a->MemoryAllocation();
+
+	LOOP_OVER_GIVEN_CONST_CHILDREN(i, a->children)
+		{
+		mem -= (*i)->MemoryAllocation();
+		AddMemoryUsage(*i, by_type);
+		}
+
+	const SupportAnalyzer* supporters[] = { a->orig_supporters, a->resp_supporters };
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		for ( const SupportAnalyzer* s = supporters[i]; s; s = s->Sibling() )
+			{
+			mem -= s->MemoryAllocation();
+			AddMemoryUsage(s, by_type);
+			}
+		}
+
+	if ( ! a->tag )
+		return;
+
+	if ( a->tag.Type() >= by_type->size() )
+		by_type->resize(a->tag.Type() + 1);
+
+	(*by_type)[a->tag.Type()] += mem;
+	}
+
 void Manager::DumpDebug()
 	{
 #ifdef DEBUG
@@ -477,17 +505,6 @@ bool Manager::BuildInitialAnalyzerTree(Connection* conn)
 			// Add TCPStats analyzer. This needs to see packets so
 			// we cannot add it as a normal child.
 			tcp->AddChildPacketAnalyzer(new tcp::TCPStats_Analyzer(conn));
-
-		if ( IsEnabled(analyzer_connsize) )
-			// Add ConnSize analyzer. Needs to see packets, not stream.
-			tcp->AddChildPacketAnalyzer(new conn_size::ConnSize_Analyzer(conn));
-		}
-
-	else
-		{
-		if ( IsEnabled(analyzer_connsize) )
-			// Add ConnSize analyzer. Needs to see packets, not stream.
-			root->AddChildAnalyzer(new conn_size::ConnSize_Analyzer(conn));
 		}
 
 	if ( pia )
@@ -585,6 +602,13 @@ void Manager::ScheduleAnalyzer(const IPAddr& orig, const IPAddr& resp, PortVal*
 
 Manager::tag_set Manager::GetScheduled(const Connection* conn)
 	{
+	// This runs for every new connection, but most of the time nothing
+	// is scheduled at all.
+	if ( conns.empty() )
+		return tag_set();
+
+	static const IPAddr wildcard(string("::"));
+
 	ConnIndex c(conn->OrigAddr(), conn->RespAddr(),
 		    ntohs(conn->RespPort()), conn->ConnTransport());
 
@@ -596,7 +620,7 @@ Manager::tag_set Manager::GetScheduled(const Connection* conn)
 		result.insert(i->second->analyzer);
 
 	// Try wildcard for originator.
-	c.orig = IPAddr(string("::"));
+	c.orig = wildcard;
 	all = conns.equal_range(c);
 
 	for ( conns_map::iterator i = all.first; i != all.second; i++ )
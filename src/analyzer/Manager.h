@@ -22,12 +22,14 @@
 #define ANALYZER_MANAGER_H
 
 #include <queue>
+#include <vector>
 
 #include "Analyzer.h"
 #include "Component.h"
 #include "Tag.h"
 #include "plugin/ComponentManager.h"
 
+#include "../AnalyzerProfile.h"
 #include "../Dict.h"
 #include "../net_util.h"
 #include "../IP.h"
@@ -335,6 +337,74 @@ public:
 	void ScheduleAnalyzer(const IPAddr& orig, const IPAddr& resp, PortVal* resp_p,
 			      Val* analyzer, double timeout);
 
+	/**
+	 * Updates the instance counts of an analyzer type. Called by
+	 * analyzer::Analyzer when an instance gets its tag, and when it's
+	 * deleted.
+	 *
+	 * @param tag The analyzer's tag.
+	 *
+	 * @param created True for a new instance, false for a deleted one.
+	 */
+	void CountInstance(const Tag& tag, bool created)
+		{
+		if ( tag.Type() >= instance_counts.size() )
+			instance_counts.resize(tag.Type() + 1);
+
+		InstanceCounts& c = instance_counts[tag.Type()];
+
+		if ( created )
+			{
+			++c.created;
+			++c.active;
+			}
+		else
+			--c.active;
+		}
+
+	/**
+	 * Returns the number of instances of an analyzer type created so far.
+	 */
+	uint64 NumCreated(const Tag& tag) const
+		{
+		return tag.Type() < instance_counts.size() ?
+			instance_counts[tag.Type()].created : 0;
+		}
+
+	/**
+	 * Returns the number of instances of an analyzer type that currently
+	 * exist.
+	 */
+	uint64 NumActive(const Tag& tag) const
+		{
+		return tag.Type() < instance_counts.size() ?
+			instance_counts[tag.Type()].active : 0;
+		}
+
+	/**
+	 * Returns the resource usage profile of an analyzer type, which its
+	 * instances update while \c analyzer_profiling is on.
+	 */
+	AnalyzerProfile* Profile(const Tag& tag)
+		{
+		if ( tag.Type() >= profiles.size() )
+			profiles.resize(tag.Type() + 1);
+
+		return &profiles[tag.Type()];
+		}
+
+	/**
+	 * Adds up the memory that an analyzer tree uses, per analyzer type.
+	 * Each analyzer counts for what Analyzer::MemoryAllocation() reports
+	 * beyond its children and support analyzers.
+	 *
+	 * @param a The tree's root.
+	 *
+	 * @param by_type Vector indexed by the tags' main type to add the
+	 * sizes to; it's grown as needed.
+	 */
+	void AddMemoryUsage(const Analyzer* a, std::vector<uint64>* by_type) const;
+
 private:
 	typedef set<Tag> tag_set;
 	typedef map<uint32, tag_set*> analyzer_map_by_port;
@@ -349,11 +419,21 @@ private:
 	analyzer_map_by_port analyzers_by_port_udp;
 
 	Tag analyzer_backdoor;
-	Tag analyzer_connsize;
 	Tag analyzer_interconn;
 	Tag analyzer_stepping;
 	Tag analyzer_tcpstats;
 
+	// Instance counts, indexed by the tags' main type.
+	struct InstanceCounts {
+		uint64 created;
+		uint64 active;
+
+		InstanceCounts()	{ created = active = 0; }
+	};
+
+	std::vector<InstanceCounts> instance_counts;
+	std::vector<AnalyzerProfile> profiles;
+
 	//// Data structures to track analyzed scheduled for future connections.
 
 	// The index for a scheduled connection.
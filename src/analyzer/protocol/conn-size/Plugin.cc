@@ -3,8 +3,6 @@
 
 #include "plugin/Plugin.h"
 
-#include "ConnSize.h"
-
 namespace plugin {
 namespace Bro_ConnSize {
 
@@ -12,11 +10,11 @@ class Plugin : public plugin::Plugin {
 public:
 	plugin::Configuration Configure()
 		{
-		AddComponent(new ::analyzer::Component("ConnSize", ::analyzer::conn_size::ConnSize_Analyzer::Instantiate));
-
+		// The counting is part of Connection; just the script-level
+		// interface to it lives here.
 		plugin::Configuration config;
 		config.name = "Bro::ConnSize";
-		config.description = "Connection size analyzer";
+		config.description = "Connection size thresholds";
 		return config;
 		}
 } plugin;
@@ -20,6 +20,9 @@ DNS_Interpreter::DNS_Interpreter(analyzer::Analyzer* arg_analyzer)
 	{
 	analyzer = arg_analyzer;
 	first_message = true;
+	num_cached_names = 0;
+	name_cache_buf_used = 0;
+	name_clean = true;
 	}
 
 int DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
@@ -34,6 +37,9 @@ int DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 
 	DNS_MsgInfo msg((DNS_RawMsgHdr*) data, is_query);
 
+	num_cached_names = 0;
+	name_cache_buf_used = 0;
+
 	if ( first_message && msg.QR && is_query == 1 )
 		{
 		is_query = msg.is_query = 0;
@@ -48,9 +54,9 @@ int DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 		{
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_query, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_query));
 		vl->append(msg.BuildHdrVal());
-		vl->append(new Val(len, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(len));
 
 		analyzer->ConnectionEvent(dns_message, vl);
 		}
@@ -232,8 +238,7 @@ int DNS_Interpreter::ParseAnswer(DNS_MsgInfo* msg,
 	// Note that the exact meaning of some of these fields will be
 	// re-interpreted by other, more adventurous RR types.
 
-	Unref(msg->query_name);
-	msg->query_name = new StringVal(new BroString(name, name_end - name, 1));
+	msg->SetQueryName(name, name_end - name);
 	msg->atype = RR_Type(ExtractShort(data, len));
 	msg->aclass = ExtractShort(data, len);
 	msg->ttl = ExtractLong(data, len);
@@ -338,6 +343,9 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len,
 					const u_char* msg_start)
 	{
 	u_char* name_start = name;
+	const u_char* data_start = data;
+	bool outer_clean = name_clean;
+	name_clean = true;
 
 	while ( ExtractLabel(data, len, name, name_len, msg_start) )
 		;
@@ -345,7 +353,10 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len,
 	int n = name - name_start;
 
 	if ( n >= 255 )
+		{
 		analyzer->Weird("DNS_NAME_too_long");
+		name_clean = false;
+		}
 
 	if ( n >= 2 && name[-1] == '.' )
 		{
@@ -359,15 +370,51 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len,
 		if ( isupper(*np) )
 			*np = tolower(*np);
 
+	if ( name_clean )
+		CacheName(data_start - msg_start, data - data_start,
+			  name_start, name - name_start);
+
+	name_clean = outer_clean && name_clean;
+
 	return name;
 	}
 
+const DNS_Interpreter::CachedName* DNS_Interpreter::LookupName(int offset) const
+	{
+	for ( int i = 0; i < num_cached_names; ++i )
+		if ( name_cache[i].offset == offset )
+			return &name_cache[i];
+
+	return 0;
+	}
+
+void DNS_Interpreter::CacheName(int offset, int consumed, const u_char* name,
+				int len)
+	{
+	if ( num_cached_names == NAME_CACHE_SIZE ||
+	     name_cache_buf_used + len > int(sizeof(name_cache_buf)) ||
+	     LookupName(offset) )
+		return;
+
+	CachedName* c = &name_cache[num_cached_names++];
+	c->offset = offset;
+	c->consumed = consumed;
+	c->pos = name_cache_buf_used;
+	c->len = len;
+
+	memcpy(name_cache_buf + name_cache_buf_used, name, len);
+	name_cache_buf_used += len;
+	}
+
 int DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 				u_char*& name, int& name_len,
 				const u_char* msg_start)
 	{
 	if ( len <= 0 )
+		{
+		name_clean = false;
 		return 0;
+		}
 
 	const u_char* orig_data = data;
 	int label_len = data[0];
@@ -375,13 +422,16 @@ int DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 	++data;
 	--len;
 
-	if ( len <= 0 )
-		return 0;
-
 	if ( label_len == 0 )
 		// Found terminating label.
 		return 0;
 
+	if ( len <= 0 )
+		{
+		name_clean = false;
+		return 0;
+		}
+
 	if ( (label_len & 0xc0) == 0xc0 )
 		{
 		unsigned short offset = (label_len & ~0xc0) << 8;
@@ -402,13 +452,28 @@ int DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 			//  sometimes compression points to compression.)
 
 			analyzer->Weird("DNS_label_forward_compress_offset");
+			name_clean = false;
 			return 0;
 			}
 
-		// Recursively resolve name.
 		const u_char* recurse_data = msg_start + offset;
 		int recurse_max_len = orig_data - recurse_data;
 
+		// If we have seen the name there already, and it fits into
+		// both the space available there now and our buffer, it's
+		// going to come out the same as before.
+		const CachedName* c = LookupName(offset);
+
+		if ( c && c->consumed <= recurse_max_len &&
+		     c->len + 2 <= name_len )
+			{
+			memcpy(name, name_cache_buf + c->pos, c->len);
+			name += c->len;
+			name_len -= c->len;
+			return 0;
+			}
+
+		// Recursively resolve name.
 		u_char* name_end = ExtractName(recurse_data, recurse_max_len,
 						name, name_len, msg_start);
 
@@ -423,6 +488,7 @@ int DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 		analyzer->Weird("DNS_label_len_gt_pkt");
 		data += len;	// consume the rest of the packet
 		len = 0;
+		name_clean = false;
 		return 0;
 		}
 
@@ -431,12 +497,14 @@ int DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 		ntohs(analyzer->Conn()->RespPort()) != 137 )
 		{
 		analyzer->Weird("DNS_label_too_long");
+		name_clean = false;
 		return 0;
 		}
 
 	if ( label_len >= name_len )
 		{
 		analyzer->Weird("DNS_label_len_gt_name_len");
+		name_clean = false;
 		return 0;
 		}
 
@@ -588,7 +656,7 @@ int DNS_Interpreter::ParseRR_SOA(DNS_MsgInfo* msg,
 
 		r->Assign(0, new StringVal(new BroString(mname, mname_end - mname, 1)));
 		r->Assign(1, new StringVal(new BroString(rname, rname_end - rname, 1)));
-		r->Assign(2, new Val(serial, TYPE_COUNT));
+		r->Assign(2, val_mgr->GetCount(serial));
 		r->Assign(3, new IntervalVal(double(refresh), Seconds));
 		r->Assign(4, new IntervalVal(double(retry), Seconds));
 		r->Assign(5, new IntervalVal(double(expire), Seconds));
@@ -628,7 +696,7 @@ int DNS_Interpreter::ParseRR_MX(DNS_MsgInfo* msg,
 		vl->append(msg->BuildHdrVal());
 		vl->append(msg->BuildAnswerVal());
 		vl->append(new StringVal(new BroString(name, name_end - name, 1)));
-		vl->append(new Val(preference, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(preference));
 
 		analyzer->ConnectionEvent(dns_MX_reply, vl);
 		}
@@ -672,9 +740,9 @@ int DNS_Interpreter::ParseRR_SRV(DNS_MsgInfo* msg,
 		vl->append(msg->BuildHdrVal());
 		vl->append(msg->BuildAnswerVal());
 		vl->append(new StringVal(new BroString(name, name_end - name, 1)));
-		vl->append(new Val(priority, TYPE_COUNT));
-		vl->append(new Val(weight, TYPE_COUNT));
-		vl->append(new Val(port, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(priority));
+		vl->append(val_mgr->GetCount(weight));
+		vl->append(val_mgr->GetCount(port));
 
 		analyzer->ConnectionEvent(dns_SRV_reply, vl);
 		}
@@ -943,7 +1011,7 @@ int DNS_Interpreter::ParseRR_CAA(DNS_MsgInfo* msg,
 	vl->append(analyzer->BuildConnVal());
 	vl->append(msg->BuildHdrVal());
 	vl->append(msg->BuildAnswerVal());
-	vl->append(new Val(flags, TYPE_COUNT));
+	vl->append(val_mgr->GetCount(flags));
 	vl->append(new StringVal(tag));
 	vl->append(new StringVal(value));
 
@@ -965,8 +1033,8 @@ void DNS_Interpreter::SendReplyOrRejectEvent(DNS_MsgInfo* msg,
 	vl->append(analyzer->BuildConnVal());
 	vl->append(msg->BuildHdrVal());
 	vl->append(new StringVal(question_name));
-	vl->append(new Val(qtype, TYPE_COUNT));
-	vl->append(new Val(qclass, TYPE_COUNT));
+	vl->append(val_mgr->GetCount(qtype));
+	vl->append(val_mgr->GetCount(qclass));
 
 	analyzer->ConnectionEvent(event, vl);
 	}
@@ -996,6 +1064,7 @@ DNS_MsgInfo::DNS_MsgInfo(DNS_RawMsgHdr* hdr, int arg_is_query)
 	is_query = arg_is_query;
 
 	query_name = 0;
+	query_name_len = 0;
 	atype = TYPE_ALL;
 	aclass = 0;
 	ttl = 0;
@@ -1010,23 +1079,45 @@ DNS_MsgInfo::~DNS_MsgInfo()
 	Unref(query_name);
 	}
 
+void DNS_MsgInfo::SetQueryName(const u_char* name, int len)
+	{
+	Unref(query_name);
+	query_name = 0;
+
+	if ( len > int(sizeof(query_name_buf)) )
+		len = sizeof(query_name_buf);
+
+	memcpy(query_name_buf, name, len);
+	query_name_len = len;
+	}
+
+StringVal* DNS_MsgInfo::QueryName()
+	{
+	if ( ! query_name )
+		query_name = new StringVal(new BroString(query_name_buf,
+							query_name_len, 1));
+
+	Ref(query_name);
+	return query_name;
+	}
+
 Val* DNS_MsgInfo::BuildHdrVal()
 	{
 	RecordVal* r = new RecordVal(dns_msg);
 
-	r->Assign(0, new Val(id, TYPE_COUNT));
-	r->Assign(1, new Val(opcode, TYPE_COUNT));
-	r->Assign(2, new Val(rcode, TYPE_COUNT));
-	r->Assign(3, new Val(QR, TYPE_BOOL));
-	r->Assign(4, new Val(AA, TYPE_BOOL));
-	r->Assign(5, new Val(TC, TYPE_BOOL));
-	r->Assign(6, new Val(RD, TYPE_BOOL));
-	r->Assign(7, new Val(RA, TYPE_BOOL));
-	r->Assign(8, new Val(Z, TYPE_COUNT));
-	r->Assign(9, new Val(qdcount, TYPE_COUNT));
-	r->Assign(10, new Val(ancount, TYPE_COUNT));
-	r->Assign(11, new Val(nscount, TYPE_COUNT));
-	r->Assign(12, new Val(arcount, TYPE_COUNT));
+	r->Assign(0, val_mgr->GetCount(id));
+	r->Assign(1, val_mgr->GetCount(opcode));
+	r->Assign(2, val_mgr->GetCount(rcode));
+	r->Assign(3, val_mgr->GetBool(QR));
+	r->Assign(4, val_mgr->GetBool(AA));
+	r->Assign(5, val_mgr->GetBool(TC));
+	r->Assign(6, val_mgr->GetBool(RD));
+	r->Assign(7, val_mgr->GetBool(RA));
+	r->Assign(8, val_mgr->GetCount(Z));
+	r->Assign(9, val_mgr->GetCount(qdcount));
+	r->Assign(10, val_mgr->GetCount(ancount));
+	r->Assign(11, val_mgr->GetCount(nscount));
+	r->Assign(12, val_mgr->GetCount(arcount));
 
 	return r;
 	}
@@ -1035,11 +1126,10 @@ Val* DNS_MsgInfo::BuildAnswerVal()
 	{
 	RecordVal* r = new RecordVal(dns_answer);
 
-	Ref(query_name);
-	r->Assign(0, new Val(int(answer_type), TYPE_COUNT));
-	r->Assign(1, query_name);
-	r->Assign(2, new Val(atype, TYPE_COUNT));
-	r->Assign(3, new Val(aclass, TYPE_COUNT));
+	r->Assign(0, val_mgr->GetCount(int(answer_type)));
+	r->Assign(1, QueryName());
+	r->Assign(2, val_mgr->GetCount(atype));
+	r->Assign(3, val_mgr->GetCount(aclass));
 	r->Assign(4, new IntervalVal(double(ttl), Seconds));
 
 	return r;
@@ -1051,15 +1141,14 @@ Val* DNS_MsgInfo::BuildEDNS_Val()
 	// than a regular resource record.
 	RecordVal* r = new RecordVal(dns_edns_additional);
 
-	Ref(query_name);
-	r->Assign(0, new Val(int(answer_type), TYPE_COUNT));
-	r->Assign(1, query_name);
+	r->Assign(0, val_mgr->GetCount(int(answer_type)));
+	r->Assign(1, QueryName());
 
 	// type = 0x29 or 41 = EDNS
-	r->Assign(2, new Val(atype, TYPE_COUNT));
+	r->Assign(2, val_mgr->GetCount(atype));
 
 	// sender's UDP payload size, per RFC 2671 4.3
-	r->Assign(3, new Val(aclass, TYPE_COUNT));
+	r->Assign(3, val_mgr->GetCount(aclass));
 
 	// Need to break the TTL field into three components:
 	// initial: [------------- ttl (32) ---------------------]
@@ -1072,11 +1161,11 @@ Val* DNS_MsgInfo::BuildEDNS_Val()
 
 	unsigned int return_error = (ercode << 8) | rcode;
 
-	r->Assign(4, new Val(return_error, TYPE_COUNT));
-	r->Assign(5, new Val(version, TYPE_COUNT));
-	r->Assign(6, new Val(z, TYPE_COUNT));
+	r->Assign(4, val_mgr->GetCount(return_error));
+	r->Assign(5, val_mgr->GetCount(version));
+	r->Assign(6, val_mgr->GetCount(z));
 	r->Assign(7, new IntervalVal(double(ttl), Seconds));
-	r->Assign(8, new Val(is_query, TYPE_COUNT));
+	r->Assign(8, val_mgr->GetCount(is_query));
 
 	return r;
 	}
@@ -1086,17 +1175,16 @@ Val* DNS_MsgInfo::BuildTSIG_Val()
 	RecordVal* r = new RecordVal(dns_tsig_additional);
 	double rtime = tsig->time_s + tsig->time_ms / 1000.0;
 
-	Ref(query_name);
-	// r->Assign(0, new Val(int(answer_type), TYPE_COUNT));
-	r->Assign(0, query_name);
-	r->Assign(1, new Val(int(answer_type), TYPE_COUNT));
+	// r->Assign(0, val_mgr->GetCount(int(answer_type)));
+	r->Assign(0, QueryName());
+	r->Assign(1, val_mgr->GetCount(int(answer_type)));
 	r->Assign(2, new StringVal(tsig->alg_name));
 	r->Assign(3, new StringVal(tsig->sig));
 	r->Assign(4, new Val(rtime, TYPE_TIME));
 	r->Assign(5, new Val(double(tsig->fudge), TYPE_TIME));
-	r->Assign(6, new Val(tsig->orig_id, TYPE_COUNT));
-	r->Assign(7, new Val(tsig->rr_error, TYPE_COUNT));
-	r->Assign(8, new Val(is_query, TYPE_COUNT));
+	r->Assign(6, val_mgr->GetCount(tsig->orig_id));
+	r->Assign(7, val_mgr->GetCount(tsig->rr_error));
+	r->Assign(8, val_mgr->GetCount(is_query));
 
 	delete tsig;
 	tsig = 0;
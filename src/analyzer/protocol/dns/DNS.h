@@ -115,6 +115,13 @@ public:
 	Val* BuildEDNS_Val();
 	Val* BuildTSIG_Val();
 
+	// Sets the name of the current RR. Its value gets created only
+	// once an event needs it.
+	void SetQueryName(const u_char* name, int len);
+
+	// Returns a new reference to the value of the current RR's name.
+	StringVal* QueryName();
+
 	int id;
 	int opcode;	///< query type, see DNS_Opcode
 	int rcode;	///< return code, see DNS_Code
@@ -130,7 +137,9 @@ public:
 	int arcount;	///< number of additional RRs
 	int is_query;	///< whether it came from the session initiator
 
-	StringVal* query_name;
+	StringVal* query_name;	///< nil until first needed
+	u_char query_name_buf[513];
+	int query_name_len;
 	RR_Type atype;
 	int aclass;	///< normally = 1, inet
 	uint32 ttl;
@@ -223,8 +232,31 @@ protected:
 					const u_char*& data, int& len,
 					BroString* question_name);
 
+	// Names that we have decompressed in the current message, by the
+	// offset they start at, for compression pointers to them. Most
+	// responses point back at the question's name over and over.
+	struct CachedName {
+		int offset;
+		int consumed;	// bytes of the message the name took up
+		int pos;	// of the result in name_cache_buf
+		int len;
+	};
+
+	const CachedName* LookupName(int offset) const;
+	void CacheName(int offset, int consumed, const u_char* name, int len);
+
 	analyzer::Analyzer* analyzer;
 	bool first_message;
+
+	static const int NAME_CACHE_SIZE = 32;
+	CachedName name_cache[NAME_CACHE_SIZE];
+	int num_cached_names;
+	u_char name_cache_buf[4096];
+	int name_cache_buf_used;
+
+	// False once the name being extracted hit a problem, in which case
+	// the result depends on where we came from and can't be cached.
+	bool name_clean;
 };
 
 
@@ -581,11 +581,11 @@ Val* HTTP_Message::BuildMessageStat(const int interrupted, const char* msg)
 	RecordVal* stat = new RecordVal(http_message_stat);
 	int field = 0;
 	stat->Assign(field++, new Val(start_time, TYPE_TIME));
-	stat->Assign(field++, new Val(interrupted, TYPE_BOOL));
+	stat->Assign(field++, val_mgr->GetBool(interrupted));
 	stat->Assign(field++, new StringVal(msg));
-	stat->Assign(field++, new Val(body_length, TYPE_COUNT));
-	stat->Assign(field++, new Val(content_gap_length, TYPE_COUNT));
-	stat->Assign(field++, new Val(header_length, TYPE_COUNT));
+	stat->Assign(field++, val_mgr->GetCount(body_length));
+	stat->Assign(field++, val_mgr->GetCount(content_gap_length));
+	stat->Assign(field++, val_mgr->GetCount(header_length));
 	return stat;
 	}
 
@@ -615,7 +615,7 @@ void HTTP_Message::Done(const int interrupted, const char* detail)
 		{
 		val_list* vl = new val_list;
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		vl->append(BuildMessageStat(interrupted, detail));
 		GetAnalyzer()->ConnectionEvent(http_message_done, vl);
 		}
@@ -648,7 +648,7 @@ void HTTP_Message::BeginEntity(mime::MIME_Entity* entity)
 		{
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		analyzer->ConnectionEvent(http_begin_entity, vl);
 		}
 	}
@@ -665,7 +665,7 @@ void HTTP_Message::EndEntity(mime::MIME_Entity* entity)
 		{
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		analyzer->ConnectionEvent(http_end_entity, vl);
 		}
 
@@ -706,7 +706,7 @@ void HTTP_Message::SubmitAllHeaders(mime::MIME_HeaderList& hlist)
 		{
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		vl->append(BuildHeaderTable(hlist));
 		analyzer->ConnectionEvent(http_all_headers, vl);
 		}
@@ -720,7 +720,7 @@ void HTTP_Message::SubmitAllHeaders(mime::MIME_HeaderList& hlist)
 
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		vl->append(ty);
 		vl->append(subty);
 		analyzer->ConnectionEvent(http_content_type, vl);
@@ -1138,8 +1138,8 @@ void HTTP_Analyzer::GenStats()
 	if ( http_stats )
 		{
 		RecordVal* r = new RecordVal(http_stats_rec);
-		r->Assign(0, new Val(num_requests, TYPE_COUNT));
-		r->Assign(1, new Val(num_replies, TYPE_COUNT));
+		r->Assign(0, val_mgr->GetCount(num_requests));
+		r->Assign(1, val_mgr->GetCount(num_replies));
 		r->Assign(2, new Val(request_version, TYPE_DOUBLE));
 		r->Assign(3, new Val(reply_version, TYPE_DOUBLE));
 
@@ -1224,7 +1224,7 @@ int HTTP_Analyzer::HTTP_RequestLine(const char* line, const char* end_of_line)
 	if ( rest == end_of_method )
 		goto error;
 
-	request_method = new StringVal(end_of_method - line, line);
+	request_method = val_mgr->GetInternedString(end_of_method - line, line);
 
 	if ( ! ParseRequest(rest, end_of_line) )
 		{
@@ -1395,7 +1395,8 @@ void HTTP_Analyzer::HTTP_Request()
 		vl->append(TruncateURI(request_URI->AsStringVal()));
 		vl->append(TruncateURI(unescaped_URI->AsStringVal()));
 
-		vl->append(new StringVal(fmt("%.1f", request_version)));
+		const char* version = fmt("%.1f", request_version);
+		vl->append(val_mgr->GetInternedString(strlen(version), version));
 		// DEBUG_MSG("%.6f http_request\n", network_time);
 		ConnectionEvent(http_request, vl);
 		}
@@ -1407,8 +1408,9 @@ void HTTP_Analyzer::HTTP_Reply()
 		{
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new StringVal(fmt("%.1f", reply_version)));
-		vl->append(new Val(reply_code, TYPE_COUNT));
+		const char* version = fmt("%.1f", reply_version);
+		vl->append(val_mgr->GetInternedString(strlen(version), version));
+		vl->append(val_mgr->GetCount(reply_code));
 		if ( reply_reason_phrase )
 			vl->append(reply_reason_phrase->Ref());
 		else
@@ -1546,7 +1548,7 @@ int HTTP_Analyzer::HTTP_ReplyLine(const char* line, const char* end_of_line)
 
 	rest = skip_whitespace(rest, end_of_line);
 	reply_reason_phrase =
-		new StringVal(end_of_line - rest, (const char *) rest);
+		val_mgr->GetInternedString(end_of_line - rest, (const char *) rest);
 
 	return 1;
 	}
@@ -1634,8 +1636,9 @@ void HTTP_Analyzer::HTTP_Header(int is_orig, mime::MIME_Header* h)
 
 		val_list* vl = new val_list();
 		vl->append(BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
-		vl->append(mime::new_string_val(h->get_name())->ToUpper());
+		vl->append(val_mgr->GetBool(is_orig));
+		data_chunk_t name = h->get_name();
+		vl->append(val_mgr->GetInternedString(name.length, name.data, true));
 		vl->append(mime::new_string_val(h->get_value()));
 		if ( DEBUG_http )
 			DEBUG_MSG("%.6f http_header\n", network_time);
@@ -1770,8 +1773,8 @@ void HTTP_Analyzer::HTTP_EntityData(int is_orig, BroString* entity_data)
 		{
 		val_list* vl = new val_list();
 		vl->append(BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
-		vl->append(new Val(entity_data->Len(), TYPE_COUNT));
+		vl->append(val_mgr->GetBool(is_orig));
+		vl->append(val_mgr->GetCount(entity_data->Len()));
 		vl->append(new StringVal(entity_data));
 		ConnectionEvent(http_entity_data, vl);
 		}
@@ -114,6 +114,7 @@ public:
 	void EndEntity(mime::MIME_Entity* entity);
 	void SubmitHeader(mime::MIME_Header* h);
 	void SubmitAllHeaders(mime::MIME_HeaderList& /* hlist */);
+	bool KeepsHeaders() const	{ return http_all_headers; }
 	void SubmitData(int len, const char* buf);
 	int RequestBuffer(int* plen, char** pbuf);
 	void SubmitAllData();
@@ -235,10 +235,10 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
-			vl->append(new Val(users, TYPE_INT));
-			vl->append(new Val(services, TYPE_INT));
-			vl->append(new Val(servers, TYPE_INT));
+			vl->append(val_mgr->GetBool(orig));
+			vl->append(val_mgr->GetInt(users));
+			vl->append(val_mgr->GetInt(services));
+			vl->append(val_mgr->GetInt(servers));
 
 			ConnectionEvent(irc_network_info, vl);
 			}
@@ -272,7 +272,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(type.c_str()));
 			vl->append(new StringVal(channel.c_str()));
 
@@ -317,10 +317,10 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
-			vl->append(new Val(users, TYPE_INT));
-			vl->append(new Val(services, TYPE_INT));
-			vl->append(new Val(servers, TYPE_INT));
+			vl->append(val_mgr->GetBool(orig));
+			vl->append(val_mgr->GetInt(users));
+			vl->append(val_mgr->GetInt(services));
+			vl->append(val_mgr->GetInt(servers));
 
 			ConnectionEvent(irc_server_info, vl);
 			}
@@ -340,8 +340,8 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
-			vl->append(new Val(channels, TYPE_INT));
+			vl->append(val_mgr->GetBool(orig));
+			vl->append(val_mgr->GetInt(channels));
 
 			ConnectionEvent(irc_channel_info, vl);
 			}
@@ -373,7 +373,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(eop - prefix, prefix));
 			vl->append(new StringVal(++msg));
 			ConnectionEvent(irc_global_users, vl);
@@ -398,7 +398,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(parts[0].c_str()));
 			vl->append(new StringVal(parts[1].c_str()));
 			vl->append(new StringVal(parts[2].c_str()));
@@ -437,7 +437,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(parts[0].c_str()));
 
 			ConnectionEvent(irc_whois_operator_line, vl);
@@ -468,7 +468,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(nick.c_str()));
 			TableVal* set = new TableVal(string_set);
 			for ( unsigned int i = 0; i < parts.size(); ++i )
@@ -504,7 +504,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 				val_list* vl = new val_list;
 
 				vl->append(BuildConnVal());
-				vl->append(new Val(orig, TYPE_BOOL));
+				vl->append(val_mgr->GetBool(orig));
 				vl->append(new StringVal(parts[1].c_str()));
 
 				const char* t = topic.c_str();
@@ -538,7 +538,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(parts[0].c_str()));
 			vl->append(new StringVal(parts[1].c_str()));
 			if ( parts[2][0] == '~' )
@@ -550,7 +550,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			vl->append(new StringVal(parts[6].c_str()));
 			if ( parts[7][0] == ':' )
 				parts[7] = parts[7].substr(1);
-			vl->append(new Val(atoi(parts[7].c_str()), TYPE_INT));
+			vl->append(val_mgr->GetInt(atoi(parts[7].c_str())));
 			vl->append(new StringVal(parts[8].c_str()));
 
 			ConnectionEvent(irc_who_line, vl);
@@ -566,7 +566,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 				{
 				val_list* vl = new val_list;
 				vl->append(BuildConnVal());
-				vl->append(new Val(orig, TYPE_BOOL));
+				vl->append(val_mgr->GetBool(orig));
 				ConnectionEvent(irc_invalid_nick, vl);
 				}
 			break;
@@ -578,8 +578,8 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 				{
 				val_list* vl = new val_list;
 				vl->append(BuildConnVal());
-				vl->append(new Val(orig, TYPE_BOOL));
-				vl->append(new Val(code == 381, TYPE_BOOL));
+				vl->append(val_mgr->GetBool(orig));
+				vl->append(val_mgr->GetBool(code == 381));
 				ConnectionEvent(irc_oper_response, vl);
 				}
 			break;
@@ -593,9 +593,9 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		default:
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
-			vl->append(new Val(code, TYPE_COUNT));
+			vl->append(val_mgr->GetCount(code));
 			vl->append(new StringVal(params.c_str()));
 
 			ConnectionEvent(irc_reply, vl);
@@ -663,18 +663,17 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(target.c_str()));
 			vl->append(new StringVal(parts[1].c_str()));
 			vl->append(new StringVal(parts[2].c_str()));
 			vl->append(new AddrVal(htonl(raw_ip)));
-			vl->append(new Val(atoi(parts[4].c_str()), TYPE_COUNT));
+			vl->append(val_mgr->GetCount(atoi(parts[4].c_str())));
 			if ( parts.size() >= 6 )
-				vl->append(new Val(atoi(parts[5].c_str()),
-							TYPE_COUNT));
+				vl->append(val_mgr->GetCount(atoi(parts[5].c_str())));
 			else
-				vl->append(new Val(0, TYPE_COUNT));
+				vl->append(val_mgr->GetCount(0));
 
 			ConnectionEvent(irc_dcc_message, vl);
 			}
@@ -683,7 +682,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(target.c_str()));
 			vl->append(new StringVal(message.c_str()));
@@ -709,7 +708,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		vl->append(new StringVal(target.c_str()));
 		vl->append(new StringVal(message.c_str()));
@@ -734,7 +733,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		vl->append(new StringVal(target.c_str()));
 		vl->append(new StringVal(message.c_str()));
@@ -748,19 +747,19 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		vector<string> parts = SplitWords(params, ' ');
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 
 		if ( parts.size() > 0 )
 			vl->append(new StringVal(parts[0].c_str()));
-		else vl->append(new StringVal(""));
+		else vl->append(val_mgr->GetEmptyString());
 
 		if ( parts.size() > 1 )
 			vl->append(new StringVal(parts[1].c_str()));
-		else vl->append(new StringVal(""));
+		else vl->append(val_mgr->GetEmptyString());
 
 		if ( parts.size() > 2 )
 			vl->append(new StringVal(parts[2].c_str()));
-		else vl->append(new StringVal(""));
+		else vl->append(val_mgr->GetEmptyString());
 
 		string realname;
 		for ( unsigned int i = 3; i < parts.size(); i++ )
@@ -784,7 +783,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(parts[0].c_str()));
 			vl->append(new StringVal(parts[1].c_str()));
 
@@ -807,7 +806,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		vl->append(new StringVal(parts[0].c_str()));
 		vl->append(new StringVal(parts[1].c_str()));
@@ -823,7 +822,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			vl->append(new StringVal(comment.c_str()));
 			}
 		else
-			vl->append(new StringVal(""));
+			vl->append(val_mgr->GetEmptyString());
 
 		ConnectionEvent(irc_kick_message, vl);
 		}
@@ -851,7 +850,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 
 		TableVal* list = new TableVal(irc_join_list);
 		vector<string> channels = SplitWords(parts[0], ',');
@@ -898,7 +897,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 
 		TableVal* list = new TableVal(irc_join_list);
 		string empty_string = "";
@@ -979,7 +978,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(nick.c_str()));
 		vl->append(set);
 		vl->append(new StringVal(message.c_str()));
@@ -1003,7 +1002,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(nickname.c_str()));
 		vl->append(new StringVal(message.c_str()));
 
@@ -1018,7 +1017,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		vl->append(new StringVal(nick.c_str()));
 
@@ -1044,12 +1043,12 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		if ( parts.size() > 0 )
 			vl->append(new StringVal(parts[0].c_str()));
 		else
-			vl->append(new StringVal(""));
-		vl->append(new Val(oper, TYPE_BOOL));
+			vl->append(val_mgr->GetEmptyString());
+		vl->append(val_mgr->GetBool(oper));
 
 		ConnectionEvent(irc_who_message, vl);
 		}
@@ -1076,7 +1075,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(server.c_str()));
 		vl->append(new StringVal(users.c_str()));
 
@@ -1087,7 +1086,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		{
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		if ( params[0] == ':' )
 			params = params.substr(1);
@@ -1106,7 +1105,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(parts[0].c_str()));
 			vl->append(new StringVal(parts[1].c_str()));
@@ -1123,7 +1122,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(params.c_str()));
 
@@ -1138,7 +1137,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		{
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(params.c_str()));
 		ConnectionEvent(irc_password_message, vl);
 		}
@@ -1160,7 +1159,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 
 		val_list* vl = new val_list;
 		vl->append(BuildConnVal());
-		vl->append(new Val(orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(orig));
 		vl->append(new StringVal(prefix.c_str()));
 		vl->append(new StringVal(server.c_str()));
 		vl->append(new StringVal(message.c_str()));
@@ -1175,7 +1174,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(command.c_str()));
 			vl->append(new StringVal(params.c_str()));
@@ -1190,7 +1189,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(orig));
 			vl->append(new StringVal(prefix.c_str()));
 			vl->append(new StringVal(command.c_str()));
 			vl->append(new StringVal(params.c_str()));
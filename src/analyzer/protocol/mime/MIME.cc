@@ -141,6 +141,9 @@ int fputs(data_chunk_t b, FILE* fp)
 
 void MIME_Mail::Undelivered(int len)
 	{
+	// Data still in the buffer comes before the gap.
+	top_level->FlushPendingData();
+
 	cur_entity_id = file_mgr->Gap(cur_entity_len, len,
 	                              analyzer->GetAnalyzerTag(), analyzer->Conn(),
 	                              is_orig, cur_entity_id);
@@ -446,11 +449,15 @@ void MIME_Multiline::append(int len, const char* data)
 	buffer.push_back(new BroString((const u_char*) data, len, 1));
 	}
 
-BroString* MIME_Multiline::get_concatenated_line()
+const BroString* MIME_Multiline::get_concatenated_line()
 	{
 	if ( buffer.size() == 0 )
 		return 0;
 
+	// Most headers fit on a single line, which we can use as is.
+	if ( buffer.size() == 1 )
+		return buffer[0];
+
 	delete line;
 	line = concatenate(buffer);
 
@@ -463,7 +470,7 @@ MIME_Header::MIME_Header(MIME_Multiline* hl)
 	lines = hl;
 	name = value = value_token = rest_value = null_data_chunk;
 
-	BroString* s = hl->get_concatenated_line();
+	const BroString* s = hl->get_concatenated_line();
 	int len = s->Len();
 	const char* data = (const char*) s->Bytes();
 
@@ -739,7 +746,13 @@ void MIME_Entity::FinishHeader()
 		{
 		ParseMIMEHeader(h);
 		SubmitHeader(h);
-		headers.push_back(h);
+
+		// Only hold on to the header if someone is going to
+		// look at the full list later.
+		if ( message->KeepsHeaders() )
+			headers.push_back(h);
+		else
+			delete h;
 		}
 	else
 		delete h;
@@ -793,9 +806,10 @@ int MIME_Entity::ParseContentTypeField(MIME_Header* h)
 	len -= offset;
 
 	Unref(content_type_str);
-	content_type_str = (new StringVal(ty.length, ty.data))->ToUpper();
+	content_type_str = val_mgr->GetInternedString(ty.length, ty.data, true);
 	Unref(content_subtype_str);
-	content_subtype_str = (new StringVal(subty.length, subty.data))->ToUpper();
+	content_subtype_str =
+		val_mgr->GetInternedString(subty.length, subty.data, true);
 
 	ParseContentType(ty, subty);
 
@@ -1010,7 +1024,9 @@ void MIME_Entity::DecodeDataLine(int len, const char* data, int trailing_CRLF)
 			DecodeBinary(len, data, trailing_CRLF);
 			break;
 	}
-	FlushData();
+
+	if ( message->SubmitsEachLine() )
+		FlushData();
 	}
 
 void MIME_Entity::DecodeBinary(int len, const char* data, int trailing_CRLF)
@@ -1113,16 +1129,27 @@ void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 
 void MIME_Entity::DecodeBase64(int len, const char* data)
 	{
-	int rlen;
-	char rbuf[128];
-
+	// Decode straight into the data buffer.
 	while ( len > 0 )
 		{
-		rlen = 128;
-		char* prbuf = rbuf;
+		if ( data_buf_offset < 0 && ! GetDataBuffer() )
+			return;
+
+		int rlen = data_buf_length - data_buf_offset;
+		char* prbuf = data_buf_data + data_buf_offset;
 		int decoded = base64_decoder->Decode(len, data, &rlen, &prbuf);
-		DataOctets(rlen, rbuf);
+		data_buf_offset += rlen;
 		len -= decoded; data += decoded;
+
+		if ( data_buf_offset == data_buf_length )
+			{
+			SubmitData(data_buf_length, data_buf_data);
+			data_buf_offset = -1;
+			}
+
+		else if ( decoded == 0 )
+			// Not enough room left for the next group.
+			FlushData();
 		}
 	}
 
@@ -1227,6 +1254,14 @@ void MIME_Entity::FlushData()
 		}
 	}
 
+void MIME_Entity::FlushPendingData()
+	{
+	if ( current_child_entity )
+		current_child_entity->FlushPendingData();
+
+	FlushData();
+	}
+
 void MIME_Entity::SubmitHeader(MIME_Header* h)
 	{
 	message->SubmitHeader(h);
@@ -1281,7 +1316,9 @@ void MIME_Entity::DebugPrintHeaders()
 RecordVal* MIME_Message::BuildHeaderVal(MIME_Header* h)
 	{
 	RecordVal* header_record = new RecordVal(mime_header_rec);
-	header_record->Assign(0, new_string_val(h->get_name())->ToUpper());
+	data_chunk_t name = h->get_name();
+	header_record->Assign(0, val_mgr->GetInternedString(name.length,
+							    name.data, true));
 	header_record->Assign(1, new_string_val(h->get_value()));
 	return header_record;
 	}
@@ -1292,7 +1329,7 @@ TableVal* MIME_Message::BuildHeaderTable(MIME_HeaderList& hlist)
 
 	for ( unsigned int i = 0; i < hlist.size(); ++i )
 		{
-		Val* index = new Val(i+1, TYPE_COUNT);	// index starting from 1
+		Val* index = val_mgr->GetCount(i+1);	// index starting from 1
 
 		MIME_Header* h = hlist[i];
 		RecordVal* header_record = BuildHeaderVal(h);
@@ -1355,7 +1392,7 @@ void MIME_Mail::Done()
 
 		val_list* vl = new val_list;
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(content_hash_length, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(content_hash_length));
 		vl->append(new StringVal(new BroString(1, digest, 16)));
 		analyzer->ConnectionEvent(mime_content_hash, vl);
 		}
@@ -1396,7 +1433,7 @@ void MIME_Mail::EndEntity(MIME_Entity* /* entity */)
 
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(s->Len(), TYPE_COUNT));
+		vl->append(val_mgr->GetCount(s->Len()));
 		vl->append(new StringVal(s));
 
 		analyzer->ConnectionEvent(mime_entity_data, vl);
@@ -1429,6 +1466,11 @@ void MIME_Mail::SubmitHeader(MIME_Header* h)
 		}
 	}
 
+bool MIME_Mail::KeepsHeaders() const
+	{
+	return mime_all_headers;
+	}
+
 void MIME_Mail::SubmitAllHeaders(MIME_HeaderList& hlist)
 	{
 	if ( mime_all_headers )
@@ -1472,7 +1514,7 @@ void MIME_Mail::SubmitData(int len, const char* buf)
 
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(data_len, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(data_len));
 		vl->append(new StringVal(data_len, data));
 		analyzer->ConnectionEvent(mime_segment_data, vl);
 		}
@@ -1519,7 +1561,7 @@ void MIME_Mail::SubmitAllData()
 
 		val_list* vl = new val_list();
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(s->Len(), TYPE_COUNT));
+		vl->append(val_mgr->GetCount(s->Len()));
 		vl->append(new StringVal(s));
 
 		analyzer->ConnectionEvent(mime_all_data, vl);
@@ -56,7 +56,7 @@ public:
 	~MIME_Multiline();
 
 	void append(int len, const char* data);
-	BroString* get_concatenated_line();
+	const BroString* get_concatenated_line();
 
 protected:
 	vector<const BroString*> buffer;
@@ -95,6 +95,10 @@ public:
 	virtual void Deliver(int len, const char* data, int trailing_CRLF);
 	virtual void EndOfData();
 
+	// Passes on any decoded data still buffered by this entity or
+	// its children.
+	void FlushPendingData();
+
 	MIME_Entity* Parent() const { return parent; }
 	int MIMEContentType() const { return content_type; }
 	StringVal* ContentType() const { return content_type_str; }
@@ -218,6 +222,17 @@ public:
 	virtual int RequestBuffer(int* plen, char** pbuf) = 0;
 	virtual void SubmitEvent(int event_type, const char* detail) = 0;
 
+	// Returns true if SubmitAllHeaders() needs to see the entity's
+	// headers. If not, each header is discarded once it has been
+	// passed to SubmitHeader().
+	virtual bool KeepsHeaders() const	{ return true; }
+
+	// Returns true if each line of entity data needs to be passed to
+	// SubmitData() as soon as it has been decoded. If not, data goes
+	// out only once the buffer from RequestBuffer() is full, or at
+	// the end of the entity.
+	virtual bool SubmitsEachLine() const	{ return true; }
+
 protected:
 	analyzer::Analyzer* analyzer;
 
@@ -238,6 +253,8 @@ public:
 	void EndEntity(MIME_Entity* entity);
 	void SubmitHeader(MIME_Header* h);
 	void SubmitAllHeaders(MIME_HeaderList& hlist);
+	bool KeepsHeaders() const;
+	bool SubmitsEachLine() const	{ return false; }
 	void SubmitData(int len, const char* buf);
 	int RequestBuffer(int* plen, char** pbuf);
 	void SubmitAllData();
@@ -7,9 +7,12 @@
 
 using namespace analyzer::pia;
 
+PIA::Stats PIA::stats;
+
 PIA::PIA(analyzer::Analyzer* arg_as_analyzer)
 	: state(INIT), as_analyzer(arg_as_analyzer), conn(), current_packet()
 	{
+	++stats.pias;
 	}
 
 PIA::~PIA()
@@ -102,8 +105,11 @@ void PIA::PIA_DeliverPacket(int len, const u_char* data, bool is_orig, uint64 se
 		{
 		AddToBuffer(&pkt_buffer, seq, len, data, is_orig, ip);
 		if ( pkt_buffer.size > dpd_buffer_size )
+			{
 			new_state = dpd_match_only_beginning ?
 						SKIPPING : MATCHING_ONLY;
+			++stats.overflowed;
+			}
 		}
 
 	// FIXME: I'm not sure why it does not work with eol=true...
@@ -157,6 +163,7 @@ void PIA_UDP::ActivateAnalyzer(analyzer::Tag tag, const Rule* rule)
 	if ( ! a )
 		return;
 
+	++stats.activated;
 	a->SetSignature(rule);
 	ReplayPacketBuffer(a);
 	}
@@ -254,13 +261,34 @@ void PIA_TCP::DeliverStream(int len, const u_char* data, bool is_orig)
 		{
 		AddToBuffer(&stream_buffer, len, data, is_orig);
 		if ( stream_buffer.size > dpd_buffer_size )
+			{
 			new_state = dpd_match_only_beginning ?
 						SKIPPING : MATCHING_ONLY;
+			++stats.overflowed;
+			}
 		}
 
 	DoMatch(data, len, is_orig, false, false, false, 0);
 
 	stream_buffer.state = new_state;
+
+	if ( stream_buffer.state != SKIPPING )
+		CheckExhausted();
+	}
+
+void PIA_TCP::CheckExhausted()
+	{
+	// Only payload signatures activate analyzers through us. Once
+	// they've all failed for both sides, further payload is of no use.
+	// (Signatures matching on data from other analyzers may still
+	// activate some, with what we've buffered so far.)
+	if ( rule_matcher && ! PayloadExhausted() )
+		return;
+
+	DBG_LOG(DBG_ANALYZER, "PIA_TCP[%d] no signature can match anymore", GetID());
+
+	pkt_buffer.state = stream_buffer.state = SKIPPING;
+	++stats.exhausted;
 	}
 
 void PIA_TCP::Undelivered(uint64 seq, int len, bool is_orig)
@@ -288,6 +316,7 @@ void PIA_TCP::ActivateAnalyzer(analyzer::Tag tag, const Rule* rule)
 		return;
 
 	analyzer::Analyzer* a = Parent()->AddChildAnalyzer(tag);
+	++stats.activated;
 	a->SetSignature(rule);
 
 	// We have two cases here:
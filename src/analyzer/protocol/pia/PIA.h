@@ -39,6 +39,16 @@ public:
 	// as pointer to an Analyzer.
 	analyzer::Analyzer* AsAnalyzer()	{ return as_analyzer; }
 
+	// Statistics about protocol detection, across all PIAs.
+	struct Stats {
+		uint64 pias;		// # PIAs created
+		uint64 activated;	// # analyzers activated by signatures
+		uint64 exhausted;	// # PIAs done early, as nothing could match
+		uint64 overflowed;	// # buffers that filled up
+	};
+
+	static const Stats& GetStats()	{ return stats; }
+
 protected:
 	void PIA_Done();
 	void PIA_DeliverPacket(int len, const u_char* data, bool is_orig,
@@ -81,6 +91,8 @@ protected:
 
 	Buffer pkt_buffer;
 
+	static Stats stats;
+
 private:
 	analyzer::Analyzer* as_analyzer;
 	Connection* conn;
@@ -140,6 +152,11 @@ public:
 
 	void ReplayStreamBuffer(analyzer::Analyzer* analyzer);
 
+	// Signatures may go by the size of the payload, so we want the
+	// segments as they are until we're done matching.
+	virtual int StreamCoalescing() const
+		{ return stream_buffer.state == SKIPPING ? -1 : 0; }
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new PIA_TCP(conn); }
 
@@ -155,6 +172,9 @@ protected:
 		{
 		Analyzer::DeliverPacket(len, data, is_orig, seq, ip, caplen);
 		PIA_DeliverPacket(len, data, is_orig, seq, ip, caplen, false);
+
+		if ( pkt_buffer.state != SKIPPING )
+			CheckExhausted();
 		}
 
 	virtual void DeliverStream(int len, const u_char* data, bool is_orig);
@@ -164,6 +184,9 @@ protected:
 					const Rule* rule = 0);
 	virtual void DeactivateAnalyzer(analyzer::Tag tag);
 
+	// Stops buffering and matching once no signature can match anymore.
+	void CheckExhausted();
+
 private:
 	// FIXME: Not sure yet whether we need both pkt_buffer and stream_buffer.
 	// In any case, it's easier this way...
@@ -15,6 +15,7 @@ public:
 	void DeliverStream(int len, const u_char* data, bool orig) override;
 	void Undelivered(uint64 seq, int len, bool orig) override;
 	void EndpointEOF(bool is_orig) override;
+	int StreamCoalescing() const override	{ return 64 * 1024; }
 
 	bool HasSMBHeader(int len, const u_char* data);
 	void NeedResync() {
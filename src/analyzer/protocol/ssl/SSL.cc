@@ -54,14 +54,100 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		// deliver data to the other side if the script layer can handle this.
 		return;
 
-	try
+	RecordTracker* t = &trackers[orig];
+
+	while ( len > 0 )
 		{
-		interp->NewData(orig, data, data + len);
+		if ( t->fast )
+			{
+			TrackRecords(t, len, data, orig);
+			return;
+			}
+
+		// Hand the parser one record at a time, so that we notice
+		// when the session is established without it having
+		// buffered any of the next record yet.
+		int n = t->valid ? TrackRecords(t, len, data, orig) : len;
+
+		try
+			{
+			interp->NewData(orig, data, data + n);
+			}
+		catch ( const binpac::Exception& e )
+			{
+			ProtocolViolation(fmt("Binpac exception: %s", e.c_msg()));
+			return;
+			}
+
+		data += n;
+		len -= n;
+
+		if ( t->valid && t->AtBoundary() && interp->established() &&
+		     interp->state(orig) == binpac::SSL::STATE_ENCRYPTED )
+			t->fast = true;
 		}
-	catch ( const binpac::Exception& e )
+	}
+
+int SSL_Analyzer::TrackRecords(RecordTracker* t, int len, const u_char* data,
+				bool orig)
+	{
+	int n = 0;
+
+	while ( n < len )
 		{
-		ProtocolViolation(fmt("Binpac exception: %s", e.c_msg()));
+		if ( t->remaining > 0 )
+			{
+			uint32 k = min(uint32(len - n), t->remaining);
+			n += k;
+			t->remaining -= k;
+
+			if ( t->remaining > 0 )
+				continue;
+			}
+
+		else
+			{
+			while ( t->hdr_len < 5 && n < len )
+				t->hdr[t->hdr_len++] = data[n++];
+
+			if ( t->hdr_len < 5 )
+				continue;
+
+			// Any TLS record has one of the content types from 20
+			// to 24 and a major version of 3. Anything else is
+			// SSLv2, which we leave to the parser, or garbage
+			// after the handshake.
+			if ( t->hdr[0] < 20 || t->hdr[0] > 24 || t->hdr[1] != 3 )
+				{
+				if ( t->fast )
+					{
+					ProtocolViolation("Invalid SSL record after encryption started");
+					had_gap = true;
+					}
+
+				t->valid = false;
+				t->fast = false;
+				return len;
+				}
+
+			t->remaining = (t->hdr[3] << 8) | t->hdr[4];
+
+			if ( t->remaining > 0 )
+				continue;
+			}
+
+		// A record is complete.
+		if ( t->fast && ssl_encrypted_data )
+			BifEvent::generate_ssl_encrypted_data(this, Conn(), orig,
+				t->hdr[0], (t->hdr[3] << 8) | t->hdr[4]);
+
+		t->hdr_len = 0;
+
+		if ( ! t->fast )
+			return n;
 		}
+
+	return n;
 	}
 
 void SSL_Analyzer::SendHandshake(const u_char* begin, const u_char* end, bool orig)
@@ -26,13 +26,40 @@ public:
 	// Overriden from tcp::TCP_ApplicationAnalyzer.
 	virtual void EndpointEOF(bool is_orig);
 
+	// Records span segments anyway; takes up to about one at a time.
+	virtual int StreamCoalescing() const	{ return 16 * 1024; }
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new SSL_Analyzer(conn); }
 
 protected:
+	// Follows the record framing of one direction, so that once the
+	// session is established we can take over from the parser at a
+	// record boundary. Past that, records carry nothing but their
+	// headers for us, and walking over them here is much cheaper
+	// than having binpac buffer and parse each of them.
+	struct RecordTracker {
+		bool valid;	// false if the framing isn't TLS'
+		bool fast;	// we've taken over from the parser
+		u_char hdr[5];
+		int hdr_len;	// header bytes seen of the current record
+		uint32 remaining;	// body bytes left of the current record
+
+		RecordTracker()	{ valid = true; fast = false; hdr_len = 0; remaining = 0; }
+
+		bool AtBoundary() const	{ return hdr_len == 0 && remaining == 0; }
+	};
+
+	// Advances the tracker over the data, up to the end of the current
+	// record, or through all of the data when it's fast forwarding.
+	// Returns the number of bytes consumed.
+	int TrackRecords(RecordTracker* t, int len, const u_char* data,
+			 bool orig);
+
 	binpac::SSL::SSL_Conn* interp;
 	binpac::TLSHandshake::Handshake_Conn* handshake_interp;
 	bool had_gap;
+	RecordTracker trackers[2];	// indexed by orig
 
 };
 
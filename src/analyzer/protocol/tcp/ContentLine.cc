@@ -1,5 +1,9 @@
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "ContentLine.h"
 #include "analyzer/protocol/tcp/TCP.h"
 
@@ -7,6 +11,46 @@
 
 using namespace analyzer::tcp;
 
+// Returns the number of bytes at the start of data that line splitting
+// doesn't need to look at individually, i.e., those up to the first CR or
+// LF (or NUL, if nul is true).
+static int plain_prefix(const u_char* data, int len, bool nul)
+	{
+	int i = 0;
+
+#ifdef __SSE2__
+	// Compare 16 bytes at a time.
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+					 _mm_cmpeq_epi8(v, lf));
+
+		if ( nul )
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, zero));
+
+		int bits = _mm_movemask_epi8(m);
+
+		if ( bits )
+			return i + __builtin_ctz(bits);
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		{
+		u_char c = data[i];
+
+		if ( c == '\r' || c == '\n' || (c == '\0' && nul) )
+			break;
+		}
+
+	return i;
+	}
+
 ContentLine_Analyzer::ContentLine_Analyzer(Connection* conn, bool orig)
 : TCP_SupportAnalyzer("CONTENTLINE", conn, orig)
 	{
@@ -213,6 +257,28 @@ int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 
 	for ( ; len > 0; --len, ++data )
 		{
+		if ( last_char != '\r' )
+			{
+			// Copy everything up to the next byte needing a
+			// closer look in one go.
+			int n = plain_prefix(data, len, flag_NULs);
+
+			if ( n > 0 )
+				{
+				if ( offset + n >= buf_len )
+					InitBuffer(max(buf_len * 2, offset + n + 1));
+
+				memcpy(buf + offset, data, n);
+				offset += n;
+				last_char = data[n - 1];
+				data += n;
+				len -= n;
+
+				if ( len == 0 )
+					break;
+				}
+			}
+
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
@@ -103,14 +103,14 @@ static RecordVal* build_syn_packet_val(int is_orig, const IP_Hdr* ip,
 
 	RecordVal* v = new RecordVal(SYN_packet);
 
-	v->Assign(0, new Val(is_orig, TYPE_BOOL));
-	v->Assign(1, new Val(int(ip->DF()), TYPE_BOOL));
-	v->Assign(2, new Val((ip->TTL()), TYPE_COUNT));
-	v->Assign(3, new Val((ip->TotalLen()), TYPE_COUNT));
-	v->Assign(4, new Val(ntohs(tcp->th_win), TYPE_COUNT));
-	v->Assign(5, new Val(winscale, TYPE_INT));
-	v->Assign(6, new Val(MSS, TYPE_COUNT));
-	v->Assign(7, new Val(SACK, TYPE_BOOL));
+	v->Assign(0, val_mgr->GetBool(is_orig));
+	v->Assign(1, val_mgr->GetBool(int(ip->DF())));
+	v->Assign(2, val_mgr->GetCount((ip->TTL())));
+	v->Assign(3, val_mgr->GetCount((ip->TotalLen())));
+	v->Assign(4, val_mgr->GetCount(ntohs(tcp->th_win)));
+	v->Assign(5, val_mgr->GetInt(winscale));
+	v->Assign(6, val_mgr->GetCount(MSS));
+	v->Assign(7, val_mgr->GetBool(SACK));
 
 	return v;
 	}
@@ -252,7 +252,7 @@ static RecordVal* build_os_val(int is_orig, const IP_Hdr* ip,
 		}
 
 	struct os_type os_from_print;
-	int id = sessions->Get_OS_From_SYN(&os_from_print,
+	int id = sessions->Get_OS_From_SYN(ip->SrcAddr(), &os_from_print,
 			uint16(ip->TotalLen()),
 			uint8(ip->DF()), uint8(ip->TTL()),
 			uint16(ntohs(tcp->th_win)),
@@ -270,9 +270,9 @@ static RecordVal* build_os_val(int is_orig, const IP_Hdr* ip,
 		if ( os_from_print.desc )
 			os->Assign(1, new StringVal(os_from_print.desc));
 		else
-			os->Assign(1, new StringVal(""));
+			os->Assign(1, val_mgr->GetEmptyString());
 
-		os->Assign(2, new Val(os_from_print.dist, TYPE_COUNT));
+		os->Assign(2, val_mgr->GetCount(os_from_print.dist));
 		os->Assign(3, new EnumVal(os_from_print.match, OS_version_inference));
 
 		return os;
@@ -311,6 +311,8 @@ static void passive_fingerprint(TCP_Analyzer* tcp, bool is_orig,
 		}
 	}
 
+ObjPool analyzer::tcp::TCP_Analyzer_pool("TCP_Analyzer", sizeof(TCP_Analyzer));
+
 TCP_Analyzer::TCP_Analyzer(Connection* conn)
 : TransportLayerAnalyzer("TCP", conn)
 	{
@@ -325,6 +327,7 @@ TCP_Analyzer::TCP_Analyzer(Connection* conn)
 	is_active = 1;
 	finished = 0;
 	reassembling = 0;
+	header_only = 0;
 	first_packet_seen = 0;
 	is_partial = 0;
 
@@ -353,6 +356,13 @@ void TCP_Analyzer::Init()
 
 void TCP_Analyzer::Done()
 	{
+	// The children get what's held back for them before they finish.
+	if ( orig->contents_processor )
+		orig->contents_processor->FlushCoalesced();
+
+	if ( resp->contents_processor )
+		resp->contents_processor->FlushCoalesced();
+
 	Analyzer::Done();
 
 	if ( terminating && connection_pending && is_active && ! BothClosed() )
@@ -418,12 +428,29 @@ void TCP_Analyzer::SetReassembler(TCP_Reassembler* rorig,
 	resp->AddReassembler(rresp);
 	rresp->SetDstAnalyzer(this);
 
+	if ( header_only )
+		{
+		rorig->StopDeliveries();
+		rresp->StopDeliveries();
+		}
+
 	if ( new_connection_contents && reassembling == 0 )
 		Event(new_connection_contents);
 
 	reassembling = 1;
 	}
 
+void TCP_Analyzer::SetHeaderOnly()
+	{
+	header_only = 1;
+
+	if ( orig->contents_processor )
+		orig->contents_processor->StopDeliveries();
+
+	if ( resp->contents_processor )
+		resp->contents_processor->StopDeliveries();
+	}
+
 const struct tcphdr* TCP_Analyzer::ExtractTCP_Header(const u_char*& data,
 							int& len, int& caplen)
 	{
@@ -456,6 +483,7 @@ bool TCP_Analyzer::ValidateChecksum(const struct tcphdr* tp,
 				TCP_Endpoint* endpoint, int len, int caplen)
 	{
 	if ( ! ignore_checksums && caplen >= len &&
+	     ! current_checksums_verified() &&
 	     ! endpoint->ValidChecksum(tp, len) )
 		{
 		Weird("bad_TCP_checksum");
@@ -955,11 +983,11 @@ void TCP_Analyzer::GeneratePacketEvent(
 	val_list* vl = new val_list();
 
 	vl->append(BuildConnVal());
-	vl->append(new Val(is_orig, TYPE_BOOL));
+	vl->append(val_mgr->GetBool(is_orig));
 	vl->append(new StringVal(flags.AsString()));
-	vl->append(new Val(rel_seq, TYPE_COUNT));
-	vl->append(new Val(flags.ACK() ? rel_ack : 0, TYPE_COUNT));
-	vl->append(new Val(len, TYPE_COUNT));
+	vl->append(val_mgr->GetCount(rel_seq));
+	vl->append(val_mgr->GetCount(flags.ACK() ? rel_ack : 0));
+	vl->append(val_mgr->GetCount(len));
 
 	// We need the min() here because Ethernet padding can lead to
 	// caplen > len.
@@ -1235,6 +1263,25 @@ void TCP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 	TCP_Flags flags(tp);
 	SetPartialStatus(flags, endpoint->IsOrig());
 
+	if ( tcp_coalesce_max_bytes > 0 )
+		{
+		// Data held back for coalescing waits no longer than
+		// tcp_coalesce_max_delay, and not past a FIN or RST.
+		bool closing = flags.FIN() || flags.RST();
+		TCP_Reassembler* r[2] = { orig->contents_processor, resp->contents_processor };
+
+		for ( int i = 0; i < 2; ++i )
+			{
+			if ( ! r[i] )
+				continue;
+
+			if ( closing )
+				r[i]->FlushCoalesced();
+			else
+				r[i]->FlushCoalescedIfDue(current_timestamp);
+			}
+		}
+
 	uint32 base_seq = ntohl(tp->th_seq);
 	uint32 ack_seq = ntohl(tp->th_ack);
 
@@ -1386,6 +1433,8 @@ void TCP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	CheckRecording(need_contents, flags);
 
+	Conn()->CountPacket(is_orig, ip->TotalLen());
+
 	// Handle child_packet analyzers.  Note: This happens *after* the
 	// packet has been processed and the TCP state updated.
 	LOOP_OVER_GIVEN_CHILDREN(i, packet_children)
@@ -1424,10 +1473,10 @@ void TCP_Analyzer::UpdateConnVal(RecordVal *conn_val)
 	RecordVal *orig_endp_val = conn_val->Lookup("orig")->AsRecordVal();
 	RecordVal *resp_endp_val = conn_val->Lookup("resp")->AsRecordVal();
 
-	orig_endp_val->Assign(0, new Val(orig->Size(), TYPE_COUNT));
-	orig_endp_val->Assign(1, new Val(int(orig->state), TYPE_COUNT));
-	resp_endp_val->Assign(0, new Val(resp->Size(), TYPE_COUNT));
-	resp_endp_val->Assign(1, new Val(int(resp->state), TYPE_COUNT));
+	orig_endp_val->Assign(0, val_mgr->GetCount(orig->Size()));
+	orig_endp_val->Assign(1, val_mgr->GetCount(int(orig->state)));
+	resp_endp_val->Assign(0, val_mgr->GetCount(resp->Size()));
+	resp_endp_val->Assign(1, val_mgr->GetCount(int(resp->state)));
 
 	// Call children's UpdateConnVal
 	Analyzer::UpdateConnVal(conn_val);
@@ -1437,6 +1486,24 @@ void TCP_Analyzer::UpdateConnVal(RecordVal *conn_val)
 		(*i)->UpdateConnVal(conn_val);
 	}
 
+unsigned int TCP_Analyzer::MemoryAllocation() const
+	{
+	unsigned int mem = Analyzer::MemoryAllocation() +
+		2 * padded_sizeof(TCP_Endpoint);
+
+	// Include the data buffered for reassembly.
+	if ( orig->contents_processor )
+		mem += orig->contents_processor->MemoryAllocation();
+
+	if ( resp->contents_processor )
+		mem += resp->contents_processor->MemoryAllocation();
+
+	LOOP_OVER_GIVEN_CONST_CHILDREN(i, packet_children)
+		mem += (*i)->MemoryAllocation();
+
+	return mem;
+	}
+
 int TCP_Analyzer::ParseTCPOptions(const struct tcphdr* tcp,
 					proc_tcp_option_t proc,
 					TCP_Analyzer* analyzer,
@@ -1493,9 +1560,9 @@ int TCP_Analyzer::TCPOptionEvent(unsigned int opt,
 		val_list* vl = new val_list();
 
 		vl->append(analyzer->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
-		vl->append(new Val(opt, TYPE_COUNT));
-		vl->append(new Val(optlen, TYPE_COUNT));
+		vl->append(val_mgr->GetBool(is_orig));
+		vl->append(val_mgr->GetCount(opt));
+		vl->append(val_mgr->GetCount(optlen));
 
 		analyzer->ConnectionEvent(tcp_option, vl);
 		}
@@ -1815,7 +1882,7 @@ void TCP_Analyzer::EndpointEOF(TCP_Reassembler* endp)
 		{
 		val_list* vl = new val_list();
 		vl->append(BuildConnVal());
-		vl->append(new Val(endp->IsOrig(), TYPE_BOOL));
+		vl->append(val_mgr->GetBool(endp->IsOrig()));
 		ConnectionEvent(connection_EOF, vl);
 		}
 
@@ -2097,11 +2164,11 @@ int TCPStats_Endpoint::DataSent(double /* t */, uint64 seq, int len, int caplen,
 			{
 			val_list* vl = new val_list();
 			vl->append(endp->TCP()->BuildConnVal());
-			vl->append(new Val(endp->IsOrig(), TYPE_BOOL));
-			vl->append(new Val(seq, TYPE_COUNT));
-			vl->append(new Val(len, TYPE_COUNT));
-			vl->append(new Val(data_in_flight, TYPE_COUNT));
-			vl->append(new Val(endp->peer->window, TYPE_COUNT));
+			vl->append(val_mgr->GetBool(endp->IsOrig()));
+			vl->append(val_mgr->GetCount(seq));
+			vl->append(val_mgr->GetCount(len));
+			vl->append(val_mgr->GetCount(data_in_flight));
+			vl->append(val_mgr->GetCount(endp->peer->window));
 
 			endp->TCP()->ConnectionEvent(tcp_rexmit, vl);
 			}
@@ -2116,13 +2183,13 @@ RecordVal* TCPStats_Endpoint::BuildStats()
 	{
 	RecordVal* stats = new RecordVal(endpoint_stats);
 
-	stats->Assign(0, new Val(num_pkts,TYPE_COUNT));
-	stats->Assign(1, new Val(num_rxmit,TYPE_COUNT));
-	stats->Assign(2, new Val(num_rxmit_bytes,TYPE_COUNT));
-	stats->Assign(3, new Val(num_in_order,TYPE_COUNT));
-	stats->Assign(4, new Val(num_OO,TYPE_COUNT));
-	stats->Assign(5, new Val(num_repl,TYPE_COUNT));
-	stats->Assign(6, new Val(endian_type,TYPE_COUNT));
+	stats->Assign(0, val_mgr->GetCount(num_pkts));
+	stats->Assign(1, val_mgr->GetCount(num_rxmit));
+	stats->Assign(2, val_mgr->GetCount(num_rxmit_bytes));
+	stats->Assign(3, val_mgr->GetCount(num_in_order));
+	stats->Assign(4, val_mgr->GetCount(num_OO));
+	stats->Assign(5, val_mgr->GetCount(num_repl));
+	stats->Assign(6, val_mgr->GetCount(endian_type));
 
 	return stats;
 	}
@@ -24,13 +24,25 @@ class TCP_Endpoint;
 class TCP_ApplicationAnalyzer;
 class TCP_Reassembler;
 
+extern ObjPool TCP_Analyzer_pool;
+
 class TCP_Analyzer : public analyzer::TransportLayerAnalyzer {
+	DECLARE_POOL_ALLOCATION(TCP_Analyzer)
+
 public:
 	TCP_Analyzer(Connection* conn);
 	virtual ~TCP_Analyzer();
 
 	void EnableReassembly();
 
+	// Switches the connection to tracking just headers.  Both
+	// endpoints keep following sequence numbers, flags and sizes, so
+	// the connection's state and sizes stay accurate, but reassembly
+	// stops buffering payload and child analyzers don't get any more
+	// of it.  Cannot be undone.
+	void SetHeaderOnly();
+	bool IsHeaderOnly() const	{ return header_only; }
+
 	// Add a child analyzer that will always get the packets,
 	// independently of whether we do any reassembly.
 	void AddChildPacketAnalyzer(analyzer::Analyzer* a);
@@ -72,6 +84,7 @@ public:
 
 	// From Analyzer.h
 	virtual void UpdateConnVal(RecordVal *conn_val);
+	virtual unsigned int MemoryAllocation() const;
 
 	// Needs to be static because it's passed as a pointer-to-function
 	// rather than pointer-to-member-function.
@@ -184,6 +197,7 @@ private:
 
 	unsigned int first_packet_seen: 2;
 	unsigned int reassembling: 1;
+	unsigned int header_only: 1;
 	unsigned int is_partial: 1;
 	unsigned int is_active: 1;
 	unsigned int finished: 1;
@@ -251,6 +265,10 @@ public:
 	//  delete them when done with them.
 	virtual void SetEnv(bool orig, char* name, char* val);
 
+	// Application analyzers get each segment as it comes unless they
+	// say otherwise, as some go by the segment sizes.
+	virtual int StreamCoalescing() const	{ return 0; }
+
 private:
 	TCP_Analyzer* tcp;
 };
@@ -13,6 +13,8 @@
 
 using namespace analyzer::tcp;
 
+ObjPool analyzer::tcp::TCP_Endpoint_pool("TCP_Endpoint", sizeof(TCP_Endpoint));
+
 TCP_Endpoint::TCP_Endpoint(TCP_Analyzer* arg_analyzer, int arg_is_orig)
 	{
 	contents_processor = 0;
@@ -236,7 +238,7 @@ int TCP_Endpoint::DataSent(double t, uint64 seq, int len, int caplen,
 				{
 				val_list* vl = new val_list();
 				vl->append(Conn()->BuildConnVal());
-				vl->append(new Val(IsOrig(), TYPE_BOOL));
+				vl->append(val_mgr->GetBool(IsOrig()));
 				vl->append(new StringVal(buf));
 				tcp_analyzer->ConnectionEvent(contents_file_write_failure, vl);
 				}
@@ -4,6 +4,7 @@
 #define ANALYZER_PROTOCOL_TCP_TCP_ENDPOINT_H
 
 #include "IPAddr.h"
+#include "ObjPool.h"
 
 class Connection;
 class IP_Hdr;
@@ -24,8 +25,12 @@ typedef enum {
 	TCP_ENDPOINT_RESET	// RST seen
 } EndpointState;
 
+extern ObjPool TCP_Endpoint_pool;
+
 // One endpoint of a TCP connection.
 class TCP_Endpoint {
+	DECLARE_POOL_ALLOCATION(TCP_Endpoint)
+
 public:
 	TCP_Endpoint(TCP_Analyzer* analyzer, int is_orig);
 	~TCP_Endpoint();
@@ -15,6 +15,9 @@ const bool DEBUG_tcp_contents = false;
 const bool DEBUG_tcp_connection_close = false;
 const bool DEBUG_tcp_match_undelivered = false;
 
+ObjPool analyzer::tcp::TCP_Reassembler_pool("TCP_Reassembler",
+					  sizeof(TCP_Reassembler));
+
 TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 				TCP_Analyzer* arg_tcp_analyzer,
 				TCP_Reassembler::Type arg_type,
@@ -32,6 +35,10 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	did_EOF = 0;
 	seq_to_skip = 0;
 	in_delivery = false;
+	coalesce_buf = 0;
+	coalesce_len = coalesce_size = 0;
+	coalesce_seq = 0;
+	coalesce_since = 0;
 
 	if ( tcp_max_old_segments )
 		SetMaxOldBlocks(tcp_max_old_segments);
@@ -56,10 +63,12 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 TCP_Reassembler::~TCP_Reassembler()
 	{
 	Unref(record_contents_file);
+	delete [] coalesce_buf;
 	}
 
 void TCP_Reassembler::Done()
 	{
+	FlushCoalesced();
 	MatchUndelivered(-1, true);
 
 	if ( record_contents_file )
@@ -133,13 +142,15 @@ void TCP_Reassembler::Gap(uint64 seq, uint64 len)
 	// The one opportunity we lose here is on clean FIN
 	// handshakes, but Oh Well.
 
+	FlushCoalesced();
+
 	if ( report_gap(endp, endp->peer) )
 		{
 		val_list* vl = new val_list;
 		vl->append(dst_analyzer->BuildConnVal());
-		vl->append(new Val(IsOrig(), TYPE_BOOL));
-		vl->append(new Val(seq, TYPE_COUNT));
-		vl->append(new Val(len, TYPE_COUNT));
+		vl->append(val_mgr->GetBool(IsOrig()));
+		vl->append(val_mgr->GetCount(seq));
+		vl->append(val_mgr->GetCount(len));
 		dst_analyzer->ConnectionEvent(content_gap, vl);
 		}
 
@@ -336,7 +347,7 @@ void TCP_Reassembler::RecordBlock(DataBlock* b, BroFile* f)
 		{
 		val_list* vl = new val_list();
 		vl->append(Endpoint()->Conn()->BuildConnVal());
-		vl->append(new Val(IsOrig(), TYPE_BOOL));
+		vl->append(val_mgr->GetBool(IsOrig()));
 		vl->append(new StringVal("TCP reassembler content write failure"));
 		tcp_analyzer->ConnectionEvent(contents_file_write_failure, vl);
 		}
@@ -353,7 +364,7 @@ void TCP_Reassembler::RecordGap(uint64 start_seq, uint64 upper_seq, BroFile* f)
 		{
 		val_list* vl = new val_list();
 		vl->append(Endpoint()->Conn()->BuildConnVal());
-		vl->append(new Val(IsOrig(), TYPE_BOOL));
+		vl->append(val_mgr->GetBool(IsOrig()));
 		vl->append(new StringVal("TCP reassembler gap write failure"));
 		tcp_analyzer->ConnectionEvent(contents_file_write_failure, vl);
 		}
@@ -433,6 +444,12 @@ void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 		}
 	}
 
+void TCP_Reassembler::ReleaseBlocks()
+	{
+	tcp_analyzer->Weird("reassembly_memory_limit_exceeded");
+	Reassembler::ReleaseBlocks();
+	}
+
 IMPLEMENT_SERIAL(TCP_Reassembler, SER_TCP_REASSEMBLER);
 
 bool TCP_Reassembler::DoSerialize(SerialInfo* info) const
@@ -572,6 +589,7 @@ void TCP_Reassembler::CheckEOF()
 			}
 
 		did_EOF = 1;
+		FlushCoalesced();
 		tcp_analyzer->EndpointEOF(this);
 		}
 	}
@@ -597,8 +615,8 @@ void TCP_Reassembler::DeliverBlock(uint64 seq, int len, const u_char* data)
 		{
 		val_list* vl = new val_list();
 		vl->append(tcp_analyzer->BuildConnVal());
-		vl->append(new Val(IsOrig(), TYPE_BOOL));
-		vl->append(new Val(seq, TYPE_COUNT));
+		vl->append(val_mgr->GetBool(IsOrig()));
+		vl->append(val_mgr->GetCount(seq));
 		vl->append(new StringVal(len, (const char*) data));
 
 		tcp_analyzer->ConnectionEvent(tcp_contents, vl);
@@ -613,6 +631,49 @@ void TCP_Reassembler::DeliverBlock(uint64 seq, int len, const u_char* data)
 	if ( skip_deliveries )
 		return;
 
+	if ( endp->peer->contents_processor )
+		endp->peer->contents_processor->FlushCoalesced();
+
+	int bound = 0;
+
+	if ( type == Forward && tcp_coalesce_max_bytes > 0 && ! in_delivery )
+		{
+		bound = dst_analyzer->ChildrenStreamCoalescing();
+
+		if ( bound > tcp_coalesce_max_bytes )
+			bound = tcp_coalesce_max_bytes;
+		}
+
+	if ( coalesce_len &&
+	     (len >= bound || coalesce_len + len > bound ||
+	      coalesce_len + len > coalesce_size ||
+	      network_time - coalesce_since > tcp_coalesce_max_delay) )
+		FlushCoalesced();
+
+	if ( len < bound )
+		{
+		if ( ! coalesce_len )
+			{
+			if ( coalesce_size < bound )
+				{
+				delete [] coalesce_buf;
+				coalesce_buf = new u_char[bound];
+				coalesce_size = bound;
+				}
+
+			coalesce_seq = seq;
+			coalesce_since = network_time;
+			}
+
+		memcpy(coalesce_buf + coalesce_len, data, len);
+		coalesce_len += len;
+
+		if ( coalesce_len == bound )
+			FlushCoalesced();
+
+		return;
+		}
+
 	in_delivery = true;
 	Deliver(seq, len, data);
 	in_delivery = false;
@@ -622,6 +683,23 @@ void TCP_Reassembler::DeliverBlock(uint64 seq, int len, const u_char* data)
 
 	}
 
+void TCP_Reassembler::FlushCoalesced()
+	{
+	if ( ! coalesce_len || in_delivery )
+		return;
+
+	// Taken out first, as delivering may get us back here.
+	int len = coalesce_len;
+	coalesce_len = 0;
+
+	in_delivery = true;
+	Deliver(coalesce_seq, len, coalesce_buf);
+	in_delivery = false;
+
+	if ( coalesce_seq + len < seq_to_skip )
+		SkipToSeq(seq_to_skip);
+	}
+
 void TCP_Reassembler::SkipToSeq(uint64 seq)
 	{
 	if ( seq > seq_to_skip )
@@ -632,6 +710,18 @@ void TCP_Reassembler::SkipToSeq(uint64 seq)
 		}
 	}
 
+void TCP_Reassembler::StopDeliveries()
+	{
+	// What's held back arrived before; it would have gone out already.
+	FlushCoalesced();
+	skip_deliveries = 1;
+
+	// While a block is being delivered, we can't release it; the
+	// remaining ones then go away as they get acked.
+	if ( ! in_delivery )
+		ClearBlocks();
+	}
+
 int TCP_Reassembler::DataPending() const
 	{
 	// If we are skipping deliveries, the reassembler will not get called
@@ -12,7 +12,11 @@ namespace analyzer { namespace tcp {
 
 class TCP_Analyzer;
 
+extern ObjPool TCP_Reassembler_pool;
+
 class TCP_Reassembler : public Reassembler {
+	DECLARE_POOL_ALLOCATION(TCP_Reassembler)
+
 public:
 	enum Type {
 		Direct,		// deliver to destination analyzer itself
@@ -61,6 +65,11 @@ public:
 	// Can be used to skip HTTP data for performance considerations.
 	void SkipToSeq(uint64 seq);
 
+	// Stops buffering and delivering payload for good.  The endpoint
+	// still tracks sequence numbers, flags and sizes.
+	void StopDeliveries();
+	bool DeliveriesStopped() const	{ return skip_deliveries; }
+
 	int DataSent(double t, uint64 seq, int len, const u_char* data,
 		     analyzer::tcp::TCP_Flags flags, bool replaying=true);
 	void AckReceived(uint64 seq);
@@ -78,6 +87,19 @@ public:
 	void DeliverBlock(uint64 seq, int len, const u_char* data);
 	virtual void Deliver(uint64 seq, int len, const u_char* data);
 
+	// Passes on the in-order data held back for coalescing, if any.
+	// It goes out before anything else of the connection, so that the
+	// analyzers see both directions in order.
+	void FlushCoalesced();
+
+	// Does FlushCoalesced() if the data has waited for longer than
+	// tcp_coalesce_max_delay.
+	void FlushCoalescedIfDue(double t)
+		{
+		if ( coalesce_len && t - coalesce_since > tcp_coalesce_max_delay )
+			FlushCoalesced();
+		}
+
 	TCP_Endpoint* Endpoint()		{ return endp; }
 	const TCP_Endpoint* Endpoint() const	{ return endp; }
 
@@ -100,6 +122,7 @@ private:
 
 	void BlockInserted(DataBlock* b) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64 n) override;
+	void ReleaseBlocks() override;
 
 	TCP_Endpoint* endp;
 
@@ -113,6 +136,14 @@ private:
 	bool in_delivery;
 	analyzer::tcp::TCP_Flags flags;
 
+	// Small in-order segments held back to go out in one piece, for
+	// analyzers which agree to that; see Analyzer::StreamCoalescing().
+	u_char* coalesce_buf;
+	int coalesce_len;
+	int coalesce_size;	// allocated
+	uint64 coalesce_seq;
+	double coalesce_since;
+
 	BroFile* record_contents_file;	// file on which to reassemble contents
 
 	Analyzer* dst_analyzer;
@@ -58,7 +58,8 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	int chksum = up->uh_sum;
 
-	if ( ! ignore_checksums && caplen >= len )
+	if ( ! ignore_checksums && caplen >= len &&
+	     ! current_checksums_verified() )
 		{
 		bool bad = false;
 
@@ -122,7 +123,7 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 			{
 			val_list* vl = new val_list;
 			vl->append(BuildConnVal());
-			vl->append(new Val(is_orig, TYPE_BOOL));
+			vl->append(val_mgr->GetBool(is_orig));
 			vl->append(new StringVal(len, (const char*) data));
 			ConnectionEvent(udp_contents, vl);
 			}
@@ -165,7 +166,10 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 		}
 
 	if ( caplen >= len )
+		{
+		Conn()->CountPacket(is_orig, ip->TotalLen());
 		ForwardPacket(len, data, is_orig, seq, ip, caplen);
+		}
 	}
 
 void UDP_Analyzer::UpdateConnVal(RecordVal *conn_val)
@@ -185,14 +189,14 @@ void UDP_Analyzer::UpdateEndpointVal(RecordVal* endp, int is_orig)
 	bro_int_t size = is_orig ? request_len : reply_len;
 	if ( size < 0 )
 		{
-		endp->Assign(0, new Val(0, TYPE_COUNT));
-		endp->Assign(1, new Val(int(UDP_INACTIVE), TYPE_COUNT));
+		endp->Assign(0, val_mgr->GetCount(0));
+		endp->Assign(1, val_mgr->GetCount(int(UDP_INACTIVE)));
 		}
 
 	else
 		{
-		endp->Assign(0, new Val(size, TYPE_COUNT));
-		endp->Assign(1, new Val(int(UDP_ACTIVE), TYPE_COUNT));
+		endp->Assign(0, val_mgr->GetCount(size));
+		endp->Assign(1, val_mgr->GetCount(int(UDP_ACTIVE)));
 		}
 	}
 
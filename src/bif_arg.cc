@@ -22,6 +22,7 @@ static struct {
 };
 
 extern const char* arg_list_name;
+extern const char* direct_arg_list_name;
 
 BuiltinFuncArg::BuiltinFuncArg(const char* arg_name, int arg_type)
 	{
@@ -77,6 +78,19 @@ void BuiltinFuncArg::PrintCArg(FILE* fp, int n)
 	fprintf(fp, "%s %s", ctype, name);
 	}
 
+// Prints the expression converting the n'th argument of a direct entry
+// point to the C type.
+void BuiltinFuncArg::PrintCDirectArg(FILE* fp, int n)
+	{
+	fprintf(fp, "(%s) (", builtin_func_arg_type[type].c_type);
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "%s[%d]", direct_arg_list_name, n);
+	fprintf(fp, builtin_func_arg_type[type].accessor, buf);
+
+	fprintf(fp, ")");
+	}
+
 void BuiltinFuncArg::PrintBroValConstructor(FILE* fp)
 	{
 	fprintf(fp, builtin_func_arg_type[type].constructor, name);
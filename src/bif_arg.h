@@ -39,6 +39,7 @@ public:
 	void PrintBro(FILE* fp);
 	void PrintCDef(FILE* fp, int n);
 	void PrintCArg(FILE* fp, int n);
+	void PrintCDirectArg(FILE* fp, int n);
 	void PrintBroValConstructor(FILE* fp);
 
 protected:
@@ -50,14 +50,14 @@ struct val_converter {
 	result_type operator()(bool a)
 		{
 		if ( type->Tag() == TYPE_BOOL )
-			return new Val(a, TYPE_BOOL);
+			return val_mgr->GetBool(a);
 		return nullptr;
 		}
 
 	result_type operator()(uint64_t a)
 		{
 		if ( type->Tag() == TYPE_COUNT )
-			return new Val(a, TYPE_COUNT);
+			return val_mgr->GetCount(a);
 		if ( type->Tag() == TYPE_COUNTER )
 			return new Val(a, TYPE_COUNTER);
 		return nullptr;
@@ -66,7 +66,7 @@ struct val_converter {
 	result_type operator()(int64_t a)
 		{
 		if ( type->Tag() == TYPE_INT )
-			return new Val(a, TYPE_INT);
+			return val_mgr->GetInt(a);
 		return nullptr;
 		}
 
@@ -135,7 +135,7 @@ struct val_converter {
 	result_type operator()(broker::port& a)
 		{
 		if ( type->Tag() == TYPE_PORT )
-			return new PortVal(a.number(), bro_broker::to_bro_port_proto(a.type()));
+			return val_mgr->GetPort(a.number(), bro_broker::to_bro_port_proto(a.type()));
 
 		return nullptr;
 		}
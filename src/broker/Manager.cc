@@ -14,6 +14,8 @@
 #include "broker/store.bif.h"
 #include "logging/Manager.h"
 #include "DebugLogger.h"
+#include "Net.h"
+#include "Timer.h"
 #include "iosource/Manager.h"
 
 using namespace std;
@@ -24,8 +26,24 @@ int bro_broker::Manager::send_flags_self_idx;
 int bro_broker::Manager::send_flags_peers_idx;
 int bro_broker::Manager::send_flags_unsolicited_idx;
 
+// First element of a message carrying a batch of events.
+static const char* const event_batch_tag = "Broker::__event_batch";
+
+namespace bro_broker {
+
+class EventBatchTimer : public Timer {
+public:
+	EventBatchTimer(double t) : Timer(t, TIMER_BROKER_EVENT_BATCH)	{ }
+
+	void Dispatch(double t, int is_expire) override
+		{ broker_mgr->FlushEventBatches(); }
+};
+
+}
+
 bro_broker::Manager::Manager()
-	: iosource::IOSource(), next_timestamp(-1)
+	: iosource::IOSource(), event_batch_size(0), event_batch_interval(0),
+	  event_batch_timer_pending(false), next_timestamp(-1)
 	{
 	SetIdle(true);
 	}
@@ -124,6 +142,9 @@ bool bro_broker::Manager::Enable(Val* broker_endpoint_flags)
 			name = fmt("bro@<unknown>.%ld", static_cast<long>(getpid()));
 		}
 
+	event_batch_size = internal_val("Broker::event_batch_size")->AsCount();
+	event_batch_interval = internal_val("Broker::event_batch_interval")->AsInterval();
+
 	int flags = endpoint_flags_to_int(broker_endpoint_flags);
 	endpoint = unique_ptr<broker::endpoint>(new broker::endpoint(name, flags));
 	iosource_mgr->Register(this, true);
@@ -192,8 +213,7 @@ bool bro_broker::Manager::Print(string topic, string msg, Val* flags)
 	if ( ! Enabled() )
 		return false;
 
-	endpoint->send(move(topic), broker::message{move(msg)},
-	               send_flags_to_int(flags));
+	Send(move(topic), broker::message{move(msg)}, send_flags_to_int(flags));
 	return true;
 	}
 
@@ -202,10 +222,81 @@ bool bro_broker::Manager::Event(std::string topic, broker::message msg, int flag
 	if ( ! Enabled() )
 		return false;
 
-	endpoint->send(move(topic), move(msg), flags);
+	if ( event_batch_size <= 1 || terminating )
+		{
+		Send(move(topic), move(msg), flags);
+		return true;
+		}
+
+	auto key = make_pair(move(topic), flags);
+	auto& batch = event_batches[key];
+
+	if ( batch.msg.empty() )
+		{
+		batch.msg.emplace_back(event_batch_tag);
+		batch.opened = network_time;
+		}
+
+	batch.msg.emplace_back(move(msg));
+	batch.queued_total += network_time;
+
+	if ( batch.msg.size() - 1 >= event_batch_size )
+		SendEventBatch(key, &batch);
+
+	else if ( ! event_batch_timer_pending )
+		{
+		timer_mgr->Add(new EventBatchTimer(network_time + event_batch_interval));
+		event_batch_timer_pending = true;
+		}
+
 	return true;
 	}
 
+void bro_broker::Manager::SendEventBatch(const EventBatchKey& key, EventBatch* batch)
+	{
+	size_t n = batch->msg.size() - 1;
+
+	auto& s = statistics.event_batch_count[key.first];
+	++s.batches;
+	s.events += n;
+	s.max_events = std::max(s.max_events, n);
+	s.delay_total += n * network_time - batch->queued_total;
+	s.delay_max = std::max(s.delay_max, network_time - batch->opened);
+
+	if ( n == 1 )
+		{
+		// Send it the normal way, no need to wrap it.
+		auto em = broker::get<broker::vector>(batch->msg[1]);
+		Send(key.first, move(*em), key.second);
+		}
+	else
+		Send(key.first, move(batch->msg), key.second);
+
+	batch->msg.clear();
+	batch->opened = 0;
+	batch->queued_total = 0;
+	}
+
+void bro_broker::Manager::Send(std::string topic, broker::message msg, int flags)
+	{
+	++statistics.sent_count[topic];
+	endpoint->send(move(topic), move(msg), flags);
+	}
+
+void bro_broker::Manager::FlushEventBatches()
+	{
+	event_batch_timer_pending = false;
+
+	if ( ! Enabled() )
+		return;
+
+	for ( auto& b : event_batches )
+		{
+		if ( ! b.second.msg.empty() )
+			SendEventBatch(b.first, &b.second);
+		}
+	}
+
 bool bro_broker::Manager::Log(EnumVal* stream, RecordVal* columns, RecordType* info,
                         int flags)
 	{
@@ -254,7 +345,7 @@ bool bro_broker::Manager::Log(EnumVal* stream, RecordVal* columns, RecordType* i
 
 	broker::message msg{broker::enum_value{stream_name}, move(column_data)};
 	std::string topic = std::string("bro/log/") + stream_name;
-	endpoint->send(move(topic), move(msg), flags);
+	Send(move(topic), move(msg), flags);
 	return true;
 	}
 
@@ -279,7 +370,15 @@ bool bro_broker::Manager::Event(std::string topic, RecordVal* args, Val* flags)
 		msg.emplace_back(data_val->data);
 		}
 
-	endpoint->send(move(topic), move(msg), send_flags_to_int(flags));
+	auto send_flags = send_flags_to_int(flags);
+
+	// Keep the order with events still queued for the same topic.
+	auto it = event_batches.find(make_pair(topic, send_flags));
+
+	if ( it != event_batches.end() && ! it->second.msg.empty() )
+		SendEventBatch(it->first, &it->second);
+
+	Send(move(topic), move(msg), send_flags);
 	return true;
 	}
 
@@ -625,6 +724,60 @@ static RecordVal* response_to_val(broker::store::response r)
 	return broker::visit(response_converter{r.request.type}, r.reply.value);
 	}
 
+void bro_broker::Manager::ProcessEvent(broker::message em)
+	{
+	if ( em.empty() )
+		{
+		reporter->Warning("got empty event message");
+		return;
+		}
+
+	std::string* event_name = broker::get<std::string>(em[0]);
+
+	if ( ! event_name )
+		{
+		reporter->Warning("got event message w/o event name: %d",
+		                  static_cast<int>(broker::which(em[0])));
+		return;
+		}
+
+	EventHandlerPtr ehp = event_registry->Lookup(event_name->data());
+
+	if ( ! ehp )
+		return;
+
+	auto arg_types = ehp->FType()->ArgTypes()->Types();
+
+	if ( static_cast<size_t>(arg_types->length()) != em.size() - 1 )
+		{
+		reporter->Warning("got event message with invalid # of args,"
+		                  " got %zd, expected %d", em.size() - 1,
+		                  arg_types->length());
+		return;
+		}
+
+	val_list* vl = new val_list;
+
+	for ( auto i = 1u; i < em.size(); ++i )
+		{
+		auto val = data_to_val(move(em[i]), (*arg_types)[i - 1]);
+
+		if ( val )
+			vl->append(val);
+		else
+			{
+			reporter->Warning("failed to convert remote event arg # %d",
+			                  i - 1);
+			break;
+			}
+		}
+
+	if ( static_cast<size_t>(vl->length()) == em.size() - 1 )
+		mgr.QueueEvent(ehp, vl);
+	else
+		delete_vals(vl);
+	}
+
 void bro_broker::Manager::Process()
 	{
 	auto outgoing_connection_updates =
@@ -643,7 +796,7 @@ void bro_broker::Manager::Process()
 				{
 				val_list* vl = new val_list;
 				vl->append(new StringVal(u.relation.remote_tuple().first));
-				vl->append(new PortVal(u.relation.remote_tuple().second,
+				vl->append(val_mgr->GetPort(u.relation.remote_tuple().second,
 				                       TRANSPORT_TCP));
 				vl->append(new StringVal(u.peer_name));
 				mgr.QueueEvent(Broker::outgoing_connection_established, vl);
@@ -655,7 +808,7 @@ void bro_broker::Manager::Process()
 				{
 				val_list* vl = new val_list;
 				vl->append(new StringVal(u.relation.remote_tuple().first));
-				vl->append(new PortVal(u.relation.remote_tuple().second,
+				vl->append(val_mgr->GetPort(u.relation.remote_tuple().second,
 				                       TRANSPORT_TCP));
 				mgr.QueueEvent(Broker::outgoing_connection_broken, vl);
 				}
@@ -666,7 +819,7 @@ void bro_broker::Manager::Process()
 				{
 				val_list* vl = new val_list;
 				vl->append(new StringVal(u.relation.remote_tuple().first));
-				vl->append(new PortVal(u.relation.remote_tuple().second,
+				vl->append(val_mgr->GetPort(u.relation.remote_tuple().second,
 				                       TRANSPORT_TCP));
 				mgr.QueueEvent(Broker::outgoing_connection_incompatible, vl);
 				}
@@ -756,56 +909,25 @@ void bro_broker::Manager::Process()
 
 		for ( auto& em : event_messages )
 			{
-			if ( em.empty() )
-				{
-				reporter->Warning("got empty event message");
-				continue;
-				}
-
-			std::string* event_name = broker::get<std::string>(em[0]);
+			auto tag = em.empty() ? nullptr : broker::get<std::string>(em[0]);
 
-			if ( ! event_name )
+			if ( ! tag || *tag != event_batch_tag )
 				{
-				reporter->Warning("got event message w/o event name: %d",
-				                  static_cast<int>(broker::which(em[0])));
+				ProcessEvent(move(em));
 				continue;
 				}
 
-			EventHandlerPtr ehp = event_registry->Lookup(event_name->data());
-
-			if ( ! ehp )
-				continue;
-
-			auto arg_types = ehp->FType()->ArgTypes()->Types();
-
-			if ( static_cast<size_t>(arg_types->length()) != em.size() - 1 )
-				{
-				reporter->Warning("got event message with invalid # of args,"
-				                  " got %zd, expected %d", em.size() - 1,
-				                  arg_types->length());
-				continue;
-				}
-
-			val_list* vl = new val_list;
+			es.second.received += em.size() - 2;
 
 			for ( auto i = 1u; i < em.size(); ++i )
 				{
-				auto val = data_to_val(move(em[i]), (*arg_types)[i - 1]);
+				auto e = broker::get<broker::vector>(em[i]);
 
-				if ( val )
-					vl->append(val);
+				if ( e )
+					ProcessEvent(move(*e));
 				else
-					{
-					reporter->Warning("failed to convert remote event arg # %d",
-					                  i - 1);
-					break;
-					}
+					reporter->Warning("got invalid event in batch");
 				}
-
-			if ( static_cast<size_t>(vl->length()) == em.size() - 1 )
-				mgr.QueueEvent(ehp, vl);
-			else
-				delete_vals(vl);
 			}
 		}
 
@@ -889,7 +1011,7 @@ void bro_broker::Manager::Process()
 		if ( responses.empty() )
 			continue;
 
-		statistics.report_count += responses.size();
+		statistics.response_count += responses.size();
 
 		for ( auto& response : responses )
 			{
@@ -905,29 +1027,51 @@ void bro_broker::Manager::Process()
 
 			auto query = *it;
 
-			if ( query->Disabled() )
+			// If the query is disabled, the trigger timer must have
+			// timed it out already.
+			if ( ! query->Disabled() )
 				{
-				// Trigger timer must have timed the query out already.
-				delete query;
-				pending_queries.erase(it);
-				continue;
+				switch ( response.reply.stat ) {
+				case broker::store::result::status::timeout:
+					query->TimedOut();
+					break;
+				case broker::store::result::status::failure:
+					query->Fail();
+					break;
+				case broker::store::result::status::success:
+					{
+					auto key = response.request.k;
+					auto is_lookup = (response.request.type == broker::store::query::tag::lookup);
+					auto data = response_to_val(move(response));
+
+					if ( is_lookup )
+						s.second->CacheLookup(key, data);
+
+					query->Add(key, data);
+					break;
+					}
+				default:
+					reporter->InternalWarning("unknown store response status: %d",
+					                         static_cast<int>(response.reply.stat));
+					break;
+				}
 				}
 
-			switch ( response.reply.stat ) {
-			case broker::store::result::status::timeout:
-				// Fine, trigger's timeout takes care of things.
-				break;
-			case broker::store::result::status::failure:
-				query->Result(query_result());
-				break;
-			case broker::store::result::status::success:
-				query->Result(query_result(response_to_val(move(response))));
-				break;
-			default:
-				reporter->InternalWarning("unknown store response status: %d",
-				                         static_cast<int>(response.reply.stat));
-				break;
-			}
+			// A batch of lookups waits for all its responses.
+			if ( ! query->Complete() )
+				continue;
+
+			if ( ! query->Disabled() )
+				{
+				auto latency = current_time() - query->StartTime();
+				++statistics.answered_query_count;
+				statistics.query_latency_total += latency;
+
+				if ( latency > statistics.query_latency_max )
+					statistics.query_latency_max = latency;
+
+				query->Deliver();
+				}
 
 			delete query;
 			pending_queries.erase(it);
@@ -14,6 +14,22 @@
 
 namespace bro_broker {
 
+/**
+ * Statistics of the batches in which auto-published events went out for
+ * a topic.
+ */
+struct EventBatchStats {
+	// Number of batches sent.
+	size_t batches = 0;
+	// Number of events they held.
+	size_t events = 0;
+	// Largest number of events in a single batch.
+	size_t max_events = 0;
+	// Total and maximum time events waited in a batch, in seconds.
+	double delay_total = 0;
+	double delay_max = 0;
+};
+
 /**
  * Communication statistics.  Some are tracked in relation to last
  * sample (bro_broker::Manager::ConsumeStatistics()).
@@ -27,6 +43,14 @@ struct Stats {
 	size_t pending_query_count = 0;
 	// Number of data store responses received (since last sample).
 	size_t response_count = 0;
+	// Number of data store queries answered (since last sample).
+	size_t answered_query_count = 0;
+	// Total and maximum time it took to answer them, in seconds (since
+	// last sample).
+	double query_latency_total = 0;
+	double query_latency_max = 0;
+	// Number of lookups answered from a handle's cache (since last sample).
+	size_t cache_hit_count = 0;
 	// Number of outgoing connection updates received (since last sample).
 	size_t outgoing_conn_status_count = 0;
 	// Number of incoming connection updates received (since last sample).
@@ -40,6 +64,11 @@ struct Stats {
 	std::map<std::string, size_t> event_count;
 	// Number of log messages received per topic-prefix (since last sample).
 	std::map<std::string, size_t> log_count;
+	// Batches of auto-published events sent per topic (since last sample).
+	std::map<std::string, EventBatchStats> event_batch_count;
+	// Number of messages sent per topic, counting a batch of events as
+	// one (since last sample).
+	std::map<std::string, size_t> sent_count;
 };
 
 /**
@@ -128,7 +157,10 @@ public:
 	bool Print(std::string topic, std::string msg, Val* flags);
 
 	/**
-	 * Send an event to any interested peers.
+	 * Send an event to any interested peers.  If Broker::event_batch_size
+	 * asks for it, the event gets queued and goes out together with
+	 * further ones for the same topic, once the batch is full or
+	 * Broker::event_batch_interval has passed.
 	 * @param topic a topic string associated with the print message.
 	 * Peers advertise interest by registering a subscription to some prefix
 	 * of this topic name.
@@ -136,7 +168,7 @@ public:
 	 * as a string followed by all of its arguments.
 	 * @param flags tune the behavior of how the message is send.
 	 * See the Broker::SendFlags record type.
-	 * @return true if the message is sent successfully.
+	 * @return true if the message is sent (or queued) successfully.
 	 */
 	bool Event(std::string topic, broker::message msg, int flags);
 
@@ -166,6 +198,11 @@ public:
 	bool Log(EnumVal* stream_id, RecordVal* columns, RecordType* info,
 	         int flags);
 
+	/**
+	 * Send all queued batches of events right away.
+	 */
+	void FlushEventBatches();
+
 	/**
 	 * Automatically send an event to any interested peers whenever it is
 	 * locally dispatched (e.g. using "event my_event(...);" in a script).
@@ -314,6 +351,12 @@ public:
 	 */
 	bool TrackStoreQuery(StoreQueryCallback* cb);
 
+	/**
+	 * Count a data store lookup answered from a handle's cache.
+	 */
+	void CountCacheHit()
+		{ ++statistics.cache_hit_count; }
+
 	/**
 	 * @return communication statistics.
 	 */
@@ -340,6 +383,22 @@ private:
 	broker::endpoint& Endpoint()
 		{ return *endpoint; }
 
+	// The events queued for a topic, as a message with the batch tag
+	// followed by one vector per event.
+	struct EventBatch {
+		broker::message msg;
+		double opened = 0;	// when the first event got queued
+		double queued_total = 0;	// sum of when each got queued
+	};
+
+	typedef std::pair<std::string, int> EventBatchKey;	// topic, flags
+
+	void SendEventBatch(const EventBatchKey& key, EventBatch* batch);
+
+	// Sends a message, counting it for the topic.
+	void Send(std::string topic, broker::message msg, int flags);
+	void ProcessEvent(broker::message em);
+
 	struct QueueWithStats {
 		broker::message_queue q;
 		size_t received = 0;
@@ -355,6 +414,11 @@ private:
 	         StoreHandleVal*> data_stores;
 	std::unordered_set<StoreQueryCallback*> pending_queries;
 
+	std::map<EventBatchKey, EventBatch> event_batches;
+	size_t event_batch_size;
+	double event_batch_interval;
+	bool event_batch_timer_pending;
+
 	Stats statistics;
 	double next_timestamp;
 
@@ -5,6 +5,10 @@
 #include <broker/store/clone.hh>
 #include <broker/store/sqlite_backend.hh>
 
+#include <algorithm>
+#include <cctype>
+#include <deque>
+
 #ifdef HAVE_ROCKSDB
 #include <broker/store/rocksdb_backend.hh>
 #include <rocksdb/db.h>
@@ -12,6 +16,32 @@
 
 OpaqueType* bro_broker::opaque_of_store_handle;
 
+// Adds a pragma for one of the SQLite options, if it's set. Returns false
+// if its value isn't one of those allowed.
+static bool add_sqlite_pragma(RecordVal* sqlite_options, int field,
+                              const char* name, const char* const* allowed,
+                              std::deque<std::string>* pragmas)
+	{
+	std::string value = sqlite_options->Lookup(field)->AsStringVal()->CheckString();
+
+	if ( value.empty() )
+		return true;
+
+	std::transform(value.begin(), value.end(), value.begin(), ::toupper);
+
+	for ( auto a = allowed; *a; ++a )
+		{
+		if ( value == *a )
+			{
+			pragmas->push_back(std::string("PRAGMA ") + name + " = " + value + ";");
+			return true;
+			}
+		}
+
+	reporter->Error("invalid sqlite backend %s: %s", name, value.data());
+	return false;
+	}
+
 bro_broker::StoreHandleVal::StoreHandleVal(broker::store::identifier id,
                                      bro_broker::StoreType arg_type,
                                      broker::util::optional<BifEnum::Broker::BackendType> arg_back,
@@ -29,11 +59,29 @@ bro_broker::StoreHandleVal::StoreHandleVal(broker::store::identifier id,
 			break;
 		case BackendType::SQLITE:
 			{
+			static const char* const journal_modes[] = {
+				"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF", 0
+			};
+
+			static const char* const synchronous_modes[] = {
+				"OFF", "NORMAL", "FULL", "EXTRA", 0
+			};
+
+			auto sqlite_options = backend_options->Lookup(0)->AsRecordVal();
+			std::string path = sqlite_options->Lookup(0)->AsStringVal()->CheckString();
+
+			// Without them, every update waits for the disk.
+			std::deque<std::string> pragmas;
+
+			if ( ! (add_sqlite_pragma(sqlite_options, 1, "journal_mode",
+			                          journal_modes, &pragmas) &&
+			        add_sqlite_pragma(sqlite_options, 2, "synchronous",
+			                          synchronous_modes, &pragmas)) )
+				break;
+
 			auto sqlite = new broker::store::sqlite_backend;
-			std::string path = backend_options->Lookup(0)->AsRecordVal()
-			                   ->Lookup(0)->AsStringVal()->CheckString();
 
-			if ( sqlite->open(path) )
+			if ( sqlite->open(path, move(pragmas)) )
 				backend.reset(sqlite);
 			else
 				{
@@ -46,14 +94,25 @@ bro_broker::StoreHandleVal::StoreHandleVal(broker::store::identifier id,
 		case BackendType::ROCKSDB:
 			{
 #ifdef HAVE_ROCKSDB
-			std::string path = backend_options->Lookup(1)->AsRecordVal()
-			                   ->Lookup(0)->AsStringVal()->CheckString();
+			auto rocksdb_options = backend_options->Lookup(1)->AsRecordVal();
+			std::string path = rocksdb_options->Lookup(0)->AsStringVal()->CheckString();
+			bro_uint_t write_buffer_size = rocksdb_options->Lookup(1)->AsCount();
+			bro_uint_t background_threads = rocksdb_options->Lookup(2)->AsCount();
+
 			rocksdb::Options rock_op;
 			rock_op.create_if_missing = true;
 
+			// Updates collect in the memtable, which gets flushed and
+			// compacted in the background.
+			if ( write_buffer_size )
+				rock_op.write_buffer_size = write_buffer_size;
+
+			if ( background_threads )
+				rock_op.IncreaseParallelism(background_threads);
+
 			auto rocksdb = new broker::store::rocksdb_backend;
 
-			if ( rocksdb->open(path, options).ok() )
+			if ( rocksdb->open(path, rock_op).ok() )
 				backend.reset(rocksdb);
 			else
 				{
@@ -89,6 +148,91 @@ bro_broker::StoreHandleVal::StoreHandleVal(broker::store::identifier id,
 		}
 	}
 
+bro_broker::StoreHandleVal::~StoreHandleVal()
+	{
+	InvalidateAll();
+	}
+
+void bro_broker::StoreHandleVal::SetLookupCache(double ttl)
+	{
+	lookup_cache_ttl = ttl;
+
+	if ( ttl <= 0 )
+		InvalidateAll();
+	}
+
+RecordVal* bro_broker::StoreHandleVal::CachedLookup(const broker::data& key)
+	{
+	if ( lookup_cache.empty() )
+		return nullptr;
+
+	auto it = lookup_cache.find(key);
+
+	if ( it == lookup_cache.end() )
+		return nullptr;
+
+	if ( it->second.second < network_time )
+		{
+		Unref(it->second.first);
+		lookup_cache.erase(it);
+		return nullptr;
+		}
+
+	Ref(it->second.first);
+	return it->second.first;
+	}
+
+void bro_broker::StoreHandleVal::CacheLookup(const broker::data& key, RecordVal* result)
+	{
+	if ( lookup_cache_ttl <= 0 )
+		return;
+
+	if ( lookup_cache.size() >= lookup_cache_sweep )
+		{
+		// Drop what expired, so that keys looked up only once don't
+		// pile up.
+		for ( auto it = lookup_cache.begin(); it != lookup_cache.end(); )
+			{
+			if ( it->second.second < network_time )
+				{
+				Unref(it->second.first);
+				it = lookup_cache.erase(it);
+				}
+			else
+				++it;
+			}
+
+		lookup_cache_sweep = std::max(size_t(1024), 2 * lookup_cache.size());
+		}
+
+	Ref(result);
+	auto& entry = lookup_cache[key];
+	Unref(entry.first);
+	entry = std::make_pair(result, network_time + lookup_cache_ttl);
+	}
+
+void bro_broker::StoreHandleVal::Invalidate(const broker::data& key)
+	{
+	if ( lookup_cache.empty() )
+		return;
+
+	auto it = lookup_cache.find(key);
+
+	if ( it == lookup_cache.end() )
+		return;
+
+	Unref(it->second.first);
+	lookup_cache.erase(it);
+	}
+
+void bro_broker::StoreHandleVal::InvalidateAll()
+	{
+	for ( auto& entry : lookup_cache )
+		Unref(entry.second.first);
+
+	lookup_cache.clear();
+	}
+
 void bro_broker::StoreHandleVal::ValDescribe(ODesc* d) const
 	{
 	using BifEnum::Broker::BackendType;
@@ -3,6 +3,7 @@
 
 #include "broker/store.bif.h"
 #include "broker/data.bif.h"
+#include "broker/Data.h"
 #include "Reporter.h"
 #include "Type.h"
 #include "Val.h"
@@ -10,6 +11,8 @@
 
 #include <broker/store/frontend.hh>
 
+#include <map>
+
 namespace bro_broker {
 
 extern OpaqueType* opaque_of_store_handle;
@@ -80,16 +83,96 @@ public:
 					   broker::store::identifier arg_store_id,
 	                   StoreType arg_store_type)
 		: trigger(arg_trigger), call(arg_call), store_id(move(arg_store_id)),
-	      store_type(arg_store_type)
+	      store_type(arg_store_type), start_time(current_time()),
+	      outstanding(1), batch(false), failed(false), timed_out(false),
+	      result(nullptr)
 		{
 		Ref(trigger);
 		}
 
 	~StoreQueryCallback()
 		{
+		Unref(result);
 		Unref(trigger);
 		}
 
+	/**
+	 * Makes the callback answer several lookups at once, with a table
+	 * of the keys that were found and their values.
+	 * @param n the number of lookups whose responses get collected.
+	 * @param found keys and values that are known already.
+	 */
+	void SetBatch(size_t n, broker::table found)
+		{
+		outstanding = n;
+		batch = true;
+		batch_results = move(found);
+		}
+
+	/**
+	 * Records a successful response.
+	 * @param key the key the query was for, if any.
+	 * @param data the response's Broker::Data value, which the callback
+	 * takes ownership of.
+	 */
+	void Add(const broker::data& key, RecordVal* data)
+		{
+		if ( ! batch )
+			{
+			Unref(result);
+			result = data;
+			return;
+			}
+
+		auto v = data->Lookup(0);
+
+		if ( v )
+			batch_results[key] = static_cast<DataVal*>(v)->data;
+
+		Unref(data);
+		}
+
+	/**
+	 * Records a failed response.
+	 */
+	void Fail()
+		{ failed = true; }
+
+	/**
+	 * Records a response that timed out; the trigger's timeout takes
+	 * care of things then.
+	 */
+	void TimedOut()
+		{ timed_out = true; }
+
+	/**
+	 * Counts a response.
+	 * @return true if that was the last one expected.
+	 */
+	bool Complete()
+		{ return --outstanding == 0; }
+
+	/**
+	 * Passes on the outcome once all responses arrived.
+	 */
+	void Deliver()
+		{
+		if ( failed )
+			Result(query_result());
+
+		else if ( timed_out )
+			;
+
+		else if ( batch )
+			Result(query_result(make_data_val(broker::data{move(batch_results)})));
+
+		else if ( result )
+			{
+			Result(query_result(result));
+			result = nullptr;
+			}
+		}
+
 	void Result(RecordVal* result)
 		{
 		trigger->Cache(call, result);
@@ -114,12 +197,23 @@ public:
 	StoreType GetStoreType() const
 		{ return store_type; }
 
+	double StartTime() const
+		{ return start_time; }
+
 private:
 
 	Trigger* trigger;
 	const CallExpr* call;
 	broker::store::identifier store_id;
 	StoreType store_type;
+	double start_time;
+
+	size_t outstanding;	// responses still to come
+	bool batch;
+	bool failed;
+	bool timed_out;
+	RecordVal* result;
+	broker::table batch_results;
 };
 
 /**
@@ -134,8 +228,44 @@ public:
 		       RecordVal* backend_options,
 		       std::chrono::duration<double> resync = std::chrono::seconds(1));
 
+	~StoreHandleVal() override;
+
 	void ValDescribe(ODesc* d) const override;
 
+	/**
+	 * Makes lookups through the handle keep their results for a while,
+	 * and answer later lookups of the same keys from those. Changes made
+	 * through the handle drop the affected keys, but changes by others
+	 * only show once the results expire.
+	 * @param ttl how long to keep results, zero to stop caching.
+	 */
+	void SetLookupCache(double ttl);
+
+	/**
+	 * @param key the key to look up.
+	 * @return the cached result of a lookup, as a Broker::Data value with
+	 * a reference for the caller, or null if there's none.
+	 */
+	RecordVal* CachedLookup(const broker::data& key);
+
+	/**
+	 * Keeps the result of a lookup, if caching is enabled.
+	 * @param key the key that was looked up.
+	 * @param result the Broker::Data value of the result.
+	 */
+	void CacheLookup(const broker::data& key, RecordVal* result);
+
+	/**
+	 * Drops a cached lookup result.
+	 * @param key the key that was looked up.
+	 */
+	void Invalidate(const broker::data& key);
+
+	/**
+	 * Drops all cached lookup results.
+	 */
+	void InvalidateAll();
+
 	DECLARE_SERIAL(StoreHandleVal);
 
 	broker::store::frontend* store;
@@ -146,6 +276,11 @@ protected:
 
 	StoreHandleVal()
 		{}
+
+	// Cached lookup results and when they expire.
+	double lookup_cache_ttl = 0;
+	size_t lookup_cache_sweep = 1024;	// size to next drop expired ones at
+	std::map<broker::data, std::pair<RecordVal*, double>> lookup_cache;
 };
 
 } // namespace bro_broker
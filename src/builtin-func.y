@@ -144,6 +144,7 @@ void set_decl_name(const char *name)
 	}
 
 const char* arg_list_name = "BiF_ARGS";
+const char* direct_arg_list_name = "BiF_ARGV";
 
 #include "bif_arg.h"
 
@@ -179,6 +180,119 @@ extern int yyerror(const char[]);
 extern int yywarn(const char msg[]);
 extern int yylex();
 
+// A function's definition goes to a temporary file first. Only once we've
+// seen its body do we know whether it also gets a direct entry point,
+// which script calls can use without building a val_list. That needs a
+// fixed number of arguments, and a body that doesn't look at the argument
+// list itself.
+FILE* fp_func_def_out = 0;
+long func_body_offset = 0;
+int body_uses_arg_list = 0;
+
+void begin_func_def()
+	{
+	fp_func_def_out = fp_func_def;
+	fp_func_def = tmpfile();
+
+	if ( ! fp_func_def )
+		{
+		fprintf(stderr, "Error: can't create temporary file\n");
+		exit(1);
+		}
+
+	body_uses_arg_list = 0;
+	}
+
+// Marks where the function's own body starts, after the arguments got
+// unpacked.
+void mark_func_body()
+	{
+	func_body_offset = ftell(fp_func_def);
+	}
+
+void end_func_def()
+	{
+	FILE* tmp = fp_func_def;
+	fp_func_def = fp_func_def_out;
+
+	long size = ftell(tmp);
+	string text(size, '\0');
+	rewind(tmp);
+
+	if ( size && fread(&text[0], size, 1, tmp) != 1 )
+		{
+		fprintf(stderr, "Error: can't read temporary file\n");
+		exit(1);
+		}
+
+	fclose(tmp);
+
+	bool direct = ! var_arg && ! body_uses_arg_list;
+
+	fprintf(fp_func_init,
+		"\t(void) new BuiltinFunc(%s, \"%s\", 0%s%s);\n",
+		decl.c_fullname.c_str(), decl.bro_fullname.c_str(),
+		direct ? ", " : "",
+		direct ? (decl.c_fullname + "_direct").c_str() : "");
+
+	if ( ! direct )
+		{
+		fprintf(fp_func_def, "%s}", text.c_str());
+		return;
+		}
+
+	// The body moves into a function taking the unpacked arguments,
+	// which both entry points call. It stays in the same namespace, for
+	// the body to see the same names.
+	string typed = decl.c_fullname + "_typed";
+
+	fprintf(fp_func_h,
+		"%sextern Val* %s_direct(Frame* frame, Val**);%s\n",
+		decl.c_namespace_start.c_str(), decl.bare_name.c_str(),
+		decl.c_namespace_end.c_str());
+
+	fprintf(fp_func_def, "%sstatic Val* %s_typed(Frame* frame",
+		decl.c_namespace_start.c_str(), decl.bare_name.c_str());
+
+	for ( int i = 0; i < (int) args.size(); ++i )
+		{
+		fprintf(fp_func_def, ", ");
+		args[i]->PrintCArg(fp_func_def, i);
+		}
+
+	fprintf(fp_func_def, ");%s\n\n", decl.c_namespace_end.c_str());
+
+	fprintf(fp_func_def, "%s", text.substr(0, func_body_offset).c_str());
+	fprintf(fp_func_def, "\treturn %s(frame", typed.c_str());
+
+	for ( int i = 0; i < (int) args.size(); ++i )
+		fprintf(fp_func_def, ", %s", args[i]->Name());
+
+	fprintf(fp_func_def, ");\n\t}\n\n");
+
+	fprintf(fp_func_def, "Val* %s_direct(Frame* frame, Val** %s)\n\t{\n",
+		decl.c_fullname.c_str(), direct_arg_list_name);
+	fprintf(fp_func_def, "\treturn %s(frame", typed.c_str());
+
+	for ( int i = 0; i < (int) args.size(); ++i )
+		{
+		fprintf(fp_func_def, ",\n\t\t");
+		args[i]->PrintCDirectArg(fp_func_def, i);
+		}
+
+	fprintf(fp_func_def, ");\n\t}\n\n");
+
+	fprintf(fp_func_def, "Val* %s(Frame* frame", typed.c_str());
+
+	for ( int i = 0; i < (int) args.size(); ++i )
+		{
+		fprintf(fp_func_def, ", ");
+		args[i]->PrintCArg(fp_func_def, i);
+		}
+
+	fprintf(fp_func_def, ")\n{%s}", text.substr(func_body_offset).c_str());
+	}
+
 char* concat(const char* str1, const char* str2)
 	{
 	int len1 = strlen(str1);
@@ -530,6 +644,7 @@ head_1:		TOK_ID opt_ws arg_begin
 			if ( definition_type == FUNC_DEF )
 				{
 				method_type = "function";
+				begin_func_def();
 				print_line_directive(fp_func_def);
 				}
 			else if ( definition_type == EVENT_DEF )
@@ -542,10 +657,6 @@ head_1:		TOK_ID opt_ws arg_begin
 
 			if ( definition_type == FUNC_DEF )
 				{
-				fprintf(fp_func_init,
-					"\t(void) new BuiltinFunc(%s, \"%s\", 0);\n",
-					decl.c_fullname.c_str(), decl.bro_fullname.c_str());
-
 				fprintf(fp_func_h,
 					"%sextern Val* %s(Frame* frame, val_list*);%s\n",
 					decl.c_namespace_start.c_str(), decl.bare_name.c_str(), decl.c_namespace_end.c_str());
@@ -677,13 +788,15 @@ body_start:	TOK_LPB c_code_begin
 
 			for ( int i = 0; i < (int) args.size(); ++i )
 				args[i]->PrintCDef(fp_func_def, i + implicit_arg);
+
+			mark_func_body();
 			print_line_directive(fp_func_def);
 			}
 	;
 
 body_end:	TOK_RPB c_code_end
 			{
-			fprintf(fp_func_def, "}");
+			end_func_def();
 			}
 	;
 
@@ -701,11 +814,20 @@ c_atom:		TOK_ID
 	|	TOK_C_TOKEN
 			{ fprintf(fp_func_def, "%s", $1); }
 	|	TOK_ARG
-			{ fprintf(fp_func_def, "(*%s)", arg_list_name); }
+			{
+			body_uses_arg_list = 1;
+			fprintf(fp_func_def, "(*%s)", arg_list_name);
+			}
 	|	TOK_ARGS
-			{ fprintf(fp_func_def, "%s", arg_list_name); }
+			{
+			body_uses_arg_list = 1;
+			fprintf(fp_func_def, "%s", arg_list_name);
+			}
 	|	TOK_ARGC
-			{ fprintf(fp_func_def, "%s->length()", arg_list_name); }
+			{
+			body_uses_arg_list = 1;
+			fprintf(fp_func_def, "%s->length()", arg_list_name);
+			}
 	|	TOK_CSTR
 			{ fprintf(fp_func_def, "%s", $1); }
 	|	TOK_ATOM
@@ -20,6 +20,40 @@
 
 using namespace file_analysis;
 
+// Returns the profile to charge a delivery to, or null if we aren't
+// profiling.
+static inline AnalyzerProfile* profile_for(const file_analysis::Analyzer* a)
+	{
+	return analyzer_profiling ? file_mgr->Profile(a->Tag()) : 0;
+	}
+
+// The following pass data on to an analyzer, within a profiling scope.
+
+static bool deliver_stream(file_analysis::Analyzer* a, const u_char* data, uint64 len)
+	{
+	AnalyzerProfileScope profile(profile_for(a), len);
+	return a->DeliverStream(data, len);
+	}
+
+static bool deliver_chunk(file_analysis::Analyzer* a, const u_char* data,
+			  uint64 len, uint64 offset)
+	{
+	AnalyzerProfileScope profile(profile_for(a), len);
+	return a->DeliverChunk(data, len, offset);
+	}
+
+static bool end_of_file(file_analysis::Analyzer* a)
+	{
+	AnalyzerProfileScope profile(profile_for(a), 0);
+	return a->EndOfFile();
+	}
+
+static bool undelivered(file_analysis::Analyzer* a, uint64 offset, uint64 len)
+	{
+	AnalyzerProfileScope profile(profile_for(a), 0);
+	return a->Undelivered(offset, len);
+	}
+
 static Val* empty_connection_table()
 	{
 	TypeList* tbl_index = new TypeList(conn_id);
@@ -34,9 +68,9 @@ static RecordVal* get_conn_id_val(const Connection* conn)
 	{
 	RecordVal* v = new RecordVal(conn_id);
 	v->Assign(0, new AddrVal(conn->OrigAddr()));
-	v->Assign(1, new PortVal(ntohs(conn->OrigPort()), conn->ConnTransport()));
+	v->Assign(1, val_mgr->GetPort(ntohs(conn->OrigPort()), conn->ConnTransport()));
 	v->Assign(2, new AddrVal(conn->RespAddr()));
-	v->Assign(3, new PortVal(ntohs(conn->RespPort()), conn->ConnTransport()));
+	v->Assign(3, val_mgr->GetPort(ntohs(conn->RespPort()), conn->ConnTransport()));
 	return v;
 	}
 
@@ -53,6 +87,7 @@ int File::overflow_bytes_idx = -1;
 int File::timeout_interval_idx = -1;
 int File::bof_buffer_size_idx = -1;
 int File::bof_buffer_idx = -1;
+int File::fingerprint_idx = -1;
 int File::meta_mime_type_idx = -1;
 int File::meta_mime_types_idx = -1;
 
@@ -74,6 +109,7 @@ void File::StaticInit()
 	timeout_interval_idx = Idx("timeout_interval", fa_file_type);
 	bof_buffer_size_idx = Idx("bof_buffer_size", fa_file_type);
 	bof_buffer_idx = Idx("bof_buffer", fa_file_type);
+	fingerprint_idx = Idx("fingerprint", fa_file_type);
 	meta_mime_type_idx = Idx("mime_type", fa_metadata_type);
 	meta_mime_types_idx = Idx("mime_types", fa_metadata_type);
 	}
@@ -95,7 +131,7 @@ File::File(const string& file_id, const string& source_name, Connection* conn,
 
 	if ( conn )
 		{
-		val->Assign(is_orig_idx, new Val(is_orig, TYPE_BOOL));
+		val->Assign(is_orig_idx, val_mgr->GetBool(is_orig));
 		UpdateConnectionFields(conn, is_orig);
 		}
 
@@ -141,6 +177,7 @@ bool File::UpdateConnectionFields(Connection* conn, bool is_orig)
 		}
 
 	conns->AsTableVal()->Assign(idx, conn->BuildConnVal());
+	conn->CompleteConnVal();
 	Unref(idx);
 	return true;
 	}
@@ -152,7 +189,7 @@ void File::RaiseFileOverNewConnection(Connection* conn, bool is_orig)
 		val_list* vl = new val_list();
 		vl->append(val->Ref());
 		vl->append(conn->BuildConnVal());
-		vl->append(new Val(is_orig, TYPE_BOOL));
+		vl->append(val_mgr->GetBool(is_orig));
 		FileEvent(file_over_new_connection, vl);
 		}
 	}
@@ -225,13 +262,13 @@ bool File::SetExtractionLimit(RecordVal* args, uint64 bytes)
 void File::IncrementByteCount(uint64 size, int field_idx)
 	{
 	uint64 old = LookupFieldDefaultCount(field_idx);
-	val->Assign(field_idx, new Val(old + size, TYPE_COUNT));
+	val->Assign(field_idx, val_mgr->GetCount(old + size));
 	}
 
 void File::SetTotalBytes(uint64 size)
 	{
 	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Total bytes %" PRIu64, id.c_str(), size);
-	val->Assign(total_bytes_idx, new Val(size, TYPE_COUNT));
+	val->Assign(total_bytes_idx, val_mgr->GetCount(size));
 	}
 
 bool File::IsComplete() const
@@ -291,25 +328,22 @@ void File::InferMetadata()
 	{
 	did_metadata_inference = true;
 
-	Val* bof_buffer_val = val->Lookup(bof_buffer_idx);
+	FinishBOF();
 
-	if ( ! bof_buffer_val )
-		{
-		if ( bof_buffer.size == 0 )
-			return;
+	if ( ! bof_buffer.val )
+		return;
 
-		BroString* bs = concatenate(bof_buffer.chunks);
-		bof_buffer_val = new StringVal(bs);
-		val->Assign(bof_buffer_idx, bof_buffer_val);
-		}
+	const u_char* data = bof_buffer.val->Bytes();
+	uint64 len = bof_buffer.val->Len();
+	len = min(len, LookupFieldDefaultCount(bof_buffer_size_idx));
+
+	if ( file_fingerprint_cache_size > 0 )
+		CheckFingerprint(data, len);
 
 	if ( ! FileEventAvailable(file_sniff) )
 		return;
 
 	RuleMatcher::MIME_Matches matches;
-	const u_char* data = bof_buffer_val->AsString()->Bytes();
-	uint64 len = bof_buffer_val->AsString()->Len();
-	len = min(len, LookupFieldDefaultCount(bof_buffer_size_idx));
 	file_mgr->DetectMIME(data, len, &matches);
 
 	val_list* vl = new val_list();
@@ -320,7 +354,7 @@ void File::InferMetadata()
 	if ( ! matches.empty() )
 		{
 		meta->Assign(meta_mime_type_idx,
-		             new StringVal(*(matches.begin()->second.begin())));
+		             file_mgr->MIMEVal(*(matches.begin()->second.begin())));
 		meta->Assign(meta_mime_types_idx,
 		             file_analysis::GenMIMEMatchesVal(matches));
 		}
@@ -329,6 +363,29 @@ void File::InferMetadata()
 	return;
 	}
 
+void File::CheckFingerprint(const u_char* data, uint64 len)
+	{
+	// Without knowing the size up front, we can't tell files with the
+	// same beginning apart.
+	Val* total = val->Lookup(total_bytes_idx);
+
+	if ( ! total )
+		return;
+
+	fingerprint = file_mgr->Fingerprint(data, len, total->AsCount());
+	val->Assign(fingerprint_idx, new StringVal(fingerprint));
+
+	string earlier = file_mgr->LookupFingerprint(fingerprint);
+
+	if ( earlier.empty() || ! FileEventAvailable(file_fingerprint_match) )
+		return;
+
+	val_list* vl = new val_list();
+	vl->append(val->Ref());
+	vl->append(new StringVal(earlier));
+	FileEvent(file_fingerprint_match, vl);
+	}
+
 bool File::BufferBOF(const u_char* data, uint64 len)
 	{
 	if ( bof_buffer.full )
@@ -336,21 +393,57 @@ bool File::BufferBOF(const u_char* data, uint64 len)
 
 	uint64 desired_size = LookupFieldDefaultCount(bof_buffer_size_idx);
 
-	bof_buffer.chunks.push_back(new BroString(data, len, 0));
+	if ( bof_buffer.size == 0 && len >= desired_size )
+		{
+		// The common case of a first chunk that's large enough.
+		bof_buffer.size = len;
+		bof_buffer.full = true;
+
+		if ( len > 0 )
+			{
+			bof_buffer.val = new StringVal(new BroString(data, len, 1));
+			val->Assign(bof_buffer_idx, bof_buffer.val->Ref());
+			}
+
+		return false;
+		}
+
+	if ( bof_buffer.size + len > bof_buffer.capacity )
+		{
+		// Leave room for the final NUL.
+		uint64 capacity = max(desired_size, bof_buffer.size + len) + 1;
+		u_char* buf = new u_char[capacity];
+
+		if ( bof_buffer.size )
+			memcpy(buf, bof_buffer.data, bof_buffer.size);
+
+		delete [] bof_buffer.data;
+		bof_buffer.data = buf;
+		bof_buffer.capacity = capacity - 1;
+		}
+
+	memcpy(bof_buffer.data + bof_buffer.size, data, len);
 	bof_buffer.size += len;
 
 	if ( bof_buffer.size < desired_size )
 		return true;
 
 	bof_buffer.full = true;
+	FinishBOF();
+	return false;
+	}
 
-	if ( bof_buffer.size > 0 )
-		{
-		BroString* bs = concatenate(bof_buffer.chunks);
-		val->Assign(bof_buffer_idx, new StringVal(bs));
-		}
+void File::FinishBOF()
+	{
+	if ( bof_buffer.val || bof_buffer.size == 0 )
+		return;
 
-	return false;
+	bof_buffer.data[bof_buffer.size] = 0;
+	bof_buffer.val = new StringVal(new BroString(1, bof_buffer.data,
+	                                             bof_buffer.size));
+	bof_buffer.data = 0;
+	bof_buffer.capacity = 0;
+	val->Assign(bof_buffer_idx, bof_buffer.val->Ref());
 	}
 
 void File::DeliverStream(const u_char* data, uint64 len)
@@ -379,31 +472,24 @@ void File::DeliverStream(const u_char* data, uint64 len)
 		if ( ! a->GotStreamDelivery() )
 			{
 			DBG_LOG(DBG_FILE_ANALYSIS, "skipping stream delivery to analyzer %s", file_mgr->GetComponentName(a->Tag()).c_str());
-			int num_bof_chunks_behind = bof_buffer.chunks.size();
+			uint64 bof_bytes_behind = bof_buffer.size;
 
 			if ( ! bof_was_full )
 				// We just added a chunk to the BOF buffer, don't count it
 				// as it will get delivered on its own.
-				num_bof_chunks_behind -= 1;
-
-			uint64 bytes_delivered = 0;
+				bof_bytes_behind -= len;
 
 			// Catch this analyzer up with the BOF buffer.
-			for ( int i = 0; i < num_bof_chunks_behind; ++i )
-				{
-				if ( ! a->DeliverStream(bof_buffer.chunks[i]->Bytes(),
-				                        bof_buffer.chunks[i]->Len()) )
-					analyzers.QueueRemove(a->Tag(), a->Args());
-
-				bytes_delivered += bof_buffer.chunks[i]->Len();
-				}
+			if ( bof_bytes_behind &&
+			     ! deliver_stream(a, BOFBytes(), bof_bytes_behind) )
+				analyzers.QueueRemove(a->Tag(), a->Args());
 
 			a->SetGotStreamDelivery();
 			// May need to catch analyzer up on missed gap?
 			// Analyzer should be fully caught up to stream_offset now.
 			}
 
-		if ( ! a->DeliverStream(data, len) )
+		if ( ! deliver_stream(a, data, len) )
 			analyzers.QueueRemove(a->Tag(), a->Args());
 		}
 
@@ -427,8 +513,8 @@ void File::DeliverChunk(const u_char* data, uint64 len, uint64 offset)
 				{
 				val_list* vl = new val_list();
 				vl->append(val->Ref());
-				vl->append(new Val(current_offset, TYPE_COUNT));
-				vl->append(new Val(gap_bytes, TYPE_COUNT));
+				vl->append(val_mgr->GetCount(current_offset));
+				vl->append(val_mgr->GetCount(gap_bytes));
 				FileEvent(file_reassembly_overflow, vl);
 				}
 			}
@@ -468,7 +554,7 @@ void File::DeliverChunk(const u_char* data, uint64 len, uint64 offset)
 	while ( (a = analyzers.NextEntry(c)) )
 		{
 		DBG_LOG(DBG_FILE_ANALYSIS, "chunk delivery to analyzer %s", file_mgr->GetComponentName(a->Tag()).c_str());
-		if ( ! a->DeliverChunk(data, len, offset) )
+		if ( ! deliver_chunk(a, data, len, offset) )
 			{
 			analyzers.QueueRemove(a->Tag(), a->Args());
 			}
@@ -517,12 +603,17 @@ void File::EndOfFile()
 
 	done = true;
 
+	// Only files we've seen in full vouch for their fingerprint.
+	if ( ! fingerprint.empty() && IsComplete() &&
+	     LookupFieldDefaultCount(missing_bytes_idx) == 0 )
+		file_mgr->AddFingerprint(fingerprint, id);
+
 	file_analysis::Analyzer* a = 0;
 	IterCookie* c = analyzers.InitForIteration();
 
 	while ( (a = analyzers.NextEntry(c)) )
 		{
-		if ( ! a->EndOfFile() )
+		if ( ! end_of_file(a) )
 			analyzers.QueueRemove(a->Tag(), a->Args());
 		}
 
@@ -555,7 +646,7 @@ void File::Gap(uint64 offset, uint64 len)
 
 	while ( (a = analyzers.NextEntry(c)) )
 		{
-		if ( ! a->Undelivered(offset, len) )
+		if ( ! undelivered(a, offset, len) )
 			analyzers.QueueRemove(a->Tag(), a->Args());
 		}
 
@@ -563,8 +654,8 @@ void File::Gap(uint64 offset, uint64 len)
 		{
 		val_list* vl = new val_list();
 		vl->append(val->Ref());
-		vl->append(new Val(offset, TYPE_COUNT));
-		vl->append(new Val(len, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(offset));
+		vl->append(val_mgr->GetCount(len));
 		FileEvent(file_gap, vl);
 		}
 
@@ -594,7 +685,7 @@ void File::FileEvent(EventHandlerPtr h, val_list* vl)
 	mgr.QueueEvent(h, vl);
 
 	if ( h == file_new || h == file_over_new_connection ||
-	     h == file_sniff ||
+	     h == file_sniff || h == file_fingerprint_match ||
 	     h == file_timeout || h == file_extraction_limit )
 		{
 		// immediate feedback is required for these events.
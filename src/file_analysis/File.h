@@ -229,6 +229,17 @@ protected:
 	 */
 	bool BufferBOF(const u_char* data, uint64 len);
 
+	/**
+	 * Moves the collected BOF chunks into the file's \c bof_buffer field.
+	 */
+	void FinishBOF();
+
+	/**
+	 * @return the BOF buffer's content.
+	 */
+	const u_char* BOFBytes() const
+		{ return bof_buffer.val ? bof_buffer.val->Bytes() : bof_buffer.data; }
+
 	/**
 	 * Does metadata inference (e.g. mime type detection via file
 	 * magic signatures) using data in the BOF (beginning-of-file) buffer
@@ -236,6 +247,15 @@ protected:
 	 */
 	void InferMetadata();
 
+	/**
+	 * Computes the file's fingerprint from the BOF buffer and its size,
+	 * if enabled by \c file_fingerprint_cache_size, and raises
+	 * \c file_fingerprint_match if an earlier file had the same.
+	 * @param data the content of the BOF buffer.
+	 * @param len number of bytes in \a data.
+	 */
+	void CheckFingerprint(const u_char* data, uint64 len);
+
 	/**
 	 * Enables reassembly on the file.
 	 */
@@ -286,16 +306,24 @@ protected:
 	bool reassembly_enabled;           /**< Whether file stream reassembly is needed. */
 	bool postpone_timeout;     /**< Whether postponing timeout is requested. */
 	bool done;                 /**< If this object is about to be deleted. */
+	string fingerprint;        /**< For the fingerprint cache, if computed. */
 	AnalyzerSet analyzers;     /**< A set of attached file analyzers. */
 
+	/**
+	 * The BOF buffer holds whole chunks, up to the one that fills it.  If
+	 * that's the first, it gets copied once, straight into #val;
+	 * otherwise, the chunks get collected in #data first.
+	 */
 	struct BOF_Buffer {
-		BOF_Buffer() : full(false), size(0) {}
+		BOF_Buffer() : full(false), size(0), capacity(0), data(0), val(0) {}
 		~BOF_Buffer()
-			{ for ( size_t i = 0; i < chunks.size(); ++i ) delete chunks[i]; }
+			{ delete [] data; Unref(val); }
 
 		bool full;
 		uint64 size;
-		BroString::CVec chunks;
+		uint64 capacity;
+		u_char* data;      /**< Fragmented content, until #val takes it over. */
+		StringVal* val;    /**< The content, once complete. */
 	} bof_buffer;              /**< Beginning of file buffer. */
 
 	static int id_idx;
@@ -311,6 +339,7 @@ protected:
 	static int timeout_interval_idx;
 	static int bof_buffer_size_idx;
 	static int bof_buffer_idx;
+	static int fingerprint_idx;
 	static int mime_type_idx;
 	static int mime_types_idx;
 
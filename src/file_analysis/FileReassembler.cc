@@ -111,6 +111,13 @@ void FileReassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 	// Not doing anything here yet.
 	}
 
+void FileReassembler::ReleaseBlocks()
+	{
+	// Holes get reported as file gaps.
+	Flush();
+	Reassembler::ReleaseBlocks();
+	}
+
 IMPLEMENT_SERIAL(FileReassembler, SER_FILE_REASSEMBLER);
 
 bool FileReassembler::DoSerialize(SerialInfo* info) const
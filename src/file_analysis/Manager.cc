@@ -10,6 +10,7 @@
 #include "Var.h"
 #include "Event.h"
 #include "UID.h"
+#include "digest.h"
 
 #include "plugin/Manager.h"
 #include "analyzer/Manager.h"
@@ -23,7 +24,8 @@ string Manager::salt;
 Manager::Manager()
 	: plugin::ComponentManager<file_analysis::Tag,
 	                           file_analysis::Component>("Files", "Tag"),
-	id_map(), ignored(), current_file_id(), magic_state()
+	id_map(), ignored(), current_file_id(), pin_current_file_id(false),
+	magic_state()
 	{
 	}
 
@@ -32,6 +34,9 @@ Manager::~Manager()
 	for ( MIMEMap::iterator i = mime_types.begin(); i != mime_types.end(); i++ )
 		delete i->second;
 
+	for ( MIMEValMap::iterator i = mime_vals.begin(); i != mime_vals.end(); i++ )
+		Unref(i->second);
+
 	// Have to assume that too much of Bro has been shutdown by this point
 	// to do anything more than reclaim memory.
 
@@ -85,6 +90,44 @@ void Manager::Terminate()
 	mgr.Drain();
 	}
 
+string Manager::Fingerprint(const u_char* bof, uint64 len,
+                             uint64 total_bytes) const
+	{
+	u_char digest[MD5_DIGEST_LENGTH];
+	MD5(bof, len, digest);
+
+	return fmt("%" PRIu64 "-%s", total_bytes, md5_digest_print(digest));
+	}
+
+string Manager::LookupFingerprint(const string& fingerprint)
+	{
+	FingerprintMap::iterator i = fingerprints.find(fingerprint);
+
+	if ( i == fingerprints.end() )
+		return "";
+
+	fingerprint_lru.splice(fingerprint_lru.begin(), fingerprint_lru,
+	                       i->second);
+
+	return i->second->second;
+	}
+
+void Manager::AddFingerprint(const string& fingerprint, const string& file_id)
+	{
+	if ( file_fingerprint_cache_size <= 0 ||
+	     fingerprints.find(fingerprint) != fingerprints.end() )
+		return;
+
+	while ( fingerprints.size() >= (unsigned int) file_fingerprint_cache_size )
+		{
+		fingerprints.erase(fingerprint_lru.back().first);
+		fingerprint_lru.pop_back();
+		}
+
+	fingerprint_lru.push_front(make_pair(fingerprint, file_id));
+	fingerprints[fingerprint] = fingerprint_lru.begin();
+	}
+
 string Manager::HashHandle(const string& handle) const
 	{
 	if ( salt.empty() )
@@ -99,13 +142,49 @@ string Manager::HashHandle(const string& handle) const
 	return Bro::UID(bits_per_uid, hash, 2).Base62("F");
 	}
 
-void Manager::SetHandle(const string& handle)
+void Manager::SetHandle(const string& handle, bool pin)
 	{
 	if ( handle.empty() )
 		return;
 
-	DBG_LOG(DBG_FILE_ANALYSIS, "Set current handle to %s", handle.c_str());
+	DBG_LOG(DBG_FILE_ANALYSIS, "Set current handle to %s%s", handle.c_str(),
+	        pin ? " (pinned)" : "");
 	current_file_id = HashHandle(handle);
+	pin_current_file_id = pin;
+	}
+
+void Manager::InvalidateHandle(analyzer::Tag tag, Connection* conn, bool is_orig)
+	{
+	PinMap::iterator i = pinned_handles.find(PinKey(make_pair(conn, is_orig), tag));
+
+	if ( i == pinned_handles.end() )
+		return;
+
+	// The index entry may stay behind; InvalidateHandles() skips those.
+	pinned_handles.erase(i);
+	}
+
+bool Manager::InvalidateHandles(const string& file_id)
+	{
+	if ( pins_by_file.empty() )
+		return false;
+
+	pair<PinIndex::iterator, PinIndex::iterator> r = pins_by_file.equal_range(file_id);
+	bool found = false;
+
+	for ( PinIndex::iterator i = r.first; i != r.second; ++i )
+		{
+		PinMap::iterator p = pinned_handles.find(i->second);
+
+		if ( p != pinned_handles.end() && p->second.second == file_id )
+			{
+			pinned_handles.erase(p);
+			found = true;
+			}
+		}
+
+	pins_by_file.erase(r.first, r.second);
+	return found;
 	}
 
 string Manager::DataIn(const u_char* data, uint64 len, uint64 offset,
@@ -381,6 +460,9 @@ bool Manager::IgnoreFile(const string& file_id)
 
 bool Manager::RemoveFile(const string& file_id)
 	{
+	// Data after this starts a new file.
+	InvalidateHandles(file_id);
+
 	HashKey key(file_id.c_str());
 	// Can't remove from the dictionary/map right away as invoking EndOfFile
 	// may cause some events to be executed which actually depend on the file
@@ -407,6 +489,7 @@ bool Manager::IsIgnored(const string& file_id)
 string Manager::GetFileID(analyzer::Tag tag, Connection* c, bool is_orig)
 	{
 	current_file_id.clear();
+	pin_current_file_id = false;
 
 	if ( IsDisabled(tag) )
 		return "";
@@ -414,6 +497,26 @@ string Manager::GetFileID(analyzer::Tag tag, Connection* c, bool is_orig)
 	if ( ! get_file_handle )
 		return "";
 
+	PinKey key(make_pair(c, is_orig), tag);
+
+	if ( ! pinned_handles.empty() )
+		{
+		// Events about what came before the data may invalidate the
+		// pin, so they need to run first.
+		mgr.Drain();
+
+		PinMap::iterator i = pinned_handles.find(key);
+
+		if ( i != pinned_handles.end() )
+			{
+			if ( i->second.first == c->GetUID() )
+				return i->second.second;
+
+			// A new connection at the same address.
+			pinned_handles.erase(i);
+			}
+		}
+
 	DBG_LOG(DBG_FILE_ANALYSIS, "Raise get_file_handle() for protocol analyzer %s",
 		analyzer_mgr->GetComponentName(tag).c_str());
 
@@ -423,10 +526,17 @@ string Manager::GetFileID(analyzer::Tag tag, Connection* c, bool is_orig)
 	val_list* vl = new val_list();
 	vl->append(tagval);
 	vl->append(c->BuildConnVal());
-	vl->append(new Val(is_orig, TYPE_BOOL));
+	vl->append(val_mgr->GetBool(is_orig));
 
 	mgr.QueueEvent(get_file_handle, vl);
 	mgr.Drain(); // need file handle immediately so we don't have to buffer data
+
+	if ( pin_current_file_id && ! current_file_id.empty() )
+		{
+		pinned_handles[key] = Pin(c->GetUID(), current_file_id);
+		pins_by_file.insert(make_pair(current_file_id, key));
+		}
+
 	return current_file_id;
 	}
 
@@ -435,7 +545,7 @@ bool Manager::IsDisabled(analyzer::Tag tag)
 	if ( ! disabled )
 		disabled = internal_const_val("Files::disable")->AsTableVal();
 
-	Val* index = new Val(tag, TYPE_COUNT);
+	Val* index = val_mgr->GetCount(tag);
 	Val* yield = disabled->Lookup(index);
 	Unref(index);
 
@@ -502,6 +612,16 @@ string Manager::DetectMIME(const u_char* data, uint64 len) const
 	return *(matches.begin()->second.begin());
 	}
 
+StringVal* Manager::MIMEVal(const string& mime_type)
+	{
+	MIMEValMap::iterator i = mime_vals.find(mime_type);
+
+	if ( i == mime_vals.end() )
+		i = mime_vals.insert(make_pair(mime_type, new StringVal(mime_type))).first;
+
+	return i->second->Ref()->AsStringVal();
+	}
+
 VectorVal* file_analysis::GenMIMEMatchesVal(const RuleMatcher::MIME_Matches& m)
 	{
 	VectorVal* rval = new VectorVal(mime_matches);
@@ -514,8 +634,8 @@ VectorVal* file_analysis::GenMIMEMatchesVal(const RuleMatcher::MIME_Matches& m)
 		for ( set<string>::const_iterator it2 = it->second.begin();
 		      it2 != it->second.end(); ++it2 )
 			{
-			element->Assign(0, new Val(it->first, TYPE_INT));
-			element->Assign(1, new StringVal(*it2));
+			element->Assign(0, val_mgr->GetInt(it->first));
+			element->Assign(1, file_mgr->MIMEVal(*it2));
 			}
 
 		rval->Assign(rval->Size(), element);
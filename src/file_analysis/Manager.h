@@ -5,7 +5,11 @@
 
 #include <string>
 #include <queue>
+#include <list>
+#include <map>
+#include <vector>
 
+#include "AnalyzerProfile.h"
 #include "Dict.h"
 #include "Net.h"
 #include "Conn.h"
@@ -79,8 +83,30 @@ public:
 	 * Take in a unique file handle string to identify next piece of
 	 * incoming file data/information.
 	 * @param handle a unique string which identifies a single file.
+	 * @param pin if true, the handle is pinned to the connection,
+	 *        direction and protocol analyzer that it's set for, so that
+	 *        further data of them resolves to the same file without
+	 *        raising \c get_file_handle again.  The pin lasts until the
+	 *        file is removed or the handle invalidated.
 	 */
-	void SetHandle(const string& handle);
+	void SetHandle(const string& handle, bool pin = false);
+
+	/**
+	 * Invalidates a pinned file handle, so that the next piece of data
+	 * raises \c get_file_handle again.
+	 * @param tag network protocol over which the file is transferred.
+	 * @param conn network connection over which the file is transferred.
+	 * @param is_orig true if the file is being sent from connection originator
+	 *        or false if is being sent in the opposite direction.
+	 */
+	void InvalidateHandle(analyzer::Tag tag, Connection* conn, bool is_orig);
+
+	/**
+	 * Invalidates all pinned file handles resolving to a file.
+	 * @param file_id the file identifier/hash.
+	 * @return whether any handle was pinned to the file.
+	 */
+	bool InvalidateHandles(const string& file_id);
 
 	/**
 	 * Pass in non-sequential file data.
@@ -302,6 +328,43 @@ public:
 	 */
 	std::string DetectMIME(const u_char* data, uint64 len) const;
 
+	/**
+	 * Returns a script-layer string for a MIME type.  These get shared, so
+	 * that files of the same type don't each allocate their own.
+	 * @param mime_type the MIME type.
+	 * @return a new reference to the value.
+	 */
+	StringVal* MIMEVal(const string& mime_type);
+
+	/**
+	 * Computes the fingerprint of a file for the fingerprint cache.
+	 * @param bof the beginning of the file, i.e. its BOF buffer.
+	 * @param len number of bytes in \a bof.
+	 * @param total_bytes the file's size.
+	 * @return the fingerprint, a string of hex digits prefixed by the size.
+	 */
+	std::string Fingerprint(const u_char* bof, uint64 len,
+	                        uint64 total_bytes) const;
+
+	/**
+	 * Looks up a fingerprint in the cache of completely seen files.
+	 * @param fingerprint the fingerprint as returned by Fingerprint().
+	 * @return the ID of the earlier file with the fingerprint, or an
+	 *         empty string if there's none in the cache.
+	 */
+	std::string LookupFingerprint(const std::string& fingerprint);
+
+	/**
+	 * Adds a completely seen file to the fingerprint cache, unless its
+	 * fingerprint is in there already. If the cache is at its limit of
+	 * \c file_fingerprint_cache_size entries, the least recently
+	 * looked up one goes.
+	 * @param fingerprint the file's fingerprint.
+	 * @param file_id the file's identifier.
+	 */
+	void AddFingerprint(const std::string& fingerprint,
+	                    const std::string& file_id);
+
 	uint64 CurrentFiles()
 		{ return id_map.Length(); }
 
@@ -311,6 +374,20 @@ public:
 	uint64 CumulativeFiles()
 		{ return id_map.NumCumulativeInserts(); }
 
+	/**
+	 * Returns the resource usage profile of a file analyzer type, which
+	 * its instances update while \c analyzer_profiling is on.
+	 * @param tag the file analyzer's tag.
+	 * @return the profile.
+	 */
+	AnalyzerProfile* Profile(const Tag& tag)
+		{
+		if ( tag.Type() >= profiles.size() )
+			profiles.resize(tag.Type() + 1);
+
+		return &profiles[tag.Type()];
+		}
+
 protected:
 	friend class FileTimer;
 
@@ -390,14 +467,34 @@ protected:
 private:
 	typedef set<Tag> TagSet;
 	typedef map<string, TagSet*> MIMEMap;
+	typedef map<string, StringVal*> MIMEValMap;
+
+	// Pinned file handles are per connection, direction and protocol
+	// analyzer.  The connection's UID guards against the pointer getting
+	// reused for a new one.
+	typedef std::pair<std::pair<Connection*, bool>, analyzer::Tag> PinKey;
+	typedef std::pair<Bro::UID, string> Pin;
+	typedef std::map<PinKey, Pin> PinMap;
+	typedef std::multimap<string, PinKey> PinIndex;
+
+	// Fingerprint cache entries, most recently used first.
+	typedef std::list<std::pair<string, string> > FingerprintList;
+	typedef map<string, FingerprintList::iterator> FingerprintMap;
 
 	TagSet* LookupMIMEType(const string& mtype, bool add_if_not_found);
 
 	PDict(File) id_map;  /**< Map file ID to file_analysis::File records. */
 	PDict(bool) ignored; /**< Ignored files.  Will be finally removed on EOF. */
 	string current_file_id;	/**< Hash of what get_file_handle event sets. */
+	bool pin_current_file_id;	/**< Whether to pin #current_file_id. */
+	PinMap pinned_handles;	/**< File IDs of pinned handles. */
+	PinIndex pins_by_file;	/**< Index into #pinned_handles by file ID. */
 	RuleFileMagicState* magic_state;	/**< File magic signature match state. */
 	MIMEMap mime_types;/**< Mapping of MIME types to analyzers. */
+	MIMEValMap mime_vals;	/**< Shared values of MIME types. */
+	FingerprintList fingerprint_lru; /**< Fingerprints and file IDs. */
+	FingerprintMap fingerprints; /**< Index into #fingerprint_lru. */
+	std::vector<AnalyzerProfile> profiles; /**< Indexed by tag type. */
 
 	static TableVal* disabled;	/**< Table of disabled analyzers. */
 	static TableType* tag_set_type;	/**< Type for set[tag]. */
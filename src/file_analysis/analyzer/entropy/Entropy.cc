@@ -13,7 +13,7 @@ Entropy::Entropy(RecordVal* args, File* file)
     : file_analysis::Analyzer(file_mgr->GetComponentTag("ENTROPY"), args, file)
 	{
 	//entropy->Init();
-	entropy = new EntropyVal;
+	entropy = new EntropyVal(BifConst::file_entropy_histogram_only);
 	fed = false;
 	}
 
@@ -3,6 +3,7 @@
 #include <string>
 
 #include "Extract.h"
+#include "ExtractWriter.h"
 #include "util.h"
 #include "Event.h"
 #include "file_analysis/Manager.h"
@@ -14,7 +15,19 @@ Extract::Extract(RecordVal* args, File* file, const string& arg_filename,
     : file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"), args, file),
       filename(arg_filename), limit(arg_limit), depth(0)
 	{
-	fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+	async = ExtractWriter::Instance() != 0;
+	overflowed = false;
+	buffer = 0;
+	buffered = 0;
+
+	// The writer thread writes at explicit offsets, so that the
+	// data we drop leaves holes of the right size.
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	if ( ! async )
+		flags |= O_APPEND;
+
+	fd = open(filename.c_str(), flags, 0666);
 
 	if ( fd < 0 )
 		{
@@ -27,10 +40,82 @@ Extract::Extract(RecordVal* args, File* file, const string& arg_filename,
 
 Extract::~Extract()
 	{
+	if ( async )
+		{
+		Flush(false);
+		delete [] buffer;
+
+		if ( fd )
+			{
+			ExtractWriter* writer = ExtractWriter::Instance();
+
+			if ( writer )
+				{
+				writer->Close(fd, depth);
+				return;
+				}
+
+			ftruncate(fd, depth);
+			}
+		}
+
 	if ( fd )
 		safe_close(fd);
 	}
 
+void Extract::Write(u_char* data, uint64 len, uint64 offset, bool may_drop)
+	{
+	ExtractWriter* writer = ExtractWriter::Instance();
+
+	if ( ! writer )
+		{
+		// Shutting down.
+		safe_pwrite(fd, data, len, offset);
+		delete [] data;
+		return;
+		}
+
+	if ( writer->Write(fd, data, len, offset, false) )
+		return;
+
+	if ( may_drop && file_extract_drop_on_overflow )
+		{
+		Overflow(len);
+		delete [] data;
+		return;
+		}
+
+	if ( may_drop )
+		Overflow(0);
+
+	writer->Write(fd, data, len, offset, true);
+	}
+
+void Extract::Flush(bool may_drop)
+	{
+	if ( ! buffered )
+		return;
+
+	Write(buffer, buffered, depth - buffered, may_drop);
+	buffer = 0;
+	buffered = 0;
+	}
+
+void Extract::Overflow(uint64 dropped)
+	{
+	if ( overflowed || ! file_extraction_overflow )
+		return;
+
+	overflowed = true;
+
+	File* f = GetFile();
+	val_list* vl = new val_list();
+	vl->append(f->GetVal()->Ref());
+	vl->append(Args()->Ref());
+	vl->append(val_mgr->GetCount(dropped));
+	f->FileEvent(file_extraction_overflow, vl);
+	}
+
 static Val* get_extract_field_val(RecordVal* args, const char* name)
 	{
 	Val* rval = args->Lookup(name);
@@ -93,15 +178,39 @@ bool Extract::DeliverStream(const u_char* data, uint64 len)
 		val_list* vl = new val_list();
 		vl->append(f->GetVal()->Ref());
 		vl->append(Args()->Ref());
-		vl->append(new Val(limit, TYPE_COUNT));
-		vl->append(new Val(len, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(limit));
+		vl->append(val_mgr->GetCount(len));
 		f->FileEvent(file_extraction_limit, vl);
 
 		// Limit may have been modified by a BIF, re-check it.
 		limit_exceeded = check_limit_exceeded(limit, depth, len, &towrite);
 		}
 
-	if ( towrite > 0 )
+	if ( towrite > 0 && async )
+		{
+		if ( buffered + towrite > WRITE_CHUNK_SIZE )
+			Flush(true);
+
+		if ( towrite >= WRITE_CHUNK_SIZE )
+			{
+			u_char* copy = new u_char[towrite];
+			memcpy(copy, data, towrite);
+			Write(copy, towrite, depth, true);
+			}
+
+		else
+			{
+			if ( ! buffer )
+				buffer = new u_char[WRITE_CHUNK_SIZE];
+
+			memcpy(buffer + buffered, data, towrite);
+			buffered += towrite;
+			}
+
+		depth += towrite;
+		}
+
+	else if ( towrite > 0 )
 		{
 		safe_write(fd, reinterpret_cast<const char*>(data), towrite);
 		depth += towrite;
@@ -112,7 +221,15 @@ bool Extract::DeliverStream(const u_char* data, uint64 len)
 
 bool Extract::Undelivered(uint64 offset, uint64 len)
 	{
-	if ( depth == offset )
+	if ( depth == offset && async )
+		{
+		// Leave a hole; the writer makes sure a gap at the end
+		// still counts toward the file's size.
+		Flush(true);
+		depth += len;
+		}
+
+	else if ( depth == offset )
 		{
 		char* tmp = new char[len]();
 		safe_write(fd, tmp, len);
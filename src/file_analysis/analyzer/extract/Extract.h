@@ -57,6 +57,12 @@ public:
 	 */
 	void SetLimit(uint64 bytes) { limit = bytes; }
 
+	/**
+	 * Size of the chunks extraction writes, when it writes on the
+	 * ExtractWriter thread. Smaller pieces of file data get coalesced.
+	 */
+	static const uint64 WRITE_CHUNK_SIZE = 65536;
+
 protected:
 
 	/**
@@ -70,11 +76,36 @@ protected:
 	Extract(RecordVal* args, File* file, const string& arg_filename,
 	        uint64 arg_limit);
 
+	/**
+	 * Passes data for the given offset of the extraction file on to the
+	 * ExtractWriter, taking ownership of it. If the writer's buffer is
+	 * full, this either waits or drops the data, as configured by
+	 * file_extract_drop_on_overflow, unless \a may_drop is false.
+	 */
+	void Write(u_char* data, uint64 len, uint64 offset, bool may_drop);
+
+	/**
+	 * Passes on the coalesced data, if any.
+	 */
+	void Flush(bool may_drop);
+
+	/**
+	 * Raises file_extraction_overflow, the first time a write doesn't fit
+	 * into the writer's buffer.
+	 * @param dropped the number of bytes dropped for lack of room.
+	 */
+	void Overflow(uint64 dropped);
+
 private:
 	string filename;
 	int fd;
 	uint64 limit;
 	uint64 depth;
+
+	bool async;	// writing on the ExtractWriter thread
+	bool overflowed;	// file_extraction_overflow was raised
+	u_char* buffer;	// coalesced data not passed on yet
+	uint64 buffered;	// bytes in buffer, ending at depth
 };
 
 } // namespace file_analysis
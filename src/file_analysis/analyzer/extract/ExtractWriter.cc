@@ -0,0 +1,134 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <unistd.h>
+
+#include "ExtractWriter.h"
+#include "NetVar.h"
+#include "Net.h"
+
+using namespace file_analysis;
+
+static ExtractWriter* extract_writer = 0;
+
+ExtractWriter* ExtractWriter::Instance()
+	{
+	if ( extract_writer )
+		return extract_writer;
+
+	if ( file_extract_buffer <= 0 || ::terminating )
+		return 0;
+
+	extract_writer = new ExtractWriter();
+	extract_writer->Start();
+
+	return extract_writer;
+	}
+
+ExtractWriter::ExtractWriter() : queue(this, 0)
+	{
+	stopping = false;
+	pending = 0;
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&has_room, 0);
+
+	SetName("extract");
+	}
+
+ExtractWriter::~ExtractWriter()
+	{
+	pthread_cond_destroy(&has_room);
+	pthread_mutex_destroy(&mutex);
+	}
+
+bool ExtractWriter::Write(int fd, u_char* data, uint64 len, uint64 offset,
+				bool wait)
+	{
+	uint64 limit = file_extract_buffer;
+
+	pthread_mutex_lock(&mutex);
+
+	// Something larger than the whole buffer still goes through once
+	// everything else is out.
+	while ( pending > 0 && pending + len > limit )
+		{
+		if ( ! wait )
+			{
+			pthread_mutex_unlock(&mutex);
+			return false;
+			}
+
+		pthread_cond_wait(&has_room, &mutex);
+		}
+
+	pending += len;
+	pthread_mutex_unlock(&mutex);
+
+	Job* job = new Job;
+	job->fd = fd;
+	job->data = data;
+	job->len = len;
+	job->offset = offset;
+	queue.Put(job);
+
+	return true;
+	}
+
+void ExtractWriter::Close(int fd, uint64 size)
+	{
+	Job* job = new Job;
+	job->fd = fd;
+	job->data = 0;
+	job->len = size;
+	job->offset = 0;
+	queue.Put(job);
+	}
+
+void ExtractWriter::Run()
+	{
+	SetOSName(Name());
+
+	while ( true )
+		{
+		Job* job = queue.Get();
+
+		if ( ! job )
+			{
+			// Leave only once everything has been written.
+			if ( (stopping || Killed()) && ! queue.Ready() )
+				break;
+
+			continue;
+			}
+
+		if ( job->data )
+			{
+			safe_pwrite(job->fd, job->data, job->len, job->offset);
+			delete [] job->data;
+
+			pthread_mutex_lock(&mutex);
+			pending -= job->len;
+			pthread_cond_signal(&has_room);
+			pthread_mutex_unlock(&mutex);
+			}
+
+		else
+			{
+			// Gaps at the end leave the file short.
+			ftruncate(job->fd, job->len);
+			safe_close(job->fd);
+			}
+
+		delete job;
+		}
+	}
+
+void ExtractWriter::OnSignalStop()
+	{
+	// The thread manager deletes us once we've finished, so from now
+	// on extraction writes on the main thread.
+	extract_writer = 0;
+
+	stopping = true;
+	queue.WakeUp();
+	}
@@ -0,0 +1,67 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef FILE_ANALYSIS_EXTRACTWRITER_H
+#define FILE_ANALYSIS_EXTRACTWRITER_H
+
+#include <pthread.h>
+
+#include "threading/BasicThread.h"
+#include "threading/RingQueue.h"
+
+namespace file_analysis {
+
+/**
+ * A thread doing the disk I/O for the file extraction analyzers, so that a
+ * slow disk doesn't stall packet processing. The amount of data waiting
+ * to be written is bounded by file_extract_buffer.
+ */
+class ExtractWriter : public threading::BasicThread {
+public:
+	/**
+	 * Returns the writer, starting it on first use. Returns null if
+	 * extraction should write on the main thread, either because
+	 * file_extract_buffer is zero or because we're shutting down.
+	 */
+	static ExtractWriter* Instance();
+
+	/**
+	 * Queues data for writing at the given offset of a file and takes
+	 * ownership of it. If the data doesn't fit into the buffer, this
+	 * waits for room if \a wait is true, and otherwise returns false
+	 * without queueing; the data then remains the caller's.
+	 */
+	bool Write(int fd, u_char* data, uint64 len, uint64 offset, bool wait);
+
+	/**
+	 * Queues closing a file once all its data has been written,
+	 * truncating or extending it to the given size first.
+	 */
+	void Close(int fd, uint64 size);
+
+protected:
+	ExtractWriter();
+	~ExtractWriter();
+
+	virtual void Run();
+	virtual void OnSignalStop();
+	virtual void OnWaitForStop()	{ }
+
+private:
+	struct Job {
+		int fd;
+		u_char* data;	// null to close
+		uint64 len;	// the final size for closing
+		uint64 offset;
+	};
+
+	threading::RingQueue<Job*> queue;
+	volatile bool stopping;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t has_room;
+	uint64 pending;	// bytes queued, but not written yet
+};
+
+} // namespace file_analysis
+
+#endif
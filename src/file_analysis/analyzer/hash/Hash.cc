@@ -13,10 +13,15 @@ Hash::Hash(RecordVal* args, File* file, HashVal* hv, const char* arg_kind)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag(to_upper(arg_kind).c_str()), args, file), hash(hv), fed(false), kind(arg_kind)
 	{
 	hash->Init();
+	thread = HashThread::Select();
 	}
 
 Hash::~Hash()
 	{
+	// The thread may still be feeding the hash.
+	if ( thread )
+		backlog.Wait();
+
 	Unref(hash);
 	}
 
@@ -28,7 +33,11 @@ bool Hash::DeliverStream(const u_char* data, uint64 len)
 	if ( ! fed )
 		fed = len > 0;
 
-	hash->Feed(data, len);
+	if ( thread )
+		thread->Feed(hash, &backlog, data, len);
+	else
+		hash->Feed(data, len);
+
 	return true;
 	}
 
@@ -48,6 +57,9 @@ void Hash::Finalize()
 	if ( ! hash->IsValid() || ! fed )
 		return;
 
+	if ( thread )
+		backlog.Wait();
+
 	val_list* vl = new val_list();
 	vl->append(GetFile()->GetVal()->Ref());
 	vl->append(new StringVal(kind));
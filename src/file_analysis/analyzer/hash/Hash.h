@@ -9,6 +9,7 @@
 #include "OpaqueVal.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "HashThread.h"
 
 #include "events.bif.h"
 
@@ -26,7 +27,8 @@ public:
 	virtual ~Hash();
 
 	/**
-	 * Incrementally hash next chunk of file contents.
+	 * Incrementally hash next chunk of file contents. With
+	 * file_hash_threads set, that happens on a HashThread.
 	 * @param data pointer to start of a chunk of a file data.
 	 * @param len number of bytes in the data chunk.
 	 * @return false if the digest is in an invalid state, else true.
@@ -61,7 +63,8 @@ protected:
 
 	/**
 	 * If some file contents have been seen, finalizes the hash of them and
-	 * raises the "file_hash" event with the results.
+	 * raises the "file_hash" event with the results. If hashing happens
+	 * on a thread, this first waits for it to catch up.
 	 */
 	void Finalize();
 
@@ -69,6 +72,8 @@ private:
 	HashVal* hash;
 	bool fed;
 	const char* kind;
+	HashThread* thread;	// null if hashing on the main thread
+	HashBacklog backlog;	// chunks queued to the thread
 };
 
 /**
@@ -0,0 +1,123 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string.h>
+#include <vector>
+
+#include "HashThread.h"
+#include "NetVar.h"
+#include "Net.h"
+
+using namespace file_analysis;
+
+static std::vector<HashThread*> hash_threads;
+static unsigned int next_hash_thread = 0;
+
+HashBacklog::HashBacklog()
+	{
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&drained, 0);
+	pending = 0;
+	}
+
+HashBacklog::~HashBacklog()
+	{
+	pthread_cond_destroy(&drained);
+	pthread_mutex_destroy(&mutex);
+	}
+
+void HashBacklog::Add()
+	{
+	pthread_mutex_lock(&mutex);
+	++pending;
+	pthread_mutex_unlock(&mutex);
+	}
+
+void HashBacklog::Done()
+	{
+	pthread_mutex_lock(&mutex);
+
+	if ( --pending == 0 )
+		pthread_cond_signal(&drained);
+
+	pthread_mutex_unlock(&mutex);
+	}
+
+void HashBacklog::Wait()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( pending > 0 )
+		pthread_cond_wait(&drained, &mutex);
+
+	pthread_mutex_unlock(&mutex);
+	}
+
+HashThread* HashThread::Select()
+	{
+	// Once we're shutting down, the thread manager may have already
+	// stopped and deleted the threads.
+	if ( file_hash_threads <= 0 || ::terminating )
+		return 0;
+
+	if ( hash_threads.size() < (unsigned int) file_hash_threads )
+		{
+		HashThread* t = new HashThread();
+		t->Start();
+		hash_threads.push_back(t);
+		return t;
+		}
+
+	return hash_threads[next_hash_thread++ % hash_threads.size()];
+	}
+
+HashThread::HashThread() : queue(this, 0)
+	{
+	stopping = false;
+	SetName(fmt("hash/%d", int(hash_threads.size())));
+	}
+
+void HashThread::Feed(HashVal* hash, HashBacklog* backlog,
+			const u_char* data, uint64 len)
+	{
+	Job* job = new Job;
+	job->hash = hash;
+	job->backlog = backlog;
+	job->data = new u_char[len];
+	job->len = len;
+	memcpy(job->data, data, len);
+
+	backlog->Add();
+	queue.Put(job);
+	}
+
+void HashThread::Run()
+	{
+	SetOSName(Name());
+
+	while ( true )
+		{
+		Job* job = queue.Get();
+
+		if ( ! job )
+			{
+			// Only leave once everything queued has been
+			// processed, as the hashes' owners wait for it.
+			if ( (stopping || Killed()) && ! queue.Ready() )
+				break;
+
+			continue;
+			}
+
+		job->hash->Feed(job->data, job->len);
+		job->backlog->Done();
+
+		delete [] job->data;
+		delete job;
+		}
+	}
+
+void HashThread::OnSignalStop()
+	{
+	stopping = true;
+	queue.WakeUp();
+	}
@@ -0,0 +1,89 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef FILE_ANALYSIS_HASHTHREAD_H
+#define FILE_ANALYSIS_HASHTHREAD_H
+
+#include <pthread.h>
+
+#include "OpaqueVal.h"
+#include "threading/BasicThread.h"
+#include "threading/RingQueue.h"
+
+namespace file_analysis {
+
+/**
+ * Tracks the chunks of file data queued for hashing on a HashThread that
+ * haven't been processed yet.
+ */
+class HashBacklog {
+public:
+	HashBacklog();
+	~HashBacklog();
+
+	/**
+	 * Notes that a chunk has been queued. Main thread only.
+	 */
+	void Add();
+
+	/**
+	 * Notes that a chunk has been processed. Hash thread only.
+	 */
+	void Done();
+
+	/**
+	 * Blocks until all queued chunks have been processed. Main thread
+	 * only.
+	 */
+	void Wait();
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t drained;
+	int pending;
+};
+
+/**
+ * A thread feeding chunks of file data into hashes, so that hashing
+ * happens in parallel to the main thread's processing. All chunks for
+ * one hash go to the same thread, so that they are processed in order.
+ */
+class HashThread : public threading::BasicThread {
+public:
+	/**
+	 * Returns the thread to use for a new hash, picking one round-robin
+	 * out of file_hash_threads of them and starting them
+	 * as needed. Returns null if hashing should happen on the main
+	 * thread.
+	 */
+	static HashThread* Select();
+
+	/**
+	 * Queues a copy of the data for feeding into the hash. The caller
+	 * needs to keep the hash and the backlog around until the
+	 * backlog has been waited for.
+	 */
+	void Feed(HashVal* hash, HashBacklog* backlog,
+		  const u_char* data, uint64 len);
+
+protected:
+	HashThread();
+
+	virtual void Run();
+	virtual void OnSignalStop();
+	virtual void OnWaitForStop()	{ }
+
+private:
+	struct Job {
+		HashVal* hash;
+		HashBacklog* backlog;
+		u_char* data;
+		uint64 len;
+	};
+
+	threading::RingQueue<Job*> queue;
+	volatile bool stopping;
+};
+
+} // namespace file_analysis
+
+#endif
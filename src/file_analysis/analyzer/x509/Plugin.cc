@@ -19,6 +19,12 @@ public:
 		config.description = "X509 analyzer";
 		return config;
 		}
+
+	void Done()
+		{
+		plugin::Plugin::Done();
+		::file_analysis::X509::ClearCache();
+		}
 } plugin;
 
 }
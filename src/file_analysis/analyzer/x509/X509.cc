@@ -4,9 +4,11 @@
 
 #include "X509.h"
 #include "Event.h"
+#include "Net.h"
 
 #include "events.bif.h"
 #include "types.bif.h"
+#include "functions.bif.h"
 
 #include "file_analysis/Manager.h"
 
@@ -15,11 +17,65 @@
 #include <openssl/asn1.h>
 #include <openssl/opensslconf.h>
 #include <openssl/err.h>
+#include <openssl/sha.h>
 
 using namespace file_analysis;
 
 IMPLEMENT_SERIAL(X509Val, SER_X509_VAL);
 
+file_analysis::X509::CacheList file_analysis::X509::cache_lru;
+file_analysis::X509::CacheMap file_analysis::X509::cache;
+file_analysis::X509::CacheStats file_analysis::X509::cache_stats;
+file_analysis::X509::VerifyCacheList file_analysis::X509::verify_cache_lru;
+file_analysis::X509::VerifyCacheMap file_analysis::X509::verify_cache;
+file_analysis::X509::VerifyCacheStats file_analysis::X509::verify_cache_stats;
+
+// Returns a copy of a certificate record sharing the field values, which
+// are all atomic. Scripts may modify the records they get, so the cached
+// ones can't be handed out themselves.
+static RecordVal* copy_cert_record(RecordVal* r)
+	{
+	RecordVal* copy = new RecordVal(BifType::Record::X509::Certificate);
+
+	for ( int i = 0; i < r->Type()->AsRecordType()->NumFields(); ++i )
+		{
+		Val* v = r->Lookup(i);
+
+		if ( v )
+			copy->Assign(i, v->Ref());
+		}
+
+	return copy;
+	}
+
+// Returns a copy of a verification result with a vector of its own, as
+// scripts may modify that too. The certificates are shared.
+static RecordVal* copy_result_record(RecordVal* r)
+	{
+	RecordVal* copy = new RecordVal(BifType::Record::X509::Result);
+	copy->Assign(0, r->Lookup(0)->Ref());
+	copy->Assign(1, r->Lookup(1)->Ref());
+
+	VectorVal* chain = r->Lookup(2) ? r->Lookup(2)->AsVectorVal() : 0;
+
+	if ( chain )
+		{
+		VectorVal* chain_copy = new VectorVal(chain->Type()->AsVectorType());
+
+		for ( unsigned int i = 0; i < chain->Size(); ++i )
+			{
+			Val* v = chain->Lookup(i);
+
+			if ( v )
+				chain_copy->Assign(i, v->Ref());
+			}
+
+		copy->Assign(2, chain_copy);
+		}
+
+	return copy;
+	}
+
 file_analysis::X509::X509(RecordVal* args, file_analysis::File* file)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag("X509"), args, file)
 	{
@@ -44,17 +100,42 @@ bool file_analysis::X509::EndOfFile()
 	// be rather straightforward...
 	const unsigned char* cert_char = reinterpret_cast<const unsigned char*>(cert_data.data());
 
-	::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
-	if ( ! ssl_cert )
+	// Repeated certificates come out of the cache, already parsed.
+	std::string sha1;
+	X509Val* cert_val = 0;
+	RecordVal* cert_record = 0;
+
+	if ( BifConst::X509::cache_size > 0 )
 		{
-		reporter->Weird(fmt("Could not parse X509 certificate (fuid %s)", GetFile()->GetID().c_str()));
-		return false;
+		u_char digest[SHA_DIGEST_LENGTH];
+		SHA1(cert_char, cert_data.size(), digest);
+		sha1.assign(reinterpret_cast<const char*>(digest), sizeof(digest));
+
+		LookupCache(sha1, &cert_val, &cert_record);
 		}
 
-	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
+	::X509* ssl_cert = 0;
+
+	if ( cert_val )
+		ssl_cert = cert_val->GetCertificate();
 
-	// parse basic information into record.
-	RecordVal* cert_record = ParseCertificate(cert_val, GetFile()->GetID().c_str());
+	else
+		{
+		ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
+		if ( ! ssl_cert )
+			{
+			reporter->Weird(fmt("Could not parse X509 certificate (fuid %s)", GetFile()->GetID().c_str()));
+			return false;
+			}
+
+		cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
+
+		// parse basic information into record.
+		cert_record = ParseCertificate(cert_val, GetFile()->GetID().c_str());
+
+		if ( ! sha1.empty() )
+			AddToCache(sha1, cert_val, cert_record);
+		}
 
 	// and send the record on to scriptland
 	val_list* vl = new val_list();
@@ -86,6 +167,131 @@ bool file_analysis::X509::EndOfFile()
 	return false;
 	}
 
+bool file_analysis::X509::LookupCache(const std::string& sha1,
+					X509Val** cert_val, RecordVal** cert_record)
+	{
+	CacheMap::iterator i = cache.find(sha1);
+
+	if ( i == cache.end() )
+		{
+		++cache_stats.misses;
+		return false;
+		}
+
+	++cache_stats.hits;
+	cache_lru.splice(cache_lru.begin(), cache_lru, i->second);
+
+	*cert_val = i->second->cert_val;
+	(*cert_val)->Ref();
+	*cert_record = copy_cert_record(i->second->cert_record);
+
+	return true;
+	}
+
+void file_analysis::X509::AddToCache(const std::string& sha1,
+					X509Val* cert_val, RecordVal* cert_record)
+	{
+	while ( cache.size() >= BifConst::X509::cache_size )
+		{
+		CacheEntry& e = cache_lru.back();
+		cache.erase(e.sha1);
+		Unref(e.cert_val);
+		Unref(e.cert_record);
+		cache_lru.pop_back();
+		++cache_stats.evictions;
+		}
+
+	// The cache keeps its own copy of the record, for the same reason
+	// that it hands out copies.
+	cert_val->Ref();
+
+	CacheEntry e;
+	e.sha1 = sha1;
+	e.cert_val = cert_val;
+	e.cert_record = copy_cert_record(cert_record);
+
+	cache_lru.push_front(e);
+	cache[sha1] = cache_lru.begin();
+	}
+
+void file_analysis::X509::GetCacheStats(CacheStats* stats)
+	{
+	*stats = cache_stats;
+	stats->size = cache.size();
+	}
+
+void file_analysis::X509::ClearCache()
+	{
+	for ( CacheList::iterator i = cache_lru.begin(); i != cache_lru.end(); ++i )
+		{
+		Unref(i->cert_val);
+		Unref(i->cert_record);
+		}
+
+	cache_lru.clear();
+	cache.clear();
+
+	for ( VerifyCacheList::iterator i = verify_cache_lru.begin();
+	      i != verify_cache_lru.end(); ++i )
+		Unref(i->result);
+
+	verify_cache_lru.clear();
+	verify_cache.clear();
+	}
+
+RecordVal* file_analysis::X509::LookupVerifyCache(const std::string& key)
+	{
+	VerifyCacheMap::iterator i = verify_cache.find(key);
+
+	if ( i == verify_cache.end() )
+		{
+		++verify_cache_stats.misses;
+		return 0;
+		}
+
+	if ( BifConst::X509::verify_cache_ttl > 0 &&
+	     network_time - i->second->added > BifConst::X509::verify_cache_ttl )
+		{
+		Unref(i->second->result);
+		verify_cache_lru.erase(i->second);
+		verify_cache.erase(i);
+		++verify_cache_stats.expirations;
+		++verify_cache_stats.misses;
+		return 0;
+		}
+
+	++verify_cache_stats.hits;
+	verify_cache_lru.splice(verify_cache_lru.begin(), verify_cache_lru, i->second);
+
+	return copy_result_record(i->second->result);
+	}
+
+void file_analysis::X509::AddToVerifyCache(const std::string& key, RecordVal* result)
+	{
+	while ( verify_cache.size() >= BifConst::X509::verify_cache_size )
+		{
+		VerifyCacheEntry& e = verify_cache_lru.back();
+		verify_cache.erase(e.key);
+		Unref(e.result);
+		verify_cache_lru.pop_back();
+		++verify_cache_stats.evictions;
+		}
+
+	VerifyCacheEntry e;
+	e.key = key;
+	e.result = copy_result_record(result);
+	e.added = network_time;
+
+	verify_cache_lru.push_front(e);
+	verify_cache[key] = verify_cache_lru.begin();
+	}
+
+void file_analysis::X509::GetVerifyCacheStats(VerifyCacheStats* stats)
+	{
+	*stats = verify_cache_stats;
+	stats->size = verify_cache.size();
+	}
+
 RecordVal* file_analysis::X509::ParseCertificate(X509Val* cert_val, const char* fid)
 	{
 	::X509* ssl_cert = cert_val->GetCertificate();
@@ -96,7 +302,7 @@ RecordVal* file_analysis::X509::ParseCertificate(X509Val* cert_val, const char*
 	RecordVal* pX509Cert = new RecordVal(BifType::Record::X509::Certificate);
 	BIO *bio = BIO_new(BIO_s_mem());
 
-	pX509Cert->Assign(0, new Val((uint64) X509_get_version(ssl_cert) + 1, TYPE_COUNT));
+	pX509Cert->Assign(0, val_mgr->GetCount((uint64) X509_get_version(ssl_cert) + 1));
 	i2a_ASN1_INTEGER(bio, X509_get_serialNumber(ssl_cert));
 	int len = BIO_read(bio, buf, sizeof(buf));
 	pX509Cert->Assign(1, new StringVal(len, buf));
@@ -196,7 +402,7 @@ RecordVal* file_analysis::X509::ParseCertificate(X509Val* cert_val, const char*
 
 		unsigned int length = KeyLength(pkey);
 		if ( length > 0 )
-			pX509Cert->Assign(10, new Val(length, TYPE_COUNT));
+			pX509Cert->Assign(10, val_mgr->GetCount(length));
 
 		EVP_PKEY_free(pkey);
 		}
@@ -223,7 +429,7 @@ StringVal* file_analysis::X509::GetExtensionFromBIO(BIO* bio)
 	if ( length == 0 )
 		{
 		BIO_free_all(bio);
-		return new StringVal("");
+		return val_mgr->GetEmptyString();
 		}
 
 	char* buffer = (char*) malloc(length);
@@ -277,7 +483,7 @@ void file_analysis::X509::ParseExtension(X509_EXTENSION* ex)
 		pX509Ext->Assign(1, new StringVal(short_name));
 
 	pX509Ext->Assign(2, new StringVal(oid));
-	pX509Ext->Assign(3, new Val(critical, TYPE_BOOL));
+	pX509Ext->Assign(3, val_mgr->GetBool(critical));
 	pX509Ext->Assign(4, ext_val);
 
 	// send off generic extension event
@@ -309,10 +515,10 @@ void file_analysis::X509::ParseBasicConstraints(X509_EXTENSION* ex)
 	if ( constr )
 		{
 		RecordVal* pBasicConstraint = new RecordVal(BifType::Record::X509::BasicConstraints);
-		pBasicConstraint->Assign(0, new Val(constr->ca ? 1 : 0, TYPE_BOOL));
+		pBasicConstraint->Assign(0, val_mgr->GetBool(constr->ca ? 1 : 0));
 
 		if ( constr->pathlen )
-			pBasicConstraint->Assign(1, new Val((int32_t) ASN1_INTEGER_get(constr->pathlen), TYPE_COUNT));
+			pBasicConstraint->Assign(1, val_mgr->GetCount((int32_t) ASN1_INTEGER_get(constr->pathlen)));
 
 		val_list* vl = new val_list();
 		vl->append(GetFile()->GetVal()->Ref());
@@ -428,7 +634,7 @@ void file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
 		if ( ips != 0 )
 			sanExt->Assign(3, ips);
 
-		sanExt->Assign(4, new Val(otherfields, TYPE_BOOL));
+		sanExt->Assign(4, val_mgr->GetBool(otherfields));
 
 		val_list* vl = new val_list();
 		vl->append(GetFile()->GetVal()->Ref());
@@ -3,6 +3,8 @@
 #ifndef FILE_ANALYSIS_X509_H
 #define FILE_ANALYSIS_X509_H
 
+#include <list>
+#include <map>
 #include <string>
 
 #include "Val.h"
@@ -51,6 +53,63 @@ public:
 	 */
 	static StringVal* GetExtensionFromBIO(BIO* bio);
 
+	/**
+	 * Statistics about the cache of parsed certificates.
+	 */
+	struct CacheStats {
+		uint64 size;	// current number of cached certificates
+		uint64 hits;
+		uint64 misses;
+		uint64 evictions;
+	};
+
+	/**
+	 * Returns the statistics of the certificate cache.
+	 */
+	static void GetCacheStats(CacheStats* stats);
+
+	/**
+	 * Empties the certificate cache and the verification cache.
+	 */
+	static void ClearCache();
+
+	/**
+	 * Statistics about the cache of chain verification results.
+	 */
+	struct VerifyCacheStats {
+		uint64 size;	// current number of cached results
+		uint64 hits;
+		uint64 misses;
+		uint64 evictions;
+		uint64 expirations;	// results dropped because of their age
+	};
+
+	/**
+	 * Looks up the result of verifying a chain.
+	 *
+	 * @param key Identifies the chain, the root store, and the
+	 * verification time, as built by x509_verify().
+	 *
+	 * @return A copy of the \c X509::Result record that the caller takes
+	 * ownership of, or null if there's none cached, or it's older than
+	 * X509::verify_cache_ttl.
+	 */
+	static RecordVal* LookupVerifyCache(const std::string& key);
+
+	/**
+	 * Caches the result of verifying a chain, evicting the least
+	 * recently used one if the cache is full.
+	 *
+	 * @param result The \c X509::Result record. The cache keeps its own
+	 * copy.
+	 */
+	static void AddToVerifyCache(const std::string& key, RecordVal* result);
+
+	/**
+	 * Returns the statistics of the verification cache.
+	 */
+	static void GetVerifyCacheStats(VerifyCacheStats* stats);
+
 protected:
 	X509(RecordVal* args, File* file);
 
@@ -61,6 +120,42 @@ private:
 
 	std::string cert_data;
 
+	// Certificates seen recently, indexed by the SHA1 of their DER
+	// encoding, so that repeated ones don't need parsing again.
+	// Entries are kept most recently used first.
+	struct CacheEntry {
+		std::string sha1;
+		X509Val* cert_val;
+		RecordVal* cert_record;
+	};
+
+	typedef std::list<CacheEntry> CacheList;
+	typedef std::map<std::string, CacheList::iterator> CacheMap;
+
+	static CacheList cache_lru;
+	static CacheMap cache;
+	static CacheStats cache_stats;
+
+	static bool LookupCache(const std::string& sha1, X509Val** cert_val,
+				RecordVal** cert_record);
+	static void AddToCache(const std::string& sha1, X509Val* cert_val,
+			       RecordVal* cert_record);
+
+	// Results of x509_verify(), kept like the certificates, along with
+	// the network time when they were added.
+	struct VerifyCacheEntry {
+		std::string key;
+		RecordVal* result;
+		double added;
+	};
+
+	typedef std::list<VerifyCacheEntry> VerifyCacheList;
+	typedef std::map<std::string, VerifyCacheList::iterator> VerifyCacheMap;
+
+	static VerifyCacheList verify_cache_lru;
+	static VerifyCacheMap verify_cache;
+	static VerifyCacheStats verify_cache_stats;
+
 	// Helpers for ParseCertificate.
 	static double GetTimeFromAsn1(const ASN1_TIME * atime, const char* fid);
 	static StringVal* KeyCurve(EVP_PKEY *key);
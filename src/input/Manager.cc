@@ -12,6 +12,8 @@
 #include "NetVar.h"
 #include "Net.h"
 #include "CompHash.h"
+#include "Metrics.h"
+#include "RemoteSerializer.h"
 
 #include "../file_analysis/Manager.h"
 #include "../threading/SerialTypes.h"
@@ -104,8 +106,11 @@ public:
 	unsigned int num_idx_fields;
 	unsigned int num_val_fields;
 	bool want_record;
+	bool bulk;
+	bool distribute;	// sends changes to the cluster's workers
 
 	TableVal* tab;
+	TableVal* pending;	// bulk loading into this
 	RecordType* rtype;
 	RecordType* itype;
 
@@ -142,7 +147,9 @@ public:
 
 Manager::TableStream::TableStream()
 	: Manager::Stream::Stream(TABLE_STREAM),
-	  num_idx_fields(), num_val_fields(), want_record(), tab(), rtype(),
+	  num_idx_fields(), num_val_fields(), want_record(), bulk(),
+	  distribute(), tab(),
+	  pending(), rtype(),
 	  itype(), currDict(), lastDict(), pred(), event()
 	{
 	}
@@ -164,6 +171,8 @@ Manager::TableStream::~TableStream()
         if ( tab )
 	        Unref(tab);
 
+	Unref(pending);
+
         if ( itype )
 	        Unref(itype);
 
@@ -196,6 +205,9 @@ Manager::Manager()
 	: plugin::ComponentManager<input::Tag, input::Component>("Input", "Reader")
 	{
 	end_of_data = internal_handler("Input::end_of_data");
+	distributed_entry = internal_handler("Input::distributed_entry");
+	distributed_removal = internal_handler("Input::distributed_removal");
+	distributed_table = internal_handler("Input::distributed_table");
 	}
 
 Manager::~Manager()
@@ -570,6 +582,22 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	Func* event = event_val ? event_val->AsFunc() : 0;
 	Unref(event_val);
 
+	Val* bulk_val = fval->Lookup("bulk", true);
+	bool bulk = bulk_val->AsBool();
+	Unref(bulk_val);
+
+	Val* distribute_val = fval->Lookup("distribute", true);
+	bool distribute = distribute_val->AsBool();
+	Unref(distribute_val);
+
+	if ( bulk && (pred || event) )
+		{
+		reporter->Error("Input stream %s: Bulk loading doesn't support predicates or events", stream_name.c_str());
+		Unref(pred);
+		Unref(want_record);
+		return false;
+		}
+
 	if ( event )
 		{
 		FuncType* etype = event->FType()->AsFuncType();
@@ -696,6 +724,8 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	stream->lastDict = new PDict(InputHash);
 	stream->lastDict->SetDeleteFunc(input_hash_delete_func);
 	stream->want_record = ( want_record->InternalInt() == 1 );
+	stream->bulk = bulk;
+	stream->distribute = distribute;
 
 	Unref(want_record); // ref'd by lookupwithdefault
 	Unref(pred);
@@ -1066,8 +1096,14 @@ Val* Manager::ValueToIndexVal(const Stream* i, int num_fields, const RecordType
 	}
 
 
+static metrics::Counter* entries_received_metric =
+	metrics::registry()->NewCounter("input.entries_received",
+					"Entries from readers that the main thread processed.");
+
 void Manager::SendEntry(ReaderFrontend* reader, Value* *vals)
 	{
+	entries_received_metric->Inc();
+
 	Stream *i = FindStream(reader);
 	if ( i == 0 )
 		{
@@ -1078,7 +1114,10 @@ void Manager::SendEntry(ReaderFrontend* reader, Value* *vals)
 
 	int readFields = 0;
 
-	if ( i->stream_type == TABLE_STREAM )
+	if ( i->stream_type == TABLE_STREAM && ((TableStream*) i)->bulk )
+		readFields = SendEntryBulk((TableStream*) i, vals);
+
+	else if ( i->stream_type == TABLE_STREAM )
 		readFields = SendEntryTable(i, vals);
 
 	else if ( i->stream_type == EVENT_STREAM )
@@ -1102,6 +1141,39 @@ void Manager::SendEntry(ReaderFrontend* reader, Value* *vals)
 	delete_value_ptr_array(vals, readFields);
 	}
 
+int Manager::SendEntryBulk(TableStream* stream, const Value* const *vals)
+	{
+	bool convert_error = false;
+
+	Val* idxval = ValueToIndexVal(stream, stream->num_idx_fields, stream->itype, vals, convert_error);
+	Val* valval;
+
+	int position = stream->num_idx_fields;
+
+	if ( stream->num_val_fields == 0 )
+		valval = 0;
+
+	else if ( stream->num_val_fields == 1 && ! stream->want_record )
+		valval = ValueToVal(stream, vals[position], stream->rtype->FieldType(0), convert_error);
+
+	else
+		valval = ValueToRecordVal(stream, vals, stream->rtype, &position, convert_error);
+
+	if ( ! convert_error )
+		{
+		if ( ! stream->pending )
+			stream->pending = new TableVal(stream->tab->Type()->AsTableType());
+
+		stream->pending->Assign(idxval, valval);
+		}
+	else
+		Unref(valval);
+
+	Unref(idxval);
+
+	return stream->num_idx_fields + stream->num_val_fields;
+	}
+
 int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	{
 	bool updated = false;
@@ -1269,6 +1341,10 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 		Ref(oldval); // otherwise it is no longer accessible after the assignment
 
 	stream->tab->Assign(idxval, k, valval);
+
+	if ( stream->distribute )
+		DistributeEntry(stream, idxval, valval);
+
 	Unref(idxval); // asssign does not consume idxval.
 
 	if ( predidx != 0 )
@@ -1312,6 +1388,75 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	return stream->num_val_fields + stream->num_idx_fields;
 	}
 
+bool Manager::ExpireEntry(TableStream* stream, HashKey* key, InputHash* ih)
+	{
+	ListVal * idx = 0;
+	Val *val = 0;
+
+	Val* predidx = 0;
+	EnumVal* ev = 0;
+	int startpos = 0;
+
+	if ( stream->pred || stream->event )
+		{
+		idx = stream->tab->RecoverIndex(ih->idxkey);
+		assert(idx != 0);
+		val = stream->tab->Lookup(idx);
+		assert(val != 0);
+		predidx = ListValToRecordVal(idx, stream->itype, &startpos);
+		Unref(idx);
+		ev = new EnumVal(BifEnum::Input::EVENT_REMOVED, BifType::Enum::Input::Event);
+		}
+
+	if ( stream->pred )
+		{
+		// ask predicate, if we want to expire this element...
+
+		Ref(ev);
+		Ref(predidx);
+		Ref(val);
+
+		bool result = CallPred(stream->pred, 3, ev, predidx, val);
+
+		if ( result == false )
+			{
+			// Keep it. That means adding the entry to currDict, it's
+			// current again.
+			Unref(predidx);
+			Unref(ev);
+			stream->currDict->Insert(key, stream->lastDict->RemoveEntry(key));
+			return false;
+			}
+		}
+
+	if ( stream->event )
+		{
+		Ref(predidx);
+		Ref(val);
+		Ref(ev);
+		SendEvent(stream->event, 4, stream->description->Ref(), ev, predidx, val);
+		}
+
+	if ( predidx )  // if we have a stream or an event...
+		Unref(predidx);
+
+	if ( ev )
+		Unref(ev);
+
+	if ( stream->distribute )
+		{
+		ListVal* removed = stream->tab->RecoverIndex(ih->idxkey);
+		DistributeRemoval(stream, removed);
+		Unref(removed);
+		}
+
+	Unref(stream->tab->Delete(ih->idxkey));
+	stream->lastDict->Remove(key); // delete in next line
+	delete(ih);
+
+	return true;
+	}
+
 void Manager::EndCurrentSend(ReaderFrontend* reader)
 	{
 	Stream *i = FindStream(reader);
@@ -1340,6 +1485,24 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( stream->bulk )
+		{
+		// Everything that's been read replaces the table's contents
+		// in one go, and the old ones get freed.
+		if ( ! stream->pending )
+			stream->pending = new TableVal(stream->tab->Type()->AsTableType());
+
+		stream->tab->SwapContents(stream->pending);
+		Unref(stream->pending);
+		stream->pending = 0;
+
+		if ( stream->distribute )
+			DistributeTable(stream);
+
+		SendEndOfData(i);
+		return;
+		}
+
 	// lastdict contains all deleted entries and should be empty apart from that
 	IterCookie *c = stream->lastDict->InitForIteration();
 	stream->lastDict->MakeRobustCookie(c);
@@ -1348,78 +1511,156 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 
 	while ( ( ih = stream->lastDict->NextEntry(lastDictIdxKey, c) ) )
 		{
-		ListVal * idx = 0;
-		Val *val = 0;
+		ExpireEntry(stream, lastDictIdxKey, ih);
+		delete lastDictIdxKey;
+		}
 
-		Val* predidx = 0;
-		EnumVal* ev = 0;
-		int startpos = 0;
+	stream->lastDict->Clear(); // should be empt. buti- well... who knows...
+	delete(stream->lastDict);
 
-		if ( stream->pred || stream->event )
-			{
-			idx = stream->tab->RecoverIndex(ih->idxkey);
-			assert(idx != 0);
-			val = stream->tab->Lookup(idx);
-			assert(val != 0);
-			predidx = ListValToRecordVal(idx, stream->itype, &startpos);
-			Unref(idx);
-			ev = new EnumVal(BifEnum::Input::EVENT_REMOVED, BifType::Enum::Input::Event);
-			}
+	stream->lastDict = stream->currDict;
+	stream->currDict = new PDict(InputHash);
+	stream->currDict->SetDeleteFunc(input_hash_delete_func);
 
-		if ( stream->pred )
-			{
-			// ask predicate, if we want to expire this element...
+#ifdef DEBUG
+	DBG_LOG(DBG_INPUT, "EndCurrentSend complete for stream %s",
+		i->name.c_str());
+#endif
 
-			Ref(ev);
-			Ref(predidx);
-			Ref(val);
+	SendEndOfData(i);
+	}
 
-			bool result = CallPred(stream->pred, 3, ev, predidx, val);
+void Manager::SendRemovedEntry(ReaderFrontend* reader, Value* *vals)
+	{
+	Stream *i = FindStream(reader);
 
-			if ( result == false )
+	if ( i == 0 )
+		{
+		reporter->InternalWarning("Unknown reader %s in SendRemovedEntry",
+		                          reader->Name());
+		return;
+		}
+
+	int readFields = 0;
+
+	if ( i->stream_type == TABLE_STREAM )
+		{
+		TableStream* stream = (TableStream*) i;
+		readFields = stream->num_idx_fields + stream->num_val_fields;
+
+		HashKey* idxhash = stream->bulk ? 0 : HashValues(stream->num_idx_fields, vals);
+
+		if ( stream->bulk )
+			{
+			// Changed entries are still pending, so this doesn't
+			// affect them.
+			bool convert_error = false;
+			Val* idxval = ValueToIndexVal(stream, stream->num_idx_fields, stream->itype, vals, convert_error);
+
+			if ( ! convert_error )
 				{
-				// Keep it. Hence - we quit and simply go to the next entry of lastDict
-				// ah well - and we have to add the entry to currDict...
-				Unref(predidx);
-				Unref(ev);
-				stream->currDict->Insert(lastDictIdxKey, stream->lastDict->RemoveEntry(lastDictIdxKey));
-				delete lastDictIdxKey;
-				continue;
+				Val* old = stream->tab->Delete(idxval);
+
+				if ( old && stream->distribute )
+					DistributeRemoval(stream, idxval);
+
+				Unref(old);
 				}
+
+			Unref(idxval);
 			}
 
-		if ( stream->event )
+		else if ( idxhash )
 			{
-			Ref(predidx);
-			Ref(val);
-			Ref(ev);
-			SendEvent(stream->event, 4, stream->description->Ref(), ev, predidx, val);
+			// If the index got sent again in this round, the entry
+			// changed and is in currDict now; nothing to remove then.
+			InputHash* ih = stream->lastDict->Lookup(idxhash);
+
+			if ( ih )
+				ExpireEntry(stream, idxhash, ih);
+
+			delete idxhash;
 			}
+		}
 
-		if ( predidx )  // if we have a stream or an event...
-			Unref(predidx);
+	else if ( i->stream_type == EVENT_STREAM )
+		// Event streams only see entries that are new.
+		readFields = ((EventStream*) i)->num_fields;
 
-		if ( ev )
-			Unref(ev);
+	else
+		readFields = 1;
 
-		Unref(stream->tab->Delete(ih->idxkey));
-		stream->lastDict->Remove(lastDictIdxKey); // delete in next line
-		delete lastDictIdxKey;
-		delete(ih);
-		}
+	delete_value_ptr_array(vals, readFields);
+	}
 
-	stream->lastDict->Clear(); // should be empt. buti- well... who knows...
-	delete(stream->lastDict);
+void Manager::EndIncrementalSend(ReaderFrontend* reader)
+	{
+	Stream *i = FindStream(reader);
 
-	stream->lastDict = stream->currDict;
-	stream->currDict = new PDict(InputHash);
-	stream->currDict->SetDeleteFunc(input_hash_delete_func);
+	if ( i == 0 )
+		{
+		reporter->InternalWarning("Unknown reader %s in EndIncrementalSend",
+		                          reader->Name());
+		return;
+		}
 
 #ifdef DEBUG
-	DBG_LOG(DBG_INPUT, "EndCurrentSend complete for stream %s",
-		i->name.c_str());
+	DBG_LOG(DBG_INPUT, "Got EndIncrementalSend stream %s", i->name.c_str());
 #endif
 
+	if ( i->stream_type == TABLE_STREAM && ((TableStream*) i)->bulk )
+		{
+		TableStream* stream = (TableStream*) i;
+
+		// The pending entries are just the changes here, so they
+		// get added to the table rather than replacing it.
+		if ( stream->pending )
+			{
+			const PDict(TableEntryVal)* changes = stream->pending->AsTable();
+			IterCookie* c = changes->InitForIteration();
+			HashKey* key;
+			TableEntryVal* v;
+
+			while ( (v = changes->NextEntry(key, c)) )
+				{
+				Val* val = v->Value();
+
+				if ( val )
+					Ref(val);
+
+				stream->tab->Assign(0, key, val);
+
+				if ( stream->distribute )
+					{
+					ListVal* idx = stream->tab->RecoverIndex(key);
+					DistributeEntry(stream, idx, val);
+					Unref(idx);
+					}
+				}
+
+			Unref(stream->pending);
+			stream->pending = 0;
+			}
+		}
+
+	else if ( i->stream_type == TABLE_STREAM )
+		{
+		TableStream* stream = (TableStream*) i;
+
+		// Unlike with EndCurrentSend, entries left in lastDict are
+		// still current, as the reader only sent what changed. So
+		// the ones sent this round join them.
+		IterCookie *c = stream->currDict->InitForIteration();
+		stream->currDict->MakeRobustCookie(c);
+		HashKey* key;
+
+		while ( stream->currDict->NextEntry(key, c) )
+			{
+			stream->lastDict->Insert(key, stream->currDict->RemoveEntry(key));
+			delete key;
+			}
+		}
+
 	SendEndOfData(i);
 	}
 
@@ -1451,8 +1692,74 @@ void Manager::SendEndOfData(const Stream *i)
 		file_mgr->EndOfFile(static_cast<const AnalysisStream*>(i)->file_id);
 	}
 
+void Manager::DistributeEntry(const TableStream* stream, Val* idx, Val* val)
+	{
+	if ( ! distributed_entry )
+		return;
+
+	// Sets have no values, but events need one.
+	if ( val )
+		Ref(val);
+	else
+		val = val_mgr->GetTrue();
+
+	Ref(idx);
+	SendEvent(distributed_entry, 3, new StringVal(stream->name.c_str()), idx, val);
+	}
+
+void Manager::DistributeRemoval(const TableStream* stream, Val* idx)
+	{
+	if ( ! distributed_removal )
+		return;
+
+	Ref(idx);
+	SendEvent(distributed_removal, 2, new StringVal(stream->name.c_str()), idx);
+	}
+
+void Manager::DistributeTable(const TableStream* stream)
+	{
+	if ( ! distributed_table )
+		return;
+
+	Ref(stream->tab);
+	SendEvent(distributed_table, 2, new StringVal(stream->name.c_str()), stream->tab);
+	}
+
+bool Manager::SendDistributedTables(SourceID peer)
+	{
+	bool success = true;
+
+	for ( map<ReaderFrontend*, Stream*>::iterator s = readers.begin(); s != readers.end(); ++s )
+		{
+		if ( s->second->stream_type != TABLE_STREAM || s->second->removed )
+			continue;
+
+		TableStream* stream = (TableStream*) s->second;
+
+		if ( ! stream->distribute )
+			continue;
+
+		// Only to this peer, unlike the changes, which go to all
+		// of them.
+		val_list* vl = new val_list(2);
+		vl->append(new StringVal(stream->name.c_str()));
+		vl->append(stream->tab->Ref());
+
+		SerialInfo info(remote_serializer);
+
+		if ( ! remote_serializer->SendCall(&info, peer, "Input::distributed_table", vl) )
+			success = false;
+
+		delete_vals(vl);
+		}
+
+	return success;
+	}
+
 void Manager::Put(ReaderFrontend* reader, Value* *vals)
 	{
+	entries_received_metric->Inc();
+
 	Stream *i = FindStream(reader);
 	if ( i == 0 )
 		{
@@ -1680,6 +1987,9 @@ int Manager::PutTable(Stream* i, const Value* const *vals)
 	else // no predicates or other stuff
 		stream->tab->Assign(idxval, valval);
 
+	if ( stream->distribute )
+		DistributeEntry(stream, idxval, valval);
+
 	Unref(idxval); // not consumed by assign
 
 	return stream->num_idx_fields + stream->num_val_fields;
@@ -1705,6 +2015,9 @@ void Manager::Clear(ReaderFrontend* reader)
 	TableStream* stream = (TableStream*) i;
 
 	stream->tab->RemoveAll();
+
+	if ( stream->distribute )
+		DistributeTable(stream);
 	}
 
 // put interface: delete old entry from table.
@@ -1782,7 +2095,12 @@ bool Manager::Delete(ReaderFrontend* reader, Value* *vals)
 			if ( ! success )
 				Warning(i, "Internal error while deleting values from input table");
 			else
+				{
 				Unref(retptr);
+
+				if ( stream->distribute )
+					DistributeRemoval(stream, idxval);
+				}
 			}
 
 		}
@@ -2287,7 +2605,7 @@ Val* Manager::ValueToVal(const Stream* i, const Value* val, BroType* request_typ
 		}
 
 	case TYPE_PORT:
-		return new PortVal(val->val.port_val.port, val->val.port_val.proto);
+		return val_mgr->GetPort(val->val.port_val.port, val->val.port_val.proto);
 
 	case TYPE_ADDR:
 		{
@@ -14,6 +14,8 @@
 
 #include <map>
 
+struct InputHash;
+
 namespace input {
 
 class ReaderFrontend;
@@ -93,6 +95,19 @@ public:
 	 */
 	bool RemoveStream(const string &id);
 
+	/**
+	 * Sends the current contents of all table streams that distribute
+	 * their table to a peer, as Input::distributed_table events. After
+	 * that, the peer gets their changes only.
+	 *
+	 * @param peer The peer, which needs to have completed the
+	 * handshake.
+	 *
+	 * This method corresponds directly to the internal BiF defined in
+	 * input.bif, which just forwards here.
+	 */
+	bool SendDistributedTables(SourceID peer);
+
 	/**
 	 * Signals the manager to shutdown at Bro's termination.
 	 */
@@ -105,7 +120,10 @@ protected:
 	friend class ClearMessage;
 	friend class SendEventMessage;
 	friend class SendEntryMessage;
+	friend class SendEntriesMessage;
 	friend class EndCurrentSendMessage;
+	friend class SendRemovedEntryMessage;
+	friend class EndIncrementalSendMessage;
 	friend class ReaderClosedMessage;
 	friend class DisableMessage;
 	friend class EndOfDataMessage;
@@ -127,6 +145,14 @@ protected:
 	void SendEntry(ReaderFrontend* reader, threading::Value* *vals);
 	void EndCurrentSend(ReaderFrontend* reader);
 
+	// For readers that track changes to their input themselves. After
+	// sending new and changed entries with SendEntry, they send the
+	// entries that went away with SendRemovedEntry, and finish with
+	// EndIncrementalSend; entries neither sent nor removed stay as they
+	// are. SendRemovedEntry takes ownership of threading::Value fields.
+	void SendRemovedEntry(ReaderFrontend* reader, threading::Value* *vals);
+	void EndIncrementalSend(ReaderFrontend* reader);
+
 	// Allows readers to directly send Bro events. The num_vals and vals
 	// must be the same the named event expects. Takes ownership of
 	// threading::Value fields.
@@ -178,9 +204,17 @@ private:
 	// type.
 	bool CheckErrorEventTypes(std::string stream_name, Func* error_event, bool table);
 
+	// SendEntry implementation for Table stream loading in bulk.
+	int SendEntryBulk(TableStream* stream, const threading::Value* const *vals);
+
 	// SendEntry implementation for Table stream.
 	int SendEntryTable(Stream* i, const threading::Value* const *vals);
 
+	// Removes an entry of lastDict from a table stream, sending the
+	// removal event. Returns false if the predicate decided to keep the
+	// entry instead; it's moved to currDict then.
+	bool ExpireEntry(TableStream* stream, HashKey* key, InputHash* ih);
+
 	// Put implementation for Table stream.
 	int PutTable(Stream* i, const threading::Value* const *vals);
 
@@ -203,6 +237,13 @@ private:
 	// Implementation of SendEndOfData (send end_of_data event).
 	void SendEndOfData(const Stream *i);
 
+	// For table streams that distribute their table, these raise the
+	// events telling workers about a changed entry, a removed one, or
+	// contents that got replaced as a whole.
+	void DistributeEntry(const TableStream* stream, Val* idx, Val* val);
+	void DistributeRemoval(const TableStream* stream, Val* idx);
+	void DistributeTable(const TableStream* stream);
+
 	// Call predicate function and return result.
 	bool CallPred(Func* pred_func, const int numvals, ...);
 
@@ -250,6 +291,9 @@ private:
 	map<ReaderFrontend*, Stream*> readers;
 
 	EventHandlerPtr end_of_data;
+	EventHandlerPtr distributed_entry;
+	EventHandlerPtr distributed_removal;
+	EventHandlerPtr distributed_table;
 };
 
 
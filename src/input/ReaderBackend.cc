@@ -3,6 +3,8 @@
 #include "ReaderBackend.h"
 #include "ReaderFrontend.h"
 #include "Manager.h"
+#include "Metrics.h"
+#include "NetVar.h"
 
 using threading::Value;
 using threading::Field;
@@ -114,6 +116,26 @@ private:
 	Value* *val;
 };
 
+class SendEntriesMessage : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendEntriesMessage(ReaderFrontend* reader, int num_entries, Value** *vals)
+		: threading::OutputMessage<ReaderFrontend>("SendEntries", reader),
+		num_entries(num_entries), vals(vals) { }
+
+	virtual bool Process()
+		{
+		for ( int i = 0; i < num_entries; i++ )
+			input_mgr->SendEntry(Object(), vals[i]);
+
+		delete [] vals;
+		return true;
+		}
+
+private:
+	int num_entries;
+	Value** *vals;
+};
+
 class EndCurrentSendMessage : public threading::OutputMessage<ReaderFrontend> {
 public:
 	EndCurrentSendMessage(ReaderFrontend* reader)
@@ -128,6 +150,36 @@ public:
 private:
 };
 
+class SendRemovedEntryMessage : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendRemovedEntryMessage(ReaderFrontend* reader, Value* *val)
+		: threading::OutputMessage<ReaderFrontend>("SendRemovedEntry", reader),
+		val(val) { }
+
+	virtual bool Process()
+		{
+		input_mgr->SendRemovedEntry(Object(), val);
+		return true;
+		}
+
+private:
+	Value* *val;
+};
+
+class EndIncrementalSendMessage : public threading::OutputMessage<ReaderFrontend> {
+public:
+	EndIncrementalSendMessage(ReaderFrontend* reader)
+		: threading::OutputMessage<ReaderFrontend>("EndIncrementalSend", reader) {}
+
+	virtual bool Process()
+		{
+		input_mgr->EndIncrementalSend(Object());
+		return true;
+		}
+
+private:
+};
+
 class EndOfDataMessage : public threading::OutputMessage<ReaderFrontend> {
 public:
 	EndOfDataMessage(ReaderFrontend* reader)
@@ -214,8 +266,20 @@ ReaderBackend::~ReaderBackend()
 	delete info;
 	}
 
+const char* ReaderBackend::CPUs() const
+	{
+	return BifConst::Threading::input_reader_cpus->CheckString();
+	}
+
+// Updated by the reader threads; input.entries_received is where the main
+// thread catches up with them.
+static metrics::Counter* entries_sent_metric =
+	metrics::registry()->NewCounter("input.entries_sent",
+					"Entries that readers passed on to the main thread.");
+
 void ReaderBackend::Put(Value* *val)
 	{
+	entries_sent_metric->Inc();
 	SendOut(new PutMessage(frontend, val));
 	}
 
@@ -239,6 +303,16 @@ void ReaderBackend::EndCurrentSend()
 	SendOut(new EndCurrentSendMessage(frontend));
 	}
 
+void ReaderBackend::SendRemovedEntry(Value* *vals)
+	{
+	SendOut(new SendRemovedEntryMessage(frontend, vals));
+	}
+
+void ReaderBackend::EndIncrementalSend()
+	{
+	SendOut(new EndIncrementalSendMessage(frontend));
+	}
+
 void ReaderBackend::EndOfData()
 	{
 	SendOut(new EndOfDataMessage(frontend));
@@ -246,9 +320,16 @@ void ReaderBackend::EndOfData()
 
 void ReaderBackend::SendEntry(Value* *vals)
 	{
+	entries_sent_metric->Inc();
 	SendOut(new SendEntryMessage(frontend, vals));
 	}
 
+void ReaderBackend::SendEntries(int num_entries, Value** *vals)
+	{
+	entries_sent_metric->Inc(num_entries);
+	SendOut(new SendEntriesMessage(frontend, num_entries, vals));
+	}
+
 bool ReaderBackend::Init(const int arg_num_fields,
 		         const threading::Field* const* arg_fields)
 	{
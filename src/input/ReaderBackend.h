@@ -27,7 +27,8 @@ enum ReaderMode {
 	/**
 	 * Automatic rereading mode. The reader should monitor the
 	 * data source for changes continually. When the data source changes,
-	 * either the whole file has to be resent using the SendEntry/EndCurrentSend functions.
+	 * either the whole file has to be resent using the SendEntry/EndCurrentSend functions,
+	 * or just the changes using SendEntry/SendRemovedEntry/EndIncrementalSend.
 	 */
 	MODE_REREAD,
 
@@ -204,6 +205,11 @@ public:
 	void Error(const char* msg) override;
 
 protected:
+	/**
+	 * Returns \c Threading::input_reader_cpus.
+	 */
+	const char* CPUs() const override;
+
 	// Methods that have to be overwritten by the individual readers
 
 	/**
@@ -329,6 +335,17 @@ protected:
 	 */
 	void SendEntry(threading::Value** vals);
 
+	/**
+	 * Like SendEntry(), but sends a whole batch of entries in one go,
+	 * which saves the overhead of passing each on by itself.
+	 *
+	 * @param num_entries The number of entries.
+	 *
+	 * @param vals Array of \a num_entries entries, each as passed to
+	 * SendEntry(). The method takes ownership of the array.
+	 */
+	void SendEntries(int num_entries, threading::Value*** vals);
+
 	/**
 	 * Method telling the manager, that the current list of entries sent
 	 * by SendEntry is finished.
@@ -339,6 +356,28 @@ protected:
 	 */
 	void EndCurrentSend();
 
+	/**
+	 * For readers that track the changes to their data source
+	 * themselves, an alternative to EndCurrentSend(): after sending
+	 * just the new and changed entries with SendEntry(), the reader
+	 * sends the entries that went away with this method, and finishes
+	 * with EndIncrementalSend(). Entries not sent again stay in place.
+	 *
+	 * Removals must come after the entries of the same update, so
+	 * that a changed entry isn't taken as gone.
+	 *
+	 * @param vals The removed entry, as it was passed to SendEntry().
+	 * The method takes ownership of the array.
+	 */
+	void SendRemovedEntry(threading::Value** vals);
+
+	/**
+	 * Method telling the manager that an update sent with SendEntry()
+	 * and SendRemovedEntry() is finished. This doesn't delete
+	 * anything, and triggers the end_of_data event.
+	 */
+	void EndIncrementalSend();
+
 private:
 	// Frontend that instantiated us. This object must not be accessed
 	// from this class, it's running in a different thread!
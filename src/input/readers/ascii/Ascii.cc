@@ -4,6 +4,8 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 
@@ -17,6 +19,9 @@ using namespace threading;
 using threading::Value;
 using threading::Field;
 
+// The number of entries passed back in one go when reading mapped files.
+static const int MAPPED_BATCH_SIZE = 1000;
+
 FieldMapping::FieldMapping(const string& arg_name, const TypeTag& arg_type, int arg_position)
 	: name(arg_name), type(arg_type), subtype(TYPE_ERROR)
 	{
@@ -49,6 +54,11 @@ FieldMapping FieldMapping::subType()
 Ascii::Ascii(ReaderFrontend *frontend) : ReaderBackend(frontend)
 	{
 	mtime = 0;
+	use_mmap = false;
+	incremental = false;
+	round = 0;
+	seen_valid = false;
+	incremental_send = false;
 	}
 
 Ascii::~Ascii()
@@ -73,6 +83,9 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	unset_field.assign( (const char*) BifConst::InputAscii::unset_field->Bytes(),
 	                   BifConst::InputAscii::unset_field->Len());
 
+	use_mmap = BifConst::InputAscii::use_mmap;
+	incremental = BifConst::InputAscii::incremental;
+
 	// Set per-filter configuration options.
 	for ( ReaderInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end(); i++ )
 		{
@@ -87,6 +100,12 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 		else if ( strcmp(i->first, "unset_field") == 0 )
 			unset_field.assign(i->second);
+
+		else if ( strcmp(i->first, "use_mmap") == 0 )
+			use_mmap = (strcmp(i->second, "T") == 0);
+
+		else if ( strcmp(i->first, "incremental") == 0 )
+			incremental = (strcmp(i->second, "T") == 0);
 		}
 
 	if ( separator.size() != 1 )
@@ -98,6 +117,26 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	formatter::Ascii::SeparatorInfo sep_info(separator, set_separator, unset_field, empty_field);
 	formatter = unique_ptr<threading::formatter::Formatter>(new formatter::Ascii(this, sep_info));
 
+	// Streaming needs to follow the file as it grows, and only ever
+	// sends new lines anyway.
+	if ( info.mode == MODE_STREAM )
+		{
+		use_mmap = false;
+		incremental = false;
+		}
+
+	if ( use_mmap )
+		{
+		if ( info.mode == MODE_REREAD )
+			{
+			struct stat sb;
+			if ( stat(info.source, &sb) == 0 )
+				mtime = sb.st_mtime;
+			}
+
+		return ReadMapped();
+		}
+
 	file.open(info.source);
 	if ( ! file.is_open() )
 		{
@@ -247,6 +286,9 @@ bool Ascii::DoUpdate()
 		case MODE_MANUAL:
 		case MODE_STREAM:
 			{
+			if ( use_mmap )
+				return ReadMapped();
+
 			// dirty, fix me. (well, apparently after trying seeking, etc
 			// - this is not that bad)
 			if ( file.is_open() )
@@ -287,81 +329,111 @@ bool Ascii::DoUpdate()
 
 	file.sync();
 
+	StartRound();
+
 	while ( GetLine(line) )
 		{
-		// split on tabs
-		bool error = false;
-		istringstream splitstream(line);
+		bool fatal = false;
+		Value** fields = NextEntry(line.data(), line.size(), &fatal);
 
-		map<int, string> stringfields;
-		int pos = 0;
-		while ( splitstream )
-			{
-			string s;
-			if ( ! getline(splitstream, s, separator[0]) )
-				break;
+		if ( fatal )
+			return false;
 
-			stringfields[pos] = s;
-			pos++;
-			}
+		if ( ! fields )
+			continue;
+
+		if ( Info().mode  == MODE_STREAM )
+			Put(fields);
+		else
+			SendEntry(fields);
+		}
 
-		pos--; // for easy comparisons of max element.
+	if ( Info().mode != MODE_STREAM )
+		EndRound();
 
-		Value** fields = new Value*[NumFields()];
+	return true;
+	}
 
-		int fpos = 0;
-		for ( vector<FieldMapping>::iterator fit = columnMap.begin();
-			fit != columnMap.end();
-			fit++ )
-			{
+Value** Ascii::NextEntry(const char* line, size_t len, bool* fatal)
+	{
+	if ( Unchanged(line, len) )
+		return 0;
 
-			if ( ! fit->present )
-				{
-				// add non-present field
-				fields[fpos] =  new Value((*fit).type, false);
-				fpos++;
-				continue;
-				}
+	Value** fields = ParseLine(line, len, fatal);
 
-			assert(fit->position >= 0 );
+	if ( ! fields )
+		ForgetLine();
 
-			if ( (*fit).position > pos || (*fit).secondary_position > pos )
-				{
-				Error(Fmt("Not enough fields in line %s. Found %d fields, want positions %d and %d",
-					  line.c_str(), pos,  (*fit).position, (*fit).secondary_position));
+	return fields;
+	}
 
-				for ( int i = 0; i < fpos; i++ )
-					delete fields[i];
+int Ascii::SplitLine(const char* line, size_t len, vector<string>* fields)
+	{
+	// Same splitting as with getline(), i.e., a trailing separator
+	// doesn't start another field.
+	const char* end = line + len;
+	const char* p = line;
+	int n = 0;
 
-				delete [] fields;
-				return false;
-				}
+	while ( p < end )
+		{
+		const char* q = (const char*) memchr(p, separator[0], end - p);
 
-			Value* val = formatter->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+		if ( ! q )
+			q = end;
 
-			if ( val == 0 )
-				{
-				Warning(Fmt("Could not convert line '%s' to Val. Ignoring line.", line.c_str()));
-				error = true;
-				break;
-				}
+		if ( n >= int(fields->size()) )
+			fields->push_back(string());
 
-			if ( (*fit).secondary_position != -1 )
-				{
-				// we have a port definition :)
-				assert(val->type == TYPE_PORT );
-				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+		(*fields)[n++].assign(p, q - p);
+		p = q + 1;
+		}
 
-				val->val.port_val.proto = formatter->ParseProto(stringfields[(*fit).secondary_position]);
-				}
+	return n;
+	}
 
-			fields[fpos] = val;
+Value** Ascii::ParseLine(const char* line, size_t len, bool* fatal)
+	{
+	int num_fields = SplitLine(line, len, &line_fields);
+	int pos = num_fields - 1; // for easy comparisons of max element.
+
+	Value** fields = new Value*[NumFields()];
+
+	int fpos = 0;
+	for ( vector<FieldMapping>::iterator fit = columnMap.begin();
+		fit != columnMap.end();
+		fit++ )
+		{
 
+		if ( ! fit->present )
+			{
+			// add non-present field
+			fields[fpos] =  new Value((*fit).type, false);
 			fpos++;
+			continue;
 			}
 
-		if ( error )
+		assert(fit->position >= 0 );
+
+		if ( (*fit).position > pos || (*fit).secondary_position > pos )
 			{
+			Error(Fmt("Not enough fields in line %s. Found %d fields, want positions %d and %d",
+				  string(line, len).c_str(), pos,  (*fit).position, (*fit).secondary_position));
+
+			for ( int i = 0; i < fpos; i++ )
+				delete fields[i];
+
+			delete [] fields;
+			*fatal = true;
+			return 0;
+			}
+
+		Value* val = formatter->ParseValue(line_fields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+
+		if ( val == 0 )
+			{
+			Warning(Fmt("Could not convert line '%s' to Val. Ignoring line.", string(line, len).c_str()));
+
 			// Encountered non-fatal error, ignoring line. But
 			// first, delete all successfully read fields and the
 			// array structure.
@@ -370,22 +442,250 @@ bool Ascii::DoUpdate()
 				delete fields[i];
 
 			delete [] fields;
+			return 0;
+			}
+
+		if ( (*fit).secondary_position != -1 )
+			{
+			// we have a port definition :)
+			assert(val->type == TYPE_PORT );
+			//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+
+			val->val.port_val.proto = formatter->ParseProto(line_fields[(*fit).secondary_position]);
+			}
+
+		fields[fpos] = val;
+
+		fpos++;
+		}
+
+	assert ( fpos == NumFields() );
+
+	return fields;
+	}
+
+bool Ascii::GetMappedLine(const char** pos, const char* end,
+			  const char** line, size_t* len)
+	{
+	while ( *pos < end )
+		{
+		const char* start = *pos;
+		const char* eol = (const char*) memchr(start, '\n', end - start);
+
+		if ( ! eol )
+			eol = end;
+
+		*pos = eol + 1;
+
+		size_t n = eol - start;
+
+		if ( n && start[n - 1] == '\r' ) // deal with \r\n by removing \r
+			--n;
+
+		if ( ! n )
 			continue;
+
+		if ( start[0] != '#' )
+			{
+			*line = start;
+			*len = n;
+			return true;
 			}
 
-		//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
-		assert ( fpos == NumFields() );
+		if ( n > 8 && memcmp(start, "#fields", 7) == 0 && start[7] == separator[0] )
+			{
+			*line = start + 8;
+			*len = n - 8;
+			return true;
+			}
+		}
 
-		if ( Info().mode  == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+	return false;
+	}
+
+bool Ascii::ReadMapped()
+	{
+	int fd = open(Info().source, O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s", Info().source));
+		return false;
 		}
 
-	if ( Info().mode != MODE_STREAM )
+	struct stat sb;
+	if ( fstat(fd, &sb) < 0 )
+		{
+		Error(Fmt("Could not get stat for %s", Info().source));
+		close(fd);
+		return false;
+		}
+
+	size_t size = sb.st_size;
+	const char* data = 0;
+
+	if ( size > 0 )
+		{
+		void* m = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if ( m == MAP_FAILED )
+			{
+			Error(Fmt("cannot map %s: %s", Info().source, Strerror(errno)));
+			close(fd);
+			return false;
+			}
+
+		data = (const char*) m;
+		madvise(m, size, MADV_SEQUENTIAL);
+		}
+
+	close(fd);
+
+	const char* pos = data;
+	const char* end = data + size;
+	const char* line;
+	size_t len;
+
+	if ( ! GetMappedLine(&pos, end, &line, &len) )
+		{
+		Error("could not read first line");
+
+		if ( data )
+			munmap((void*) data, size);
+
+		return false;
+		}
+
+	headerline.assign(line, len);
+
+	if ( ! ReadHeader(true) )
+		{
+		munmap((void*) data, size);
+		return false;
+		}
+
+	Value*** batch = 0;
+	int batch_pos = 0;
+	bool success = true;
+
+	StartRound();
+
+	while ( GetMappedLine(&pos, end, &line, &len) )
+		{
+		bool fatal = false;
+		Value** fields = NextEntry(line, len, &fatal);
+
+		if ( fatal )
+			{
+			success = false;
+			break;
+			}
+
+		if ( ! fields )
+			continue;
+
+		if ( ! batch )
+			batch = new Value**[MAPPED_BATCH_SIZE];
+
+		batch[batch_pos++] = fields;
+
+		if ( batch_pos == MAPPED_BATCH_SIZE )
+			{
+			SendEntries(batch_pos, batch);
+			batch = 0;
+			batch_pos = 0;
+			}
+		}
+
+	munmap((void*) data, size);
+
+	if ( batch )
+		SendEntries(batch_pos, batch);
+
+	if ( success )
+		EndRound();
+
+	return success;
+	}
+
+void Ascii::StartRound()
+	{
+	if ( ! incremental )
+		return;
+
+	// Without a complete earlier round to compare against, or with
+	// different columns, everything gets sent.
+	incremental_send = seen_valid && headerline == seen_headerline;
+
+	if ( ! incremental_send )
+		{
+		seen_lines.clear();
+		seen_headerline = headerline;
+		}
+
+	seen_valid = false;
+	++round;
+	}
+
+bool Ascii::Unchanged(const char* line, size_t len)
+	{
+	if ( ! incremental )
+		return false;
+
+	line_key.assign(line, len);
+	line_map::iterator i = seen_lines.find(line_key);
+
+	if ( i == seen_lines.end() )
+		{
+		seen_lines.insert(std::make_pair(line_key, round));
+		return false;
+		}
+
+	i->second = round;
+	return incremental_send;
+	}
+
+void Ascii::ForgetLine()
+	{
+	// Lines that don't convert don't make it into the table, so they
+	// can't be removed later. Sending them again each round also
+	// repeats the warning, as without incremental mode.
+	if ( incremental )
+		seen_lines.erase(line_key);
+	}
+
+void Ascii::EndRound()
+	{
+	if ( ! incremental_send )
+		{
 		EndCurrentSend();
+		seen_valid = incremental;
+		return;
+		}
 
-	return true;
+	// Whatever wasn't seen this round has been removed from the file.
+	line_map::iterator i = seen_lines.begin();
+
+	while ( i != seen_lines.end() )
+		{
+		if ( i->second == round )
+			{
+			++i;
+			continue;
+			}
+
+		const string& line = i->first;
+		bool fatal = false;
+		Value** fields = ParseLine(line.data(), line.size(), &fatal);
+
+		if ( fields )
+			SendRemovedEntry(fields);
+
+		i = seen_lines.erase(i);
+		}
+
+	EndIncrementalSend();
+	seen_valid = true;
 	}
 
 bool Ascii::DoHeartbeat(double network_time, double current_time)
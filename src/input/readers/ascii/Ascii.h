@@ -7,6 +7,7 @@
 #include <vector>
 #include <fstream>
 #include <memory>
+#include <unordered_map>
 
 #include "input/ReaderBackend.h"
 #include "threading/formatters/Ascii.h"
@@ -56,6 +57,46 @@ private:
 	bool ReadHeader(bool useCached);
 	bool GetLine(string& str);
 
+	// Reads the whole file through a memory mapping, for the modes that
+	// start from the beginning with every update.
+	bool ReadMapped();
+
+	// Returns the next line of a mapped file the way GetLine() does,
+	// advancing *pos past it.
+	bool GetMappedLine(const char** pos, const char* end,
+			   const char** line, size_t* len);
+
+	// Turns the next line of the file into an entry for both the
+	// stream and the mapped reading. Returns null if the line gets
+	// skipped, because it hasn't changed or can't be converted; sets
+	// *fatal if reading can't continue.
+	threading::Value** NextEntry(const char* line, size_t len, bool* fatal);
+
+	// Splits a line into fields, reusing the strings in fields.
+	// Returns the number of fields.
+	int SplitLine(const char* line, size_t len, vector<string>* fields);
+
+	// Splits a line and converts its fields into values. Returns null
+	// if the line has to be ignored; sets *fatal if reading can't
+	// continue.
+	threading::Value** ParseLine(const char* line, size_t len, bool* fatal);
+
+	// Prepares sending the lines of the file. In incremental mode, this
+	// decides whether only changes get sent.
+	void StartRound();
+
+	// Returns true if a line can be skipped because it was sent before,
+	// and otherwise remembers it in incremental mode.
+	bool Unchanged(const char* line, size_t len);
+
+	// Drops the line last passed to Unchanged() from the lines sent
+	// before, because it couldn't be converted.
+	void ForgetLine();
+
+	// Finishes sending the lines of the file, including sending the
+	// removed ones in incremental mode.
+	void EndRound();
+
 	ifstream file;
 	time_t mtime;
 
@@ -65,11 +106,26 @@ private:
 	// keep a copy of the headerline to determine field locations when stream descriptions change
 	string headerline;
 
+	// The current line's fields, reused from line to line.
+	vector<string> line_fields;
+
 	// options set from the script-level.
 	string separator;
 	string set_separator;
 	string empty_field;
 	string unset_field;
+	bool use_mmap;
+	bool incremental;
+
+	// For incremental mode, the lines sent so far along with the round
+	// they were last seen in.
+	typedef std::unordered_map<string, uint32> line_map;
+	line_map seen_lines;
+	string seen_headerline;
+	string line_key;	// scratch for lookups
+	uint32 round;
+	bool seen_valid;	// the last round completed
+	bool incremental_send;	// only sending changes in this round
 
 	std::unique_ptr<threading::formatter::Formatter> formatter;
 };
@@ -0,0 +1,618 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "Columnar.h"
+
+#include "threading/SerialTypes.h"
+
+using namespace input::reader;
+using threading::Value;
+using threading::Field;
+
+static const char* const columnar_magic = "BROCOL1\n";
+static const size_t columnar_magic_len = 8;
+
+Columnar::Columnar(ReaderFrontend *frontend) : ReaderBackend(frontend)
+	{
+	mtime = 0;
+	}
+
+Columnar::~Columnar()
+	{
+	DoClose();
+	}
+
+void Columnar::DoClose()
+	{
+	}
+
+bool Columnar::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( info.mode == MODE_STREAM )
+		{
+		Error("Columnar files can't be streamed, use MANUAL or REREAD mode.");
+		return false;
+		}
+
+	if ( info.mode == MODE_REREAD )
+		{
+		struct stat sb;
+		if ( stat(info.source, &sb) == 0 )
+			mtime = sb.st_mtime;
+		}
+
+	return ReadFile();
+	}
+
+bool Columnar::DoUpdate()
+	{
+	if ( Info().mode == MODE_REREAD )
+		{
+		struct stat sb;
+		if ( stat(Info().source, &sb) == -1 )
+			{
+			Error(Fmt("Could not get stat for %s", Info().source));
+			return false;
+			}
+
+		if ( sb.st_mtime <= mtime ) // no change
+			return true;
+
+		mtime = sb.st_mtime;
+		}
+
+	return ReadFile();
+	}
+
+bool Columnar::ReadFile()
+	{
+	int fd = open(Info().source, O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s", Info().source));
+		return false;
+		}
+
+	struct stat sb;
+	if ( fstat(fd, &sb) < 0 )
+		{
+		Error(Fmt("Could not get stat for %s", Info().source));
+		close(fd);
+		return false;
+		}
+
+	size_t size = sb.st_size;
+
+	// The magic at both ends and the footer's offset at least.
+	if ( size < 2 * columnar_magic_len + 8 )
+		{
+		Error(Fmt("%s is not a finished columnar log", Info().source));
+		close(fd);
+		return false;
+		}
+
+	void* m = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( m == MAP_FAILED )
+		{
+		Error(Fmt("cannot map %s: %s", Info().source, Strerror(errno)));
+		return false;
+		}
+
+	const u_char* data = (const u_char*) m;
+	const u_char* trailer = data + size - columnar_magic_len - 8;
+
+	if ( memcmp(data, columnar_magic, columnar_magic_len) != 0 ||
+	     memcmp(trailer + 8, columnar_magic, columnar_magic_len) != 0 )
+		{
+		Error(Fmt("%s is not a finished columnar log", Info().source));
+		munmap(m, size);
+		return false;
+		}
+
+	Cursor header(data + columnar_magic_len, trailer);
+	bool ok = ReadHeader(&header);
+
+	if ( ok )
+		{
+		uint64 footer_offset = 0;
+
+		for ( int i = 0; i < 8; ++i )
+			footer_offset |= uint64(trailer[i]) << (8 * i);
+
+		Cursor footer(data + footer_offset, trailer);
+
+		if ( footer_offset >= uint64(trailer - data) || GetByte(&footer) != 'F' )
+			footer.failed = true;
+
+		GetVarint(&footer); // total rows
+		uint64 num_chunks = GetVarint(&footer);
+
+		for ( uint64 i = 0; ok && i < num_chunks && ! footer.failed; ++i )
+			{
+			uint64 offset = GetVarint(&footer);
+			uint64 num_rows = GetVarint(&footer);
+
+			if ( ! footer.failed )
+				ok = ReadChunk(data, trailer, offset, num_rows);
+			}
+
+		if ( ok && footer.failed )
+			{
+			Error(Fmt("%s has a corrupt chunk index", Info().source));
+			ok = false;
+			}
+		}
+
+	munmap(m, size);
+
+	if ( ok )
+		EndCurrentSend();
+
+	return ok;
+	}
+
+bool Columnar::ReadHeader(Cursor* c)
+	{
+	uint64 len = GetVarint(c);
+	GetBytes(c, len); // path
+	GetDouble(c); // open time
+
+	uint64 num_file_fields = GetVarint(c);
+	file_fields.clear();
+
+	for ( uint64 i = 0; i < num_file_fields && ! c->failed; ++i )
+		{
+		FileField f;
+
+		len = GetVarint(c);
+		const u_char* name = GetBytes(c, len);
+		f.name.assign((const char*) name, name ? len : 0);
+
+		len = GetVarint(c);
+		const u_char* type_name = GetBytes(c, len);
+		f.type_name.assign((const char*) type_name, type_name ? len : 0);
+
+		f.type = TypeTag(GetByte(c));
+		f.subtype = TypeTag(GetByte(c));
+		f.optional = (GetByte(c) == 1);
+
+		file_fields.push_back(f);
+		}
+
+	if ( c->failed )
+		{
+		Error(Fmt("%s has a corrupt header", Info().source));
+		return false;
+		}
+
+	mapping.clear();
+
+	for ( int i = 0; i < NumFields(); ++i )
+		{
+		const Field* field = Fields()[i];
+		int pos = -1;
+
+		for ( unsigned int j = 0; j < file_fields.size(); ++j )
+			{
+			if ( file_fields[j].name == field->name )
+				{
+				pos = j;
+				break;
+				}
+			}
+
+		if ( pos < 0 )
+			{
+			if ( field->optional )
+				{
+				// Always sent back as unset then.
+				mapping.push_back(-1);
+				continue;
+				}
+
+			Error(Fmt("Did not find requested field %s in input data file %s.",
+				  field->name, Info().source));
+			return false;
+			}
+
+		const FileField& f = file_fields[pos];
+		bool container = (f.type == TYPE_TABLE || f.type == TYPE_VECTOR);
+
+		if ( f.type != field->type || (container && f.subtype != field->subtype) )
+			{
+			Error(Fmt("Field %s is of type %s in %s, not %s.", field->name,
+				  f.type_name.c_str(), Info().source, field->TypeName().c_str()));
+			return false;
+			}
+
+		mapping.push_back(pos);
+		}
+
+	return true;
+	}
+
+bool Columnar::ReadChunk(const u_char* data, const u_char* end, uint64 offset,
+			 uint64 num_rows)
+	{
+	Cursor c(data + offset, end);
+
+	if ( offset >= uint64(end - data) || GetByte(&c) != 'C' || GetVarint(&c) != num_rows )
+		{
+		Error(Fmt("%s has a corrupt chunk at offset %" PRIu64, Info().source, offset));
+		return false;
+		}
+
+	std::vector<bool> needed(file_fields.size(), false);
+
+	for ( unsigned int i = 0; i < mapping.size(); ++i )
+		{
+		if ( mapping[i] >= 0 )
+			needed[mapping[i]] = true;
+		}
+
+	std::vector<Column> columns(file_fields.size());
+
+	for ( unsigned int i = 0; i < columns.size(); ++i )
+		{
+		columns[i].field = &file_fields[i];
+
+		if ( ! ReadColumn(&c, needed[i] ? &columns[i] : 0, num_rows) )
+			{
+			Error(Fmt("%s has a corrupt column %s in the chunk at offset %" PRIu64,
+				  Info().source, file_fields[i].name.c_str(), offset));
+			return false;
+			}
+		}
+
+	if ( num_rows == 0 )
+		return true;
+
+	Value*** rows = new Value**[num_rows];
+
+	for ( uint64 row = 0; row < num_rows; ++row )
+		{
+		Value** vals = new Value*[NumFields()];
+		int i;
+
+		for ( i = 0; i < NumFields(); ++i )
+			{
+			const Field* field = Fields()[i];
+
+			if ( mapping[i] < 0 )
+				vals[i] = new Value(field->type, false);
+			else
+				vals[i] = GetValue(&columns[mapping[i]], row, field);
+
+			if ( ! vals[i] )
+				break;
+			}
+
+		if ( i < NumFields() )
+			{
+			Error(Fmt("%s has a corrupt value of %s in the chunk at offset %" PRIu64,
+				  Info().source, Fields()[i]->name, offset));
+
+			for ( int j = 0; j < i; ++j )
+				delete vals[j];
+
+			delete [] vals;
+
+			for ( uint64 j = 0; j < row; ++j )
+				{
+				for ( int k = 0; k < NumFields(); ++k )
+					delete rows[j][k];
+
+				delete [] rows[j];
+				}
+
+			delete [] rows;
+			return false;
+			}
+
+		rows[row] = vals;
+		}
+
+	// A chunk holds a limited number of rows, so it's passed on as
+	// one batch.
+	SendEntries(num_rows, rows);
+
+	return true;
+	}
+
+bool Columnar::ReadColumn(Cursor* c, Column* col, uint64 num_rows)
+	{
+	bool dictionary = (GetByte(c) == 1);
+	bool compressed = (GetByte(c) == 1);
+	uint64 raw_size = GetVarint(c);
+	uint64 stored_size = GetVarint(c);
+	const u_char* stored = GetBytes(c, stored_size);
+
+	if ( ! stored )
+		return false;
+
+	if ( ! col )
+		// Not needed, just skip it.
+		return true;
+
+	Cursor r(stored, stored + stored_size);
+
+	if ( compressed && raw_size > 0 )
+		{
+		// zlib doesn't compress better than about 1:1000, so anything
+		// claiming more is corrupt rather than worth allocating.
+		if ( raw_size / 1024 > stored_size )
+			return false;
+
+		col->raw.resize(raw_size);
+		uLongf len = raw_size;
+
+		if ( uncompress((Bytef*) &col->raw[0], &len, stored, stored_size) != Z_OK ||
+		     len != raw_size )
+			return false;
+
+		const u_char* raw = (const u_char*) col->raw.data();
+		r = Cursor(raw, raw + raw_size);
+		}
+
+	if ( col->field->optional )
+		{
+		uint64 len = (num_rows + 7) / 8;
+		const u_char* bits = GetBytes(&r, len);
+		col->presence = Cursor(bits, bits + len);
+		}
+
+	col->dictionary = dictionary;
+
+	if ( dictionary )
+		{
+		uint64 num_entries = GetVarint(&r);
+
+		for ( uint64 i = 0; i < num_entries && ! r.failed; ++i )
+			{
+			uint64 len = GetVarint(&r);
+			const u_char* entry = GetBytes(&r, len);
+			col->entries.push_back(std::make_pair(entry, len));
+			}
+		}
+
+	col->values = r;
+
+	return ! r.failed;
+	}
+
+Value* Columnar::GetValue(Column* col, uint64 row, const Field* field)
+	{
+	if ( col->field->optional &&
+	     ! (col->presence.pos[row / 8] & (1 << (row % 8))) )
+		return new Value(field->type, false);
+
+	if ( ! col->dictionary )
+		return GetPlain(&col->values, field->type, field->subtype);
+
+	uint64 i = GetVarint(&col->values);
+
+	if ( col->values.failed || i >= col->entries.size() )
+		return 0;
+
+	return GetString(col->entries[i].first, col->entries[i].second, field->type);
+	}
+
+Value* Columnar::GetPlain(Cursor* c, TypeTag type, TypeTag subtype)
+	{
+	if ( type == TYPE_ENUM || type == TYPE_STRING || type == TYPE_FILE || type == TYPE_FUNC )
+		{
+		uint64 len = GetVarint(c);
+		const u_char* data = GetBytes(c, len);
+		return data ? GetString(data, len, type) : 0;
+		}
+
+	Value* v = new Value(type, true);
+
+	switch ( type ) {
+	case TYPE_BOOL:
+		v->val.int_val = GetByte(c) ? 1 : 0;
+		break;
+
+	case TYPE_INT:
+		{
+		// Zigzag encoded.
+		uint64 z = GetVarint(c);
+		v->val.int_val = int64(z >> 1) ^ -int64(z & 1);
+		break;
+		}
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		v->val.uint_val = GetVarint(c);
+		break;
+
+	case TYPE_PORT:
+		v->val.port_val.port = GetVarint(c);
+		v->val.port_val.proto = TransportProto(GetByte(c));
+		break;
+
+	case TYPE_SUBNET:
+	case TYPE_ADDR:
+		{
+		Value::addr_t& a = type == TYPE_ADDR ?
+			v->val.addr_val : v->val.subnet_val.prefix;
+
+		u_char family = GetByte(c);
+
+		if ( family == 4 )
+			{
+			a.family = IPv4;
+			const u_char* bytes = GetBytes(c, 4);
+
+			if ( bytes )
+				memcpy(&a.in.in4, bytes, 4);
+			}
+
+		else if ( family == 6 )
+			{
+			a.family = IPv6;
+			const u_char* bytes = GetBytes(c, 16);
+
+			if ( bytes )
+				memcpy(&a.in.in6, bytes, 16);
+			}
+
+		else
+			c->failed = true;
+
+		if ( type == TYPE_SUBNET )
+			v->val.subnet_val.length = GetByte(c);
+
+		break;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_INTERVAL:
+	case TYPE_TIME:
+		v->val.double_val = GetDouble(c);
+		break;
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		Value::set_t& s = type == TYPE_TABLE ?
+			v->val.set_val : v->val.vector_val;
+
+		uint64 n = GetVarint(c);
+
+		// Each element takes at least one byte.
+		if ( n > uint64(c->end - c->pos) )
+			{
+			c->failed = true;
+			break;
+			}
+
+		s.size = 0;
+		s.vals = new Value*[n];
+
+		for ( uint64 i = 0; i < n; ++i )
+			{
+			Value* e = GetPlain(c, subtype, TYPE_ERROR);
+
+			if ( ! e )
+				{
+				c->failed = true;
+				break;
+				}
+
+			s.vals[s.size++] = e;
+			}
+
+		break;
+		}
+
+	default:
+		c->failed = true;
+		break;
+	}
+
+	if ( c->failed )
+		{
+		delete v;
+		return 0;
+		}
+
+	return v;
+	}
+
+Value* Columnar::GetString(const u_char* data, uint64 len, TypeTag type)
+	{
+	Value* v = new Value(type, true);
+	v->val.string_val.data = new char[len];
+	v->val.string_val.length = len;
+	memcpy(v->val.string_val.data, data, len);
+	return v;
+	}
+
+u_char Columnar::GetByte(Cursor* c)
+	{
+	if ( c->failed || c->pos >= c->end )
+		{
+		c->failed = true;
+		return 0;
+		}
+
+	return *c->pos++;
+	}
+
+uint64 Columnar::GetVarint(Cursor* c)
+	{
+	uint64 n = 0;
+
+	for ( int shift = 0; shift < 64; shift += 7 )
+		{
+		u_char b = GetByte(c);
+		n |= uint64(b & 0x7f) << shift;
+
+		if ( b < 0x80 )
+			return n;
+		}
+
+	c->failed = true;
+	return 0;
+	}
+
+double Columnar::GetDouble(Cursor* c)
+	{
+	const u_char* bytes = GetBytes(c, 8);
+
+	if ( ! bytes )
+		return 0;
+
+	uint64 bits = 0;
+
+	for ( int i = 0; i < 8; ++i )
+		bits |= uint64(bytes[i]) << (8 * i);
+
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+	}
+
+const u_char* Columnar::GetBytes(Cursor* c, uint64 len)
+	{
+	if ( c->failed || len > uint64(c->end - c->pos) )
+		{
+		c->failed = true;
+		return 0;
+		}
+
+	const u_char* bytes = c->pos;
+	c->pos += len;
+	return bytes;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode ) {
+		case MODE_MANUAL:
+			// yay, we do nothing :)
+			break;
+
+		case MODE_REREAD:
+			Update(); // call update and not DoUpdate, because update
+				  // checks disabled.
+			break;
+
+		default:
+			assert(false);
+	}
+
+	return true;
+	}
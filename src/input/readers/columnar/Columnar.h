@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Reader for the files of the columnar log writer, see
+// logging/writers/columnar/Columnar.h for their format. Together the two
+// serve as a binary snapshot format for input tables: log a table's
+// entries with Log::WRITER_COLUMNAR once it has been loaded, and read the
+// resulting file back with this reader, e.g. after a restart. That skips
+// parsing text entirely; the file gets mapped into memory, and the footer's
+// index leads to the chunks.
+
+#ifndef INPUT_READERS_COLUMNAR_H
+#define INPUT_READERS_COLUMNAR_H
+
+#include <string>
+#include <vector>
+
+#include "input/ReaderBackend.h"
+
+namespace input { namespace reader {
+
+class Columnar : public ReaderBackend {
+public:
+	Columnar(ReaderFrontend* frontend);
+	~Columnar();
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	virtual bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	                    const threading::Field* const* fields);
+	virtual void DoClose();
+	virtual bool DoUpdate();
+	virtual bool DoHeartbeat(double network_time, double current_time);
+
+private:
+	// A position in a block of encoded data. Reading past the end sets
+	// failed, and returns zeros from then on.
+	struct Cursor {
+		const u_char* pos;
+		const u_char* end;
+		bool failed;
+
+		Cursor(const u_char* arg_pos = 0, const u_char* arg_end = 0)
+			: pos(arg_pos), end(arg_end), failed(false)	{ }
+	};
+
+	// A field of the file as described by its header.
+	struct FileField {
+		string name;
+		string type_name;
+		TypeTag type;
+		TypeTag subtype;
+		bool optional;
+	};
+
+	// The stored values of one field within the current chunk.
+	struct Column {
+		const FileField* field;
+		string raw;	// decompressed data, if compressed
+		Cursor presence;	// bitmap, for optional fields
+		Cursor values;
+		bool dictionary;
+		std::vector<std::pair<const u_char*, uint64> > entries;
+	};
+
+	bool ReadFile();
+	bool ReadHeader(Cursor* c);
+	bool ReadChunk(const u_char* data, const u_char* end, uint64 offset,
+		       uint64 num_rows);
+	bool ReadColumn(Cursor* c, Column* col, uint64 num_rows);
+	threading::Value* GetValue(Column* col, uint64 row, const threading::Field* field);
+	threading::Value* GetPlain(Cursor* c, TypeTag type, TypeTag subtype);
+	threading::Value* GetString(const u_char* data, uint64 len, TypeTag type);
+
+	static u_char GetByte(Cursor* c);
+	static uint64 GetVarint(Cursor* c);
+	static double GetDouble(Cursor* c);
+	static const u_char* GetBytes(Cursor* c, uint64 len);
+
+	time_t mtime;
+
+	std::vector<FileField> file_fields;
+
+	// For each field the reader has to return, the index of the file's
+	// field providing it, or -1 if the file doesn't have it.
+	std::vector<int> mapping;
+};
+
+}
+}
+
+#endif /* INPUT_READERS_COLUMNAR_H */
@@ -8,7 +8,11 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "Raw.h"
 #include "Plugin.h"
@@ -20,11 +24,15 @@ extern "C" {
 #include "setsignal.h"
 }
 
+extern char** environ;
+
 using namespace input::reader;
 using threading::Value;
 using threading::Field;
 
-const int Raw::block_size = 4096; // how big do we expect our chunks of data to be.
+// How much to read at once. Lines get split off in the buffer, so bigger
+// reads mean fewer system calls for high-rate sources.
+const int Raw::block_size = 65536;
 
 Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclose), stderrfile(nullptr, fclose)
 	{
@@ -38,8 +46,6 @@ Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclo
 
 	sep_length = BifConst::InputRaw::record_separator->Len();
 
-	bufpos = 0;
-
 	stdin_fileno = fileno(stdin);
 	stdout_fileno = fileno(stdout);
 	stderr_fileno = fileno(stderr);
@@ -136,142 +142,122 @@ bool Raw::Execute()
 		return false;
 		}
 
-	childpid = fork();
-	if ( childpid < 0 )
+	// posix_spawn() doesn't copy our address space, unlike fork(),
+	// which is expensive for a process as large as Bro may get. The
+	// child gets its pipes, its own process group, and default signal
+	// handling.
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+
+	posix_spawn_file_actions_addclose(&actions, pipes[stdout_in]);
+	posix_spawn_file_actions_adddup2(&actions, pipes[stdout_out], stdout_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdout_out]);
+
+	posix_spawn_file_actions_addclose(&actions, pipes[stdin_out]);
+	if ( stdin_towrite )
+		posix_spawn_file_actions_adddup2(&actions, pipes[stdin_in], stdin_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdin_in]);
+
+	posix_spawn_file_actions_addclose(&actions, pipes[stderr_in]);
+	if ( use_stderr )
+		posix_spawn_file_actions_adddup2(&actions, pipes[stderr_out], stderr_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stderr_out]);
+
+	// The signal mask is inherited, so unblock everything, and reset
+	// SIGPIPE, which may be ignored when debugging scripts.
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+				 POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	const char* argv[] = { "sh", "-c", fname.c_str(), 0 };
+	int res = posix_spawn(&childpid, "/bin/sh", &actions, &attr,
+			      (char* const*) argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if ( res != 0 )
 		{
+		childpid = -1;
 		UnlockForkMutex();
-		Error(Fmt("Could not create child process: %d", errno));
-		return false;
-		}
 
-	else if ( childpid == 0 )
-		{
-		// we are the child.
-
-		// Obtain a process group w/ child's PID.
-		if ( setpgid(0, 0) == -1 )
-			_exit(251);
-
-		close(pipes[stdout_in]);
-		if ( dup2(pipes[stdout_out], stdout_fileno) == -1 )
-			_exit(252);
-
-		close(pipes[stdout_out]);
+		for ( int i = 0; i < 6; i++ )
+			ClosePipeEnd(i);
 
-		close(pipes[stdin_out]);
-		if ( stdin_towrite && dup2(pipes[stdin_in], stdin_fileno) == -1 )
-			_exit(253);
+		Error(Fmt("Could not create child process: %d", res));
+		return false;
+		}
 
-		close(pipes[stdin_in]);
+	if ( ! UnlockForkMutex() )
+		return false;
 
-		close(pipes[stderr_in]);
-		if ( use_stderr && dup2(pipes[stderr_out], stderr_fileno) == -1 )
-			_exit(254);
+	ClosePipeEnd(stdout_out);
 
-		close(pipes[stderr_out]);
+	if ( Info().mode == MODE_STREAM )
+		{
+		if ( ! SetFDFlags(pipes[stdout_in], F_SETFL, O_NONBLOCK) )
+			return false;
+		}
 
-		// Signal mask is inherited over fork-exec, so reset any ignored
-		// signals to default behavior and unblock any blocked signals.
-		setsignal(SIGPIPE, SIG_DFL); // May be ignored when debugging scripts.
-		sigset_t mask;
-		sigfillset(&mask);
-		// Assuming the fork-one model of pthreads' fork(), using sigprocmask()
-		// makes sense over pthread_sigmask() here.
-		sigprocmask(SIG_UNBLOCK, &mask, 0);
+	ClosePipeEnd(stdin_in);
 
-		execl("/bin/sh", "sh", "-c", fname.c_str(), (char*) NULL);
-		fprintf(stderr, "Exec failed :(......\n");
-		_exit(255);
+	if ( stdin_towrite )
+		{
+		// Ya, just always set this to nonblocking. we do not
+		// want to block on a program receiving data. Note
+		// that there is a small gotcha with it. More data is
+		// queued when more data is read from the program
+		// output. Hence, when having a program in
+		// mode_manual where the first write cannot write
+		// everything, the rest will be stuck in a queue that
+		// is never emptied.
+		if ( ! SetFDFlags(pipes[stdin_out], F_SETFL, O_NONBLOCK) )
+			return false;
 		}
 	else
-		{
-		// we are the parent
-
-		// Parent also sets child process group immediately to avoid a race.
-		if ( setpgid(childpid, childpid) == -1 )
-			{
-			if ( errno == EACCES )
-				// Child already did exec. That's fine since then it must have
-				// already done the setpgid() itself.
-				;
-
-			else if ( errno == ESRCH && kill(childpid, 0) == 0 )
-				// Sometimes (e.g. FreeBSD) this error is reported even though
-				// child exists, so do extra sanity check of whether it exists.
-				;
+		ClosePipeEnd(stdin_out);
 
-			else
-				{
-				char buf[256];
-				strerror_r(errno, buf, sizeof(buf));
-				Warning(Fmt("Could not set child process group: %s", buf));
-				}
-			}
+	ClosePipeEnd(stderr_out);
 
-		if ( ! UnlockForkMutex() )
+	if ( use_stderr )
+		{
+		if ( ! SetFDFlags(pipes[stderr_in], F_SETFL, O_NONBLOCK) )
 			return false;
+		}
+	else
+		ClosePipeEnd(stderr_in);
 
-		ClosePipeEnd(stdout_out);
-
-		if ( Info().mode == MODE_STREAM )
-			{
-			if ( ! SetFDFlags(pipes[stdout_in], F_SETFL, O_NONBLOCK) )
-				return false;
-			}
-
-		ClosePipeEnd(stdin_in);
+	file = std::unique_ptr<FILE, int(*)(FILE*)>(fdopen(pipes[stdout_in], "r"), fclose);
 
-		if ( stdin_towrite )
-			{
-			// Ya, just always set this to nonblocking. we do not
-			// want to block on a program receiving data. Note
-			// that there is a small gotcha with it. More data is
-			// queued when more data is read from the program
-			// output. Hence, when having a program in
-			// mode_manual where the first write cannot write
-			// everything, the rest will be stuck in a queue that
-			// is never emptied.
-			if ( ! SetFDFlags(pipes[stdin_out], F_SETFL, O_NONBLOCK) )
-				return false;
-			}
-		else
-			ClosePipeEnd(stdin_out);
+	if ( ! file )
+		{
+		Error("Could not convert stdout_in fileno to file");
+		return false;
+		}
 
-		ClosePipeEnd(stderr_out);
+	pipes[stdout_in] = -1; // will be closed by fclose
 
-		if ( use_stderr )
-			{
-			if ( ! SetFDFlags(pipes[stderr_in], F_SETFL, O_NONBLOCK) )
-				return false;
-			}
-		else
-			ClosePipeEnd(stderr_in);
-
-		file = std::unique_ptr<FILE, int(*)(FILE*)>(fdopen(pipes[stdout_in], "r"), fclose);
+	if ( use_stderr )
+		{
+		stderrfile = std::unique_ptr<FILE, int(*)(FILE*)>(fdopen(pipes[stderr_in], "r"), fclose);
 
-		if ( ! file )
+		if ( ! stderrfile )
 			{
-			Error("Could not convert stdout_in fileno to file");
+			Error("Could not convert stderr_in fileno to file");
 			return false;
 			}
 
-		pipes[stdout_in] = -1; // will be closed by fclose
-
-		if ( use_stderr )
-			{
-			stderrfile = std::unique_ptr<FILE, int(*)(FILE*)>(fdopen(pipes[stderr_in], "r"), fclose);
-
-			if ( ! stderrfile )
-				{
-				Error("Could not convert stderr_in fileno to file");
-				return false;
-				}
-
-			pipes[stderr_in] = -1; // will be closed by fclose
-			}
-
-		return true;
+		pipes[stderr_in] = -1; // will be closed by fclose
 		}
+
+	return true;
 	}
 
 bool Raw::OpenInput()
@@ -321,9 +307,13 @@ bool Raw::CloseInput()
 #endif
 
 	file.reset(nullptr);
+	stdout_buf.Clear();
 
 	if ( use_stderr )
+		{
 		stderrfile.reset(nullptr);
+		stderr_buf.Clear();
+		}
 
 	if ( execute )
 		{
@@ -438,76 +428,86 @@ bool Raw::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fie
 	return true;
 	}
 
-int64_t Raw::GetLine(FILE* arg_file)
+int64_t Raw::GetLine(FILE* arg_file, LineBuffer* lb)
 	{
-	errno = 0;
-	int pos = 0; // strstr_n only works on ints - so no use to use something different here
-	int offset = 0;
-
-	if ( ! buf )
-		buf = std::unique_ptr<char[]>(new char[block_size]);
-
-	int repeats = 1;
+	// Reads bypass stdio's buffering, as lines get split off in our own
+	// buffer. Nothing else reads from the file.
+	int fd = fileno(arg_file);
 
 	for ( ;; )
 		{
-		size_t readbytes = fread(buf.get()+bufpos+offset, 1, block_size-bufpos, arg_file);
-		pos += bufpos + readbytes;
-		//printf("Pos: %d\n", pos);
-		bufpos = offset = 0; // read full block size in next read...
-
-		if ( pos == 0 && errno != 0 )
-			break;
-
-		// researching everything each time is a bit... cpu-intensive. But otherwhise we have
-		// to deal with situations where the separator is multi-character and split over multiple
-		// reads...
-		int found = strstr_n(pos, (unsigned char*) buf.get(), separator.size(), (unsigned char*) separator.c_str());
-
-		if ( found == -1 )
+		if ( lb->end - lb->start >= sep_length )
 			{
-			// we did not find it and have to search again in the next try. resize buffer....
-			// but first check if we encountered the file end - because if we did this was it.
-			if ( feof(arg_file) != 0 )
+			// Separators may have been split over two reads, so search
+			// from just before where the last search stopped.
+			size_t from = std::max(lb->scanned, lb->start);
+			int found = strstr_n(lb->end - from, (unsigned char*) lb->data.get() + from,
+					     sep_length, (unsigned char*) separator.c_str());
+
+			if ( found >= 0 )
 				{
-				if ( pos == 0 )
-					return -1; // signal EOF - and that we had no more data.
-				else
-					{
-					outbuf = std::move(buf); // buf is null after this
-					return pos;
-					}
+				size_t len = from + found - lb->start;
+				outbuf = std::unique_ptr<char[]>(new char[len]);
+				memcpy(outbuf.get(), lb->data.get() + lb->start, len);
+				lb->start += len + sep_length;
+				lb->scanned = lb->start;
+				return len;
 				}
 
-			repeats++;
-			// bah, we cannot use realloc because we would have to change the delete in the manager to a free.
-			std::unique_ptr<char[]> newbuf = std::unique_ptr<char[]>(new char[block_size*repeats]);
-			memcpy(newbuf.get(), buf.get(), block_size*(repeats-1));
-			buf = std::move(newbuf);
-			offset = block_size*(repeats-1);
+			lb->scanned = lb->end - (sep_length - 1);
 			}
-		else
+
+		if ( lb->start == lb->end )
+			lb->start = lb->end = lb->scanned = 0;
+
+		if ( lb->size - lb->end < (size_t) block_size )
 			{
-			outbuf = std::move(buf);
+			// Make room, moving what's left to the front, and
+			// growing the buffer for lines longer than it.
+			size_t pending = lb->end - lb->start;
+			size_t new_size = std::max(lb->size, (size_t) block_size);
 
-			if ( found < pos )
-				{
-				// we have leftovers. copy them into the buffer for the next line
-				buf = std::unique_ptr<char[]>(new char[block_size]);
-				memcpy(buf.get(), outbuf.get() + found + sep_length, pos - found - sep_length);
-				bufpos = pos - found - sep_length;
-				}
+			while ( new_size - pending < (size_t) block_size )
+				new_size *= 2;
+
+			char* data = (new_size == lb->size) ? lb->data.get() : new char[new_size];
+
+			if ( pending )
+				memmove(data, lb->data.get() + lb->start, pending);
 
-			return found;
+			if ( data != lb->data.get() )
+				lb->data = std::unique_ptr<char[]>(data);
+
+			lb->size = new_size;
+			lb->scanned -= std::min(lb->scanned, lb->start);
+			lb->end = pending;
+			lb->start = 0;
 			}
 
-		}
+		ssize_t n = read(fd, lb->data.get() + lb->end, lb->size - lb->end);
 
-	if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
-		return -2;
+		if ( n > 0 )
+			{
+			lb->end += n;
+			continue;
+			}
+
+		if ( n == 0 )
+			{
+			// At the end, what's left is the last line.
+			if ( lb->start == lb->end )
+				return -1; // signal EOF - and that we had no more data.
+
+			size_t len = lb->end - lb->start;
+			outbuf = std::unique_ptr<char[]>(new char[len]);
+			memcpy(outbuf.get(), lb->data.get() + lb->start, len);
+			lb->start = lb->end = lb->scanned = 0;
+			return len;
+			}
+
+		if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+			return -2;
 
-	else
-		{
 		// an error code we did no expect. This probably is bad.
 		Error(Fmt("Reader encountered unexpected error code %d", errno));
 		return -3;
@@ -573,10 +573,8 @@ bool Raw::DoUpdate()
 		case MODE_MANUAL:
 		case MODE_STREAM:
 			if ( Info().mode == MODE_STREAM && file )
-				{
-				clearerr(file.get());  // remove end of file evil bits
+				// reading goes on where it stopped
 				break;
-				}
 
 			CloseInput();
 			if ( ! OpenInput() )
@@ -596,7 +594,7 @@ bool Raw::DoUpdate()
 		if ( stdin_towrite > 0 )
 			WriteToStdin();
 
-		int64_t length = GetLine(file.get());
+		int64_t length = GetLine(file.get(), &stdout_buf);
 		//printf("Read %lld bytes\n", length);
 
 		if ( length == -3 )
@@ -628,7 +626,7 @@ bool Raw::DoUpdate()
 		{
 		for ( ;; )
 			{
-			int64_t length = GetLine(stderrfile.get());
+			int64_t length = GetLine(stderrfile.get(), &stderr_buf);
 			//printf("Read stderr %lld bytes\n", length);
 			if ( length == -3 )
 				return false;
@@ -40,9 +40,23 @@ private:
 	bool LockForkMutex();
 	bool UnlockForkMutex();
 
+	// Data read from a file or pipe that hasn't been returned as lines
+	// yet: the bytes from start to end. Up to scanned, there's no
+	// separator in them.
+	struct LineBuffer {
+		std::unique_ptr<char[]> data;
+		size_t size;
+		size_t start;
+		size_t end;
+		size_t scanned;
+
+		LineBuffer() : size(), start(), end(), scanned()	{ }
+		void Clear()	{ data.reset(); size = start = end = scanned = 0; }
+	};
+
 	bool OpenInput();
 	bool CloseInput();
-	int64_t GetLine(FILE* file);
+	int64_t GetLine(FILE* file, LineBuffer* lb);
 	bool Execute();
 	void WriteToStdin();
 
@@ -57,9 +71,9 @@ private:
 	string separator;
 	unsigned int sep_length; // length of the separator
 
-	int bufpos;
-	std::unique_ptr<char[]> buf;
-	std::unique_ptr<char[]> outbuf;
+	LineBuffer stdout_buf;
+	LineBuffer stderr_buf;
+	std::unique_ptr<char[]> outbuf; // the line GetLine() returned
 
 	int stdin_fileno;
 	int stdout_fileno;
@@ -21,7 +21,8 @@ using threading::Field;
 
 SQLite::SQLite(ReaderFrontend *frontend)
 	: ReaderBackend(frontend),
-	  fields(), num_fields(), mode(), started(), query(), db(), st()
+	  fields(), num_fields(), mode(), started(), query(), db(), st(),
+	  mtime(), batch_size(), last_key()
 	{
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
@@ -49,6 +50,18 @@ SQLite::~SQLite()
 
 void SQLite::DoClose()
 	{
+	if ( last_key )
+		{
+		sqlite3_value_free(last_key);
+		last_key = 0;
+		}
+
+	if ( st != 0 )
+		{
+		sqlite3_finalize(st);
+		st = 0;
+		}
+
 	if ( db != 0 )
 		{
 		sqlite3_close(db);
@@ -79,16 +92,17 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	// allows simultaneous writes to one file.
 	sqlite3_enable_shared_cache(1);
 
-	if ( Info().mode != MODE_MANUAL )
+	if ( Info().mode != MODE_MANUAL && Info().mode != MODE_REREAD )
 		{
-		Error("SQLite only supports manual reading mode.");
+		Error("SQLite only supports manual and reread reading modes.");
 		return false;
 		}
 
 	started = false;
 
-	string fullpath(info.source);
+	fullpath = info.source;
 	fullpath.append(".sqlite");
+	Changed();
 
 	string query;
 	ReaderInfo::config_map::const_iterator it = info.config.find("query");
@@ -100,6 +114,43 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	else
 		query = it->second;
 
+	batch_size = BifConst::InputSQLite::batch_size;
+
+	it = info.config.find("batch_size");
+	if ( it != info.config.end() )
+		batch_size = strtoul(it->second, 0, 10);
+
+	if ( batch_size == 0 )
+		batch_size = 1;
+
+	it = info.config.find("incremental_key");
+	if ( it != info.config.end() && *it->second )
+		{
+		incremental_key = it->second;
+
+		// The first query returns everything, later ones only what's
+		// new, in order so that the last row has the largest key.
+		string key = "\"";
+
+		for ( string::const_iterator i = incremental_key.begin();
+		      i != incremental_key.end(); ++i )
+			{
+			if ( *i == '"' )
+				key += '"';
+
+			key += *i;
+			}
+
+		key += "\"";
+
+		// The query becomes a subquery, which mustn't end the statement.
+		string::size_type end = query.find_last_not_of("; \t\r\n");
+		query.erase(end == string::npos ? 0 : end + 1);
+
+		query = "SELECT * FROM (" + query + ") WHERE ?1 IS NULL OR " +
+			key + " > ?1 ORDER BY " + key;
+		}
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
@@ -303,6 +354,45 @@ bool SQLite::DoUpdate()
 			}
 		}
 
+	int key_column = -1;
+
+	if ( ! incremental_key.empty() )
+		{
+		for ( int i = 0; i < numcolumns; ++i )
+			{
+			if ( incremental_key == sqlite3_column_name(st, i) )
+				{
+				key_column = i;
+				break;
+				}
+			}
+
+		if ( key_column == -1 )
+			{
+			Error(Fmt("Incremental key %s not found after SQLite statement", incremental_key.c_str()));
+			delete [] mapping;
+			delete [] submapping;
+			return false;
+			}
+
+		int rc = last_key ? sqlite3_bind_value(st, 1, last_key) : sqlite3_bind_null(st, 1);
+
+		if ( checkError(rc) )
+			{
+			delete [] mapping;
+			delete [] submapping;
+			return false;
+			}
+		}
+
+	// Only what's new comes back once the first query returned something.
+	bool incremental = (last_key != 0);
+
+	// Rows go to the main thread in batches, rather than each in its
+	// own message.
+	Value*** batch = 0;
+	unsigned int batch_pos = 0;
+
 	int errorcode;
 	while ( ( errorcode = sqlite3_step(st)) == SQLITE_ROW )
 		{
@@ -317,22 +407,61 @@ bool SQLite::DoUpdate()
 					delete ofields[k];
 
 				delete [] ofields;
+
+				for ( unsigned int k = 0; k < batch_pos; ++k )
+					{
+					for ( unsigned int l = 0; l < num_fields; ++l )
+						delete batch[k][l];
+
+					delete [] batch[k];
+					}
+
+				delete [] batch;
 				delete [] mapping;
 				delete [] submapping;
+				sqlite3_reset(st);
 				return false;
 				}
 			}
 
-		SendEntry(ofields);
+		if ( key_column >= 0 && sqlite3_column_type(st, key_column) != SQLITE_NULL )
+			{
+			if ( last_key )
+				sqlite3_value_free(last_key);
+
+			last_key = sqlite3_value_dup(sqlite3_column_value(st, key_column));
+			}
+
+		if ( ! batch )
+			batch = new Value**[batch_size];
+
+		batch[batch_pos++] = ofields;
+
+		if ( batch_pos == batch_size )
+			{
+			SendEntries(batch_pos, batch);
+			batch = 0;
+			batch_pos = 0;
+			}
 		}
 
+	if ( batch )
+		SendEntries(batch_pos, batch);
+
 	delete [] mapping;
 	delete [] submapping;
 
 	if ( checkError(errorcode) ) // check the last error code returned by sqlite
+		{
+		sqlite3_reset(st);
 		return false;
+		}
 
-	EndCurrentSend();
+	// An incremental update leaves the entries from before alone.
+	if ( incremental )
+		EndIncrementalSend();
+	else
+		EndCurrentSend();
 
 	if ( checkError(sqlite3_reset(st)) )
 		return false;
@@ -340,3 +469,42 @@ bool SQLite::DoUpdate()
 	return true;
 	}
 
+
+bool SQLite::Changed()
+	{
+	// With write-ahead logging, changes go to a second file until they
+	// get checkpointed.
+	time_t t = 0;
+	struct stat sb;
+
+	if ( stat(fullpath.c_str(), &sb) == 0 )
+		t = sb.st_mtime;
+
+	if ( stat((fullpath + "-wal").c_str(), &sb) == 0 && sb.st_mtime > t )
+		t = sb.st_mtime;
+
+	if ( t == mtime )
+		return false;
+
+	mtime = t;
+	return true;
+	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode ) {
+	case MODE_MANUAL:
+		break;
+
+	case MODE_REREAD:
+		if ( Changed() )
+			Update(); // call update and not DoUpdate, because update
+				  // checks disabled.
+		break;
+
+	default:
+		assert(false);
+	}
+
+	return true;
+	}
@@ -25,11 +25,14 @@ protected:
 	virtual bool DoInit(const ReaderInfo& info, int arg_num_fields, const threading::Field* const* arg_fields);
 	virtual void DoClose();
 	virtual bool DoUpdate();
-	virtual bool DoHeartbeat(double network_time, double current_time)	{ return true; }
+	virtual bool DoHeartbeat(double network_time, double current_time);
 
 private:
 	bool checkError(int code);
 
+	// Returns true if the database file changed since the last check.
+	bool Changed();
+
 	threading::Value* EntryToVal(sqlite3_stmt *st, const threading::Field *field, int pos, int subpos);
 
 	const threading::Field* const * fields; // raw mapping
@@ -41,6 +44,15 @@ private:
 	sqlite3_stmt *st;
 	threading::formatter::Ascii* io;
 
+	string fullpath;
+	time_t mtime;	// of the database file, for rereads
+	unsigned int batch_size;	// rows per message to the main thread
+
+	// With incremental rereads, each query only returns the rows whose
+	// key column is larger than what the last ones returned.
+	string incremental_key;
+	sqlite3_value* last_key;	// largest key seen so far, or null
+
 	string set_separator;
 	string unset_field;
 	string empty_field;
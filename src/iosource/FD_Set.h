@@ -77,6 +77,20 @@ public:
 		return false;
 		}
 
+	typedef std::set<int>::const_iterator const_iterator;
+
+	/**
+	 * @return an iterator to the first file descriptor of the set.
+	 */
+	const_iterator begin() const
+		{ return fds.begin(); }
+
+	/**
+	 * @return an iterator past the last file descriptor of the set.
+	 */
+	const_iterator end() const
+		{ return fds.end(); }
+
 	/**
 	 * @return whether any file descriptors have been added to the set.
 	 */
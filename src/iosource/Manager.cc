@@ -54,6 +54,7 @@ IOSource* Manager::FindSoonest(double* ts)
 		if ( ! (*i)->src->IsOpen() )
 			{
 			(*i)->src->Done();
+			poller.Forget(*i);
 			delete *i;
 			sources.erase(i);
 			break;
@@ -94,17 +95,11 @@ IOSource* Manager::FindSoonest(double* ts)
 
 	// If we found one and aren't going to select this time,
 	// return it.
-	int maxx = 0;
-
 	if ( soonest_src && (call_count % SELECT_FREQUENCY) != 0 )
 		goto finished;
 
-	// Select on the join of all file descriptors.
-	fd_set fd_read, fd_write, fd_except;
-
-	FD_ZERO(&fd_read);
-	FD_ZERO(&fd_write);
-	FD_ZERO(&fd_except);
+	// Wait on the join of all file descriptors.
+	poller.Clear();
 
 	for ( SourceList::iterator i = sources.begin();
 	      i != sources.end(); ++i )
@@ -112,13 +107,17 @@ IOSource* Manager::FindSoonest(double* ts)
 		Source* src = (*i);
 
 		if ( ! src->src->IsIdle() )
-			// No need to select on sources which we know to
-			// be ready.
+			{
+			// No need to wait on sources which we know to be
+			// ready, but we keep their descriptors registered.
+			src->AddFds(&poller, false);
 			continue;
+			}
 
 		src->Clear();
 		src->src->GetFds(&src->fd_read, &src->fd_write, &src->fd_except);
-		src->SetFds(&fd_read, &fd_write, &fd_except, &maxx);
+		src->AddFds(&poller, true);
+		++src->polled;
 		}
 
 	// We can't block indefinitely even when all sources are dry:
@@ -141,36 +140,32 @@ IOSource* Manager::FindSoonest(double* ts)
 		select(0, 0, 0, 0, &timeout);
 		}
 
-	if ( ! maxx )
+	if ( poller.Empty() )
 		// No selectable fd at all.
 		goto finished;
 
 	timeout.tv_sec = 0;
 	timeout.tv_usec = 0;
 
-	if ( select(maxx + 1, &fd_read, &fd_write, &fd_except, &timeout) > 0 )
-		{ // Find soonest.
-		for ( SourceList::iterator i = sources.begin();
-		      i != sources.end(); ++i )
-			{
-			Source* src = (*i);
+	ready.clear();
+	poller.Wait(timeout, &ready);
 
-			if ( ! src->src->IsIdle() )
-				continue;
+	// Find soonest.
+	for ( std::vector<void*>::const_iterator i = ready.begin();
+	      i != ready.end(); ++i )
+		{
+		Source* src = (Source*) (*i);
+		++src->ready;
 
-			if ( src->Ready(&fd_read, &fd_write, &fd_except) )
-				{
-				double local_network_time = 0;
-				double ts = src->src->NextTimestamp(&local_network_time);
-				if ( ts > 0.0 && ts < soonest_ts )
-					{
-					soonest_ts = ts;
-					soonest_src = src->src;
-					soonest_local_network_time =
-						local_network_time ?
-							local_network_time : ts;
-					}
-				}
+		double local_network_time = 0;
+		double ts = src->src->NextTimestamp(&local_network_time);
+		if ( ts > 0.0 && ts < soonest_ts )
+			{
+			soonest_ts = ts;
+			soonest_src = src->src;
+			soonest_local_network_time =
+				local_network_time ?
+					local_network_time : ts;
 			}
 		}
 
@@ -199,6 +194,8 @@ void Manager::Register(IOSource* src, bool dont_count)
 	Source* s = new Source;
 	s->src = src;
 	s->dont_count = dont_count;
+	s->polled = 0;
+	s->ready = 0;
 	if ( dont_count )
 		++dont_counts;
 
@@ -318,10 +315,28 @@ PktDumper* Manager::OpenPktDumper(const string& path, bool append)
 	return pd;
 	}
 
-void Manager::Source::SetFds(fd_set* read, fd_set* write, fd_set* except,
-                             int* maxx) const
+void Manager::GetSourceStats(source_stats_list* stats) const
+	{
+	for ( SourceList::const_iterator i = sources.begin(); i != sources.end(); ++i )
+		{
+		SourceStats s;
+		s.polled = (*i)->polled;
+		s.ready = (*i)->ready;
+		stats->push_back(std::make_pair(std::string((*i)->src->Tag()), s));
+		}
+	}
+
+static void add_fds(Poller* poller, const FD_Set& fds, int events,
+		    void* cookie, bool report)
+	{
+	for ( FD_Set::const_iterator i = fds.begin(); i != fds.end(); ++i )
+		poller->Add(*i, events, cookie, report);
+	}
+
+void Manager::Source::AddFds(Poller* poller, bool report) const
 	{
-	*maxx = std::max(*maxx, fd_read.Set(read));
-	*maxx = std::max(*maxx, fd_write.Set(write));
-	*maxx = std::max(*maxx, fd_except.Set(except));
+	void* cookie = const_cast<Source*>(this);
+	add_fds(poller, fd_read, Poller::READ, cookie, report);
+	add_fds(poller, fd_write, Poller::WRITE, cookie, report);
+	add_fds(poller, fd_except, Poller::EXCEPT, cookie, report);
 	}
@@ -5,7 +5,10 @@
 
 #include <string>
 #include <list>
+#include <vector>
 #include "iosource/FD_Set.h"
+#include "iosource/Poller.h"
+#include "util.h"
 
 namespace iosource {
 
@@ -67,6 +70,31 @@ public:
 	 */
 	const PktSrcList& GetPktSrcs() const	{ return pkt_srcs; }
 
+	/**
+	 * Statistics about how often a source had input when we waited on
+	 * its file descriptors.
+	 */
+	struct SourceStats {
+		uint64 polled;	///< Number of waits while the source was idle.
+		uint64 ready;	///< Number of those that reported it ready.
+	};
+
+	typedef std::list<std::pair<std::string, SourceStats> > source_stats_list;
+
+	/**
+	 * Returns the readiness statistics of all registered sources, along
+	 * with their tags.
+	 *
+	 * @param stats A list to append the statistics to.
+	 */
+	void GetSourceStats(source_stats_list* stats) const;
+
+	/**
+	 * Returns the name of the mechanism used to wait on the sources'
+	 * file descriptors, like "epoll" or "select".
+	 */
+	const char* PollBackend() const	{ return poller.Backend(); }
+
 	/**
 	 * Terminate all processing immediately by removing all sources (and
 	 * therefore now returning a Size() of zero).
@@ -99,7 +127,8 @@ public:
 private:
 	/**
 	 * When looking for a source with something to process, every
-	 * SELECT_FREQUENCY calls we will go ahead and block on a select().
+	 * SELECT_FREQUENCY calls we will go ahead and wait on the sources'
+	 * file descriptors.
 	 */
 	static const int SELECT_FREQUENCY = 25;
 
@@ -120,13 +149,10 @@ private:
 		FD_Set fd_write;
 		FD_Set fd_except;
 		bool dont_count;
+		uint64 polled;
+		uint64 ready;
 
-		bool Ready(fd_set* read, fd_set* write, fd_set* except) const
-			{ return fd_read.Ready(read) || fd_write.Ready(write) ||
-			         fd_except.Ready(except); }
-
-		void SetFds(fd_set* read, fd_set* write, fd_set* except,
-		            int* maxx) const;
+		void AddFds(Poller* poller, bool report) const;
 
 		void Clear()
 			{ fd_read.Clear(); fd_write.Clear(); fd_except.Clear(); }
@@ -139,6 +165,9 @@ private:
 
 	PktSrcList pkt_srcs;
 	PktDumperList pkt_dumpers;
+
+	Poller poller;
+	std::vector<void*> ready;
 };
 
 }
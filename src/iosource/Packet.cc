@@ -17,13 +17,22 @@ extern "C" {
 
 void Packet::Init(int arg_link_type, struct timeval *arg_ts, uint32 arg_caplen,
 		  uint32 arg_len, const u_char *arg_data, int arg_copy,
-		  std::string arg_tag)
+		  std::string arg_tag, bool ts_nanos)
 	{
 	if ( data && copy )
 		delete [] data;
 
 	link_type = arg_link_type;
 	ts = *arg_ts;
+
+	int64 nsecs = ts.tv_usec;
+
+	if ( ts_nanos )
+		ts.tv_usec /= 1000;
+	else
+		nsecs *= 1000;
+
+	time_ns = int64(ts.tv_sec) * 1000000000 + nsecs;
 	cap_len = arg_caplen;
 	len = arg_len;
 	tag = arg_tag;
@@ -38,12 +47,19 @@ void Packet::Init(int arg_link_type, struct timeval *arg_ts, uint32 arg_caplen,
 	else
 		data = arg_data;
 
-	time = ts.tv_sec + double(ts.tv_usec) / 1e6;
+	if ( ts_nanos )
+		time = ts.tv_sec + double(nsecs) / 1e9;
+	else
+		time = ts.tv_sec + double(ts.tv_usec) / 1e6;
 	hdr_size = GetLinkHeaderSize(arg_link_type);
 	l3_proto = L3_UNKNOWN;
 	eth_type = 0;
 	vlan = 0;
 	inner_vlan = 0;
+	conn_hash = 0;
+	conn_hash_valid = false;
+	conn_proto = 0;
+	checksums_verified = false;
 	l2_src = 0;
 	l2_dst = 0;
 
@@ -519,12 +535,12 @@ RecordVal* Packet::BuildPktHdrVal() const
 		l2_hdr->Assign(4, FmtEUI48(data));  	// dst
 
 		if ( vlan )
-			l2_hdr->Assign(5, new Val(vlan, TYPE_COUNT));
+			l2_hdr->Assign(5, val_mgr->GetCount(vlan));
 
 		if ( inner_vlan )
-			l2_hdr->Assign(6, new Val(inner_vlan, TYPE_COUNT));
+			l2_hdr->Assign(6, val_mgr->GetCount(inner_vlan));
 
-		l2_hdr->Assign(7, new Val(eth_type, TYPE_COUNT));
+		l2_hdr->Assign(7, val_mgr->GetCount(eth_type));
 
 		if ( eth_type == ETHERTYPE_ARP || eth_type == ETHERTYPE_REVARP )
 			// We also identify ARP for L3 over ethernet
@@ -533,8 +549,8 @@ RecordVal* Packet::BuildPktHdrVal() const
 	else
 		l2_hdr->Assign(0, new EnumVal(BifEnum::LINK_UNKNOWN, BifType::Enum::link_encap));
 
-	l2_hdr->Assign(1, new Val(len, TYPE_COUNT));
-	l2_hdr->Assign(2, new Val(cap_len, TYPE_COUNT));
+	l2_hdr->Assign(1, val_mgr->GetCount(len));
+	l2_hdr->Assign(2, val_mgr->GetCount(cap_len));
 
 	l2_hdr->Assign(8, new EnumVal(l3, BifType::Enum::layer3_proto));
 
@@ -47,13 +47,17 @@ public:
 	 *
 	 * @param tag A textual tag to associate with the packet for
 	 * differentiating the input streams.
+	 *
+	 * @param ts_nanos If true, the *tv_usec* field of *ts* holds
+	 * nanoseconds rather than microseconds, as libpcap returns them
+	 * when asked for nanosecond precision.
 	 */
 	Packet(int link_type, struct timeval *ts, uint32 caplen,
 	       uint32 len, const u_char *data, int copy = false,
-	       std::string tag = std::string(""))
+	       std::string tag = std::string(""), bool ts_nanos = false)
 	           : data(0), l2_src(0), l2_dst(0)
 	       {
-	       Init(link_type, ts, caplen, len, data, copy, tag);
+	       Init(link_type, ts, caplen, len, data, copy, tag, ts_nanos);
 	       }
 
 	/**
@@ -95,10 +99,14 @@ public:
 	 *
 	 * @param tag A textual tag to associate with the packet for
 	 * differentiating the input streams.
+	 *
+	 * @param ts_nanos If true, the *tv_usec* field of *ts* holds
+	 * nanoseconds rather than microseconds, as libpcap returns them
+	 * when asked for nanosecond precision.
 	 */
 	void Init(int link_type, struct timeval *ts, uint32 caplen,
 		uint32 len, const u_char *data, int copy = false,
-		std::string tag = std::string(""));
+		std::string tag = std::string(""), bool ts_nanos = false);
 
 	/**
 	 * Returns true if parsing the layer 2 fields failed, including when
@@ -155,7 +163,8 @@ public:
 	// These are passed in through the constructor.
 	std::string tag;		/// Used in serialization
 	double time;			/// Timestamp reconstituted as float
-	struct timeval ts;		/// Capture timestamp
+	struct timeval ts;		/// Capture timestamp, to the microsecond
+	int64 time_ns;			/// Capture timestamp in nanoseconds since the epoch
 	const u_char* data;		/// Packet data.
 	uint32 len;			/// Actual length on wire
 	uint32 cap_len;			/// Captured packet length
@@ -204,6 +213,32 @@ public:
 	 */
 	uint32 inner_vlan;
 
+	/**
+	 * Hash of the packet's connection key, if NetSessions::Prefetch()
+	 * has classified the packet ahead of processing it. Valid iff
+	 * conn_hash_valid is true.
+	 */
+	hash_t conn_hash;
+
+	/**
+	 * True if conn_hash is set.
+	 */
+	bool conn_hash_valid;
+
+	/**
+	 * The transport protocol that conn_hash is for, either \c
+	 * IPPROTO_TCP or \c IPPROTO_UDP. Valid iff conn_hash_valid is true.
+	 */
+	int conn_proto;
+
+	/**
+	 * True if the network card has already verified the packet's IP
+	 * and transport checksums, so that there's no need to compute them
+	 * again. Packet sources that learn this from the capture (e.g., from
+	 * checksum offloading flags) set it after Init(), which resets it.
+	 */
+	bool checksums_verified;
+
 private:
 	// Calculate layer 2 attributes. Sets
 	void ProcessLayer2();
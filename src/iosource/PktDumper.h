@@ -54,6 +54,13 @@ public:
 	 */
 	int HdrSize() const;
 
+	/**
+	 * Returns true if a thread writes out the dumper's packets. Such a
+	 * dumper must not be used from a signal handler, as the code that
+	 * got interrupted may hold the thread's lock.
+	 */
+	virtual bool WritesBehind() const	{ return false; }
+
 	/**
 	 * Writes a packet to the dumper.
 	 *
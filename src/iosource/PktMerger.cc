@@ -0,0 +1,117 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include "PktMerger.h"
+#include "PktSrc.h"
+#include "util.h"
+
+using namespace iosource;
+
+PktMerger::PktMerger(double arg_skew)
+	{
+	skew = arg_skew;
+	newest = released = 0;
+	seq = 0;
+	SetIdle(true);
+	}
+
+PktMerger::~PktMerger()
+	{
+	while ( ! queue.empty() )
+		{
+		delete queue.top().pkt;
+		queue.pop();
+		}
+	}
+
+void PktMerger::AddSource(PktSrc* src)
+	{
+	sources[src] = 0;
+	src->SetMerger(this);
+	}
+
+void PktMerger::Add(PktSrc* src, const Packet& pkt)
+	{
+	++stats.merged;
+
+	if ( pkt.time < released )
+		++stats.late;
+
+	else if ( pkt.time < newest )
+		++stats.reordered;
+
+	if ( pkt.time > newest )
+		newest = pkt.time;
+
+	double& last = sources[src];
+
+	if ( pkt.time > last )
+		last = pkt.time;
+
+	double now = current_time(true);
+
+	struct timeval ts = pkt.ts;
+
+	Entry e;
+	e.ts = pkt.time;
+	e.seq = seq++;
+	e.arrival = now;
+	e.pkt = new Packet(pkt.link_type, &ts, pkt.cap_len, pkt.len,
+			   pkt.data, true, pkt.tag);
+	e.src = src;
+	queue.push(e);
+
+	if ( queue.size() > stats.max_buffered )
+		stats.max_buffered = queue.size();
+
+	Release(now);
+	}
+
+bool PktMerger::Releasable(const Entry& e, double now) const
+	{
+	if ( e.ts <= newest - skew || now - e.arrival >= skew ||
+	     queue.size() > MAX_BUFFERED )
+		return true;
+
+	// Otherwise it can go only once all the sources are past it, as
+	// each delivers its packets in order.
+	for ( source_map::const_iterator i = sources.begin();
+	      i != sources.end(); ++i )
+		{
+		if ( i->second < e.ts && i->first->IsOpen() )
+			return false;
+		}
+
+	return true;
+	}
+
+void PktMerger::Release(double now)
+	{
+	while ( ! queue.empty() && Releasable(queue.top(), now) )
+		{
+		Entry e = queue.top();
+		queue.pop();
+
+		if ( e.ts > released )
+			released = e.ts;
+
+		e.src->DispatchMerged(e.pkt);
+		delete e.pkt;
+		}
+
+	SetIdle(queue.empty());
+	}
+
+double PktMerger::NextTimestamp(double* network_time)
+	{
+	if ( queue.empty() || ! Releasable(queue.top(), current_time(true)) )
+		return -1.0;
+
+	return queue.top().ts;
+	}
+
+void PktMerger::Process()
+	{
+	Release(current_time(true));
+	}
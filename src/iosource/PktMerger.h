@@ -0,0 +1,138 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef IOSOURCE_PKTSRC_PKTMERGER_H
+#define IOSOURCE_PKTSRC_PKTMERGER_H
+
+#include <map>
+#include <queue>
+#include <vector>
+
+#include "IOSource.h"
+#include "Packet.h"
+
+namespace iosource {
+
+class PktSrc;
+
+/**
+ * Puts the packets of several live sources into timestamp order. When
+ * capturing from, e.g., both directions of a tap on separate interfaces,
+ * the kernel delivers each direction with its own delay, so picking the
+ * source with the soonest pending packet still reorders packets that are
+ * close to each other in time. The merger instead holds back the
+ * sources' packets in a min-heap for a short while, up to a given skew,
+ * and releases them in order.
+ *
+ * A packet leaves the merger once no source can deliver an earlier one
+ * anymore: when each of them has been seen with that timestamp or a
+ * later one, when a packet that much later than the skew has arrived, or
+ * when it's been waiting for the skew in real time.
+ */
+class PktMerger : public IOSource {
+public:
+	/**
+	 * Statistics on the merged packets.
+	 */
+	struct Stats {
+		/**
+		 * Packets that passed through the merger.
+		 */
+		uint64 merged;
+
+		/**
+		 * Packets that arrived after one with a later timestamp from
+		 * another source, and that the merger put back into order.
+		 */
+		uint64 reordered;
+
+		/**
+		 * Packets that arrived after the merger had already released
+		 * a later one, which it hence couldn't put back into order.
+		 */
+		uint64 late;
+
+		/**
+		 * Largest number of packets waiting at the same time.
+		 */
+		uint64 max_buffered;
+
+		Stats()	{ merged = reordered = late = max_buffered = 0; }
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param skew The most that the sources' timestamps may differ by
+	 * for the merger to still put them into order.
+	 */
+	PktMerger(double skew);
+
+	/**
+	 * Destructor. Packets still waiting don't get dispatched anymore.
+	 */
+	virtual ~PktMerger();
+
+	/**
+	 * Adds a source to merge. Its packets then come here, rather than
+	 * going to processing right away.
+	 */
+	void AddSource(PktSrc* src);
+
+	/**
+	 * Queues a copy of a source's packet, and releases those that are
+	 * due.
+	 */
+	void Add(PktSrc* src, const Packet& pkt);
+
+	/**
+	 * Returns statistics on the merged packets so far.
+	 */
+	void Statistics(Stats* s) const	{ *s = stats; }
+
+	// IOSource interface.
+	virtual void GetFds(FD_Set* read, FD_Set* write, FD_Set* except)	{ }
+	virtual double NextTimestamp(double* network_time);
+	virtual void Process();
+	virtual const char* Tag()	{ return "PktMerger"; }
+
+private:
+	// Upper bound on how many packets may wait, in case the real time
+	// condition never holds.
+	static const size_t MAX_BUFFERED = 65536;
+
+	struct Entry {
+		double ts;
+		uint64 seq;	// for keeping equal timestamps in order
+		double arrival;	// in real time
+		Packet* pkt;
+		PktSrc* src;
+	};
+
+	struct Later {
+		bool operator()(const Entry& a, const Entry& b) const
+			{ return a.ts != b.ts ? a.ts > b.ts : a.seq > b.seq; }
+	};
+
+	bool Releasable(const Entry& e, double now) const;
+
+	// Dispatches the packets that are due.
+	void Release(double now);
+
+	double skew;
+
+	std::priority_queue<Entry, std::vector<Entry>, Later> queue;
+
+	// The latest timestamp seen from each source.
+	typedef std::map<PktSrc*, double> source_map;
+	source_map sources;
+
+	double newest;	// latest timestamp of all
+	double released;	// latest timestamp released
+	uint64 seq;
+
+	Stats stats;
+};
+
+}
+
+#endif
@@ -1,6 +1,7 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <errno.h>
+#include <signal.h>
 #include <sys/stat.h>
 
 #include "bro-config.h"
@@ -10,6 +11,9 @@
 #include "Hash.h"
 #include "Net.h"
 #include "Sessions.h"
+#include "Var.h"
+#include "Manager.h"
+#include "PktMerger.h"
 
 #include "pcap/pcap.bif.h"
 
@@ -29,6 +33,12 @@ PktSrc::PktSrc()
 	errbuf = "";
 	SetClosed(true);
 
+	batch = 0;
+	batch_size = -1;
+	batch_len = batch_next = 0;
+	batch_packet = 0;
+	merger = 0;
+
 	next_sync_point = 0;
 	first_timestamp = 0.0;
 	current_pseudo = 0.0;
@@ -39,6 +49,8 @@ PktSrc::~PktSrc()
 	{
 	for ( auto code : filters )
 		delete code;
+
+	delete [] batch;
 	}
 
 const std::string& PktSrc::Path() const
@@ -222,6 +234,18 @@ double PktSrc::NextTimestamp(double* local_network_time)
 	if ( ! IsOpen() )
 		return -1.0;
 
+	if ( batch_next < batch_len )
+		{
+		// The rest of an interrupted batch comes first.
+		if ( net_is_processing_suspended() )
+			{
+			SetIdle(true);
+			return -1.0;
+			}
+
+		return batch[batch_next].time;
+		}
+
 	if ( ! ExtractNextPacketInternal() )
 		return -1.0;
 
@@ -244,12 +268,22 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
+	if ( batch_next < batch_len )
+		{
+		// We can't extract anything else before the batch is done.
+		DispatchBatch();
+		return;
+		}
+
 	if ( ! ExtractNextPacketInternal() )
 		return;
 
 	if ( current_packet.Layer2Valid() )
 		{
-		if ( pseudo_realtime )
+		if ( merger )
+			merger->Add(this, current_packet);
+
+		else if ( pseudo_realtime )
 			{
 			current_pseudo = CheckPseudoTime();
 			net_packet_dispatch(current_pseudo, &current_packet, this);
@@ -263,6 +297,115 @@ void PktSrc::Process()
 
 	have_packet = 0;
 	DoneWithPacket();
+
+	ProcessBatch();
+	}
+
+void PktSrc::ProcessBatch()
+	{
+	if ( batch_size < 0 )
+		{
+		batch_size = BifConst::packet_batch_size;
+
+		// Minus the one already processed.
+		if ( batch_size > 1 )
+			batch = new Packet[batch_size - 1];
+		}
+
+	if ( ! batch || ! IsOpen() )
+		return;
+
+	// The packets need to be interleaved with any other packet source,
+	// and we can't batch at all when we need to delay packets.
+	if ( pseudo_realtime || net_is_processing_suspended() ||
+	     iosource_mgr->GetPktSrcs().size() > 1 )
+		return;
+
+	int n = ExtractNextPackets(batch, batch_size - 1);
+
+	if ( n <= 0 )
+		return;
+
+	batch_len = n;
+	batch_next = 0;
+
+	// Classifying the whole batch first starts all of its lookups into
+	// the connection tables, whose entries then arrive in the cache in
+	// parallel. That leaves fetching the connections themselves, which
+	// needs the entries, so we do that a few packets ahead of the one
+	// we're dispatching.
+	for ( int i = 0; i < n; ++i )
+		sessions->Prefetch(&batch[i]);
+
+	for ( int i = 0; i < n && i < PREFETCH_DISTANCE; ++i )
+		sessions->PrefetchConnection(&batch[i]);
+
+	DispatchBatch();
+	}
+
+void PktSrc::DispatchBatch()
+	{
+	while ( batch_next < batch_len )
+		{
+		// Any of the packets may have triggered these, and we then
+		// need to stop just as if we were going one packet at a time.
+		// A termination request shows up as the signal first, which
+		// net_run() acts on once we return.
+		if ( terminating || signal_val == SIGTERM || signal_val == SIGINT )
+			{
+			// The rest won't be needed anymore.
+			batch_next = batch_len;
+			break;
+			}
+
+		if ( net_is_processing_suspended() )
+			{
+			// We'll continue with batch_next once resumed.
+			batch_packet = 0;
+			return;
+			}
+
+		int i = batch_next++;
+		Packet* pkt = &batch[i];
+
+		if ( i + PREFETCH_DISTANCE < batch_len )
+			sessions->PrefetchConnection(&batch[i + PREFETCH_DISTANCE]);
+
+		if ( pkt->time < 0 )
+			{
+			Weird("negative_packet_timestamp", pkt);
+			continue;
+			}
+
+		if ( ! pkt->Layer2Valid() )
+			continue;
+
+		batch_packet = pkt;
+		net_packet_dispatch(pkt->time, pkt, this);
+		}
+
+	batch_packet = 0;
+	DoneWithPackets(batch_len);
+	batch_len = batch_next = 0;
+	}
+
+void PktSrc::DispatchMerged(const Packet* pkt)
+	{
+	// Reuses the batch's mechanism for making it the current packet.
+	const Packet* old = batch_packet;
+	batch_packet = pkt;
+	net_packet_dispatch(pkt->time, pkt, this);
+	batch_packet = old;
+	}
+
+int PktSrc::ExtractNextPackets(Packet* pkts, int max)
+	{
+	return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithPackets(int num)
+	{
+	DoneWithPacket();
 	}
 
 const char* PktSrc::Tag()
@@ -379,6 +522,12 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr *hdr, const u_ch
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	{
+	if ( batch_packet )
+		{
+		*pkt = batch_packet;
+		return true;
+		}
+
 	if ( ! have_packet )
 		return false;
 
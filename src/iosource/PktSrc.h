@@ -12,8 +12,12 @@
 
 declare(PDict,BPF_Program);
 
+struct ConnID;
+
 namespace iosource {
 
+class PktMerger;
+
 /**
  * Base class for packet sources.
  */
@@ -170,6 +174,23 @@ public:
 	 */
 	bool GetCurrentPacket(const Packet** hdr);
 
+	/**
+	 * Makes the source pass its packets on to a merger, which puts them
+	 * into order with those of other sources, rather than dispatching
+	 * them right away.
+	 *
+	 * @param m The merger, which must stay around as long as the source.
+	 */
+	void SetMerger(PktMerger* m)	{ merger = m; }
+
+	/**
+	 * Dispatches a packet of this source that a merger had been holding
+	 * back. While it's being processed, it's the current packet.
+	 *
+	 * @param pkt The packet.
+	 */
+	void DispatchMerged(const Packet* pkt);
+
 	// PacketSource interace for derived classes to override.
 
 	/**
@@ -212,6 +233,26 @@ public:
 	 */
 	virtual void Statistics(Stats* stats) = 0;
 
+	/**
+	 * Asks the source to stop delivering a flow's packets, if it can,
+	 * such as by installing a bypass rule into the kernel or the NIC.
+	 * Bro calls this when a connection gets bypassed; packets that
+	 * still arrive for it get discarded right after the connection
+	 * lookup either way.
+	 *
+	 * Derived classes may override this method. The default
+	 * implementation does nothing.
+	 *
+	 * @param id The flow's addresses and ports, the latter in network
+	 * byte order, with the originator as source.
+	 *
+	 * @param proto The flow's transport protocol.
+	 *
+	 * @return True if the source took care of the flow.
+	 */
+	virtual bool BypassFlow(const ConnID& id, TransportProto proto)
+		{ return false; }
+
 protected:
 	friend class Manager;
 
@@ -341,6 +382,41 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides a batch of subsequent packets from the source at once.
+	 * When batching is enabled via \a packet_batch_size, Bro uses this
+	 * to process a burst of packets following the one returned by \a
+	 * ExtractNextPacket() without returning to the main loop's source
+	 * selection in between.
+	 *
+	 * Derived classes may override this method if they can return
+	 * multiple packets more efficiently than one at a time. The
+	 * default implementation returns a single packet via \a
+	 * ExtractNextPacket().
+	 *
+	 * @param pkts An array of packet structures to fill in, in the
+	 * order of the packets. The callee keeps ownership of the data but
+	 * must guarantee that it stays available at least until \a
+	 * DoneWithPackets() is called. It is guaranteed that there's no
+	 * other extraction between this call and \a DoneWithPackets().
+	 *
+	 * @param max The maximum number of packets to return; at least 1.
+	 *
+	 * @return The number of packets filled in. Zero if no packet is
+	 * available or an error occured (which must be flagged via
+	 * Error()).
+	 */
+	virtual int ExtractNextPackets(Packet* pkts, int max);
+
+	/**
+	 * Signals that the data of the packets previously extracted with
+	 * \a ExtractNextPackets() will no longer be needed. The default
+	 * implementation calls \a DoneWithPacket().
+	 *
+	 * @param num The number of packets that the batch contained.
+	 */
+	virtual void DoneWithPackets(int num);
+
 private:
 	// Checks if the current packet has a pseudo-time <= current_time. If
 	// yes, returns pseudo-time, otherwise 0.
@@ -349,6 +425,14 @@ private:
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Dispatches a batch of further packets, if batching is enabled.
+	void ProcessBatch();
+
+	// Dispatches the packets of the current batch, starting with
+	// batch_next. Stops early if processing gets suspended, leaving the
+	// rest for later, or if Bro is terminating.
+	void DispatchBatch();
+
 	// IOSource interface implementation.
 	virtual void Init();
 	virtual void Done();
@@ -363,6 +447,19 @@ private:
 	bool have_packet;
 	Packet current_packet;
 
+	// For batch processing.
+	Packet* batch;	// Allocated on first use.
+	int batch_size;
+	int batch_len;	// Number of packets in the current batch.
+	int batch_next;	// Next one of them to dispatch.
+	const Packet* batch_packet;	// The one currently being dispatched.
+
+	// How many packets of a batch ProcessBatch() fetches the
+	// connections for ahead of the one it's dispatching.
+	static const int PREFETCH_DISTANCE = 4;
+
+	PktMerger* merger;	// Where our packets go, if not null.
+
 	// For BPF filtering support.
 	std::vector<BPF_Program *> filters;
 
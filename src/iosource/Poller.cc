@@ -0,0 +1,473 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#elif defined(HAVE_KQUEUE)
+#include <sys/event.h>
+#endif
+
+#include <algorithm>
+
+#include "Poller.h"
+#include "Reporter.h"
+
+using namespace iosource;
+
+Poller::Poller()
+	{
+	backend = SELECT;
+	kfd = -1;
+	num_reporting = 0;
+
+#ifdef HAVE_EPOLL
+	kfd = epoll_create(64);
+
+	if ( kfd >= 0 )
+		backend = EPOLL;
+#elif defined(HAVE_KQUEUE)
+	kfd = kqueue();
+
+	if ( kfd >= 0 )
+		backend = KQUEUE;
+#endif
+
+	if ( kfd >= 0 )
+		fcntl(kfd, F_SETFD, FD_CLOEXEC);
+	}
+
+Poller::~Poller()
+	{
+	if ( kfd >= 0 )
+		close(kfd);
+	}
+
+const char* Poller::Backend() const
+	{
+	switch ( backend ) {
+	case EPOLL:	return "epoll";
+	case KQUEUE:	return "kqueue";
+	default:	return "select";
+	}
+	}
+
+void Poller::Clear()
+	{
+	interest.clear();
+	num_reporting = 0;
+	}
+
+void Poller::Add(int fd, int events, void* cookie, bool report)
+	{
+	if ( fd < 0 || ! events )
+		return;
+
+	interest_map::iterator it = interest.find(fd);
+
+	if ( it == interest.end() )
+		{
+		Interest n;
+		n.events = 0;
+		n.owner = cookie;
+		it = interest.insert(std::make_pair(fd, n)).first;
+		}
+
+	Interest& i = it->second;
+	i.events |= events;
+
+	if ( report )
+		{
+		i.cookies.push_back(std::make_pair(cookie, events));
+		++num_reporting;
+		}
+	}
+
+void Poller::Forget(void* cookie)
+	{
+	// If the descriptors are still open, the next registration finds
+	// them in the kernel and updates them instead.
+	for ( registration_map::iterator r = registered.begin();
+	      r != registered.end(); )
+		{
+		if ( r->second.owner == cookie )
+			registered.erase(r++);
+		else
+			++r;
+		}
+
+	for ( owner_map::iterator a = always_ready.begin();
+	      a != always_ready.end(); )
+		{
+		if ( a->second == cookie )
+			always_ready.erase(a++);
+		else
+			++a;
+		}
+	}
+
+void Poller::Collect(int fd, int events, std::vector<void*>* ready)
+	{
+	interest_map::const_iterator i = interest.find(fd);
+
+	if ( i == interest.end() )
+		return;
+
+	for ( size_t j = 0; j < i->second.cookies.size(); ++j )
+		{
+		void* cookie = i->second.cookies[j].first;
+
+		if ( (i->second.cookies[j].second & events) &&
+		     std::find(ready->begin(), ready->end(), cookie) == ready->end() )
+			ready->push_back(cookie);
+		}
+	}
+
+void Poller::Wait(const struct timeval& timeout, std::vector<void*>* ready)
+	{
+	if ( backend == SELECT )
+		WaitSelect(timeout, ready);
+	else
+		WaitKernel(timeout, ready);
+	}
+
+void Poller::WaitSelect(const struct timeval& timeout, std::vector<void*>* ready)
+	{
+	fd_set fd_read, fd_write, fd_except;
+
+	FD_ZERO(&fd_read);
+	FD_ZERO(&fd_write);
+	FD_ZERO(&fd_except);
+
+	int maxx = -1;
+
+	for ( interest_map::const_iterator i = interest.begin();
+	      i != interest.end(); ++i )
+		{
+		int fd = i->first;
+
+		if ( fd >= FD_SETSIZE )
+			{
+			static bool warned = false;
+
+			if ( ! warned )
+				{
+				reporter->Warning("file descriptor %d exceeds FD_SETSIZE, not watching it", fd);
+				warned = true;
+				}
+
+			continue;
+			}
+
+		if ( i->second.events & READ )
+			FD_SET(fd, &fd_read);
+
+		if ( i->second.events & WRITE )
+			FD_SET(fd, &fd_write);
+
+		if ( i->second.events & EXCEPT )
+			FD_SET(fd, &fd_except);
+
+		maxx = std::max(maxx, fd);
+		}
+
+	if ( maxx < 0 )
+		return;
+
+	struct timeval tv = timeout;
+
+	if ( select(maxx + 1, &fd_read, &fd_write, &fd_except, &tv) <= 0 )
+		return;
+
+	for ( interest_map::const_iterator i = interest.begin();
+	      i != interest.end() && i->first <= maxx; ++i )
+		{
+		int fd = i->first;
+		int events = 0;
+
+		if ( FD_ISSET(fd, &fd_read) )
+			events |= READ;
+
+		if ( FD_ISSET(fd, &fd_write) )
+			events |= WRITE;
+
+		if ( FD_ISSET(fd, &fd_except) )
+			events |= EXCEPT;
+
+		if ( events )
+			Collect(fd, events, ready);
+		}
+	}
+
+void Poller::Sync()
+	{
+	for ( interest_map::const_iterator i = interest.begin();
+	      i != interest.end(); ++i )
+		{
+		int fd = i->first;
+		int events = i->second.events;
+		void* owner = i->second.owner;
+
+		owner_map::iterator a = always_ready.find(fd);
+
+		if ( a != always_ready.end() )
+			{
+			if ( a->second == owner )
+				continue;
+
+			// Someone else's now, so it may be watchable.
+			always_ready.erase(a);
+			}
+
+		registration_map::iterator r = registered.find(fd);
+		int old_events = 0;
+
+		// If the number now belongs to someone else, the old
+		// descriptor got closed, which took it out of the kernel's
+		// set. The interest may look the same, but the new one still
+		// needs adding.
+		if ( r != registered.end() && r->second.owner == owner )
+			old_events = r->second.events;
+
+		if ( old_events == events )
+			continue;
+
+		if ( Register(fd, old_events, events) )
+			{
+			Registration reg = { events, owner };
+			registered[fd] = reg;
+			}
+		else
+			{
+			if ( r != registered.end() )
+				registered.erase(r);
+
+			always_ready[fd] = owner;
+			}
+		}
+
+	// Drop whatever isn't of interest anymore.
+	for ( registration_map::iterator r = registered.begin();
+	      r != registered.end(); )
+		{
+		if ( interest.find(r->first) != interest.end() )
+			{
+			++r;
+			continue;
+			}
+
+		Register(r->first, r->second.events, 0);
+		registered.erase(r++);
+		}
+
+	for ( owner_map::iterator a = always_ready.begin();
+	      a != always_ready.end(); )
+		{
+		if ( interest.find(a->first) == interest.end() )
+			always_ready.erase(a++);
+		else
+			++a;
+		}
+	}
+
+#ifdef HAVE_EPOLL
+
+static uint32_t to_epoll(int events)
+	{
+	uint32_t e = 0;
+
+	if ( events & Poller::READ )
+		e |= EPOLLIN;
+
+	if ( events & Poller::WRITE )
+		e |= EPOLLOUT;
+
+	if ( events & Poller::EXCEPT )
+		e |= EPOLLPRI;
+
+	return e;
+	}
+
+bool Poller::Register(int fd, int old_events, int new_events)
+	{
+	struct epoll_event ev;
+	ev.events = to_epoll(new_events);
+	ev.data.fd = fd;
+
+	if ( ! new_events )
+		{
+		// Errors don't matter here, as the kernel drops closed
+		// descriptors by itself.
+		epoll_ctl(kfd, EPOLL_CTL_DEL, fd, &ev);
+		return true;
+		}
+
+	// Our view of what's registered may be stale if a descriptor got
+	// closed and reused in between, so we retry the other operation.
+	int op = old_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	if ( epoll_ctl(kfd, op, fd, &ev) == 0 )
+		return true;
+
+	if ( (op == EPOLL_CTL_MOD && errno == ENOENT) ||
+	     (op == EPOLL_CTL_ADD && errno == EEXIST) )
+		{
+		op = (op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+
+		if ( epoll_ctl(kfd, op, fd, &ev) == 0 )
+			return true;
+		}
+
+	// EPERM for regular files and the like.
+	return false;
+	}
+
+void Poller::WaitKernel(const struct timeval& timeout, std::vector<void*>* ready)
+	{
+	Sync();
+
+	int timeout_ms = timeout.tv_sec * 1000 + (timeout.tv_usec + 999) / 1000;
+
+	if ( ! always_ready.empty() )
+		{
+		for ( owner_map::const_iterator a = always_ready.begin();
+		      a != always_ready.end(); ++a )
+			Collect(a->first, READ | WRITE | EXCEPT, ready);
+
+		timeout_ms = 0;
+		}
+
+	if ( registered.empty() )
+		return;
+
+	int max_events = registered.size();
+	events_buf.resize(max_events * sizeof(struct epoll_event));
+	struct epoll_event* evs = (struct epoll_event*) &events_buf[0];
+
+	int n = epoll_wait(kfd, evs, max_events, timeout_ms);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		int events = 0;
+
+		// Same as select(), we report errors as readable and
+		// writable.
+		if ( evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) )
+			events |= READ;
+
+		if ( evs[i].events & (EPOLLOUT | EPOLLERR) )
+			events |= WRITE;
+
+		if ( evs[i].events & EPOLLPRI )
+			events |= EXCEPT;
+
+		Collect(evs[i].data.fd, events, ready);
+		}
+	}
+
+#elif defined(HAVE_KQUEUE)
+
+// kqueue has no notion of exceptional conditions; we approximate them
+// with readability, which out-of-band data implies.
+static int kq_filters(int events)
+	{
+	int f = 0;
+
+	if ( events & (Poller::READ | Poller::EXCEPT) )
+		f |= Poller::READ;
+
+	if ( events & Poller::WRITE )
+		f |= Poller::WRITE;
+
+	return f;
+	}
+
+static bool kq_change(int kfd, int fd, int16_t filter, uint16_t flags)
+	{
+	struct kevent ch;
+	EV_SET(&ch, fd, filter, flags, 0, 0, 0);
+	return kevent(kfd, &ch, 1, 0, 0, 0) == 0;
+	}
+
+bool Poller::Register(int fd, int old_events, int new_events)
+	{
+	int old_f = kq_filters(old_events);
+	int new_f = kq_filters(new_events);
+
+	if ( (old_f & READ) && ! (new_f & READ) )
+		kq_change(kfd, fd, EVFILT_READ, EV_DELETE);
+
+	if ( (old_f & WRITE) && ! (new_f & WRITE) )
+		kq_change(kfd, fd, EVFILT_WRITE, EV_DELETE);
+
+	// Adding an existing filter just updates it, so we don't need to
+	// care about stale registrations here.
+	if ( (new_f & READ) && ! kq_change(kfd, fd, EVFILT_READ, EV_ADD) )
+		return false;
+
+	if ( (new_f & WRITE) && ! kq_change(kfd, fd, EVFILT_WRITE, EV_ADD) )
+		return false;
+
+	return true;
+	}
+
+void Poller::WaitKernel(const struct timeval& timeout, std::vector<void*>* ready)
+	{
+	Sync();
+
+	struct timespec ts;
+	ts.tv_sec = timeout.tv_sec;
+	ts.tv_nsec = timeout.tv_usec * 1000;
+
+	if ( ! always_ready.empty() )
+		{
+		for ( owner_map::const_iterator a = always_ready.begin();
+		      a != always_ready.end(); ++a )
+			Collect(a->first, READ | WRITE | EXCEPT, ready);
+
+		ts.tv_sec = ts.tv_nsec = 0;
+		}
+
+	if ( registered.empty() )
+		return;
+
+	// Up to two filters per descriptor.
+	int max_events = 2 * registered.size();
+	events_buf.resize(max_events * sizeof(struct kevent));
+	struct kevent* evs = (struct kevent*) &events_buf[0];
+
+	int n = kevent(kfd, 0, 0, evs, max_events, &ts);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		int events = 0;
+
+		if ( evs[i].filter == EVFILT_READ )
+			events = READ | EXCEPT;
+
+		else if ( evs[i].filter == EVFILT_WRITE )
+			events = WRITE;
+
+		Collect(evs[i].ident, events, ready);
+		}
+	}
+
+#else
+
+bool Poller::Register(int fd, int old_events, int new_events)
+	{
+	return false;
+	}
+
+void Poller::WaitKernel(const struct timeval& timeout, std::vector<void*>* ready)
+	{
+	WaitSelect(timeout, ready);
+	}
+
+#endif
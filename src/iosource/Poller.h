@@ -0,0 +1,137 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef IOSOURCE_POLLER_H
+#define IOSOURCE_POLLER_H
+
+#include <sys/time.h>
+
+#include <map>
+#include <vector>
+
+namespace iosource {
+
+/**
+ * Waits for a set of file descriptors to become ready. Where the OS
+ * supports it (epoll on Linux, kqueue on BSD/macOS), the descriptors stay
+ * registered with the kernel across calls and only changes to the
+ * interest set cost a system call. Otherwise, this falls back to
+ * select().
+ */
+class Poller {
+public:
+	/**
+	 * Events to wait for, and report, as a bit mask.
+	 */
+	enum { READ = 1, WRITE = 2, EXCEPT = 4 };
+
+	/**
+	 * Constructor. Picks the best backend available.
+	 */
+	Poller();
+
+	/**
+	 * Destructor.
+	 */
+	~Poller();
+
+	/**
+	 * Returns the name of the backend in use: "epoll", "kqueue", or
+	 * "select".
+	 */
+	const char* Backend() const;
+
+	/**
+	 * Starts collecting a new interest set for the next Wait().
+	 * Descriptors that don't get added again are unregistered then.
+	 */
+	void Clear();
+
+	/**
+	 * Adds interest in events of a file descriptor.
+	 *
+	 * @param fd The file descriptor.
+	 *
+	 * @param events A mask of READ, WRITE, and EXCEPT.
+	 *
+	 * @param cookie An opaque value identifying who the descriptor
+	 * belongs to, which Wait() reports when it becomes ready. If the
+	 * same number shows up with another cookie, it's taken to be a new
+	 * descriptor that needs registering anew.
+	 *
+	 * @param report If false, the descriptor just stays registered
+	 * without being reported.
+	 */
+	void Add(int fd, int events, void* cookie, bool report = true);
+
+	/**
+	 * Drops what's registered for a cookie that's going away, so that
+	 * a new one at the same address doesn't get taken for it.
+	 */
+	void Forget(void* cookie);
+
+	/**
+	 * Returns true if no descriptor to report has been added since the
+	 * last Clear().
+	 */
+	bool Empty() const	{ return ! num_reporting; }
+
+	/**
+	 * Waits for any of the descriptors added since the last Clear() to
+	 * become ready.
+	 *
+	 * @param timeout The maximum time to wait.
+	 *
+	 * @param ready A vector to which the cookies of all ready
+	 * descriptors are appended, each cookie only once.
+	 */
+	void Wait(const struct timeval& timeout, std::vector<void*>* ready);
+
+private:
+	enum BackendType { SELECT, EPOLL, KQUEUE };
+
+	struct Interest {
+		int events;
+		void* owner;	// the first cookie added
+		std::vector<std::pair<void*, int> > cookies;	// to report
+	};
+
+	struct Registration {
+		int events;
+		void* owner;
+	};
+
+	typedef std::map<int, Interest> interest_map;
+	typedef std::map<int, Registration> registration_map;
+	typedef std::map<int, void*> owner_map;
+
+	// Brings the kernel's registrations in line with the interest set.
+	void Sync();
+
+	// Updates the registration of a single descriptor. Returns false if
+	// the descriptor can't be watched by the backend.
+	bool Register(int fd, int old_events, int new_events);
+
+	// Appends the cookies interested in any of the events.
+	void Collect(int fd, int events, std::vector<void*>* ready);
+
+	void WaitSelect(const struct timeval& timeout, std::vector<void*>* ready);
+	void WaitKernel(const struct timeval& timeout, std::vector<void*>* ready);
+
+	BackendType backend;
+	int kfd;	// epoll or kqueue descriptor; -1 for select.
+	int num_reporting;
+
+	interest_map interest;
+	registration_map registered;
+
+	// Descriptors the kernel backend refuses to watch, like regular
+	// files, with their owners. Just like select(), we consider them
+	// always ready.
+	owner_map always_ready;
+
+	std::vector<char> events_buf;
+};
+
+}
+
+#endif
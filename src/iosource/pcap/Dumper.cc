@@ -2,69 +2,88 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
 
 #include "Dumper.h"
+#include "WriteBehind.h"
 #include "../PktSrc.h"
 #include "../../Net.h"
+#include "../../Metrics.h"
 
 #include "pcap.bif.h"
 
 using namespace iosource::pcap;
 
+uint64 PcapDumper::num_dropped = 0;
+
+static double dump_drops()
+	{
+	return PcapDumper::NumDropped();
+	}
+
+// The size of a trace file's header, and of each packet's.
+static const uint64 file_hdr_size = 24;
+static const uint64 pkt_hdr_size = 16;
+
 PcapDumper::PcapDumper(const std::string& path, bool arg_append)
 	{
 	append = arg_append;
 	props.path = path;
 	dumper = 0;
 	pd = 0;
+	write_behind = 0;
+	file_open_time = 0;
+	next_rotation = 0;
+	file_bytes = 0;
+	rotation_seq = 0;
+
+	static bool registered = false;
+
+	if ( ! registered )
+		{
+		registered = true;
+		metrics::registry()->NewCallbackCounter("pcap.dump_dropped",
+							"Packets that dumpers dropped because writing them fell behind.",
+							dump_drops);
+		}
 	}
 
 PcapDumper::~PcapDumper()
 	{
+	delete write_behind;
 	}
 
-void PcapDumper::Open()
+std::string PcapDumper::OpenFile(bool append_to, uint64* size)
 	{
-	int linktype = -1;
-
-	pd = pcap_open_dead(DLT_EN10MB, BifConst::Pcap::snaplen);
+	dumper = 0;
 
 	if ( ! pd )
-		{
-		Error("error for pcap_open_dead");
-		return;
-		}
+		pd = pcap_open_dead(DLT_EN10MB, BifConst::Pcap::snaplen);
 
-	if ( props.path.empty() )
-		{
-		Error("no filename given");
-		return;
-		}
+	if ( ! pd )
+		return "error for pcap_open_dead";
 
 	struct stat s;
 	int exists = 0;
 
-	if ( append )
+	if ( append_to )
 		{
 		// See if output file already exists (and is non-empty).
 		exists = stat(props.path.c_str(), &s); ;
 
 		if ( exists < 0 && errno != ENOENT )
-			{
-			Error(fmt("can't stat file %s: %s", props.path.c_str(), strerror(errno)));
-			return;
-			}
+			return fmt("can't stat file %s: %s", props.path.c_str(), strerror(errno));
 		}
 
-	if ( ! append || exists < 0 || s.st_size == 0 )
+	if ( ! append_to || exists < 0 || s.st_size == 0 )
 		{
 		// Open new file.
 		dumper = pcap_dump_open(pd, props.path.c_str());
 		if ( ! dumper )
-			{
-			Error(pcap_geterr(pd));
-			return;
-			}
+			return pcap_geterr(pd);
+
+		if ( size )
+			*size = file_hdr_size;
 		}
 
 	else
@@ -75,41 +94,237 @@ void PcapDumper::Open()
 		// a FILE ... :-(
 		dumper = (pcap_dumper_t*) fopen(props.path.c_str(), "a");
 		if ( ! dumper )
-			{
-			Error(fmt("can't open dump %s: %s", props.path.c_str(), strerror(errno)));
-			return;
-			}
+			return fmt("can't open dump %s: %s", props.path.c_str(), strerror(errno));
+
+		if ( size )
+			*size = s.st_size;
+		}
+
+	return "";
+	}
+
+void PcapDumper::CloseFile()
+	{
+	if ( dumper )
+		pcap_dump_close(dumper);
+
+	dumper = 0;
+	}
+
+void PcapDumper::FinishRetired()
+	{
+	std::vector<pcap_dumper_t*> retired = write_behind->TakeRetired();
+
+	for ( size_t i = 0; i < retired.size(); ++i )
+		pcap_dump_close(retired[i]);
+
+	std::string err = write_behind->TakeError();
+
+	if ( err.size() )
+		Error(err);
+	}
+
+void PcapDumper::Open()
+	{
+	if ( props.path.empty() )
+		{
+		Error("no filename given");
+		return;
+		}
+
+	std::string err = OpenFile(append, &file_bytes);
+
+	if ( err.size() )
+		{
+		Error(err);
+		return;
 		}
 
 	props.open_time = network_time;
 	props.hdr_size = Packet::GetLinkHeaderSize(pcap_datalink(pd));
+
+	if ( BifConst::Pcap::dump_queue_packets > 0 )
+		{
+		write_behind = new WriteBehind(dumper, BifConst::Pcap::dump_queue_packets);
+
+		if ( ! write_behind->Start() )
+			{
+			// We can still write the file ourselves.
+			delete write_behind;
+			write_behind = 0;
+			}
+		}
+
 	Opened(props);
 	}
 
 void PcapDumper::Close()
 	{
-	if ( ! dumper )
+	// Without a current file after a failed rotation, there may still
+	// be a thread to stop.
+	if ( ! pd )
 		return;
 
-	pcap_dump_close(dumper);
+	if ( write_behind )
+		{
+		write_behind->Stop();
+		FinishRetired();
+		delete write_behind;
+		write_behind = 0;
+		}
+
+	CloseFile();
 	pcap_close(pd);
-	dumper = 0;
 	pd = 0;
-
 	Closed();
 	}
 
+void PcapDumper::Write(const struct pcap_pkthdr& hdr, const u_char* data)
+	{
+	if ( dumper )
+		pcap_dump((u_char*) dumper, &hdr, data);
+	}
+
+std::string PcapDumper::Rotate(const std::string& new_name)
+	{
+	if ( ! dumper )
+		return "";
+
+	// Renaming doesn't get in the way of writing to the file, so a
+	// writer thread can go on with what it still has queued for it.
+	if ( rename(props.path.c_str(), new_name.c_str()) < 0 )
+		// We stay with the current file then.
+		return fmt("can't move %s to %s: %s", props.path.c_str(),
+			   new_name.c_str(), strerror(errno));
+
+	pcap_dumper_t* old = dumper;
+	std::string err = OpenFile(false);
+
+	if ( write_behind )
+		// We get the old file back to close once it's written.
+		write_behind->Switch(dumper);
+	else
+		pcap_dump_close(old);
+
+	return err;
+	}
+
+bool PcapDumper::RotationDue(const Packet* pkt)
+	{
+	double interval = BifConst::Pcap::dump_rotation_interval;
+	uint64 size = BifConst::Pcap::dump_rotation_size;
+
+	if ( file_open_time == 0 )
+		{
+		// The first packet starts the first file's time.
+		file_open_time = pkt->time;
+
+		if ( interval )
+			next_rotation = pkt->time + calc_next_rotate(pkt->time, interval, -1);
+		}
+
+	return (interval && pkt->time >= next_rotation) ||
+		(size && file_bytes > file_hdr_size &&
+		 file_bytes + pkt_hdr_size + pkt->cap_len > size);
+	}
+
+std::string PcapDumper::RotationBase() const
+	{
+	// Rotated files get the time of their first packet, like logs do.
+	time_t teatime = time_t(file_open_time);
+	struct tm tm;
+	char tbuf[64];
+	localtime_r(&teatime, &tm);
+	strftime(tbuf, sizeof(tbuf), "%Y-%m-%d-%H-%M-%S", &tm);
+
+	return fmt("%s.%s", props.path.c_str(), tbuf);
+	}
+
+std::string PcapDumper::RotatedName() const
+	{
+	std::string name = RotationBase();
+
+	// With size-based rotation, that may not be unique.
+	if ( name == last_rotation )
+		name = fmt("%s-%d", name.c_str(), rotation_seq + 1);
+
+	return name;
+	}
+
+void PcapDumper::Rotated(const Packet* pkt)
+	{
+	std::string base = RotationBase();
+
+	if ( base == last_rotation )
+		++rotation_seq;
+	else
+		{
+		last_rotation = base;
+		rotation_seq = 0;
+		}
+
+	file_open_time = pkt->time;
+	file_bytes = file_hdr_size;
+
+	double interval = BifConst::Pcap::dump_rotation_interval;
+
+	if ( interval )
+		next_rotation = pkt->time + calc_next_rotate(pkt->time, interval, -1);
+	}
+
 bool PcapDumper::Dump(const Packet* pkt)
 	{
 	if ( ! dumper )
 		return false;
 
+	if ( write_behind )
+		FinishRetired();
+
 	// Reconstitute the pcap_pkthdr.
 	const struct pcap_pkthdr phdr = {
 		.ts = pkt->ts, .caplen = pkt->cap_len, .len = pkt->len
 	};
 
-	pcap_dump((u_char*) dumper, &phdr, pkt->data);
+	bool rotate = (BifConst::Pcap::dump_rotation_interval ||
+		       BifConst::Pcap::dump_rotation_size) &&
+		RotationDue(pkt);
+
+	if ( rotate )
+		{
+		// If the queue is full, the packet wouldn't fit either. We
+		// then rotate with the next one.
+		if ( write_behind && ! write_behind->HasRoom() )
+			{
+			++num_dropped;
+			return true;
+			}
+
+		std::string err = Rotate(RotatedName());
+		Rotated(pkt);
+
+		if ( err.size() )
+			{
+			Error(err);
+
+			if ( ! dumper )
+				return false;
+			}
+		}
+
+	if ( ! write_behind )
+		{
+		Write(phdr, pkt->data);
+		file_bytes += pkt_hdr_size + pkt->cap_len;
+		return true;
+		}
+
+	if ( ! write_behind->Write(phdr, pkt->data) )
+		{
+		++num_dropped;
+		return true;
+		}
+
+	file_bytes += pkt_hdr_size + pkt->cap_len;
 	return true;
 	}
 
@@ -12,6 +12,8 @@ extern "C" {
 namespace iosource {
 namespace pcap {
 
+class WriteBehind;
+
 class PcapDumper : public PktDumper {
 public:
 	PcapDumper(const std::string& path, bool append);
@@ -19,6 +21,14 @@ public:
 
 	static PktDumper* Instantiate(const std::string& path, bool appen);
 
+	/**
+	 * Returns how many packets all dumpers together dropped because
+	 * their writer threads fell behind.
+	 */
+	static uint64 NumDropped()	{ return num_dropped; }
+
+	virtual bool WritesBehind() const	{ return write_behind != 0; }
+
 protected:
 	// PktDumper interface.
 	virtual void Open();
@@ -26,16 +36,56 @@ protected:
 	virtual bool Dump(const Packet* pkt);
 
 private:
+	// Opens props.path, returning an error message if that fails. If
+	// given, *size* receives the file's size.
+	std::string OpenFile(bool append, uint64* size = 0);
+	void CloseFile();
+
+	// Closes the files that the writer thread is done with, and reports
+	// what it ran into.
+	void FinishRetired();
+
+	// Writes out a packet. That's the writer thread's job if there is
+	// one.
+	void Write(const struct pcap_pkthdr& hdr, const u_char* data);
+
+	// Moves the current file over to a new name, and starts a new one.
+	// Returns an error message if that fails. A writer thread gets the
+	// new file queued in order with the packets, and needs to have room
+	// for it.
+	std::string Rotate(const std::string& new_name);
+
+	// Checks whether the packet should go into a new file.
+	bool RotationDue(const Packet* pkt);
+
+	// Returns the name for the current file once it's rotated.
+	std::string RotatedName() const;
+	std::string RotationBase() const;
+
+	// Resets the rotation state after rotating, to start the next file
+	// with the given packet.
+	void Rotated(const Packet* pkt);
+
 	Properties props;
 
 	bool append;
 	pcap_dumper_t* dumper;
 	pcap_t* pd;
+
+	WriteBehind* write_behind;
+
+	// Rotation happens in packet time. The size counts what's been
+	// passed on for writing, including what's still queued.
+	double file_open_time;
+	double next_rotation;
+	uint64 file_bytes;
+	std::string last_rotation;	// base name of the last rotation
+	int rotation_seq;	// number of rotations with the same base
+
+	static uint64 num_dropped;
 };
 
 }
 }
 
 #endif
-
-
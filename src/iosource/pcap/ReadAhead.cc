@@ -0,0 +1,165 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <signal.h>
+
+#include "bro-config.h"
+
+#include "ReadAhead.h"
+
+using namespace iosource::pcap;
+
+ReadAhead::ReadAhead(pcap_t* arg_pd, int packets)
+	{
+	pd = arg_pd;
+	block_packets = packets / NUM_BLOCKS;
+
+	if ( block_packets < 1 )
+		block_packets = 1;
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&cond, 0);
+	filled = taken = freed = 0;
+	eof = stopping = false;
+	running = false;
+	num_stalls = 0;
+	}
+
+ReadAhead::~ReadAhead()
+	{
+	Stop();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+	}
+
+bool ReadAhead::Start()
+	{
+	if ( pthread_create(&thread, 0, Launcher, this) != 0 )
+		return false;
+
+	running = true;
+	return true;
+	}
+
+void ReadAhead::Stop()
+	{
+	if ( ! running )
+		return;
+
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, 0);
+	running = false;
+	}
+
+const ReadAhead::Block* ReadAhead::Next()
+	{
+	pthread_mutex_lock(&mutex);
+
+	if ( taken == filled && ! eof )
+		{
+		++num_stalls;
+
+		while ( taken == filled && ! eof && ! stopping )
+			pthread_cond_wait(&cond, &mutex);
+		}
+
+	const Block* b = 0;
+
+	if ( taken < filled )
+		b = &blocks[taken++ % NUM_BLOCKS];
+
+	pthread_mutex_unlock(&mutex);
+	return b;
+	}
+
+void ReadAhead::Release(const Block* b)
+	{
+	pthread_mutex_lock(&mutex);
+	++freed;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	}
+
+void* ReadAhead::Launcher(void* arg)
+	{
+	// Signals are for the main thread to handle, except for those which
+	// POSIX leaves undefined when blocked.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	((ReadAhead*) arg)->Run();
+	return 0;
+	}
+
+void ReadAhead::Run()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( true )
+		{
+		while ( filled - freed >= NUM_BLOCKS && ! stopping )
+			pthread_cond_wait(&cond, &mutex);
+
+		if ( stopping )
+			break;
+
+		// Nobody else touches the block until we count it as filled.
+		Block* b = &blocks[filled % NUM_BLOCKS];
+
+		pthread_mutex_unlock(&mutex);
+		bool more = Fill(b);
+		pthread_mutex_lock(&mutex);
+
+		if ( b->NumPackets() > 0 )
+			++filled;
+
+		if ( ! more )
+			eof = true;
+
+		pthread_cond_broadcast(&cond);
+
+		if ( eof )
+			break;
+		}
+
+	pthread_mutex_unlock(&mutex);
+	}
+
+bool ReadAhead::Fill(Block* b)
+	{
+	b->data.clear();
+	b->offsets.clear();
+	b->hdrs.clear();
+
+	while ( b->NumPackets() < block_packets )
+		{
+		struct pcap_pkthdr* hdr;
+		const u_char* data;
+
+		int rc = pcap_next_ex(pd, &hdr, &data);
+
+		if ( rc <= 0 )
+			{
+			// -2 is the end of the file; 0, a timeout, can't
+			// happen with files.
+			if ( rc == -1 )
+				error = pcap_geterr(pd);
+
+			return false;
+			}
+
+		b->offsets.push_back(b->data.size());
+		b->hdrs.push_back(*hdr);
+		b->data.insert(b->data.end(), data, data + hdr->caplen);
+		}
+
+	return true;
+	}
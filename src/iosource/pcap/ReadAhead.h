@@ -0,0 +1,140 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef IOSOURCE_PKTSRC_PCAP_READAHEAD_H
+#define IOSOURCE_PKTSRC_PCAP_READAHEAD_H
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace iosource {
+namespace pcap {
+
+/**
+ * A thread reading packets from a trace file ahead of their processing,
+ * so that waiting on the disk and decoding the file's records happens in
+ * parallel to the analysis. The thread copies the packets into a small
+ * number of blocks, which it hands over one at a time. Only whole blocks
+ * pass between the threads, so the locking cost spreads over many
+ * packets.
+ *
+ * Once started, the thread is the only one using the pcap handle until
+ * Stop() returns.
+ */
+class ReadAhead {
+public:
+	/**
+	 * A block of subsequent packets from the file.
+	 */
+	struct Block {
+		std::vector<u_char> data;
+		std::vector<size_t> offsets;
+		std::vector<struct pcap_pkthdr> hdrs;
+
+		int NumPackets() const	{ return hdrs.size(); }
+
+		const u_char* Data(int i) const	{ return &data[offsets[i]]; }
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param pd The handle to read from.
+	 *
+	 * @param packets The number of packets to read ahead at most.
+	 */
+	ReadAhead(pcap_t* pd, int packets);
+
+	/**
+	 * Destructor. Stops the thread if it's still running.
+	 */
+	~ReadAhead();
+
+	/**
+	 * Starts the thread.
+	 *
+	 * @return False if it couldn't be created, in which case the caller
+	 * can read from the handle itself.
+	 */
+	bool Start();
+
+	/**
+	 * Stops the thread and waits for it to finish, even if it hasn't
+	 * reached the end of the file yet. Afterwards, the handle is free
+	 * to close.
+	 */
+	void Stop();
+
+	/**
+	 * Returns the next block of packets, waiting for the thread to
+	 * provide it if necessary. The caller must pass it back to Release()
+	 * before asking for the next one.
+	 *
+	 * @return The block, or null if the thread has reached the end of
+	 * the file or an error.
+	 */
+	const Block* Next();
+
+	/**
+	 * Passes a block returned by Next() back for reuse.
+	 */
+	void Release(const Block* b);
+
+	/**
+	 * @return The error that stopped the thread, or an empty string if
+	 * it stopped at the end of the file (or hasn't stopped yet).
+	 */
+	const std::string& Error() const	{ return error; }
+
+	/**
+	 * @return How often Next() had to wait for the thread.
+	 */
+	uint64 NumStalls() const	{ return num_stalls; }
+
+private:
+	// Number of blocks that the packets to read ahead get spread over.
+	// While we work on one, the thread fills the others.
+	static const int NUM_BLOCKS = 4;
+
+	static void* Launcher(void* arg);
+
+	void Run();
+
+	// Fills the block with up to block_packets packets. Returns false if
+	// it reached the end of the file or an error.
+	bool Fill(Block* b);
+
+	pcap_t* pd;
+	int block_packets;
+
+	Block blocks[NUM_BLOCKS];
+
+	// Blocks move through the ring in order: the thread fills the one
+	// at filled, Next() takes the one at taken, and Release() gives
+	// back the one at freed. The counts only ever grow, and the
+	// thread waits while all blocks are between freed and filled.
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint64 filled;
+	uint64 taken;
+	uint64 freed;
+	bool eof;	// the thread has filled its last block
+	bool stopping;
+
+	pthread_t thread;
+	bool running;
+
+	std::string error;
+	uint64 num_stalls;
+};
+
+}
+}
+
+#endif
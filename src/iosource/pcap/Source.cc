@@ -6,6 +6,7 @@
 
 #include "Source.h"
 #include "iosource/Packet.h"
+#include "Reporter.h"
 
 #include "pcap.bif.h"
 
@@ -25,9 +26,14 @@ PcapSource::PcapSource(const std::string& path, bool is_live)
 	props.path = path;
 	props.is_live = is_live;
 	pd = 0;
+	ts_nanos = false;
 	memset(&current_hdr, 0, sizeof(current_hdr));
 	memset(&last_hdr, 0, sizeof(last_hdr));
 	last_data = 0;
+	read_ahead = 0;
+	read_block = 0;
+	read_index = 0;
+	filter_index = -1;
 	}
 
 void PcapSource::Open()
@@ -43,6 +49,14 @@ void PcapSource::Close()
 	if ( ! pd )
 		return;
 
+	if ( read_ahead )
+		{
+		// Stops the thread before we close its handle.
+		delete read_ahead;
+		read_ahead = 0;
+		read_block = 0;
+		}
+
 	pcap_close(pd);
 	pd = 0;
 	last_data = 0;
@@ -126,12 +140,18 @@ void PcapSource::OpenLive()
 		return;
 		}
 
+	SetTimestampType();
+
 	if ( pcap_activate(pd) )
 		{
 		PcapError("pcap_activate");
 		return;
 		}
 
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+	ts_nanos = (pcap_get_tstamp_precision(pd) == PCAP_TSTAMP_PRECISION_NANO);
+#endif
+
 #ifdef HAVE_LINUX
 	if ( pcap_setnonblock(pd, 1, tmp_errbuf) < 0 )
 		{
@@ -157,11 +177,45 @@ void PcapSource::OpenLive()
 	Opened(props);
 	}
 
+void PcapSource::SetTimestampType()
+	{
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+	// Failing is fine, we'll get microseconds then.
+	if ( BifConst::Pcap::nanosecond_timestamps )
+		pcap_set_tstamp_precision(pd, PCAP_TSTAMP_PRECISION_NANO);
+#endif
+
+#ifdef PCAP_TSTAMP_ADAPTER
+	if ( ! BifConst::Pcap::hardware_timestamps )
+		return;
+
+	// Prefer the adapter's clock synchronized with the system's.
+	if ( pcap_set_tstamp_type(pd, PCAP_TSTAMP_ADAPTER) != 0 &&
+	     pcap_set_tstamp_type(pd, PCAP_TSTAMP_ADAPTER_UNSYNCED) != 0 )
+		reporter->Warning("%s does not support hardware timestamps",
+				  props.path.c_str());
+#else
+	if ( BifConst::Pcap::hardware_timestamps )
+		reporter->Warning("libpcap does not support hardware timestamps");
+#endif
+	}
+
 void PcapSource::OpenOffline()
 	{
 	char errbuf[PCAP_ERRBUF_SIZE];
 
-	pd = pcap_open_offline(props.path.c_str(), errbuf);
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+	if ( BifConst::Pcap::nanosecond_timestamps )
+		{
+		// Traces with microseconds get converted, so this works for
+		// all of them.
+		pd = pcap_open_offline_with_tstamp_precision(props.path.c_str(),
+						PCAP_TSTAMP_PRECISION_NANO, errbuf);
+		ts_nanos = true;
+		}
+	else
+#endif
+		pd = pcap_open_offline(props.path.c_str(), errbuf);
 
 	if ( ! pd )
 		{
@@ -181,15 +235,29 @@ void PcapSource::OpenOffline()
 		InternalError("OS does not support selectable pcap fd");
 
 	props.is_live = false;
+
+	if ( BifConst::Pcap::read_ahead_packets > 0 )
+		{
+		read_ahead = new ReadAhead(pd, BifConst::Pcap::read_ahead_packets);
+
+		if ( ! read_ahead->Start() )
+			{
+			// We can still read the file ourselves.
+			delete read_ahead;
+			read_ahead = 0;
+			}
+		}
+
 	Opened(props);
 	}
 
-bool PcapSource::ExtractNextPacket(Packet* pkt)
+const u_char* PcapSource::ReadNextPacket()
 	{
 	if ( ! pd )
-		return false;
+		return 0;
 
-	const u_char* data = pcap_next(pd, &current_hdr);
+	const u_char* data = read_ahead ? ReadAheadPacket()
+					: pcap_next(pd, &current_hdr);
 
 	if ( ! data )
 		{
@@ -199,16 +267,15 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 		if ( ! props.is_live )
 			Close();
 
-		return false;
+		return 0;
 		}
 
-	last_data = data;
-	pkt->Init(props.link_type, &current_hdr.ts, current_hdr.caplen, current_hdr.len, data);
-
 	if ( current_hdr.len == 0 || current_hdr.caplen == 0 )
 		{
-		Weird("empty_pcap_header", pkt);
-		return false;
+		Packet pkt(props.link_type, &current_hdr.ts, current_hdr.caplen,
+			   current_hdr.len, data, false, "", ts_nanos);
+		Weird("empty_pcap_header", &pkt);
+		return 0;
 		}
 
 	last_hdr = current_hdr;
@@ -216,6 +283,55 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 	++stats.received;
 	stats.bytes_received += current_hdr.len;
 
+	return data;
+	}
+
+const u_char* PcapSource::ReadAheadPacket()
+	{
+	while ( true )
+		{
+		if ( read_block && read_index < read_block->NumPackets() )
+			{
+			current_hdr = read_block->hdrs[read_index];
+			const u_char* data = read_block->Data(read_index++);
+
+			if ( filter_index < 0 ||
+			     ApplyBPFFilter(filter_index, &current_hdr, data) )
+				return data;
+
+			if ( ! pd )
+				// Closed, the filter is gone.
+				return 0;
+
+			continue;
+			}
+
+		if ( read_block )
+			read_ahead->Release(read_block);
+
+		read_block = read_ahead->Next();
+		read_index = 0;
+
+		if ( ! read_block )
+			{
+			if ( read_ahead->Error().size() )
+				Error(fmt("pcap_error: %s", read_ahead->Error().c_str()));
+
+			return 0;
+			}
+		}
+	}
+
+bool PcapSource::ExtractNextPacket(Packet* pkt)
+	{
+	const u_char* data = ReadNextPacket();
+
+	if ( ! data )
+		return false;
+
+	// No copy, the packet points right into libpcap's buffer.
+	pkt->Init(props.link_type, &last_hdr.ts, last_hdr.caplen, last_hdr.len,
+		  data, false, "", ts_nanos);
 	return true;
 	}
 
@@ -224,6 +340,42 @@ void PcapSource::DoneWithPacket()
 	// Nothing to do.
 	}
 
+int PcapSource::ExtractNextPackets(Packet* pkts, int max)
+	{
+	if ( batch_hdrs.size() < (size_t)max )
+		{
+		batch_hdrs.resize(max);
+		batch_offsets.resize(max);
+		}
+
+	batch_buf.clear();
+
+	int n = 0;
+	const u_char* data;
+
+	// Copy everything into one contiguous buffer first, as it may
+	// move while growing. We set up the packets once it's complete.
+	while ( n < max && (data = ReadNextPacket()) )
+		{
+		batch_hdrs[n] = last_hdr;
+		batch_offsets[n] = batch_buf.size();
+		batch_buf.insert(batch_buf.end(), data, data + last_hdr.caplen);
+		++n;
+		}
+
+	for ( int i = 0; i < n; ++i )
+		pkts[i].Init(props.link_type, &batch_hdrs[i].ts,
+			     batch_hdrs[i].caplen, batch_hdrs[i].len,
+			     &batch_buf[batch_offsets[i]], false, "", ts_nanos);
+
+	return n;
+	}
+
+void PcapSource::DoneWithPackets(int num)
+	{
+	// Nothing to do, we keep the buffer for reuse.
+	}
+
 bool PcapSource::PrecompileFilter(int index, const std::string& filter)
 	{
 	return PktSrc::PrecompileBPFFilter(index, filter);
@@ -247,6 +399,12 @@ bool PcapSource::SetFilter(int index)
 		return false;
 		}
 
+	if ( read_ahead )
+		{
+		filter_index = index;
+		return true;
+		}
+
 	if ( pcap_setfilter(pd, code->GetProgram()) < 0 )
 		{
 		PcapError();
@@ -3,7 +3,10 @@
 #ifndef IOSOURCE_PKTSRC_PCAP_SOURCE_H
 #define IOSOURCE_PKTSRC_PCAP_SOURCE_H
 
+#include <vector>
+
 #include "../PktSrc.h"
+#include "ReadAhead.h"
 
 namespace iosource {
 namespace pcap {
@@ -21,6 +24,8 @@ protected:
 	virtual void Close();
 	virtual bool ExtractNextPacket(Packet* pkt);
 	virtual void DoneWithPacket();
+	virtual int ExtractNextPackets(Packet* pkts, int max);
+	virtual void DoneWithPackets(int num);
 	virtual bool PrecompileFilter(int index, const std::string& filter);
 	virtual bool SetFilter(int index);
 	virtual void Statistics(Stats* stats);
@@ -30,15 +35,42 @@ private:
 	void OpenOffline();
 	void PcapError(const char* where = 0);
 	void SetHdrSize();
+	void SetTimestampType();
+
+	// Reads the next packet from libpcap into current_hdr and returns
+	// its data, or null if there's none. The data remains valid only
+	// until the next read.
+	const u_char* ReadNextPacket();
+
+	// Like ReadNextPacket(), but taking the packets from read_ahead.
+	const u_char* ReadAheadPacket();
 
 	Properties props;
 	Stats stats;
 
 	pcap_t *pd;
 
+	// True if libpcap gives us nanoseconds in the headers' tv_usec.
+	bool ts_nanos;
+
 	struct pcap_pkthdr current_hdr;
 	struct pcap_pkthdr last_hdr;
 	const u_char* last_data;
+
+	// libpcap reuses its buffer with the next read, so for a batch we
+	// need to copy the packets. They all go into a single buffer that's
+	// kept around for later batches.
+	std::vector<u_char> batch_buf;
+	std::vector<size_t> batch_offsets;
+	std::vector<struct pcap_pkthdr> batch_hdrs;
+
+	// For trace files with Pcap::read_ahead_packets set, the thread
+	// reading them and the block of its packets we're at. The filter
+	// then applies here, as the handle belongs to the thread.
+	ReadAhead* read_ahead;
+	const ReadAhead::Block* read_block;
+	int read_index;
+	int filter_index;
 };
 
 }
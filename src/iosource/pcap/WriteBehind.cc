@@ -0,0 +1,211 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+
+#include "bro-config.h"
+
+#include "WriteBehind.h"
+#include "../../Net.h"
+
+using namespace iosource::pcap;
+
+WriteBehind::WriteBehind(pcap_dumper_t* arg_file, int packets)
+	: slots(packets > 0 ? packets : 1)
+	{
+	file = arg_file;
+	error[0] = '\0';
+
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&cond, 0);
+	queued = written = 0;
+	stopping = false;
+	running = false;
+	}
+
+WriteBehind::~WriteBehind()
+	{
+	Stop();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+	}
+
+bool WriteBehind::Start()
+	{
+	if ( pthread_create(&thread, 0, Launcher, this) != 0 )
+		return false;
+
+	running = true;
+	return true;
+	}
+
+void WriteBehind::Stop()
+	{
+	if ( ! running )
+		return;
+
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, 0);
+	running = false;
+	}
+
+bool WriteBehind::HasRoom()
+	{
+	// Reading traces, Reserve() waits for room.
+	if ( ! reading_live )
+		return true;
+
+	pthread_mutex_lock(&mutex);
+	bool room = queued - written < slots.size();
+	pthread_mutex_unlock(&mutex);
+
+	return room;
+	}
+
+WriteBehind::Slot* WriteBehind::Reserve()
+	{
+	pthread_mutex_lock(&mutex);
+
+	// Reading traces, we'd rather wait than lose packets.
+	while ( queued - written >= slots.size() && ! reading_live )
+		pthread_cond_wait(&cond, &mutex);
+
+	bool full = queued - written >= slots.size();
+	pthread_mutex_unlock(&mutex);
+
+	return full ? 0 : &slots[queued % slots.size()];
+	}
+
+void WriteBehind::Commit()
+	{
+	pthread_mutex_lock(&mutex);
+	++queued;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	}
+
+bool WriteBehind::Write(const struct pcap_pkthdr& hdr, const u_char* data)
+	{
+	Slot* s = Reserve();
+
+	if ( ! s )
+		return false;
+
+	// Reuses the buffer's memory from earlier packets.
+	s->hdr = hdr;
+	s->data.assign(data, data + hdr.caplen);
+	s->switch_file = false;
+	Commit();
+	return true;
+	}
+
+bool WriteBehind::Switch(pcap_dumper_t* next)
+	{
+	Slot* s = Reserve();
+
+	if ( ! s )
+		return false;
+
+	s->switch_file = true;
+	s->next = next;
+	Commit();
+	return true;
+	}
+
+std::vector<pcap_dumper_t*> WriteBehind::TakeRetired()
+	{
+	std::vector<pcap_dumper_t*> r;
+	pthread_mutex_lock(&mutex);
+	r.swap(retired);
+	pthread_mutex_unlock(&mutex);
+	return r;
+	}
+
+std::string WriteBehind::TakeError()
+	{
+	pthread_mutex_lock(&mutex);
+	std::string e = error;
+	error[0] = '\0';
+	pthread_mutex_unlock(&mutex);
+	return e;
+	}
+
+void* WriteBehind::Launcher(void* arg)
+	{
+	// Signals are for the main thread to handle, except for those which
+	// POSIX leaves undefined when blocked.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	((WriteBehind*) arg)->Run();
+	return 0;
+	}
+
+void WriteBehind::Run()
+	{
+	pthread_mutex_lock(&mutex);
+
+	while ( true )
+		{
+		while ( written == queued && ! stopping )
+			pthread_cond_wait(&cond, &mutex);
+
+		// Even when stopping, we write out what's queued.
+		if ( written == queued )
+			break;
+
+		// Nobody else touches the slot until we count it as written.
+		Slot* s = &slots[written % slots.size()];
+
+		pthread_mutex_unlock(&mutex);
+
+		pcap_dumper_t* done = 0;
+
+		if ( s->switch_file )
+			{
+			Flush();
+			done = file;
+			file = s->next;
+			}
+
+		else if ( file )
+			pcap_dump((u_char*) file, &s->hdr, s->data.data());
+
+		pthread_mutex_lock(&mutex);
+
+		if ( done )
+			retired.push_back(done);
+
+		++written;
+		pthread_cond_broadcast(&cond);
+		}
+
+	pthread_mutex_unlock(&mutex);
+
+	// The caller closes the last file, but any error writing it should
+	// still show.
+	Flush();
+	}
+
+void WriteBehind::Flush()
+	{
+	if ( ! file || pcap_dump_flush(file) == 0 )
+		return;
+
+	char buf[128];
+	strerror_r(errno, buf, sizeof(buf));
+
+	pthread_mutex_lock(&mutex);
+	snprintf(error, sizeof(error), "can't write dump file: %s", buf);
+	pthread_mutex_unlock(&mutex);
+	}
@@ -0,0 +1,144 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef IOSOURCE_PKTSRC_PCAP_WRITEBEHIND_H
+#define IOSOURCE_PKTSRC_PCAP_WRITEBEHIND_H
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace iosource {
+namespace pcap {
+
+/**
+ * A thread writing a dumper's packets to its file, so that the main thread
+ * doesn't wait on the disk. The packets get copied into a fixed ring of
+ * slots whose buffers are reused. If the ring is full when capturing live,
+ * further packets get dropped rather than holding up the analysis; reading
+ * traces, the main thread waits for room instead.
+ *
+ * The thread only ever writes packets to files that the main thread has
+ * opened for it. It neither opens nor closes any itself, and doesn't use
+ * anything else that isn't safe to call from several threads at once.
+ */
+class WriteBehind {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param file The file to write to first. It's up to the caller to
+	 * close it once the thread no longer uses it.
+	 *
+	 * @param packets The number of packets that may be waiting at most.
+	 */
+	WriteBehind(pcap_dumper_t* file, int packets);
+
+	/**
+	 * Destructor. Stops the thread if it's still running.
+	 */
+	~WriteBehind();
+
+	/**
+	 * Starts the thread.
+	 *
+	 * @return False if it couldn't be created, in which case the caller
+	 * can write to the file itself.
+	 */
+	bool Start();
+
+	/**
+	 * Writes out what's queued, then stops the thread and waits for it
+	 * to finish. Afterwards, all files handed to the thread are free to
+	 * close.
+	 */
+	void Stop();
+
+	/**
+	 * @return False if a packet or switch queued now would get
+	 * dropped. Only the main thread queues, so if there's room, it
+	 * stays until the next one.
+	 */
+	bool HasRoom();
+
+	/**
+	 * Queues a copy of a packet for writing.
+	 *
+	 * @return False if the queue is full and the packet got dropped.
+	 */
+	bool Write(const struct pcap_pkthdr& hdr, const u_char* data);
+
+	/**
+	 * Queues a switch to another file, which happens in order with the
+	 * packets. The one written so far is passed back by TakeRetired()
+	 * once the thread is done with it.
+	 *
+	 * @param file The already opened file for the following packets,
+	 * or null to drop them.
+	 *
+	 * @return False if the queue is full and the switch got dropped.
+	 */
+	bool Switch(pcap_dumper_t* file);
+
+	/**
+	 * @return The files that the thread has switched away from since
+	 * the last call, for the caller to close.
+	 */
+	std::vector<pcap_dumper_t*> TakeRetired();
+
+	/**
+	 * @return The error that the thread ran into, if any, and clears
+	 * it.
+	 */
+	std::string TakeError();
+
+private:
+	struct Slot {
+		struct pcap_pkthdr hdr;
+		std::vector<u_char> data;
+		bool switch_file;	// if set, a switch to next instead
+		pcap_dumper_t* next;	// null to stop writing
+	};
+
+	static void* Launcher(void* arg);
+
+	void Run();
+
+	// Flushes the current file, recording an error if that fails.
+	void Flush();
+
+	// Returns the next slot to fill, or null if there's none free. The
+	// thread leaves it alone until Commit() queues it.
+	Slot* Reserve();
+	void Commit();
+
+	pcap_dumper_t* file;	// only the thread uses this once started
+	std::vector<Slot> slots;
+
+	// Slots move through the ring in order: Commit() adds the one at
+	// queued, and the thread writes out the one at written. The counts
+	// only ever grow.
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint64 queued;
+	uint64 written;
+	bool stopping;
+
+	pthread_t thread;
+	bool running;
+
+	// Both protected by the mutex. The thread can't use fmt() or
+	// strerror(), so it writes its errors into a buffer of its own.
+	std::vector<pcap_dumper_t*> retired;
+	char error[256];
+};
+
+}
+}
+
+#endif
@@ -1,12 +1,15 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <algorithm>
+#include <new>
 
 #include "../Event.h"
 #include "../EventHandler.h"
 #include "../NetVar.h"
 #include "../Net.h"
 #include "../Type.h"
+#include "../Metrics.h"
+#include "../Anon.h"
 
 #include "threading/Manager.h"
 #include "threading/SerialTypes.h"
@@ -22,13 +25,38 @@
 
 using namespace logging;
 
+// Fills in a log value directly from a Val of an atomic type, which takes
+// no space beyond the value itself.
+typedef void (*LogValConverter)(threading::Value* lval, Val* val);
+
 struct Manager::Filter {
 	Val* fval;
 	string name;
 	EnumVal* id;
 	Func* pred;
+
+	// The declarative conditions on a row's columns, all of which it
+	// needs to meet. They're checked before pred.
+	struct Condition {
+		vector<int> steps;	// the column's record indices
+		int op;	// a BifEnum::Log::ConditionOp
+		Val* value;
+	};
+
+	vector<Condition> conditions;
+
+	bool AddCondition(RecordType* columns, RecordVal* c);
+	bool Matches(RecordVal* columns) const;
+
 	Func* path_func;
 	string path;
+
+	// With path_func_fields, the columns that path_func's result depends
+	// on, and the paths it returned so far, by their values.
+	bool memoize_path;
+	vector<int> path_key_fields;
+	map<string, string> path_cache;
+
 	Val* path_val;
 	EnumVal* writer;
 	TableVal* config;
@@ -41,6 +69,7 @@ struct Manager::Filter {
 	bool remote;
 	double interval;
 	Func* postprocessor;
+	int addr_anonymization;	// an ip_addr_anonymization_method_t
 
 	int num_fields;
 	threading::Field** fields;
@@ -50,6 +79,30 @@ struct Manager::Filter {
 	// sub-records.
 	vector<list<int> > indices;
 
+	// Where each field's value comes from, compiled from indices once
+	// the fields are known, so that writing a row doesn't need to chase
+	// lists or switch on types again for the common fields.
+	struct FieldPlan {
+		bool from_ext;	// from the ext_func's record, not the columns
+		int first_step;	// the field's record indices, in steps
+		int num_steps;
+		LogValConverter convert;	// null if it needs packing
+	};
+
+	vector<FieldPlan> plan;
+	vector<int> steps;
+
+	void CompilePlan();
+
+	// Filters with the same column set log the same values, so that
+	// a record needs converting only once for all of them.
+	int column_set;
+
+	// For streams with more than one writer thread, the field whose
+	// value selects the thread, or -1 to spread rows round-robin.
+	int shard_field;
+	uint64 next_shard;
+
 	~Filter();
 };
 
@@ -71,6 +124,13 @@ struct Manager::Stream {
 	string name;
 	RecordType* columns;
 	EventHandlerPtr event;
+	double max_delay;
+	int num_shards;
+	string shard_by;
+	uint64 max_queued_rows;
+	uint64 max_queued_bytes;
+	int overload_policy;
+	uint64 overload_sample_rate;
 	list<Filter*> filters;
 
 	typedef pair<int, string> WriterPathPair;
@@ -100,6 +160,202 @@ Manager::Filter::~Filter()
 	free(fields);
 
 	Unref(path_val);
+
+	for ( size_t i = 0; i < conditions.size(); ++i )
+		Unref(conditions[i].value);
+	}
+
+bool Manager::Filter::AddCondition(RecordType* columns, RecordVal* c)
+	{
+	string column = c->Lookup("column")->AsString()->CheckString();
+	Val* op_val = c->Lookup("op", true);
+	Val* value = c->Lookup("value");
+
+	Condition cond;
+	cond.op = op_val->InternalInt();
+	Unref(op_val);
+
+	// Find the column, following dots into nested records.
+	BroType* t = columns;
+	string::size_type start = 0;
+
+	while ( true )
+		{
+		string::size_type dot = column.find('.', start);
+		string part = column.substr(start, dot == string::npos ? dot : dot - start);
+		int offset = t->Tag() == TYPE_RECORD ?
+			t->AsRecordType()->FieldOffset(part.c_str()) : -1;
+
+		if ( offset < 0 )
+			{
+			reporter->Error("condition of filter '%s' names unknown column '%s'",
+					name.c_str(), column.c_str());
+			return false;
+			}
+
+		cond.steps.push_back(offset);
+		t = t->AsRecordType()->FieldType(offset);
+
+		if ( dot == string::npos )
+			break;
+
+		start = dot + 1;
+		}
+
+	BroType* vt = value ? value->Type() : 0;
+	bool ok = false;
+
+	switch ( cond.op ) {
+	case BifEnum::Log::EQ:
+	case BifEnum::Log::NE:
+		ok = vt && is_atomic_type(t) && same_type(t, vt);
+		break;
+
+	case BifEnum::Log::IN:
+	case BifEnum::Log::NOT_IN:
+		if ( ! vt )
+			break;
+
+		if ( t->Tag() == TYPE_ADDR && vt->Tag() == TYPE_SUBNET )
+			ok = true;
+
+		else if ( vt->IsSet() )
+			{
+			const type_list* it = vt->AsTableType()->IndexTypes();
+
+			ok = it->length() == 1 &&
+				(same_type((*it)[0], t) ||
+				 (t->Tag() == TYPE_ADDR && (*it)[0]->Tag() == TYPE_SUBNET));
+			}
+
+		break;
+	}
+
+	if ( ! ok )
+		{
+		reporter->Error("condition of filter '%s' can't check column '%s' with a value of type %s",
+				name.c_str(), column.c_str(),
+				vt ? type_name(vt->Tag()) : "<none>");
+		return false;
+		}
+
+	cond.value = value->Ref();
+	conditions.push_back(cond);
+	return true;
+	}
+
+bool Manager::Filter::Matches(RecordVal* columns) const
+	{
+	for ( size_t i = 0; i < conditions.size(); ++i )
+		{
+		const Condition& c = conditions[i];
+		Val* v = columns;
+
+		for ( size_t j = 0; v && j < c.steps.size(); ++j )
+			v = v->AsRecordVal()->Lookup(c.steps[j]);
+
+		bool negate = (c.op == BifEnum::Log::NE || c.op == BifEnum::Log::NOT_IN);
+		bool hit;
+
+		if ( ! v )
+			hit = false;
+
+		else if ( c.op == BifEnum::Log::EQ || c.op == BifEnum::Log::NE )
+			hit = same_atomic_val(v, c.value);
+
+		else if ( c.value->Type()->Tag() == TYPE_SUBNET )
+			hit = c.value->AsSubNetVal()->Contains(v->AsAddr());
+
+		else
+			hit = c.value->AsTableVal()->Lookup(v, false) != 0;
+
+		if ( hit == negate )
+			return false;
+		}
+
+	return true;
+	}
+
+static void convert_int(threading::Value* lval, Val* val)
+	{
+	lval->val.int_val = val->InternalInt();
+	}
+
+static void convert_count(threading::Value* lval, Val* val)
+	{
+	lval->val.uint_val = val->InternalUnsigned();
+	}
+
+static void convert_port(threading::Value* lval, Val* val)
+	{
+	lval->val.port_val.port = val->AsPortVal()->Port();
+	lval->val.port_val.proto = val->AsPortVal()->PortType();
+	}
+
+static void convert_subnet(threading::Value* lval, Val* val)
+	{
+	val->AsSubNet().ConvertToThreadingValue(&lval->val.subnet_val);
+	}
+
+static void convert_addr(threading::Value* lval, Val* val)
+	{
+	val->AsAddr().ConvertToThreadingValue(&lval->val.addr_val);
+	}
+
+static void convert_double(threading::Value* lval, Val* val)
+	{
+	lval->val.double_val = val->InternalDouble();
+	}
+
+void Manager::Filter::CompilePlan()
+	{
+	plan.clear();
+	steps.clear();
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		FieldPlan f;
+		f.from_ext = i < num_ext_fields;
+		f.first_step = steps.size();
+		f.num_steps = indices[i].size();
+		steps.insert(steps.end(), indices[i].begin(), indices[i].end());
+
+		switch ( fields[i]->type ) {
+		case TYPE_BOOL:
+		case TYPE_INT:
+			f.convert = convert_int;
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_COUNTER:
+			f.convert = convert_count;
+			break;
+
+		case TYPE_PORT:
+			f.convert = convert_port;
+			break;
+
+		case TYPE_SUBNET:
+			f.convert = convert_subnet;
+			break;
+
+		case TYPE_ADDR:
+			f.convert = convert_addr;
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			f.convert = convert_double;
+			break;
+
+		default:
+			f.convert = 0;
+			break;
+		}
+
+		plan.push_back(f);
+		}
 	}
 
 Manager::Stream::~Stream()
@@ -127,6 +383,7 @@ Manager::Manager()
 	: plugin::ComponentManager<logging::Tag, logging::Component>("Log", "Writer")
 	{
 	rotations_pending = 0;
+	num_column_sets = 0;
 	}
 
 Manager::~Manager()
@@ -283,7 +540,7 @@ bool Manager::CreateStream(EnumVal* id, RecordVal* sval)
 		if ( ! same_type((*args)[0], columns) )
 			{
 			reporter->Error("stream event's argument type does not match column record type");
-			return new Val(0, TYPE_BOOL);
+			return val_mgr->GetFalse();
 			}
 		}
 
@@ -307,6 +564,34 @@ bool Manager::CreateStream(EnumVal* id, RecordVal* sval)
 	streams[idx]->event = event ? event_registry->Lookup(event->Name()) : 0;
 	streams[idx]->columns = columns->Ref()->AsRecordType();
 
+	Val* max_delay = sval->Lookup("max_delay", true);
+	streams[idx]->max_delay = max_delay->AsInterval();
+	Unref(max_delay);
+
+	Val* writer_threads = sval->Lookup("writer_threads", true);
+	streams[idx]->num_shards = max(int(writer_threads->AsCount()), 1);
+	Unref(writer_threads);
+
+	Val* shard_by = sval->Lookup("shard_by");
+
+	if ( shard_by )
+		streams[idx]->shard_by = shard_by->AsString()->CheckString();
+
+	Val* max_queued_rows = sval->Lookup("max_queued_rows", true);
+	Val* max_queued_bytes = sval->Lookup("max_queued_bytes", true);
+	Val* overload_policy = sval->Lookup("overload_policy", true);
+	Val* overload_sample_rate = sval->Lookup("overload_sample_rate", true);
+
+	streams[idx]->max_queued_rows = max_queued_rows->AsCount();
+	streams[idx]->max_queued_bytes = max_queued_bytes->AsCount();
+	streams[idx]->overload_policy = overload_policy->AsEnum();
+	streams[idx]->overload_sample_rate = overload_sample_rate->AsCount();
+
+	Unref(max_queued_rows);
+	Unref(max_queued_bytes);
+	Unref(overload_policy);
+	Unref(overload_sample_rate);
+
 #ifdef ENABLE_BROKER
 	streams[idx]->enable_remote = internal_val("Log::enable_remote_logging")->AsBool();
 	streams[idx]->remote_flags = broker::PEERS;
@@ -549,6 +834,8 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	Val* name = fval->Lookup("name", true);
 	Val* pred = fval->Lookup("pred", true);
 	Val* path_func = fval->Lookup("path_func", true);
+	Val* path_func_fields = fval->Lookup("path_func_fields");
+	Val* conditions = fval->Lookup("conditions");
 	Val* log_local = fval->Lookup("log_local", true);
 	Val* log_remote = fval->Lookup("log_remote", true);
 	Val* interv = fval->Lookup("interv", true);
@@ -558,6 +845,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	Val* scope_sep = fval->Lookup("scope_sep", true);
 	Val* ext_prefix = fval->Lookup("ext_prefix", true);
 	Val* ext_func = fval->Lookup("ext_func", true);
+	Val* addr_anonymization = fval->Lookup("addr_anonymization", true);
 
 	Filter* filter = new Filter;
 	filter->fval = fval->Ref();
@@ -565,6 +853,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	filter->id = id->Ref()->AsEnumVal();
 	filter->pred = pred ? pred->AsFunc() : 0;
 	filter->path_func = path_func ? path_func->AsFunc() : 0;
+	filter->memoize_path = false;
 	filter->writer = writer->Ref()->AsEnumVal();
 	filter->local = log_local->AsBool();
 	filter->remote = log_remote->AsBool();
@@ -575,6 +864,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	filter->scope_sep = scope_sep->AsString()->CheckString();
 	filter->ext_prefix = ext_prefix->AsString()->CheckString();
 	filter->ext_func = ext_func ? ext_func->AsFunc() : 0;
+	filter->addr_anonymization = addr_anonymization->AsEnum();
 
 	Unref(name);
 	Unref(pred);
@@ -588,6 +878,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	Unref(scope_sep);
 	Unref(ext_prefix);
 	Unref(ext_func);
+	Unref(addr_anonymization);
 
 	// Build the list of fields that the filter wants included, including
 	// potentially rolling out fields.
@@ -625,6 +916,71 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 		return false;
 		}
 
+	filter->CompilePlan();
+
+	if ( conditions )
+		{
+		VectorVal* cv = conditions->AsVectorVal();
+
+		for ( unsigned int i = 0; i < cv->Size(); ++i )
+			{
+			Val* c = cv->Lookup(i);
+
+			if ( c && ! filter->AddCondition(stream->columns, c->AsRecordVal()) )
+				{
+				delete filter;
+				return false;
+				}
+			}
+		}
+
+	if ( path_func_fields )
+		{
+		ListVal* names = path_func_fields->AsTableVal()->ConvertToPureList();
+
+		for ( int i = 0; names && i < names->Length(); ++i )
+			{
+			const char* name = names->Index(i)->AsString()->CheckString();
+			int offset = stream->columns->FieldOffset(name);
+
+			if ( offset < 0 )
+				{
+				reporter->Error("path_func_fields of filter '%s' names unknown column '%s'",
+						filter->name.c_str(), name);
+				Unref(names);
+				delete filter;
+				return false;
+				}
+
+			filter->path_key_fields.push_back(offset);
+			}
+
+		// Keep the key independent of the set's order.
+		sort(filter->path_key_fields.begin(), filter->path_key_fields.end());
+		filter->memoize_path = true;
+		Unref(names);
+		}
+
+	filter->shard_field = -1;
+	filter->next_shard = 0;
+
+	if ( stream->num_shards > 1 && stream->shard_by.size() )
+		{
+		for ( int i = 0; i < filter->num_fields; ++i )
+			{
+			if ( stream->shard_by == filter->fields[i]->name )
+				{
+				filter->shard_field = i;
+				break;
+				}
+			}
+
+		if ( filter->shard_field < 0 )
+			reporter->Warning("filter '%s' on stream '%s' doesn't log field '%s', spreading its rows round-robin",
+					  filter->name.c_str(), stream->name.c_str(),
+					  stream->shard_by.c_str());
+		}
+
 	// Get the path for the filter.
 	Val* path_val = fval->Lookup("path");
 
@@ -644,6 +1000,24 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	// Remove any filter with the same name we might already have.
 	RemoveFilter(id, filter->name);
 
+	// Extension fields come from calling a filter's function, so only
+	// filters without them can share their values.
+	filter->column_set = ++num_column_sets;
+
+	if ( filter->num_ext_fields == 0 )
+		{
+		for ( list<Filter*>::iterator i = stream->filters.begin();
+		      i != stream->filters.end(); ++i )
+			{
+			if ( (*i)->num_ext_fields == 0 && (*i)->indices == filter->indices &&
+			     (*i)->addr_anonymization == filter->addr_anonymization )
+				{
+				filter->column_set = (*i)->column_set;
+				break;
+				}
+			}
+		}
+
 	// Add the new one.
 	stream->filters.push_back(filter);
 
@@ -702,8 +1076,161 @@ bool Manager::RemoveFilter(EnumVal* id, string name)
 	return true;
 	}
 
+namespace {
+
+// The rows converted for the filters of a single write, indexed by column
+// set. Holds a reference to each of them, so that they stay around while
+// writers may already be done with them.
+class SharedRows {
+public:
+	~SharedRows()
+		{
+		for ( unsigned int i = 0; i < rows.size(); ++i )
+			threading::Value::DeleteRow(rows[i].num_fields, rows[i].vals);
+		}
+
+	// Returns a new reference to the row, or null if there's none.
+	threading::Value** Lookup(int column_set)
+		{
+		for ( unsigned int i = 0; i < rows.size(); ++i )
+			{
+			if ( rows[i].column_set == column_set )
+				{
+				threading::Value::RefRow(rows[i].vals);
+				return rows[i].vals;
+				}
+			}
+
+		return 0;
+		}
+
+	// Adds a packed row, keeping a reference of our own.
+	void Add(int column_set, threading::Value** vals, int num_fields)
+		{
+		threading::Value::RefRow(vals);
+
+		Row r;
+		r.column_set = column_set;
+		r.num_fields = num_fields;
+		r.vals = vals;
+		rows.push_back(r);
+		}
+
+private:
+	struct Row {
+		int column_set;
+		int num_fields;
+		threading::Value** vals;
+	};
+
+	// Streams rarely have more than a few filters.
+	vector<Row> rows;
+};
+
+// Hashes a log value for picking the writer thread of its row.
+hash_t hash_log_value(const threading::Value* val)
+	{
+	if ( ! val->present )
+		return 0;
+
+	switch ( val->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		return HashKey::HashBytes(&val->val.int_val, sizeof(val->val.int_val));
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		return HashKey::HashBytes(&val->val.uint_val, sizeof(val->val.uint_val));
+
+	case TYPE_PORT:
+		return HashKey::HashBytes(&val->val.port_val.port, sizeof(val->val.port_val.port)) +
+			val->val.port_val.proto;
+
+	case TYPE_SUBNET:
+	case TYPE_ADDR:
+		{
+		const threading::Value::addr_t& a = val->type == TYPE_ADDR ?
+			val->val.addr_val : val->val.subnet_val.prefix;
+
+		hash_t h = a.family == IPv4 ?
+			HashKey::HashBytes(&a.in.in4, sizeof(a.in.in4)) :
+			HashKey::HashBytes(&a.in.in6, sizeof(a.in.in6));
+
+		if ( val->type == TYPE_SUBNET )
+			h += val->val.subnet_val.length;
+
+		return h;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return HashKey::HashBytes(&val->val.double_val, sizeof(val->val.double_val));
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		return HashKey::HashBytes(val->val.string_val.data, val->val.string_val.length);
+
+	case TYPE_TABLE:
+		{
+		// Sets come in no particular order.
+		hash_t h = 0;
+
+		for ( int i = 0; i < val->val.set_val.size; ++i )
+			h += hash_log_value(val->val.set_val.vals[i]);
+
+		return h;
+		}
+
+	case TYPE_VECTOR:
+		{
+		hash_t h = 0;
+
+		for ( int i = 0; i < val->val.vector_val.size; ++i )
+			h = h * 31 + hash_log_value(val->val.vector_val.vals[i]);
+
+		return h;
+		}
+
+	default:
+		return 0;
+	}
+	}
+
+}
+
+static metrics::Counter* writes_metric =
+	metrics::registry()->NewCounter("logging.writes",
+					"Log records passed to Log::write().");
+
+// The most paths memoized per filter. More than that means path_func_fields
+// doesn't pin down paths well, and we start over.
+static const size_t max_path_cache_size = 10000;
+
+// Returns what identifies the values of the given columns for memoizing a
+// filter's path.
+static string path_cache_key(const vector<int>& fields, RecordVal* columns)
+	{
+	ODesc d(DESC_BINARY);
+
+	for ( size_t i = 0; i < fields.size(); ++i )
+		{
+		Val* v = columns->Lookup(fields[i]);
+		d.Add(v ? 1 : 0);
+
+		if ( v )
+			v->Describe(&d);
+		}
+
+	return string((const char*) d.Bytes(), d.Len());
+	}
+
 bool Manager::Write(EnumVal* id, RecordVal* columns)
 	{
+	SharedRows shared;
+
 	Stream* stream = FindStream(id);
 	if ( ! stream )
 		return false;
@@ -711,6 +1238,8 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 	if ( ! stream->enabled )
 		return true;
 
+	writes_metric->Inc();
+
 	columns = columns->CoerceTo(stream->columns);
 
 	if ( ! columns )
@@ -734,6 +1263,9 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 		Filter* filter = *i;
 		string path = filter->path;
 
+		if ( ! filter->conditions.empty() && ! filter->Matches(columns) )
+			continue;
+
 		if ( filter->pred )
 			{
 			// See whether the predicates indicates that we want
@@ -756,50 +1288,76 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 
 		if ( filter->path_func )
 			{
-			val_list vl(3);
-			vl.append(id->Ref());
+			string key;
+			map<string, string>::iterator cached;
+
+			if ( filter->memoize_path )
+				{
+				key = path_cache_key(filter->path_key_fields, columns);
+				cached = filter->path_cache.find(key);
+				}
 
-			Val* path_arg;
-			if ( filter->path_val )
-				path_arg = filter->path_val->Ref();
+			if ( filter->memoize_path && cached != filter->path_cache.end() )
+				path = cached->second;
 			else
-				path_arg = new StringVal("");
+				{
+				// The first call doesn't get a path yet, so its result
+				// isn't what further calls would return.
+				bool had_path = filter->path_val != 0;
 
-			vl.append(path_arg);
+				val_list vl(3);
+				vl.append(id->Ref());
 
-			Val* rec_arg;
-			BroType* rt = filter->path_func->FType()->Args()->FieldType("rec");
+				Val* path_arg;
+				if ( filter->path_val )
+					path_arg = filter->path_val->Ref();
+				else
+					path_arg = val_mgr->GetEmptyString();
 
-			if ( rt->Tag() == TYPE_RECORD )
-				rec_arg = columns->CoerceTo(rt->AsRecordType(), true);
-			else
-				// Can be TYPE_ANY here.
-				rec_arg = columns->Ref();
+				vl.append(path_arg);
 
-			vl.append(rec_arg);
+				Val* rec_arg;
+				BroType* rt = filter->path_func->FType()->Args()->FieldType("rec");
 
-			Val* v = 0;
+				if ( rt->Tag() == TYPE_RECORD )
+					rec_arg = columns->CoerceTo(rt->AsRecordType(), true);
+				else
+					// Can be TYPE_ANY here.
+					rec_arg = columns->Ref();
 
-			v = filter->path_func->Call(&vl);
+				vl.append(rec_arg);
 
-			if ( ! v )
-				return false;
+				Val* v = 0;
 
-			if ( v->Type()->Tag() != TYPE_STRING )
-				{
-				reporter->Error("path_func did not return string");
+				v = filter->path_func->Call(&vl);
+
+				if ( ! v )
+					return false;
+
+				if ( v->Type()->Tag() != TYPE_STRING )
+					{
+					reporter->Error("path_func did not return string");
+					Unref(v);
+					return false;
+					}
+
+				if ( ! filter->path_val )
+					{
+					filter->path = v->AsString()->CheckString();
+					filter->path_val = v->Ref();
+					}
+
+				path = v->AsString()->CheckString();
 				Unref(v);
-				return false;
-				}
 
-			if ( ! filter->path_val )
-				{
-				filter->path = v->AsString()->CheckString();
-				filter->path_val = v->Ref();
-				}
+				if ( filter->memoize_path && had_path )
+					{
+					if ( filter->path_cache.size() >= max_path_cache_size )
+						filter->path_cache.clear();
 
-			path = v->AsString()->CheckString();
-			Unref(v);
+					filter->path_cache[key] = path;
+					}
+				}
 
 #ifdef DEBUG
 			DBG_LOG(DBG_LOGGING, "Path function for filter '%s' on stream '%s' return '%s'",
@@ -807,7 +1365,30 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 #endif
 			}
 
-		Stream::WriterPathPair wpp(filter->writer->AsEnum(), path);
+		// Convert the record, or reuse the values of an earlier filter
+		// with the same columns if possible.
+		threading::Value** vals = shared.Lookup(filter->column_set);
+
+		if ( ! vals )
+			{
+			vals = RecordToFilterVals(stream, filter, columns);
+
+			if ( filter->num_fields > 0 )
+				shared.Add(filter->column_set, vals, filter->num_fields);
+			}
+
+		int shard = 0;
+
+		if ( stream->num_shards > 1 )
+			{
+			if ( filter->shard_field >= 0 )
+				shard = hash_log_value(vals[filter->shard_field]) % stream->num_shards;
+			else
+				shard = filter->next_shard++ % stream->num_shards;
+			}
+
+		Stream::WriterPathPair wpp(filter->writer->AsEnum(),
+					   ShardPath(stream, path, shard));
 
 		// See if we already have a writer for this path.
 		Stream::WriterMap::iterator w = stream->writers.find(wpp);
@@ -824,7 +1405,7 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 				char num[32];
 				snprintf(num, sizeof(num), "-%u", i++);
 				new_path = path + num;
-				wpp.second = new_path;
+				wpp.second = ShardPath(stream, new_path, shard);
 				w = stream->writers.find(wpp);
 			} while ( w != stream->writers.end() &&
 			          CheckFilterWriterConflict(w->second, filter) );
@@ -850,16 +1431,14 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 
 		else
 			{
-			// No, need to create one.
+			// No, need to create one. The writers of all of a path's
+			// shards get created together, so that their files
+			// rotate in sync.
 
-			// Copy the fields for WriterFrontend::Init() as it
-			// will take ownership.
-			threading::Field** arg_fields = new threading::Field*[filter->num_fields];
-
-			for ( int j = 0; j < filter->num_fields; ++j )
+			// Rename fields if a field name map is set.
+			if ( filter->field_name_map )
 				{
-				// Rename fields if a field name map is set.
-				if ( filter->field_name_map )
+				for ( int j = 0; j < filter->num_fields; ++j )
 					{
 					const char* name = filter->fields[j]->name;
 					StringVal *fn = new StringVal(name);
@@ -871,43 +1450,53 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 						}
 					delete fn;
 					}
-				arg_fields[j] = new threading::Field(*filter->fields[j]);
 				}
 
-			WriterBackend::WriterInfo* info = new WriterBackend::WriterInfo;
-			info->path = copy_string(path.c_str());
-			info->network_time = network_time;
+			for ( int s = 0; s < stream->num_shards; ++s )
+				{
+				// Copy the fields for WriterFrontend::Init() as it
+				// will take ownership.
+				threading::Field** arg_fields = new threading::Field*[filter->num_fields];
 
-			HashKey* k;
-			IterCookie* c = filter->config->AsTable()->InitForIteration();
+				for ( int j = 0; j < filter->num_fields; ++j )
+					arg_fields[j] = new threading::Field(*filter->fields[j]);
 
-			TableEntryVal* v;
-			while ( (v = filter->config->AsTable()->NextEntry(k, c)) )
-				{
-				ListVal* index = filter->config->RecoverIndex(k);
-				string key = index->Index(0)->AsString()->CheckString();
-				string value = v->Value()->AsString()->CheckString();
-				info->config.insert(std::make_pair(copy_string(key.c_str()), copy_string(value.c_str())));
-				Unref(index);
-				delete k;
-				}
+				WriterBackend::WriterInfo* info = new WriterBackend::WriterInfo;
+				info->path = copy_string(ShardPath(stream, path, s).c_str());
+				info->network_time = network_time;
 
-			// CreateWriter() will set the other fields in info.
+				HashKey* k;
+				IterCookie* c = filter->config->AsTable()->InitForIteration();
 
-			writer = CreateWriter(stream->id, filter->writer,
-					      info, filter->num_fields, arg_fields, filter->local,
-					      filter->remote, false, filter->name);
+				TableEntryVal* v;
+				while ( (v = filter->config->AsTable()->NextEntry(k, c)) )
+					{
+					ListVal* index = filter->config->RecoverIndex(k);
+					string key = index->Index(0)->AsString()->CheckString();
+					string value = v->Value()->AsString()->CheckString();
+					info->config.insert(std::make_pair(copy_string(key.c_str()), copy_string(value.c_str())));
+					Unref(index);
+					delete k;
+					}
 
-			if ( ! writer )
-				{
-				Unref(columns);
-				return false;
-				}
-			}
+				// CreateWriter() will set the other fields in info.
 
-		// Alright, can do the write now.
+				WriterFrontend* shard_writer =
+					CreateWriter(stream->id, filter->writer,
+						     info, filter->num_fields, arg_fields, filter->local,
+						     filter->remote, false, filter->name);
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns);
+				if ( ! shard_writer )
+					{
+					DeleteVals(filter->num_fields, vals);
+					Unref(columns);
+					return false;
+					}
+
+				if ( s == shard )
+					writer = shard_writer;
+				}
+			}
 
 		// Write takes ownership of vals.
 		assert(writer);
@@ -930,15 +1519,170 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 	return true;
 	}
 
-threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
+namespace {
+
+// Packs a log row into a single allocation: the array of values, the
+// values themselves including those nested in sets and vectors, and
+// their string data. It's built in two passes, first measuring each of
+// a row's values and then packing them in the same order. Enum names
+// aren't copied, they point into the (never deleted) enum types, and
+// neither are immortal strings, such as the interned ones, which get
+// formatted from the same bytes each time.
+class RowPacker {
+public:
+	RowPacker()	{ num_values = num_pointers = 0; num_bytes = 0; }
+	~RowPacker();
+
+	void Measure(Val* val, BroType* ty = 0);
+	void MeasureUnset()	{ ++num_values; }
+
+	// For values that a LogValConverter takes care of.
+	void MeasureConverted()	{ ++num_values; }
+
+	// Allocates the row after all its values have been measured.
+	threading::Value** Allocate(int num_fields);
+
+	threading::Value* Pack(Val* val, BroType* ty = 0);
+	threading::Value* PackUnset(TypeTag type)
+		{ return NewValue(type, false); }
+
+	threading::Value* PackConverted(LogValConverter convert, Val* val,
+					TypeTag type)
+		{
+		threading::Value* lval = NewValue(type, true);
+		convert(lval, val);
+		return lval;
+		}
+
+private:
+	threading::Value* NewValue(TypeTag type, bool present);
+	void PackString(threading::Value* lval, const char* data, int len);
+
+	int num_values;
+	int num_pointers;
+	size_t num_bytes;
+
+	// Computed while measuring, used again while packing.
+	list<ListVal*> sets;
+	list<string> strings;
+
+	threading::Value** next_pointer;
+	threading::Value* next_value;
+	char* next_byte;
+};
+
+}
+
+RowPacker::~RowPacker()
+	{
+	for ( list<ListVal*>::iterator i = sets.begin(); i != sets.end(); ++i )
+		Unref(*i);
+	}
+
+void RowPacker::Measure(Val* val, BroType* ty)
+	{
+	if ( ! ty )
+		ty = val->Type();
+
+	++num_values;
+
+	if ( ! val )
+		return;
+
+	switch ( ty->Tag() ) {
+	case TYPE_STRING:
+		if ( ! val->IsImmortal() )
+			num_bytes += val->AsString()->Len();
+		break;
+
+	case TYPE_FILE:
+		strings.push_back(val->AsFile()->Name());
+		num_bytes += strings.back().size() + 1;
+		break;
+
+	case TYPE_FUNC:
+		{
+		ODesc d;
+		val->AsFunc()->Describe(&d);
+		strings.push_back(d.Description());
+		num_bytes += strings.back().size() + 1;
+		break;
+		}
+
+	case TYPE_TABLE:
+		{
+		ListVal* set = val->AsTableVal()->ConvertToPureList();
+		if ( ! set )
+			// ConvertToPureList has reported an internal warning
+			// already. Just keep going by making something up.
+			set = new ListVal(TYPE_INT);
+
+		sets.push_back(set);
+		num_pointers += set->Length();
+
+		for ( int i = 0; i < set->Length(); i++ )
+			Measure(set->Index(i));
+
+		break;
+		}
+
+	case TYPE_VECTOR:
+		{
+		const vector<Val*>* elems = val->AsVector();
+		BroType* yt = val->Type()->AsVectorType()->YieldType();
+		num_pointers += elems->size();
+
+		for ( unsigned int i = 0; i < elems->size(); i++ )
+			Measure((*elems)[i], yt);
+
+		break;
+		}
+
+	default:
+		break;
+	}
+	}
+
+threading::Value** RowPacker::Allocate(int num_fields)
+	{
+	// The block is aligned for any type; the pointers keep the values
+	// following them aligned.
+	size_t pointers = (num_fields + num_pointers) * sizeof(threading::Value*);
+	size_t values = num_values * sizeof(threading::Value);
+
+	threading::Value** row = threading::Value::AllocateRow(pointers + values + num_bytes);
+	char* block = reinterpret_cast<char*>(row);
+	next_pointer = row + num_fields;
+	next_value = reinterpret_cast<threading::Value*>(block + pointers);
+	next_byte = block + pointers + values;
+
+	return row;
+	}
+
+threading::Value* RowPacker::NewValue(TypeTag type, bool present)
+	{
+	threading::Value* lval = new (next_value++) threading::Value(type, present);
+	lval->packed = true;
+	return lval;
+	}
+
+void RowPacker::PackString(threading::Value* lval, const char* data, int len)
+	{
+	memcpy(next_byte, data, len);
+	lval->val.string_val.data = next_byte;
+	lval->val.string_val.length = len;
+	next_byte += len;
+	}
+
+threading::Value* RowPacker::Pack(Val* val, BroType* ty)
 	{
 	if ( ! ty )
 		ty = val->Type();
 
 	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+		return NewValue(ty->Tag(), false);
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	threading::Value* lval = NewValue(ty->Tag(), true);
 
 	switch ( lval->type ) {
 	case TYPE_BOOL:
@@ -951,18 +1695,14 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 		const char* s =
 			val->Type()->AsEnumType()->Lookup(val->InternalInt());
 
-		if ( s )
-			{
-			lval->val.string_val.data = copy_string(s);
-			lval->val.string_val.length = strlen(s);
-			}
-
-		else
+		if ( ! s )
 			{
 			val->Type()->Error("enum type does not contain value", val);
-			lval->val.string_val.data = copy_string("");
-			lval->val.string_val.length = 0;
+			s = "";
 			}
+
+		lval->val.string_val.data = const_cast<char*>(s);
+		lval->val.string_val.length = strlen(s);
 		break;
 		}
 
@@ -993,47 +1733,39 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 	case TYPE_STRING:
 		{
 		const BroString* s = val->AsString();
-		char* buf = new char[s->Len()];
-		memcpy(buf, s->Bytes(), s->Len());
 
-		lval->val.string_val.data = buf;
-		lval->val.string_val.length = s->Len();
-		break;
-		}
+		if ( val->IsImmortal() )
+			{
+			lval->val.string_val.data = (char*) s->Bytes();
+			lval->val.string_val.length = s->Len();
+			}
+		else
+			PackString(lval, (const char*) s->Bytes(), s->Len());
 
-	case TYPE_FILE:
-		{
-		const BroFile* f = val->AsFile();
-		string s = f->Name();
-		lval->val.string_val.data = copy_string(s.c_str());
-		lval->val.string_val.length = s.size();
 		break;
 		}
 
+	case TYPE_FILE:
 	case TYPE_FUNC:
 		{
-		ODesc d;
-		const Func* f = val->AsFunc();
-		f->Describe(&d);
-		const char* s = d.Description();
-		lval->val.string_val.data = copy_string(s);
-		lval->val.string_val.length = strlen(s);
+		const string& s = strings.front();
+		PackString(lval, s.c_str(), s.size() + 1);
+		lval->val.string_val.length = s.size();
+		strings.pop_front();
 		break;
 		}
 
 	case TYPE_TABLE:
 		{
-		ListVal* set = val->AsTableVal()->ConvertToPureList();
-		if ( ! set )
-			// ConvertToPureList has reported an internal warning
-			// already. Just keep going by making something up.
-			set = new ListVal(TYPE_INT);
+		ListVal* set = sets.front();
+		sets.pop_front();
 
 		lval->val.set_val.size = set->Length();
-		lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+		lval->val.set_val.vals = next_pointer;
+		next_pointer += set->Length();
 
 		for ( int i = 0; i < lval->val.set_val.size; i++ )
-			lval->val.set_val.vals[i] = ValToLogVal(set->Index(i));
+			lval->val.set_val.vals[i] = Pack(set->Index(i));
 
 		Unref(set);
 		break;
@@ -1041,17 +1773,14 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 
 	case TYPE_VECTOR:
 		{
-		VectorVal* vec = val->AsVectorVal();
-		lval->val.vector_val.size = vec->Size();
-		lval->val.vector_val.vals =
-			new threading::Value* [lval->val.vector_val.size];
+		const vector<Val*>* elems = val->AsVector();
+		BroType* yt = val->Type()->AsVectorType()->YieldType();
+		lval->val.vector_val.size = elems->size();
+		lval->val.vector_val.vals = next_pointer;
+		next_pointer += elems->size();
 
 		for ( int i = 0; i < lval->val.vector_val.size; i++ )
-			{
-			lval->val.vector_val.vals[i] =
-				ValToLogVal(vec->Lookup(i),
-					    vec->Type()->YieldType());
-			}
+			lval->val.vector_val.vals[i] = Pack((*elems)[i], yt);
 
 		break;
 		}
@@ -1076,51 +1805,99 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			ext_rec = res->AsRecordVal();
 		}
 
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	if ( filter->num_fields == 0 )
+		{
+		if ( ext_rec )
+			Unref(ext_rec);
+
+		return new threading::Value*[0];
+		}
+
+	// First find the value for each field, which can potentially be
+	// nested inside other records; null if it's not set.
+	Val** fvals = new Val*[filter->num_fields];
+	RowPacker packer;
+
+	const Filter::FieldPlan* plan = &filter->plan[0];
+	const int* steps = filter->steps.empty() ? 0 : &filter->steps[0];
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
-		Val* val;
-		if ( i < filter->num_ext_fields )
-			{
-			if ( ! ext_rec )
-				{
-				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
-				continue;
-				}
+		const Filter::FieldPlan& f = plan[i];
 
-			val = ext_rec;
-			}
-		else
-			val = columns;
+		// If the executing function did not return a record, send
+		// empty values for all of its fields.
+		Val* val = f.from_ext ? ext_rec : columns;
 
-		// For each field, first find the right value, which can
-		// potentially be nested inside other records.
-		list<int>& indices = filter->indices[i];
+		const int* step = steps + f.first_step;
 
-		for ( list<int>::iterator j = indices.begin(); j != indices.end(); ++j )
-			{
-			val = val->AsRecordVal()->Lookup(*j);
+		for ( int j = 0; val && j < f.num_steps; ++j )
+			val = val->AsRecordVal()->Lookup(step[j]);
 
-			if ( ! val )
-				{
-				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
-				break;
-				}
-			}
+		fvals[i] = val;
 
-		if ( val )
-			vals[i] = ValToLogVal(val);
+		if ( ! val )
+			packer.MeasureUnset();
+		else if ( f.convert )
+			packer.MeasureConverted();
+		else
+			packer.Measure(val);
+		}
+
+	threading::Value** vals = packer.Allocate(filter->num_fields);
+
+	for ( int i = 0; i < filter->num_fields; ++i )
+		{
+		TypeTag type = filter->fields[i]->type;
+
+		if ( ! fvals[i] )
+			vals[i] = packer.PackUnset(type);
+		else if ( plan[i].convert )
+			vals[i] = packer.PackConverted(plan[i].convert, fvals[i], type);
+		else
+			vals[i] = packer.Pack(fvals[i]);
 		}
 
+	delete [] fvals;
+
 	if ( ext_rec )
 		Unref(ext_rec);
 
+	if ( filter->addr_anonymization != KEEP_ORIG_ADDR )
+		AnonymizeAddrs(filter, vals);
+
 	return vals;
 	}
 
+void Manager::AnonymizeAddrs(Filter* filter, threading::Value** vals)
+	{
+	AnonymizeIPAddr* anon = 0;
+
+	if ( filter->addr_anonymization > 0 &&
+	     filter->addr_anonymization < NUM_ADDR_ANONYMIZATION_METHODS )
+		anon = ip_anonymizer[filter->addr_anonymization];
+
+	if ( ! anon )
+		{
+		reporter->Error("invalid address anonymization for log filter %s",
+				filter->name.c_str());
+		filter->addr_anonymization = KEEP_ORIG_ADDR;
+		return;
+		}
+
+	for ( int i = 0; i < filter->num_fields; ++i )
+		{
+		threading::Value* v = vals[i];
+
+		if ( v->type != TYPE_ADDR || ! v->present ||
+		     v->val.addr_val.family != IPv4 )
+			continue;
+
+		struct in_addr* a = &v->val.addr_val.in.in4;
+		a->s_addr = anon->Anonymize(a->s_addr);
+		}
+	}
+
 WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBackend::WriterInfo* info,
 				int num_fields, const threading::Field* const*  fields, bool local, bool remote, bool from_remote,
 				const string& instantiating_filter)
@@ -1160,7 +1937,7 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
 		{
 		Filter* f = *it;
 		if ( f->writer->AsEnum() == writer->AsEnum() &&
-		     f->path == info->path )
+		     IsPathOrShard(stream, f->path, info->path) )
 			{
 			found_filter_match = true;
 			winfo->interval = f->interval;
@@ -1191,6 +1968,11 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
 	winfo->info->rotation_base = parse_rotate_base_time(base_time);
 
 	winfo->writer = new WriterFrontend(*winfo->info, id, writer, local, remote);
+	winfo->writer->SetMaxDelay(stream->max_delay);
+	winfo->writer->SetQueueLimits(stream->max_queued_rows,
+				      stream->max_queued_bytes,
+				      stream->overload_policy,
+				      stream->overload_sample_rate);
 	winfo->writer->Init(num_fields, fields);
 
 	InstallRotationTimer(winfo);
@@ -1198,18 +1980,66 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
 	return winfo->writer;
 	}
 
-void Manager::DeleteVals(int num_fields, threading::Value** vals)
+string Manager::ShardPath(const Stream* stream, const string& path, int shard)
+	{
+	if ( stream->num_shards <= 1 )
+		return path;
+
+	char num[32];
+	snprintf(num, sizeof(num), ".%d", shard);
+	return path + num;
+	}
+
+bool Manager::IsPathOrShard(const Stream* stream, const string& path,
+			    const string& candidate)
 	{
-	// Note this code is duplicated in WriterBackend::DeleteVals().
-	for ( int i = 0; i < num_fields; i++ )
-		delete vals[i];
+	if ( stream->num_shards <= 1 )
+		return candidate == path;
 
-	delete [] vals;
+	for ( int s = 0; s < stream->num_shards; ++s )
+		{
+		if ( candidate == ShardPath(stream, path, s) )
+			return true;
+		}
+
+	return false;
+	}
+
+void Manager::DeleteVals(int num_fields, threading::Value** vals)
+	{
+	threading::Value::DeleteRow(num_fields, vals);
 	}
 
 bool Manager::Write(EnumVal* id, EnumVal* writer, string path, int num_fields,
 		   threading::Value** vals)
 	{
+	WriterFrontend* w;
+
+	if ( ! LookupWriter(id, writer, path, &w) )
+		{
+		DeleteVals(num_fields, vals);
+		return false;
+		}
+
+	if ( ! w )
+		{
+		DeleteVals(num_fields, vals);
+		return true;
+		}
+
+	w->Write(num_fields, vals);
+
+	DBG_LOG(DBG_LOGGING,
+		"Wrote pre-filtered record to path '%s'", path.c_str());
+
+	return true;
+	}
+
+bool Manager::LookupWriter(EnumVal* id, EnumVal* writer, const string& path,
+			   WriterFrontend** w)
+	{
+	*w = 0;
+
 	Stream* stream = FindStream(id);
 
 	if ( ! stream )
@@ -1221,20 +2051,16 @@ bool Manager::Write(EnumVal* id, EnumVal* writer, string path, int num_fields,
 		DBG_LOG(DBG_LOGGING, "unknown stream %s in Manager::Write()",
 			desc.Description());
 #endif
-		DeleteVals(num_fields, vals);
 		return false;
 		}
 
 	if ( ! stream->enabled )
-		{
-		DeleteVals(num_fields, vals);
 		return true;
-		}
 
-	Stream::WriterMap::iterator w =
+	Stream::WriterMap::iterator i =
 		stream->writers.find(Stream::WriterPathPair(writer->AsEnum(), path));
 
-	if ( w == stream->writers.end() )
+	if ( i == stream->writers.end() )
 		{
 		// Don't know this writer.
 #ifdef DEBUG
@@ -1243,16 +2069,10 @@ bool Manager::Write(EnumVal* id, EnumVal* writer, string path, int num_fields,
 		DBG_LOG(DBG_LOGGING, "unknown writer %s in Manager::Write()",
 			desc.Description());
 #endif
-		DeleteVals(num_fields, vals);
 		return false;
 		}
 
-	w->second->writer->Write(num_fields, vals);
-
-	DBG_LOG(DBG_LOGGING,
-		"Wrote pre-filtered record to path '%s' on stream '%s'",
-		path.c_str(), stream->name.c_str());
-
+	*w = i->second->writer;
 	return true;
 	}
 
@@ -1313,6 +2133,41 @@ bool Manager::Flush(EnumVal* id)
 	return true;
 	}
 
+TableVal* Manager::GetWriterStats()
+	{
+	TableVal* stats = new TableVal(BifType::Table::Log::WriterStatsTable);
+
+	for ( vector<Stream *>::iterator s = streams.begin(); s != streams.end(); ++s )
+		{
+		if ( ! *s )
+			continue;
+
+		for ( Stream::WriterMap::iterator i = (*s)->writers.begin();
+		      i != (*s)->writers.end(); i++ )
+			{
+			WriterFrontend* writer = i->second->writer;
+
+			RecordVal* r = new RecordVal(BifType::Record::Log::WriterStats);
+			int n = 0;
+
+			r->Assign(n++, val_mgr->GetCount(writer->BatchSize()));
+			r->Assign(n++, val_mgr->GetCount(writer->Buffered()));
+			r->Assign(n++, val_mgr->GetCount(writer->Batches()));
+			r->Assign(n++, val_mgr->GetCount(writer->QueueDepth()));
+			r->Assign(n++, val_mgr->GetCount(writer->QueuedRows()));
+			r->Assign(n++, val_mgr->GetCount(writer->QueuedBytes()));
+			r->Assign(n++, val_mgr->GetCount(writer->Dropped()));
+			r->Assign(n++, val_mgr->GetCount(writer->Blocked()));
+
+			Val* index = new StringVal(writer->Name());
+			stats->Assign(index, r);
+			Unref(index);
+			}
+		}
+
+	return stats;
+	}
+
 void Manager::Terminate()
 	{
 	for ( vector<Stream *>::iterator s = streams.begin(); s != streams.end(); ++s )
@@ -1504,7 +2359,7 @@ bool Manager::FinishedRotation(WriterFrontend* writer, const char* new_name, con
 	info->Assign(2, new StringVal(winfo->writer->Info().path));
 	info->Assign(3, new Val(open, TYPE_TIME));
 	info->Assign(4, new Val(close, TYPE_TIME));
-	info->Assign(5, new Val(terminating, TYPE_BOOL));
+	info->Assign(5, val_mgr->GetBool(terminating));
 
 	Func* func = winfo->postprocessor;
 	if ( ! func )
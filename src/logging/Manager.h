@@ -152,6 +152,17 @@ public:
 	 */
 	bool Flush(EnumVal* id);
 
+	/**
+	 * Returns statistics about the write buffers of all writers.
+	 *
+	 * This methods corresponds directly to the internal BiF defined in
+	 * logging.bif, which just forwards here.
+	 *
+	 * @return A table of \c Log::WriterStats records indexed by writer
+	 * name.
+	 */
+	TableVal* GetWriterStats();
+
 	/**
 	 * Signals the manager to shutdown at Bro's termination.
 	 */
@@ -207,6 +218,13 @@ protected:
 	bool Write(EnumVal* id, EnumVal* writer, string path,
 		   int num_fields, threading::Value** vals);
 
+	// Finds the writer that the Write() above passes rows on to, so that
+	// a batch of them for the same one needs only one lookup. Returns
+	// false if there's no such writer. For a disabled stream, returns
+	// true but sets *w to null, as its rows get dropped.
+	bool LookupWriter(EnumVal* id, EnumVal* writer, const string& path,
+			  WriterFrontend** w);
+
 	// Announces all instantiated writers to peer.
 	void SendAllWritersTo(RemoteSerializer::PeerID peer);
 
@@ -228,8 +246,18 @@ private:
 	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
 				    RecordVal* columns);
 
-	threading::Value* ValToLogVal(Val* val, BroType* ty = 0);
+	// Applies a filter's addr_anonymization to its converted values.
+	void AnonymizeAddrs(Filter* filter, threading::Value** vals);
+
 	Stream* FindStream(EnumVal* id);
+
+	// Returns the path of one of the writers of a stream with more than
+	// one writer thread, or the path itself for other streams.
+	static string ShardPath(const Stream* stream, const string& path, int shard);
+
+	// Returns true if a candidate is a path or one of its shards' paths.
+	static bool IsPathOrShard(const Stream* stream, const string& path,
+				  const string& candidate);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
 	void Rotate(WriterInfo* info);
@@ -240,6 +268,7 @@ private:
 
 	vector<Stream *> streams;	// Indexed by stream enum.
 	int rotations_pending;	// Number of rotations not yet finished.
+	int num_column_sets;	// Number of distinct filter column sets.
 };
 
 }
@@ -1,6 +1,8 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include "util.h"
+#include "Metrics.h"
+#include "NetVar.h"
 #include "threading/SerialTypes.h"
 
 #include "Manager.h"
@@ -127,6 +129,9 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	frontend = arg_frontend;
 	info = new WriterInfo(frontend->Info());
 	rotation_counter = 0;
+	queued_rows = 0;
+	queued_bytes = 0;
+	shed_rows = 0;
 
 	SetName(frontend->Name());
 	}
@@ -144,16 +149,15 @@ WriterBackend::~WriterBackend()
 	delete info;
 	}
 
+const char* WriterBackend::CPUs() const
+	{
+	return BifConst::Threading::log_writer_cpus->CheckString();
+	}
+
 void WriterBackend::DeleteVals(int num_writes, Value*** vals)
 	{
 	for ( int j = 0; j < num_writes; ++j )
-		{
-		// Note this code is duplicated in Manager::DeleteVals().
-		for ( int i = 0; i < num_fields; i++ )
-			delete vals[j][i];
-
-		delete [] vals[j];
-		}
+		Value::DeleteRow(num_fields, vals[j]);
 
 	delete [] vals;
 	}
@@ -196,6 +200,12 @@ bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	return true;
 	}
 
+// Updated by the writer threads, so that the difference to logging.writes
+// is what's queued up (or was shed) on the way.
+static metrics::Counter* rows_written_metric =
+	metrics::registry()->NewCounter("logging.rows_written",
+					"Log rows that writers wrote out.");
+
 bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	{
 	// Double-check that the arguments match. If we get this from remote,
@@ -233,19 +243,29 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 			}
 		}
 
-	bool success = true;
+	// Discard the oldest rows if the frontend has asked for it.
+	uint64 shed = shed_rows;
+	int first = 0;
 
-	if ( ! Failed() )
+	while ( shed > 0 )
 		{
-		for ( int j = 0; j < num_writes; j++ )
-			{
-			success = DoWrite(num_fields, fields, vals[j]);
+		uint64 n = min(shed, uint64(num_writes));
 
-			if ( ! success )
-				break;
+		if ( shed_rows.compare_exchange_weak(shed, shed - n) )
+			{
+			first = n;
+			break;
 			}
 		}
 
+	bool success = true;
+
+	if ( ! Failed() && first < num_writes )
+		{
+		success = DoWriteBatch(num_fields, fields, num_writes - first, vals + first);
+		rows_written_metric->Inc(num_writes - first);
+		}
+
 	DeleteVals(num_writes, vals);
 
 	if ( ! success )
@@ -254,6 +274,18 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::DoWriteBatch(int num_fields, const Field* const* fields,
+				 int num_writes, Value*** vals)
+	{
+	for ( int j = 0; j < num_writes; j++ )
+		{
+		if ( ! DoWrite(num_fields, fields, vals[j]) )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
@@ -5,6 +5,8 @@
 #ifndef LOGGING_WRITERBACKEND_H
 #define LOGGING_WRITERBACKEND_H
 
+#include <atomic>
+
 #include "threading/MsgThread.h"
 
 #include "Component.h"
@@ -152,6 +154,45 @@ public:
 	 */
 	bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+	/**
+	 * Accounts for rows that the frontend has queued for writing. This
+	 * method is thread-safe.
+	 *
+	 * @param rows The number of rows.
+	 *
+	 * @param bytes The memory the rows take up.
+	 */
+	void Queued(uint64 rows, uint64 bytes)
+		{ queued_rows += rows; queued_bytes += bytes; }
+
+	/**
+	 * Accounts for queued rows that have been written or discarded.
+	 * This method is thread-safe.
+	 */
+	void Dequeued(uint64 rows, uint64 bytes)
+		{ queued_rows -= rows; queued_bytes -= bytes; }
+
+	/**
+	 * Returns the number of rows queued, but not written yet. This
+	 * method is thread-safe.
+	 */
+	uint64 QueuedRows() const	{ return queued_rows; }
+
+	/**
+	 * Returns the memory the rows queued, but not written yet, take up.
+	 * This method is thread-safe.
+	 */
+	uint64 QueuedBytes() const	{ return queued_bytes; }
+
+	/**
+	 * Asks the writer to discard the next rows it gets to instead of
+	 * writing them, i.e., the oldest of those queued. This method is
+	 * thread-safe.
+	 *
+	 * @param rows The number of rows to discard.
+	 */
+	void Shed(uint64 rows)	{ shed_rows += rows; }
+
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
 	 * supports that. (If not, it will be ignored).
@@ -258,6 +299,11 @@ public:
 protected:
 	friend class FinishMessage;
 
+	/**
+	 * Returns \c Threading::log_writer_cpus.
+	 */
+	virtual const char* CPUs() const;
+
 	/**
 	 * Writer-specific intialization method.
 	 *
@@ -283,6 +329,23 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method implementing recording of a batch
+	 * of log entries, as they arrive from the frontend together.
+	 *
+	 * A writer implementation may override this method to handle a
+	 * whole batch at once, e.g. in a single database transaction. The
+	 * default implementation calls DoWrite() for each entry. The
+	 * return value has the same meaning as DoWrite()'s.
+	 *
+	 * @param num_writes The number of entries in the batch.
+	 *
+	 * @param vals The entries in the batch, each passed on as to
+	 * DoWrite(). The caller keeps ownership.
+	 */
+	virtual bool DoWriteBatch(int num_fields, const threading::Field* const*  fields,
+				  int num_writes, threading::Value*** vals);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -388,6 +451,11 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+
+	// Shared with the frontend's thread.
+	std::atomic<uint64> queued_rows;	// Rows queued for writing.
+	std::atomic<uint64> queued_bytes;	// Memory of the queued rows.
+	std::atomic<uint64> shed_rows;	// Queued rows to discard.
 };
 
 
@@ -1,5 +1,7 @@
+#include <unistd.h>
 
 #include "Net.h"
+#include "NetVar.h"
 #include "threading/SerialTypes.h"
 
 #include "Manager.h"
@@ -54,16 +56,23 @@ private:
 class WriteMessage : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals,
+		     uint64 bytes)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		num_fields(num_fields), num_writes(num_writes), vals(vals), bytes(bytes)	{}
 
-	virtual bool Process() { return Object()->Write(num_fields, num_writes, vals); }
+	virtual bool Process()
+		{
+		bool result = Object()->Write(num_fields, num_writes, vals);
+		Object()->Dequeued(num_writes, bytes);
+		return result;
+		}
 
 private:
 	int num_fields;
 	int num_writes;
 	Value ***vals;
+	uint64 bytes;
 };
 
 class SetBufMessage : public threading::InputMessage<WriterBackend>
@@ -110,6 +119,17 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	remote = arg_remote;
 	write_buffer = 0;
 	write_buffer_pos = 0;
+	batch_size = WRITER_BUFFER_SIZE;
+	first_write = 0;
+	max_delay = 0;
+	batches = 0;
+	buffered_bytes = 0;
+	max_queued_rows = max_queued_bytes = 0;
+	overload_policy = BifEnum::Log::BLOCK;
+	sample_rate = 1;
+	sample_counter = 0;
+	overloaded = false;
+	dropped = overload_dropped = blocked = 0;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -203,17 +223,34 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		return;
 		}
 
+	uint64 bytes = Value::RowSize(num_fields, vals);
+
+	if ( (max_queued_rows || max_queued_bytes) && ! Admit(bytes) )
+		{
+		DeleteVals(arg_num_fields, vals);
+		return;
+		}
+
 	if ( ! write_buffer )
 		{
 		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
+		write_buffer = new Value**[batch_size];
 		write_buffer_pos = 0;
+		first_write = network_time;
 		}
 
 	write_buffer[write_buffer_pos++] = vals;
+	buffered_bytes += bytes;
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || terminating )
-		// Buffer full (or no bufferin desired or termiating).
+	if ( write_buffer_pos >= batch_size )
+		{
+		// Buffer full.
+		AdaptBatchSize(true);
+		FlushWriteBuffer();
+		}
+
+	else if ( ! buf || terminating || network_time - first_write >= max_delay )
+		// No buffering desired, termiating, or waited long enough.
 		FlushWriteBuffer();
 
 	}
@@ -224,12 +261,137 @@ void WriterFrontend::FlushWriteBuffer()
 		// Nothing to do.
 		return;
 
+	if ( write_buffer_pos < batch_size )
+		AdaptBatchSize(false);
+
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		{
+		backend->Queued(write_buffer_pos, buffered_bytes);
+		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos,
+						 write_buffer, buffered_bytes));
+		}
+
+	++batches;
 
 	// Clear buffer (no delete, we pass ownership to child thread.)
 	write_buffer = 0;
 	write_buffer_pos = 0;
+	buffered_bytes = 0;
+	}
+
+void WriterFrontend::AdaptBatchSize(bool filled)
+	{
+	int max_batch_size = max(int(BifConst::Log::max_batch_size), 1);
+
+	if ( filled )
+		{
+		// Busy stream: larger batches save messaging overhead.
+		// Writes stay within the delay bound regardless.
+		batch_size = min(2 * batch_size, max_batch_size);
+		return;
+		}
+
+	// A batch that got flushed mostly empty means we're waiting for
+	// writes longer than needed, unless the backend is falling behind
+	// anyways, in which case larger batches help it to catch up.
+	if ( write_buffer_pos < batch_size / 4 && QueueDepth() <= 1 )
+		batch_size = max(batch_size / 2, MIN_BATCH_SIZE);
+
+	if ( batch_size > max_batch_size )
+		batch_size = max_batch_size;
+	}
+
+uint64 WriterFrontend::QueueDepth() const
+	{
+	if ( ! backend )
+		return 0;
+
+	threading::MsgThread::Stats stats;
+	backend->GetStats(&stats);
+	return stats.pending_in;
+	}
+
+void WriterFrontend::SetQueueLimits(uint64 max_rows, uint64 max_bytes, int policy,
+				    uint64 arg_sample_rate)
+	{
+	max_queued_rows = max_rows;
+	max_queued_bytes = max_bytes;
+	overload_policy = policy;
+	sample_rate = max(arg_sample_rate, uint64(1));
+	}
+
+uint64 WriterFrontend::QueuedRows() const
+	{
+	return write_buffer_pos + (backend ? backend->QueuedRows() : 0);
+	}
+
+uint64 WriterFrontend::QueuedBytes() const
+	{
+	return buffered_bytes + (backend ? backend->QueuedBytes() : 0);
+	}
+
+bool WriterFrontend::Overloaded(uint64 bytes) const
+	{
+	return (max_queued_rows && QueuedRows() + 1 > max_queued_rows) ||
+	       (max_queued_bytes && QueuedBytes() + bytes > max_queued_bytes);
+	}
+
+bool WriterFrontend::Admit(uint64 bytes)
+	{
+	if ( ! Overloaded(bytes) )
+		{
+		if ( overloaded )
+			{
+			reporter->Info("log writer %s caught up, %" PRIu64 " rows dropped",
+				       name, overload_dropped);
+			overloaded = false;
+			}
+
+		return true;
+		}
+
+	if ( ! overloaded )
+		{
+		reporter->Warning("log writer %s can't keep up, queue limits reached",
+				  name);
+		overloaded = true;
+		overload_dropped = 0;
+		}
+
+	switch ( overload_policy ) {
+	case BifEnum::Log::BLOCK:
+		// Wait for the backend to make room. A row larger than the
+		// whole byte limit still goes through once the queue is
+		// empty.
+		++blocked;
+		FlushWriteBuffer();
+
+		while ( backend && ! backend->Killed() && Overloaded(bytes) &&
+			QueuedRows() > 0 )
+			usleep(1000);
+
+		return true;
+
+	case BifEnum::Log::DROP_OLDEST:
+		// Keep the queue at its limit by having the backend discard
+		// one of the oldest rows for each new one.
+		backend->Shed(1);
+		++dropped;
+		++overload_dropped;
+		return true;
+
+	case BifEnum::Log::SAMPLE:
+		if ( ++sample_counter % sample_rate == 0 )
+			return true;
+
+		// Fall through.
+
+	case BifEnum::Log::DROP_NEWEST:
+	default:
+		++dropped;
+		++overload_dropped;
+		return false;
+	}
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
@@ -274,9 +436,5 @@ void WriterFrontend::Rotate(const char* rotated_path, double open, double close,
 
 void WriterFrontend::DeleteVals(int num_fields, Value** vals)
 	{
-	// Note this code is duplicated in Manager::DeleteVals().
-	for ( int i = 0; i < num_fields; i++ )
-		delete vals[i];
-
-	delete [] vals;
+	Value::DeleteRow(num_fields, vals);
 	}
@@ -158,6 +158,74 @@ public:
 	 */
 	void FlushWriteBuffer();
 
+	/**
+	 * Sets the longest time that writes may wait in the write buffer.
+	 *
+	 * @param delay The delay in seconds of network time.
+	 */
+	void SetMaxDelay(double delay)	{ max_delay = delay; }
+
+	/**
+	 * Returns the number of writes the write buffer currently collects
+	 * before passing them on to the backend.
+	 */
+	int BatchSize() const	{ return batch_size; }
+
+	/**
+	 * Returns the number of writes currently in the write buffer.
+	 */
+	int Buffered() const	{ return write_buffer_pos; }
+
+	/**
+	 * Returns the number of batches of writes sent to the backend.
+	 */
+	uint64 Batches() const	{ return batches; }
+
+	/**
+	 * Returns the number of messages waiting for the backend to
+	 * process them.
+	 */
+	uint64 QueueDepth() const;
+
+	/**
+	 * Limits the rows queued for the backend, either in the write
+	 * buffer or waiting for the backend to get to them.
+	 *
+	 * @param max_rows The maximum number of rows, zero for no limit.
+	 *
+	 * @param max_bytes The maximum memory the rows may take up, zero
+	 * for no limit.
+	 *
+	 * @param policy The BifEnum::Log::OverloadPolicy for writes beyond
+	 * the limits.
+	 *
+	 * @param sample_rate With the SAMPLE policy, writes beyond the
+	 * limits keep one row out of this many.
+	 */
+	void SetQueueLimits(uint64 max_rows, uint64 max_bytes, int policy,
+			    uint64 sample_rate);
+
+	/**
+	 * Returns the number of rows queued for the backend.
+	 */
+	uint64 QueuedRows() const;
+
+	/**
+	 * Returns the memory the rows queued for the backend take up.
+	 */
+	uint64 QueuedBytes() const;
+
+	/**
+	 * Returns the number of rows dropped because of the queue limits.
+	 */
+	uint64 Dropped() const	{ return dropped; }
+
+	/**
+	 * Returns the number of writes that waited for the backend
+	 * because of the queue limits.
+	 */
+	uint64 Blocked() const	{ return blocked; }
+
 	/**
 	 * Disables the writer frontend. From now on, all method calls that
 	 * would normally send message over to the backend, turn into no-ops.
@@ -220,10 +288,37 @@ protected:
 	int num_fields;	// The number of log fields.
 	const threading::Field* const*  fields;	// The log fields.
 
-	// Buffer for bulk writes.
-	static const int WRITER_BUFFER_SIZE = 1000;
+	// Adapts the batch size to how a batch filled.
+	void AdaptBatchSize(bool filled);
+
+	// Applies the queue limits to a new row. Returns false if the row
+	// is to be dropped.
+	bool Admit(uint64 bytes);
+
+	// Returns true if a new row would exceed the queue limits.
+	bool Overloaded(uint64 bytes) const;
+
+	// Buffer for bulk writes. Its size adapts to the write rate.
+	static const int WRITER_BUFFER_SIZE = 1000;	// Initial batch size.
+	static const int MIN_BATCH_SIZE = 10;
+	int batch_size;	// Size of the next buffer.
 	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	threading::Value*** write_buffer;	// Buffer of size batch_size.
+	double first_write;	// Network time of the buffer's first write.
+	double max_delay;	// Longest time a write may stay buffered.
+	uint64 batches;	// Number of batches sent to the backend.
+	uint64 buffered_bytes;	// Memory of the rows in the buffer.
+
+	// Queue limits, see SetQueueLimits().
+	uint64 max_queued_rows;
+	uint64 max_queued_bytes;
+	int overload_policy;
+	uint64 sample_rate;
+	uint64 sample_counter;
+	bool overloaded;	// True while limits are being enforced.
+	uint64 dropped;	// Rows dropped because of the limits.
+	uint64 overload_dropped;	// ... since the current overload started.
+	uint64 blocked;	// Writes that waited because of the limits.
 };
 
 }
@@ -18,11 +18,13 @@ using threading::Field;
 Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	{
 	fd = 0;
+	gzfile = 0;
 	ascii_done = false;
 	output_to_stdout = false;
 	include_meta = false;
 	tsv = false;
 	use_json = false;
+	gzip_level = 0;
 	formatter = 0;
 
 	InitConfigOptions();
@@ -34,6 +36,7 @@ void Ascii::InitConfigOptions()
 	output_to_stdout = BifConst::LogAscii::output_to_stdout;
 	include_meta = BifConst::LogAscii::include_meta;
 	use_json = BifConst::LogAscii::use_json;
+	gzip_level = BifConst::LogAscii::gzip_level;
 
 	separator.assign(
 			(const char*) BifConst::LogAscii::separator->Bytes(),
@@ -115,6 +118,20 @@ bool Ascii::InitFilterOptions()
 				}
 			}
 
+		else if ( strcmp(i->first, "gzip_level") == 0 )
+			{
+			char* end;
+			long level = strtol(i->second, &end, 10);
+
+			if ( *i->second == '\0' || *end != '\0' || level < 0 || level > 9 )
+				{
+				Error("invalid value for 'gzip_level', must be a number between 0 and 9");
+				return false;
+				}
+
+			gzip_level = level;
+			}
+
 		else if ( strcmp(i->first, "separator") == 0 )
 			separator.assign(i->second);
 
@@ -192,7 +209,7 @@ bool Ascii::WriteHeaderField(const string& key, const string& val)
 	{
 	string str = meta_prefix + key + separator + val + "\n";
 
-	return safe_write(fd, str.c_str(), str.length());
+	return InternalWrite(fd, str.c_str(), str.length());
 	}
 
 void Ascii::CloseFile(double t)
@@ -203,7 +220,7 @@ void Ascii::CloseFile(double t)
 	if ( include_meta && ! tsv )
 		WriteHeaderField("close", Timestamp(0));
 
-	safe_close(fd);
+	InternalClose(fd);
 	fd = 0;
 	}
 
@@ -221,6 +238,9 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 
 	fname = IsSpecial(path) ? path : path + "." + LogExt();
 
+	if ( gzip_level > 0 && ! IsSpecial(path) )
+		fname += ".gz";
+
 	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
 
 	if ( fd < 0 )
@@ -231,6 +251,19 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 		return false;
 		}
 
+	if ( gzip_level > 0 && ! IsSpecial(path) )
+		{
+		gzfile = gzdopen(fd, Fmt("wb%d", gzip_level));
+
+		if ( ! gzfile )
+			{
+			Error(Fmt("cannot compress %s", fname.c_str()));
+			safe_close(fd);
+			fd = 0;
+			return false;
+			}
+		}
+
 	if ( ! WriteHeader(path) )
 		{
 		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
@@ -264,7 +297,7 @@ bool Ascii::WriteHeader(const string& path)
 		{
 		// A single TSV-style line is all we need.
 		string str = names + "\n";
-		if ( ! safe_write(fd, str.c_str(), str.length()) )
+		if ( ! InternalWrite(fd, str.c_str(), str.length()) )
 			return false;
 
 		return true;
@@ -275,7 +308,7 @@ bool Ascii::WriteHeader(const string& path)
 		+ get_escaped_string(separator, false)
 		+ "\n";
 
-	if ( ! safe_write(fd, str.c_str(), str.length()) )
+	if ( ! InternalWrite(fd, str.c_str(), str.length()) )
 		return false;
 
 	if ( ! (WriteHeaderField("set_separator", get_escaped_string(set_separator, false)) &&
@@ -294,6 +327,11 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	// A sync flush completes the compressed data so far, so that it
+	// can be decompressed by whoever follows the file.
+	if ( gzfile )
+		gzflush(gzfile, Z_SYNC_FLUSH);
+
 	fsync(fd);
 	return true;
 	}
@@ -337,18 +375,18 @@ bool Ascii::DoWrite(int num_fields, const Field* const * fields,
 		char hex[4] = {'\\', 'x', '0', '0'};
 		bytetohex(bytes[0], hex + 2);
 
-		if ( ! safe_write(fd, hex, 4) )
+		if ( ! InternalWrite(fd, hex, 4) )
 			goto write_error;
 
 		++bytes;
 		--len;
 		}
 
-	if ( ! safe_write(fd, bytes, len) )
+	if ( ! InternalWrite(fd, bytes, len) )
 		goto write_error;
 
         if ( ! IsBuf() )
-		fsync(fd);
+		DoFlush(0);
 
 	return true;
 
@@ -370,6 +408,9 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
 	string nname = string(rotated_path) + "." + LogExt();
 
+	if ( gzip_level > 0 )
+		nname += ".gz";
+
 	if ( rename(fname.c_str(), nname.c_str()) != 0 )
 		{
 		char buf[256];
@@ -401,6 +442,50 @@ bool Ascii::DoHeartbeat(double network_time, double current_time)
 	return true;
 	}
 
+bool Ascii::InternalWrite(int fd, const char* data, int len)
+	{
+	if ( ! gzfile )
+		return safe_write(fd, data, len);
+
+	while ( len > 0 )
+		{
+		int n = gzwrite(gzfile, data, len);
+
+		if ( n <= 0 )
+			{
+			const char* err = gzerror(gzfile, &n);
+			Error(Fmt("error compressing %s: %s", fname.c_str(), err));
+			return false;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
+bool Ascii::InternalClose(int fd)
+	{
+	if ( ! gzfile )
+		{
+		safe_close(fd);
+		return true;
+		}
+
+	// This closes the descriptor as well.
+	int res = gzclose(gzfile);
+	gzfile = 0;
+
+	if ( res != Z_OK )
+		{
+		Error(Fmt("error closing %s", fname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
 string Ascii::LogExt()
 	{
 	const char* ext = getenv("BRO_LOG_SUFFIX");
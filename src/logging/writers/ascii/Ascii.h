@@ -5,6 +5,8 @@
 #ifndef LOGGING_WRITER_ASCII_H
 #define LOGGING_WRITER_ASCII_H
 
+#include <zlib.h>
+
 #include "logging/WriterBackend.h"
 #include "threading/formatters/Ascii.h"
 #include "threading/formatters/JSON.h"
@@ -42,8 +44,11 @@ private:
 	void InitConfigOptions();
 	bool InitFilterOptions();
 	bool InitFormatter();
+	bool InternalWrite(int fd, const char* data, int len);
+	bool InternalClose(int fd);
 
 	int fd;
+	gzFile gzfile;
 	string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -61,6 +66,7 @@ private:
 
 	bool use_json;
 	string json_timestamps;
+	int gzip_level;
 
 	threading::formatter::Formatter* formatter;
 	bool init_options;
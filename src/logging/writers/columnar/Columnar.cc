@@ -0,0 +1,498 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "threading/SerialTypes.h"
+
+#include "Columnar.h"
+#include "columnar.bif.h"
+
+using namespace logging::writer;
+using namespace threading;
+using threading::Value;
+using threading::Field;
+
+static const char* const columnar_magic = "BROCOL1\n";
+
+// Dictionary encoding stops for a column once it has collected this many
+// distinct values in a chunk, or more than a quarter of the chunk's rows;
+// such columns are mostly unique values like UIDs.
+static const unsigned int max_dictionary_size = 65536;
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	fd = 0;
+	offset = 0;
+	columnar_done = false;
+	chunk_rows = 0;
+	total_rows = 0;
+
+	rows_per_chunk = BifConst::LogColumnar::rows_per_chunk;
+	compression_level = BifConst::LogColumnar::compression_level;
+	dictionary_encoding = BifConst::LogColumnar::dictionary_encoding;
+
+	if ( rows_per_chunk == 0 )
+		rows_per_chunk = 1;
+
+	if ( compression_level > 9 )
+		compression_level = 9;
+	}
+
+Columnar::~Columnar()
+	{
+	if ( ! columnar_done )
+		// In case of errors aborting the logging altogether,
+		// DoFinish() may not have been called.
+		CloseFile();
+
+	for ( unsigned int i = 0; i < columns.size(); ++i )
+		delete columns[i];
+	}
+
+string Columnar::LogExt()
+	{
+	return "bcol";
+	}
+
+bool Columnar::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
+	{
+	assert(! fd);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		Column* c = new Column;
+		c->field = fields[i];
+		ResetColumn(c);
+		columns.push_back(c);
+		}
+
+	fname = string(info.path) + "." + LogExt();
+
+	return OpenFile();
+	}
+
+bool Columnar::OpenFile()
+	{
+	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s: %s", fname.c_str(),
+			  Strerror(errno)));
+		fd = 0;
+		return false;
+		}
+
+	offset = 0;
+	total_rows = 0;
+	chunk_index.clear();
+
+	string header(columnar_magic);
+	AddString(&header, Info().path, strlen(Info().path));
+	AddDouble(&header, current_time(true));
+	AddVarint(&header, columns.size());
+
+	for ( unsigned int i = 0; i < columns.size(); ++i )
+		{
+		const Field* f = columns[i]->field;
+		string type = f->TypeName();
+		AddString(&header, f->name, strlen(f->name));
+		AddString(&header, type.data(), type.size());
+		header += char(f->type);
+		header += char(f->subtype);
+		header += char(f->optional ? 1 : 0);
+		}
+
+	return Write(header);
+	}
+
+bool Columnar::CloseFile()
+	{
+	if ( ! fd )
+		return true;
+
+	bool ok = WriteChunk();
+
+	if ( ok )
+		{
+		uint64 footer_offset = offset;
+
+		string footer("F");
+		AddVarint(&footer, total_rows);
+		AddVarint(&footer, chunk_index.size());
+
+		for ( unsigned int i = 0; i < chunk_index.size(); ++i )
+			{
+			AddVarint(&footer, chunk_index[i].first);
+			AddVarint(&footer, chunk_index[i].second);
+			}
+
+		for ( int i = 0; i < 8; ++i )
+			footer += char((footer_offset >> (8 * i)) & 0xff);
+
+		footer += columnar_magic;
+
+		ok = Write(footer);
+		}
+
+	safe_close(fd);
+	fd = 0;
+
+	return ok;
+	}
+
+bool Columnar::Write(const string& data)
+	{
+	if ( ! safe_write(fd, data.data(), data.size()) )
+		return Fail();
+
+	offset += data.size();
+	return true;
+	}
+
+bool Columnar::Fail()
+	{
+	Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+	return false;
+	}
+
+void Columnar::ResetColumn(Column* c)
+	{
+	c->dictionary = dictionary_encoding && IsStringType(c->field->type);
+	c->presence.clear();
+	c->values.clear();
+	c->index.clear();
+	c->entries.clear();
+	c->rows.clear();
+	}
+
+bool Columnar::DoWrite(int num_fields, const Field* const * fields,
+			     Value** vals)
+	{
+	if ( ! fd && ! OpenFile() )
+		return false;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		Column* c = columns[i];
+
+		if ( c->field->optional )
+			{
+			if ( chunk_rows % 8 == 0 )
+				c->presence += '\0';
+
+			if ( vals[i]->present )
+				c->presence[chunk_rows / 8] |= (1 << (chunk_rows % 8));
+			}
+
+		if ( vals[i]->present )
+			AddValue(c, vals[i]);
+		}
+
+	if ( ++chunk_rows >= rows_per_chunk )
+		return WriteChunk();
+
+	return true;
+	}
+
+void Columnar::AddValue(Column* c, const Value* val)
+	{
+	if ( ! c->dictionary )
+		{
+		AddPlain(&c->values, val);
+		return;
+		}
+
+	string s(val->val.string_val.data, val->val.string_val.length);
+	std::map<string, uint32>::iterator i = c->index.find(s);
+
+	if ( i != c->index.end() )
+		{
+		c->rows.push_back(i->second);
+		return;
+		}
+
+	if ( c->entries.size() >= max_dictionary_size ||
+	     c->entries.size() > rows_per_chunk / 4 )
+		{
+		// Too many distinct values, fall back to plain values for the
+		// rest of the chunk.
+		for ( unsigned int j = 0; j < c->rows.size(); ++j )
+			{
+			const string* e = c->entries[c->rows[j]];
+			AddString(&c->values, e->data(), e->size());
+			}
+
+		c->dictionary = false;
+		c->index.clear();
+		c->entries.clear();
+		c->rows.clear();
+
+		AddPlain(&c->values, val);
+		return;
+		}
+
+	uint32 n = c->entries.size();
+	i = c->index.insert(std::make_pair(s, n)).first;
+	c->entries.push_back(&i->first);
+	c->rows.push_back(n);
+	}
+
+bool Columnar::WriteChunk()
+	{
+	if ( chunk_rows == 0 )
+		return true;
+
+	chunk_index.push_back(std::make_pair(offset, chunk_rows));
+	total_rows += chunk_rows;
+
+	string head("C");
+	AddVarint(&head, chunk_rows);
+
+	bool ok = Write(head);
+
+	for ( unsigned int i = 0; i < columns.size(); ++i )
+		{
+		if ( ok )
+			ok = WriteColumn(columns[i]);
+
+		ResetColumn(columns[i]);
+		}
+
+	chunk_rows = 0;
+
+	return ok;
+	}
+
+bool Columnar::WriteColumn(Column* c)
+	{
+	string raw(c->presence);
+
+	if ( c->dictionary )
+		{
+		AddVarint(&raw, c->entries.size());
+
+		for ( unsigned int i = 0; i < c->entries.size(); ++i )
+			AddString(&raw, c->entries[i]->data(), c->entries[i]->size());
+
+		for ( unsigned int i = 0; i < c->rows.size(); ++i )
+			AddVarint(&raw, c->rows[i]);
+		}
+	else
+		raw += c->values;
+
+	string stored;
+	bool compressed = false;
+
+	if ( compression_level > 0 && raw.size() > 0 )
+		{
+		uLongf len = compressBound(raw.size());
+		stored.resize(len);
+
+		if ( compress2((Bytef*) &stored[0], &len, (const Bytef*) raw.data(),
+			       raw.size(), compression_level) == Z_OK &&
+		     len < raw.size() )
+			{
+			stored.resize(len);
+			compressed = true;
+			}
+		}
+
+	string head;
+	head += char(c->dictionary ? 1 : 0);
+	head += char(compressed ? 1 : 0);
+	AddVarint(&head, raw.size());
+	AddVarint(&head, compressed ? stored.size() : raw.size());
+
+	return Write(head) && Write(compressed ? stored : raw);
+	}
+
+bool Columnar::IsStringType(TypeTag t)
+	{
+	return t == TYPE_STRING || t == TYPE_ENUM || t == TYPE_FILE || t == TYPE_FUNC;
+	}
+
+void Columnar::AddVarint(string* s, uint64 n)
+	{
+	while ( n >= 0x80 )
+		{
+		*s += char((n & 0x7f) | 0x80);
+		n >>= 7;
+		}
+
+	*s += char(n);
+	}
+
+void Columnar::AddString(string* s, const char* data, uint64 len)
+	{
+	AddVarint(s, len);
+	s->append(data, len);
+	}
+
+void Columnar::AddDouble(string* s, double d)
+	{
+	uint64 bits;
+	memcpy(&bits, &d, sizeof(bits));
+
+	for ( int i = 0; i < 8; ++i )
+		*s += char((bits >> (8 * i)) & 0xff);
+	}
+
+void Columnar::AddPlain(string* s, const Value* val)
+	{
+	switch ( val->type ) {
+	case TYPE_BOOL:
+		*s += char(val->val.int_val ? 1 : 0);
+		break;
+
+	case TYPE_INT:
+		{
+		// Zigzag encoding keeps small negative numbers short.
+		int64 i = val->val.int_val;
+		AddVarint(s, (uint64(i) << 1) ^ uint64(i >> 63));
+		break;
+		}
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		AddVarint(s, val->val.uint_val);
+		break;
+
+	case TYPE_PORT:
+		AddVarint(s, val->val.port_val.port);
+		*s += char(val->val.port_val.proto);
+		break;
+
+	case TYPE_SUBNET:
+	case TYPE_ADDR:
+		{
+		const Value::addr_t& a = val->type == TYPE_ADDR ?
+			val->val.addr_val : val->val.subnet_val.prefix;
+
+		if ( a.family == IPv4 )
+			{
+			*s += char(4);
+			s->append((const char*) &a.in.in4, 4);
+			}
+		else
+			{
+			*s += char(6);
+			s->append((const char*) &a.in.in6, 16);
+			}
+
+		if ( val->type == TYPE_SUBNET )
+			*s += char(val->val.subnet_val.length);
+
+		break;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_INTERVAL:
+	case TYPE_TIME:
+		AddDouble(s, val->val.double_val);
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		AddString(s, val->val.string_val.data, val->val.string_val.length);
+		break;
+
+	case TYPE_TABLE:
+		AddVarint(s, val->val.set_val.size);
+
+		for ( int i = 0; i < val->val.set_val.size; ++i )
+			AddPlain(s, val->val.set_val.vals[i]);
+
+		break;
+
+	case TYPE_VECTOR:
+		AddVarint(s, val->val.vector_val.size);
+
+		for ( int i = 0; i < val->val.vector_val.size; ++i )
+			AddPlain(s, val->val.vector_val.vals[i]);
+
+		break;
+
+	default:
+		// Can't happen, the logging framework only passes on
+		// the types above.
+		break;
+	}
+	}
+
+bool Columnar::DoFlush(double network_time)
+	{
+	// Get everything so far out into a (possibly short) chunk.
+	if ( ! fd )
+		return true;
+
+	if ( ! WriteChunk() )
+		return false;
+
+	fsync(fd);
+	return true;
+	}
+
+bool Columnar::DoFinish(double network_time)
+	{
+	if ( columnar_done )
+		{
+		fprintf(stderr, "internal error: duplicate finish\n");
+		abort();
+		}
+
+	columnar_done = true;
+
+	return CloseFile();
+	}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( ! fd )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	// The footer needs writing before the file can be used.
+	CloseFile();
+
+	string nname = string(rotated_path) + "." + LogExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::DoSetBuf(bool enabled)
+	{
+	// Nothing to do, rows are always buffered into chunks.
+	return true;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	// Nothing to do.
+	return true;
+	}
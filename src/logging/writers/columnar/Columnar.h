@@ -0,0 +1,115 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for compressed, column-oriented binary logs.
+//
+// The writer buffers rows and writes them out column by column in chunks
+// of up to LogColumnar::rows_per_chunk rows. All integers below are
+// unsigned LEB128 varints unless noted otherwise, and strings are a
+// varint length followed by the bytes. A file looks like this:
+//
+//     magic      "BROCOL1\n"
+//     header     path, open time (8-byte LE double), number of fields,
+//                then per field its name, its type name as in ASCII
+//                logs (e.g. "set[string]"), its type tag byte, its
+//                subtype tag byte, and a byte that's 1 if it's optional.
+//     chunk*     'C', number of rows, then per field a column:
+//                encoding byte (0 plain, 1 dictionary), compression
+//                byte (0 none, 1 zlib), raw size, stored size, and the
+//                stored bytes.
+//     footer     'F', total rows, number of chunks, then per chunk its
+//                file offset and number of rows.
+//     trailer    the footer's file offset (8-byte LE), "BROCOL1\n".
+//
+// Uncompressed, a column starts with a bitmap of which rows have the
+// field set (LSB first) if the field is optional. The values of the rows
+// that have it follow. Plain values are a byte for bools, zigzag varints
+// for ints, varints for counts, the number and a transport protocol byte
+// for ports, the family (4 or 6) and the address bytes in network order
+// for addresses, followed by the length byte for subnets, 8-byte LE
+// doubles for doubles, times and intervals, and strings for strings,
+// enums, files and functions. Sets and vectors are the number of
+// elements followed by the elements' plain values. Dictionary encoded
+// columns, only used for string-like types, hold the number of distinct
+// values, those values, and each row's index into them.
+
+#ifndef LOGGING_WRITER_COLUMNAR_H
+#define LOGGING_WRITER_COLUMNAR_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logging/WriterBackend.h"
+
+namespace logging { namespace writer {
+
+class Columnar : public WriterBackend {
+public:
+	Columnar(WriterFrontend* frontend);
+	~Columnar();
+
+	static string LogExt();
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	virtual bool DoInit(const WriterInfo& info, int num_fields,
+			    const threading::Field* const* fields);
+	virtual bool DoWrite(int num_fields, const threading::Field* const* fields,
+			     threading::Value** vals);
+	virtual bool DoSetBuf(bool enabled);
+	virtual bool DoRotate(const char* rotated_path, double open,
+			      double close, bool terminating);
+	virtual bool DoFlush(double network_time);
+	virtual bool DoFinish(double network_time);
+	virtual bool DoHeartbeat(double network_time, double current_time);
+
+private:
+	// The buffered values of one field for the current chunk.
+	struct Column {
+		const threading::Field* field;
+		bool dictionary;	// still collecting a dictionary
+		string presence;	// bitmap, for optional fields
+		string values;	// plain values
+		std::map<string, uint32> index;	// dictionary indices
+		std::vector<const string*> entries;	// dictionary in index order
+		std::vector<uint32> rows;	// dictionary index per value
+	};
+
+	bool OpenFile();
+	bool CloseFile();
+	bool WriteChunk();
+	bool WriteColumn(Column* c);
+	bool Write(const string& data);
+	bool Fail();
+	void ResetColumn(Column* c);
+	void AddValue(Column* c, const threading::Value* val);
+
+	static bool IsStringType(TypeTag t);
+	static void AddVarint(string* s, uint64 n);
+	static void AddString(string* s, const char* data, uint64 len);
+	static void AddDouble(string* s, double d);
+	static void AddPlain(string* s, const threading::Value* val);
+
+	int fd;
+	string fname;
+	uint64 offset;	// of the next byte to write
+	bool columnar_done;
+
+	std::vector<Column*> columns;
+	uint64 chunk_rows;
+	uint64 total_rows;
+	std::vector<std::pair<uint64, uint64> > chunk_index;	// offset, rows
+
+	// Options set from the script-level.
+	uint64 rows_per_chunk;
+	int compression_level;
+	bool dictionary_encoding;
+};
+
+}
+}
+
+
+#endif
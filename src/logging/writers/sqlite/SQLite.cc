@@ -18,7 +18,8 @@ using threading::Field;
 
 SQLite::SQLite(WriterFrontend* frontend)
 	: WriterBackend(frontend),
-	  fields(), num_fields(), db(), st()
+	  fields(), num_fields(), db(), st(),
+	  batch_timing(), batches(), rows(), batch_time(), max_batch_time()
 	{
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
@@ -111,6 +112,40 @@ bool SQLite::checkError(int code)
 	return false;
 	}
 
+bool SQLite::Exec(const string& statement)
+	{
+	char *errorMsg = 0;
+	int res = sqlite3_exec(db, statement.c_str(), NULL, NULL, &errorMsg);
+	if ( res != SQLITE_OK )
+		{
+		Error(Fmt("Error executing '%s': %s", statement.c_str(), errorMsg));
+		sqlite3_free(errorMsg);
+		return false;
+		}
+
+	return true;
+	}
+
+// Sets a pragma from the writer's config option of the same name, if
+// given. Only the listed values are accepted, as they go into the
+// statement verbatim.
+bool SQLite::SetPragma(const WriterInfo& info, const char* name,
+		       const char* const* values)
+	{
+	WriterInfo::config_map::const_iterator it = info.config.find(name);
+	if ( it == info.config.end() )
+		return true;
+
+	for ( const char* const* v = values; *v; ++v )
+		{
+		if ( strcasecmp(it->second, *v) == 0 )
+			return Exec(Fmt("PRAGMA %s = %s;", name, *v));
+		}
+
+	Error(Fmt("invalid value '%s' for SQLite option %s", it->second, name));
+	return false;
+	}
+
 bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 			    const Field* const * arg_fields)
 	{
@@ -150,6 +185,21 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 					NULL)) )
 		return false;
 
+	static const char* const journal_modes[] = {
+		"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF", 0
+	};
+
+	static const char* const synchronous_modes[] = {
+		"OFF", "NORMAL", "FULL", "EXTRA", 0
+	};
+
+	it = info.config.find("batch_timing");
+	batch_timing = (it != info.config.end() && strcmp(it->second, "T") == 0);
+
+	if ( ! (SetPragma(info, "journal_mode", journal_modes) &&
+		SetPragma(info, "synchronous", synchronous_modes)) )
+		return false;
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 		//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -356,6 +406,57 @@ bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	return true;
 	}
 
+bool SQLite::DoWriteBatch(int num_fields, const Field* const * fields,
+			  int num_writes, Value*** vals)
+	{
+	// Committing each row on its own is slow, so the whole batch goes
+	// into one transaction.
+	double start = current_time(true);
+
+	if ( ! Exec("BEGIN TRANSACTION;") )
+		return false;
+
+	bool success = true;
+
+	for ( int j = 0; j < num_writes; j++ )
+		{
+		if ( ! DoWrite(num_fields, fields, vals[j]) )
+			{
+			success = false;
+			break;
+			}
+		}
+
+	// Keep what got written before any failure, as separate commits
+	// would have.
+	if ( ! Exec("COMMIT;") )
+		return false;
+
+	double elapsed = current_time(true) - start;
+
+	++batches;
+	rows += num_writes;
+	batch_time += elapsed;
+
+	if ( elapsed > max_batch_time )
+		max_batch_time = elapsed;
+
+	if ( batch_timing )
+		MsgThread::Info(Fmt("wrote batch of %d rows in %.6f secs",
+				    num_writes, elapsed));
+
+	return success;
+	}
+
+bool SQLite::DoFinish(double network_time)
+	{
+	if ( batch_timing && batches )
+		MsgThread::Info(Fmt("wrote %" PRIu64 " rows in %" PRIu64 " batches in %.6f secs, longest batch %.6f secs",
+				    rows, batches, batch_time, max_batch_time));
+
+	return true;
+	}
+
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating))
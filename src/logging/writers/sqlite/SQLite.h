@@ -26,15 +26,20 @@ protected:
 			    const threading::Field* const* arg_fields);
 	virtual bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals);
+	virtual bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+				  int num_writes, threading::Value*** vals);
 	virtual bool DoSetBuf(bool enabled) { return true; }
 	virtual bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating);
 	virtual bool DoFlush(double network_time)	{ return true; }
-	virtual bool DoFinish(double network_time)	{ return true; }
+	virtual bool DoFinish(double network_time);
 	virtual bool DoHeartbeat(double network_time, double current_time)	{ return true; }
 
 private:
 	bool checkError(int code);
+	bool Exec(const string& statement);
+	bool SetPragma(const WriterInfo& info, const char* name,
+		       const char* const* values);
 
 	int AddParams(threading::Value* val, int pos);
 	string GetTableType(int, int);
@@ -50,6 +55,13 @@ private:
 	string empty_field;
 
 	threading::formatter::Ascii* io;
+
+	// Statistics on the write batches, each written in a transaction.
+	bool batch_timing;	// True to report each batch's timing.
+	uint64 batches;
+	uint64 rows;
+	double batch_time;	// Total time spent writing batches.
+	double max_batch_time;	// Longest time a batch took.
 };
 
 }
@@ -46,7 +46,12 @@ extern "C" void OPENSSL_add_all_algorithms_conf(void);
 #include "EventRegistry.h"
 #include "Stats.h"
 #include "Brofiler.h"
+#include "ScriptProfiler.h"
+#include "MetricsServer.h"
+#include "PacketRing.h"
+#include "LoadShedder.h"
 
+#include "threading/CPUAffinity.h"
 #include "threading/Manager.h"
 #include "input/Manager.h"
 #include "logging/Manager.h"
@@ -125,9 +130,11 @@ OpaqueType* md5_type = 0;
 OpaqueType* sha1_type = 0;
 OpaqueType* sha256_type = 0;
 OpaqueType* entropy_type = 0;
+OpaqueType* moments_type = 0;
 OpaqueType* cardinality_type = 0;
 OpaqueType* topk_type = 0;
 OpaqueType* bloomfilter_type = 0;
+OpaqueType* cuckoofilter_type = 0;
 OpaqueType* x509_opaque_type = 0;
 
 // Keep copy of command line
@@ -217,6 +224,11 @@ void usage()
 	fprintf(stderr, "    $BRO_LOG_SUFFIX                | ASCII log file extension (.%s)\n", logging::writer::Ascii::LogExt().c_str());
 	fprintf(stderr, "    $BRO_PROFILER_FILE             | Output file for script execution statistics (not set)\n");
 	fprintf(stderr, "    $BRO_DISABLE_BROXYGEN          | Disable Broxygen documentation support (%s)\n", getenv("BRO_DISABLE_BROXYGEN") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_TIMER_WHEEL               | Use a timing wheel for the global timers (%s)\n", getenv("BRO_TIMER_WHEEL") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_NO_OBJ_POOLS              | Allocate connection state through malloc only (%s)\n", getenv("BRO_NO_OBJ_POOLS") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_COMPILE_SCRIPTS           | Run script functions and event handlers as bytecode (%s)\n", getenv("BRO_COMPILE_SCRIPTS") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_NO_SCRIPT_OPTIMIZATION    | Disable constant folding in scripts (%s)\n", getenv("BRO_NO_SCRIPT_OPTIMIZATION") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_HASH_FUNCTION             | Hash function for tables, siphash24 or siphash13 (%s)\n", getenv("BRO_HASH_FUNCTION") ? getenv("BRO_HASH_FUNCTION") : "siphash24");
 
 	fprintf(stderr, "\n");
 
@@ -313,6 +325,12 @@ void done_with_network()
 
 	net_finish(1);
 
+	// Connections are gone now, so nothing's going to add packets. This
+	// isn't part of net_finish(), which the watchdog calls from its
+	// signal handler, where waiting for the writer's lock could deadlock.
+	if ( packet_ring_writer )
+		packet_ring_writer->Finish();
+
 #ifdef USE_PERFTOOLS_DEBUG
 
 		if ( perftools_profile )
@@ -341,6 +359,9 @@ void terminate_bro()
 
 	brofiler.WriteStats();
 
+	if ( script_profiler )
+		script_profiler->Stop();
+
 	EventHandlerPtr bro_done = internal_handler("bro_done");
 	if ( bro_done )
 		mgr.QueueEvent(bro_done, new val_list);
@@ -382,6 +403,8 @@ void terminate_bro()
 	delete log_mgr;
 	delete plugin_mgr;
 	delete reporter;
+	delete packet_ring_writer;
+	delete load_shedder;
 	delete iosource_mgr;
 
 	reporter = 0;
@@ -711,6 +734,7 @@ int main(int argc, char** argv)
 	bro_start_time = current_time(true);
 
 	reporter = new Reporter();
+	val_mgr = new ValManager();
 	thread_mgr = new threading::Manager();
 	plugin_mgr = new plugin::Manager();
 
@@ -751,7 +775,10 @@ int main(int argc, char** argv)
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr("<GLOBAL>");
+	if ( getenv("BRO_TIMER_WHEEL") )
+		timer_mgr = new TW_TimerMgr("<GLOBAL>");
+	else
+		timer_mgr = new PQ_TimerMgr("<GLOBAL>");
 	// timer_mgr = new CQ_TimerMgr();
 
 	broxygen_mgr = new broxygen::Manager(broxygen_config, bro_argv[0]);
@@ -791,6 +818,7 @@ int main(int argc, char** argv)
 	dns_mgr->SetDir(".state");
 
 	iosource_mgr = new iosource::Manager();
+	packet_ring_writer = new PacketRingWriter();
 	persistence_serializer = new PersistenceSerializer();
 	remote_serializer = new RemoteSerializer();
 	event_registry = new EventRegistry();
@@ -835,9 +863,11 @@ int main(int argc, char** argv)
 	sha1_type = new OpaqueType("sha1");
 	sha256_type = new OpaqueType("sha256");
 	entropy_type = new OpaqueType("entropy");
+	moments_type = new OpaqueType("moments");
 	cardinality_type = new OpaqueType("cardinality");
 	topk_type = new OpaqueType("topk");
 	bloomfilter_type = new OpaqueType("bloomfilter");
+	cuckoofilter_type = new OpaqueType("cuckoofilter");
 	x509_opaque_type = new OpaqueType("x509");
 
 	// The leak-checker tends to produce some false
@@ -859,6 +889,17 @@ int main(int argc, char** argv)
 
 	plugin_mgr->InitBifs();
 
+	if ( reporter->Errors() > 0 )
+		exit(1);
+
+	// As early as the option is available, so that most of what we
+	// allocate comes from the CPUs' node, and so that all threads
+	// started from here on, including the communication ones, inherit
+	// the setting.
+	threading::pin_thread(pthread_self(),
+			      BifConst::Threading::main_cpus->CheckString(),
+			      "main thread");
+
 	if ( reporter->Errors() > 0 )
 		exit(1);
 
@@ -892,6 +933,7 @@ int main(int argc, char** argv)
 		}
 
 	reporter->InitOptions();
+	load_shedder = LoadShedder::Create();
 	broxygen_mgr->GenerateDocs();
 
 	if ( user_pcap_filter )
@@ -1040,6 +1082,20 @@ int main(int argc, char** argv)
 		// we don't have any other source for it.
 		net_update_time(current_time());
 
+	simplify_script_functions();
+
+	EventRegistry::string_list* empty_handlers =
+		event_registry->SuppressEmptyHandlers();
+
+	if ( report_empty_event_handlers )
+		{
+		for ( int i = 0; i < empty_handlers->length(); ++i )
+			reporter->Info("not generating event with empty handlers: %s",
+				       (*empty_handlers)[i]);
+		}
+
+	delete empty_handlers;
+
 	EventHandlerPtr bro_init = internal_handler("bro_init");
 	if ( bro_init )	//### this should be a function
 		mgr.QueueEvent(bro_init, new val_list);
@@ -1087,7 +1143,7 @@ int main(int argc, char** argv)
 
 		val_list* vl = new val_list;
 		vl->append(new StringVal(i->name.c_str()));
-		vl->append(new Val(i->include_level, TYPE_COUNT));
+		vl->append(val_mgr->GetCount(i->include_level));
 		mgr.QueueEvent(bro_script_loaded, vl);
 		}
 
@@ -1102,6 +1158,20 @@ int main(int argc, char** argv)
 
 	iosource_mgr->Register(thread_mgr, true);
 
+	if ( BifConst::metrics_port->Port() )
+		{
+		metrics_server = new MetricsServer();
+
+		if ( metrics_server->Listen(BifConst::metrics_address->CheckString(),
+					    BifConst::metrics_port->Port()) )
+			iosource_mgr->Register(metrics_server, true);
+		else
+			{
+			delete metrics_server;
+			metrics_server = 0;
+			}
+		}
+
 	if ( iosource_mgr->Size() > 0 ||
 	     have_pending_timers ||
 	     BifConst::exit_only_after_terminate )
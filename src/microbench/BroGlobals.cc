@@ -0,0 +1,10 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// The microbenchmarks link against the same objects as the bro binary,
+// which refer to the globals that live in main.cc. We pull them in from
+// there rather than keeping a copy, and rename its main() out of the way
+// of our own.
+
+#define main bro_main
+#include "../main.cc"
+#undef main
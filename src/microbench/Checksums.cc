@@ -0,0 +1,30 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for the ones-complement checksum that validates IP, TCP,
+// UDP and ICMP headers and payloads.
+
+#include "bro-config.h"
+
+#include <vector>
+
+#include "Microbench.h"
+#include "net_util.h"
+
+using namespace microbench;
+
+// Arguments: number of bytes checksummed, from an IPv4 header up to a jumbo
+// frame.
+static void OnesComplementChecksum(State& state)
+	{
+	std::vector<u_char> data(state.Arg(0));
+
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = i * 7;
+
+	while ( state.KeepRunning() )
+		DoNotOptimize(ones_complement_checksum(&data[0], data.size(), 0));
+
+	state.SetBytesProcessed(state.Iterations() * data.size());
+	}
+
+MICROBENCH(OnesComplementChecksum)->Arg(20)->Arg(64)->Arg(576)->Arg(1500)->Arg(9000);
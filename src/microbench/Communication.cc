@@ -0,0 +1,144 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for the transport between communicating peers:
+// ChunkedIOFd over a local socket, and ChunkedIOShm on top of it.
+
+#include "bro-config.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Microbench.h"
+#include "ChunkedIO.h"
+#include "Reporter.h"
+
+using namespace microbench;
+
+static const char* transport_names[] = { "socket", "shm" };
+static const char* direction_names[] = { "one-way", "round-trip" };
+
+// Sets up the two ends of a transport, switching them over to shared
+// memory if requested, as peers on the same host do with
+// remote_shm_size set.
+static void make_transport(bool shared_memory, ChunkedIO** a, ChunkedIO** b)
+	{
+	int fds[2];
+
+	if ( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 )
+		reporter->FatalError("can't create socket pair: %s", strerror(errno));
+
+	*a = new ChunkedIOFd(fds[0], "microbench-a");
+	*b = new ChunkedIOFd(fds[1], "microbench-b");
+
+	if ( ! shared_memory )
+		return;
+
+	const char* dir = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+	ChunkedIOShm* shm_a = new ChunkedIOShm(dir, 1024 * 1024);
+	shm_a->SetConnection(*a);
+	*a = shm_a;
+
+	if ( ! shm_a->Init() )
+		reporter->FatalError("can't set up shared memory: %s", shm_a->Error());
+
+	ChunkedIOShm* shm_b = new ChunkedIOShm(shm_a->Path(), 0);
+	shm_b->SetConnection(*b);
+	*b = shm_b;
+
+	if ( ! shm_b->Init() )
+		reporter->FatalError("can't open shared memory: %s", shm_b->Error());
+
+	shm_a->EnableWrites();
+	shm_a->EnableReads();
+	shm_b->EnableWrites();
+	shm_b->EnableReads();
+	}
+
+// Receives one chunk on *to*, moving *from*'s output along while
+// waiting.
+static void receive(ChunkedIO* from, ChunkedIO* to)
+	{
+	for ( ;; )
+		{
+		ChunkedIO::Chunk* c = 0;
+
+		if ( ! from->Flush() || ! to->Read(&c) )
+			reporter->FatalError("transfer failed: %s %s",
+					     from->Error(), to->Error());
+
+		if ( c )
+			{
+			delete c;
+			return;
+			}
+		}
+	}
+
+// Sends one chunk per iteration from one end to the other. In round-trip
+// mode, each chunk gets sent back before the next one goes out, which
+// measures latency; otherwise chunks go one way as fast as possible.
+// Arguments: chunk size, transport (socket or shared memory), direction.
+static void ChunkedIOTransfer(State& state)
+	{
+	uint32 size = state.Arg(0);
+	bool round_trip = state.Arg(2);
+
+	ChunkedIO* a;
+	ChunkedIO* b;
+	make_transport(state.Arg(1), &a, &b);
+
+	uint64 sent = 0;
+	uint64 received = 0;
+
+	while ( state.KeepRunning() )
+		{
+		if ( ! a->Write(new ChunkedIO::Chunk(new char[size], size)) )
+			reporter->FatalError("write failed: %s", a->Error());
+
+		++sent;
+
+		if ( round_trip )
+			{
+			receive(a, b);
+
+			if ( ! b->Write(new ChunkedIO::Chunk(new char[size], size)) )
+				reporter->FatalError("write failed: %s", b->Error());
+
+			receive(b, a);
+			++received;
+			}
+
+		else if ( a->IsFillingUp() )
+			{
+			// Let the other end catch up.
+			while ( received + 1 < sent )
+				{
+				receive(a, b);
+				++received;
+				}
+			}
+		}
+
+	// What's still in flight counts as well.
+	state.ResumeTiming();
+
+	while ( received < sent )
+		{
+		receive(a, b);
+		++received;
+		}
+
+	state.PauseTiming();
+
+	state.SetBytesProcessed(sent * size * (round_trip ? 2 : 1));
+	state.SetLabel(fmt("%s/%s", transport_names[state.Arg(1)],
+			   direction_names[round_trip]));
+
+	delete a;
+	delete b;
+	}
+
+MICROBENCH(ChunkedIOTransfer)->ArgsProduct({{64, 1000, 65536},
+					    {0, 1},
+					    {0, 1}});
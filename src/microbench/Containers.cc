@@ -0,0 +1,495 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for the container classes: Dictionary, PriorityQueue,
+// IntSet, BitVector, and PrefixTable.
+
+#include "bro-config.h"
+
+#include <algorithm>
+#include <random>
+
+#include "Microbench.h"
+#include "Dict.h"
+#include "Hash.h"
+#include "IntSet.h"
+#include "IPAddr.h"
+#include "PrefixTable.h"
+#include "PriorityQueue.h"
+#include "probabilistic/BitVector.h"
+
+using namespace microbench;
+
+// Key types for the dictionary benchmarks.
+enum { KEY_COUNT, KEY_STRING, KEY_ADDR, KEY_CONN };
+
+// Orders in which to access the keys.
+enum { ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_MISSING };
+
+static const char* key_type_names[] = { "count", "string", "addr", "conn" };
+static const char* access_names[] = { "sequential", "random", "missing" };
+static const char* layout_names[] = { "chained", "open" };
+
+// The same seed every time, so that runs are comparable.
+static const unsigned int SHUFFLE_SEED = 42;
+
+// Builds the i'th key of the given type. Distinct i give distinct keys.
+static HashKey* make_key(int type, int64 i)
+	{
+	switch ( type ) {
+	case KEY_STRING:
+		{
+		std::string s = fmt("host-%" PRId64 ".example.com", i);
+		HashKey k(s.c_str());
+		return new HashKey(k.Key(), k.Size(), k.Hash());
+		}
+
+	case KEY_ADDR:
+		{
+		// An IPv4 address in its IPv6-mapped form, as in a
+		// connection's key.
+		uint32 a[4] = { 0, 0, htonl(0xffff), htonl(0x0a000000 + uint32(i)) };
+		HashKey k(a, 4);
+		return new HashKey(k.Key(), k.Size(), k.Hash());
+		}
+
+	case KEY_CONN:
+		{
+		// Two IPv6 addresses plus the ports, shaped like the keys
+		// of the connection tables.
+		uint32 c[9];
+		memset(c, 0, sizeof(c));
+		c[3] = uint32(i);
+		c[7] = uint32(i) * 2654435761U;
+		HashKey k(c, 9);
+		return new HashKey(k.Key(), k.Size(), k.Hash());
+		}
+
+	default:
+		return new HashKey(bro_int_t(i));
+	}
+	}
+
+class KeySet {
+public:
+	KeySet(int type, int64 n, int64 first = 0)
+		{
+		for ( int64 i = 0; i < n; ++i )
+			keys.push_back(make_key(type, first + i));
+		}
+
+	~KeySet()
+		{
+		for ( size_t i = 0; i < keys.size(); ++i )
+			delete keys[i];
+		}
+
+	void Shuffle()
+		{
+		std::mt19937 rng(SHUFFLE_SEED);
+		std::shuffle(keys.begin(), keys.end(), rng);
+		}
+
+	size_t Size() const	{ return keys.size(); }
+	const HashKey* operator[](size_t i) const	{ return keys[i]; }
+
+private:
+	std::vector<HashKey*> keys;
+};
+
+static Dictionary* fill_dict(const KeySet& keys, int layout)
+	{
+	Dictionary* d = new Dictionary(UNORDERED, DEFAULT_DICT_SIZE,
+					layout ? OPEN_ADDRESSING : CHAINED);
+
+	for ( size_t i = 0; i < keys.Size(); ++i )
+		d->Insert((void*) keys[i]->Key(), keys[i]->Size(), keys[i]->Hash(),
+			  (void*) (i + 1), 1);
+
+	return d;
+	}
+
+static void set_dict_label(State& state)
+	{
+	state.SetLabel(fmt("%s/%s/%s", key_type_names[state.Arg(1)],
+			   access_names[state.Arg(2)],
+			   layout_names[state.Arg(3)]));
+	}
+
+// Arguments: number of keys, key type, access pattern, layout.
+static void DictLookup(State& state)
+	{
+	int64 n = state.Arg(0);
+	int type = state.Arg(1);
+	int access = state.Arg(2);
+
+	KeySet keys(type, n);
+	Dictionary* d = fill_dict(keys, state.Arg(3));
+
+	// Absent keys come from the same space as the present ones.
+	KeySet probes(type, n, access == ACCESS_MISSING ? n : 0);
+
+	if ( access == ACCESS_RANDOM )
+		probes.Shuffle();
+
+	size_t i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		DoNotOptimize(d->Lookup(probes[i]));
+
+		if ( ++i == probes.Size() )
+			i = 0;
+		}
+
+	set_dict_label(state);
+	delete d;
+	}
+
+MICROBENCH(DictLookup)->ArgsProduct({{16, 1024, 65536, 1048576},
+				     {KEY_COUNT, KEY_STRING, KEY_ADDR, KEY_CONN},
+				     {ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_MISSING},
+				     {0, 1}});
+
+// How DictBatchLookup prefetches, as NetSessions does for packet batches.
+enum { PREFETCH_NONE, PREFETCH_ENTRIES, PREFETCH_VALUES };
+
+static const char* prefetch_names[] = { "none", "entries", "entries+values" };
+
+// Size of the objects that DictBatchLookup's values point to, about that
+// of a Connection.
+static const int BATCH_OBJECT_SIZE = 512;
+
+// Looks up a batch of random connection-like keys at a time and touches
+// the object each one's value points to, as processing a packet batch
+// does. Running it under "perf stat -e cache-misses" with the different
+// prefetch modes shows how many of the misses the prefetching hides.
+// Arguments: number of keys, batch size, prefetch mode, layout.
+static void DictBatchLookup(State& state)
+	{
+	int64 n = state.Arg(0);
+	int64 batch_size = state.Arg(1);
+	int prefetch = state.Arg(2);
+	const int distance = 4;
+
+	KeySet keys(KEY_ADDR, n);
+	Dictionary* d = new Dictionary(UNORDERED, DEFAULT_DICT_SIZE,
+					state.Arg(3) ? OPEN_ADDRESSING : CHAINED);
+	std::vector<char*> objects;
+
+	for ( size_t i = 0; i < keys.Size(); ++i )
+		{
+		char* o = new char[BATCH_OBJECT_SIZE];
+		memset(o, int(i), BATCH_OBJECT_SIZE);
+		objects.push_back(o);
+		d->Insert((void*) keys[i]->Key(), keys[i]->Size(),
+			  keys[i]->Hash(), o, 1);
+		}
+
+	KeySet probes(KEY_ADDR, n);
+	probes.Shuffle();
+
+	size_t next = 0;
+
+	while ( state.KeepRunning() )
+		{
+		if ( next + batch_size > probes.Size() )
+			next = 0;
+
+		const size_t first = next;
+		next += batch_size;
+
+		if ( prefetch != PREFETCH_NONE )
+			for ( size_t i = first; i < next; ++i )
+				d->Prefetch(probes[i]->Hash());
+
+		if ( prefetch == PREFETCH_VALUES )
+			for ( size_t i = first; i < next && i < first + distance; ++i )
+				d->PrefetchValue(probes[i]->Hash());
+
+		for ( size_t i = first; i < next; ++i )
+			{
+			if ( prefetch == PREFETCH_VALUES && i + distance < next )
+				d->PrefetchValue(probes[i + distance]->Hash());
+
+			const char* o = (const char*) d->Lookup(probes[i]);
+			DoNotOptimize(o[0]);
+			}
+		}
+
+	state.SetItemsProcessed(state.Iterations() * batch_size);
+	state.SetLabel(fmt("batch %" PRId64 "/%s/%s", batch_size,
+			   prefetch_names[prefetch], layout_names[state.Arg(3)]));
+
+	delete d;
+
+	for ( size_t i = 0; i < objects.size(); ++i )
+		delete [] objects[i];
+	}
+
+MICROBENCH(DictBatchLookup)->ArgsProduct({{65536, 1048576, 4194304},
+					  {8, 32},
+					  {PREFETCH_NONE, PREFETCH_ENTRIES, PREFETCH_VALUES},
+					  {0, 1}});
+
+// Fills a dictionary from empty per iteration, including its resizes.
+// Arguments: number of keys, key type, access pattern (sequential or
+// random), layout.
+static void DictInsert(State& state)
+	{
+	int64 n = state.Arg(0);
+	KeySet keys(state.Arg(1), n);
+
+	if ( state.Arg(2) == ACCESS_RANDOM )
+		keys.Shuffle();
+
+	while ( state.KeepRunning() )
+		delete fill_dict(keys, state.Arg(3));
+
+	state.SetItemsProcessed(state.Iterations() * n);
+	set_dict_label(state);
+	}
+
+MICROBENCH(DictInsert)->ArgsProduct({{16, 1024, 65536},
+				     {KEY_COUNT, KEY_STRING, KEY_ADDR, KEY_CONN},
+				     {ACCESS_SEQUENTIAL, ACCESS_RANDOM},
+				     {0, 1}});
+
+// Removes every key and inserts it again, as a table with a constant
+// number of entries sees when old ones expire and new ones arrive.
+// Arguments: number of keys, key type, access pattern (sequential or
+// random), layout.
+static void DictChurn(State& state)
+	{
+	int64 n = state.Arg(0);
+	KeySet keys(state.Arg(1), n);
+	Dictionary* d = fill_dict(keys, state.Arg(3));
+
+	if ( state.Arg(2) == ACCESS_RANDOM )
+		keys.Shuffle();
+
+	size_t i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		const HashKey* k = keys[i];
+		void* v = d->Remove(k);
+		d->Insert((void*) k->Key(), k->Size(), k->Hash(), v, 1);
+
+		if ( ++i == keys.Size() )
+			i = 0;
+		}
+
+	set_dict_label(state);
+	delete d;
+	}
+
+MICROBENCH(DictChurn)->ArgsProduct({{1024, 65536, 1048576},
+				    {KEY_COUNT, KEY_ADDR, KEY_CONN},
+				    {ACCESS_SEQUENTIAL, ACCESS_RANDOM},
+				    {0, 1}});
+
+// Arguments: number of keys, layout.
+static void DictIterate(State& state)
+	{
+	int64 n = state.Arg(0);
+	KeySet keys(KEY_COUNT, n);
+	Dictionary* d = fill_dict(keys, state.Arg(1));
+
+	while ( state.KeepRunning() )
+		{
+		IterCookie* c = d->InitForIteration();
+		const void* key;
+		int key_len;
+		void* v;
+
+		while ( (v = d->NextEntry(key, key_len, c)) )
+			DoNotOptimize(v);
+		}
+
+	state.SetItemsProcessed(state.Iterations() * n);
+	state.SetLabel(layout_names[state.Arg(1)]);
+	delete d;
+	}
+
+MICROBENCH(DictIterate)->ArgsProduct({{1024, 65536}, {0, 1}});
+
+class BenchElement : public PQ_Element {
+public:
+	BenchElement(double t) : PQ_Element(t)	{ }
+	void SetTime(double t)	{ time = t; }
+};
+
+// Keeps a queue at a constant size, replacing the earliest element with
+// one further in the future, like the timer manager does. Arguments:
+// queue size, access pattern (sequential for monotonically growing times,
+// random for random ones).
+static void PriorityQueueAddRemove(State& state)
+	{
+	int64 n = state.Arg(0);
+	bool random = state.Arg(1) == ACCESS_RANDOM;
+
+	std::mt19937 rng(SHUFFLE_SEED);
+	std::uniform_real_distribution<double> dist(0, 1);
+
+	// The queue deletes the elements when done.
+	PriorityQueue q;
+
+	for ( int64 i = 0; i < n; ++i )
+		q.Add(new BenchElement(random ? dist(rng) * n : i));
+
+	double t = n;
+
+	while ( state.KeepRunning() )
+		{
+		BenchElement* e = (BenchElement*) q.Remove();
+		e->SetTime(random ? e->Time() + dist(rng) * n : t++);
+		q.Add(e);
+		}
+
+	state.SetLabel(access_names[state.Arg(1)]);
+	}
+
+MICROBENCH(PriorityQueueAddRemove)->ArgsProduct({{16, 1024, 65536, 1048576},
+						 {ACCESS_SEQUENTIAL, ACCESS_RANDOM}});
+
+// Arguments: range of the integers, access pattern.
+static void IntSetContains(State& state)
+	{
+	int64 n = state.Arg(0);
+	int access = state.Arg(1);
+
+	IntSet s;
+
+	// Every other one, with the odd ones standing in for the missing.
+	for ( int64 i = 0; i < n; i += 2 )
+		s.Insert(i);
+
+	std::vector<unsigned int> probes;
+
+	for ( int64 i = 0; i < n / 2; ++i )
+		probes.push_back(access == ACCESS_MISSING ? 2 * i + 1 : 2 * i);
+
+	if ( access == ACCESS_RANDOM )
+		{
+		std::mt19937 rng(SHUFFLE_SEED);
+		std::shuffle(probes.begin(), probes.end(), rng);
+		}
+
+	size_t i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		DoNotOptimize(s.Contains(probes[i]));
+
+		if ( ++i == probes.size() )
+			i = 0;
+		}
+
+	state.SetLabel(access_names[access]);
+	}
+
+MICROBENCH(IntSetContains)->ArgsProduct({{1024, 1048576},
+					 {ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_MISSING}});
+
+// Arguments: number of bits, access pattern (sequential or random).
+static void BitVectorSet(State& state)
+	{
+	int64 n = state.Arg(0);
+	probabilistic::BitVector v(n);
+
+	std::vector<probabilistic::BitVector::size_type> idx;
+
+	for ( int64 i = 0; i < n; ++i )
+		idx.push_back(i);
+
+	if ( state.Arg(1) == ACCESS_RANDOM )
+		{
+		std::mt19937 rng(SHUFFLE_SEED);
+		std::shuffle(idx.begin(), idx.end(), rng);
+		}
+
+	size_t i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		v.Set(idx[i]);
+
+		if ( ++i == idx.size() )
+			{
+			i = 0;
+			v.Reset();
+			}
+		}
+
+	state.SetLabel(access_names[state.Arg(1)]);
+	}
+
+MICROBENCH(BitVectorSet)->ArgsProduct({{1024, 1048576},
+				       {ACCESS_SEQUENTIAL, ACCESS_RANDOM}});
+
+// Arguments: number of bits.
+static void BitVectorCount(State& state)
+	{
+	int64 n = state.Arg(0);
+	probabilistic::BitVector v(n);
+
+	for ( int64 i = 0; i < n; i += 3 )
+		v.Set(i);
+
+	while ( state.KeepRunning() )
+		DoNotOptimize(v.Count());
+
+	state.SetBytesProcessed(state.Iterations() * n / 8);
+	}
+
+MICROBENCH(BitVectorCount)->Arg(1024)->Arg(1048576);
+
+// Looks up addresses in a table of /24 subnets (plus a few wider ones
+// they nest in). Arguments: number of subnets, access pattern.
+static void PrefixTableLookup(State& state)
+	{
+	int64 n = state.Arg(0);
+	int access = state.Arg(1);
+
+	PrefixTable t;
+
+	for ( int64 i = 0; i < n; ++i )
+		{
+		uint32 a = htonl(0x0a000000 + (uint32(i) << 8));
+		t.Insert(IPAddr(IPv4, &a, IPAddr::Network), 96 + 24, (void*) 1);
+		}
+
+	t.Insert(IPAddr("10.0.0.0"), 96 + 8, (void*) 2);
+	t.Insert(IPAddr("10.0.0.0"), 96 + 16, (void*) 3);
+
+	std::vector<IPAddr> probes;
+
+	for ( int64 i = 0; i < n; ++i )
+		{
+		// Missing ones are outside of 10/8.
+		uint32 base = access == ACCESS_MISSING ? 0xc0000000 : 0x0a000000;
+		uint32 a = htonl(base + (uint32(i) << 8) + uint32(i % 256));
+		probes.push_back(IPAddr(IPv4, &a, IPAddr::Network));
+		}
+
+	if ( access == ACCESS_RANDOM )
+		{
+		std::mt19937 rng(SHUFFLE_SEED);
+		std::shuffle(probes.begin(), probes.end(), rng);
+		}
+
+	size_t i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		DoNotOptimize(t.Lookup(probes[i], 128));
+
+		if ( ++i == probes.size() )
+			i = 0;
+		}
+
+	state.SetLabel(access_names[access]);
+	}
+
+MICROBENCH(PrefixTableLookup)->ArgsProduct({{16, 1024, 65536},
+					    {ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_MISSING}});
@@ -0,0 +1,105 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for the formatters that log writers use.
+
+#include "bro-config.h"
+
+#include "Microbench.h"
+#include "Desc.h"
+#include "threading/SerialTypes.h"
+#include "threading/formatters/JSON.h"
+
+using namespace microbench;
+using threading::Field;
+using threading::Value;
+
+static const char* json_modes[] = { "per-field", "row" };
+
+// Formats rows shaped like those of conn.log, reusing one buffer across
+// rows as the ASCII writer does. Argument: 1 to pass whole rows, as
+// writers do, which renders the field names only once; 0 to format each
+// field individually with its name, as happens for values outside of
+// log rows.
+static void JSONFormatRow(State& state)
+	{
+	static const char* const names[] = {
+		"ts", "uid", "id.orig_h", "id.orig_p", "proto", "service",
+		"duration", "orig_bytes", "history", "query",
+	};
+
+	const int num_fields = sizeof(names) / sizeof(names[0]);
+
+	static const TypeTag types[num_fields] = {
+		TYPE_TIME, TYPE_STRING, TYPE_ADDR, TYPE_PORT, TYPE_ENUM,
+		TYPE_STRING, TYPE_INTERVAL, TYPE_COUNT, TYPE_STRING, TYPE_STRING,
+	};
+
+	static const char* const strings[num_fields] = {
+		0, "CHhAvVGS1DHFjwGM9", 0, 0, "tcp", 0, 0, 0, "ShADadFf",
+		"/index.php?a=1&b=\"x\"",
+	};
+
+	Field* fields[num_fields];
+	Value* vals[num_fields];
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		fields[i] = new Field(names[i], 0, types[i], TYPE_VOID, false);
+		vals[i] = new Value(types[i]);
+
+		if ( strings[i] )
+			{
+			vals[i]->val.string_val.data = copy_string(strings[i]);
+			vals[i]->val.string_val.length = strlen(strings[i]);
+			}
+		}
+
+	vals[0]->val.double_val = 1411172973.308196;
+	vals[2]->val.addr_val.family = IPv4;
+	vals[2]->val.addr_val.in.in4.s_addr = htonl(0xc0a80102);
+	vals[3]->val.port_val.port = 49285;
+	vals[3]->val.port_val.proto = TRANSPORT_TCP;
+	vals[5]->present = false;
+	vals[6]->val.double_val = 0.041605;
+	vals[7]->val.uint_val = 1724;
+
+	bool rows = state.Arg(0);
+	threading::formatter::JSON json(0, threading::formatter::JSON::TS_EPOCH);
+	ODesc desc;
+
+	while ( state.KeepRunning() )
+		{
+		desc.Clear();
+
+		if ( rows )
+			json.Describe(&desc, num_fields, fields, vals);
+
+		else
+			{
+			desc.AddRaw("{", 1);
+
+			for ( int j = 0; j < num_fields; ++j )
+				{
+				if ( j > 0 && vals[j]->present )
+					desc.AddRaw(",", 1);
+
+				json.Describe(&desc, vals[j], fields[j]->name);
+				}
+
+			desc.AddRaw("}", 1);
+			}
+
+		DoNotOptimize(desc.Bytes());
+		}
+
+	state.SetBytesProcessed(state.Iterations() * desc.Len());
+	state.SetLabel(json_modes[rows]);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		delete fields[i];
+		delete vals[i];
+		}
+	}
+
+MICROBENCH(JSONFormatRow)->Arg(0)->Arg(1);
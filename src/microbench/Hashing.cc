@@ -0,0 +1,296 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for hashing: HashKey's byte hashing, and CompositeHash
+// turning index values into keys and back.
+
+#include "bro-config.h"
+
+#include "Microbench.h"
+#include "CompHash.h"
+#include "Conn.h"
+#include "Hash.h"
+#include "Type.h"
+#include "Val.h"
+
+using namespace microbench;
+
+// Index types, as scripts use for tables.
+enum { INDEX_COUNT, INDEX_STRING, INDEX_ADDR, INDEX_CONN, INDEX_MIXED };
+
+static const char* index_names[] = {
+	"count", "string", "addr", "addr,port,addr,port", "string,count,addr"
+};
+
+static TypeList* make_index_type(int index)
+	{
+	TypeList* tl = new TypeList();
+
+	switch ( index ) {
+	case INDEX_COUNT:
+		tl->Append(base_type(TYPE_COUNT));
+		break;
+
+	case INDEX_STRING:
+		tl->Append(base_type(TYPE_STRING));
+		break;
+
+	case INDEX_ADDR:
+		tl->Append(base_type(TYPE_ADDR));
+		break;
+
+	case INDEX_CONN:
+		tl->Append(base_type(TYPE_ADDR));
+		tl->Append(base_type(TYPE_PORT));
+		tl->Append(base_type(TYPE_ADDR));
+		tl->Append(base_type(TYPE_PORT));
+		break;
+
+	case INDEX_MIXED:
+		tl->Append(base_type(TYPE_STRING));
+		tl->Append(base_type(TYPE_COUNT));
+		tl->Append(base_type(TYPE_ADDR));
+		break;
+	}
+
+	return tl;
+	}
+
+static Val* make_addr(uint32 i)
+	{
+	uint32 a = htonl(0x0a000000 + i);
+	return new AddrVal(IPAddr(IPv4, &a, IPAddr::Network));
+	}
+
+// Builds an index value of the given kind, as TableVal would look up.
+static ListVal* make_index(int index, uint32 i)
+	{
+	ListVal* lv = new ListVal(TYPE_ANY);
+
+	switch ( index ) {
+	case INDEX_COUNT:
+		lv->Append(val_mgr->GetCount(i));
+		break;
+
+	case INDEX_STRING:
+		lv->Append(new StringVal(fmt("host-%u.example.com", i)));
+		break;
+
+	case INDEX_ADDR:
+		lv->Append(make_addr(i));
+		break;
+
+	case INDEX_CONN:
+		lv->Append(make_addr(i));
+		lv->Append(val_mgr->GetPort(1024 + i % 60000, TRANSPORT_TCP));
+		lv->Append(make_addr(i + 1));
+		lv->Append(val_mgr->GetPort(80, TRANSPORT_TCP));
+		break;
+
+	case INDEX_MIXED:
+		lv->Append(new StringVal(fmt("user%u", i)));
+		lv->Append(val_mgr->GetCount(i));
+		lv->Append(make_addr(i));
+		break;
+	}
+
+	return lv;
+	}
+
+// A ring of different index values, so that we aren't hashing the same
+// one over and over.
+static const int NUM_INDICES = 1024;
+
+class IndexSet {
+public:
+	IndexSet(int index)
+		{
+		tl = make_index_type(index);
+		hash = new CompositeHash(tl);
+
+		for ( int i = 0; i < NUM_INDICES; ++i )
+			vals.push_back(make_index(index, i));
+		}
+
+	~IndexSet()
+		{
+		for ( size_t i = 0; i < vals.size(); ++i )
+			Unref(vals[i]);
+
+		delete hash;
+		Unref(tl);
+		}
+
+	TypeList* tl;
+	CompositeHash* hash;
+	std::vector<ListVal*> vals;
+};
+
+// Arguments: index type.
+static void CompHashCompute(State& state)
+	{
+	IndexSet s(state.Arg(0));
+	int i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		delete s.hash->ComputeHash(s.vals[i], 1);
+		i = (i + 1) % NUM_INDICES;
+		}
+
+	state.SetLabel(index_names[state.Arg(0)]);
+	}
+
+MICROBENCH(CompHashCompute)->Arg(INDEX_COUNT)->Arg(INDEX_STRING)
+	->Arg(INDEX_ADDR)->Arg(INDEX_CONN)->Arg(INDEX_MIXED);
+
+// The allocation-free variant that lookups use. Arguments: index type.
+static void CompHashRawKey(State& state)
+	{
+	IndexSet s(state.Arg(0));
+	CompositeHash::RawKeyBuffer buf;
+	int i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		const void* key;
+		int size;
+
+		if ( s.hash->ComputeRawKey(s.vals[i], 1, &buf, key, size) )
+			DoNotOptimize(HashKey::HashBytes(key, size));
+
+		i = (i + 1) % NUM_INDICES;
+		}
+
+	state.SetLabel(index_names[state.Arg(0)]);
+	}
+
+MICROBENCH(CompHashRawKey)->Arg(INDEX_COUNT)->Arg(INDEX_STRING)
+	->Arg(INDEX_ADDR)->Arg(INDEX_CONN)->Arg(INDEX_MIXED);
+
+// Turns keys back into values, as iterating over a table does.
+// Arguments: index type.
+static void CompHashRecover(State& state)
+	{
+	IndexSet s(state.Arg(0));
+	std::vector<HashKey*> keys;
+
+	for ( int i = 0; i < NUM_INDICES; ++i )
+		keys.push_back(s.hash->ComputeHash(s.vals[i], 1));
+
+	int i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		Unref(s.hash->RecoverVals(keys[i]));
+		i = (i + 1) % NUM_INDICES;
+		}
+
+	state.SetLabel(index_names[state.Arg(0)]);
+
+	for ( size_t j = 0; j < keys.size(); ++j )
+		delete keys[j];
+	}
+
+MICROBENCH(CompHashRecover)->Arg(INDEX_COUNT)->Arg(INDEX_STRING)
+	->Arg(INDEX_ADDR)->Arg(INDEX_CONN)->Arg(INDEX_MIXED);
+
+// Arguments: number of bytes hashed.
+static void HashBytes(State& state)
+	{
+	std::vector<u_char> data(state.Arg(0));
+
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = i * 7;
+
+	while ( state.KeepRunning() )
+		DoNotOptimize(HashKey::HashBytes(&data[0], data.size()));
+
+	state.SetBytesProcessed(state.Iterations() * data.size());
+	}
+
+MICROBENCH(HashBytes)->Arg(4)->Arg(16)->Arg(64)->Arg(1024);
+
+// The keys that dominate tables. Connection keys are what the session
+// table hashes, composite ones what script tables do.
+enum { KEY_CONN4, KEY_CONN6, KEY_COMPOSITE_CONN, KEY_COMPOSITE_STRING };
+
+static const char* key_names[] = {
+	"conn4", "conn6", "composite-conn", "composite-string"
+};
+
+static const char* hash_function_names[] = { "siphash24", "siphash13" };
+
+static void make_keys(int kind, std::vector<std::string>* keys)
+	{
+	if ( kind == KEY_CONN4 || kind == KEY_CONN6 )
+		{
+		for ( int i = 0; i < NUM_INDICES; ++i )
+			{
+			ConnID id;
+
+			if ( kind == KEY_CONN4 )
+				{
+				uint32 a = htonl(0x0a000000 + i);
+				uint32 b = htonl(0xc0a80001);
+				id.src_addr = IPAddr(IPv4, &a, IPAddr::Network);
+				id.dst_addr = IPAddr(IPv4, &b, IPAddr::Network);
+				}
+			else
+				{
+				id.src_addr = IPAddr(fmt("2001:db8::%x", i + 1));
+				id.dst_addr = IPAddr("2001:db8:1::1");
+				}
+
+			id.src_port = htons(1024 + i);
+			id.dst_port = htons(80);
+			id.is_one_way = false;
+
+			HashKey* k = BuildConnIDHashKey(id);
+			keys->push_back(std::string((const char*) k->Key(), k->Size()));
+			delete k;
+			}
+
+		return;
+		}
+
+	IndexSet s(kind == KEY_COMPOSITE_CONN ? INDEX_CONN : INDEX_STRING);
+
+	for ( int i = 0; i < NUM_INDICES; ++i )
+		{
+		HashKey* k = s.hash->ComputeHash(s.vals[i], 1);
+		keys->push_back(std::string((const char*) k->Key(), k->Size()));
+		delete k;
+		}
+	}
+
+// Compares the hash functions that $BRO_HASH_FUNCTION selects among.
+// Arguments: hash function, key kind.
+static void HashFunctions(State& state)
+	{
+	std::vector<std::string> keys;
+	make_keys(state.Arg(1), &keys);
+
+	HashFunction saved = hash_function;
+	hash_function = (HashFunction) state.Arg(0);
+
+	uint64 bytes = 0;
+	int i = 0;
+
+	while ( state.KeepRunning() )
+		{
+		const std::string& k = keys[i];
+		DoNotOptimize(HashKey::HashBytes(k.data(), k.size()));
+		bytes += k.size();
+		i = (i + 1) % NUM_INDICES;
+		}
+
+	hash_function = saved;
+
+	state.SetBytesProcessed(bytes);
+	state.SetLabel(fmt("%s %s", hash_function_names[state.Arg(0)],
+			   key_names[state.Arg(1)]));
+	}
+
+MICROBENCH(HashFunctions)->ArgsProduct({{HASH_FN_SIPHASH24, HASH_FN_SIPHASH13},
+					 {KEY_CONN4, KEY_CONN6,
+					  KEY_COMPOSITE_CONN, KEY_COMPOSITE_STRING}});
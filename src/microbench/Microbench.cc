@@ -0,0 +1,344 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "Microbench.h"
+#include "Hash.h"
+#include "Reporter.h"
+#include "Val.h"
+
+extern char version[];
+
+using namespace microbench;
+
+// Upper bound on the iterations of a single run, for operations that
+// are too fast to measure otherwise.
+static const uint64 MAX_ITERATIONS = 1000000000;
+
+State::State(uint64 arg_max_iterations, const std::vector<int64>& arg_args)
+	: args(arg_args)
+	{
+	iterations = 0;
+	max_iterations = arg_max_iterations;
+	running = false;
+	real_start = cpu_start = 0;
+	real_time = cpu_time = 0;
+	items = bytes = 0;
+	}
+
+double State::CPUNow()
+	{
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+
+	return r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6 +
+		r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+	}
+
+void State::PauseTiming()
+	{
+	if ( ! running )
+		return;
+
+	real_time += current_time(true) - real_start;
+	cpu_time += CPUNow() - cpu_start;
+	running = false;
+	}
+
+void State::ResumeTiming()
+	{
+	if ( running )
+		return;
+
+	real_start = current_time(true);
+	cpu_start = CPUNow();
+	running = true;
+	}
+
+Benchmark::Benchmark(const char* arg_name, Function arg_func)
+	: name(arg_name)
+	{
+	func = arg_func;
+	}
+
+Benchmark* Benchmark::Arg(int64 a)
+	{
+	arg_sets.push_back(std::vector<int64>(1, a));
+	return this;
+	}
+
+Benchmark* Benchmark::Args(const std::vector<int64>& args)
+	{
+	arg_sets.push_back(args);
+	return this;
+	}
+
+Benchmark* Benchmark::Range(int64 lo, int64 hi)
+	{
+	for ( int64 a = lo; a < hi; a *= 8 )
+		Arg(a);
+
+	return Arg(hi);
+	}
+
+Benchmark* Benchmark::ArgsProduct(const std::vector<std::vector<int64> >& values)
+	{
+	std::vector<size_t> idx(values.size(), 0);
+
+	while ( true )
+		{
+		std::vector<int64> args;
+
+		for ( size_t i = 0; i < values.size(); ++i )
+			args.push_back(values[i][idx[i]]);
+
+		arg_sets.push_back(args);
+
+		// Advance like an odometer, last argument fastest.
+		size_t i = values.size();
+
+		while ( i > 0 )
+			{
+			--i;
+
+			if ( ++idx[i] < values[i].size() )
+				break;
+
+			idx[i] = 0;
+
+			if ( i == 0 )
+				return this;
+			}
+
+		if ( values.empty() )
+			return this;
+		}
+	}
+
+// A function-level static, so that registration from other translation
+// units' static initializers doesn't depend on initialization order.
+static std::vector<Benchmark*>& registry()
+	{
+	static std::vector<Benchmark*> benchmarks;
+	return benchmarks;
+	}
+
+Benchmark* microbench::Register(const char* name, Function func)
+	{
+	Benchmark* b = new Benchmark(name, func);
+	registry().push_back(b);
+	return b;
+	}
+
+static std::string full_name(const Benchmark* b, const std::vector<int64>& args)
+	{
+	std::string name = b->Name();
+
+	for ( size_t i = 0; i < args.size(); ++i )
+		name += fmt("/%" PRId64, args[i]);
+
+	return name;
+	}
+
+static std::string json_escape(const std::string& s)
+	{
+	std::string r;
+
+	for ( size_t i = 0; i < s.size(); ++i )
+		{
+		if ( s[i] == '"' || s[i] == '\\' )
+			r += '\\';
+
+		r += s[i];
+		}
+
+	return r;
+	}
+
+// Runs a benchmark with growing iteration counts until it takes at least
+// min_time, and returns the state of the final run.
+static State run_one(const Benchmark* b, const std::vector<int64>& args,
+			double min_time)
+	{
+	uint64 n = 1;
+
+	while ( true )
+		{
+		State s(n, args);
+		b->Func()(s);
+
+		if ( s.RealTime() >= min_time || n >= MAX_ITERATIONS )
+			return s;
+
+		// Aim a bit past the minimum time with the next run, but
+		// don't grow by more than 10x at once, as the first runs
+		// are too short to predict from reliably.
+		double mult = s.RealTime() > 0 ? min_time * 1.4 / s.RealTime() : 10;
+
+		if ( mult > 10 )
+			mult = 10;
+
+		uint64 next = uint64(n * mult);
+		n = next > n ? next : n + 1;
+
+		if ( n > MAX_ITERATIONS )
+			n = MAX_ITERATIONS;
+		}
+	}
+
+int microbench::RunAll(const std::string& filter, double min_time, bool json,
+			FILE* out)
+	{
+	int num_run = 0;
+
+	if ( json )
+		{
+		fprintf(out, "{\n  \"context\": {\n");
+		fprintf(out, "    \"version\": \"%s\",\n", version);
+		fprintf(out, "    \"date\": %.6f,\n", current_time(true));
+		fprintf(out, "    \"min_time\": %.3f\n", min_time);
+		fprintf(out, "  },\n  \"benchmarks\": [");
+		}
+	else
+		fprintf(out, "%-48s %14s %14s %12s  %s\n", "Benchmark",
+			"Time (ns)", "CPU (ns)", "Iterations", "Items/s");
+
+	std::vector<Benchmark*>& benchmarks = registry();
+
+	for ( size_t i = 0; i < benchmarks.size(); ++i )
+		{
+		const Benchmark* b = benchmarks[i];
+		std::vector<std::vector<int64> > arg_sets = b->ArgSets();
+
+		if ( arg_sets.empty() )
+			arg_sets.push_back(std::vector<int64>());
+
+		for ( size_t j = 0; j < arg_sets.size(); ++j )
+			{
+			std::string name = full_name(b, arg_sets[j]);
+
+			if ( name.find(filter) == std::string::npos )
+				continue;
+
+			State s = run_one(b, arg_sets[j], min_time);
+
+			double iters = s.Iterations();
+			double real_ns = s.RealTime() * 1e9 / iters;
+			double cpu_ns = s.CPUTime() * 1e9 / iters;
+			double items_per_sec = s.CPUTime() > 0 ?
+				s.ItemsProcessed() / s.CPUTime() : 0;
+			double bytes_per_sec = s.CPUTime() > 0 ?
+				s.BytesProcessed() / s.CPUTime() : 0;
+
+			if ( json )
+				{
+				fprintf(out, "%s\n    {\n", num_run ? "," : "");
+				fprintf(out, "      \"name\": \"%s\",\n", json_escape(name).c_str());
+				fprintf(out, "      \"label\": \"%s\",\n", json_escape(s.Label()).c_str());
+				fprintf(out, "      \"iterations\": %" PRIu64 ",\n", s.Iterations());
+				fprintf(out, "      \"real_time_ns\": %.3f,\n", real_ns);
+				fprintf(out, "      \"cpu_time_ns\": %.3f,\n", cpu_ns);
+				fprintf(out, "      \"items_per_second\": %.1f,\n", items_per_sec);
+				fprintf(out, "      \"bytes_per_second\": %.1f\n", bytes_per_sec);
+				fprintf(out, "    }");
+				}
+			else
+				fprintf(out, "%-48s %14.1f %14.1f %12" PRIu64 "  %.4g %s\n",
+					name.c_str(), real_ns, cpu_ns, s.Iterations(),
+					items_per_sec, s.Label().c_str());
+
+			fflush(out);
+			++num_run;
+			}
+		}
+
+	if ( json )
+		fprintf(out, "\n  ]\n}\n");
+
+	return num_run;
+	}
+
+static void usage(const char* prog)
+	{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "    -f|--filter <string>   | run only benchmarks whose name contains <string>\n");
+	fprintf(stderr, "    -t|--min-time <secs>   | run each benchmark for at least <secs> (default 0.5)\n");
+	fprintf(stderr, "    -j|--json              | report as JSON rather than a table\n");
+	fprintf(stderr, "    -o|--output <file>     | write the report to <file> rather than stdout\n");
+	fprintf(stderr, "    -h|--help              | command line help\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "    $BRO_SEED_FILE         | file to load the hash seeds from\n");
+	exit(1);
+	}
+
+int main(int argc, char** argv)
+	{
+	std::string filter;
+	double min_time = 0.5;
+	bool json = false;
+	const char* output = 0;
+
+	static struct option long_opts[] = {
+		{"filter", required_argument, 0, 'f'},
+		{"min-time", required_argument, 0, 't'},
+		{"json", no_argument, 0, 'j'},
+		{"output", required_argument, 0, 'o'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0},
+	};
+
+	int op;
+
+	while ( (op = getopt_long(argc, argv, "f:t:jo:h", long_opts, 0)) != EOF )
+		{
+		switch ( op ) {
+		case 'f':
+			filter = optarg;
+			break;
+
+		case 't':
+			min_time = atof(optarg);
+			break;
+
+		case 'j':
+			json = true;
+			break;
+
+		case 'o':
+			output = optarg;
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+		}
+
+	// Just enough of Bro's initialization for the data structures to
+	// work; there's no script layer.
+	reporter = new Reporter();
+	val_mgr = new ValManager();
+
+	const char* seed_file = getenv("BRO_SEED_FILE");
+	init_random_seed(seed_file && *seed_file ? seed_file : 0, 0);
+	init_hash_function();
+
+	FILE* out = stdout;
+
+	if ( output && ! (out = fopen(output, "w")) )
+		{
+		fprintf(stderr, "cannot open %s: %s\n", output, strerror(errno));
+		return 1;
+		}
+
+	int n = RunAll(filter, min_time, json, out);
+
+	if ( out != stdout )
+		fclose(out);
+
+	return n > 0 ? 0 : 1;
+	}
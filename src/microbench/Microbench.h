@@ -0,0 +1,194 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef microbench_h
+#define microbench_h
+
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+/**
+ * A small harness for timing core data structures in isolation, along
+ * the lines of Google's benchmark library. A benchmark is a function that
+ * runs its operation in a loop for as long as State::KeepRunning() says
+ * so; the harness picks the number of iterations such that each
+ * benchmark runs for a minimum time, and reports the time per iteration.
+ *
+ *     static void DictLookup(microbench::State& state)
+ *         {
+ *         // ... set up a dictionary with state.Arg(0) keys ...
+ *
+ *         while ( state.KeepRunning() )
+ *             d.Lookup(keys[i++ % n]);
+ *         }
+ *
+ *     MICROBENCH(DictLookup)->Arg(16)->Arg(1024)->Arg(65536);
+ *
+ * Each registered set of arguments becomes its own benchmark, named after
+ * the function and its arguments ("DictLookup/1024").
+ */
+namespace microbench {
+
+/**
+ * The state of a running benchmark.
+ */
+class State {
+public:
+	State(uint64 max_iterations, const std::vector<int64>& args);
+
+	/**
+	 * Returns true for as long as the benchmark should perform another
+	 * iteration. Starts the timer on the first call, and stops it once
+	 * it returns false.
+	 */
+	bool KeepRunning()
+		{
+		if ( iterations == 0 && ! running )
+			ResumeTiming();
+
+		if ( iterations < max_iterations )
+			{
+			++iterations;
+			return true;
+			}
+
+		PauseTiming();
+		return false;
+		}
+
+	/**
+	 * Returns the benchmark's i'th argument.
+	 */
+	int64 Arg(int i) const	{ return args[i]; }
+
+	/**
+	 * Stops the timer, for setup work within the loop that shouldn't
+	 * count.
+	 */
+	void PauseTiming();
+
+	/**
+	 * Restarts the timer after PauseTiming().
+	 */
+	void ResumeTiming();
+
+	/**
+	 * Sets the number of items that the benchmark processed in total,
+	 * for reporting a rate. Defaults to the number of iterations.
+	 */
+	void SetItemsProcessed(uint64 n)	{ items = n; }
+
+	/**
+	 * Sets the number of bytes that the benchmark processed in total,
+	 * for reporting a throughput.
+	 */
+	void SetBytesProcessed(uint64 n)	{ bytes = n; }
+
+	/**
+	 * Sets a label describing the arguments, such as the key type or
+	 * access pattern, for the report.
+	 */
+	void SetLabel(const std::string& arg_label)	{ label = arg_label; }
+
+	uint64 Iterations() const	{ return iterations; }
+	uint64 ItemsProcessed() const	{ return items ? items : iterations; }
+	uint64 BytesProcessed() const	{ return bytes; }
+	const std::string& Label() const	{ return label; }
+
+	double RealTime() const	{ return real_time; }
+	double CPUTime() const	{ return cpu_time; }
+
+private:
+	static double CPUNow();
+
+	uint64 iterations;
+	uint64 max_iterations;
+	std::vector<int64> args;
+
+	bool running;
+	double real_start;
+	double cpu_start;
+	double real_time;
+	double cpu_time;
+
+	uint64 items;
+	uint64 bytes;
+	std::string label;
+};
+
+typedef void (*Function)(State& state);
+
+/**
+ * A registered benchmark function with its sets of arguments.
+ */
+class Benchmark {
+public:
+	Benchmark(const char* name, Function func);
+
+	/**
+	 * Adds a run with a single argument.
+	 */
+	Benchmark* Arg(int64 a);
+
+	/**
+	 * Adds a run with several arguments.
+	 */
+	Benchmark* Args(const std::vector<int64>& args);
+
+	/**
+	 * Adds runs with the first argument ranging between lo and hi,
+	 * multiplying by 8 from one to the next (with hi always included).
+	 */
+	Benchmark* Range(int64 lo, int64 hi);
+
+	/**
+	 * Adds runs for all combinations of the given argument values.
+	 */
+	Benchmark* ArgsProduct(const std::vector<std::vector<int64> >& values);
+
+	const std::string& Name() const	{ return name; }
+	Function Func() const	{ return func; }
+	const std::vector<std::vector<int64> >& ArgSets() const
+		{ return arg_sets; }
+
+private:
+	std::string name;
+	Function func;
+	std::vector<std::vector<int64> > arg_sets;
+};
+
+/**
+ * Registers a benchmark; used through MICROBENCH().
+ */
+Benchmark* Register(const char* name, Function func);
+
+/**
+ * Runs all registered benchmarks whose name contains filter, each for at
+ * least min_time seconds, and writes a report to out, either as JSON or
+ * as a table.
+ *
+ * @return The number of benchmarks run.
+ */
+int RunAll(const std::string& filter, double min_time, bool json, FILE* out);
+
+/**
+ * Prevents the compiler from optimizing away a value that the benchmark
+ * computes but doesn't otherwise use.
+ */
+template <class T>
+inline void DoNotOptimize(const T& value)
+	{
+	asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+}
+
+#define MICROBENCH_CONCAT2(a, b) a##b
+#define MICROBENCH_CONCAT(a, b) MICROBENCH_CONCAT2(a, b)
+
+#define MICROBENCH(func) \
+	static microbench::Benchmark* MICROBENCH_CONCAT(microbench_, __LINE__) \
+		__attribute__((unused)) = microbench::Register(#func, func)
+
+#endif
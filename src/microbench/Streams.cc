@@ -0,0 +1,155 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for stream processing: Base64Converter and the
+// Reassembler.
+
+#include "bro-config.h"
+
+#include <algorithm>
+#include <random>
+
+#include "Microbench.h"
+#include "Base64.h"
+#include "Reassem.h"
+
+using namespace microbench;
+
+// Orders in which segments arrive.
+enum { ORDER_IN_SEQUENCE, ORDER_SWAPPED, ORDER_RANDOM };
+
+static const char* order_names[] = { "in-sequence", "swapped", "random" };
+
+// Arguments: number of bytes encoded.
+static void Base64Encode(State& state)
+	{
+	std::vector<u_char> data(state.Arg(0));
+
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = i * 7;
+
+	Base64Converter conv(0);
+
+	while ( state.KeepRunning() )
+		{
+		int blen;
+		char* buf = 0;
+		conv.Encode(data.size(), &data[0], &blen, &buf);
+		delete [] buf;
+		}
+
+	state.SetBytesProcessed(state.Iterations() * data.size());
+	}
+
+MICROBENCH(Base64Encode)->Arg(64)->Arg(1024)->Arg(65536);
+
+// Arguments: number of bytes decoded.
+static void Base64Decode(State& state)
+	{
+	std::vector<u_char> data(state.Arg(0));
+
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = i * 7;
+
+	int elen;
+	char* encoded = 0;
+	Base64Converter(0).Encode(data.size(), &data[0], &elen, &encoded);
+
+	while ( state.KeepRunning() )
+		{
+		Base64Converter conv(0);
+		int blen;
+		char* buf = 0;
+		conv.Decode(elen, encoded, &blen, &buf);
+		delete [] buf;
+
+		buf = 0;
+		conv.Done(&blen, &buf);
+		delete [] buf;
+		}
+
+	state.SetBytesProcessed(state.Iterations() * elen);
+	delete [] encoded;
+	}
+
+MICROBENCH(Base64Decode)->Arg(64)->Arg(1024)->Arg(65536);
+
+// Delivers whatever became contiguous and lets go of it, the way the
+// stream reassemblers do, but without an analyzer to pass it on to.
+class BenchReassembler : public Reassembler {
+public:
+	BenchReassembler() : Reassembler(1)	{ delivered = 0; }
+
+	uint64 delivered;
+
+protected:
+	virtual void BlockInserted(DataBlock* start_block)
+		{
+		if ( start_block->seq > last_reassem_seq ||
+		     start_block->upper <= last_reassem_seq )
+			return;
+
+		for ( DataBlock* b = start_block;
+		      b && b->seq <= last_reassem_seq; b = b->next )
+			{
+			if ( b->seq == last_reassem_seq )
+				{
+				delivered += b->Size();
+				last_reassem_seq += b->Size();
+				}
+			}
+
+		TrimToSeq(last_reassem_seq);
+		}
+
+	virtual void Overlap(const u_char* b1, const u_char* b2, uint64 n)
+		{
+		}
+};
+
+// Segments per window; each iteration feeds one window's worth.
+static const int WINDOW_SEGMENTS = 32;
+
+// Arguments: segment size, arrival order.
+static void ReassemblerNewBlock(State& state)
+	{
+	int64 size = state.Arg(0);
+	int order = state.Arg(1);
+
+	std::vector<u_char> data(size, 'x');
+
+	// The order in which the segments of a window arrive.
+	std::vector<int> perm;
+
+	for ( int i = 0; i < WINDOW_SEGMENTS; ++i )
+		perm.push_back(i);
+
+	if ( order == ORDER_SWAPPED )
+		{
+		for ( int i = 0; i + 1 < WINDOW_SEGMENTS; i += 2 )
+			std::swap(perm[i], perm[i + 1]);
+		}
+
+	else if ( order == ORDER_RANDOM )
+		{
+		std::mt19937 rng(42);
+		std::shuffle(perm.begin(), perm.end(), rng);
+		}
+
+	BenchReassembler r;
+	uint64 seq = 1;
+
+	while ( state.KeepRunning() )
+		{
+		for ( int i = 0; i < WINDOW_SEGMENTS; ++i )
+			r.NewBlock(0, seq + perm[i] * size, size, &data[0]);
+
+		seq += WINDOW_SEGMENTS * size;
+		}
+
+	state.SetItemsProcessed(state.Iterations() * WINDOW_SEGMENTS);
+	state.SetBytesProcessed(r.delivered);
+	state.SetLabel(order_names[order]);
+	}
+
+MICROBENCH(ReassemblerNewBlock)->ArgsProduct({{64, 1460},
+					      {ORDER_IN_SEQUENCE, ORDER_SWAPPED, ORDER_RANDOM}});
@@ -0,0 +1,36 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for the UIDs that connections and files get: generating
+// the random bits, and rendering them in base62.
+
+#include "bro-config.h"
+
+#include "Microbench.h"
+#include "UID.h"
+
+using namespace microbench;
+
+// Arguments: number of bits, as bits_per_uid sets them.
+static void UIDSet(State& state)
+	{
+	Bro::UID uid;
+
+	while ( state.KeepRunning() )
+		{
+		uid.Set(state.Arg(0));
+		DoNotOptimize(uid.Hash());
+		}
+	}
+
+MICROBENCH(UIDSet)->Arg(64)->Arg(96)->Arg(128);
+
+// Arguments: number of bits, as bits_per_uid sets them.
+static void UIDBase62(State& state)
+	{
+	Bro::UID uid(state.Arg(0));
+
+	while ( state.KeepRunning() )
+		DoNotOptimize(uid.Base62("C"));
+	}
+
+MICROBENCH(UIDBase62)->Arg(64)->Arg(96)->Arg(128);
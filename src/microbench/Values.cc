@@ -0,0 +1,104 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Microbenchmarks for script values: making deep copies of them, and
+// the reference counting of constants.
+
+#include "bro-config.h"
+
+#include "Microbench.h"
+#include "Expr.h"
+#include "Type.h"
+#include "Val.h"
+
+using namespace microbench;
+
+static const char* copy_modes[] = { "direct", "serialization" };
+static const char* constant_modes[] = { "counted", "immortal" };
+
+// Builds a table[addr] of record { host: addr; services: set[port];
+// last_seen: time; } with n entries, as a script tracking hosts has.
+static TableVal* make_host_table(int n)
+	{
+	type_decl_list* fields = new type_decl_list();
+	fields->append(new TypeDecl(base_type(TYPE_ADDR), copy_string("host")));
+
+	TypeList* port_index = new TypeList(base_type(TYPE_PORT));
+	port_index->Append(base_type(TYPE_PORT));
+	SetType* port_set = new SetType(port_index, 0);
+	fields->append(new TypeDecl(port_set, copy_string("services")));
+
+	fields->append(new TypeDecl(base_type(TYPE_TIME), copy_string("last_seen")));
+	RecordType* info = new RecordType(fields);
+
+	TypeList* addr_index = new TypeList(base_type(TYPE_ADDR));
+	addr_index->Append(base_type(TYPE_ADDR));
+	TableType* tt = new TableType(addr_index, info);
+	TableVal* t = new TableVal(tt);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		AddrVal* a = new AddrVal(htonl(0x0a000000 + i));
+
+		TableVal* services = new TableVal(port_set);
+		PortVal* p = val_mgr->GetPort(i + 1, TRANSPORT_TCP);
+		services->Assign(p, 0);
+		Unref(p);
+		p = val_mgr->GetPort(22, TRANSPORT_TCP);
+		services->Assign(p, 0);
+		Unref(p);
+
+		RecordVal* r = new RecordVal(info);
+		r->Assign(0, a->Ref());
+		r->Assign(1, services);
+		r->Assign(2, new Val(1411172973.308196 + i, TYPE_TIME));
+
+		t->Assign(a, r);
+		Unref(a);
+		}
+
+	Unref(tt);
+	return t;
+	}
+
+// Copies a table of records per iteration, as copy() does.
+// Arguments: number of entries, 1 to copy through serialization as
+// copy() used to, 0 to copy directly.
+static void ValueCopy(State& state)
+	{
+	TableVal* t = make_host_table(state.Arg(0));
+	bool serialize = state.Arg(1);
+
+	while ( state.KeepRunning() )
+		Unref(serialize ? t->SerialClone() : t->Clone());
+
+	state.SetItemsProcessed(state.Iterations() * state.Arg(0));
+	state.SetLabel(copy_modes[serialize]);
+	Unref(t);
+	}
+
+MICROBENCH(ValueCopy)->ArgsProduct({{8, 1024}, {0, 1}});
+
+// Evaluates a constant and discards the result, taking and releasing a
+// reference. Argument: 1 to mark the value immortal, as literals in
+// scripts are, 0 to count its references.
+static void ConstantEval(State& state)
+	{
+	Val* v = new Val(42, TYPE_COUNT);
+	ConstExpr* e = new ConstExpr(v);
+	bool immortal = state.Arg(0);
+
+	if ( immortal )
+		v->MakeImmortal();
+
+	while ( state.KeepRunning() )
+		Unref(e->Eval(0));
+
+	state.SetLabel(constant_modes[immortal]);
+	Unref(e);
+
+	if ( immortal )
+		// Unref() has left it alone.
+		delete v;
+	}
+
+MICROBENCH(ConstantEval)->Arg(0)->Arg(1);
@@ -9,6 +9,13 @@
 
 #include <arpa/inet.h>
 
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "Reporter.h"
 #include "net_util.h"
 #include "IPAddr.h"
@@ -18,18 +25,55 @@
 // Returns the ones-complement checksum of a chunk of b short-aligned bytes.
 int ones_complement_checksum(const void* p, int b, uint32 sum)
 	{
-	const u_short* sp = (u_short*) p;	// better be aligned!
+	const u_char* cp = (const u_char*) p;
+	int n = b / 2;	// count of short's; an odd last byte is left out
+	uint64 acc = sum;
 
-	b /= 2;	// convert to count of short's
+	// Adding up the shorts in wider words comes out the same, as 2^16
+	// is 1 in ones-complement arithmetic; the carries just need folding
+	// back in at the end. No need for endian conversions either.
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
 
-	/* No need for endian conversions. */
-	while ( --b >= 0 )
-		sum += *sp++;
+	while ( n >= 8 )
+		{
+		// Each of the four 32-bit lanes takes two shorts per round,
+		// which in a block this size can't overflow them.
+		int rounds = std::min(n / 8, 16384);
+		__m128i vsum = zero;
+
+		for ( int i = 0; i < rounds; ++i, cp += 16 )
+			{
+			__m128i v = _mm_loadu_si128((const __m128i*) cp);
+			vsum = _mm_add_epi32(vsum, _mm_unpacklo_epi16(v, zero));
+			vsum = _mm_add_epi32(vsum, _mm_unpackhi_epi16(v, zero));
+			}
+
+		uint32 lanes[4];
+		_mm_storeu_si128((__m128i*) lanes, vsum);
+		acc += uint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+		n -= rounds * 8;
+		}
+#endif
 
-	while ( sum > 0xffff )
-		sum = (sum & 0xffff) + (sum >> 16);
+	for ( ; n >= 2; n -= 2, cp += 4 )
+		{
+		uint32 w;
+		memcpy(&w, cp, sizeof(w));
+		acc += w;
+		}
 
-	return sum;
+	if ( n )
+		{
+		u_short s;
+		memcpy(&s, cp, sizeof(s));
+		acc += s;
+		}
+
+	while ( acc > 0xffff )
+		acc = (acc & 0xffff) + (acc >> 16);
+
+	return acc;
 	}
 
 int ones_complement_checksum(const IPAddr& a, uint32 sum)
@@ -8,7 +8,8 @@
 %token TOK_ATENDIF TOK_ATELSE TOK_ATIF TOK_ATIFDEF TOK_ATIFNDEF
 %token TOK_BOOL TOK_BREAK TOK_CASE TOK_CONST
 %token TOK_CONSTANT TOK_COPY TOK_COUNT TOK_COUNTER TOK_DEFAULT TOK_DELETE
-%token TOK_DOUBLE TOK_ELSE TOK_ENUM TOK_EVENT TOK_EXPORT TOK_FALLTHROUGH
+%token TOK_DOUBLE TOK_ELSE TOK_ENUM TOK_EVENT TOK_EVERY TOK_EXPORT
+%token TOK_FALLTHROUGH
 %token TOK_FILE TOK_FOR TOK_FUNCTION TOK_GLOBAL TOK_HOOK TOK_ID TOK_IF TOK_INT
 %token TOK_INTERVAL TOK_LIST TOK_LOCAL TOK_MODULE
 %token TOK_NEXT TOK_OF TOK_OPAQUE TOK_PATTERN TOK_PATTERN_TEXT
@@ -451,7 +452,7 @@ expr:
 	|	TOK_LOCAL local_id '=' expr
 			{
 			set_location(@2, @4);
-			$$ = add_and_assign_local($2, $4, new Val(1, TYPE_BOOL));
+			$$ = add_and_assign_local($2, $4, val_mgr->GetTrue());
 			}
 
 	|	expr '[' expr_list ']'
@@ -463,7 +464,7 @@ expr:
 	|	expr '[' opt_expr ':' opt_expr ']'
 			{
 			set_location(@1, @6);
-			Expr* low = $3 ? $3 : new ConstExpr(new Val(0, TYPE_COUNT));
+			Expr* low = $3 ? $3 : new ConstExpr(val_mgr->GetCount(0));
 			Expr* high = $5 ? $5 : new SizeExpr($1);
 			ListExpr* le = new ListExpr(low);
 			le->Append(high);
@@ -638,6 +639,12 @@ expr:
 			$$ = new ScheduleExpr($2, $4);
 			}
 
+	|	TOK_SCHEDULE TOK_EVERY expr '{' event '}'
+			{
+			set_location(@1, @6);
+			$$ = new ScheduleExpr($3, $5, true);
+			}
+
 	|	TOK_ID
 			{
 			set_location(@1);
@@ -677,7 +684,9 @@ expr:
 							       id->Name());
 					if ( intval < 0 )
 						reporter->InternalError("enum value not found for %s", id->Name());
-					$$ = new ConstExpr(new EnumVal(intval, t));
+					Val* v = new EnumVal(intval, t);
+					v->MakeImmortal();
+					$$ = new ConstExpr(v);
 					}
 				else
 					$$ = new NameExpr(id);
@@ -690,6 +699,14 @@ expr:
 	|	TOK_CONSTANT
 			{
 			set_location(@1);
+
+			// Literals stay around with the script's code, so
+			// there's no point in counting references to them.
+			// Tables (from hostnames) are left alone, as scripts
+			// can modify them.
+			if ( $1->Type()->Tag() != TYPE_TABLE )
+				$1->MakeImmortal();
+
 			$$ = new ConstExpr($1);
 			}
 
@@ -697,7 +714,9 @@ expr:
 			{
 			set_location(@1);
 			$1->Compile();
-			$$ = new ConstExpr(new PatternVal($1));
+			Val* v = new PatternVal($1);
+			v->MakeImmortal();
+			$$ = new ConstExpr(v);
 			}
 
 	|       '|' expr '|'
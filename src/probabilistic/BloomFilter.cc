@@ -1,13 +1,17 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <typeinfo>
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <stdlib.h>
+#include <string.h>
 
 #include "BloomFilter.h"
 
 #include "CounterVector.h"
 #include "Serializer.h"
+#include "digest.h"
 
 #include "../util.h"
 
@@ -166,6 +170,251 @@ size_t BasicBloomFilter::Count(const HashKey* key) const
 	return 1;
 	}
 
+BlockedBloomFilter::BlockedBloomFilter()
+	{
+	words = 0;
+	num_blocks = 0;
+	k = 0;
+	}
+
+BlockedBloomFilter::BlockedBloomFilter(const Hasher* hasher, size_t blocks,
+				       size_t arg_k)
+	: BloomFilter(hasher)
+	{
+	words = 0;
+	k = arg_k;
+	Allocate(blocks);
+	}
+
+BlockedBloomFilter::~BlockedBloomFilter()
+	{
+	free(words);
+	}
+
+void BlockedBloomFilter::Allocate(size_t arg_num_blocks)
+	{
+	free(words);
+	words = 0;
+	num_blocks = arg_num_blocks;
+
+	size_t size = num_blocks * words_per_block * sizeof(uint64);
+	void* p;
+
+	if ( posix_memalign(&p, 64, size) != 0 )
+		reporter->InternalError("cannot allocate %zu bytes for Bloom filter", size);
+
+	memset(p, 0, size);
+	words = static_cast<uint64*>(p);
+	}
+
+double BlockedBloomFilter::FalsePositiveRate(size_t blocks, size_t k,
+					     size_t capacity)
+	{
+	// The number of elements per block follows a Poisson distribution.
+	double lambda = static_cast<double>(capacity) / blocks;
+	double p = std::exp(-lambda);
+	double fp = 0;
+	double max = lambda + 10 * std::sqrt(lambda) + 10;
+
+	for ( size_t n = 0; n <= max; ++n )
+		{
+		if ( n > 0 )
+			p *= lambda / n;
+
+		double unset = std::pow(1 - 1.0 / bits_per_block, double(k * n));
+		fp += p * std::pow(1 - unset, double(k));
+		}
+
+	return fp;
+	}
+
+size_t BlockedBloomFilter::Blocks(double fp, size_t capacity, size_t* k)
+	{
+	capacity = std::max(capacity, size_t(1));
+
+	size_t cells = BasicBloomFilter::M(fp, capacity);
+	size_t blocks = std::max(size_t(1), (cells + bits_per_block - 1) / bits_per_block);
+
+	*k = std::max(size_t(1), BasicBloomFilter::K(blocks * bits_per_block, capacity));
+
+	// Add blocks until the uneven load no longer pushes the rate past
+	// fp. Beyond a few hundred elements per block the filter is
+	// saturated anyway.
+	for ( int i = 0; i < 32 && double(capacity) / blocks < bits_per_block; ++i )
+		{
+		if ( FalsePositiveRate(blocks, *k, capacity) <= fp )
+			break;
+
+		blocks += std::max(size_t(1), blocks / 20);
+		*k = std::max(size_t(1), BasicBloomFilter::K(blocks * bits_per_block, capacity));
+		}
+
+	return blocks;
+	}
+
+bool BlockedBloomFilter::Empty() const
+	{
+	for ( size_t i = 0; i < num_blocks * words_per_block; ++i )
+		{
+		if ( words[i] )
+			return false;
+		}
+
+	return true;
+	}
+
+void BlockedBloomFilter::Clear()
+	{
+	memset(words, 0, num_blocks * words_per_block * sizeof(uint64));
+	}
+
+bool BlockedBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const BlockedBloomFilter* o = static_cast<const BlockedBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in BlockedBloomFilter merge");
+		return false;
+		}
+
+	else if ( num_blocks != o->num_blocks || k != o->k )
+		{
+		reporter->Error("different sizes in BlockedBloomFilter merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < num_blocks * words_per_block; ++i )
+		words[i] |= o->words[i];
+
+	return true;
+	}
+
+BlockedBloomFilter* BlockedBloomFilter::Clone() const
+	{
+	BlockedBloomFilter* copy = new BlockedBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->k = k;
+	copy->Allocate(num_blocks);
+	memcpy(copy->words, words, num_blocks * words_per_block * sizeof(uint64));
+
+	return copy;
+	}
+
+std::string BlockedBloomFilter::InternalState() const
+	{
+	u_char buf[SHA256_DIGEST_LENGTH];
+	uint64 digest;
+	SHA256_CTX ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, words, num_blocks * words_per_block * sizeof(uint64));
+	sha256_final(&ctx, buf);
+	memcpy(&digest, buf, sizeof(digest));
+
+	return fmt("%" PRIu64, digest);
+	}
+
+IMPLEMENT_SERIAL(BlockedBloomFilter, SER_BLOCKEDBLOOMFILTER)
+
+bool BlockedBloomFilter::DoSerialize(SerialInfo* info) const
+	{
+	DO_SERIALIZE(SER_BLOCKEDBLOOMFILTER, BloomFilter);
+
+	if ( ! (SERIALIZE(static_cast<uint64>(num_blocks)) &&
+		SERIALIZE(static_cast<uint64>(k))) )
+		return false;
+
+	for ( size_t i = 0; i < num_blocks * words_per_block; ++i )
+		if ( ! SERIALIZE(words[i]) )
+			return false;
+
+	return true;
+	}
+
+bool BlockedBloomFilter::DoUnserialize(UnserialInfo* info)
+	{
+	DO_UNSERIALIZE(BloomFilter);
+
+	uint64 n;
+	uint64 arg_k;
+
+	if ( ! (UNSERIALIZE(&n) && UNSERIALIZE(&arg_k)) || n == 0 || arg_k == 0 )
+		return false;
+
+	k = static_cast<size_t>(arg_k);
+	Allocate(static_cast<size_t>(n));
+
+	for ( size_t i = 0; i < num_blocks * words_per_block; ++i )
+		if ( ! UNSERIALIZE(&words[i]) )
+			return false;
+
+	return true;
+	}
+
+size_t BlockedBloomFilter::Locate(const HashKey* key,
+				  uint64 mask[words_per_block]) const
+	{
+	Hasher::digest_vector h = hasher->Hash(key);
+
+	for ( size_t i = 0; i < words_per_block; ++i )
+		mask[i] = 0;
+
+	// Each bit needs 9 bits of hash. We stretch the second digest as
+	// far as needed with SplitMix64 steps.
+	uint64 state = h[1];
+	uint64 x = 0;
+	int avail = 0;
+
+	for ( size_t i = 0; i < k; ++i )
+		{
+		if ( avail < 9 )
+			{
+			state += 0x9e3779b97f4a7c15ULL;
+			x = state;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+			x ^= x >> 31;
+			avail = 64;
+			}
+
+		uint64 bit = x & (bits_per_block - 1);
+		x >>= 9;
+		avail -= 9;
+
+		mask[bit / 64] |= uint64(1) << (bit % 64);
+		}
+
+	return (h[0] % num_blocks) * words_per_block;
+	}
+
+void BlockedBloomFilter::Add(const HashKey* key)
+	{
+	uint64 mask[words_per_block];
+	uint64* block = words + Locate(key, mask);
+
+	for ( size_t i = 0; i < words_per_block; ++i )
+		block[i] |= mask[i];
+	}
+
+size_t BlockedBloomFilter::Count(const HashKey* key) const
+	{
+	uint64 mask[words_per_block];
+	const uint64* block = words + Locate(key, mask);
+
+	// Branch-free over the block's words, which compilers turn into
+	// vector instructions.
+	uint64 missing = 0;
+
+	for ( size_t i = 0; i < words_per_block; ++i )
+		missing |= mask[i] & ~block[i];
+
+	return missing ? 0 : 1;
+	}
+
 CountingBloomFilter::CountingBloomFilter()
 	{
 	cells = 0;
@@ -180,6 +180,98 @@ private:
 	BitVector* bits;
 };
 
+/**
+ * A blocked Bloom filter. It splits its bits into blocks of one cache
+ * line each, and keeps all *k* bits of an element within a single block.
+ * Lookups thus touch just one cache line, at the cost of a slightly
+ * higher false-positive rate for the same number of bits.
+ */
+class BlockedBloomFilter : public BloomFilter {
+public:
+	/**
+	 * Constructs a blocked Bloom filter.
+	 *
+	 * @param hasher The hasher to use. It must provide at least two
+	 * hash functions. The first selects the block, the second the bits
+	 * within it.
+	 *
+	 * @param blocks The number of blocks. Blocks computes the number
+	 * needed for a false-positive rate.
+	 *
+	 * @param k The number of bits to set per element.
+	 */
+	BlockedBloomFilter(const Hasher* hasher, size_t blocks, size_t k);
+
+	/**
+	 * Destructor.
+	 */
+	~BlockedBloomFilter();
+
+	/**
+	 * Computes the number of blocks needed to support a given false
+	 * positive rate and capacity. That's more than a basic Bloom filter
+	 * of the same parameters needs bits, as elements don't spread
+	 * evenly across blocks.
+	 *
+	 * @param fp The false positive rate.
+	 *
+	 * @param capacity The expected number of elements that will be
+	 * stored.
+	 *
+	 * @param k Receives the number of bits to set per element.
+	 *
+	 * Returns: The number of blocks.
+	 */
+	static size_t Blocks(double fp, size_t capacity, size_t* k);
+
+	// Overridden from BloomFilter.
+	virtual bool Empty() const override;
+	virtual void Clear() override;
+	virtual bool Merge(const BloomFilter* other) override;
+	virtual BlockedBloomFilter* Clone() const override;
+	virtual string InternalState() const override;
+
+protected:
+	DECLARE_SERIAL(BlockedBloomFilter);
+
+	/**
+	 * Default constructor.
+	 */
+	BlockedBloomFilter();
+
+	// Overridden from BloomFilter.
+	virtual void Add(const HashKey* key) override;
+	virtual size_t Count(const HashKey* key) const override;
+
+private:
+	// A block has as many bits as a cache line.
+	static const size_t words_per_block = 8;
+	static const size_t bits_per_block = words_per_block * 64;
+
+	/**
+	 * Allocates zeroed, cache-line aligned blocks.
+	 */
+	void Allocate(size_t arg_num_blocks);
+
+	/**
+	 * Computes the block an element goes into, and the bits to set
+	 * within it.
+	 *
+	 * @return The index of the block's first word.
+	 */
+	size_t Locate(const HashKey* key, uint64 mask[words_per_block]) const;
+
+	/**
+	 * Returns the false-positive rate of a filter with the given number
+	 * of blocks and bits per element, once it holds *capacity* elements.
+	 */
+	static double FalsePositiveRate(size_t blocks, size_t k, size_t capacity);
+
+	uint64* words;
+	size_t num_blocks;
+	size_t k;
+};
+
 /**
  * A counting Bloom filter.
  */
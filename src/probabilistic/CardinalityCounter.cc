@@ -2,6 +2,8 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
 
 #include "CardinalityCounter.h"
@@ -10,6 +12,76 @@
 
 using namespace probabilistic;
 
+// Bucket values are below 128, so each byte of a word of buckets has its
+// high bit clear. That allows handling a word's buckets at once.
+static const uint64_t high_bits = 0x8080808080808080ULL;
+static const uint64_t low_bits = 0x7f7f7f7f7f7f7f7fULL;
+
+// Returns the bytewise maximum of two words of buckets.
+static inline uint64_t max_buckets(uint64_t a, uint64_t b)
+	{
+	// The high bit of a byte ends up set where a's byte is at least b's.
+	uint64_t ge = ((a | high_bits) - b) & high_bits;
+	uint64_t mask = (ge >> 7) * 0xff;
+	return (a & mask) | (b & ~mask);
+	}
+
+// Returns the number of non-zero buckets in a word of buckets.
+static inline int used_buckets(uint64_t w)
+	{
+	return __builtin_popcountll((w + low_bits) & high_bits);
+	}
+
+static inline uint32_t sparse_index(uint32_t e)
+	{
+	return e >> 8;
+	}
+
+static inline uint8_t sparse_value(uint32_t e)
+	{
+	return e & 0xff;
+	}
+
+// The two helper functions of Ertl's improved raw estimator, see
+// "New cardinality estimation algorithms for HyperLogLog sketches", 2017.
+static double ertl_sigma(double x)
+	{
+	if ( x == 1 )
+		return INFINITY;
+
+	double y = 1;
+	double z = x;
+	double z_old;
+
+	do {
+		x *= x;
+		z_old = z;
+		z += x * y;
+		y += y;
+	} while ( z != z_old );
+
+	return z;
+	}
+
+static double ertl_tau(double x)
+	{
+	if ( x == 0 || x == 1 )
+		return 0;
+
+	double y = 1;
+	double z = 1 - x;
+	double z_old;
+
+	do {
+		x = sqrt(x);
+		z_old = z;
+		y *= 0.5;
+		z -= (1 - x) * (1 - x) * y;
+	} while ( z != z_old );
+
+	return z / 3;
+	}
+
 int CardinalityCounter::OptimalB(double error, double confidence) const
 	{
 	double initial_estimate = 2 * (log(1.04) - log(error)) / log(2);
@@ -56,18 +128,19 @@ void CardinalityCounter::Init(uint64_t size)
 
 	p = calc_p;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
+	// Buckets get allocated once the counter stops being sparse.
+	sparse_mode = (m <= (1 << 24));
 
-	assert(buckets.size() == m);
+	if ( ! sparse_mode )
+		buckets.assign(m, 0);
 
 	V = m;
 	}
 
 CardinalityCounter::CardinalityCounter(CardinalityCounter& other)
-	: buckets(other.buckets)
+	: buckets(other.buckets), sparse(other.sparse)
 	{
+	sparse_mode = other.sparse_mode;
 	V = other.V;
 	alpha_m = other.alpha_m;
 	m = other.m;
@@ -83,6 +156,8 @@ CardinalityCounter::CardinalityCounter(CardinalityCounter&& o)
 
 	o.m = 0;
 	buckets = std::move(o.buckets);
+	sparse = std::move(o.sparse);
+	sparse_mode = o.sparse_mode;
 	}
 
 CardinalityCounter::CardinalityCounter(double error_margin, double confidence)
@@ -102,9 +177,8 @@ CardinalityCounter::CardinalityCounter(uint64_t arg_size, uint64_t arg_V, double
 	{
 	m = arg_size;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
+	buckets.assign(m, 0);
+	sparse_mode = false;
 
 	alpha_m = arg_alpha_m;
 	V = arg_V;
@@ -129,15 +203,83 @@ void CardinalityCounter::AddElement(uint64_t hash)
 	uint64_t index = hash % m;
 	hash = hash-index;
 
-	if( buckets[index] == 0 )
+	uint8_t temp = Rank(hash);
+
+	if ( sparse_mode )
+		{
+		uint32_t e = (uint32_t(index) << 8) | temp;
+		std::vector<uint32_t>::iterator i =
+			std::lower_bound(sparse.begin(), sparse.end(), uint32_t(index) << 8);
+
+		if ( i != sparse.end() && sparse_index(*i) == index )
+			{
+			if ( temp > sparse_value(*i) )
+				*i = e;
+
+			return;
+			}
+
+		sparse.insert(i, e);
 		V--;
 
-	uint8_t temp = Rank(hash);
+		if ( sparse.size() > SparseLimit() )
+			MakeDense();
+
+		return;
+		}
+
+	if( buckets[index] == 0 )
+		V--;
 
 	if ( temp > buckets[index] )
 		buckets[index] = temp;
 	}
 
+void CardinalityCounter::MakeDense()
+	{
+	if ( ! sparse_mode )
+		return;
+
+	buckets.assign(m, 0);
+
+	for ( unsigned int i = 0; i < sparse.size(); i++ )
+		buckets[sparse_index(sparse[i])] = sparse_value(sparse[i]);
+
+	std::vector<uint32_t>().swap(sparse);
+	sparse_mode = false;
+	}
+
+void CardinalityCounter::Histogram(uint64_t counts[65]) const
+	{
+	memset(counts, 0, 65 * sizeof(uint64_t));
+
+	if ( sparse_mode )
+		{
+		for ( unsigned int i = 0; i < sparse.size(); i++ )
+			++counts[sparse_value(sparse[i])];
+
+		counts[0] = V;
+		return;
+		}
+
+	for ( uint64_t i = 0; i < m; i++ )
+		++counts[buckets[i]];
+	}
+
+double CardinalityCounter::ImprovedEstimate(const uint64_t counts[65]) const
+	{
+	// Bucket values go up to q + 1.
+	int q = 64 - p;
+	double z = m * ertl_tau(1 - double(counts[q + 1]) / m);
+
+	for ( int k = q; k >= 1; k-- )
+		z = 0.5 * (z + counts[k]);
+
+	z += m * ertl_sigma(double(counts[0]) / m);
+
+	return m * m / (2 * log(2.0) * z);
+	}
+
 /**
  * Estimate the size by using the the "raw" HyperLogLog estimate. Then,
  * check if it's too "large" or "small" because the raw estimate doesn't
@@ -149,16 +291,28 @@ void CardinalityCounter::AddElement(uint64_t hash)
  **/
 double CardinalityCounter::Size() const
 	{
+	// All buckets with the same value contribute the same, so sum
+	// up their histogram instead of each bucket.
+	uint64_t counts[65];
+	Histogram(counts);
+
 	double answer = 0;
-	for ( unsigned int i = 0; i < m; i++ )
-		answer += pow(2, -((int)buckets[i]));
+	for ( int i = 0; i < 65; i++ )
+		{
+		if ( counts[i] )
+			answer += counts[i] * ldexp(1.0, -i);
+		}
 
 	answer = 1 / answer;
 	answer = (alpha_m * m * m * answer);
 
-	if ( answer <= 5.0 * (m/2) )
+	if ( answer <= 5.0 * (m/2) && V > 0 )
 		return m * log(((double)m) / V);
 
+	else if ( answer <= 5.0 * m )
+		// The raw estimate is biased here.
+		return ImprovedEstimate(counts);
+
 	else if ( answer <= (pow(2, 64) / 30) )
 		return answer;
 
@@ -171,24 +325,102 @@ bool CardinalityCounter::Merge(CardinalityCounter* c)
 	if ( m != c->GetM() )
 		return false;
 
-	const vector<uint8_t> temp = c->GetBuckets();
+	if ( c->sparse_mode )
+		{
+		if ( sparse_mode )
+			{
+			MergeSparse(c->sparse);
+			return true;
+			}
 
-	V = 0;
+		for ( unsigned int i = 0; i < c->sparse.size(); i++ )
+			{
+			uint32_t index = sparse_index(c->sparse[i]);
+			uint8_t value = sparse_value(c->sparse[i]);
 
-	for ( unsigned int i = 0; i < m; i++ )
-		{
-		if ( temp[i] > buckets[i] )
-			buckets[i] = temp[i];
+			if ( buckets[index] == 0 )
+				V--;
+
+			if ( value > buckets[index] )
+				buckets[index] = value;
+			}
 
-		if ( buckets[i] == 0 )
-			++V;
+		return true;
 		}
 
+	MakeDense();
+	MergeDense(c->buckets);
 	return true;
 	}
 
-const vector<uint8_t> &CardinalityCounter::GetBuckets() const
+void CardinalityCounter::MergeSparse(const std::vector<uint32_t>& other)
+	{
+	std::vector<uint32_t> merged;
+	merged.reserve(sparse.size() + other.size());
+
+	std::vector<uint32_t>::const_iterator i = sparse.cbegin();
+	std::vector<uint32_t>::const_iterator j = other.begin();
+
+	while ( i != sparse.cend() && j != other.end() )
+		{
+		if ( sparse_index(*i) < sparse_index(*j) )
+			merged.push_back(*i++);
+
+		else if ( sparse_index(*j) < sparse_index(*i) )
+			merged.push_back(*j++);
+
+		else
+			{
+			merged.push_back(std::max(*i, *j));
+			++i;
+			++j;
+			}
+		}
+
+	merged.insert(merged.end(), i, sparse.cend());
+	merged.insert(merged.end(), j, other.end());
+
+	sparse.swap(merged);
+	V = m - sparse.size();
+
+	if ( sparse.size() > SparseLimit() )
+		MakeDense();
+	}
+
+void CardinalityCounter::MergeDense(const std::vector<uint8_t>& other)
+	{
+	uint8_t* a = &buckets[0];
+	const uint8_t* b = &other[0];
+	uint64_t used = 0;
+	uint64_t i = 0;
+
+	// Eight buckets at a time; m is a power of two of at least 16.
+	for ( ; i + 8 <= m; i += 8 )
+		{
+		uint64_t wa, wb;
+		memcpy(&wa, a + i, sizeof(wa));
+		memcpy(&wb, b + i, sizeof(wb));
+
+		uint64_t w = max_buckets(wa, wb);
+		memcpy(a + i, &w, sizeof(w));
+		used += used_buckets(w);
+		}
+
+	for ( ; i < m; i++ )
+		{
+		if ( b[i] > a[i] )
+			a[i] = b[i];
+
+		if ( a[i] )
+			++used;
+		}
+
+	V = m - used;
+	}
+
+const vector<uint8_t> &CardinalityCounter::GetBuckets()
 	{
+	MakeDense();
 	return buckets;
 	}
 
@@ -205,6 +437,24 @@ bool CardinalityCounter::Serialize(SerialInfo* info) const
 	valid &= SERIALIZE(V);
 	valid &= SERIALIZE(alpha_m);
 
+	if ( sparse_mode )
+		{
+		// The format always has the full set of buckets.
+		unsigned int j = 0;
+
+		for ( unsigned int i = 0; i < m; i++ )
+			{
+			uint8_t value = 0;
+
+			if ( j < sparse.size() && sparse_index(sparse[j]) == i )
+				value = sparse_value(sparse[j++]);
+
+			valid &= SERIALIZE((char)value);
+			}
+
+		return valid;
+		}
+
 	for ( unsigned int i = 0; i < m; i++ )
 		valid &= SERIALIZE((char)buckets[i]);
 
@@ -236,7 +486,26 @@ CardinalityCounter* CardinalityCounter::Unserialize(UnserialInfo* info)
 	if ( ! valid )
 		{
 		delete c;
-		c = 0;
+		return 0;
+		}
+
+	// Go back to sparse if few buckets are in use.
+	if ( m <= (1 << 24) && m - c->V <= c->SparseLimit() )
+		{
+		for ( unsigned int i = 0; i < m; i++ )
+			{
+			if ( buckets[i] )
+				c->sparse.push_back((i << 8) | buckets[i]);
+			}
+
+		if ( c->sparse.size() <= c->SparseLimit() )
+			{
+			std::vector<uint8_t>().swap(buckets);
+			c->V = m - c->sparse.size();
+			c->sparse_mode = true;
+			}
+		else
+			c->sparse.clear();
 		}
 
 	return c;
@@ -10,6 +10,12 @@ namespace probabilistic {
 
 /**
  * A probabilistic cardinality counter using the HyperLogLog algorithm.
+ *
+ * As long as only few of its buckets are in use, the counter keeps just
+ * those in a sorted list, which takes much less memory than the full set
+ * of buckets for the large counters that small error margins need.
+ * It switches to the full set once the list grows beyond an eighth of
+ * the number of buckets.
  */
 class CardinalityCounter {
 public:
@@ -113,13 +119,19 @@ protected:
 
 	/**
 	 * Returns the buckets array that holds all of the rough cardinality
-	 * estimates.
+	 * estimates. This switches the counter to the full set of buckets
+	 * if it's sparse so far.
 	 *
 	 * Use GetM() to determine the size.
 	 *
 	 * @return Array containing cardinality estimates
 	 */
-	const std::vector<uint8_t>& GetBuckets() const;
+	const std::vector<uint8_t>& GetBuckets();
+
+	/**
+	 * Returns true if the counter currently keeps only its used buckets.
+	 */
+	bool IsSparse() const	{ return sparse_mode; }
 
 private:
 	/**
@@ -166,11 +178,56 @@ private:
 	 */
 	uint8_t Rank(uint64_t hash_modified) const;
 
+	/**
+	 * Switches a sparse counter to the full set of buckets.
+	 */
+	void MakeDense();
+
+	/**
+	 * Merges a list of used buckets into this sparse counter, switching
+	 * to the full set of buckets if the result gets too large.
+	 *
+	 * @param other sorted list of used buckets, encoded like sparse
+	 */
+	void MergeSparse(const std::vector<uint32_t>& other);
+
+	/**
+	 * Merges a full set of buckets into this counter's full set, and
+	 * updates V.
+	 *
+	 * @param other buckets of the same size as ours
+	 */
+	void MergeDense(const std::vector<uint8_t>& other);
+
+	/**
+	 * Fills in the number of buckets having each possible value.
+	 *
+	 * @param counts array receiving the counts, indexed by bucket value
+	 */
+	void Histogram(uint64_t counts[65]) const;
+
+	/**
+	 * Returns the estimate of Ertl's improved raw estimator, computed
+	 * from the histogram of the bucket values. Unlike the paper's raw
+	 * estimate it has no bias for cardinalities of a few times m,
+	 * which is the range that HyperLogLog++ corrects with empirically
+	 * determined tables.
+	 *
+	 * @param counts histogram as returned by Histogram()
+	 */
+	double ImprovedEstimate(const uint64_t counts[65]) const;
+
 	/**
 	 * flsll from FreeBSD; especially Linux does not have this.
 	 */
 	static int flsll(uint64_t mask);
 
+	/**
+	 * Returns the maximum number of entries a sparse counter keeps
+	 * before switching to the full set of buckets.
+	 */
+	uint64_t SparseLimit() const	{ return m / 8; }
+
 	/**
 	 * This is the number of buckets that will be stored. The standard
 	 * error is 1.04/sqrt(m), so the actual cardinality will be the
@@ -186,6 +243,15 @@ private:
 	 */
 	std::vector<uint8_t> buckets;
 
+	/**
+	 * The buckets in use while the counter is sparse, sorted by index.
+	 * Each entry holds the bucket's index in its upper 24 bits and its
+	 * value in the lower 8. Counters with more buckets than fit into 24
+	 * bits are never sparse.
+	 */
+	std::vector<uint32_t> sparse;
+	bool sparse_mode;
+
 	/**
 	 * There are some state constants that need to be kept track of to
 	 * make the final estimate easier. V is the number of values in
@@ -0,0 +1,346 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <cmath>
+
+#include "CuckooFilter.h"
+
+#include "Serializer.h"
+
+#include "../util.h"
+
+using namespace probabilistic;
+
+// Constants for operating on all slots of a bucket at once.
+static const uint64 slots_low = 0x0001000100010001ULL;
+static const uint64 slots_high = 0x8000800080008000ULL;
+static const uint64 slots_rest = 0x7fff7fff7fff7fffULL;
+
+CuckooFilter::CuckooFilter()
+	{
+	hasher = 0;
+	num_items = 0;
+	have_victim = false;
+	victim_fp = 0;
+	victim_index = 0;
+	}
+
+CuckooFilter::CuckooFilter(const Hasher* arg_hasher, size_t num_buckets)
+	: buckets(num_buckets, 0)
+	{
+	hasher = arg_hasher;
+	num_items = 0;
+	have_victim = false;
+	victim_fp = 0;
+	victim_index = 0;
+	}
+
+CuckooFilter::~CuckooFilter()
+	{
+	delete hasher;
+	}
+
+size_t CuckooFilter::Buckets(size_t capacity)
+	{
+	// Leave some headroom, as insertions start failing at about 95%.
+	double needed = std::ceil(capacity / (slots_per_bucket * 0.95));
+
+	size_t n = 1;
+	while ( n < needed )
+		n <<= 1;
+
+	return n;
+	}
+
+CuckooFilter::bucket CuckooFilter::Matches(bucket b, uint16 fp)
+	{
+	// Zeroes the slots holding the fingerprint, then finds the zero
+	// slots: adding 0x7fff to a slot's low 15 bits carries into its top
+	// bit unless they're all zero, and never into the next slot.
+	bucket x = b ^ (fp * slots_low);
+	return ~(((x & slots_rest) + slots_rest) | x) & slots_high;
+	}
+
+void CuckooFilter::Locate(const HashKey* key, uint16* fp, size_t* index) const
+	{
+	Hasher::digest h = hasher->Hash(key)[0];
+
+	// The fingerprint takes the top bits, the index the bottom ones. A
+	// zero fingerprint would mark an empty slot.
+	*fp = h >> 48;
+
+	if ( *fp == 0 )
+		*fp = 1;
+
+	*index = h & (buckets.size() - 1);
+	}
+
+size_t CuckooFilter::AltIndex(size_t index, uint16 fp) const
+	{
+	// Being an XOR, this maps the two buckets onto each other.
+	return (index ^ (fp * 0x5bd1e995ULL)) & (buckets.size() - 1);
+	}
+
+bool CuckooFilter::Insert(uint16 fp, size_t index)
+	{
+	size_t alt = AltIndex(index, fp);
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		bucket& b = buckets[i == 0 ? index : alt];
+		bucket empty = Matches(b, 0);
+
+		if ( empty )
+			{
+			b |= bucket(fp) << (__builtin_ctzll(empty) & ~15);
+			return true;
+			}
+		}
+
+	// Both buckets are full, so we evict a fingerprint and move it over
+	// to its alternate bucket, and so on. The choice of slot is
+	// deterministic, so that the filter's state depends on nothing but
+	// its input.
+	if ( fp & 1 )
+		index = alt;
+
+	for ( size_t n = 0; n < max_kicks; ++n )
+		{
+		int shift = ((fp + n) % slots_per_bucket) * 16;
+		bucket& b = buckets[index];
+		uint16 evicted = b >> shift;
+
+		b = (b & ~(bucket(0xffff) << shift)) | (bucket(fp) << shift);
+		fp = evicted;
+		index = AltIndex(index, fp);
+
+		bucket& next = buckets[index];
+		bucket empty = Matches(next, 0);
+
+		if ( empty )
+			{
+			next |= bucket(fp) << (__builtin_ctzll(empty) & ~15);
+			return true;
+			}
+		}
+
+	// Rather than undoing all the kicks, we keep the last one aside.
+	have_victim = true;
+	victim_fp = fp;
+	victim_index = index;
+	return true;
+	}
+
+bool CuckooFilter::Add(const HashKey* key)
+	{
+	if ( have_victim )
+		return false;
+
+	uint16 fp;
+	size_t index;
+	Locate(key, &fp, &index);
+
+	Insert(fp, index);
+	++num_items;
+	return true;
+	}
+
+bool CuckooFilter::Remove(const HashKey* key)
+	{
+	uint16 fp;
+	size_t index;
+	Locate(key, &fp, &index);
+
+	size_t alt = AltIndex(index, fp);
+
+	if ( have_victim && victim_fp == fp &&
+	     (victim_index == index || victim_index == alt) )
+		{
+		have_victim = false;
+		--num_items;
+		return true;
+		}
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		bucket& b = buckets[i == 0 ? index : alt];
+		bucket found = Matches(b, fp);
+
+		if ( ! found )
+			continue;
+
+		b &= ~(bucket(0xffff) << (__builtin_ctzll(found) & ~15));
+		--num_items;
+
+		// Now there's room for the victim again.
+		if ( have_victim )
+			{
+			have_victim = false;
+			Insert(victim_fp, victim_index);
+			}
+
+		return true;
+		}
+
+	return false;
+	}
+
+size_t CuckooFilter::Count(const HashKey* key) const
+	{
+	uint16 fp;
+	size_t index;
+	Locate(key, &fp, &index);
+
+	size_t alt = AltIndex(index, fp);
+	size_t n = __builtin_popcountll(Matches(buckets[index], fp));
+
+	if ( alt != index )
+		n += __builtin_popcountll(Matches(buckets[alt], fp));
+
+	if ( have_victim && victim_fp == fp &&
+	     (victim_index == index || victim_index == alt) )
+		++n;
+
+	return n;
+	}
+
+void CuckooFilter::Clear()
+	{
+	std::fill(buckets.begin(), buckets.end(), 0);
+	num_items = 0;
+	have_victim = false;
+	}
+
+bool CuckooFilter::Merge(const CuckooFilter* other)
+	{
+	if ( ! hasher->Equals(other->hasher) )
+		{
+		reporter->Error("incompatible hashers in CuckooFilter merge");
+		return false;
+		}
+
+	if ( buckets.size() != other->buckets.size() )
+		{
+		reporter->Error("different number of buckets in CuckooFilter merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < other->buckets.size(); ++i )
+		{
+		for ( bucket b = other->buckets[i]; b; b >>= 16 )
+			{
+			uint16 fp = b;
+
+			if ( ! fp )
+				continue;
+
+			if ( have_victim )
+				return false;
+
+			Insert(fp, i);
+			++num_items;
+			}
+		}
+
+	if ( other->have_victim )
+		{
+		if ( have_victim )
+			return false;
+
+		Insert(other->victim_fp, other->victim_index);
+		++num_items;
+		}
+
+	return true;
+	}
+
+CuckooFilter* CuckooFilter::Clone() const
+	{
+	CuckooFilter* copy = new CuckooFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->buckets = buckets;
+	copy->num_items = num_items;
+	copy->have_victim = have_victim;
+	copy->victim_fp = victim_fp;
+	copy->victim_index = victim_index;
+
+	return copy;
+	}
+
+std::string CuckooFilter::InternalState() const
+	{
+	return fmt("%zu items in %zu buckets%s", num_items, buckets.size(),
+		   have_victim ? ", full" : "");
+	}
+
+bool CuckooFilter::Serialize(SerialInfo* info) const
+	{
+	return SerialObj::Serialize(info);
+	}
+
+CuckooFilter* CuckooFilter::Unserialize(UnserialInfo* info)
+	{
+	return reinterpret_cast<CuckooFilter*>(SerialObj::Unserialize(info, SER_CUCKOOFILTER));
+	}
+
+IMPLEMENT_SERIAL(CuckooFilter, SER_CUCKOOFILTER);
+
+bool CuckooFilter::DoSerialize(SerialInfo* info) const
+	{
+	DO_SERIALIZE(SER_CUCKOOFILTER, SerialObj);
+
+	if ( ! hasher->Serialize(info) )
+		return false;
+
+	if ( ! SERIALIZE(static_cast<uint64>(buckets.size())) )
+		return false;
+
+	for ( size_t i = 0; i < buckets.size(); ++i )
+		if ( ! SERIALIZE(buckets[i]) )
+			return false;
+
+	return SERIALIZE(have_victim) &&
+		SERIALIZE(victim_fp) &&
+		SERIALIZE(static_cast<uint64>(victim_index));
+	}
+
+bool CuckooFilter::DoUnserialize(UnserialInfo* info)
+	{
+	DO_UNSERIALIZE(SerialObj);
+
+	hasher = Hasher::Unserialize(info);
+	if ( ! hasher )
+		return false;
+
+	uint64 n;
+	if ( ! UNSERIALIZE(&n) )
+		return false;
+
+	// The bucket count must be a power of two.
+	if ( n == 0 || (n & (n - 1)) )
+		return false;
+
+	buckets.resize(n);
+	num_items = 0;
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		if ( ! UNSERIALIZE(&buckets[i]) )
+			return false;
+
+		num_items += __builtin_popcountll(~Matches(buckets[i], 0) & slots_high);
+		}
+
+	uint64 index;
+	if ( ! (UNSERIALIZE(&have_victim) &&
+		UNSERIALIZE(&victim_fp) &&
+		UNSERIALIZE(&index)) || index >= n )
+		return false;
+
+	victim_index = index;
+
+	if ( have_victim )
+		++num_items;
+
+	return true;
+	}
@@ -0,0 +1,189 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef PROBABILISTIC_CUCKOOFILTER_H
+#define PROBABILISTIC_CUCKOOFILTER_H
+
+#include <string>
+#include <vector>
+
+#include "Hasher.h"
+
+namespace probabilistic {
+
+/**
+ * A cuckoo filter. Like a Bloom filter, it answers set membership queries
+ * with a small false-positive rate, but it can also remove elements again,
+ * for about the memory of a basic Bloom filter rather than that of a
+ * counting one.
+ *
+ * The filter stores a 16-bit fingerprint per element, in one of two
+ * candidate buckets of four slots each. The second bucket derives from the
+ * first and the fingerprint alone (partial-key cuckoo hashing), so that
+ * elements can move between their buckets without knowing the element
+ * itself. A bucket fits into a single 64-bit word, which lookups compare
+ * against the fingerprint in all four slots at once. With that layout, the
+ * false-positive rate is about 1.2e-4, and the filter fills up to about
+ * 95% before insertions start to fail.
+ */
+class CuckooFilter : public SerialObj {
+public:
+	/**
+	 * Constructs a cuckoo filter.
+	 *
+	 * @param hasher The hasher to use. Only its first hash value is used.
+	 *
+	 * @param buckets The number of buckets, which must be a power of two.
+	 * *Buckets* computes it for a given capacity.
+	 */
+	CuckooFilter(const Hasher* hasher, size_t buckets);
+
+	/**
+	 * Destructor.
+	 */
+	~CuckooFilter();
+
+	/**
+	 * Computes the number of buckets needed to hold a given number of
+	 * elements.
+	 *
+	 * @param capacity The expected number of elements that will be stored.
+	 *
+	 * @return The number of buckets, a power of two.
+	 */
+	static size_t Buckets(size_t capacity);
+
+	/**
+	 * Adds an element. An element may be added more than once; it then
+	 * needs to be removed as many times.
+	 *
+	 * @param key The key associated with the element to add.
+	 *
+	 * @return False if the filter is full. It then remains unchanged.
+	 */
+	bool Add(const HashKey* key);
+
+	/**
+	 * Removes an element added earlier. Removing an element that hasn't
+	 * been added may remove another one that shares its fingerprint.
+	 *
+	 * @param key The key associated with the element to remove.
+	 *
+	 * @return True if the element was found.
+	 */
+	bool Remove(const HashKey* key);
+
+	/**
+	 * Retrieves how often an element appears to be in the filter.
+	 *
+	 * @param key The key associated with the element to check.
+	 *
+	 * @return The number of times *key* has been added, or more in the
+	 * case of false positives.
+	 */
+	size_t Count(const HashKey* key) const;
+
+	/**
+	 * Returns the number of elements in the filter.
+	 */
+	size_t Size() const	{ return num_items; }
+
+	/**
+	 * Checks whether the filter is empty.
+	 */
+	bool Empty() const	{ return num_items == 0; }
+
+	/**
+	 * Removes all elements.
+	 */
+	void Clear();
+
+	/**
+	 * Adds all elements of another filter to this one. Both must have
+	 * the same number of buckets and equal hashers.
+	 *
+	 * @param other The other filter.
+	 *
+	 * @return False if the filters don't match, or if this one ran full.
+	 * It may then hold some, but not all, of *other*'s elements.
+	 */
+	bool Merge(const CuckooFilter* other);
+
+	/**
+	 * Constructs a copy of this filter.
+	 */
+	CuckooFilter* Clone() const;
+
+	/**
+	 * Returns a string with a representation of the filter's internal
+	 * state. This is for debugging/testing purposes only.
+	 */
+	std::string InternalState() const;
+
+	/**
+	 * Serializes the filter.
+	 *
+	 * @param info The serializaton information to use.
+	 *
+	 * @return True if successful.
+	 */
+	bool Serialize(SerialInfo* info) const;
+
+	/**
+	 * Unserializes a filter.
+	 *
+	 * @param info The serializaton information to use.
+	 *
+	 * @return The unserialized filter, or null if an error occured.
+	 */
+	static CuckooFilter* Unserialize(UnserialInfo* info);
+
+protected:
+	DECLARE_SERIAL(CuckooFilter);
+
+	/**
+	 * Default constructor.
+	 */
+	CuckooFilter();
+
+private:
+	typedef uint64 bucket;
+
+	static const size_t slots_per_bucket = 4;
+	static const size_t max_kicks = 500;
+
+	/**
+	 * Computes an element's fingerprint and first bucket.
+	 */
+	void Locate(const HashKey* key, uint16* fp, size_t* index) const;
+
+	/**
+	 * Returns the other bucket a fingerprint may go into.
+	 */
+	size_t AltIndex(size_t index, uint16 fp) const;
+
+	/**
+	 * Stores a fingerprint into one of its buckets, kicking others over
+	 * to their alternate buckets as needed.
+	 */
+	bool Insert(uint16 fp, size_t index);
+
+	/**
+	 * Returns a mask with the top bit set of each slot holding the
+	 * fingerprint; with a zero fingerprint, of each empty slot.
+	 */
+	static bucket Matches(bucket b, uint16 fp);
+
+	const Hasher* hasher;
+	std::vector<bucket> buckets;
+	size_t num_items;
+
+	// A fingerprint that found no room when its insertion gave up
+	// kicking. Once there's one, the filter counts as full.
+	bool have_victim;
+	uint16 victim_fp;
+	size_t victim_index;
+};
+
+}
+
+#endif
@@ -240,3 +240,105 @@ bool DoubleHasher::DoUnserialize(UnserialInfo* info)
 
 	return true;
 	}
+
+// Helpers for FastHasher.
+
+static const uint64 fast_p0 = 0xa0761d6478bd642fULL;
+static const uint64 fast_p1 = 0xe7037ed1a0b428dbULL;
+static const uint64 fast_p2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64 fast_p3 = 0x589965cc75374cc3ULL;
+
+// Multiplies into 128 bits and folds the halves together.
+static inline uint64 fast_mix(uint64 a, uint64 b)
+	{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = static_cast<__uint128_t>(a) * b;
+	return static_cast<uint64>(r) ^ static_cast<uint64>(r >> 64);
+#else
+	uint64 ha = a >> 32, la = a & 0xffffffff;
+	uint64 hb = b >> 32, lb = b & 0xffffffff;
+	uint64 hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+	uint64 mid = (ll >> 32) + (hl & 0xffffffff) + (lh & 0xffffffff);
+	uint64 lo = (mid << 32) | (ll & 0xffffffff);
+	uint64 hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+	return lo ^ hi;
+#endif
+	}
+
+static inline uint64 fast_read(const u_char* p)
+	{
+	uint64 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+	}
+
+FastHasher::FastHasher(size_t k, seed_t seed)
+	: Hasher(k, seed)
+	{
+	}
+
+Hasher::digest_vector FastHasher::Hash(const void* x, size_t n) const
+	{
+	const u_char* p = reinterpret_cast<const u_char*>(x);
+	uint64 a = Seed().h1 ^ fast_p0;
+	uint64 b = Seed().h2 ^ fast_p1 ^ n;
+
+	for ( ; n >= 16; n -= 16, p += 16 )
+		{
+		uint64 x0 = fast_read(p) ^ a;
+		uint64 x1 = fast_read(p + 8) ^ b;
+		a = fast_mix(x0 ^ fast_p2, x1 ^ fast_p1);
+		b = fast_mix(x0 ^ fast_p3, x1 ^ fast_p0);
+		}
+
+	if ( n > 0 )
+		{
+		u_char tail[16] = { 0 };
+		memcpy(tail, p, n);
+
+		uint64 x0 = fast_read(tail) ^ a;
+		uint64 x1 = fast_read(tail + 8) ^ b;
+		a = fast_mix(x0 ^ fast_p2, x1 ^ fast_p1);
+		b = fast_mix(x0 ^ fast_p3, x1 ^ fast_p0);
+		}
+
+	digest d1 = fast_mix(a ^ fast_p0, b ^ fast_p2);
+	digest d2 = fast_mix(b ^ fast_p1, a ^ fast_p3);
+	digest_vector h(K(), 0);
+
+	for ( size_t i = 0; i < h.size(); ++i )
+		h[i] = d1 + i * d2;
+
+	return h;
+	}
+
+FastHasher* FastHasher::Clone() const
+	{
+	return new FastHasher(*this);
+	}
+
+bool FastHasher::Equals(const Hasher* other) const
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	return K() == other->K() &&
+		Seed().h1 == other->Seed().h1 &&
+		Seed().h2 == other->Seed().h2;
+	}
+
+IMPLEMENT_SERIAL(FastHasher, SER_FASTHASHER)
+
+bool FastHasher::DoSerialize(SerialInfo* info) const
+	{
+	DO_SERIALIZE(SER_FASTHASHER, Hasher);
+
+	// Nothing to do here, the base class has all we need serialized already.
+	return true;
+	}
+
+bool FastHasher::DoUnserialize(UnserialInfo* info)
+	{
+	DO_UNSERIALIZE(Hasher);
+	return true;
+	}
@@ -245,6 +245,36 @@ private:
 	UHF h2;
 };
 
+/**
+ * A hasher that hashes an element just once, into 128 bits, and derives
+ * all *k* hash values from the two halves with double hashing. Its hash
+ * function builds on 64x64-bit multiplication, in the style of wyhash, and
+ * consumes 16 bytes per step. That makes it quite a bit faster than the
+ * other hashers, which compute several SipHash or MD5 digests per element.
+ * It's not suitable for anything but hash tables and filters, though.
+ */
+class FastHasher : public Hasher {
+public:
+	/**
+	 * Constructor for a hasher with *k* hash functions.
+	 *
+	 * @param k The number of hash functions to use.
+	 *
+	 * @param seed The seed for the hasher.
+	 */
+	FastHasher(size_t k, Hasher::seed_t seed);
+
+	// Overridden from Hasher.
+	virtual digest_vector Hash(const void* x, size_t n) const final;
+	virtual FastHasher* Clone() const final;
+	virtual bool Equals(const Hasher* other) const final;
+
+	DECLARE_SERIAL(FastHasher);
+
+private:
+	FastHasher() { }
+};
+
 }
 
 #endif
@@ -1,5 +1,8 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
+#include <vector>
+
 #include "probabilistic/Topk.h"
 #include "CompHash.h"
 #include "Reporter.h"
@@ -19,6 +22,13 @@ static void topk_element_hash_delete_func(void* val)
 Element::~Element()
 	{
 	Unref(value);
+	delete key;
+	}
+
+static bool topk_count_less(const std::pair<uint64, Element*>& a,
+			    const std::pair<uint64, Element*>& b)
+	{
+	return a.first < b.first;
 	}
 
 void TopkVal::Typify(BroType* t)
@@ -38,6 +48,40 @@ HashKey* TopkVal::GetHash(Val* v) const
 	return key;
 	}
 
+Element* TopkVal::NewElement(Val* v, HashKey* key)
+	{
+	Element* e = new Element();
+	e->epsilon = 0;
+	e->value = v->Ref();
+	e->key = key;
+	e->parent = 0;
+
+	// The dictionary takes over the copy's key.
+	HashKey k(key->Key(), key->Size(), key->Hash());
+	elementDict->Insert(&k, e);
+
+	return e;
+	}
+
+void TopkVal::AddToBucket(Element* e, Bucket* b)
+	{
+	e->parent = b;
+	e->pos = b->elements.insert(b->elements.end(), e);
+	}
+
+void TopkVal::RemoveFromBucket(Element* e)
+	{
+	Bucket* b = e->parent;
+	b->elements.erase(e->pos);
+	e->parent = 0;
+
+	if ( b->elements.empty() )
+		{
+		buckets.erase(b->bucketPos);
+		delete b;
+		}
+	}
+
 TopkVal::TopkVal(uint64 arg_size) : OpaqueVal(topk_type)
 	{
 	elementDict = new PDict(Element);
@@ -93,6 +137,12 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			}
 		}
 
+	// First sum up the counts of all elements the other one has, taking
+	// them out of their buckets. Elements end up at the end of their
+	// new bucket, in the order we come across them.
+	std::vector<std::pair<uint64, Element*> > merged;
+	merged.reserve(value->numElements);
+
 	std::list<Bucket*>::const_iterator it = value->buckets.begin();
 	while ( it != value->buckets.end() )
 		{
@@ -104,38 +154,24 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			{
 			Element* e = *eit;
 			// lookup if we already know this one...
-			HashKey* key = GetHash(e->value);
-			Element* olde = (Element*) elementDict->Lookup(key);
+			Element* olde = (Element*) elementDict->Lookup(e->key);
+			uint64 newcount = currcount;
 
 			if ( olde == 0 )
 				{
-				olde = new Element();
-				olde->epsilon = 0;
-				olde->value = e->value->Ref();
-				// insert at bucket position 0
-				if ( buckets.size() > 0 )
-					{
-					assert (buckets.front()-> count > 0 );
-					}
-
-				Bucket* newbucket = new Bucket();
-				newbucket->count = 0;
-				newbucket->bucketPos = buckets.insert(buckets.begin(), newbucket);
-
-				olde->parent = newbucket;
-				newbucket->elements.insert(newbucket->elements.end(), olde);
-
-				elementDict->Insert(key, olde);
+				HashKey* key = new HashKey(e->key->Key(), e->key->Size(),
+							   e->key->Hash());
+				olde = NewElement(e->value, key);
 				numElements++;
-
+				}
+			else
+				{
+				newcount += olde->parent->count;
+				RemoveFromBucket(olde);
 				}
 
-			// now that we are sure that the old element is present - increment epsilon
 			olde->epsilon += e->epsilon;
-
-			// and increment position...
-			IncrementCounter(olde, currcount);
-			delete key;
+			merged.push_back(std::make_pair(newcount, olde));
 
 			eit++;
 			}
@@ -143,6 +179,29 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 		it++;
 		}
 
+	// Then put them into their buckets in a single pass.
+	std::stable_sort(merged.begin(), merged.end(), topk_count_less);
+
+	std::list<Bucket*>::iterator bi = buckets.begin();
+
+	for ( size_t i = 0; i < merged.size(); ++i )
+		{
+		uint64 count = merged[i].first;
+
+		while ( bi != buckets.end() && (*bi)->count < count )
+			bi++;
+
+		if ( bi == buckets.end() || (*bi)->count != count )
+			{
+			Bucket* b = new Bucket();
+			b->count = count;
+			bi = buckets.insert(bi, b);
+			b->bucketPos = bi;
+			}
+
+		AddToBucket(merged[i].second, *bi);
+		}
+
 	// now we have added everything. And our top-k table could be too big.
 	// prune everything...
 
@@ -159,9 +218,7 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 		assert(b->elements.size() > 0);
 
 		Element* e = b->elements.front();
-		HashKey* key = GetHash(e->value);
-		elementDict->RemoveEntry(key);
-		delete key;
+		elementDict->RemoveEntry(e->key);
 		delete e;
 
 		b->elements.pop_front();
@@ -256,18 +313,20 @@ bool TopkVal::DoUnserialize(UnserialInfo* info)
 
 		for ( uint64_t j = 0; j < elements_count; j++ )
 			{
-			Element* e = new Element();
-			v &= UNSERIALIZE(&e->epsilon);
-			e->value = Val::Unserialize(info, type);
-			e->parent = b;
+			uint64 epsilon;
+			v &= UNSERIALIZE(&epsilon);
+			Val* value = Val::Unserialize(info, type);
 
-			b->elements.insert(b->elements.end(), e);
+			if ( ! value )
+				return false;
 
-			HashKey* key = GetHash(e->value);
+			HashKey* key = GetHash(value);
 			assert (elementDict->Lookup(key) == 0);
 
-			elementDict->Insert(key, e);
-			delete key;
+			Element* e = NewElement(value, key);
+			Unref(value);
+			e->epsilon = epsilon;
+			AddToBucket(e, b);
 
 			i++;
 			}
@@ -385,67 +444,52 @@ void TopkVal::Encountered(Val* encountered)
 	HashKey* key = GetHash(encountered);
 	Element* e = (Element*) elementDict->Lookup(key);
 
-	if ( e == 0 )
+	if ( e )
 		{
-		e = new Element();
-		e->epsilon = 0;
-		e->value = encountered->Ref(); // or no ref?
-
-		// well, we do not know this one yet...
-		if ( numElements < size )
-			{
-			// brilliant. just add it at position 1
-			if ( buckets.size() == 0 || (*buckets.begin())->count > 1 )
-				{
-				Bucket* b = new Bucket();
-				b->count = 1;
-				std::list<Bucket*>::iterator pos = buckets.insert(buckets.begin(), b);
-				b->bucketPos = pos;
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
-			else
-				{
-				Bucket* b = *buckets.begin();
-				assert(b->count == 1);
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
+		delete key;
+		IncrementCounter(e);
+		return;
+		}
 
-			elementDict->Insert(key, e);
-			numElements++;
-			delete key;
+	// well, we do not know this one yet...
+	if ( numElements < size )
+		{
+		e = NewElement(encountered, key);
 
-			return; // done. it is at pos 1.
+		// brilliant. just add it at position 1
+		if ( buckets.size() == 0 || (*buckets.begin())->count > 1 )
+			{
+			Bucket* b = new Bucket();
+			b->count = 1;
+			b->bucketPos = buckets.insert(buckets.begin(), b);
+			AddToBucket(e, b);
 			}
-
 		else
 			{
-			// replace element with min-value
-			Bucket* b = *buckets.begin(); // bucket with smallest elements
-
-			// evict oldest element with least hits.
-			assert(b->elements.size() > 0);
-			HashKey* deleteKey = GetHash((*(b->elements.begin()))->value);
-			b->elements.erase(b->elements.begin());
-			Element* deleteElement = (Element*) elementDict->RemoveEntry(deleteKey);
-			assert(deleteElement); // there has to have been a minimal element...
-			delete deleteElement;
-			delete deleteKey;
-
-			// and add the new one to the end
-			e->epsilon = b->count;
-			b->elements.insert(b->elements.end(), e);
-			elementDict->Insert(key, e);
-			e->parent = b;
-
-			// fallthrough, increment operation has to run!
+			Bucket* b = *buckets.begin();
+			assert(b->count == 1);
+			AddToBucket(e, b);
 			}
 
+		numElements++;
+		return; // done. it is at pos 1.
 		}
 
-	// ok, we now have an element in e
-	delete key;
+	// replace element with min-value
+	Bucket* b = *buckets.begin(); // bucket with smallest elements
+
+	// evict oldest element with least hits.
+	assert(b->elements.size() > 0);
+	Element* deleteElement = b->elements.front();
+	b->elements.pop_front();
+	elementDict->RemoveEntry(deleteElement->key);
+	delete deleteElement;
+
+	// and add the new one to the end
+	e = NewElement(encountered, key);
+	e->epsilon = b->count;
+	AddToBucket(e, b);
+
 	IncrementCounter(e); // well, this certainly was anticlimatic.
 	}
 
@@ -482,19 +526,10 @@ void TopkVal::IncrementCounter(Element* e, unsigned int count)
 		nextBucket = b;
 		}
 
-	// ok, now we have the new bucket in nextBucket. Shift the element over...
-	currBucket->elements.remove(e);
-	nextBucket->elements.insert(nextBucket->elements.end(), e);
-
-	e->parent = nextBucket;
-
-	// if currBucket is empty, we have to delete it now
-	if ( currBucket->elements.size() == 0 )
-		{
-		buckets.remove(currBucket);
-		delete currBucket;
-		currBucket = 0;
-		}
+	// ok, now we have the new bucket in nextBucket. Shift the element
+	// over, which deletes currBucket if it is empty now.
+	RemoveFromBucket(e);
+	AddToBucket(e, nextBucket);
 	}
 
 };
@@ -28,8 +28,13 @@ struct Bucket {
 struct Element {
 	uint64 epsilon;
 	Val* value;
+	HashKey* key; // of value, kept to avoid hashing it again
 	Bucket* parent;
 
+	// Our position in the parent's list of elements, for removing us
+	// without searching.
+	std::list<Element*>::iterator pos;
+
 	~Element();
 };
 
@@ -138,6 +143,35 @@ private:
 	 */
 	void IncrementCounter(Element* e, unsigned int count = 1);
 
+	/**
+	 * Creates a new element for a value and adds it to the dictionary.
+	 * The caller has to put it into a bucket.
+	 *
+	 * @param v value for the element
+	 *
+	 * @param key HashKey for the value, which the element takes over
+	 *
+	 * @returns the new element
+	 */
+	Element* NewElement(Val* v, HashKey* key);
+
+	/**
+	 * Appends an element to a bucket's list of elements.
+	 *
+	 * @param e element to add, which must not be in any bucket
+	 *
+	 * @param b bucket to add the element to
+	 */
+	void AddToBucket(Element* e, Bucket* b);
+
+	/**
+	 * Takes an element out of its bucket, deleting the bucket if it
+	 * becomes empty.
+	 *
+	 * @param e element to remove from its bucket
+	 */
+	void RemoveFromBucket(Element* e);
+
 	/**
 	 * get the hashkey for a specific value
 	 *
@@ -13,6 +13,20 @@ int syntax_error = 0;
 
 int clower(int sym);
 void yyerror(const char msg[]);
+
+// Bounded repetition copies what's repeated once per count; beyond this
+// many NFA states, we warn that the pattern will be slow to compile and
+// may make for a large DFA.
+static const int MAX_REPL_STATES = 1000;
+
+static void check_repl(const NFA_Machine* m, int count)
+	{
+	int64 n = int64(m->NumStates()) * count;
+
+	if ( n > MAX_REPL_STATES )
+		reporter->Warning("repetition in pattern /%s/ expands to %" PRId64 " NFA states",
+				  RE_parse_input, n);
+	}
 %}
 
 %token TOK_CHAR TOK_NUMBER TOK_CCL TOK_CCE
@@ -64,6 +78,8 @@ singleton	:  singleton '*'
 				synerr("bad iteration values");
 			else
 				{
+				check_repl($1, $5);
+
 				if ( $3 == 0 )
 					{
 					if ( $5 == 0 )
@@ -89,7 +105,10 @@ singleton	:  singleton '*'
 			else if ( $3 == 0 )
 				$1->MakeClosure();
 			else
+				{
+				check_repl($1, $3);
 				$1->MakeRepl($3, NO_UPPER_BOUND);
+				}
 			}
 
 		|  singleton '{' TOK_NUMBER '}'
@@ -102,7 +121,10 @@ singleton	:  singleton '*'
 				$$ = new NFA_Machine(new EpsilonState());
 				}
 			else
+				{
+				check_repl($1, $3);
 				$1->LinkCopies($3-1);
+				}
 			}
 
 		|  '.'
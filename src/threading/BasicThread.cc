@@ -4,7 +4,9 @@
 
 #include "bro-config.h"
 #include "BasicThread.h"
+#include "CPUAffinity.h"
 #include "Manager.h"
+#include "NetVar.h"
 
 #ifdef HAVE_LINUX
 #include <sys/prctl.h>
@@ -114,9 +116,24 @@ void BasicThread::Start()
 
 	DBG_LOG(DBG_THREADING, "Started thread %s", name);
 
+	// Set from here rather than by the thread itself, so that problems
+	// can go to the reporter.
+	const char* cpus = CPUs();
+
+	if ( pin_thread(pthread, cpus, name) )
+		{
+		pinned_cpus = cpus;
+		DBG_LOG(DBG_THREADING, "Pinned thread %s to CPUs %s", name, cpus);
+		}
+
 	OnStart();
 	}
 
+const char* BasicThread::CPUs() const
+	{
+	return BifConst::Threading::other_cpus->CheckString();
+	}
+
 void BasicThread::SignalStop()
 	{
 	if ( ! started )
@@ -176,6 +193,9 @@ void BasicThread::Done()
 
 	terminating = true;
 	killed = true;
+
+	// Gets the thread joined.
+	thread_mgr->Wakeup(0);
 	}
 
 void* BasicThread::launcher(void *arg)
@@ -5,6 +5,8 @@
 #include <pthread.h>
 #include <semaphore.h>
 
+#include <string>
+
 #include "util.h"
 
 using namespace std;
@@ -70,6 +72,14 @@ public:
 	 */
 	void Start();
 
+	/**
+	 * Returns the CPUs that the thread got pinned to when it started,
+	 * or an empty string if it wasn't.
+	 *
+	 * This method must be called only from the main thread.
+	 */
+	const std::string& PinnedCPUs() const	{ return pinned_cpus; }
+
 	/**
 	 * Signals the thread to prepare for stopping, but doesn't block to
 	 * wait for that to happen. Use WaitForStop() for that.
@@ -160,6 +170,15 @@ protected:
 	 */
 	virtual void OnWaitForStop() = 0;
 
+	/**
+	 * Returns the CPUs to pin the thread to when it starts, in the
+	 * format of \c Threading::other_cpus; if empty, the thread runs
+	 * wherever the main thread may. Derived classes override this to
+	 * pick the option for their class of threads. The default returns
+	 * \c Threading::other_cpus.
+	 */
+	virtual const char* CPUs() const;
+
 	/**
 	 * Executed with Kill(). This is a hook into killing the thread.
 	 */
@@ -200,6 +219,7 @@ private:
 	bool started; 		// Set to to true once running.
 	bool terminating;	// Set to to true to signal termination.
 	bool killed;	// Set to true once forcefully killed.
+	std::string pinned_cpus;	// Set once pinned.
 
 	// For implementing Fmt().
 	char* buf;
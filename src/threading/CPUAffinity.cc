@@ -0,0 +1,168 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+
+#include "CPUAffinity.h"
+#include "Reporter.h"
+
+using namespace threading;
+
+bool threading::parse_cpu_list(const char* list, std::vector<int>* cpus)
+	{
+	const char* p = list;
+
+	while ( *p )
+		{
+		char* end;
+		long first = strtol(p, &end, 10);
+
+		if ( end == p || first < 0 )
+			return false;
+
+		long last = first;
+		p = end;
+
+		if ( *p == '-' )
+			{
+			++p;
+			last = strtol(p, &end, 10);
+
+			if ( end == p || last < first )
+				return false;
+
+			p = end;
+			}
+
+		for ( long cpu = first; cpu <= last; ++cpu )
+			cpus->push_back(int(cpu));
+
+		if ( *p == ',' && *(p + 1) )
+			++p;
+		else if ( *p )
+			return false;
+		}
+
+	return ! cpus->empty();
+	}
+
+bool threading::pin_thread(pthread_t thread, const char* list, const char* what)
+	{
+	if ( ! *list )
+		return false;
+
+	std::vector<int> cpus;
+
+	if ( ! parse_cpu_list(list, &cpus) )
+		{
+		reporter->Error("invalid CPU list for %s: %s", what, list);
+		return false;
+		}
+
+#ifdef HAVE_LINUX
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for ( size_t i = 0; i < cpus.size(); ++i )
+		{
+		if ( cpus[i] >= CPU_SETSIZE )
+			{
+			reporter->Error("CPU %d out of range for %s", cpus[i], what);
+			return false;
+			}
+
+		CPU_SET(cpus[i], &set);
+		}
+
+	int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+
+	if ( err != 0 )
+		{
+		reporter->Warning("can't pin %s to CPUs %s: %s", what, list,
+				  strerror(err));
+		return false;
+		}
+
+	return true;
+#else
+	reporter->Warning("can't pin %s to CPUs %s: not supported on this platform",
+			  what, list);
+	return false;
+#endif
+	}
+
+int threading::current_cpu()
+	{
+#ifdef HAVE_LINUX
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+	}
+
+int threading::cpu_numa_node(int cpu)
+	{
+	if ( cpu < 0 )
+		return -1;
+
+	// Each CPU's directory has a link to its node's.
+	DIR* dir = opendir(fmt("/sys/devices/system/cpu/cpu%d", cpu));
+
+	if ( ! dir )
+		return -1;
+
+	int node = -1;
+	struct dirent* e;
+
+	while ( (e = readdir(dir)) )
+		{
+		if ( strncmp(e->d_name, "node", 4) == 0 &&
+		     sscanf(e->d_name + 4, "%d", &node) == 1 )
+			break;
+		}
+
+	closedir(dir);
+	return node;
+	}
+
+void threading::numa_memory_usage(std::map<int, uint64>* bytes)
+	{
+	// Each mapping's line lists its pages per node as "N<node>=<pages>",
+	// along with "kernelpagesize_kB=<size>".
+	FILE* f = fopen("/proc/self/numa_maps", "r");
+
+	if ( ! f )
+		return;
+
+	char line[4096];
+
+	while ( fgets(line, sizeof(line), f) )
+		{
+		std::map<int, uint64> pages;
+		uint64 page_size = 4096;
+
+		for ( char* t = strtok(line, " \n"); t; t = strtok(0, " \n") )
+			{
+			int node;
+			unsigned long long n;
+
+			if ( sscanf(t, "N%d=%llu", &node, &n) == 2 )
+				pages[node] += n;
+
+			else if ( sscanf(t, "kernelpagesize_kB=%llu", &n) == 1 )
+				page_size = n * 1024;
+			}
+
+		for ( std::map<int, uint64>::const_iterator i = pages.begin();
+		      i != pages.end(); ++i )
+			(*bytes)[i->first] += i->second * page_size;
+		}
+
+	fclose(f);
+	}
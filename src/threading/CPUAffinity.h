@@ -0,0 +1,72 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef THREADING_CPUAFFINITY_H
+#define THREADING_CPUAFFINITY_H
+
+#include <pthread.h>
+
+#include <map>
+#include <vector>
+
+#include "util.h"
+
+/**
+ * Support for pinning threads to CPUs and for finding out where on a NUMA
+ * system they run and their memory resides. All of it is Linux-only;
+ * elsewhere pinning fails with a warning and the NUMA information comes
+ * back empty.
+ *
+ * There's no separate control over where memory goes: Linux places a page
+ * on the node of the CPU that first touches it, so once a thread is pinned,
+ * the packet buffers and tables it allocates come from its local node.
+ */
+namespace threading {
+
+/**
+ * Parses a list of CPUs in the format that taskset(1) takes, such as
+ * "0-3,8,10-11".
+ *
+ * @param list The list.
+ *
+ * @param cpus Receives the CPUs' numbers.
+ *
+ * @return False if the list isn't well-formed.
+ */
+bool parse_cpu_list(const char* list, std::vector<int>* cpus);
+
+/**
+ * Restricts a thread to run only on the given CPUs. Problems go to the
+ * reporter.
+ *
+ * @param thread The thread.
+ *
+ * @param list The CPUs, in the format of parse_cpu_list(). If empty, the
+ * thread stays where it is.
+ *
+ * @param what Describes the thread for error messages.
+ *
+ * @return True if the thread got pinned.
+ */
+bool pin_thread(pthread_t thread, const char* list, const char* what);
+
+/**
+ * Returns the CPU that the calling thread is running on, or -1 if unknown.
+ */
+int current_cpu();
+
+/**
+ * Returns the NUMA node that a CPU belongs to, or -1 if unknown.
+ */
+int cpu_numa_node(int cpu);
+
+/**
+ * Determines how much of the process' resident memory is on each NUMA
+ * node.
+ *
+ * @param bytes Receives the number of bytes by node.
+ */
+void numa_memory_usage(std::map<int, uint64>* bytes);
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <sstream>
 #include <errno.h>
+#include <string.h>
 
 #include "Formatter.h"
 #include "bro_inet_ntop.h"
@@ -22,26 +23,125 @@ Formatter::~Formatter()
 	{
 	}
 
-string Formatter::Render(const threading::Value::addr_t& addr) const
+// Renders an address into a buffer of at least INET6_ADDRSTRLEN bytes.
+// Returns the length, or 0 if it didn't work.
+static int render_addr(const threading::Value::addr_t& addr, char* buf)
 	{
+	const char* s;
+
 	if ( addr.family == IPv4 )
+		s = bro_inet_ntop(AF_INET, &addr.in.in4, buf, INET6_ADDRSTRLEN);
+	else
+		s = bro_inet_ntop(AF_INET6, &addr.in.in6, buf, INET6_ADDRSTRLEN);
+
+	return s ? strlen(buf) : 0;
+	}
+
+static const char* bad_addr(const threading::Value::addr_t& addr)
+	{
+	return addr.family == IPv4 ? "<bad IPv4 address conversion>" :
+				     "<bad IPv6 address conversion>";
+	}
+
+// Renders a number in decimal into a buffer of at least 20 bytes, from the
+// back, two digits at a time. Returns the start of the digits; they end at
+// buf + 20.
+static char* render_uint(uint64 u, char* buf)
+	{
+	static const char digit_pairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	char* p = buf + 20;
+
+	while ( u >= 100 )
 		{
-		char s[INET_ADDRSTRLEN];
+		const char* d = &digit_pairs[(u % 100) * 2];
+		u /= 100;
+		*--p = d[1];
+		*--p = d[0];
+		}
 
-		if ( ! bro_inet_ntop(AF_INET, &addr.in.in4, s, INET_ADDRSTRLEN) )
-			return "<bad IPv4 address conversion>";
-		else
-			return s;
+	if ( u >= 10 )
+		{
+		const char* d = &digit_pairs[u * 2];
+		*--p = d[1];
+		*--p = d[0];
 		}
 	else
-		{
-		char s[INET6_ADDRSTRLEN];
+		*--p = '0' + u;
 
-		if ( ! bro_inet_ntop(AF_INET6, &addr.in.in6, s, INET6_ADDRSTRLEN) )
-			return "<bad IPv6 address conversion>";
-		else
-			return s;
-		}
+	return p;
+	}
+
+string Formatter::Render(const threading::Value::addr_t& addr) const
+	{
+	char s[INET6_ADDRSTRLEN];
+
+	if ( ! render_addr(addr, s) )
+		return bad_addr(addr);
+
+	return s;
+	}
+
+void Formatter::Add(ODesc* desc, const threading::Value::addr_t& addr) const
+	{
+	char s[INET6_ADDRSTRLEN];
+	int n = render_addr(addr, s);
+
+	if ( n )
+		desc->AddN(s, n);
+	else
+		desc->Add(bad_addr(addr));
+	}
+
+void Formatter::Add(ODesc* desc, const threading::Value::subnet_t& subnet) const
+	{
+	Add(desc, subnet.prefix);
+
+	uint64 len = subnet.length;
+
+	if ( subnet.prefix.family == IPv4 )
+		len -= 96;
+
+	char buf[21];	// room for the slash in front
+	char* p = render_uint(uint32(len), buf + 1);
+	*--p = '/';
+	desc->AddN(p, buf + 21 - p);
+	}
+
+void Formatter::AddFixed(ODesc* desc, double d) const
+	{
+	char buf[256];
+	modp_dtoa(d, buf, 6);
+	desc->AddN(buf, strlen(buf));
+	}
+
+void Formatter::AddInt(ODesc* desc, int64 i) const
+	{
+	char buf[21];
+	uint64 u = i < 0 ? 0 - uint64(i) : uint64(i);
+	char* p = render_uint(u, buf + 1);
+
+	if ( i < 0 )
+		*--p = '-';
+
+	desc->AddN(p, buf + 21 - p);
+	}
+
+void Formatter::AddCount(ODesc* desc, uint64 u) const
+	{
+	char buf[20];
+	char* p = render_uint(u, buf);
+	desc->AddN(p, buf + 20 - p);
 	}
 
 TransportProto Formatter::ParseProto(const string &proto) const
@@ -112,6 +112,61 @@ public:
 	 */
 	string Render(double d) const;
 
+	/**
+	 * Appends an IP address to a description, in the same form as
+	 * Render() returns it but without building a string first.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param desc The ODesc object to write to.
+	 *
+	 * @param addr The address.
+	 */
+	void Add(ODesc* desc, const threading::Value::addr_t& addr) const;
+
+	/**
+	 * Appends a subnet to a description, in the same form as Render()
+	 * returns it but without building a string first.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param desc The ODesc object to write to.
+	 *
+	 * @param subnet The subnet.
+	 */
+	void Add(ODesc* desc, const threading::Value::subnet_t& subnet) const;
+
+	/**
+	 * Appends a double to a description with Bro's standard precision,
+	 * in the same form as Render() returns it but without building a
+	 * string first.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param desc The ODesc object to write to.
+	 *
+	 * @param d The double.
+	 */
+	void AddFixed(ODesc* desc, double d) const;
+
+	/**
+	 * Appends an integer in decimal to a description. This renders the
+	 * same digits as ODesc::Add(), but two at a time and without the
+	 * detours through the C string functions.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param desc The ODesc object to write to.
+	 *
+	 * @param i The integer.
+	 */
+	void AddInt(ODesc* desc, int64 i) const;
+
+	/**
+	 * Like AddInt(), for unsigned integers.
+	 */
+	void AddCount(ODesc* desc, uint64 u) const;
+
 	/**
 	 * Convert a string into a TransportProto. The string must be one of
 	 * \c tcp, \c udp, \c icmp, or \c unknown.
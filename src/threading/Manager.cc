@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include "Manager.h"
 #include "NetVar.h"
 
@@ -8,9 +10,10 @@ Manager::Manager()
 	{
 	DBG_LOG(DBG_THREADING, "Creating thread manager ...");
 
-	did_process = true;
 	next_beat = 0;
 	terminating = false;
+	reap = false;
+	pthread_mutex_init(&wakeup_mutex, 0);
 	SetIdle(true);
 	}
 
@@ -18,6 +21,8 @@ Manager::~Manager()
 	{
 	if ( all_threads.size() )
 		Terminate();
+
+	pthread_mutex_destroy(&wakeup_mutex);
 	}
 
 void Manager::Terminate()
@@ -27,7 +32,19 @@ void Manager::Terminate()
 	terminating = true;
 
 	// First process remaining thread output for the message threads.
-	do Process(); while ( did_process );
+	bool did_process;
+
+	do
+		{
+		did_process = false;
+
+		for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
+			if ( ProcessOutput(*i) )
+				did_process = true;
+
+		ReapThreads();
+		}
+	while ( did_process );
 
 	// Signal all to stop.
 
@@ -47,6 +64,12 @@ void Manager::Terminate()
 	all_threads.clear();
 	msg_threads.clear();
 
+	pthread_mutex_lock(&wakeup_mutex);
+	woken.clear();
+	reap = false;
+	wakeup_flare.Extinguish();
+	pthread_mutex_unlock(&wakeup_mutex);
+
 	SetIdle(true);
 	SetClosed(true);
 	terminating = false;
@@ -56,7 +79,6 @@ void Manager::AddThread(BasicThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "Adding thread %s ...", thread->Name());
 	all_threads.push_back(thread);
-	SetIdle(false);
 	}
 
 void Manager::AddMsgThread(MsgThread* thread)
@@ -65,32 +87,35 @@ void Manager::AddMsgThread(MsgThread* thread)
 	msg_threads.push_back(thread);
 	}
 
+void Manager::Wakeup(MsgThread* thread)
+	{
+	pthread_mutex_lock(&wakeup_mutex);
+
+	if ( woken.empty() && ! reap )
+		wakeup_flare.Fire();
+
+	if ( thread )
+		woken.push_back(thread);
+	else
+		reap = true;
+
+	pthread_mutex_unlock(&wakeup_mutex);
+	}
+
 void Manager::GetFds(iosource::FD_Set* read, iosource::FD_Set* write,
                      iosource::FD_Set* except)
 	{
+	read->Insert(wakeup_flare.FD());
 	}
 
 double Manager::NextTimestamp(double* network_time)
 	{
-//	fprintf(stderr, "N %.6f %.6f did_process=%d next_next=%.6f\n", ::network_time, timer_mgr->Time(), (int)did_process, next_beat);
+	pthread_mutex_lock(&wakeup_mutex);
+	bool pending = reap || ! woken.empty();
+	pthread_mutex_unlock(&wakeup_mutex);
 
-	if ( ::network_time && (did_process || ::network_time > next_beat || ! next_beat) )
-		// If we had something to process last time (or out heartbeat
-		// is due or not set yet), we want to check for more asap.
-		return timer_mgr->Time();
-
-	for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
-		{
-		MsgThread* t = *i;
-
-		if ( t->MightHaveOut() || t->Killed() )
-			// Even if the thread doesn't have output, it may be killed/done,
-			// which should also signify that processing is needed.  The
-			// "processing" in that case is joining the thread and deleting it.
-			return timer_mgr->Time();
-		}
-
-	return -1.0;
+	// As long as there's no network time, the output waits.
+	return pending ? timer_mgr->Time() : -1.0;
 	}
 
 void Manager::KillThreads()
@@ -99,54 +124,71 @@ void Manager::KillThreads()
 
 	for ( all_thread_list::iterator i = all_threads.begin(); i != all_threads.end(); i++ )
 		(*i)->Kill();
-        }
+
+	Wakeup(0);
+	}
 
 void Manager::KillThread(BasicThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "Killing thread %s ...", thread->Name());
 	thread->Kill();
+	Wakeup(0);
+	}
+
+void Manager::SendHeartbeats(double t)
+	{
+	next_beat = t + BifConst::Threading::heartbeat_interval;
+
+	for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
+		(*i)->Heartbeat();
 	}
 
 void Manager::Process()
 	{
-	bool do_beat = false;
+	std::vector<MsgThread*> threads;
+	bool do_reap;
 
-	if ( network_time && (network_time > next_beat || ! next_beat) )
-		{
-		do_beat = true;
-		next_beat = ::network_time + BifConst::Threading::heartbeat_interval;
-		}
+	pthread_mutex_lock(&wakeup_mutex);
+	threads.swap(woken);
+	do_reap = reap;
+	reap = false;
+	wakeup_flare.Extinguish();
+	pthread_mutex_unlock(&wakeup_mutex);
 
-	did_process = false;
+	for ( std::vector<MsgThread*>::iterator i = threads.begin(); i != threads.end(); i++ )
+		ProcessOutput(*i);
 
-	for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
-		{
-		MsgThread* t = *i;
+	if ( do_reap )
+		ReapThreads();
+	}
 
-		if ( do_beat )
-			t->Heartbeat();
+bool Manager::ProcessOutput(MsgThread* t)
+	{
+	// Output that arrives from here on needs to wake us up again.
+	t->wakeup_pending = false;
+
+	bool did_process = false;
+
+	while ( t->HasOut() )
+		{
+		Message* msg = t->RetrieveOut();
+		assert(msg);
 
-		while ( t->HasOut() )
+		if ( ! msg->Process() )
 			{
-			Message* msg = t->RetrieveOut();
-			assert(msg);
-
-			if ( msg->Process() )
-				{
-				if ( network_time )
-					did_process = true;
-				}
-
-			else
-				{
-				reporter->Error("%s failed, terminating thread", msg->Name());
-				t->SignalStop();
-				}
-
-			delete msg;
+			reporter->Error("%s failed, terminating thread", msg->Name());
+			t->SignalStop();
 			}
+
+		delete msg;
+		did_process = true;
 		}
 
+	return did_process;
+	}
+
+void Manager::ReapThreads()
+	{
 	all_thread_list to_delete;
 
 	for ( all_thread_list::iterator i = all_threads.begin(); i != all_threads.end(); i++ )
@@ -169,10 +211,31 @@ void Manager::Process()
 			msg_threads.remove(mt);
 
 		t->Join();
+
+		if ( mt )
+			{
+			// It may have signaled output since the last Process().
+			pthread_mutex_lock(&wakeup_mutex);
+			woken.erase(std::remove(woken.begin(), woken.end(), mt),
+				    woken.end());
+			pthread_mutex_unlock(&wakeup_mutex);
+			}
+
 		delete t;
 		}
+	}
+
+threading::Manager::cpu_list threading::Manager::GetThreadCPUs() const
+	{
+	cpu_list cpus;
+
+	for ( all_thread_list::const_iterator i = all_threads.begin(); i != all_threads.end(); i++ )
+		{
+		if ( ! (*i)->PinnedCPUs().empty() )
+			cpus.push_back(std::make_pair((*i)->Name(), (*i)->PinnedCPUs()));
+		}
 
-//	fprintf(stderr, "P %.6f %.6f do_beat=%d did_process=%d next_next=%.6f\n", network_time, timer_mgr->Time(), do_beat, (int)did_process, next_beat);
+	return cpus;
 	}
 
 const threading::Manager::msg_stats_list& threading::Manager::GetMsgThreadStats()
@@ -2,9 +2,12 @@
 #ifndef THREADING_MANAGER_H
 #define THREADING_MANAGER_H
 
+#include <pthread.h>
 #include <list>
+#include <vector>
 
 #include "iosource/IOSource.h"
+#include "Flare.h"
 
 #include "BasicThread.h"
 #include "MsgThread.h"
@@ -17,9 +20,11 @@ namespace threading {
  * once it has terminated.
  *
  * In addition to basic threads, the manager also provides additional
- * functionality specific to MsgThread instances. In particular, it polls
- * their outgoing message queue on a regular basis and feeds data sent into
- * the rest of Bro. It also triggers the regular heartbeats.
+ * functionality specific to MsgThread instances. In particular, it feeds
+ * the data they send into the rest of Bro, and it triggers the regular
+ * heartbeats. Rather than polling all the threads, the manager stays idle
+ * until one of them signals output by lighting a flare, and then services
+ * just those that did.
  */
 class Manager : public iosource::IOSource
 {
@@ -68,6 +73,16 @@ public:
 	 */
 	int NumThreads() const { return all_threads.size(); }
 
+	typedef std::list<std::pair<string, string> > cpu_list;
+
+	/**
+	 * Returns the CPUs that threads got pinned to when they started.
+	 *
+	 * @return A list with one entry for each pinned thread, consisting
+	 * of the thread's name and its CPUs.
+	 */
+	cpu_list GetThreadCPUs() const;
+
 	/**
 	 * Signals a specific threads to terminate immediately.
 	 */
@@ -78,6 +93,19 @@ public:
 	 */
 	void KillThreads();
 
+	/**
+	 * Sends all message threads a heartbeat if one is due, which is
+	 * once per Threading::heartbeat_interval of network time. The main
+	 * loop calls this each round.
+	 *
+	 * @param t The current network time.
+	 */
+	void CheckHeartbeat(double t)
+		{
+		if ( t && (t > next_beat || ! next_beat) )
+			SendHeartbeats(t);
+		}
+
 protected:
 	friend class BasicThread;
 	friend class MsgThread;
@@ -100,6 +128,17 @@ protected:
 	 */
 	void AddMsgThread(MsgThread* thread);
 
+	/**
+	 * Tells the manager that a message thread has output waiting, so
+	 * that the main loop gets to it. Unlike the other methods, the child
+	 * threads call this, once for each time that the manager retrieves
+	 * their output.
+	 *
+	 * @param thread The thread, or null if a thread terminated and
+	 * needs joining.
+	 */
+	void Wakeup(MsgThread* thread);
+
 	/**
 	 * Part of the IOSource interface.
 	 */
@@ -128,10 +167,22 @@ private:
 	typedef std::list<MsgThread*> msg_thread_list;
 	msg_thread_list msg_threads;
 
-	bool did_process;	// True if the last Process() found some work to do.
+	void SendHeartbeats(double t);
+
+	// Feeds a thread's output into Bro. Returns true if there was any.
+	bool ProcessOutput(MsgThread* t);
+
+	// Joins and deletes the threads that terminated.
+	void ReapThreads();
+
 	double next_beat;	// Timestamp when the next heartbeat will be sent.
 	bool terminating;	// True if we are in Terminate().
 
+	bro::Flare wakeup_flare;	// lit while there are wakeups pending
+	pthread_mutex_t wakeup_mutex;	// protects woken and reap
+	std::vector<MsgThread*> woken;	// threads with output
+	bool reap;	// true if threads may need joining
+
 	msg_stats_list stats;
 };
 
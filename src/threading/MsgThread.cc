@@ -166,6 +166,7 @@ bool ReporterMessage::Process()
 MsgThread::MsgThread() : BasicThread(), queue_in(this, 0), queue_out(0, this)
 	{
 	cnt_sent_in = cnt_sent_out = 0;
+	wakeup_pending = false;
 	main_finished = false;
 	child_finished = false;
 	failed = false;
@@ -331,6 +332,9 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 	queue_out.Put(msg);
 
 	++cnt_sent_out;
+
+	if ( ! wakeup_pending.exchange(true) )
+		thread_mgr->Wakeup(this);
 	}
 
 BasicOutputMessage* MsgThread::RetrieveOut()
@@ -3,11 +3,12 @@
 #define THREADING_MSGTHREAD_H
 
 #include <pthread.h>
+#include <atomic>
 
 #include "DebugLogger.h"
 
 #include "BasicThread.h"
-#include "Queue.h"
+#include "RingQueue.h"
 
 namespace threading {
 
@@ -166,8 +167,8 @@ public:
 		uint64_t pending_out;	//! Number of messages sent from the child but not yet processed by the main thread.
 
 		/// Statistics from our queues.
-		Queue<BasicInputMessage *>::Stats  queue_in_stats;
-		Queue<BasicOutputMessage *>::Stats queue_out_stats;
+		RingQueue<BasicInputMessage *>::Stats  queue_in_stats;
+		RingQueue<BasicOutputMessage *>::Stats queue_out_stats;
 		};
 
 	/**
@@ -300,12 +301,16 @@ private:
 	 */
 	void Finished();
 
-	Queue<BasicInputMessage *> queue_in;
-	Queue<BasicOutputMessage *> queue_out;
+	RingQueue<BasicInputMessage *> queue_in;
+	RingQueue<BasicOutputMessage *> queue_out;
 
 	uint64_t cnt_sent_in;	// Counts message sent to child.
 	uint64_t cnt_sent_out;	// Counts message sent by child.
 
+	// True while the manager has been told about output it hasn't
+	// retrieved yet, so that the child tells it just once.
+	std::atomic<bool> wakeup_pending;
+
 	bool main_finished;	// Main thread is finished, meaning child_finished propagated back through message queue.
 	bool child_finished;	// Child thread is finished.
 	bool failed;	// Set to true when a command failed.
@@ -0,0 +1,385 @@
+#ifndef THREADING_RINGQUEUE_H
+#define THREADING_RINGQUEUE_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+
+#include "Reporter.h"
+#include "BasicThread.h"
+#include "Queue.h"
+
+namespace threading {
+
+/**
+ * A bounded single-reader single-writer queue that doesn't take any locks
+ * as long as neither side needs to wait for the other.
+ *
+ * Elements are kept in a ring buffer, with each side owning one of the
+ * two indices. If the ring is empty, the reader first spins and then
+ * yields for a little while before it goes to sleep on a condition
+ * variable. If the ring is full, the writer spins for a bit as well; if
+ * there's still no room then, it stalls: the element goes into a locked
+ * overflow list instead, which the reader drains before switching back to
+ * the ring. We don't block the writer, as the main thread and a child
+ * could then end up waiting for each other.
+ *
+ * The interface is the same as Queue's. All RingQueue instances must be
+ * instantiated by Bro's main thread.
+ */
+template<typename T>
+class RingQueue
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * reader, writer: The corresponding threads. This is for checking
+	 * whether they have terminated so that we can abort I/O opeations.
+	 * Can be left null for the main thread.
+	 *
+	 * capacity: The number of elements the ring can hold, rounded up
+	 * to a power of two.
+	 */
+	RingQueue(BasicThread* arg_reader, BasicThread* arg_writer,
+		  uint64_t capacity = DEFAULT_CAPACITY);
+
+	/**
+	 * Destructor.
+	 */
+	~RingQueue();
+
+	/**
+	 * Retrieves one element. This may block for a little while of no
+	 * input is available and eventually return with a null element if
+	 * nothing shows up.
+	 */
+	T Get();
+
+	/**
+	 * Queues one element.
+	 */
+	void Put(T data);
+
+	/**
+	 * Returns true if the next Get() operation will succeed.
+	 */
+	bool Ready();
+
+	/**
+	 * Returns true if the next Get() operation might succeed. Same as
+	 * Queue::MaybeReady(), this is cheap but may occasionally not reflect
+	 * the actual state.
+	 */
+	bool MaybeReady()
+		{ return num_reads.load(std::memory_order_relaxed) !=
+		         num_writes.load(std::memory_order_relaxed); }
+
+	/** Wake up the reader if it's currently blocked for input. This is
+	 primarily to give it a chance to check termination quickly.
+	**/
+	void WakeUp();
+
+	/**
+	 * Returns the number of queued items not yet retrieved.
+	 */
+	uint64_t Size();
+
+	/**
+	 * Statistics about inter-thread communication.
+	 */
+	struct Stats
+		{
+		uint64_t num_reads;	//! Number of messages read from the queue.
+		uint64_t num_writes;	//! Number of messages written to the queue.
+		uint64_t num_stalls;	//! Number of times the writer found the ring full.
+		uint64_t max_size;	//! Largest number of messages queued at once.
+		uint64_t capacity;	//! Number of messages the ring can hold.
+		};
+
+	/**
+	 * Returns statistics about the queue's usage.
+	 *
+	 * @param stats A pointer to a structure that will be filled with
+	 * current numbers. */
+	void GetStats(Stats* stats);
+
+private:
+	static const uint64_t DEFAULT_CAPACITY = 4096;
+	static const int SPIN_ROUNDS = 1000;	// Busy loops before yielding.
+	static const int YIELD_ROUNDS = 10;	// Yields before sleeping.
+
+	// Reader side: pops from the ring, or the overflow list if we've
+	// stalled. Must not be called with the mutex held.
+	bool TryGet(T* data);
+
+	// Reader side: pops from the ring only.
+	bool TryPop(T* data);
+
+	// Writer side: pushes into the ring if there's room.
+	bool TryPut(T data);
+
+	bool RingEmpty() const
+		{ return read_idx.load(std::memory_order_relaxed) ==
+		         write_idx.load(std::memory_order_acquire); }
+
+	static void Relax()
+		{
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+		}
+
+	T* ring;
+	uint64_t mask;
+
+	BasicThread* reader;
+	BasicThread* writer;
+
+	// The indices are placed on their own cache lines so that reader and
+	// writer don't keep invalidating each other's.
+	char pad0[64];
+	std::atomic<uint64_t> write_idx;	// Next slot to write; writer only.
+	char pad1[64];
+	std::atomic<uint64_t> read_idx;	// Next slot to read; reader only.
+	char pad2[64];
+
+	// Set while the overflow list has elements. The writer doesn't touch
+	// the ring as long as this is set.
+	std::atomic<bool> stalled;
+	std::atomic<bool> sleeping;	// Reader waits on has_data.
+
+	pthread_mutex_t mutex;	// Protects overflow and has_data.
+	pthread_cond_t has_data;	// Signals when data becomes available.
+	std::deque<T> overflow;
+
+	// Statistics.
+	std::atomic<uint64_t> num_reads;
+	std::atomic<uint64_t> num_writes;
+	std::atomic<uint64_t> num_stalls;
+	std::atomic<uint64_t> max_size;
+};
+
+template<typename T>
+inline RingQueue<T>::RingQueue(BasicThread* arg_reader, BasicThread* arg_writer,
+			       uint64_t capacity)
+	{
+	reader = arg_reader;
+	writer = arg_writer;
+
+	uint64_t size = 1;
+
+	while ( size < capacity )
+		size <<= 1;
+
+	ring = new T[size];
+	mask = size - 1;
+
+	write_idx = read_idx = 0;
+	stalled = sleeping = false;
+	num_reads = num_writes = num_stalls = max_size = 0;
+
+	if ( pthread_cond_init(&has_data, 0) != 0 )
+		reporter->FatalError("cannot init queue condition variable");
+
+	if ( pthread_mutex_init(&mutex, 0) != 0 )
+		reporter->FatalError("cannot init queue mutex");
+	}
+
+template<typename T>
+inline RingQueue<T>::~RingQueue()
+	{
+	pthread_cond_destroy(&has_data);
+	pthread_mutex_destroy(&mutex);
+	delete [] ring;
+	}
+
+template<typename T>
+inline bool RingQueue<T>::TryPut(T data)
+	{
+	uint64_t w = write_idx.load(std::memory_order_relaxed);
+
+	if ( w - read_idx.load(std::memory_order_acquire) > mask )
+		return false;
+
+	ring[w & mask] = data;
+	write_idx.store(w + 1, std::memory_order_release);
+	return true;
+	}
+
+template<typename T>
+inline bool RingQueue<T>::TryPop(T* data)
+	{
+	uint64_t r = read_idx.load(std::memory_order_relaxed);
+
+	if ( r == write_idx.load(std::memory_order_acquire) )
+		return false;
+
+	*data = ring[r & mask];
+	read_idx.store(r + 1, std::memory_order_release);
+	num_reads.fetch_add(1, std::memory_order_relaxed);
+	return true;
+	}
+
+template<typename T>
+inline bool RingQueue<T>::TryGet(T* data)
+	{
+	if ( TryPop(data) )
+		return true;
+
+	if ( ! stalled.load(std::memory_order_acquire) )
+		return false;
+
+	safe_lock(&mutex);
+
+	// The writer may have filled the ring up again before it stalled;
+	// those elements come first.
+	bool ok = TryPop(data);
+
+	if ( ! ok && ! overflow.empty() )
+		{
+		*data = overflow.front();
+		overflow.pop_front();
+
+		if ( overflow.empty() )
+			stalled.store(false, std::memory_order_release);
+
+		num_reads.fetch_add(1, std::memory_order_relaxed);
+		ok = true;
+		}
+
+	safe_unlock(&mutex);
+	return ok;
+	}
+
+template<typename T>
+inline T RingQueue<T>::Get()
+	{
+	T data;
+
+	for ( int i = 0; i < SPIN_ROUNDS; ++i )
+		{
+		if ( TryGet(&data) )
+			return data;
+
+		Relax();
+		}
+
+	for ( int i = 0; i < YIELD_ROUNDS; ++i )
+		{
+		sched_yield();
+
+		if ( TryGet(&data) )
+			return data;
+		}
+
+	if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
+		return 0;
+
+	safe_lock(&mutex);
+
+	// Pairs with the fence in Put(): either the writer sees us sleeping,
+	// or we see its element.
+	sleeping.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( RingEmpty() && ! stalled.load(std::memory_order_relaxed) )
+		{
+		struct timespec ts;
+		ts.tv_sec = time(0) + 5;
+		ts.tv_nsec = 0;
+
+		pthread_cond_timedwait(&has_data, &mutex, &ts);
+		}
+
+	sleeping.store(false, std::memory_order_relaxed);
+	safe_unlock(&mutex);
+
+	return TryGet(&data) ? data : 0;
+	}
+
+template<typename T>
+inline void RingQueue<T>::Put(T data)
+	{
+	// Count first so that Size() never goes negative.
+	uint64_t n = num_writes.fetch_add(1, std::memory_order_relaxed) + 1;
+	bool done = false;
+
+	if ( ! stalled.load(std::memory_order_acquire) )
+		{
+		done = TryPut(data);
+
+		if ( ! done )
+			{
+			num_stalls.fetch_add(1, std::memory_order_relaxed);
+
+			for ( int i = 0; i < SPIN_ROUNDS && ! done; ++i )
+				{
+				Relax();
+				done = TryPut(data);
+				}
+			}
+		}
+
+	if ( ! done )
+		{
+		safe_lock(&mutex);
+		overflow.push_back(data);
+		stalled.store(true, std::memory_order_release);
+		safe_unlock(&mutex);
+		}
+
+	uint64_t size = n - num_reads.load(std::memory_order_relaxed);
+
+	if ( size > max_size.load(std::memory_order_relaxed) )
+		max_size.store(size, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( sleeping.load(std::memory_order_relaxed) )
+		{
+		safe_lock(&mutex);
+		pthread_cond_signal(&has_data);
+		safe_unlock(&mutex);
+		}
+	}
+
+template<typename T>
+inline bool RingQueue<T>::Ready()
+	{
+	return ! RingEmpty() || stalled.load(std::memory_order_acquire);
+	}
+
+template<typename T>
+inline uint64_t RingQueue<T>::Size()
+	{
+	// Reads first, so that we can't see more reads than writes.
+	uint64_t reads = num_reads.load(std::memory_order_acquire);
+	uint64_t writes = num_writes.load(std::memory_order_acquire);
+	return writes - reads;
+	}
+
+template<typename T>
+inline void RingQueue<T>::GetStats(Stats* stats)
+	{
+	stats->num_reads = num_reads.load(std::memory_order_relaxed);
+	stats->num_writes = num_writes.load(std::memory_order_relaxed);
+	stats->num_stalls = num_stalls.load(std::memory_order_relaxed);
+	stats->max_size = max_size.load(std::memory_order_relaxed);
+	stats->capacity = mask + 1;
+	}
+
+template<typename T>
+inline void RingQueue<T>::WakeUp()
+	{
+	safe_lock(&mutex);
+	pthread_cond_signal(&has_data);
+	safe_unlock(&mutex);
+	}
+
+}
+
+#endif
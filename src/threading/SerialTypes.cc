@@ -1,5 +1,8 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <atomic>
+#include <cstddef>
+#include <new>
 
 #include "SerialTypes.h"
 #include "../RemoteSerializer.h"
@@ -87,6 +90,10 @@ string Field::TypeName() const
 
 Value::~Value()
 	{
+	if ( packed )
+		// The block holding the row owns everything.
+		return;
+
 	if ( (type == TYPE_ENUM || type == TYPE_STRING || type == TYPE_FILE || type == TYPE_FUNC)
 	     && present )
 		delete [] val.string_val.data;
@@ -108,6 +115,105 @@ Value::~Value()
 		}
 	}
 
+// Packed rows are preceded by their reference count and size, padded to
+// keep the row aligned for any type.
+struct PackedRowHeader {
+	std::atomic<int> refs;
+	size_t size;
+
+	PackedRowHeader(size_t arg_size) : refs(1), size(arg_size)	{ }
+};
+
+static const size_t packed_row_header = 16;
+
+static_assert(sizeof(PackedRowHeader) <= packed_row_header &&
+	      packed_row_header % alignof(std::max_align_t) == 0,
+	      "packed row header breaks alignment");
+
+static PackedRowHeader* packed_row_header_of(Value** vals)
+	{
+	char* block = reinterpret_cast<char*>(vals) - packed_row_header;
+	return reinterpret_cast<PackedRowHeader*>(block);
+	}
+
+Value** Value::AllocateRow(size_t size)
+	{
+	char* block = new char[packed_row_header + size];
+	new (block) PackedRowHeader(packed_row_header + size);
+	return reinterpret_cast<Value**>(block + packed_row_header);
+	}
+
+void Value::RefRow(Value** vals)
+	{
+	packed_row_header_of(vals)->refs.fetch_add(1);
+	}
+
+void Value::DeleteRow(int num_fields, Value** vals)
+	{
+	if ( num_fields > 0 && vals[0]->packed )
+		{
+		PackedRowHeader* header = packed_row_header_of(vals);
+
+		if ( header->refs.fetch_sub(1) == 1 )
+			{
+			header->~PackedRowHeader();
+			delete [] reinterpret_cast<char*>(header);
+			}
+
+		return;
+		}
+
+	for ( int i = 0; i < num_fields; i++ )
+		delete vals[i];
+
+	delete [] vals;
+	}
+
+size_t Value::RowSize(int num_fields, Value** vals)
+	{
+	if ( num_fields > 0 && vals[0]->packed )
+		return packed_row_header_of(vals)->size;
+
+	size_t size = num_fields * sizeof(Value*);
+
+	for ( int i = 0; i < num_fields; i++ )
+		size += ValueSize(vals[i]);
+
+	return size;
+	}
+
+size_t Value::ValueSize(const Value* val)
+	{
+	size_t size = sizeof(Value);
+
+	if ( ! val->present )
+		return size;
+
+	switch ( val->type ) {
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		size += val->val.string_val.length;
+		break;
+
+	case TYPE_TABLE:
+		for ( int i = 0; i < val->val.set_val.size; i++ )
+			size += sizeof(Value*) + ValueSize(val->val.set_val.vals[i]);
+		break;
+
+	case TYPE_VECTOR:
+		for ( int i = 0; i < val->val.vector_val.size; i++ )
+			size += sizeof(Value*) + ValueSize(val->val.vector_val.vals[i]);
+		break;
+
+	default:
+		break;
+	}
+
+	return size;
+	}
+
 bool Value::IsCompatibleType(BroType* t, bool atomic_only)
 	{
 	if ( ! t )
@@ -93,6 +93,7 @@ private:
 struct Value {
 	TypeTag type;	//! The type of the value.
 	bool present;	//! False for optional record fields that are not set.
+	bool packed;	//! True if part of a row allocated in one block.
 
 	struct set_t { bro_int_t size; Value** vals; };
 	typedef set_t vec_t;
@@ -139,7 +140,7 @@ struct Value {
 	* that is not set.
 	 */
 	Value(TypeTag arg_type = TYPE_ERROR, bool arg_present = true)
-		: type(arg_type), present(arg_present)	{}
+		: type(arg_type), present(arg_present), packed(false)	{}
 
 	/**
 	 * Destructor.
@@ -171,7 +172,58 @@ struct Value {
 	 * method is thread-safe. */
 	static bool IsCompatibleType(BroType* t, bool atomic_only=false);
 
+	/**
+	 * Allocates a block for packing a row of values into, i.e., an
+	 * array of them as passed to log writers, followed by whatever
+	 * else the caller places there. The values put into the block must
+	 * be marked as \a packed. The block is reference counted, starting
+	 * with one reference. This method is thread-safe.
+	 *
+	 * @param size The size of the block, including the array.
+	 *
+	 * @return The start of the block, aligned for any type, where the
+	 * array goes.
+	 */
+	static Value** AllocateRow(size_t size);
+
+	/**
+	 * Adds a reference to a row packed into a block allocated with
+	 * AllocateRow(), so that it can be passed on to more than one
+	 * writer. Each reference gets released with DeleteRow(). This
+	 * method is thread-safe.
+	 *
+	 * @param vals The row.
+	 */
+	static void RefRow(Value** vals);
+
+	/**
+	 * Deletes a row of values, i.e., an array of them as passed to log
+	 * writers. The row may either have been allocated value by value,
+	 * or have been packed into a block by AllocateRow(), with all its
+	 * values marked as \a packed; that releases one reference to the
+	 * block. This method is thread-safe.
+	 *
+	 * @param num_fields The number of values in the row.
+	 *
+	 * @param vals The row.
+	 */
+	static void DeleteRow(int num_fields, Value** vals);
+
+	/**
+	 * Returns the memory a row of values takes up. For rows packed
+	 * into a block that's the block's size, otherwise an estimate.
+	 * This method is thread-safe.
+	 *
+	 * @param num_fields The number of values in the row.
+	 *
+	 * @param vals The row.
+	 */
+	static size_t RowSize(int num_fields, Value** vals);
+
 private:
+	// Returns the memory an unpacked value takes up.
+	static size_t ValueSize(const Value* val);
+
 	friend class ::IPAddr;
 	Value(const Value& other)	{ } // Disabled.
 };
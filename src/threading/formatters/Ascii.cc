@@ -83,24 +83,24 @@ bool Ascii::Describe(ODesc* desc, threading::Value* val, const string& name) con
 		break;
 
 	case TYPE_INT:
-		desc->Add(val->val.int_val);
+		AddInt(desc, val->val.int_val);
 		break;
 
 	case TYPE_COUNT:
 	case TYPE_COUNTER:
-		desc->Add(val->val.uint_val);
+		AddCount(desc, val->val.uint_val);
 		break;
 
 	case TYPE_PORT:
-		desc->Add(val->val.port_val.port);
+		AddCount(desc, val->val.port_val.port);
 		break;
 
 	case TYPE_SUBNET:
-		desc->Add(Render(val->val.subnet_val));
+		Add(desc, val->val.subnet_val);
 		break;
 
 	case TYPE_ADDR:
-		desc->Add(Render(val->val.addr_val));
+		Add(desc, val->val.addr_val);
 		break;
 
 	case TYPE_DOUBLE:
@@ -112,10 +112,10 @@ bool Ascii::Describe(ODesc* desc, threading::Value* val, const string& name) con
 
 	case TYPE_INTERVAL:
 	case TYPE_TIME:
-		// Rendering via Render() keeps trailing 0s after the decimal
+		// Rendering via AddFixed() keeps trailing 0s after the decimal
 		// point. The difference with DOUBLE is mainly to keep the
 		// log format consistent.
-		desc->Add(Render(val->val.double_val));
+		AddFixed(desc, val->val.double_val);
 		break;
 
 	case TYPE_ENUM:
@@ -18,6 +18,7 @@ using namespace threading::formatter;
 JSON::JSON(MsgThread* t, TimeFormat tf) : Formatter(t), surrounding_braces(true)
 	{
 	timestamps = tf;
+	key_fields = 0;
 	}
 
 JSON::~JSON()
@@ -27,11 +28,17 @@ JSON::~JSON()
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
                     Value** vals) const
 	{
+	if ( key_fields != fields || int(keys.size()) != num_fields )
+		PrepareKeys(num_fields, fields);
+
 	if ( surrounding_braces )
-		desc->AddRaw("{");
+		desc->AddRaw("{", 1);
 
 	for ( int i = 0; i < num_fields; i++ )
 		{
+		if ( ! vals[i]->present )
+			continue;
+
 		const u_char* bytes = desc->Bytes();
 		int len = desc->Len();
 
@@ -39,20 +46,42 @@ bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
 		     len > 0 &&
 		     bytes[len-1] != ',' &&
 		     bytes[len-1] != '{' &&
-		     bytes[len-1] != '[' &&
-		     vals[i]->present )
-			desc->AddRaw(",");
+		     bytes[len-1] != '[' )
+			desc->AddRaw(",", 1);
+
+		const string& key = keys[i];
 
-		if ( ! Describe(desc, vals[i], fields[i]->name) )
+		if ( key.size() )
+			desc->AddRaw(key.data(), key.size());
+
+		if ( ! DescribeValue(desc, vals[i]) )
 			return false;
 		}
 
 	if ( surrounding_braces )
-		desc->AddRaw("}");
+		desc->AddRaw("}", 1);
 
 	return true;
 	}
 
+void JSON::PrepareKeys(int num_fields, const Field* const * fields) const
+	{
+	keys.clear();
+	keys.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		const char* name = fields[i]->name;
+
+		if ( name && *name )
+			keys.push_back(string("\"") + name + "\":");
+		else
+			keys.push_back("");
+		}
+
+	key_fields = fields;
+	}
+
 bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 	{
 	if ( ! val->present )
@@ -65,6 +94,41 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 		desc->AddRaw("\":", 2);
 		}
 
+	return DescribeValue(desc, val);
+	}
+
+void JSON::AddEscaped(ODesc* desc, const char* s, int len)
+	{
+	int start = 0;
+
+	for ( int i = 0; i < len; ++i )
+		{
+		unsigned char c = s[i];
+
+		if ( c >= 32 && c <= 126 && c != '"' && c != '\'' &&
+		     c != '\\' && c != '&' )
+			continue;
+
+		if ( i > start )
+			desc->AddRaw(s + start, i - start);
+
+		// 2byte Unicode escape special characters.
+		char esc[6] = { '\\', 'u', '0', '0', '0', '0' };
+		bytetohex(c, esc + 4);
+		desc->AddRaw(esc, sizeof(esc));
+
+		start = i + 1;
+		}
+
+	if ( len > start )
+		desc->AddRaw(s + start, len - start);
+	}
+
+bool JSON::DescribeValue(ODesc* desc, Value* val) const
+	{
+	if ( ! val->present )
+		return true;
+
 	switch ( val->type )
 		{
 		case TYPE_BOOL:
@@ -72,7 +136,7 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 			break;
 
 		case TYPE_INT:
-			desc->Add(val->val.int_val);
+			AddInt(desc, val->val.int_val);
 			break;
 
 		case TYPE_COUNT:
@@ -85,23 +149,23 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 				desc->AddRaw("null", 4);
 				}
 			else
-				desc->Add(val->val.uint_val);
+				AddCount(desc, val->val.uint_val);
 			break;
 			}
 
 		case TYPE_PORT:
-			desc->Add(val->val.port_val.port);
+			AddCount(desc, val->val.port_val.port);
 			break;
 
 		case TYPE_SUBNET:
 			desc->AddRaw("\"", 1);
-			desc->Add(Render(val->val.subnet_val));
+			Add(desc, val->val.subnet_val);
 			desc->AddRaw("\"", 1);
 			break;
 
 		case TYPE_ADDR:
 			desc->AddRaw("\"", 1);
-			desc->Add(Render(val->val.addr_val));
+			Add(desc, val->val.addr_val);
 			desc->AddRaw("\"", 1);
 			break;
 
@@ -166,24 +230,7 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 		case TYPE_FUNC:
 			{
 			desc->AddRaw("\"", 1);
-
-			for ( int i = 0; i < val->val.string_val.length; ++i )
-				{
-				char c = val->val.string_val.data[i];
-
-				// 2byte Unicode escape special characters.
-				if ( c < 32 || c > 126 || c == '\n' || c == '"' || c == '\'' || c == '\\' || c == '&' )
-					{
-					desc->AddRaw("\\u00", 4);
-					char hex[2] = {'0', '0'};
-					bytetohex(c, hex);
-					desc->AddRaw(hex, 1);
-					desc->AddRaw(hex + 1, 1);
-					}
-				else
-					desc->AddRaw(&c, 1);
-				}
-
+			AddEscaped(desc, val->val.string_val.data, val->val.string_val.length);
 			desc->AddRaw("\"", 1);
 			break;
 			}
@@ -197,7 +244,7 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 				if ( j > 0 )
 					desc->AddRaw(",", 1);
 
-				Describe(desc, val->val.set_val.vals[j]);
+				DescribeValue(desc, val->val.set_val.vals[j]);
 				}
 
 			desc->AddRaw("]", 1);
@@ -212,7 +259,7 @@ bool JSON::Describe(ODesc* desc, Value* val, const string& name) const
 				{
 				if ( j > 0 )
 					desc->AddRaw(",", 1);
-				Describe(desc, val->val.vector_val.vals[j]);
+				DescribeValue(desc, val->val.vector_val.vals[j]);
 				}
 
 			desc->AddRaw("]", 1);
@@ -3,6 +3,9 @@
 #ifndef THREADING_FORMATTERS_JSON_H
 #define THREADING_FORMATTERS_JSON_H
 
+#include <string>
+#include <vector>
+
 #include "../Formatter.h"
 
 namespace threading { namespace formatter {
@@ -30,8 +33,22 @@ public:
 	void SurroundingBraces(bool use_braces);
 
 private:
+	// Renders a value without its key.
+	bool DescribeValue(ODesc* desc, threading::Value* val) const;
+
+	// Adds a string's characters, escaping them as necessary. Runs of
+	// characters that don't need escaping go in with a single copy.
+	static void AddEscaped(ODesc* desc, const char* s, int len);
+
+	// Renders the keys ("name":) for a set of fields. Writers pass the
+	// same fields with every write, so this happens only once for them.
+	void PrepareKeys(int num_fields, const threading::Field* const * fields) const;
+
 	TimeFormat timestamps;
 	bool surrounding_braces;
+
+	mutable const threading::Field* const * key_fields;
+	mutable std::vector<std::string> keys;
 };
 
 }}
@@ -488,10 +488,29 @@ int strstr_n(const int big_len, const u_char* big,
 	if ( little_len > big_len )
 		return -1;
 
-	for ( int i = 0; i <= big_len - little_len; ++i )
+	if ( little_len <= 0 )
+		return 0;
+
+	// Let memchr(), which libcs vectorize, skip ahead to the candidates
+	// for the first byte, and check the last one before comparing the
+	// rest.
+	const u_char first = little[0];
+	const u_char last = little[little_len - 1];
+	const u_char* p = big;
+	const u_char* end = big + big_len - little_len + 1;
+
+	while ( p < end )
 		{
-		if ( ! memcmp(big + i, little, little_len) )
-			return i;
+		p = (const u_char*) memchr(p, first, end - p);
+
+		if ( ! p )
+			return -1;
+
+		if ( p[little_len - 1] == last &&
+		     ! memcmp(p + 1, little + 1, little_len - 1) )
+			return p - big;
+
+		++p;
 		}
 
 	return -1;
@@ -377,6 +377,11 @@ void _set_processing_status(const char* status);
 // gettimeofday().
 extern double network_time;
 
+// The same in nanoseconds since the epoch. If network time comes from a
+// packet, this is the packet's exact timestamp, which a double can't hold
+// to the nanosecond.
+extern int64 network_time_ns;
+
 // Returns the current time.
 // (In pseudo-realtime mode this is faked to be the start time of the
 // trace plus the time interval Bro has been running. To avoid this,